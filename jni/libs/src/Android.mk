@@ -115,16 +115,24 @@ LOCAL_C_INCLUDES := \
 LOCAL_SRC_FILES := \
   src/admob.cpp \
   src/analytics.cpp \
+  src/asset_loader.cpp \
+  src/audio_thread.cpp \
+  src/benchmark.cpp \
   src/camera.cpp \
+  src/component_scheduler.cpp \
   src/components/attributes.cpp \
   src/components/audio_listener.cpp \
+  src/components/entity_pool.cpp \
+  src/components/export_builder.cpp \
   src/components/lap_dependent.cpp \
   src/components/light.cpp \
+  src/components/particles.cpp \
   src/components/patron.cpp \
   src/components/player.cpp \
   src/components/player_projectile.cpp \
   src/components/rail_denizen.cpp \
   src/components/rail_node.cpp \
+  src/components/remote_entity.cpp \
   src/components/render_3d_text.cpp \
   src/components/river.cpp \
   src/components/scenery.cpp \
@@ -133,17 +141,35 @@ LOCAL_SRC_FILES := \
   src/components/simple_movement.cpp \
   src/components/sound.cpp \
   src/components/time_limit.cpp \
+  src/debug_draw_batch.cpp \
   src/default_entity_factory.cpp \
   src/default_graph_factory.cpp \
+  src/dynamic_resolution.cpp \
+  src/entity_bvh.cpp \
+  src/fixed_timestep.cpp \
+  src/frame_pacer.cpp \
   src/full_screen_fader.cpp \
   src/game.cpp \
+  src/gl_uploader.cpp \
   src/gpg_manager.cpp \
+  src/gpu_timer.cpp \
+  src/graph_event_queue.cpp \
   src/gui.cpp \
+  src/impostor_renderer.cpp \
+  src/init_phases.cpp \
   src/inputcontrollers/android_cardboard_controller.cpp \
   src/inputcontrollers/gamepad_controller.cpp \
+  src/inputcontrollers/input_recording.cpp \
   src/inputcontrollers/onscreen_controller.cpp \
+  src/inputcontrollers/scripted_controller.cpp \
+  src/inputcontrollers/tap_event_queue.cpp \
   src/invites.cpp \
+  src/job_system.cpp \
   src/main.cpp \
+  src/mapped_file.cpp \
+  src/memory_tracker.cpp \
+  src/menu_cache.cpp \
+  src/microbenchmark.cpp \
   src/messaging.cpp \
   src/modules/attributes.cpp \
   src/modules/gpg.cpp \
@@ -153,8 +179,27 @@ LOCAL_SRC_FILES := \
   src/modules/state.cpp \
   src/modules/ui_string.cpp \
   src/modules/zooshi.cpp \
+  src/overlay_index.cpp \
+  src/profiler.cpp \
+  src/projectile_grid.cpp \
+  src/projectile_snapshot.cpp \
+  src/prop_instancer.cpp \
+  src/prototype_cache.cpp \
+  src/quality_governor.cpp \
+  src/rail_visibility.cpp \
   src/railmanager.cpp \
   src/remote_config.cpp \
+  src/render_culler.cpp \
+  src/render_queue.cpp \
+  src/residency_cache.cpp \
+  src/resume_snapshot.cpp \
+  src/river_mesh_builder.cpp \
+  src/save_store.cpp \
+  src/services_thread.cpp \
+  src/shader_cache.cpp \
+  src/shader_uniforms.cpp \
+  src/sprite_batch.cpp \
+  src/state_sync.cpp \
   src/states/game_menu_state.cpp \
   src/states/game_over_state.cpp \
   src/states/gameplay_state.cpp \
@@ -163,7 +208,10 @@ LOCAL_SRC_FILES := \
   src/states/pause_state.cpp \
   src/states/states_common.cpp \
   src/states/scene_lab_state.cpp \
+  src/tangent_space.cpp \
+  src/trusted_assets.cpp \
   src/unlockable_manager.cpp \
+  src/update_lod.cpp \
   src/world.cpp \
   src/world_renderer.cpp \
   src/xp_system.cpp
@@ -179,8 +227,10 @@ ZOOSHI_SCHEMA_FILES := \
   $(ZOOSHI_SCHEMA_DIR)/gpg.fbs \
   $(ZOOSHI_SCHEMA_DIR)/input_config.fbs \
   $(ZOOSHI_SCHEMA_DIR)/rail_def.fbs \
+  $(ZOOSHI_SCHEMA_DIR)/resume_data.fbs \
   $(ZOOSHI_SCHEMA_DIR)/save_data.fbs \
-  $(ZOOSHI_SCHEMA_DIR)/unlockables.fbs
+  $(ZOOSHI_SCHEMA_DIR)/unlockables.fbs \
+  $(ZOOSHI_SCHEMA_DIR)/visibility.fbs
 
 # Make each source file order-only dependent upon the assets (via the pipe |)
 # This guarantees build_assets will run first, but not force all src files to
@@ -25,9 +25,18 @@ generated files, you can call this script with the argument 'clean'.
 """
 
 import sys
+import bisect
+import fnmatch
 import glob
+import hashlib
+import itertools
+import multiprocessing
 import os
 import json
+import math
+import re
+import struct
+import subprocess
 
 # The project root directory, which is two levels up from this script's
 # directory.
@@ -44,6 +53,7 @@ sys.path.append(os.path.join(PROJECT_ROOT, os.path.pardir, 'scene_lab',
 sys.path.append(os.path.join(PROJECT_ROOT, os.path.pardir, 'py'))
 
 import distutils.dir_util
+import distutils.spawn
 import scene_lab_asset_builder as builder
 
 # ============================================================================
@@ -87,19 +97,181 @@ INTERMEDIATE_ASSETS_PATH = os.path.join(PROJECT_ROOT, 'obj', 'assets')
 # Directory where png files are written to before they are converted to webp.
 INTERMEDIATE_TEXTURE_PATH = os.path.join(INTERMEDIATE_ASSETS_PATH, 'textures')
 
+# Directory where rail json files are written after their splines are baked.
+INTERMEDIATE_RAIL_PATH = os.path.join(INTERMEDIATE_ASSETS_PATH, 'rails')
+
+# Content hashes of the inputs each generated file was last built from. Files
+# are rebuilt when the hash of their inputs changes, rather than when an input
+# is newer, so touching or checking out a file doesn't rebuild it.
+BUILD_HASHES_FILE = os.path.join(INTERMEDIATE_ASSETS_PATH, 'build_hashes.json')
+
+# Level entity files that are regrouped for loading by group_level_entities().
+# Written to the intermediate directory under the same names.
+GROUPED_LEVEL_FILES = ['lvl_*_patrons.json', 'lvl_*_props.json']
+
+# Levels whose entity files are split into sectors along the raft's rail by
+# split_level_sectors(), so the game only loads the sectors near the raft.
+# Sector n holds the entities nearest the rail between n and n + 1 times
+# `sector_length` along it, and is written to <level>_sector_<n>.json, which
+# the level's `sectors` in config.json must list. Entities whose prototype is
+# in `resident_prototypes`, or that have no position, are written to
+# <level>_resident.json instead, to be loaded with the level.
+SECTORED_LEVELS = [
+    {'level': 'lvl_endless',
+     'rail_file': 'lvl_endless_rail.json',
+     'rail_name': 'player_path',
+     'entity_files': ['lvl_endless_patrons.json', 'lvl_endless_props.json'],
+     'sector_length': 50.0,
+     # Feeding it starts the raft, so it can't wait to be streamed in.
+     'resident_prototypes': ['PatronHungryHippo_First']},
+]
+
+# Levels whose static entities bake_level_visibility() sorts by the stretches
+# of the raft's rail they can be seen from, so the game can skip the rest.
+# Segment n covers from n to n + 1 times `segment_length` along the rail, and
+# is sampled every `sample_spacing`, widened by `segment_margin` at each end
+# since the game measures along the rail's spline rather than between its
+# nodes. Written to <level>_visibility.json, the level's `visibility_file` in
+# config.json. Entities without an entity_id or a position aren't covered.
+#
+# The camera is taken to be `eye_height` up, seeing `view_distance` around
+# it, which should be past the rendering config's cull_distance. Entities
+# reach `entity_size` times their largest scale up and out from their
+# position. The river's outer banks rise to at least `bank_height` somewhere
+# between the `bank_band` distances from the rail, for every zone's width,
+# so what's past them and below the line of sight over that height is
+# hidden.
+VISIBILITY_LEVELS = [
+    {'level': 'lvl_endless',
+     'rail_file': 'lvl_endless_rail.json',
+     'rail_name': 'player_path',
+     'entity_files': ['lvl_endless_props.json'],
+     'segment_length': 25.0,
+     'segment_margin': 5.0,
+     'sample_spacing': 2.5,
+     'eye_height': 4.0,
+     'view_distance': 55.0,
+     'entity_size': 3.0,
+     'bank_band': [13.5, 23.5],
+     'bank_height': 3.5},
+    {'level': 'lvl_easy',
+     'rail_file': 'lvl_easy_rail.json',
+     'rail_name': 'player_path',
+     'entity_files': ['lvl_easy_props.json'],
+     'segment_length': 25.0,
+     'segment_margin': 5.0,
+     'sample_spacing': 2.5,
+     'eye_height': 4.0,
+     'view_distance': 55.0,
+     'entity_size': 3.0,
+     'bank_band': [19.0, 26.5],
+     'bank_height': 4.5},
+]
+
+# Distance between the points where lines of sight are tested against the
+# banks.
+VISIBILITY_RAY_STEP = 0.5
+
+# How much to lengthen each dimension's range when quantizing a rail's spline.
+# Must match kRangeSafeBoundsPercent in railmanager.cpp.
+RAIL_RANGE_SAFE_BOUNDS_PERCENT = 1.1
+
+# Materials whose textures are also compressed for the GPU, as glob patterns.
+# UI textures are also loaded by name from code, so they stay webp only.
+COMPRESSED_MATERIALS = ['ground_material.json', 'lake_daytime.json',
+                        'riverbank_*.json']
+
+# GPU texture formats to compress textures to. Each compressed material gets a
+# copy under the format's directory, referring to the compressed textures.
+# The directories must match texture_formats in assets.json.
+COMPRESSED_TEXTURE_FORMATS = [
+    {
+        'name': 'etc2',
+        'directory': os.path.join('compressed', 'etc2'),
+        'extension': 'ktx',
+        # etc2comp's compressor. Builds the whole mip chain into the KTX.
+        'tool': 'EtcTool',
+        'args': ['-format', 'RGBA8', '-effort', '60', '-mipmaps', '16',
+                 '-output'],
+    },
+]
+
+# Size of the post-transform vertex cache that mesh indices are ordered for.
+# Most mobile GPUs cache at least this many vertices.
+VERTEX_CACHE_SIZE = 32
+
 # Directories for animations.
 RAW_ANIM_PATH = os.path.join(RAW_ASSETS_PATH, 'anims')
 
+# Tolerances that animation clips are fitted to by compress_anims(), for
+# clips matching each glob pattern, which are looser than anim_pipeline's
+# defaults. The pipeline already drops channels that don't change and stores
+# quantized keys, so fewer keys is what's left to save. Clips that are only
+# seen briefly, or from afar, can afford the most error. Each tolerance is
+# the most a fitted curve may stray from the clip: `translate` in distance
+# units, `rotate` and `angle` (of the curve's slope) in degrees, and `scale`
+# as a factor.
+ANIM_COMPRESSION = [
+    {'pattern': '*_appear.fbx',
+     'translate': 0.02, 'rotate': 1.0, 'scale': 0.01, 'angle': 2.0},
+    {'pattern': '*_disappear.fbx',
+     'translate': 0.02, 'rotate': 1.0, 'scale': 0.01, 'angle': 2.0},
+    {'pattern': '*_happy.fbx',
+     'translate': 0.01, 'rotate': 0.5, 'scale': 0.005, 'angle': 1.0},
+    {'pattern': '*_eat.fbx',
+     'translate': 0.01, 'rotate': 0.5, 'scale': 0.005, 'angle': 1.0},
+]
+
+# How anim_meta entries in ASSET_META are passed to anim_pipeline. Must match
+# the asset builder, since compress_anims() converts clips again.
+ANIM_META_ARGS = {
+    'repeat': lambda value: ['--repeat' if value else '--norepeat'],
+    'unit': lambda value: ['--unit', value],
+    'rootbone': lambda value: ['--root_bone'] if value else [],
+}
+
 # Directory inside the assets directory where flatbuffer schemas are copied.
 SCHEMA_OUTPUT_PATH = 'flatbufferschemas'
 
 # Potential root directories for source assets.
-ASSET_ROOTS = [RAW_ASSETS_PATH, INTERMEDIATE_TEXTURE_PATH]
+ASSET_ROOTS = [RAW_ASSETS_PATH, INTERMEDIATE_ASSETS_PATH,
+               INTERMEDIATE_TEXTURE_PATH]
 # Overlay directories.
 OVERLAY_DIRS = [os.path.relpath(f, RAW_ASSETS_PATH)
                 for f in glob.glob(os.path.join(RAW_ASSETS_PATH, 'overlays',
                                                 '*'))]
 
+# Written to each built overlay directory, listing the files in it, so the
+# game can find overlay files without probing for them. Must match
+# kOverlayIndexFile in src/overlay_index.cpp.
+OVERLAY_INDEX_FILE = 'overlay_files.txt'
+
+# Rendering options the game's settings can turn on and off, by the shader
+# define each controls. Must match kDefinesText in src/world_renderer.cpp.
+SHADER_OPTION_DEFINES = ['PHONG_SHADING', 'SPECULAR_EFFECT', 'SHADOW_EFFECT']
+
+# Lists each combination of SHADER_OPTION_DEFINES, one per line, for the game
+# to build its shaders with while loading. Must match kShaderVariantsFile in
+# src/world_renderer.cpp.
+SHADER_VARIANTS_FILE = 'shader_variants.txt'
+
+# Passing this argument also writes TRUSTED_ASSETS_FILE, listing the
+# flatbuffer binaries built from json with their hashes. flatc only writes
+# binaries that match their schemas, so the game trusts the listed files in
+# its own assets, and skips verifying them when they're loaded. Must match
+# kTrustedAssetsFile in src/trusted_assets.cpp.
+TRUSTED_BUNDLE_ARG = 'trusted_bundle'
+TRUSTED_ASSETS_FILE = 'trusted_assets.txt'
+
+# Passing this argument also packs each built overlay into a single
+# overlays/<name>.zoopack archive, in the format read by src/overlay_index.cpp.
+PACK_OVERLAYS_ARG = 'pack_overlays'
+OVERLAY_PACK_EXTENSION = '.zoopack'
+OVERLAY_PACK_MAGIC = b'ZPAK'
+OVERLAY_PACK_VERSION = 1
+# Files in a pack start on this boundary, so flatbuffers in it are aligned.
+OVERLAY_PACK_ALIGNMENT = 8
+
 # ============================================================================
 # The following constants reference data in external components.
 # ============================================================================
@@ -122,11 +294,17 @@ FLATBUFFERS_CONVERSION_DATA = [
                      os.path.join(RAW_ASSETS_PATH, 'entity_list.json'),
                      os.path.join(RAW_ASSETS_PATH, 'entity_rails.json'),
                     ] +
-                    glob.glob(os.path.join(RAW_ASSETS_PATH, 'lvl_*.json'))),
+                    [f for f in glob.glob(os.path.join(RAW_ASSETS_PATH,
+                                                       'lvl_*.json'))
+                     if not any(fnmatch.fnmatch(os.path.basename(f), p)
+                                for p in GROUPED_LEVEL_FILES)]),
     builder.FlatbuffersConversionData(
         schema=PROJECT_SCHEMA_PATH.join('rail_def.fbs'),
         extension='rail',
-        input_files=glob.glob(os.path.join(RAW_RAIL_PATH, '*.json'))),
+        input_files=[os.path.join(INTERMEDIATE_RAIL_PATH,
+                                  os.path.basename(f))
+                     for f in glob.glob(os.path.join(RAW_RAIL_PATH,
+                                                     '*.json'))]),
     builder.FlatbuffersConversionData(
         schema=builder.PINDROP_ROOT.join('schemas', 'audio_config.fbs'),
         extension='pinconfig',
@@ -180,6 +358,728 @@ FLATBUFFERS_CONVERSION_DATA = [
         extension='', input_files=[]),
 ]
 
+def bake_rail(rail):
+  """Fits a constant speed spline through a rail's positions.
+
+  This is a port of motive's CalculateConstSpeedCurveFromPositions, which
+  Rail::InitializeFromPositions calls for rails that aren't baked, so the two
+  must produce the same nodes. Debug builds check that they do when a baked
+  rail is loaded.
+
+  The time of each node is proportional to its distance along the rail. The
+  derivative at each node points from the position `reliable_distance` before
+  it to the position `reliable_distance` after it, clamped to the ends of the
+  rail, and has the length of the rail's constant speed. Like motive, this
+  doesn't wrap around the ends of rails that wrap.
+
+  Args:
+    rail: Dictionary holding a RailDef in json form.
+
+  Returns:
+    A dictionary holding a BakedRail in json form, or None if the rail can't
+    be baked.
+  """
+  positions = [[p.get('x', 0.0), p.get('y', 0.0), p.get('z', 0.0)]
+               for p in rail.get('positions', [])]
+  total_time = rail.get('total_time', 0.0)
+  reliable_distance = rail.get('reliable_distance', 0.0)
+  if len(positions) < 2 or total_time <= 0.0:
+    return None
+
+  distances = [0.0]
+  for prev, cur in zip(positions, positions[1:]):
+    distances.append(distances[-1] + math.sqrt(
+        sum((c - p) ** 2 for p, c in zip(prev, cur))))
+  total_distance = distances[-1]
+  if total_distance <= 0.0:
+    return None
+  times = [d / total_distance * total_time for d in distances]
+  speed = total_distance / total_time
+
+  def position_at(distance):
+    """Returns the position `distance` along the rail, clamped to its ends."""
+    distance = min(max(distance, 0.0), total_distance)
+    i = max(bisect.bisect_right(distances, distance) - 1, 0)
+    if i >= len(positions) - 1:
+      return positions[-1]
+    length = distances[i + 1] - distances[i]
+    t = (distance - distances[i]) / length if length > 0.0 else 0.0
+    return [a + (b - a) * t for a, b in zip(positions[i], positions[i + 1])]
+
+  derivatives = []
+  for i, distance in enumerate(distances):
+    if reliable_distance > 0.0:
+      before = position_at(distance - reliable_distance)
+      after = position_at(distance + reliable_distance)
+    else:
+      before = positions[max(i - 1, 0)]
+      after = positions[min(i + 1, len(positions) - 1)]
+    direction = [b - a for a, b in zip(before, after)]
+    length = math.sqrt(sum(d * d for d in direction))
+    derivatives.append([d / length * speed if length > 0.0 else 0.0
+                        for d in direction])
+
+  range_min = []
+  range_max = []
+  for dimension in range(3):
+    values = [p[dimension] for p in positions]
+    center = (min(values) + max(values)) / 2.0
+    half_length = ((max(values) - min(values)) / 2.0 *
+                   RAIL_RANGE_SAFE_BOUNDS_PERCENT)
+    range_min.append(center - half_length)
+    range_max.append(center + half_length)
+
+  def vec3(v):
+    return {'x': v[0], 'y': v[1], 'z': v[2]}
+
+  return {
+      'nodes': [{'time': t, 'position': vec3(p), 'derivative': vec3(d)}
+                for t, p, d in zip(times, positions, derivatives)],
+      'range_min': vec3(range_min),
+      'range_max': vec3(range_max),
+  }
+
+
+def bake_rails():
+  """Writes each rail json file, with its spline baked, to the intermediate
+  rail directory, where it's picked up by the flatbuffer conversion."""
+  if not os.path.exists(INTERMEDIATE_RAIL_PATH):
+    os.makedirs(INTERMEDIATE_RAIL_PATH)
+  for input_file in glob.glob(os.path.join(RAW_RAIL_PATH, '*.json')):
+    output_file = os.path.join(INTERMEDIATE_RAIL_PATH,
+                               os.path.basename(input_file))
+    if not BUILD_HASHES.needs_rebuild(output_file, [input_file]):
+      continue
+    with open(input_file) as f:
+      rail = json.load(f)
+    baked = bake_rail(rail)
+    if baked:
+      rail['baked'] = baked
+    with open(output_file, 'w') as f:
+      json.dump(rail, f, indent=2, sort_keys=True)
+    BUILD_HASHES.record(output_file, [input_file])
+
+
+def group_entities_by_prototype(entity_list):
+  """Reorders entities so those with the same prototype are adjacent.
+
+  Entities with the same prototype get the same components from it, so
+  creating them one after another fills each component's data in runs rather
+  than jumping between components for every entity. Groups are in the order
+  their prototype first appears, and entities keep their order within a group,
+  so the first entity in the file is still created first.
+
+  Args:
+    entity_list: List of EntityDefs in json form.
+
+  Returns:
+    The reordered list.
+  """
+  def prototype(entity):
+    for component in entity.get('component_list', []):
+      if component.get('data_type') == 'corgi_MetaDef':
+        return component.get('data', {}).get('prototype', '')
+    return ''
+
+  groups = {}
+  order = []
+  for entity in entity_list:
+    name = prototype(entity)
+    if name not in groups:
+      groups[name] = []
+      order.append(name)
+    groups[name].append(entity)
+  return [entity for name in order for entity in groups[name]]
+
+
+def group_level_entities():
+  """Writes each of GROUPED_LEVEL_FILES, with its entities grouped by
+  prototype, to the intermediate directory, where it's picked up by the
+  flatbuffer conversion. Files split by split_level_sectors() are skipped.
+
+  Returns:
+    List of the level json files written or already up to date.
+  """
+  if not os.path.exists(INTERMEDIATE_ASSETS_PATH):
+    os.makedirs(INTERMEDIATE_ASSETS_PATH)
+  sectored = set(f for level in SECTORED_LEVELS
+                 for f in level['entity_files'])
+  written = []
+  for pattern in GROUPED_LEVEL_FILES:
+    for input_file in glob.glob(os.path.join(RAW_ASSETS_PATH, pattern)):
+      if os.path.basename(input_file) in sectored:
+        continue
+      output_file = os.path.join(INTERMEDIATE_ASSETS_PATH,
+                                 os.path.basename(input_file))
+      written.append(output_file)
+      if not BUILD_HASHES.needs_rebuild(output_file, [input_file]):
+        continue
+      with open(input_file) as f:
+        level = json.load(f)
+      level['entity_list'] = group_entities_by_prototype(
+          level.get('entity_list', []))
+      with open(output_file, 'w') as f:
+        json.dump(level, f, indent=2, sort_keys=True)
+      BUILD_HASHES.record(output_file, [input_file])
+  return written
+
+
+def entity_component(entity, data_type):
+  """The data of an entity's component of type `data_type`, or None."""
+  for component in entity.get('component_list', []):
+    if component.get('data_type') == data_type:
+      return component.get('data', {})
+  return None
+
+
+def rail_node_positions(entity_list, rail_name):
+  """Positions of the RailNodes of the rail named `rail_name`, in order.
+
+  Args:
+    entity_list: List of EntityDefs in json form.
+    rail_name: The rail_name of the nodes to return.
+
+  Returns:
+    List of [x, y] positions, with the first repeated at the end if the rail
+    wraps.
+  """
+  nodes = []
+  for entity in entity_list:
+    node = entity_component(entity, 'RailNodeDef')
+    transform = entity_component(entity, 'corgi_TransformDef')
+    if node is None or transform is None:
+      continue
+    if node.get('rail_name') != rail_name:
+      continue
+    position = transform.get('position', {})
+    nodes.append((node.get('ordering', 0), node,
+                  [position.get('x', 0.0), position.get('y', 0.0)]))
+  nodes.sort(key=lambda n: n[0])
+  positions = [p for _, _, p in nodes]
+  # Like the game, the first node says whether the rail wraps.
+  if nodes and nodes[0][1].get('wraps', True):
+    positions.append(positions[0])
+  return positions
+
+
+def rail_length(positions):
+  """Length of the straight lines through `positions`."""
+  return sum(((b[0] - a[0]) ** 2 + (b[1] - a[1]) ** 2) ** 0.5
+             for a, b in zip(positions, positions[1:]))
+
+
+def rail_distance(positions, point):
+  """How far along the rail through `positions` the point nearest `point` is.
+
+  Distances are along the straight lines between the nodes, which is close
+  to what the game measures along the curve through them.
+  """
+  best = (float('inf'), 0.0)
+  start = 0.0
+  for a, b in zip(positions, positions[1:]):
+    ab = [b[0] - a[0], b[1] - a[1]]
+    length_sq = ab[0] ** 2 + ab[1] ** 2
+    t = 0.0
+    if length_sq > 0.0:
+      t = ((point[0] - a[0]) * ab[0] + (point[1] - a[1]) * ab[1]) / length_sq
+      t = min(max(t, 0.0), 1.0)
+    nearest = [a[0] + ab[0] * t, a[1] + ab[1] * t]
+    dist_sq = (point[0] - nearest[0]) ** 2 + (point[1] - nearest[1]) ** 2
+    length = length_sq ** 0.5
+    if dist_sq < best[0]:
+      best = (dist_sq, start + length * t)
+    start += length
+  return best[1]
+
+
+def split_level_sectors():
+  """Writes the entities of each of SECTORED_LEVELS, split into sectors along
+  its rail, to the intermediate directory, where they're picked up by the
+  flatbuffer conversion.
+
+  Returns:
+    List of the sector json files written or already up to date.
+  """
+  if not os.path.exists(INTERMEDIATE_ASSETS_PATH):
+    os.makedirs(INTERMEDIATE_ASSETS_PATH)
+  written = []
+  for level in SECTORED_LEVELS:
+    input_files = [os.path.join(RAW_ASSETS_PATH, f)
+                   for f in [level['rail_file']] + level['entity_files']]
+    with open(input_files[0]) as f:
+      positions = rail_node_positions(json.load(f).get('entity_list', []),
+                                      level['rail_name'])
+    sector_length = level['sector_length']
+    num_sectors = max(
+        int(math.ceil(rail_length(positions) / sector_length)), 1)
+
+    def output_path(suffix):
+      return os.path.join(INTERMEDIATE_ASSETS_PATH,
+                          '%s_%s.json' % (level['level'], suffix))
+    output_files = ([output_path('resident')] +
+                    [output_path('sector_%d' % i) for i in range(num_sectors)])
+    written.extend(output_files)
+    if not any(BUILD_HASHES.needs_rebuild(f, input_files)
+               for f in output_files):
+      continue
+
+    lists = [[] for _ in output_files]
+    for input_file in input_files[1:]:
+      with open(input_file) as f:
+        entity_list = json.load(f).get('entity_list', [])
+      for entity in entity_list:
+        meta = entity_component(entity, 'corgi_MetaDef') or {}
+        transform = entity_component(entity, 'corgi_TransformDef')
+        if (meta.get('prototype') in level['resident_prototypes'] or
+            transform is None or len(positions) < 2):
+          lists[0].append(entity)
+          continue
+        position = transform.get('position', {})
+        distance = rail_distance(
+            positions, [position.get('x', 0.0), position.get('y', 0.0)])
+        sector = min(int(distance / sector_length), num_sectors - 1)
+        lists[sector + 1].append(entity)
+
+    for output_file, entity_list in zip(output_files, lists):
+      with open(output_file, 'w') as f:
+        json.dump({'entity_list': group_entities_by_prototype(entity_list)},
+                  f, indent=2, sort_keys=True)
+      BUILD_HASHES.record(output_file, input_files)
+  return written
+
+
+def rail_point(positions, distance):
+  """The point `distance` along the straight lines through `positions`."""
+  for a, b in zip(positions, positions[1:]):
+    length = ((b[0] - a[0]) ** 2 + (b[1] - a[1]) ** 2) ** 0.5
+    if distance <= length and length > 0.0:
+      t = distance / length
+      return [a[0] + (b[0] - a[0]) * t, a[1] + (b[1] - a[1]) * t]
+    distance -= length
+  return list(positions[-1])
+
+
+def distance_to_line(point, a, b):
+  """Distance from `point` to the line segment from `a` to `b`."""
+  ab = [b[0] - a[0], b[1] - a[1]]
+  length_sq = ab[0] ** 2 + ab[1] ** 2
+  t = 0.0
+  if length_sq > 0.0:
+    t = ((point[0] - a[0]) * ab[0] + (point[1] - a[1]) * ab[1]) / length_sq
+    t = min(max(t, 0.0), 1.0)
+  return ((point[0] - a[0] - ab[0] * t) ** 2 +
+          (point[1] - a[1] - ab[1] * t) ** 2) ** 0.5
+
+
+def rail_lines_near(positions, point, distance):
+  """The lines between `positions` that come within `distance` of `point`."""
+  return [(a, b) for a, b in zip(positions, positions[1:])
+          if distance_to_line(point, a, b) <= distance]
+
+
+def distance_from_lines(point, lines, default):
+  """How far `point` is from the nearest of `lines`, or `default`."""
+  return min([distance_to_line(point, a, b) for a, b in lines] + [default])
+
+
+def visible_from(level, eye, lines, entity):
+  """Whether `entity` can be seen from `eye`, given the `lines` of the rail
+  near it.
+
+  Args:
+    level: One of VISIBILITY_LEVELS.
+    eye: [x, y] position of the camera.
+    lines: The lines of the rail within the view distance and bank band of
+      `eye`, from rail_lines_near().
+    entity: (position, size) of the entity, as [x, y, z] and how far it
+      reaches.
+
+  Returns:
+    False if the entity is too far away, or behind the banks.
+  """
+  position, size = entity
+  to_entity = [position[0] - eye[0], position[1] - eye[1]]
+  distance = (to_entity[0] ** 2 + to_entity[1] ** 2) ** 0.5
+  if distance - size > level['view_distance']:
+    return False
+  inner, outer = level['bank_band']
+  far = outer + level['view_distance']
+  if (distance <= size or
+      distance_from_lines(position, lines, far) - size <= outer):
+    return True
+
+  # Look at the near edge of the entity's top. Where the line of sight is
+  # over the band, it passes the top of the banks somewhere, and the entity
+  # is hidden if it's always below them there.
+  target = [position[0] - to_entity[0] * size / distance,
+            position[1] - to_entity[1] * size / distance]
+  eye_height = level['eye_height']
+  top = position[2] + size
+  steps = max(int(math.ceil(distance / VISIBILITY_RAY_STEP)), 1)
+  crossed = False
+  for i in range(steps + 1):
+    t = float(i) / steps
+    point = [eye[0] + (target[0] - eye[0]) * t,
+             eye[1] + (target[1] - eye[1]) * t]
+    lateral = distance_from_lines(point, lines, far)
+    if inner <= lateral <= outer:
+      crossed = True
+      if eye_height + (top - eye_height) * t >= level['bank_height']:
+        return True
+  return not crossed
+
+
+def bake_level_visibility():
+  """Writes which static entities of each of VISIBILITY_LEVELS can be seen
+  from each segment of its rail to the intermediate directory, where it's
+  picked up by the flatbuffer conversion.
+
+  Returns:
+    List of the visibility json files written or already up to date.
+  """
+  if not os.path.exists(INTERMEDIATE_ASSETS_PATH):
+    os.makedirs(INTERMEDIATE_ASSETS_PATH)
+  written = []
+  for level in VISIBILITY_LEVELS:
+    input_files = [os.path.join(RAW_ASSETS_PATH, f)
+                   for f in [level['rail_file']] + level['entity_files']]
+    output_file = os.path.join(INTERMEDIATE_ASSETS_PATH,
+                               '%s_visibility.json' % level['level'])
+    written.append(output_file)
+    if not BUILD_HASHES.needs_rebuild(output_file, input_files):
+      continue
+
+    with open(input_files[0]) as f:
+      positions = rail_node_positions(json.load(f).get('entity_list', []),
+                                      level['rail_name'])
+    entity_ids = []
+    entities = []
+    for input_file in input_files[1:]:
+      with open(input_file) as f:
+        entity_list = json.load(f).get('entity_list', [])
+      for entity in entity_list:
+        meta = entity_component(entity, 'corgi_MetaDef') or {}
+        transform = entity_component(entity, 'corgi_TransformDef')
+        if not meta.get('entity_id') or transform is None:
+          continue
+        position = transform.get('position', {})
+        scale = transform.get('scale', {})
+        entity_ids.append(meta['entity_id'])
+        entities.append((
+            [position.get(axis, 0.0) for axis in 'xyz'],
+            level['entity_size'] * max(abs(scale.get(axis, 1.0))
+                                       for axis in 'xyz')))
+
+    length = rail_length(positions)
+    segment_length = level['segment_length']
+    num_segments = max(int(math.ceil(length / segment_length)), 1)
+    segments = []
+    for segment in range(num_segments if len(positions) >= 2 else 0):
+      start = max(segment * segment_length - level['segment_margin'], 0.0)
+      end = min((segment + 1) * segment_length + level['segment_margin'],
+                length)
+      samples = max(int(math.ceil((end - start) / level['sample_spacing'])), 1)
+      visible = set()
+      for i in range(samples + 1):
+        eye = rail_point(positions, start + (end - start) * i / samples)
+        lines = rail_lines_near(
+            positions, eye, level['view_distance'] + level['bank_band'][1])
+        visible.update(
+            index for index, entity in enumerate(entities)
+            if index not in visible and
+            visible_from(level, eye, lines, entity))
+      segments.append({'visible': sorted(visible)})
+
+    with open(output_file, 'w') as f:
+      json.dump({'entity_ids': entity_ids,
+                 'segment_length': segment_length,
+                 'segments': segments}, f, indent=2, sort_keys=True)
+    BUILD_HASHES.record(output_file, input_files)
+  return written
+
+
+def content_hash(input_file):
+  """Hash of a file's contents."""
+  digest = hashlib.sha1()
+  with open(input_file, 'rb') as f:
+    digest.update(f.read())
+  return digest.hexdigest()
+
+
+class BuildHashes(object):
+  """Content hashes of the inputs each generated file was built from.
+
+  A file's hash covers the contents of all of its inputs and of this script,
+  so a file is rebuilt when any of them changes, such as a schema included by
+  the schema a json file is converted with.
+  """
+
+  def __init__(self, path):
+    self.path = path
+    self.file_hashes = {}
+    try:
+      with open(path) as f:
+        self.hashes = json.load(f)
+    except (IOError, ValueError):
+      self.hashes = {}
+
+  def file_hash(self, input_file):
+    """Hash of a file's contents. Each file is only read once per build."""
+    if input_file not in self.file_hashes:
+      self.file_hashes[input_file] = content_hash(input_file)
+    return self.file_hashes[input_file]
+
+  def inputs_hash(self, input_files):
+    """Hash of the contents of input_files and this script."""
+    digest = hashlib.sha1()
+    for input_file in [__file__] + sorted(input_files):
+      digest.update(self.file_hash(input_file).encode('utf-8'))
+    return digest.hexdigest()
+
+  def needs_rebuild(self, output_file, input_files):
+    """Returns True if output_file is missing, or its inputs have changed
+    since it was recorded."""
+    return (not os.path.exists(output_file) or
+            self.hashes.get(output_file) != self.inputs_hash(input_files))
+
+  def record(self, output_file, input_files):
+    """Records that output_file was built from input_files."""
+    self.hashes[output_file] = self.inputs_hash(input_files)
+
+  def forget(self, output_file):
+    """Makes output_file be rebuilt next time, e.g. if building it failed."""
+    self.hashes.pop(output_file, None)
+
+  def save(self):
+    if not os.path.exists(os.path.dirname(self.path)):
+      os.makedirs(os.path.dirname(self.path))
+    with open(self.path, 'w') as f:
+      json.dump(self.hashes, f, indent=2, sort_keys=True)
+
+
+BUILD_HASHES = BuildHashes(BUILD_HASHES_FILE)
+
+
+def schema_files(schema, include_paths):
+  """The schema and every schema it includes, recursively.
+
+  Args:
+    schema: Path of a flatbuffer schema.
+    include_paths: Directories to look for included schemas in.
+
+  Returns:
+    List of schema paths that exist.
+  """
+  found = []
+  pending = [str(schema)]
+  while pending:
+    path = pending.pop()
+    if path in found or not os.path.exists(path):
+      continue
+    found.append(path)
+    with open(path) as f:
+      includes = re.findall(r'^\s*include\s+"([^"]+)"\s*;', f.read(),
+                            re.MULTILINE)
+    for include in includes:
+      for directory in [os.path.dirname(path)] + include_paths:
+        if os.path.exists(os.path.join(directory, include)):
+          pending.append(os.path.join(directory, include))
+          break
+  return found
+
+
+def built_flatbuffer_path(input_file, extension):
+  """Path the asset builder writes input_file's flatbuffer binary to."""
+  roots = [r for r in ASSET_ROOTS
+           if os.path.abspath(input_file).startswith(r + os.sep)]
+  root = max(roots, key=len) if roots else os.path.dirname(input_file)
+  relative = os.path.relpath(os.path.abspath(input_file), root)
+  return os.path.join(ASSETS_PATH,
+                      os.path.splitext(relative)[0] + '.' + extension)
+
+
+def flatbuffer_conversions(conversion_data):
+  """Each json file converted by conversion_data, with its binary and every
+  file it depends on.
+
+  Returns:
+    List of (output_file, input_files) tuples.
+  """
+  include_paths = list(set(os.path.dirname(str(c.schema))
+                           for c in conversion_data))
+  conversions = []
+  for conversion in conversion_data:
+    if not conversion.input_files:
+      continue
+    schemas = schema_files(conversion.schema, include_paths)
+    for input_file in conversion.input_files:
+      conversions.append(
+          (built_flatbuffer_path(input_file, conversion.extension),
+           [input_file] + schemas))
+  return conversions
+
+
+def skip_unchanged_conversions(conversions):
+  """Gets the asset builder to only convert json files whose inputs changed.
+
+  The asset builder converts any json file that's newer than its binary. An
+  unchanged binary is touched, so the builder skips it. A binary whose schema
+  changed is removed, so the builder rebuilds it even though its json file is
+  older.
+  """
+  for output_file, input_files in conversions:
+    # Files built before hashes were recorded are left to the timestamps.
+    if (not os.path.exists(output_file) or
+        output_file not in BUILD_HASHES.hashes):
+      continue
+    if BUILD_HASHES.needs_rebuild(output_file, input_files):
+      os.remove(output_file)
+    else:
+      os.utime(output_file, None)
+
+
+def record_conversions(conversions):
+  """Records the inputs of each binary the asset builder wrote."""
+  for output_file, input_files in conversions:
+    if os.path.exists(output_file):
+      BUILD_HASHES.record(output_file, input_files)
+    else:
+      BUILD_HASHES.forget(output_file)
+
+
+def run_compressor(command):
+  """Runs a texture compressor. Called on the worker processes."""
+  return subprocess.call(command) == 0
+
+
+def compress_textures(texture_format, tool, textures):
+  """Compresses textures for the GPU, across a process per core.
+
+  Args:
+    texture_format: Entry of COMPRESSED_TEXTURE_FORMATS to compress to.
+    tool: Path to the format's compressor.
+    textures: Paths of the textures within the assets, such as
+      'textures/lake_daytime.webp'.
+
+  Returns:
+    Dictionary from each texture to its compressed texture's path within the
+    assets, or None if there's no source image for it or it couldn't be
+    compressed.
+  """
+  compressed = {}
+  jobs = []
+  for texture in set(textures):
+    name = os.path.splitext(os.path.basename(texture))[0]
+    sources = texture_files(name + '.png')
+    if not sources:
+      compressed[texture] = None
+      continue
+    compressed[texture] = (os.path.splitext(texture)[0] + '.' +
+                           texture_format['extension'])
+    output_file = os.path.join(ASSETS_PATH, compressed[texture])
+    if BUILD_HASHES.needs_rebuild(output_file, sources[:1]):
+      if not os.path.exists(os.path.dirname(output_file)):
+        os.makedirs(os.path.dirname(output_file))
+      command = [tool, sources[0]] + texture_format['args'] + [output_file]
+      jobs.append((texture, sources[0], output_file, command))
+  if not jobs:
+    return compressed
+
+  pool = multiprocessing.Pool(min(len(jobs), multiprocessing.cpu_count()))
+  try:
+    results = pool.map(run_compressor, [job[3] for job in jobs])
+  finally:
+    pool.close()
+    pool.join()
+  for (texture, source, output_file, _), succeeded in zip(jobs, results):
+    if succeeded:
+      BUILD_HASHES.record(output_file, [source])
+    else:
+      sys.stderr.write('Failed to compress %s to %s.\n' %
+                       (source, texture_format['name']))
+      BUILD_HASHES.forget(output_file)
+      compressed[texture] = None
+  return compressed
+
+
+def compress_materials():
+  """Compresses the textures of each of COMPRESSED_MATERIALS, and writes a
+  copy of the material that uses them to the intermediate directory, where
+  it's picked up by the flatbuffer conversion.
+
+  Returns:
+    List of the material json files written.
+  """
+  materials = []
+  for pattern in COMPRESSED_MATERIALS:
+    materials += glob.glob(os.path.join(RAW_MATERIAL_PATH, pattern))
+
+  written = []
+  for texture_format in COMPRESSED_TEXTURE_FORMATS:
+    tool = distutils.spawn.find_executable(texture_format['tool'])
+    if not tool:
+      sys.stderr.write('%s not found; skipping %s textures.\n' %
+                       (texture_format['tool'], texture_format['name']))
+      continue
+    output_path = os.path.join(INTERMEDIATE_ASSETS_PATH,
+                               texture_format['directory'], 'materials')
+    if not os.path.exists(output_path):
+      os.makedirs(output_path)
+    # Materials are relaxed json, with comments and unquoted keys, so the
+    # texture names are replaced in the text.
+    sources = {}
+    for input_file in materials:
+      with open(input_file) as f:
+        sources[input_file] = f.read()
+    textures = dict((input_file, re.findall(r'"([^"]+\.webp)"', material))
+                    for input_file, material in sources.items())
+    compressed = compress_textures(
+        texture_format, tool, sum(textures.values(), []))
+    for input_file in materials:
+      material = sources[input_file]
+      # Only use the copy if every texture was compressed.
+      if (not textures[input_file] or
+          None in [compressed[t] for t in textures[input_file]]):
+        continue
+      for texture in textures[input_file]:
+        material = material.replace('"%s"' % texture,
+                                    '"%s"' % compressed[texture])
+      output_file = os.path.join(output_path, os.path.basename(input_file))
+      with open(output_file, 'w') as f:
+        f.write(material)
+      written.append(output_file)
+  return written
+
+
+# Set by flatbuffers_conversion_data(), for main() to record once the asset
+# builder has converted them.
+FLATBUFFER_CONVERSIONS = []
+
+
+def flatbuffers_conversion_data():
+  """Bakes any generated json inputs, then returns the conversion data."""
+  bake_rails()
+  global FLATBUFFER_CONVERSIONS
+  compressed_materials = compress_materials()
+  grouped_levels = group_level_entities() + split_level_sectors()
+  conversion_data = FLATBUFFERS_CONVERSION_DATA + [
+      builder.FlatbuffersConversionData(
+          schema=PROJECT_SCHEMA_PATH.join('components.fbs'),
+          extension='zooentity',
+          input_files=grouped_levels),
+      builder.FlatbuffersConversionData(
+          schema=builder.FPLBASE_ROOT.join('schemas', 'materials.fbs'),
+          extension='fplmat',
+          input_files=compressed_materials),
+      builder.FlatbuffersConversionData(
+          schema=PROJECT_SCHEMA_PATH.join('visibility.fbs'),
+          extension='zoovis',
+          input_files=bake_level_visibility())]
+  FLATBUFFER_CONVERSIONS = flatbuffer_conversions(conversion_data)
+  skip_unchanged_conversions(FLATBUFFER_CONVERSIONS)
+  return conversion_data
+
+
 def fbx_files_to_convert():
   """FBX files to convert to fplmesh."""
   return glob.glob(os.path.join(RAW_MESH_PATH, '*.fbx'))
@@ -214,6 +1114,332 @@ def anim_files_to_convert():
   return glob.glob(os.path.join(RAW_ANIM_PATH, '*.fbx'))
 
 
+def anim_meta_args(anim_file):
+  """anim_pipeline arguments for the anim_meta entries whose name is part of
+  anim_file's name, in the order they're listed."""
+  with open(ASSET_META) as f:
+    anim_meta = json.load(f).get('anim_meta', [])
+  name = os.path.splitext(os.path.basename(anim_file))[0]
+  args = []
+  for meta in anim_meta:
+    if meta.get('name', '') not in name:
+      continue
+    for key, value in sorted(meta.items()):
+      if key in ANIM_META_ARGS:
+        args += ANIM_META_ARGS[key](value)
+  return args
+
+
+def compress_anims():
+  """Converts the animation clips matching ANIM_COMPRESSION again, fitted to
+  its looser tolerances. Clips that can't be converted again keep what the
+  asset builder wrote."""
+  tool = distutils.spawn.find_executable('anim_pipeline')
+  if not tool:
+    sys.stderr.write('anim_pipeline not found; skipping anim compression.\n')
+    return
+  saved = 0
+  for anim_file in anim_files_to_convert():
+    name = os.path.basename(anim_file)
+    settings = [c for c in ANIM_COMPRESSION
+                if fnmatch.fnmatch(name, c['pattern'])]
+    output_file = built_flatbuffer_path(anim_file, 'motiveanim')
+    if not settings or not os.path.exists(output_file):
+      continue
+    # Record the compressed clip, so it's only compressed again once the
+    # builder has converted it again.
+    key = output_file + ':compressed'
+    if BUILD_HASHES.hashes.get(key) == content_hash(output_file):
+      continue
+    tolerances = settings[0]
+    command = [tool, '--translate', str(tolerances['translate']),
+               '--rotate', str(tolerances['rotate']),
+               '--scale', str(tolerances['scale']),
+               '--angle', str(tolerances['angle'])]
+    command += anim_meta_args(anim_file) + ['-o', output_file + '.tmp',
+                                            anim_file]
+    original_size = os.path.getsize(output_file)
+    if subprocess.call(command) != 0:
+      sys.stderr.write('Failed to compress %s.\n' % anim_file)
+      if os.path.exists(output_file + '.tmp'):
+        os.remove(output_file + '.tmp')
+      continue
+    os.remove(output_file)
+    os.rename(output_file + '.tmp', output_file)
+    saved += original_size - os.path.getsize(output_file)
+    BUILD_HASHES.hashes[key] = content_hash(output_file)
+  if saved:
+    sys.stdout.write('Compressing animations saved %d bytes.\n' % saved)
+
+
+def schema_field_ids(schema, table):
+  """Field ids of a table in a flatbuffer schema, by name.
+
+  Fields are numbered in the order they're declared, unless they give an id
+  attribute.
+  """
+  with open(str(schema)) as f:
+    text = re.sub(r'//[^\n]*', '', f.read())
+  body = re.search(r'\btable\s+%s\s*\{([^}]*)\}' % table, text)
+  if not body:
+    return {}
+  ids = {}
+  for number, field in enumerate(f for f in body.group(1).split(';')
+                                 if f.strip()):
+    name = field.split(':')[0].strip()
+    explicit = re.search(r'\bid\s*:\s*(\d+)', field)
+    ids[name] = int(explicit.group(1)) if explicit else number
+  return ids
+
+
+def flatbuffer_field(buf, table, field_id):
+  """Position of a field's value in a flatbuffer, or None if it's not set.
+
+  Args:
+    buf: The flatbuffer.
+    table: Position of the table in buf.
+    field_id: Id of the field in the table.
+  """
+  vtable = table - struct.unpack_from('<i', buf, table)[0]
+  vtable_size = struct.unpack_from('<H', buf, vtable)[0]
+  entry = 4 + 2 * field_id
+  if entry >= vtable_size:
+    return None
+  offset = struct.unpack_from('<H', buf, vtable + entry)[0]
+  return table + offset if offset else None
+
+
+def flatbuffer_vector(buf, field):
+  """Position and length of the vector a field refers to."""
+  vector = field + struct.unpack_from('<I', buf, field)[0]
+  return vector + 4, struct.unpack_from('<I', buf, vector)[0]
+
+
+def vertex_cache_order(indices, cache_size):
+  """Reorders a triangle list for a post-transform vertex cache.
+
+  Uses Tom Forsyth's linear-speed vertex cache optimization: each step adds
+  the triangle whose vertices score highest, favouring vertices recently added
+  to a simulated LRU cache and vertices with few triangles left to add.
+
+  Args:
+    indices: List of vertex indices, three per triangle.
+    cache_size: Number of vertices in the simulated cache.
+
+  Returns:
+    The same triangles, in a new order.
+  """
+  num_triangles = len(indices) // 3
+  if num_triangles < 2:
+    return list(indices)
+  vertex_triangles = {}
+  for triangle in range(num_triangles):
+    for vertex in indices[3 * triangle:3 * triangle + 3]:
+      vertex_triangles.setdefault(vertex, []).append(triangle)
+  remaining = dict((v, len(t)) for v, t in vertex_triangles.items())
+
+  def score(vertex, position):
+    if remaining[vertex] == 0:
+      return -1.0
+    if position < 0:
+      cache_score = 0.0
+    elif position < 3:
+      # The last triangle's vertices score the same, whichever order they
+      # were added in.
+      cache_score = 0.75
+    else:
+      cache_score = (1.0 - float(position - 3) / (cache_size - 3)) ** 1.5
+    return cache_score + 2.0 * remaining[vertex] ** -0.5
+
+  vertex_scores = dict((v, score(v, -1)) for v in vertex_triangles)
+  added = [False] * num_triangles
+  cache = []
+  order = []
+  next_unadded = 0
+  best = max(range(num_triangles),
+             key=lambda t: sum(vertex_scores[v]
+                               for v in indices[3 * t:3 * t + 3]))
+  while best is not None:
+    added[best] = True
+    triangle = indices[3 * best:3 * best + 3]
+    order.extend(triangle)
+    for vertex in triangle:
+      remaining[vertex] -= 1
+    cache = triangle + [v for v in cache if v not in triangle]
+    evicted = cache[cache_size:]
+    cache = cache[:cache_size]
+    for position, vertex in enumerate(cache):
+      vertex_scores[vertex] = score(vertex, position)
+    for vertex in evicted:
+      vertex_scores[vertex] = score(vertex, -1)
+
+    best = None
+    best_score = -1.0
+    for vertex in cache:
+      for candidate in vertex_triangles[vertex]:
+        if added[candidate]:
+          continue
+        candidate_score = sum(vertex_scores[v]
+                              for v in indices[3 * candidate:3 * candidate + 3])
+        if candidate_score > best_score:
+          best, best_score = candidate, candidate_score
+    if best is None:
+      # Nothing in the cache has triangles left, so start somewhere new.
+      while next_unadded < num_triangles and added[next_unadded]:
+        next_unadded += 1
+      if next_unadded < num_triangles:
+        best = next_unadded
+  return order
+
+
+def optimize_mesh(mesh_file, surface_field, index_fields):
+  """Reorders the indices of each of a mesh's surfaces for the vertex cache.
+
+  The indices are rewritten in place, since there are as many as before.
+
+  Args:
+    mesh_file: Path of an fplmesh file.
+    surface_field: Field id of the Mesh's surfaces.
+    index_fields: Dictionary from the field ids of a Surface's index vectors
+      to their struct format character.
+  """
+  with open(mesh_file, 'rb') as f:
+    buf = bytearray(f.read())
+  mesh = struct.unpack_from('<I', buf, 0)[0]
+  surfaces = flatbuffer_field(buf, mesh, surface_field)
+  if surfaces is None:
+    return
+  start, count = flatbuffer_vector(buf, surfaces)
+  for i in range(count):
+    element = start + 4 * i
+    surface = element + struct.unpack_from('<I', buf, element)[0]
+    for field_id, index_format in index_fields.items():
+      field = flatbuffer_field(buf, surface, field_id)
+      if field is None:
+        continue
+      indices_start, num_indices = flatbuffer_vector(buf, field)
+      vector_format = '<%d%s' % (num_indices, index_format)
+      indices = list(struct.unpack_from(vector_format, buf, indices_start))
+      struct.pack_into(vector_format, buf, indices_start,
+                       *vertex_cache_order(indices, VERTEX_CACHE_SIZE))
+  with open(mesh_file, 'wb') as f:
+    f.write(buf)
+
+
+def optimize_meshes():
+  """Reorders the indices of each mesh converted from FBX for the vertex
+  cache. Meshes already optimized since they were converted are skipped."""
+  schema = builder.FPLBASE_ROOT.join('schemas', 'mesh.fbs')
+  mesh_ids = schema_field_ids(schema, 'Mesh')
+  surface_ids = schema_field_ids(schema, 'Surface')
+  if 'surfaces' not in mesh_ids:
+    sys.stderr.write('No surfaces in %s; skipping mesh optimization.\n' %
+                     schema)
+    return
+  index_fields = dict((surface_ids[name], index_format)
+                      for name, index_format in (('indices', 'H'),
+                                                 ('indices32', 'I'))
+                      if name in surface_ids)
+  for fbx_file in fbx_files_to_convert():
+    mesh_file = built_flatbuffer_path(fbx_file, 'fplmesh')
+    if not os.path.exists(mesh_file):
+      continue
+    # Record the optimized mesh, so it's only optimized again once the
+    # builder has converted it again.
+    key = mesh_file + ':optimized'
+    if BUILD_HASHES.hashes.get(key) == content_hash(mesh_file):
+      continue
+    optimize_mesh(mesh_file, mesh_ids['surfaces'], index_fields)
+    BUILD_HASHES.hashes[key] = content_hash(mesh_file)
+
+
+def write_shader_variants():
+  """Writes every combination of the shader defines the game's settings can
+  enable, so the game can build them all before they're used."""
+  variants = []
+  for count in range(len(SHADER_OPTION_DEFINES) + 1):
+    variants += itertools.combinations(SHADER_OPTION_DEFINES, count)
+  if not os.path.exists(ASSETS_PATH):
+    os.makedirs(ASSETS_PATH)
+  with open(os.path.join(ASSETS_PATH, SHADER_VARIANTS_FILE), 'w') as f:
+    f.write(''.join(' '.join(variant) + '\n' for variant in variants))
+
+
+def overlay_files(overlay_dir):
+  """Paths of the files in a built overlay, relative to it, using '/'."""
+  files = []
+  for root, _, names in os.walk(overlay_dir):
+    for name in names:
+      path = os.path.relpath(os.path.join(root, name), overlay_dir)
+      if path != OVERLAY_INDEX_FILE:
+        files.append(path.replace(os.sep, '/'))
+  return sorted(files)
+
+
+def write_overlay_indices(pack):
+  """Writes the file list of each built overlay, and packs them if asked."""
+  for overlay in OVERLAY_DIRS:
+    overlay_dir = os.path.join(ASSETS_PATH, overlay)
+    if not os.path.isdir(overlay_dir):
+      continue
+    files = overlay_files(overlay_dir)
+    with open(os.path.join(overlay_dir, OVERLAY_INDEX_FILE), 'w') as f:
+      f.write(''.join(path + '\n' for path in files))
+    if pack:
+      pack_overlay(overlay_dir, files, overlay_dir + OVERLAY_PACK_EXTENSION)
+
+
+def pack_overlay(overlay_dir, files, output_file):
+  """Writes `files` from `overlay_dir` into a single archive.
+
+  The archive is little-endian: the magic, the version and the file count as
+  uint32s, then each file's path length, path, offset and size, then the
+  files' contents.
+  """
+  def align(offset):
+    return (offset + OVERLAY_PACK_ALIGNMENT - 1) & ~(OVERLAY_PACK_ALIGNMENT - 1)
+
+  paths = [path.encode('utf-8') for path in files]
+  offset = align(12 + sum(12 + len(path) for path in paths))
+  entries = []
+  for path, name in zip(paths, files):
+    size = os.path.getsize(os.path.join(overlay_dir, name))
+    entries.append((path, offset, size))
+    offset = align(offset + size)
+
+  with open(output_file, 'wb') as pack:
+    pack.write(OVERLAY_PACK_MAGIC)
+    pack.write(struct.pack('<II', OVERLAY_PACK_VERSION, len(entries)))
+    for path, offset, size in entries:
+      pack.write(struct.pack('<I', len(path)) + path)
+      pack.write(struct.pack('<II', offset, size))
+    for (path, offset, _), name in zip(entries, files):
+      pack.write(b'\0' * (offset - pack.tell()))
+      with open(os.path.join(overlay_dir, name), 'rb') as f:
+        pack.write(f.read())
+
+
+def write_trusted_assets(trusted):
+  """Lists each flatbuffer binary built from json outside the overlays, or
+  removes the list if the bundle isn't trusted."""
+  list_file = os.path.join(ASSETS_PATH, TRUSTED_ASSETS_FILE)
+  if not trusted:
+    if os.path.exists(list_file):
+      os.remove(list_file)
+    return
+  overlays = [os.path.join(ASSETS_PATH, overlay) + os.sep
+              for overlay in OVERLAY_DIRS]
+  lines = []
+  for output_file, _ in FLATBUFFER_CONVERSIONS:
+    if (not os.path.exists(output_file) or
+        any(output_file.startswith(overlay) for overlay in overlays)):
+      continue
+    path = os.path.relpath(output_file, ASSETS_PATH).replace(os.sep, '/')
+    lines.append('%s %s\n' % (content_hash(output_file), path))
+  with open(list_file, 'w') as f:
+    f.write(''.join(sorted(lines)))
+
+
 def main():
   """Builds or cleans the assets needed for the game.
 
@@ -221,12 +1447,20 @@ def main():
   alternatively, call it with the argument 'all'. To just convert the
   flatbuffer json files, call it with 'flatbuffers'. Likewise to convert the
   png files to webp files, call it with 'webp'. To clean all converted files,
-  call it with 'clean'.
+  call it with 'clean'. Passing 'pack_overlays' as well packs each overlay into
+  a single archive, and passing 'trusted_bundle' lists the binaries the game
+  needn't verify.
 
   Returns:
     Returns 0 on success.
   """
-  return builder.main(
+  pack = PACK_OVERLAYS_ARG in sys.argv
+  if pack:
+    sys.argv.remove(PACK_OVERLAYS_ARG)
+  trusted = TRUSTED_BUNDLE_ARG in sys.argv
+  if trusted:
+    sys.argv.remove(TRUSTED_BUNDLE_ARG)
+  result = builder.main(
       project_root=PROJECT_ROOT,
       assets_path=ASSETS_PATH,
       asset_meta=ASSET_META,
@@ -237,8 +1471,24 @@ def main():
       png_files_to_convert=png_files_to_convert,
       anim_files_to_convert=anim_files_to_convert,
       fbx_files_to_convert=fbx_files_to_convert,
-      flatbuffers_conversion_data=lambda: FLATBUFFERS_CONVERSION_DATA,
+      flatbuffers_conversion_data=flatbuffers_conversion_data,
       schema_output_path='flatbufferschemas')
+  if 'clean' in sys.argv:
+    if os.path.exists(BUILD_HASHES_FILE):
+      os.remove(BUILD_HASHES_FILE)
+    return result
+  if result != 0:
+    # Leave the hashes from the last good build, so whatever this build got
+    # through is checked again next time.
+    return result
+  record_conversions(FLATBUFFER_CONVERSIONS)
+  optimize_meshes()
+  compress_anims()
+  write_shader_variants()
+  write_overlay_indices(pack)
+  write_trusted_assets(trusted)
+  BUILD_HASHES.save()
+  return result
 
 
 if __name__ == '__main__':
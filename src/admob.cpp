@@ -14,6 +14,8 @@
 
 #include "admob.h"
 
+#include <algorithm>
+
 #include "mathfu/internal/disable_warnings_begin.h"
 
 #include "firebase/app.h"
@@ -49,6 +51,17 @@ namespace rewarded_video = firebase::admob::rewarded_video;
 const char* kAdMobAppID = "ca-app-pub-3940256099942544~1891588914";
 const char* kRewardedVideoAdUnit = "ca-app-pub-3940256099942544/4705454513";
 
+// Milliseconds to wait before loading again after the first failure. Each
+// failure after that doubles the wait, up to the maximum.
+const int kRewardedVideoRetryDelay = 5000;
+const int kRewardedVideoMaxRetryDelay = 5 * 60 * 1000;
+
+AdMobHelper::AdMobHelper()
+    : rewarded_video_status_(kAdMobStatusInitializing),
+      initialized_(false),
+      retry_delay_(kRewardedVideoRetryDelay),
+      retry_time_(0) {}
+
 AdMobHelper::~AdMobHelper() {
   if (rewarded_video_available()) {
     rewarded_video::Destroy();
@@ -65,6 +78,7 @@ void AdMobHelper::InitializeCompletion(
     helper->rewarded_video_status_ = kAdMobStatusError;
   } else {
     rewarded_video::SetListener(&helper->listener_);
+    helper->initialized_ = true;
     helper->LoadNewRewardedVideo();
   }
 }
@@ -85,6 +99,7 @@ void AdMobHelper::LoadNewRewardedVideoCompletion(
                       completed_future.ErrorMessage());
     helper->rewarded_video_status_ = kAdMobStatusError;
   } else {
+    helper->retry_delay_ = kRewardedVideoRetryDelay;
     helper->rewarded_video_status_ = kAdMobStatusAvailable;
   }
 }
@@ -98,6 +113,15 @@ void AdMobHelper::LoadNewRewardedVideo() {
       .OnCompletion(LoadNewRewardedVideoCompletion, this);
 }
 
+void AdMobHelper::PrefetchRewardedVideo(int delta_time) {
+  if (!initialized_ || rewarded_video_status_ != kAdMobStatusError) return;
+  retry_time_ += delta_time;
+  if (retry_time_ < retry_delay_) return;
+  retry_time_ = 0;
+  retry_delay_ = std::min(retry_delay_ * 2, kRewardedVideoMaxRetryDelay);
+  LoadNewRewardedVideo();
+}
+
 
 // static
 void AdMobHelper::ShowRewardedVideoCompletion(
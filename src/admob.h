@@ -81,12 +81,18 @@ class RewardedVideoListener : public firebase::admob::rewarded_video::Listener {
 
 class AdMobHelper {
  public:
+  AdMobHelper();
   ~AdMobHelper();
 
   void Initialize(const firebase::App& app);
 
   void LoadNewRewardedVideo();
 
+  // Call during gameplay, so a rewarded video that failed to load is loaded
+  // again before the next menu wants to offer it. Retries back off after
+  // each failure.
+  void PrefetchRewardedVideo(int delta_time);
+
   void ShowRewardedVideo();
   bool CheckShowRewardedVideo();
 
@@ -113,6 +119,12 @@ class AdMobHelper {
 
   RewardedVideoListener listener_;
   AdMobStatus rewarded_video_status_;
+  // Set once the rewarded video service is ready to load ads.
+  bool initialized_;
+  // Milliseconds to wait before the next load after a failure, and how long
+  // has been waited so far.
+  int retry_delay_;
+  int retry_time_;
 };
 
 }  // zooshi
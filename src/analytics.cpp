@@ -15,6 +15,7 @@
 #include "analytics.h"
 
 #include "components/player.h"
+#include "services_thread.h"
 
 namespace fpl {
 namespace zooshi {
@@ -41,6 +42,38 @@ const char* kParameterElapsedLevelTime = "elapsed_level_time";
 // Parameter used to track the control scheme being used.
 const char* kParameterControlScheme = "control_scheme";
 
+// Events summarizing performance, sent when gameplay finishes. The device
+// model is attached to every event by Firebase.
+const char* kEventPerformanceFrames = "perf_frames";
+const char* kEventPerformanceMemory = "perf_memory";
+const char* kEventPerformanceLoading = "perf_loading";
+
+// The upper bound, in milliseconds, of each frame time bucket but the last,
+// and the parameter each bucket's count is sent as.
+static const float kFrameTimeBounds[] = {17.5f, 20.0f, 25.0f,
+                                         34.0f, 50.0f, 100.0f};
+static const char* kFrameTimeParameters[] = {
+    "frames_60fps", "frames_50fps", "frames_40fps", "frames_30fps",
+    "frames_20fps", "frames_10fps", "frames_slower"};
+static_assert(sizeof(kFrameTimeParameters) / sizeof(kFrameTimeParameters[0]) ==
+                  AnalyticsBuffer::kNumFrameTimeBuckets &&
+              sizeof(kFrameTimeBounds) / sizeof(kFrameTimeBounds[0]) ==
+                  AnalyticsBuffer::kNumFrameTimeBuckets - 1,
+              "Need a bound for each frame time bucket but the last.");
+static const char* kMissedFramesParameter = "missed_frames";
+
+// The parameter each MemoryTag's peak is sent as, in kilobytes.
+static const char* kMemoryPeakParameters[] = {
+    "textures_kb",   "meshes_kb",  "files_kb",
+    "components_kb", "physics_kb", "residency_kb"};
+static_assert(sizeof(kMemoryPeakParameters) /
+                      sizeof(kMemoryPeakParameters[0]) ==
+                  kMemoryTagCount,
+              "Need a parameter for each MemoryTag.");
+
+static const char* kStartupTimeParameter = "startup_ms";
+static const char* kLoadingTimeParameter = "loading_ms";
+
 const char* AnalyticsControlValue(const World* world) {
   if (world->rendering_mode() == kRenderingStereoscopic) return "VR";
   if (world->entity_manager
@@ -62,5 +95,145 @@ firebase::analytics::Parameter AnalyticsControlParameter(const World* world) {
                                         AnalyticsControlValue(world));
 }
 
+AnalyticsBuffer::AnalyticsBuffer()
+    : services_thread_(nullptr),
+      mutex_(SDL_CreateMutex()),
+      startup_ms_(-1.0f),
+      loading_ms_(-1.0f),
+      load_times_sent_(false) {
+  StartFrameCounts();
+}
+
+AnalyticsBuffer::~AnalyticsBuffer() { SDL_DestroyMutex(mutex_); }
+
+void AnalyticsBuffer::CountPatronFed(const std::string& patron_type,
+                                     const char* control_scheme) {
+  SDL_LockMutex(mutex_);
+  // There are only a handful of patron types, so a linear search is enough,
+  // and only the first of each type allocates.
+  auto it = patron_fed_.begin();
+  for (; it != patron_fed_.end(); ++it) {
+    if (it->control_scheme == control_scheme &&
+        it->patron_type == patron_type) {
+      break;
+    }
+  }
+  if (it == patron_fed_.end()) {
+    PatronFedCount count = {patron_type, control_scheme, 0};
+    patron_fed_.push_back(count);
+    it = patron_fed_.end() - 1;
+  }
+  it->count++;
+  SDL_UnlockMutex(mutex_);
+}
+
+void AnalyticsBuffer::CountFrame(float frame_ms, bool missed) {
+  int bucket = 0;
+  while (bucket < kNumFrameTimeBuckets - 1 &&
+         frame_ms > kFrameTimeBounds[bucket]) {
+    bucket++;
+  }
+  SDL_AtomicAdd(&frame_buckets_[bucket], 1);
+  if (missed) SDL_AtomicAdd(&missed_frames_, 1);
+}
+
+void AnalyticsBuffer::StartFrameCounts() {
+  for (int i = 0; i < kNumFrameTimeBuckets; ++i) {
+    SDL_AtomicSet(&frame_buckets_[i], 0);
+  }
+  SDL_AtomicSet(&missed_frames_, 0);
+}
+
+void AnalyticsBuffer::TakePerformanceCounts(PerformanceCounts* counts) {
+  for (int i = 0; i < kNumFrameTimeBuckets; ++i) {
+    counts->frame_buckets[i] = SDL_AtomicSet(&frame_buckets_[i], 0);
+  }
+  counts->missed_frames = SDL_AtomicSet(&missed_frames_, 0);
+
+  const MemoryTracker& memory = MemoryTracker::Get();
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    counts->memory_peaks_kb[i] =
+        static_cast<int64_t>(memory.peak(static_cast<MemoryTag>(i)) / 1024);
+  }
+
+  // Each launch only loads once.
+  counts->startup_ms = -1;
+  counts->loading_ms = -1;
+  if (!load_times_sent_ && loading_ms_ >= 0.0f) {
+    counts->startup_ms = static_cast<int64_t>(startup_ms_);
+    counts->loading_ms = static_cast<int64_t>(loading_ms_);
+    load_times_sent_ = true;
+  }
+}
+
+void AnalyticsBuffer::Flush() {
+  std::vector<PatronFedCount> counts;
+  SDL_LockMutex(mutex_);
+  counts.swap(patron_fed_);
+  SDL_UnlockMutex(mutex_);
+  PerformanceCounts performance;
+  TakePerformanceCounts(&performance);
+
+  if (services_thread_ != nullptr) {
+    services_thread_->Post([counts, performance]() {
+      SendPatronFed(counts);
+      SendPerformance(performance);
+    });
+  } else {
+    SendPatronFed(counts);
+    SendPerformance(performance);
+  }
+}
+
+void AnalyticsBuffer::SendPatronFed(const std::vector<PatronFedCount>& counts) {
+  for (auto it = counts.begin(); it != counts.end(); ++it) {
+    firebase::analytics::Parameter parameters[] = {
+        firebase::analytics::Parameter(kParameterPatronType,
+                                       it->patron_type.c_str()),
+        firebase::analytics::Parameter(kParameterControlScheme,
+                                       it->control_scheme),
+        firebase::analytics::Parameter(firebase::analytics::kParameterQuantity,
+                                       it->count),
+    };
+    firebase::analytics::LogEvent(kEventPatronFed, parameters,
+                                  sizeof(parameters) / sizeof(parameters[0]));
+  }
+}
+
+void AnalyticsBuffer::SendPerformance(const PerformanceCounts& counts) {
+  std::vector<firebase::analytics::Parameter> frames;
+  int64_t total_frames = 0;
+  for (int i = 0; i < kNumFrameTimeBuckets; ++i) {
+    frames.push_back(firebase::analytics::Parameter(kFrameTimeParameters[i],
+                                                    counts.frame_buckets[i]));
+    total_frames += counts.frame_buckets[i];
+  }
+  frames.push_back(firebase::analytics::Parameter(kMissedFramesParameter,
+                                                  counts.missed_frames));
+  if (total_frames > 0) {
+    firebase::analytics::LogEvent(kEventPerformanceFrames, frames.data(),
+                                  frames.size());
+  }
+
+  std::vector<firebase::analytics::Parameter> memory;
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    memory.push_back(firebase::analytics::Parameter(
+        kMemoryPeakParameters[i], counts.memory_peaks_kb[i]));
+  }
+  firebase::analytics::LogEvent(kEventPerformanceMemory, memory.data(),
+                                memory.size());
+
+  if (counts.loading_ms >= 0) {
+    firebase::analytics::Parameter loading[] = {
+        firebase::analytics::Parameter(kStartupTimeParameter,
+                                       counts.startup_ms),
+        firebase::analytics::Parameter(kLoadingTimeParameter,
+                                       counts.loading_ms),
+    };
+    firebase::analytics::LogEvent(kEventPerformanceLoading, loading,
+                                  sizeof(loading) / sizeof(loading[0]));
+  }
+}
+
 }  // zooshi
 }  // fpl
@@ -23,6 +23,11 @@
 
 #include "mathfu/internal/disable_warnings_end.h"
 
+#include <string>
+#include <vector>
+#include "SDL_atomic.h"
+#include "SDL_mutex.h"
+#include "memory_tracker.h"
 #include "world.h"
 
 namespace fpl {
@@ -50,11 +55,93 @@ extern const char* kParameterElapsedLevelTime;
 // Parameter used to track the control scheme being used.
 extern const char* kParameterControlScheme;
 
+// Events summarizing performance, sent when gameplay finishes.
+extern const char* kEventPerformanceFrames;
+extern const char* kEventPerformanceMemory;
+extern const char* kEventPerformanceLoading;
+
 // Helper function to get the value used with the control scheme parameter.
 const char* AnalyticsControlValue(const World* world);
 // Helper function to create the parameter defining the controller being used.
 firebase::analytics::Parameter AnalyticsControlParameter(const World* world);
 
+class ServicesThread;
+
+// Counts frequent events during gameplay, such as patrons being fed, so they
+// can be recorded from collision callbacks without calling into Firebase.
+// Flush() sends the counts as one event per distinct set of parameters, with
+// the count as its quantity, from the services thread.
+class AnalyticsBuffer {
+ public:
+  AnalyticsBuffer();
+  ~AnalyticsBuffer();
+
+  // If null, Flush() sends events on the calling thread.
+  void set_services_thread(ServicesThread* services_thread) {
+    services_thread_ = services_thread;
+  }
+
+  // Count a fed patron. `control_scheme` must be a string literal, such as
+  // one from AnalyticsControlValue(). Safe to call from any thread.
+  void CountPatronFed(const std::string& patron_type,
+                      const char* control_scheme);
+
+  // Count a frame that started `frame_ms` after the one before, and whether
+  // it `missed` its deadline. Called from the render thread, and never
+  // blocks.
+  void CountFrame(float frame_ms, bool missed);
+
+  // Start counting frames from zero, such as when gameplay starts.
+  void StartFrameCounts();
+
+  // How long startup and the loading screen took, in milliseconds. Sent
+  // with the first Flush() after they're set.
+  void set_startup_time(float ms) { startup_ms_ = ms; }
+  void set_loading_time(float ms) { loading_ms_ = ms; }
+
+  // Send the counts so far, the frame counts since StartFrameCounts(), and
+  // the memory peaks, and start counting from zero.
+  void Flush();
+
+  // Frame times are counted in a histogram of this many buckets.
+  static const int kNumFrameTimeBuckets = 7;
+
+ private:
+  struct PatronFedCount {
+    std::string patron_type;
+    const char* control_scheme;
+    int64_t count;
+  };
+
+  // What's sent in the performance events.
+  struct PerformanceCounts {
+    int64_t frame_buckets[kNumFrameTimeBuckets];
+    int64_t missed_frames;
+    int64_t memory_peaks_kb[kMemoryTagCount];
+    // Negative once sent, or if not yet known.
+    int64_t startup_ms;
+    int64_t loading_ms;
+  };
+
+  static void SendPatronFed(const std::vector<PatronFedCount>& counts);
+  static void SendPerformance(const PerformanceCounts& counts);
+  void TakePerformanceCounts(PerformanceCounts* counts);
+
+  ServicesThread* services_thread_;
+
+  // Guards `patron_fed_`.
+  SDL_mutex* mutex_;
+  std::vector<PatronFedCount> patron_fed_;
+
+  // Frames in each histogram bucket, and how many missed their deadline.
+  SDL_atomic_t frame_buckets_[kNumFrameTimeBuckets];
+  SDL_atomic_t missed_frames_;
+
+  float startup_ms_;
+  float loading_ms_;
+  bool load_times_sent_;
+};
+
 }  // zooshi
 }  // fpl
 
@@ -0,0 +1,377 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "asset_loader.h"
+
+#include <algorithm>
+#include <set>
+#include "SDL_timer.h"
+#include "fplbase/material.h"
+#include "fplbase/utilities.h"
+#include "mapped_file.h"
+#include "memory_tracker.h"
+
+namespace fpl {
+namespace zooshi {
+
+// How long each frame may spend starting streamed loads. Meshes are read and
+// uploaded by the render thread, so this bounds the hitch they cause.
+static const double kStreamingBudgetMilliseconds = 2.0;
+
+// How often, in frames, the loaded textures and meshes are counted.
+static const int kMemorySampleFrames = 60;
+
+typedef flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>
+    FileList;
+
+static bool ComparePriority(const AssetGroupDef* a, const AssetGroupDef* b) {
+  return a->priority() < b->priority();
+}
+
+// Bits each texel of `texture` takes on the GPU, in the format it was
+// uploaded in.
+static size_t BitsPerTexel(const fplbase::Texture& texture) {
+  switch (texture.format()) {
+    case fplbase::kFormat888:
+      return 24;
+    case fplbase::kFormat5551:
+    case fplbase::kFormat565:
+    case fplbase::kFormatLuminanceAlpha:
+      return 16;
+    case fplbase::kFormatLuminance:
+      return 8;
+    // The KTX files are ETC2 RGBA8, which like ASTC 4x4 packs 4x4 texels in
+    // 16 bytes.
+    case fplbase::kFormatKTX:
+    case fplbase::kFormatASTC:
+      return 8;
+    // ETC1 packs 4x4 texels in 8 bytes.
+    case fplbase::kFormatPKM:
+      return 4;
+    default:
+      return 32;
+  }
+}
+
+// Bytes `texture` takes on the GPU. Materials are mipmapped, and a full mip
+// chain adds a third.
+static size_t TextureBytes(const fplbase::Texture& texture) {
+  const mathfu::vec2i size = texture.size();
+  const size_t texels = static_cast<size_t>(size.x()) * size.y();
+  return texels * BitsPerTexel(texture) / 8 * 4 / 3;
+}
+
+// Add the textures of each loaded material in `materials` to `textures`.
+static void AddTextures(fplbase::AssetManager* asset_manager,
+                        const FileList* materials,
+                        std::set<const fplbase::Texture*>* textures) {
+  if (materials == nullptr) return;
+  for (auto it = materials->begin(); it != materials->end(); ++it) {
+    fplbase::Material* material = asset_manager->FindMaterial(it->c_str());
+    if (material == nullptr) continue;
+    textures->insert(material->textures().begin(),
+                     material->textures().end());
+  }
+}
+
+AssetLoader::AssetLoader()
+    : asset_manager_(nullptr),
+      audio_engine_(nullptr),
+      audio_thread_(nullptr),
+      manifest_(nullptr),
+      evict_other_levels_(false),
+      required_finalized_(false),
+      required_sounds_finalized_(false),
+      streaming_(false),
+      groups_pending_(false),
+      level_lock_(0),
+      frames_until_memory_sample_(0) {}
+
+void AssetLoader::Initialize(const AssetManifest* manifest,
+                             fplbase::AssetManager* asset_manager,
+                             pindrop::AudioEngine* audio_engine,
+                             AudioThread* audio_thread,
+                             bool evict_other_levels) {
+  manifest_ = manifest;
+  asset_manager_ = asset_manager;
+  audio_engine_ = audio_engine;
+  audio_thread_ = audio_thread;
+  evict_other_levels_ = evict_other_levels;
+  required_finalized_ = false;
+  required_sounds_finalized_ = false;
+  streaming_ = false;
+
+  std::vector<const AssetGroupDef*> defs;
+  if (manifest->asset_groups() != nullptr) {
+    defs.assign(manifest->asset_groups()->begin(),
+                manifest->asset_groups()->end());
+  }
+  std::stable_sort(defs.begin(), defs.end(), ComparePriority);
+  groups_.clear();
+  for (auto it = defs.begin(); it != defs.end(); ++it) {
+    Group group;
+    group.def = *it;
+    group.next_mesh = 0;
+    group.next_material = 0;
+    group.next_sound_bank = 0;
+    group.loaded = false;
+    groups_.push_back(group);
+  }
+  groups_pending_ = !groups_.empty();
+}
+
+bool AssetLoader::SoundsFinalized() {
+  AudioEngineLock lock(audio_thread_);
+  return audio_engine_->TryFinalize();
+}
+
+bool AssetLoader::TryFinalize() {
+  // Streamed groups are finalized by Update(), so once the required assets
+  // are in, only the loaded level's groups are waited on.
+  if (!required_finalized_) {
+    if (!required_sounds_finalized_) {
+      required_sounds_finalized_ = SoundsFinalized();
+    }
+    required_finalized_ =
+        asset_manager_->TryFinalize() && required_sounds_finalized_;
+    if (!required_finalized_) return false;
+  }
+  const std::string level = LoadedLevel();
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    if (IsLevelGroup(*it, level) && !it->loaded) return false;
+  }
+  return true;
+}
+
+void AssetLoader::OnGroupLoaded(const char* group_name,
+                                const ReadyCallback& ready) {
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    if (it->def->name() == nullptr || it->def->name()->str() != group_name) {
+      continue;
+    }
+    it->ready.push_back(ready);
+    if (it->loaded) ready();
+    return;
+  }
+  fplbase::LogError("No asset group named %s", group_name);
+}
+
+void AssetLoader::set_loaded_level(const char* level_name) {
+  SDL_AtomicLock(&level_lock_);
+  loaded_level_ = level_name;
+  SDL_AtomicUnlock(&level_lock_);
+}
+
+std::string AssetLoader::LoadedLevel() {
+  SDL_AtomicLock(&level_lock_);
+  const std::string level = loaded_level_;
+  SDL_AtomicUnlock(&level_lock_);
+  return level;
+}
+
+bool AssetLoader::IsLevelGroup(const Group& group, const std::string& level) {
+  return group.def->level() != nullptr && !level.empty() &&
+         level == group.def->level()->c_str();
+}
+
+bool AssetLoader::CanLoad(const Group& group) const {
+  return !evict_other_levels_ || group.def->level() == nullptr ||
+         evicted_level_ == group.def->level()->c_str();
+}
+
+void AssetLoader::Evict(Group* group) {
+  // Materials can share textures, which are unloaded with them. Keep any
+  // material whose textures are also used by one that stays loaded.
+  std::set<const fplbase::Texture*> kept;
+  AddTextures(asset_manager_, manifest_->material_list(), &kept);
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    if (&*it != group && CanLoad(*it)) {
+      AddTextures(asset_manager_, it->def->material_list(), &kept);
+    }
+  }
+
+  const FileList* materials = group->def->material_list();
+  for (size_t i = 0; i < group->next_material; ++i) {
+    const char* filename =
+        materials->Get(static_cast<flatbuffers::uoffset_t>(i))->c_str();
+    fplbase::Material* material = asset_manager_->FindMaterial(filename);
+    if (material == nullptr) continue;
+    bool shared = false;
+    for (auto it = material->textures().begin();
+         it != material->textures().end() && !shared; ++it) {
+      shared = kept.count(*it) > 0;
+    }
+    if (!shared) asset_manager_->UnloadMaterial(filename);
+  }
+  const FileList* meshes = group->def->mesh_list();
+  for (size_t i = 0; i < group->next_mesh; ++i) {
+    const char* filename =
+        meshes->Get(static_cast<flatbuffers::uoffset_t>(i))->c_str();
+    fplbase::Mesh* mesh = asset_manager_->FindMesh(filename);
+    if (mesh != nullptr && on_unload_mesh_) on_unload_mesh_(mesh);
+    asset_manager_->UnloadMesh(filename);
+  }
+  const FileList* sound_banks = group->def->sound_banks();
+  AudioEngineLock lock(audio_thread_);
+  for (size_t i = 0; i < group->next_sound_bank; ++i) {
+    audio_engine_->UnloadSoundBank(
+        sound_banks->Get(static_cast<flatbuffers::uoffset_t>(i))->str());
+  }
+  group->next_mesh = 0;
+  group->next_material = 0;
+  group->next_sound_bank = 0;
+  group->loaded = false;
+}
+
+void AssetLoader::MeasureMemory() {
+  std::set<const fplbase::Texture*> textures;
+  AddTextures(asset_manager_, manifest_->material_list(), &textures);
+  const char* const always_loaded[] = {manifest_->loading_material()->c_str(),
+                                       manifest_->fader_material()->c_str()};
+  for (size_t i = 0; i < FPL_ARRAYSIZE(always_loaded); ++i) {
+    fplbase::Material* material =
+        asset_manager_->FindMaterial(always_loaded[i]);
+    if (material == nullptr) continue;
+    textures.insert(material->textures().begin(), material->textures().end());
+  }
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    AddTextures(asset_manager_, it->def->material_list(), &textures);
+  }
+  size_t texture_bytes = 0;
+  for (auto it = textures.begin(); it != textures.end(); ++it) {
+    texture_bytes += TextureBytes(**it);
+  }
+  MemoryTracker::Get().Set(kMemoryTextures, texture_bytes);
+
+  // Meshes are counted by the size of their files, which hold little else.
+  std::vector<const FileList*> mesh_lists(1, manifest_->mesh_list());
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    mesh_lists.push_back(it->def->mesh_list());
+  }
+  size_t mesh_bytes = 0;
+  for (auto list = mesh_lists.begin(); list != mesh_lists.end(); ++list) {
+    if (*list == nullptr) continue;
+    for (auto it = (*list)->begin(); it != (*list)->end(); ++it) {
+      if (asset_manager_->FindMesh(it->c_str()) == nullptr) continue;
+      auto size = mesh_bytes_.find(it->str());
+      if (size == mesh_bytes_.end()) {
+        MappedFile file;
+        MapFile(it->c_str(), &file);
+        size = mesh_bytes_.insert(std::make_pair(it->str(), file.size())).first;
+      }
+      mesh_bytes += size->second;
+    }
+  }
+  MemoryTracker::Get().Set(kMemoryMeshes, mesh_bytes);
+}
+
+void AssetLoader::Update() {
+  if (!required_finalized_) return;
+
+  if (--frames_until_memory_sample_ <= 0) {
+    MeasureMemory();
+    frames_until_memory_sample_ = kMemorySampleFrames;
+  }
+
+  // Once over budget, stay evicting, so the groups aren't reloaded.
+  const MemoryTracker& tracker = MemoryTracker::Get();
+  bool over_budget = false;
+  if (!evict_other_levels_ && (tracker.OverBudget(kMemoryTextures) ||
+                               tracker.OverBudget(kMemoryMeshes))) {
+    fplbase::LogInfo("Memory: evicting asset groups of other levels");
+    evict_other_levels_ = true;
+    over_budget = true;
+  }
+
+  const std::string level = LoadedLevel();
+  if (evict_other_levels_) {
+    if (level != evicted_level_ || over_budget) {
+      evicted_level_ = level;
+      for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+        if (!CanLoad(*it) && (it->next_mesh > 0 || it->next_material > 0)) {
+          Evict(&*it);
+        }
+      }
+    }
+  }
+
+  const uint64_t start = SDL_GetPerformanceCounter();
+  const uint64_t budget = static_cast<uint64_t>(
+      SDL_GetPerformanceFrequency() * kStreamingBudgetMilliseconds / 1000.0);
+  // The loaded level's groups go first, so switching to a level only waits
+  // on its own groups.
+  groups_pending_ = false;
+  for (int pass = 0; pass < 2 && !groups_pending_; ++pass) {
+    for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+      if (it->loaded || !CanLoad(*it) ||
+          IsLevelGroup(*it, level) != (pass == 0)) {
+        continue;
+      }
+      if (!StreamGroup(&*it, start, budget)) {
+        groups_pending_ = true;
+        break;
+      }
+    }
+  }
+  streaming_ = groups_pending_;
+}
+
+bool AssetLoader::StreamGroup(Group* group, uint64_t start, uint64_t budget) {
+  const FileList* meshes = group->def->mesh_list();
+  const FileList* materials = group->def->material_list();
+  const FileList* sound_banks = group->def->sound_banks();
+  while (SDL_GetPerformanceCounter() - start < budget) {
+    if (meshes != nullptr && group->next_mesh < meshes->size()) {
+      asset_manager_->LoadMesh(
+          meshes->Get(static_cast<flatbuffers::uoffset_t>(group->next_mesh++))
+              ->c_str());
+    } else if (materials != nullptr &&
+               group->next_material < materials->size()) {
+      asset_manager_->LoadMaterial(
+          materials->Get(
+              static_cast<flatbuffers::uoffset_t>(group->next_material++))
+              ->c_str());
+    } else if (sound_banks != nullptr &&
+               group->next_sound_bank < sound_banks->size()) {
+      // Only the bank's definitions are read here. Its sounds are decoded
+      // on pindrop's loader thread.
+      AudioEngineLock lock(audio_thread_);
+      audio_engine_->LoadSoundBank(
+          sound_banks->Get(
+              static_cast<flatbuffers::uoffset_t>(group->next_sound_bank++))
+              ->str());
+      if (group->next_sound_bank == sound_banks->size()) {
+        audio_engine_->StartLoadingSoundFiles();
+      }
+    } else if (!asset_manager_->TryFinalize()) {
+      // The meshes and materials are read on the loader thread, and their
+      // GL objects made here as they arrive.
+      return false;
+    } else if (sound_banks != nullptr && sound_banks->size() > 0 &&
+               !SoundsFinalized()) {
+      return false;
+    } else {
+      group->loaded = true;
+      for (auto ready = group->ready.begin(); ready != group->ready.end();
+           ++ready) {
+        (*ready)();
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,143 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_ASSET_LOADER_H_
+#define ZOOSHI_ASSET_LOADER_H_
+
+#include <functional>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "SDL_atomic.h"
+#include "assets_generated.h"
+#include "audio_thread.h"
+#include "fplbase/asset_manager.h"
+#include "pindrop/pindrop.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Streams in the manifest's asset groups in the background, in order of
+// priority, once the required assets have loaded, so the menu can be shown
+// sooner. When the memory budgets ask for it, or textures or meshes go over
+// budget, groups belonging to a level are only kept while that level is
+// loaded.
+class AssetLoader {
+ public:
+  typedef std::function<void()> ReadyCallback;
+  typedef std::function<void(fplbase::Mesh* mesh)> UnloadCallback;
+
+  AssetLoader();
+
+  // Queue the manifest's asset groups. The required assets and sounds are
+  // loaded by the game, before any groups are streamed.
+  void Initialize(const AssetManifest* manifest,
+                  fplbase::AssetManager* asset_manager,
+                  pindrop::AudioEngine* audio_engine,
+                  AudioThread* audio_thread, bool evict_other_levels);
+
+  // Finalize the required assets and sounds that have loaded. Returns true
+  // once they're ready, and the groups of the level set_loaded_level() last
+  // recorded have loaded too. Other groups may still be streaming in. Must be
+  // called on the render thread.
+  bool TryFinalize();
+
+  // Call `ready` each time the group named `group_name` has loaded, from
+  // Update(), or right away if it already has. Sounds in the group's banks
+  // can't be found until then.
+  void OnGroupLoaded(const char* group_name, const ReadyCallback& ready);
+
+  // Start loading more of the streamed groups, within a small time budget,
+  // and finalize those that have loaded, the loaded level's first. Evicts
+  // other levels' groups if memory is tight. Counts the loaded textures and
+  // meshes towards the MemoryTracker every so often. Call once a frame on the
+  // render thread.
+  void Update();
+
+  // Record the level that was just loaded. May be called from any thread;
+  // evictions happen in the next Update().
+  void set_loaded_level(const char* level_name);
+
+  // True until every group that can be loaded has been.
+  bool streaming() const { return streaming_; }
+
+  // Call `unload` with each mesh an eviction is about to delete, from
+  // Update(), so anything kept for it can be dropped.
+  void set_on_unload_mesh(const UnloadCallback& unload) {
+    on_unload_mesh_ = unload;
+  }
+
+ private:
+  struct Group {
+    const AssetGroupDef* def;
+    // How many of the group's meshes, materials and sound banks have been
+    // loaded.
+    size_t next_mesh;
+    size_t next_material;
+    size_t next_sound_bank;
+    bool loaded;
+    std::vector<ReadyCallback> ready;
+  };
+
+  // Groups that belong to another level while evicting can't be loaded.
+  bool CanLoad(const Group& group) const;
+  // True if `group` is only needed by `level`.
+  static bool IsLevelGroup(const Group& group, const std::string& level);
+  // Load more of `group` until `budget` performance counter ticks have
+  // passed since `start`. Returns true once it has loaded and been
+  // finalized.
+  bool StreamGroup(Group* group, uint64_t start, uint64_t budget);
+  // The level set_loaded_level() last recorded.
+  std::string LoadedLevel();
+  // Finalize the sounds that have loaded, under the audio lock. Returns true
+  // once every bank asked for is ready.
+  bool SoundsFinalized();
+  void Evict(Group* group);
+
+  // Set the MemoryTracker's texture and mesh counts from what's loaded.
+  void MeasureMemory();
+
+  fplbase::AssetManager* asset_manager_;
+  pindrop::AudioEngine* audio_engine_;
+  // Held while calling `audio_engine_`.
+  AudioThread* audio_thread_;
+  const AssetManifest* manifest_;
+  bool evict_other_levels_;
+  std::vector<Group> groups_;
+  UnloadCallback on_unload_mesh_;
+  bool required_finalized_;
+  // Pindrop finalizes every bank at once, so once the required sounds are
+  // in, only the groups' banks wait on it.
+  bool required_sounds_finalized_;
+  bool streaming_;
+  // True while groups that can be loaded haven't all been started.
+  bool groups_pending_;
+
+  // The level set_loaded_level() last recorded, guarded by `level_lock_`,
+  // and the level the groups were last evicted for.
+  SDL_SpinLock level_lock_;
+  std::string loaded_level_;
+  std::string evicted_level_;
+
+  // The size of each mesh file MeasureMemory() has seen, and the frames
+  // until it's next called.
+  std::map<std::string, size_t> mesh_bytes_;
+  int frames_until_memory_sample_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_ASSET_LOADER_H_
@@ -0,0 +1,300 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "audio_thread.h"
+
+#include "fplbase/utilities.h"
+#include "profiler.h"
+
+// We need to undef this macro or AudioEngine::PlaySound() won't compile.
+#if defined(PlaySound)
+#undef PlaySound
+#endif  // defined(PlaySound)
+
+using fplbase::LogError;
+
+namespace fpl {
+namespace zooshi {
+
+// Commands the queue holds. A power of two, so the indices can wrap. The
+// update thread sends a few per voice each frame, so this covers several
+// frames of the audio thread falling behind.
+static const unsigned int kQueueSize = 2048;
+
+// Voices are the slot in the low bits, and the generation of the slot's use
+// above, so a stale voice doesn't match the slot's next sound.
+static const int kVoiceSlotBits = 8;
+static const int kMaxGeneration = 0x7fffff;
+static_assert(AudioThread::kMaxVoices <= (1 << kVoiceSlotBits),
+              "Voice slots must fit in their bits.");
+
+static int VoiceSlot(AudioVoice voice) {
+  return voice & ((1 << kVoiceSlotBits) - 1);
+}
+
+static int VoiceGeneration(AudioVoice voice) {
+  return voice >> kVoiceSlotBits;
+}
+
+mathfu::vec3 AudioThread::Location(const Command& command) {
+  return mathfu::vec3(command.values[0], command.values[1], command.values[2]);
+}
+
+AudioThread::AudioThread()
+    : audio_engine_(nullptr),
+      thread_(nullptr),
+      started_(false),
+      wake_(SDL_CreateSemaphore(0)),
+      engine_mutex_(SDL_CreateMutex()),
+      commands_(kQueueSize),
+      dropping_(false) {
+  SDL_AtomicSet(&exiting_, 0);
+  SDL_AtomicSet(&head_, 0);
+  SDL_AtomicSet(&tail_, 0);
+  // Hand out the lowest slots first.
+  for (int i = kMaxVoices - 1; i >= 0; --i) free_voices_.push_back(i);
+  for (int i = kMaxListeners - 1; i >= 0; --i) free_listeners_.push_back(i);
+  for (int i = 0; i < kMaxVoices; ++i) {
+    voice_generations_[i] = 0;
+    channel_generations_[i] = 0;
+    SDL_AtomicSet(&finished_[i], 0);
+  }
+}
+
+AudioThread::~AudioThread() {
+  Shutdown();
+  SDL_DestroySemaphore(wake_);
+  SDL_DestroyMutex(engine_mutex_);
+}
+
+void AudioThread::Initialize(pindrop::AudioEngine* audio_engine) {
+  audio_engine_ = audio_engine;
+}
+
+void AudioThread::Start() {
+  if (thread_ != nullptr) return;
+  started_ = true;
+  thread_ = SDL_CreateThread(ThreadMain, "Zooshi Audio Thread", this);
+  if (thread_ == nullptr) {
+    LogError("Error creating audio thread: %s", SDL_GetError());
+  }
+}
+
+void AudioThread::Shutdown() {
+  if (!started_) return;
+  if (thread_ != nullptr) {
+    SDL_AtomicSet(&exiting_, 1);
+    SDL_SemPost(wake_);
+    SDL_WaitThread(thread_, nullptr);
+    thread_ = nullptr;
+    SDL_AtomicSet(&exiting_, 0);
+  }
+  started_ = false;
+  RunCommands();
+}
+
+AudioVoice AudioThread::PlaySound(pindrop::SoundHandle sound,
+                                  const mathfu::vec3& location) {
+  if (free_voices_.empty()) return 0;
+  const int slot = free_voices_.back();
+  free_voices_.pop_back();
+  int& generation = voice_generations_[slot];
+  generation = generation % kMaxGeneration + 1;
+
+  Command command;
+  command.type = kPlaySound;
+  command.slot = slot;
+  command.generation = generation;
+  command.sound = sound;
+  command.values[0] = location.x;
+  command.values[1] = location.y;
+  command.values[2] = location.z;
+  Push(command);
+  return (generation << kVoiceSlotBits) | slot;
+}
+
+void AudioThread::Stop(AudioVoice voice) {
+  if (voice == 0) return;
+  Command command;
+  command.type = kStop;
+  command.slot = VoiceSlot(voice);
+  command.generation = VoiceGeneration(voice);
+  Push(command);
+  free_voices_.push_back(command.slot);
+}
+
+void AudioThread::SetLocation(AudioVoice voice,
+                              const mathfu::vec3& location) {
+  if (voice == 0) return;
+  Command command;
+  command.type = kSetLocation;
+  command.slot = VoiceSlot(voice);
+  command.generation = VoiceGeneration(voice);
+  command.values[0] = location.x;
+  command.values[1] = location.y;
+  command.values[2] = location.z;
+  Push(command);
+}
+
+bool AudioThread::Playing(AudioVoice voice) const {
+  if (voice == 0) return false;
+  SDL_atomic_t* finished =
+      const_cast<SDL_atomic_t*>(&finished_[VoiceSlot(voice)]);
+  return SDL_AtomicGet(finished) != VoiceGeneration(voice);
+}
+
+int AudioThread::AddListener() {
+  if (free_listeners_.empty()) {
+    LogError("Audio: more than %d listeners", kMaxListeners);
+    return -1;
+  }
+  Command command;
+  command.type = kAddListener;
+  command.slot = free_listeners_.back();
+  free_listeners_.pop_back();
+  Push(command);
+  return command.slot;
+}
+
+void AudioThread::RemoveListener(int listener) {
+  if (listener < 0) return;
+  Command command;
+  command.type = kRemoveListener;
+  command.slot = listener;
+  Push(command);
+  free_listeners_.push_back(listener);
+}
+
+void AudioThread::SetListenerMatrix(int listener,
+                                    const mathfu::mat4& matrix) {
+  if (listener < 0) return;
+  Command command;
+  command.type = kSetListenerMatrix;
+  command.slot = listener;
+  for (int i = 0; i < 16; ++i) command.values[i] = matrix[i];
+  Push(command);
+}
+
+void AudioThread::AdvanceFrame(float delta_time) {
+  Command command;
+  command.type = kAdvanceFrame;
+  command.values[0] = delta_time;
+  Push(command);
+  if (thread_ != nullptr) {
+    SDL_SemPost(wake_);
+  } else if (started_) {
+    RunCommands();
+  }
+}
+
+void AudioThread::Push(const Command& command) {
+  if (!started_) {
+    AudioEngineLock lock(this);
+    Execute(command);
+    return;
+  }
+  const unsigned int tail = static_cast<unsigned int>(SDL_AtomicGet(&tail_));
+  const unsigned int head = static_cast<unsigned int>(SDL_AtomicGet(&head_));
+  if (tail - head >= kQueueSize) {
+    if (!dropping_) LogError("Audio: command queue full, dropping commands");
+    dropping_ = true;
+    return;
+  }
+  dropping_ = false;
+  commands_[tail & (kQueueSize - 1)] = command;
+  // The atomic set publishes the command before the new tail.
+  SDL_AtomicSet(&tail_, static_cast<int>(tail + 1));
+}
+
+void AudioThread::RunCommands() {
+  SDL_LockMutex(engine_mutex_);
+  unsigned int head = static_cast<unsigned int>(SDL_AtomicGet(&head_));
+  const unsigned int tail = static_cast<unsigned int>(SDL_AtomicGet(&tail_));
+  while (head != tail) {
+    Execute(commands_[head & (kQueueSize - 1)]);
+    ++head;
+    SDL_AtomicSet(&head_, static_cast<int>(head));
+  }
+  SDL_UnlockMutex(engine_mutex_);
+}
+
+void AudioThread::Execute(const Command& command) {
+  switch (command.type) {
+    case kPlaySound: {
+      pindrop::Channel& channel = channels_[command.slot];
+      channel = audio_engine_->PlaySound(command.sound, Location(command));
+      channel_generations_[command.slot] = command.generation;
+      if (!channel.Valid()) {
+        // Tell the update thread right away, so it doesn't wait on a sound
+        // that never started.
+        channel_generations_[command.slot] = 0;
+        SDL_AtomicSet(&finished_[command.slot], command.generation);
+      }
+      break;
+    }
+    case kStop: {
+      pindrop::Channel& channel = channels_[command.slot];
+      if (channel_generations_[command.slot] == command.generation &&
+          channel.Valid()) {
+        channel.Stop();
+      }
+      channel = pindrop::Channel();
+      channel_generations_[command.slot] = 0;
+      break;
+    }
+    case kSetLocation: {
+      pindrop::Channel& channel = channels_[command.slot];
+      if (channel_generations_[command.slot] == command.generation &&
+          channel.Valid()) {
+        channel.SetLocation(Location(command));
+      }
+      break;
+    }
+    case kAddListener:
+      listeners_[command.slot] = audio_engine_->AddListener();
+      break;
+    case kRemoveListener:
+      audio_engine_->RemoveListener(&listeners_[command.slot]);
+      listeners_[command.slot] = pindrop::Listener();
+      break;
+    case kSetListenerMatrix: {
+      pindrop::Listener& listener = listeners_[command.slot];
+      if (listener.Valid()) listener.SetMatrix(mathfu::mat4(command.values));
+      break;
+    }
+    case kAdvanceFrame:
+      audio_engine_->AdvanceFrame(command.values[0]);
+      // Let the update thread know which voices ran out.
+      for (int i = 0; i < kMaxVoices; ++i) {
+        if (channel_generations_[i] != 0 && !channels_[i].Valid()) {
+          SDL_AtomicSet(&finished_[i], channel_generations_[i]);
+          channel_generations_[i] = 0;
+        }
+      }
+      break;
+  }
+}
+
+int AudioThread::ThreadMain(void* data) {
+  AudioThread* audio = static_cast<AudioThread*>(data);
+  Profiler::Get().SetThreadName("Audio");
+  while (!SDL_AtomicGet(&audio->exiting_)) {
+    SDL_SemWait(audio->wake_);
+    audio->RunCommands();
+  }
+  return 0;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,179 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_AUDIO_THREAD_H_
+#define ZOOSHI_AUDIO_THREAD_H_
+
+#include <vector>
+#include "SDL_atomic.h"
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
+#include "mathfu/glsl_mappings.h"
+#include "pindrop/pindrop.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A voice started by AudioThread::PlaySound(). Zero is no voice.
+typedef int AudioVoice;
+
+// Advances pindrop on its own thread, so mixing bookkeeping stays out of the
+// update. The sound and listener components queue their plays, stops and
+// moves here instead of calling pindrop, and the audio thread applies them
+// before each AdvanceFrame().
+//
+// Everything but the thread itself is called from the update thread only.
+// The queue has a single producer and a single consumer, so neither side
+// ever waits for the other.
+//
+// Pindrop isn't thread safe, so the audio thread applies commands under a
+// lock. Anything that still calls pindrop directly, such as the states'
+// music and the graphs' play_sound nodes, must hold an AudioEngineLock.
+class AudioThread {
+ public:
+  // The most voices and listeners that can be in use at once.
+  static const int kMaxVoices = 128;
+  static const int kMaxListeners = 4;
+
+  AudioThread();
+  ~AudioThread();
+
+  // Set the engine that commands are applied to. Until Start() is called,
+  // they're applied right away, on the calling thread.
+  void Initialize(pindrop::AudioEngine* audio_engine);
+
+  // Start the thread. If it can't start, commands are still queued, and are
+  // applied by AdvanceFrame() on the calling thread. Either way, commands
+  // are never applied where they're pushed, so the listener can be updated
+  // on a worker while another thread holds the engine lock.
+  void Start();
+
+  // Stop the thread, and apply whatever it didn't get to.
+  void Shutdown();
+
+  // Play `sound` at `location`. Returns zero if every voice is in use.
+  AudioVoice PlaySound(pindrop::SoundHandle sound,
+                       const mathfu::vec3& location);
+
+  // Stop `voice`, and free it for reuse. Must be called for every voice
+  // PlaySound() returns, even once it's no longer Playing().
+  void Stop(AudioVoice voice);
+
+  void SetLocation(AudioVoice voice, const mathfu::vec3& location);
+
+  // Whether `voice` hadn't finished as of the audio thread's last frame.
+  // Voices that haven't started yet are playing.
+  bool Playing(AudioVoice voice) const;
+
+  // Add a listener, and return it, or -1 if there are too many.
+  int AddListener();
+  void RemoveListener(int listener);
+  void SetListenerMatrix(int listener, const mathfu::mat4& matrix);
+
+  // Apply the commands queued so far, and advance pindrop by `delta_time`
+  // seconds. Never blocks.
+  void AdvanceFrame(float delta_time);
+
+  // Hold the lock pindrop is called under. It's recursive, so commands
+  // applied on the calling thread, before Start(), may be pushed with it
+  // held.
+  void LockEngine() { SDL_LockMutex(engine_mutex_); }
+  void UnlockEngine() { SDL_UnlockMutex(engine_mutex_); }
+
+ private:
+  enum CommandType {
+    kPlaySound,
+    kStop,
+    kSetLocation,
+    kAddListener,
+    kRemoveListener,
+    kSetListenerMatrix,
+    kAdvanceFrame
+  };
+
+  struct Command {
+    CommandType type;
+    // The voice or listener slot.
+    int slot;
+    int generation;
+    pindrop::SoundHandle sound;
+    // The location, matrix or delta time.
+    float values[16];
+  };
+
+  static int ThreadMain(void* data);
+  static mathfu::vec3 Location(const Command& command);
+
+  // Queue `command`, or apply it if Start() hasn't been called. If the
+  // queue is full, the command is dropped.
+  void Push(const Command& command);
+
+  // Apply every command queued so far. Called from the audio thread, or
+  // from AdvanceFrame() if the thread couldn't start.
+  void RunCommands();
+  void Execute(const Command& command);
+
+  pindrop::AudioEngine* audio_engine_;
+  SDL_Thread* thread_;
+  // Set by Start(), even if the thread couldn't start, until Shutdown().
+  bool started_;
+  SDL_sem* wake_;
+  SDL_atomic_t exiting_;
+  SDL_mutex* engine_mutex_;
+
+  // Ring buffer of commands. The update thread writes at `tail_` and the
+  // audio thread reads from `head_`; each index is only written by its
+  // side.
+  std::vector<Command> commands_;
+  SDL_atomic_t head_;
+  SDL_atomic_t tail_;
+  bool dropping_;
+
+  // Owned by the update thread.
+  std::vector<int> free_voices_;
+  std::vector<int> free_listeners_;
+  int voice_generations_[kMaxVoices];
+
+  // Owned by the audio thread. The generation of the play each channel is
+  // for, or zero once it's stopped or finished.
+  pindrop::Channel channels_[kMaxVoices];
+  int channel_generations_[kMaxVoices];
+  pindrop::Listener listeners_[kMaxListeners];
+
+  // The generation of the last play of each voice that finished on its own,
+  // written by the audio thread.
+  SDL_atomic_t finished_[kMaxVoices];
+};
+
+// Holds `audio_thread`'s engine lock for as long as it's in scope, so pindrop
+// can be called directly. `audio_thread` may be null, in which case nothing
+// else calls pindrop.
+class AudioEngineLock {
+ public:
+  explicit AudioEngineLock(AudioThread* audio_thread)
+      : audio_thread_(audio_thread) {
+    if (audio_thread_ != nullptr) audio_thread_->LockEngine();
+  }
+  ~AudioEngineLock() {
+    if (audio_thread_ != nullptr) audio_thread_->UnlockEngine();
+  }
+
+ private:
+  AudioThread* audio_thread_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_AUDIO_THREAD_H_
@@ -0,0 +1,179 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "SDL_rwops.h"
+#include "SDL_timer.h"
+#include "camera.h"
+#include "components/player.h"
+#include "components/rail_denizen.h"
+#include "fplbase/utilities.h"
+#include "inputcontrollers/input_recording.h"
+#include "inputcontrollers/scripted_controller.h"
+#include "states/states_common.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+// Seed for rand(), which the game uses for projectile spin, river generation
+// and the like, so every run simulates the same thing.
+static const unsigned int kRandomSeed = 1;
+
+// Used if the game isn't configured with a fixed timestep.
+static const corgi::WorldTime kDefaultStepTime = 16;
+
+void Benchmark::Initialize(World* world, fplbase::AssetManager* asset_manager,
+                           pindrop::AudioEngine* audio_engine) {
+  world_ = world;
+  asset_manager_ = asset_manager;
+  audio_engine_ = audio_engine;
+}
+
+bool Benchmark::Run(const BenchmarkOptions& options) {
+  ReplayController* replay = nullptr;
+  size_t level_index = options.level_index;
+  if (!options.replay_filename.empty()) {
+    replay = new ReplayController();
+    if (!replay->Load(options.replay_filename.c_str())) {
+      delete replay;
+      return false;
+    }
+    level_index = replay->level_index();
+  }
+
+  const WorldDef* world_def = world_->config->world_def();
+  if (level_index >= world_def->levels()->size()) {
+    LogError("Benchmark: there is no level %d.",
+             static_cast<int>(level_index));
+    delete replay;
+    return false;
+  }
+
+  // The loading state would normally finish loading on the render thread.
+  while (!(asset_manager_->TryFinalize() && audio_engine_->TryFinalize())) {
+    SDL_Delay(1);
+  }
+
+  srand(kRandomSeed);
+  world_->level_index = level_index;
+  if (replay != nullptr) {
+    world_->level_seed = replay->level_seed();
+    world_->keep_level_seed = true;
+  }
+  LoadWorldDef(world_, world_def);
+  world_->keep_level_seed = false;
+  if (replay != nullptr) srand(replay->start_seed());
+
+  if (replay != nullptr) {
+    world_->AddController(replay);
+  } else {
+    world_->AddController(new ScriptedController(
+        options.fire_interval, options.sweep_period, options.sweep_angle));
+  }
+  world_->SetActiveController(kControllerScripted);
+  world_->player_component.set_state(kPlayerState_Active);
+
+  Camera camera;
+  world_->services_component.set_camera(&camera);
+  UpdateMainCamera(&camera, world_);
+
+  const RailDenizenData* raft =
+      world_->entity_manager.GetComponentData<RailDenizenData>(
+          world_->services_component.raft_entity());
+  if (raft == nullptr) {
+    LogError("Benchmark: the level has no raft.");
+    return false;
+  }
+
+  const corgi::WorldTime step_time =
+      options.step_time > 0 ? options.step_time : kDefaultStepTime;
+  if (replay != nullptr) {
+    LogInfo("Benchmark: replaying %s on level %d.",
+            options.replay_filename.c_str(), static_cast<int>(level_index));
+  } else {
+    LogInfo("Benchmark: simulating %d laps of level %d, %dms per step.",
+            options.laps, static_cast<int>(level_index), step_time);
+  }
+
+  Profiler& profiler = Profiler::Get();
+  const bool profiler_enabled = profiler.enabled();
+  profiler.set_enabled(true);
+  profiler.ResetThread();
+
+  const uint64_t start = SDL_GetPerformanceCounter();
+  int steps = 0;
+  while (steps < options.max_steps &&
+         (replay != nullptr ? !replay->finished()
+                            : raft->lap_number < options.laps)) {
+    world_->StepComponents(replay != nullptr ? replay->next_delta_time()
+                                             : step_time);
+    StreamLevelSectors(world_, false);
+    UpdateRailVisibility(world_);
+    UpdateMainCamera(&camera, world_);
+    profiler.EndFrame();
+    steps++;
+  }
+  const double seconds =
+      static_cast<double>(SDL_GetPerformanceCounter() - start) /
+      static_cast<double>(SDL_GetPerformanceFrequency());
+
+  if (replay == nullptr && raft->lap_number < options.laps) {
+    LogError("Benchmark: stopped after %d steps, on lap %d.", steps,
+             raft->lap_number);
+  }
+  Report(options, steps, seconds);
+  profiler.set_enabled(profiler_enabled);
+  world_->services_component.set_camera(nullptr);
+  return true;
+}
+
+void Benchmark::Report(const BenchmarkOptions& options, int steps,
+                       double seconds) {
+  std::vector<ProfileSummary> summaries;
+  const int frames = Profiler::Get().GetThreadSummaries(&summaries);
+  const double frames_divisor = frames > 0 ? frames : 1;
+
+  LogInfo("Benchmark: %d steps in %.2fs, %.3fms per step.", steps, seconds,
+          steps > 0 ? seconds * 1000.0 / steps : 0.0);
+  LogInfo("%-36s %10s %10s", "Region", "ms/step", "max ms");
+  std::string csv = "region,depth,ms_per_step,max_ms\n";
+  char buffer[128];
+  for (auto it = summaries.begin(); it != summaries.end(); ++it) {
+    const double ms_per_step = it->total_ms / frames_divisor;
+    LogInfo("%*s%-*s %10.4f %10.4f", 2 * it->depth, "", 36 - 2 * it->depth,
+            it->name, ms_per_step, it->max_ms);
+    snprintf(buffer, sizeof(buffer), "%s,%d,%.4f,%.4f\n", it->name, it->depth,
+             ms_per_step, it->max_ms);
+    csv += buffer;
+  }
+
+  if (options.report_filename.empty()) return;
+  SDL_RWops* file = SDL_RWFromFile(options.report_filename.c_str(), "w");
+  if (file == nullptr) {
+    LogError("Couldn't open %s to write the benchmark report: %s",
+             options.report_filename.c_str(), SDL_GetError());
+    return;
+  }
+  SDL_RWwrite(file, csv.c_str(), 1, csv.size());
+  SDL_RWclose(file);
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,85 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_BENCHMARK_H_
+#define ZOOSHI_BENCHMARK_H_
+
+#include <string>
+#include <vector>
+#include "corgi/entity_manager.h"
+#include "fplbase/asset_manager.h"
+#include "pindrop/pindrop.h"
+#include "profiler.h"
+#include "world.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct BenchmarkOptions {
+  BenchmarkOptions()
+      : laps(3),
+        level_index(1),
+        step_time(0),
+        max_steps(100000),
+        fire_interval(15),
+        sweep_period(240),
+        sweep_angle(0.5f) {}
+
+  // Laps of the raft to simulate.
+  int laps;
+  // Index into the world def's levels.
+  size_t level_index;
+  // Milliseconds simulated per step. If 0, the game's fixed timestep is used.
+  corgi::WorldTime step_time;
+  // Stop after this many steps, even if the laps aren't done.
+  int max_steps;
+  // Settings for the ScriptedController that plays the game.
+  int fire_interval;
+  int sweep_period;
+  float sweep_angle;
+  // If set, the report is also written here as comma separated values.
+  std::string report_filename;
+  // If set, the input recorded here is replayed instead, on the level and
+  // with the step times it was recorded with. The ScriptedController
+  // settings and step_time are ignored, and the run ends with the recording.
+  std::string replay_filename;
+};
+
+// Plays a level of the game with a ScriptedController, or replays a
+// recording of someone playing it, stepping the simulation as fast as
+// possible with nothing rendered. Reports how long each component took per
+// step, to catch performance regressions.
+class Benchmark {
+ public:
+  Benchmark()
+      : world_(nullptr), asset_manager_(nullptr), audio_engine_(nullptr) {}
+
+  void Initialize(World* world, fplbase::AssetManager* asset_manager,
+                  pindrop::AudioEngine* audio_engine);
+
+  // Returns false if the level couldn't be run.
+  bool Run(const BenchmarkOptions& options);
+
+ private:
+  void Report(const BenchmarkOptions& options, int steps, double seconds);
+
+  World* world_;
+  fplbase::AssetManager* asset_manager_;
+  pindrop::AudioEngine* audio_engine_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_BENCHMARK_H_
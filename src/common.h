@@ -26,4 +26,27 @@ struct NormalMappedVertex {
   mathfu::vec4_packed tangent;
 };
 
+// A vertex definition specific to normalmapping with colors.
+struct NormalMappedColorVertex {
+  mathfu::vec3_packed pos;
+  mathfu::vec2_packed tc;
+  mathfu::vec3_packed norm;
+  mathfu::vec4_packed tangent;
+  unsigned char color[4];
+};
+
+// Either vertex above in 32 bytes, for shaders built with
+// PACKED_NORMALS. fplbase has no packed normal attributes, so the normal is
+// sent as the color, and the tangent as the second texture coordinates. The
+// color is dropped, since no mesh shader reads it.
+struct PackedNormalMappedVertex {
+  mathfu::vec3_packed pos;
+  mathfu::vec2_packed tc;
+  // The normal in xyz, and the tangent's handedness in w, each mapped from
+  // -1 to 1 onto 0 to 255.
+  unsigned char norm[4];
+  // The tangent's direction, octahedron encoded.
+  mathfu::vec2_packed tangent;
+};
+
 #endif  // COMMON_H_
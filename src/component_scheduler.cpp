@@ -0,0 +1,107 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "component_scheduler.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "job_system.h"
+
+namespace fpl {
+namespace zooshi {
+
+void ScheduledComponent::UpdateOrDefer(corgi::WorldTime delta_time) {
+  if (scheduler_ == nullptr) {
+    ScheduledUpdate(delta_time);
+  } else {
+    scheduler_->Reached(this, delta_time);
+  }
+}
+
+bool ComponentScheduler::Conflict(const Entry& a, const Entry& b) {
+  return (a.writes & (b.reads | b.writes)) != 0 ||
+         (b.writes & (a.reads | a.writes)) != 0;
+}
+
+void ComponentScheduler::Add(ScheduledComponent* component,
+                             UpdateResourceMask reads,
+                             UpdateResourceMask writes) {
+  assert(component->scheduler_ == nullptr);
+  Entry entry;
+  entry.component = component;
+  entry.reads = reads;
+  entry.writes = writes;
+  entry.reached = false;
+
+  // Run after every earlier component that shares state with this one.
+  entry.wave = 0;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (Conflict(*it, entry)) entry.wave = std::max(entry.wave, it->wave + 1);
+  }
+  num_waves_ = std::max(num_waves_, entry.wave + 1);
+  entries_.push_back(entry);
+  component->scheduler_ = this;
+}
+
+void ComponentScheduler::Reached(ScheduledComponent* component,
+                                 corgi::WorldTime delta_time) {
+  auto entry = std::find_if(
+      entries_.begin(), entries_.end(),
+      [component](const Entry& e) { return e.component == component; });
+  assert(entry != entries_.end());
+
+  // If a component is reached twice before the rest, something other than
+  // EntityManager::UpdateComponents() is updating it. Don't hold it back.
+  if (entry->reached) RunWaves(delta_time);
+
+  entry->reached = true;
+  num_reached_++;
+  if (num_reached_ == static_cast<int>(entries_.size())) {
+    RunWaves(delta_time);
+  }
+}
+
+void ComponentScheduler::RunWaves(corgi::WorldTime delta_time) {
+  std::vector<ScheduledComponent*>& wave_components = wave_components_;
+  for (int wave = 0; wave < num_waves_; ++wave) {
+    wave_components.clear();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->reached && it->wave == wave) {
+        wave_components.push_back(it->component);
+      }
+    }
+    if (job_system_ == nullptr) {
+      for (auto it = wave_components.begin(); it != wave_components.end();
+           ++it) {
+        (*it)->ScheduledUpdate(delta_time);
+      }
+    } else {
+      job_system_->ParallelFor(
+          static_cast<int>(wave_components.size()), 1,
+          [&wave_components, delta_time](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+              wave_components[i]->ScheduledUpdate(delta_time);
+            }
+          });
+    }
+  }
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    it->reached = false;
+  }
+  num_reached_ = 0;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,116 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_COMPONENT_SCHEDULER_H_
+#define ZOOSHI_COMPONENT_SCHEDULER_H_
+
+#include <stdint.h>
+#include <vector>
+#include "corgi/entity_manager.h"
+
+namespace fpl {
+namespace zooshi {
+
+class ComponentScheduler;
+class JobSystem;
+
+// Shared state that scheduled component updates read or write, other than
+// their own component data. Updates that write some state are never run at
+// the same time as updates that read or write it.
+enum UpdateResource {
+  // Position, orientation and scale in TransformData.
+  kUpdateResourceTransformLocal = 1 << 0,
+  // World transforms in TransformData, as calculated by TransformComponent.
+  kUpdateResourceTransformWorld = 1 << 1,
+  // Parents and children in TransformData.
+  kUpdateResourceTransformHierarchy = 1 << 2,
+  // Visibility in RenderMeshData.
+  kUpdateResourceRenderMesh = 1 << 3,
+  // The Bullet physics world.
+  kUpdateResourcePhysics = 1 << 4,
+  // The audio engine.
+  kUpdateResourceAudio = 1 << 5,
+  // EntityManager's list of entities to delete.
+  kUpdateResourceEntityDeletion = 1 << 6,
+  // RailDenizenData.
+  kUpdateResourceRailDenizen = 1 << 7,
+};
+typedef uint32_t UpdateResourceMask;
+
+// A component whose update can be run by a ComponentScheduler, in parallel
+// with other scheduled components that don't share any state with it.
+class ScheduledComponent {
+ public:
+  ScheduledComponent() : scheduler_(nullptr) {}
+  virtual ~ScheduledComponent() {}
+
+  // Does the work of the component's UpdateAllEntities().
+  virtual void ScheduledUpdate(corgi::WorldTime delta_time) = 0;
+
+ protected:
+  // Call from UpdateAllEntities(). If the component isn't scheduled, this
+  // runs ScheduledUpdate() immediately. Otherwise, the scheduler runs it,
+  // along with its other components, once all of them have been reached.
+  void UpdateOrDefer(corgi::WorldTime delta_time);
+
+ private:
+  friend class ComponentScheduler;
+  ComponentScheduler* scheduler_;
+};
+
+// Runs the updates of a set of components in parallel, as far as the state
+// they declare they read and write allows. EntityManager::UpdateComponents()
+// still reaches each component in the order it was registered, but the
+// updates are held back until the last of them is reached. So register a
+// set of components next to each other: anything registered between them
+// would be updated before the earlier ones.
+class ComponentScheduler {
+ public:
+  ComponentScheduler() : job_system_(nullptr), num_waves_(0), num_reached_(0) {}
+
+  void Initialize(JobSystem* job_system) { job_system_ = job_system; }
+
+  // Schedule `component`. Components that share state are run in the order
+  // they were added.
+  void Add(ScheduledComponent* component, UpdateResourceMask reads,
+           UpdateResourceMask writes);
+
+ private:
+  friend class ScheduledComponent;
+
+  struct Entry {
+    ScheduledComponent* component;
+    UpdateResourceMask reads;
+    UpdateResourceMask writes;
+    // Entries in the same wave share no state, so run in parallel.
+    int wave;
+    bool reached;
+  };
+
+  static bool Conflict(const Entry& a, const Entry& b);
+  void Reached(ScheduledComponent* component, corgi::WorldTime delta_time);
+  void RunWaves(corgi::WorldTime delta_time);
+
+  JobSystem* job_system_;
+  std::vector<Entry> entries_;
+  int num_waves_;
+  // Scratch buffer for RunWaves(), kept to reuse its allocation.
+  std::vector<ScheduledComponent*> wave_components_;
+  int num_reached_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_COMPONENT_SCHEDULER_H_
@@ -15,6 +15,7 @@
 #include "components/attributes.h"
 
 #include "breadboard/event.h"
+#include "components/export_builder.h"
 #include "components/services.h"
 #include "corgi_component_library/graph.h"
 #include "flatui/flatui.h"
@@ -44,10 +45,11 @@ corgi::ComponentInterface::RawDataUniquePtr AttributesComponent::ExportRawData(
     const corgi::EntityRef& entity) const {
   if (GetComponentData(entity) == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
 
   fbb.Finish(CreateAttributesDef(fbb));
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 }  // zooshi
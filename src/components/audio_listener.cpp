@@ -13,10 +13,10 @@
 // limitations under the License.
 
 #include "components/audio_listener.h"
+#include "components/export_builder.h"
 #include "components/services.h"
 #include "corgi/entity_common.h"
 #include "corgi_component_library/transform.h"
-#include "pindrop/pindrop.h"
 
 CORGI_DEFINE_COMPONENT(fpl::zooshi::AudioListenerComponent,
                        fpl::zooshi::AudioListenerData)
@@ -27,12 +27,23 @@ namespace zooshi {
 using corgi::component_library::TransformComponent;
 using corgi::component_library::TransformData;
 
+static bool SameMatrix(const mathfu::mat4& a, const mathfu::mat4& b) {
+  for (int i = 0; i < 16; ++i) {
+    if (a[i] != b[i]) return false;
+  }
+  return true;
+}
+
 void AudioListenerComponent::Init() {
-  audio_engine_ =
-      entity_manager_->GetComponent<ServicesComponent>()->audio_engine();
+  audio_thread_ =
+      entity_manager_->GetComponent<ServicesComponent>()->audio_thread();
+}
+
+void AudioListenerComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
+  UpdateOrDefer(delta_time);
 }
 
-void AudioListenerComponent::UpdateAllEntities(
+void AudioListenerComponent::ScheduledUpdate(
     corgi::WorldTime /*delta_time*/) {
   TransformComponent* transform_component =
       entity_manager_->GetComponent<TransformComponent>();
@@ -40,20 +51,29 @@ void AudioListenerComponent::UpdateAllEntities(
        ++iter) {
     corgi::EntityRef& entity = iter->entity;
     AudioListenerData* listener_data = Data<AudioListenerData>(entity);
-    assert(listener_data->listener.Valid());
-    mathfu::mat4 listener_matrix = transform_component->WorldTransform(entity);
-    listener_data->listener.SetMatrix(listener_matrix);
+    if (listener_data->listener < 0) continue;
+    const mathfu::mat4 listener_matrix =
+        transform_component->WorldTransform(entity);
+    if (listener_data->placed &&
+        SameMatrix(listener_matrix, listener_data->listener_matrix)) {
+      continue;
+    }
+    listener_data->listener_matrix = listener_matrix;
+    listener_data->placed = true;
+    audio_thread_->SetListenerMatrix(listener_data->listener,
+                                     listener_matrix);
   }
 }
 
 void AudioListenerComponent::InitEntity(corgi::EntityRef& entity) {
   AudioListenerData* listener_data = Data<AudioListenerData>(entity);
-  listener_data->listener = audio_engine_->AddListener();
+  listener_data->listener = audio_thread_->AddListener();
 }
 
 void AudioListenerComponent::CleanupEntity(corgi::EntityRef& entity) {
   AudioListenerData* listener_data = Data<AudioListenerData>(entity);
-  audio_engine_->RemoveListener(&listener_data->listener);
+  audio_thread_->RemoveListener(listener_data->listener);
+  listener_data->listener = -1;
 }
 
 void AudioListenerComponent::AddFromRawData(corgi::EntityRef& entity,
@@ -66,10 +86,11 @@ corgi::ComponentInterface::RawDataUniquePtr
 AudioListenerComponent::ExportRawData(const corgi::EntityRef& entity) const {
   if (GetComponentData(entity) == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
 
   fbb.Finish(CreateListenerDef(fbb));
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 }  // zooshi
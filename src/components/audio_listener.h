@@ -15,20 +15,30 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_LISTENER_H_
 #define FPL_ZOOSHI_COMPONENTS_LISTENER_H_
 
+#include "audio_thread.h"
+#include "component_scheduler.h"
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "corgi/entity_manager.h"
-#include "pindrop/pindrop.h"
+#include "mathfu/glsl_mappings.h"
 
 namespace fpl {
 namespace zooshi {
 
 // Data for scene object components.
 struct AudioListenerData {
-  pindrop::Listener listener;
+  AudioListenerData() : listener(-1), placed(false) {}
+
+  // The listener on the audio thread, or -1 if there were too many.
+  int listener;
+  // The world transform last given to the listener. Pindrop inverts the
+  // matrix it's given, so it's only updated when the entity has moved.
+  mathfu::mat4 listener_matrix;
+  bool placed;
 };
 
-class AudioListenerComponent : public corgi::Component<AudioListenerData> {
+class AudioListenerComponent : public corgi::Component<AudioListenerData>,
+                               public ScheduledComponent {
  public:
   virtual ~AudioListenerComponent() {}
 
@@ -39,9 +49,10 @@ class AudioListenerComponent : public corgi::Component<AudioListenerData> {
 
   virtual void CleanupEntity(corgi::EntityRef& entity);
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+  virtual void ScheduledUpdate(corgi::WorldTime delta_time);
 
  private:
-  pindrop::AudioEngine* audio_engine_;
+  AudioThread* audio_thread_;
 };
 
 }  // zooshi
@@ -0,0 +1,232 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/entity_pool.h"
+
+#include <algorithm>
+#include "components/services.h"
+#include "components/sound.h"
+#include "components/time_limit.h"
+#include "corgi_component_library/animation.h"
+#include "corgi_component_library/graph.h"
+#include "corgi_component_library/physics.h"
+#include "corgi_component_library/rendermesh.h"
+#include "fplbase/utilities.h"
+
+CORGI_DEFINE_COMPONENT(fpl::zooshi::EntityPoolComponent,
+                       fpl::zooshi::PooledEntityData)
+
+namespace fpl {
+namespace zooshi {
+
+using corgi::component_library::AnimationComponent;
+using corgi::component_library::AnimationData;
+using corgi::component_library::GraphComponent;
+using corgi::component_library::PhysicsComponent;
+using corgi::component_library::PhysicsData;
+using corgi::component_library::RenderMeshComponent;
+using fplbase::LogInfo;
+
+void EntityPoolComponent::CleanupEntity(corgi::EntityRef& entity) {
+  PooledEntityData* pooled_data = GetComponentData(entity);
+  if (pooled_data->active) pools_[pooled_data->pool].stats.active--;
+}
+
+void EntityPoolComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
+  for (auto it = released_.begin(); it != released_.end(); ++it) {
+    if (!it->IsValid()) continue;
+    Pool& pool = pools_[GetComponentData(*it)->pool];
+    if (pool.inactive.size() >= static_cast<size_t>(pool.capacity)) {
+      pool.stats.discarded++;
+      entity_manager_->DeleteEntity(*it);
+      continue;
+    }
+    SetActive(*it, false);
+    pool.inactive.push_back(*it);
+  }
+  released_.clear();
+}
+
+int EntityPoolComponent::FindPool(const char* prototype) {
+  auto it = pool_indices_.find(prototype);
+  if (it != pool_indices_.end()) return it->second;
+
+  Pool pool;
+  pool.prototype = prototype;
+  pool.flat_prototype = prototype_cache_ != nullptr
+                            ? prototype_cache_->Find(prototype)
+                            : nullptr;
+  pool.capacity = config_ != nullptr ? config_->default_capacity() : 16;
+  pool.animation = -1;
+  if (config_ != nullptr && config_->pools() != nullptr) {
+    for (auto def = config_->pools()->begin(); def != config_->pools()->end();
+         ++def) {
+      if (def->prototype() == nullptr || def->prototype()->str() != prototype) {
+        continue;
+      }
+      if (def->capacity() > 0) pool.capacity = def->capacity();
+      pool.animation = def->animation();
+    }
+  }
+  const int index = static_cast<int>(pools_.size());
+  pools_.push_back(pool);
+  pool_indices_[prototype] = index;
+  return index;
+}
+
+void EntityPoolComponent::Prewarm(const char* prototype, int count) {
+  const int pool_index = FindPool(prototype);
+  Pool& pool = pools_[pool_index];
+
+  // Drop entities that were deleted along with the level they were made for.
+  size_t kept = 0;
+  for (size_t i = 0; i < pool.inactive.size(); ++i) {
+    if (pool.inactive[i].IsValid()) pool.inactive[kept++] = pool.inactive[i];
+  }
+  pool.inactive.resize(kept);
+
+  while (pool.inactive.size() < static_cast<size_t>(count)) {
+    corgi::EntityRef entity = Create(pool_index);
+    SetActive(entity, false);
+    pool.inactive.push_back(entity);
+  }
+}
+
+void EntityPoolComponent::PrewarmConfigured() {
+  if (config_ == nullptr || config_->pools() == nullptr) return;
+  for (auto def = config_->pools()->begin(); def != config_->pools()->end();
+       ++def) {
+    if (def->prototype() != nullptr && def->prewarm() > 0) {
+      Prewarm(def->prototype()->c_str(), def->prewarm());
+    }
+  }
+}
+
+corgi::EntityRef EntityPoolComponent::Acquire(const char* prototype) {
+  const int pool_index = FindPool(prototype);
+  Pool& pool = pools_[pool_index];
+  corgi::EntityRef entity;
+  while (!pool.inactive.empty() && !entity.IsValid()) {
+    entity = pool.inactive.back();
+    pool.inactive.pop_back();
+  }
+  if (entity.IsValid()) {
+    pool.stats.reused++;
+    SetActive(entity, true);
+  } else {
+    entity = Create(pool_index);
+  }
+  pool.stats.peak_active = std::max(pool.stats.peak_active, pool.stats.active);
+  return entity;
+}
+
+void EntityPoolComponent::Release(corgi::EntityRef entity) {
+  PooledEntityData* pooled_data = GetComponentData(entity);
+  if (pooled_data == nullptr) {
+    entity_manager_->DeleteEntity(entity);
+    return;
+  }
+  if (!pooled_data->active) return;
+  pooled_data->active = false;
+  Pool& pool = pools_[pooled_data->pool];
+  pool.stats.active--;
+  pool.stats.released++;
+  released_.push_back(entity);
+}
+
+bool EntityPoolComponent::IsActive(const corgi::EntityRef& entity) const {
+  const PooledEntityData* pooled_data = GetComponentData(entity);
+  return pooled_data == nullptr || pooled_data->active;
+}
+
+const EntityPoolStats* EntityPoolComponent::Stats(
+    const char* prototype) const {
+  auto it = pool_indices_.find(prototype);
+  return it == pool_indices_.end() ? nullptr : &pools_[it->second].stats;
+}
+
+void EntityPoolComponent::LogStats() const {
+  for (auto it = pools_.begin(); it != pools_.end(); ++it) {
+    const EntityPoolStats& stats = it->stats;
+    LogInfo(
+        "Entity pool %s: %d created, %d reused, %d released, %d discarded, "
+        "%d active (%d peak), %d inactive of %d",
+        it->prototype.c_str(), stats.created, stats.reused, stats.released,
+        stats.discarded, stats.active, stats.peak_active,
+        static_cast<int>(it->inactive.size()), it->capacity);
+  }
+}
+
+void EntityPoolComponent::ResetStats() {
+  for (auto it = pools_.begin(); it != pools_.end(); ++it) {
+    const int active = it->stats.active;
+    it->stats = EntityPoolStats();
+    it->stats.active = active;
+    it->stats.peak_active = active;
+  }
+}
+
+corgi::EntityRef EntityPoolComponent::Create(int pool_index) {
+  Pool& pool = pools_[pool_index];
+  corgi::EntityRef entity =
+      pool.flat_prototype != nullptr
+          ? prototype_cache_->Create(*pool.flat_prototype, entity_manager_)
+          : entity_manager_->GetComponent<ServicesComponent>()
+                ->entity_factory()
+                ->CreateEntityFromPrototype(pool.prototype.c_str(),
+                                            entity_manager_);
+  entity_manager_->GetComponent<GraphComponent>()->EntityPostLoadFixup(entity);
+  PooledEntityData* pooled_data = AddEntity(entity);
+  pooled_data->pool = pool_index;
+  pooled_data->active = true;
+  pool.stats.created++;
+  pool.stats.active++;
+  return entity;
+}
+
+void EntityPoolComponent::SetActive(corgi::EntityRef& entity, bool active) {
+  PooledEntityData* pooled_data = GetComponentData(entity);
+  const Pool& pool = pools_[pooled_data->pool];
+  if (active && !pooled_data->active) pools_[pooled_data->pool].stats.active++;
+  if (!active && pooled_data->active) pools_[pooled_data->pool].stats.active--;
+  pooled_data->active = active;
+
+  if (Data<PhysicsData>(entity) != nullptr) {
+    PhysicsComponent* physics_component =
+        entity_manager_->GetComponent<PhysicsComponent>();
+    if (active) {
+      physics_component->EnablePhysics(entity);
+    } else {
+      physics_component->DisablePhysics(entity);
+    }
+  }
+  entity_manager_->GetComponent<RenderMeshComponent>()
+      ->SetVisibilityRecursively(entity, active);
+  entity_manager_->GetComponent<TimeLimitComponent>()->Restart(entity,
+                                                               active);
+  SoundComponent* sound_component =
+      entity_manager_->GetComponent<SoundComponent>();
+  if (active) {
+    sound_component->Play(entity);
+  } else {
+    sound_component->Stop(entity);
+  }
+  if (active && pool.animation >= 0 && Data<AnimationData>(entity) != nullptr) {
+    entity_manager_->GetComponent<AnimationComponent>()->AnimateFromTable(
+        entity, pool.animation);
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,149 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_ZOOSHI_COMPONENTS_ENTITY_POOL_H_
+#define FPL_ZOOSHI_COMPONENTS_ENTITY_POOL_H_
+
+#include <assert.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "config_generated.h"
+#include "corgi/component.h"
+#include "corgi/entity_manager.h"
+#include "prototype_cache.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Counts of what a pool has done since the level loaded.
+struct EntityPoolStats {
+  EntityPoolStats()
+      : created(0), reused(0), released(0), discarded(0), active(0),
+        peak_active(0) {}
+
+  // Entities made from the prototype, including prewarmed ones.
+  int created;
+  // Acquisitions served by an inactive entity.
+  int reused;
+  int released;
+  // Released entities that were deleted, since the pool was full.
+  int discarded;
+  // Entities acquired and not yet released, and the most there have been.
+  int active;
+  int peak_active;
+};
+
+// Added to each entity a pool made.
+struct PooledEntityData {
+  PooledEntityData() : pool(-1), active(true) {}
+
+  // Index of the pool the entity is returned to.
+  int pool;
+  // False while the entity waits in its pool.
+  bool active;
+};
+
+// Keeps inactive entities for each prototype that's spawned while playing,
+// so spawning reuses one instead of creating an entity from its prototype,
+// and keeps the entity manager's allocations steady. Inactive entities are
+// hidden, and have no physics, sound or time limit.
+//
+// Reused entities also keep their graph instances. The graph factory loads
+// each graph's definition once and shares it, so an entity only owns its
+// graph's node state, and that is initialized once, when the pool creates it.
+//
+// Reach it through ServicesComponent::entity_pool(). Like the services, no
+// entity data is loaded for it.
+class EntityPoolComponent : public corgi::Component<PooledEntityData> {
+ public:
+  EntityPoolComponent() : config_(nullptr), prototype_cache_(nullptr) {}
+  virtual ~EntityPoolComponent() {}
+
+  // `config` may be null, in which case every pool has the default capacity.
+  void Configure(const EntityPoolConfig* config) { config_ = config; }
+
+  // Entities are created from `prototype_cache` when it has their prototype,
+  // and through the entity factory otherwise. May be null.
+  void set_prototype_cache(PrototypeCache* prototype_cache) {
+    prototype_cache_ = prototype_cache;
+  }
+
+  virtual void AddFromRawData(corgi::EntityRef& /*entity*/,
+                              const void* /*raw_data*/) {
+    assert(false);
+  }
+  virtual void InitEntity(corgi::EntityRef& /*entity*/) {}
+  virtual void CleanupEntity(corgi::EntityRef& entity);
+
+  // Return the entities released since the last update to their pools.
+  virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+
+  // Fill `prototype`'s pool with up to `count` inactive entities.
+  void Prewarm(const char* prototype, int count);
+
+  // Prewarm the configured pools. Call after loading a level, since that
+  // deletes every pooled entity.
+  void PrewarmConfigured();
+
+  // Take an entity from `prototype`'s pool, or create one if the pool is
+  // empty. The caller places it.
+  corgi::EntityRef Acquire(const char* prototype);
+
+  // Return an entity to its pool, or delete it if it didn't come from one.
+  // Like deletion, this takes effect at the next update, since it may be
+  // called while physics handles collisions. For scheduled updates, this
+  // counts as kUpdateResourceEntityDeletion.
+  void Release(corgi::EntityRef entity);
+
+  // False for pooled entities that are waiting to be acquired.
+  bool IsActive(const corgi::EntityRef& entity) const;
+
+  // Null if nothing has been made from `prototype`.
+  const EntityPoolStats* Stats(const char* prototype) const;
+  void LogStats() const;
+
+  // Forget the stats, such as when a level loads.
+  void ResetStats();
+
+ private:
+  struct Pool {
+    std::string prototype;
+    // Null if the prototype isn't in the cache.
+    const FlatPrototype* flat_prototype;
+    int capacity;
+    int animation;
+    std::vector<corgi::EntityRef> inactive;
+    EntityPoolStats stats;
+  };
+
+  int FindPool(const char* prototype);
+  corgi::EntityRef Create(int pool_index);
+  void SetActive(corgi::EntityRef& entity, bool active);
+
+  const EntityPoolConfig* config_;
+  PrototypeCache* prototype_cache_;
+  std::vector<Pool> pools_;
+  std::map<std::string, int> pool_indices_;
+  // Entities to return to their pools at the next update.
+  std::vector<corgi::EntityRef> released_;
+};
+
+}  // zooshi
+}  // fpl
+
+CORGI_REGISTER_COMPONENT(fpl::zooshi::EntityPoolComponent,
+                         fpl::zooshi::PooledEntityData)
+
+#endif  // FPL_ZOOSHI_COMPONENTS_ENTITY_POOL_H_
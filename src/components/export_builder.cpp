@@ -0,0 +1,77 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/export_builder.h"
+
+#include <string.h>
+#include <vector>
+#include "SDL_mutex.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Idle builders kept for reuse. Exports are normally made one at a time, so
+// a few covers any overlap.
+static const size_t kMaxPooledBuilders = 4;
+
+// Builders past this size are freed instead of pooled, so one huge export
+// doesn't pin its memory.
+static const size_t kMaxPooledBuilderSize = 64 * 1024;
+
+// Created on first use, and kept until exit.
+static SDL_mutex* PoolMutex() {
+  static SDL_mutex* mutex = SDL_CreateMutex();
+  return mutex;
+}
+
+static std::vector<flatbuffers::FlatBufferBuilder*>& Pool() {
+  static std::vector<flatbuffers::FlatBufferBuilder*> pool;
+  return pool;
+}
+
+ExportBuilder::ExportBuilder() : fbb_(nullptr) {
+  SDL_LockMutex(PoolMutex());
+  std::vector<flatbuffers::FlatBufferBuilder*>& pool = Pool();
+  if (!pool.empty()) {
+    fbb_ = pool.back();
+    pool.pop_back();
+  }
+  SDL_UnlockMutex(PoolMutex());
+  if (fbb_ == nullptr) fbb_ = new flatbuffers::FlatBufferBuilder();
+}
+
+ExportBuilder::~ExportBuilder() {
+  if (fbb_->GetSize() <= kMaxPooledBuilderSize) {
+    fbb_->Clear();
+    SDL_LockMutex(PoolMutex());
+    std::vector<flatbuffers::FlatBufferBuilder*>& pool = Pool();
+    if (pool.size() < kMaxPooledBuilders) {
+      pool.push_back(fbb_);
+      fbb_ = nullptr;
+    }
+    SDL_UnlockMutex(PoolMutex());
+  }
+  delete fbb_;
+}
+
+corgi::ComponentInterface::RawDataUniquePtr ExportBuilder::Release() {
+  const size_t size = fbb_->GetSize();
+  uint8_t* data = new uint8_t[size];
+  memcpy(data, fbb_->GetBufferPointer(), size);
+  return corgi::ComponentInterface::RawDataUniquePtr(
+      data, [](uint8_t* buffer) { delete[] buffer; });
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,51 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_ZOOSHI_COMPONENTS_EXPORT_BUILDER_H_
+#define FPL_ZOOSHI_COMPONENTS_EXPORT_BUILDER_H_
+
+#include "corgi/component.h"
+#include "flatbuffers/flatbuffers.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A FlatBufferBuilder for ExportRawData(), borrowed from a pool shared by
+// every component. Saving a scene exports each component of each entity, so
+// a fresh builder apiece spent most of the save growing new buffers. Pooled
+// builders keep the storage they've grown, and Release() copies the finished
+// definition into an allocation of just its size.
+//
+// Safe to use from any thread.
+class ExportBuilder {
+ public:
+  ExportBuilder();
+  ~ExportBuilder();
+
+  flatbuffers::FlatBufferBuilder& fbb() { return *fbb_; }
+
+  // A copy of the finished buffer, which the caller owns.
+  corgi::ComponentInterface::RawDataUniquePtr Release();
+
+ private:
+  ExportBuilder(const ExportBuilder&);
+  ExportBuilder& operator=(const ExportBuilder&);
+
+  flatbuffers::FlatBufferBuilder* fbb_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // FPL_ZOOSHI_COMPONENTS_EXPORT_BUILDER_H_
@@ -14,6 +14,8 @@
 
 #include "components/lap_dependent.h"
 
+#include <algorithm>
+#include "components/export_builder.h"
 #include "components/rail_denizen.h"
 #include "components/services.h"
 #include "corgi_component_library/physics.h"
@@ -46,6 +48,7 @@ void LapDependentComponent::AddFromRawData(corgi::EntityRef& entity,
   LapDependentData* lap_dependent_data = AddEntity(entity);
   lap_dependent_data->min_lap = lap_dependent_def->min_lap();
   lap_dependent_data->max_lap = lap_dependent_def->max_lap();
+  dirty_ = true;
 }
 
 corgi::ComponentInterface::RawDataUniquePtr
@@ -53,17 +56,22 @@ LapDependentComponent::ExportRawData(const corgi::EntityRef& entity) const {
   const LapDependentData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
   LapDependentDefBuilder builder(fbb);
   builder.add_min_lap(data->min_lap);
   builder.add_max_lap(data->max_lap);
 
   fbb.Finish(builder.Finish());
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 void LapDependentComponent::InitEntity(corgi::EntityRef& /*entity*/) {}
 
+void LapDependentComponent::CleanupEntity(corgi::EntityRef& /*entity*/) {
+  dirty_ = true;
+}
+
 void LapDependentComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
   corgi::EntityRef raft =
       entity_manager_->GetComponent<ServicesComponent>()->raft_entity();
@@ -72,32 +80,64 @@ void LapDependentComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
   float lap = raft_rail_denizen != nullptr
                   ? raft_rail_denizen->total_lap_progress
                   : 0.0f;
+
+  // Lap progress only goes backwards when a game restarts or the editor moves
+  // the raft, so then everything is updated.
+  if (dirty_ || lap < lap_) {
+    Rebuild(lap);
+    return;
+  }
+
+  // Activate the entities whose windows were entered, unless they were also
+  // left since the last update.
+  for (; next_activation_ < starts_.size() &&
+         starts_[next_activation_].lap <= lap;
+       ++next_activation_) {
+    corgi::EntityRef& entity = starts_[next_activation_].entity;
+    LapDependentData* data = GetComponentData(entity);
+    if (lap <= data->max_lap && !data->currently_active) {
+      ActivateEntity(entity);
+    }
+  }
+  for (; next_deactivation_ < ends_.size() &&
+         ends_[next_deactivation_].lap < lap;
+       ++next_deactivation_) {
+    corgi::EntityRef& entity = ends_[next_deactivation_].entity;
+    if (GetComponentData(entity)->currently_active) DeactivateEntity(entity);
+  }
+  lap_ = lap;
+}
+
+void LapDependentComponent::Rebuild(float lap) {
+  starts_.clear();
+  ends_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
     LapDependentData* data = GetComponentData(iter->entity);
+    const LapEdge start = {data->min_lap, iter->entity};
+    const LapEdge end = {data->max_lap, iter->entity};
+    starts_.push_back(start);
+    ends_.push_back(end);
+
     if (lap >= data->min_lap && lap <= data->max_lap) {
-      if (data->currently_active) continue;
-      data->currently_active = true;
-      auto rm_component = entity_manager_->GetComponent<RenderMeshComponent>();
-      if (rm_component) {
-        rm_component->SetVisibilityRecursively(iter->entity, true);
-      }
-      auto phys_component = entity_manager_->GetComponent<PhysicsComponent>();
-      if (phys_component) {
-        phys_component->EnablePhysics(iter->entity);
-      }
+      if (!data->currently_active) ActivateEntity(iter->entity);
     } else if (data->currently_active) {
-      data->currently_active = false;
-      auto rm_component = entity_manager_->GetComponent<RenderMeshComponent>();
-      if (rm_component) {
-        rm_component->SetVisibilityRecursively(iter->entity, false);
-      }
-      auto phys_component = entity_manager_->GetComponent<PhysicsComponent>();
-      if (phys_component) {
-        phys_component->DisablePhysics(iter->entity);
-      }
+      DeactivateEntity(iter->entity);
     }
   }
+  std::sort(starts_.begin(), starts_.end());
+  std::sort(ends_.begin(), ends_.end());
+
+  // Windows that start at or before `lap` have been entered, and windows that
+  // end before it have been left.
+  const LapEdge current = {lap, corgi::EntityRef()};
+  next_activation_ = static_cast<size_t>(
+      std::upper_bound(starts_.begin(), starts_.end(), current) -
+      starts_.begin());
+  next_deactivation_ = static_cast<size_t>(
+      std::lower_bound(ends_.begin(), ends_.end(), current) - ends_.begin());
+  lap_ = lap;
+  dirty_ = false;
 }
 
 void LapDependentComponent::ActivateAllEntities() {
@@ -106,6 +146,7 @@ void LapDependentComponent::ActivateAllEntities() {
        ++iter) {
     ActivateEntity(iter->entity);
   }
+  dirty_ = true;
 }
 
 void LapDependentComponent::DeactivateAllEntities() {
@@ -114,6 +155,7 @@ void LapDependentComponent::DeactivateAllEntities() {
        ++iter) {
     DeactivateEntity(iter->entity);
   }
+  dirty_ = true;
 }
 
 void LapDependentComponent::ActivateEntity(corgi::EntityRef& entity) {
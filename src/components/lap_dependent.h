@@ -15,6 +15,7 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_LAP_DEPENDENT_H_
 #define FPL_ZOOSHI_COMPONENTS_LAP_DEPENDENT_H_
 
+#include <vector>
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "corgi/entity_manager.h"
@@ -30,22 +31,50 @@ struct LapDependentData {
   bool currently_active;
 };
 
+// Shows entities, and enables their physics, while the raft's lap progress
+// is within their lap window.
+//
+// Entities are kept sorted by where their windows start and end, so as the
+// raft moves forward, only the entities whose windows it has just crossed
+// into or out of are looked at.
 class LapDependentComponent : public corgi::Component<LapDependentData> {
  public:
+  LapDependentComponent()
+      : next_activation_(0), next_deactivation_(0), lap_(0.0f), dirty_(true) {}
   virtual ~LapDependentComponent() {}
 
   virtual void Init();
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* raw_data);
   virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
   virtual void InitEntity(corgi::EntityRef& entity);
+  virtual void CleanupEntity(corgi::EntityRef& entity);
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
 
   void ActivateAllEntities();
   void DeactivateAllEntities();
 
  private:
+  // Where an entity's lap window starts or ends.
+  struct LapEdge {
+    float lap;
+    corgi::EntityRef entity;
+    bool operator<(const LapEdge& other) const { return lap < other.lap; }
+  };
+
   void ActivateEntity(corgi::EntityRef& entity);
   void DeactivateEntity(corgi::EntityRef& entity);
+  // Sort the lap windows again, and update every entity for `lap`.
+  void Rebuild(float lap);
+
+  // Sorted by lap. Edges before the cursors have been passed.
+  std::vector<LapEdge> starts_;
+  std::vector<LapEdge> ends_;
+  size_t next_activation_;
+  size_t next_deactivation_;
+  // The lap progress the entities were last updated for.
+  float lap_;
+  // Set when entities or their windows change.
+  bool dirty_;
 };
 
 }  // zooshi
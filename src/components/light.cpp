@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "components/light.h"
+#include "components/export_builder.h"
 #include "components/services.h"
 #include "flatbuffers/flatbuffers.h"
 #include "fplbase/flatbuffer_utils.h"
@@ -48,7 +49,8 @@ corgi::ComponentInterface::RawDataUniquePtr LightComponent::ExportRawData(
   const LightData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
 
   LightDefBuilder builder(fbb);
   builder.add_shadow_intensity(data->shadow_intensity);
@@ -64,7 +66,7 @@ corgi::ComponentInterface::RawDataUniquePtr LightComponent::ExportRawData(
   builder.add_specular_intensity(data->specular_intensity);
 
   fbb.Finish(builder.Finish());
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 }  // zooshi
@@ -0,0 +1,343 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "components/particles.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include "components/export_builder.h"
+#include "corgi_component_library/transform.h"
+#include "flatbuffers/flatbuffers.h"
+#include "fplbase/flatbuffer_utils.h"
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+#include "mathfu/utilities.h"
+
+CORGI_DEFINE_COMPONENT(fpl::zooshi::ParticleEmitterComponent,
+                       fpl::zooshi::ParticleEmitterData)
+
+using corgi::component_library::TransformComponent;
+using fplbase::ColorRGBA;
+using fplbase::Vec4ToColorRGBA;
+using mathfu::vec3;
+using mathfu::vec4;
+
+namespace fpl {
+namespace zooshi {
+
+static const char* kParticleShaderName = "shaders/particle";
+// Particles are indexed with 16 bits.
+static const size_t kMaxParticles = 0x10000 / 4;
+static const float kPi = 3.14159265f;
+
+// The uniforms are looked up by name, as there are only a few per effect.
+static void SetUniform(fplbase::Shader* shader, const char* name,
+                       float value) {
+  fplbase::UniformHandle handle = shader->FindUniform(name);
+  if (fplbase::ValidUniformHandle(handle)) {
+    shader->SetUniform(handle, &value, 1);
+  }
+}
+
+static void SetUniform(fplbase::Shader* shader, const char* name,
+                       const vec3& value) {
+  fplbase::UniformHandle handle = shader->FindUniform(name);
+  const float values[] = {value.x, value.y, value.z};
+  if (fplbase::ValidUniformHandle(handle)) {
+    shader->SetUniform(handle, values, 3);
+  }
+}
+
+static void SetUniform(fplbase::Shader* shader, const char* name,
+                       const vec4& value) {
+  fplbase::UniformHandle handle = shader->FindUniform(name);
+  const float values[] = {value.x, value.y, value.z, value.w};
+  if (fplbase::ValidUniformHandle(handle)) {
+    shader->SetUniform(handle, values, 4);
+  }
+}
+
+ParticleEmitterComponent::~ParticleEmitterComponent() {
+  for (auto it = effects_.begin(); it != effects_.end(); ++it) {
+    if (it->second.vertex_buffer != 0) {
+      GL_CALL(glDeleteBuffers(1, &it->second.vertex_buffer));
+    }
+  }
+  if (index_buffer_ != 0) GL_CALL(glDeleteBuffers(1, &index_buffer_));
+}
+
+void ParticleEmitterComponent::Init() {
+  services_ = entity_manager_->GetComponent<ServicesComponent>();
+}
+
+void ParticleEmitterComponent::AddFromRawData(corgi::EntityRef& entity,
+                                              const void* raw_data) {
+  auto emitter_def = static_cast<const ParticleEmitterDef*>(raw_data);
+  ParticleEmitterData* data = AddEntity(entity);
+  data->effect =
+      emitter_def->effect() != nullptr ? emitter_def->effect()->c_str() : "";
+  data->count = emitter_def->count();
+  data->lifetime = emitter_def->lifetime();
+  data->speed = emitter_def->speed();
+  data->spread = emitter_def->spread();
+  data->gravity = emitter_def->gravity();
+  data->start_size = emitter_def->start_size();
+  data->end_size = emitter_def->end_size();
+  if (emitter_def->start_color() != nullptr) {
+    data->start_color = LoadColorRGBA(emitter_def->start_color());
+  }
+  if (emitter_def->end_color() != nullptr) {
+    data->end_color = LoadColorRGBA(emitter_def->end_color());
+  }
+  if (emitter_def->offset() != nullptr) {
+    data->offset = LoadVec3(emitter_def->offset());
+  }
+
+  // The effect's look is fixed by the first emitter that uses it.
+  Effect& effect = effects_[data->effect];
+  if (effect.params.count == 0) effect.params = *data;
+}
+
+corgi::ComponentInterface::RawDataUniquePtr
+ParticleEmitterComponent::ExportRawData(const corgi::EntityRef& entity) const {
+  const ParticleEmitterData* data = GetComponentData(entity);
+  if (data == nullptr) return nullptr;
+
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
+  auto effect = fbb.CreateString(data->effect);
+  const ColorRGBA start_color = Vec4ToColorRGBA(data->start_color);
+  const ColorRGBA end_color = Vec4ToColorRGBA(data->end_color);
+  const fplbase::Vec3 offset(data->offset.x, data->offset.y, data->offset.z);
+
+  ParticleEmitterDefBuilder builder(fbb);
+  builder.add_effect(effect);
+  builder.add_count(data->count);
+  builder.add_lifetime(data->lifetime);
+  builder.add_speed(data->speed);
+  builder.add_spread(data->spread);
+  builder.add_gravity(data->gravity);
+  builder.add_start_size(data->start_size);
+  builder.add_end_size(data->end_size);
+  builder.add_start_color(&start_color);
+  builder.add_end_color(&end_color);
+  builder.add_offset(&offset);
+  fbb.Finish(builder.Finish());
+  return export_builder.Release();
+}
+
+void ParticleEmitterComponent::InitEntity(corgi::EntityRef& entity) {
+  entity_manager_->AddEntityToComponent<TransformComponent>(entity);
+}
+
+void ParticleEmitterComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
+  time_ += static_cast<float>(delta_time) / 1000.0f;
+  ExpireBursts();
+}
+
+void ParticleEmitterComponent::ExpireBursts() {
+  bool any_alive = false;
+  for (auto it = effects_.begin(); it != effects_.end(); ++it) {
+    Effect& effect = it->second;
+    size_t expired = 0;
+    while (expired < effect.burst_times.size() &&
+           effect.burst_times[expired] + effect.params.lifetime <= time_) {
+      ++expired;
+    }
+    if (expired > 0) {
+      effect.burst_times.erase(effect.burst_times.begin(),
+                               effect.burst_times.begin() + expired);
+      effect.vertices.erase(
+          effect.vertices.begin(),
+          effect.vertices.begin() + expired * effect.params.count * 4);
+      effect.uploaded = false;
+    }
+    any_alive = any_alive || !effect.burst_times.empty();
+  }
+  if (!any_alive) time_ = 0.0f;
+}
+
+void ParticleEmitterComponent::Burst(const corgi::EntityRef& entity,
+                                     const vec3& offset) {
+  const ParticleEmitterData* data = GetComponentData(entity);
+  if (data == nullptr) return;
+  Effect& effect = effects_[data->effect];
+  const ParticleEmitterData& params = effect.params;
+  if (params.count <= 0 ||
+      effect.vertices.size() / 4 + params.count > kMaxParticles) {
+    return;
+  }
+
+  const vec3 origin =
+      GetComponent<TransformComponent>()->WorldPosition(entity) +
+      data->offset + offset;
+  static const float kCorners[4][2] = {{0.0f, 0.0f}, {1.0f, 0.0f},
+                                       {0.0f, 1.0f}, {1.0f, 1.0f}};
+  for (int i = 0; i < params.count; ++i) {
+    // Somewhere within `spread` of straight up, at half to full speed.
+    const float cos_tilt = 1.0f - params.spread * mathfu::Random<float>();
+    const float sin_tilt = sqrtf(1.0f - cos_tilt * cos_tilt);
+    const float heading = 2.0f * kPi * mathfu::Random<float>();
+    const vec3 velocity =
+        vec3(sin_tilt * cosf(heading), sin_tilt * sinf(heading), cos_tilt) *
+        params.speed * mathfu::RandomInRange(0.5f, 1.0f);
+    for (int corner = 0; corner < 4; ++corner) {
+      Vertex vertex;
+      vertex.origin[0] = origin.x;
+      vertex.origin[1] = origin.y;
+      vertex.origin[2] = origin.z;
+      vertex.origin[3] = time_;
+      vertex.velocity[0] = velocity.x;
+      vertex.velocity[1] = velocity.y;
+      vertex.velocity[2] = velocity.z;
+      vertex.corner[0] = kCorners[corner][0];
+      vertex.corner[1] = kCorners[corner][1];
+      effect.vertices.push_back(vertex);
+    }
+  }
+  effect.burst_times.push_back(time_);
+  effect.uploaded = false;
+}
+
+void ParticleEmitterComponent::ClearBursts() {
+  for (auto it = effects_.begin(); it != effects_.end(); ++it) {
+    it->second.burst_times.clear();
+    it->second.vertices.clear();
+    it->second.uploaded = false;
+  }
+  time_ = 0.0f;
+}
+
+void ParticleEmitterComponent::UploadIndices(size_t num_quads) {
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_));
+  if (num_quads <= index_buffer_quads_) return;
+  std::vector<uint16_t> indices;
+  indices.reserve(num_quads * 6);
+  static const uint16_t kQuadIndices[] = {0, 1, 2, 2, 1, 3};
+  for (size_t quad = 0; quad < num_quads; ++quad) {
+    for (int i = 0; i < 6; ++i) {
+      indices.push_back(static_cast<uint16_t>(quad * 4 + kQuadIndices[i]));
+    }
+  }
+  GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                       indices.size() * sizeof(uint16_t), indices.data(),
+                       GL_STATIC_DRAW));
+  index_buffer_quads_ = num_quads;
+}
+
+void ParticleEmitterComponent::Render(const corgi::CameraInterface& camera,
+                                      fplbase::Renderer& renderer) {
+  size_t max_quads = 0;
+  for (auto it = effects_.begin(); it != effects_.end(); ++it) {
+    max_quads = std::max(max_quads, it->second.vertices.size() / 4);
+  }
+  if (max_quads == 0) return;
+  if (shader_ == nullptr) {
+    shader_ = services_->asset_manager()->LoadShader(kParticleShaderName);
+    if (shader_ == nullptr) return;
+  }
+  if (index_buffer_ == 0) GL_CALL(glGenBuffers(1, &index_buffer_));
+
+  // Particles are blended over the scene, and so don't hide each other.
+  renderer.set_color(mathfu::kOnes4f);
+  renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+  renderer.SetCulling(fplbase::kCullingModeNone);
+  GL_CALL(glDepthMask(GL_FALSE));
+
+  UploadIndices(max_quads);
+  const GLuint origin = fplbase::Mesh::kAttributePosition;
+  const GLuint velocity = fplbase::Mesh::kAttributeNormal;
+  const GLuint corner = fplbase::Mesh::kAttributeTexCoord;
+  GL_CALL(glEnableVertexAttribArray(origin));
+  GL_CALL(glEnableVertexAttribArray(velocity));
+  GL_CALL(glEnableVertexAttribArray(corner));
+
+  // Each eye draws every effect into its viewport in turn.
+  if (!camera.IsStereo()) {
+    RenderView(camera, camera.GetTransformMatrix(), renderer);
+  } else {
+    for (int view = 0; view < 2; ++view) {
+      renderer.SetViewport(camera.viewport(view));
+      RenderView(camera, camera.GetTransformMatrix(view), renderer);
+    }
+  }
+  GL_CALL(glDisableVertexAttribArray(origin));
+  GL_CALL(glDisableVertexAttribArray(velocity));
+  GL_CALL(glDisableVertexAttribArray(corner));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+  GL_CALL(glDepthMask(GL_TRUE));
+  renderer.SetCulling(fplbase::kCullingModeBack);
+  renderer.SetBlendMode(fplbase::kBlendModeOff);
+}
+
+void ParticleEmitterComponent::RenderView(
+    const corgi::CameraInterface& camera, const mathfu::mat4& view_projection,
+    fplbase::Renderer& renderer) {
+  renderer.set_model_view_projection(view_projection);
+  shader_->Set(renderer);
+
+  // Each particle is a quad facing the camera.
+  const vec3 facing = camera.facing().Normalized();
+  const vec3 right = vec3::CrossProduct(facing, camera.up()).Normalized();
+  SetUniform(shader_, "camera_right", right);
+  SetUniform(shader_, "camera_up", vec3::CrossProduct(right, facing));
+  SetUniform(shader_, "time", time_);
+
+  const GLuint origin = fplbase::Mesh::kAttributePosition;
+  const GLuint velocity = fplbase::Mesh::kAttributeNormal;
+  const GLuint corner = fplbase::Mesh::kAttributeTexCoord;
+  for (auto it = effects_.begin(); it != effects_.end(); ++it) {
+    Effect& effect = it->second;
+    if (effect.vertices.empty()) continue;
+    if (effect.vertex_buffer == 0) {
+      GL_CALL(glGenBuffers(1, &effect.vertex_buffer));
+    }
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, effect.vertex_buffer));
+    // The buffer only changes when bursts are launched or expire.
+    if (!effect.uploaded) {
+      GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                           effect.vertices.size() * sizeof(Vertex),
+                           effect.vertices.data(), GL_DYNAMIC_DRAW));
+      effect.uploaded = true;
+    }
+    GL_CALL(glVertexAttribPointer(
+        origin, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        reinterpret_cast<const void*>(offsetof(Vertex, origin))));
+    GL_CALL(glVertexAttribPointer(
+        velocity, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        reinterpret_cast<const void*>(offsetof(Vertex, velocity))));
+    GL_CALL(glVertexAttribPointer(
+        corner, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        reinterpret_cast<const void*>(offsetof(Vertex, corner))));
+
+    const ParticleEmitterData& params = effect.params;
+    SetUniform(shader_, "lifetime", params.lifetime);
+    SetUniform(shader_, "gravity", params.gravity);
+    SetUniform(shader_, "start_size", params.start_size);
+    SetUniform(shader_, "end_size", params.end_size);
+    SetUniform(shader_, "start_color", params.start_color);
+    SetUniform(shader_, "end_color", params.end_color);
+    GL_CALL(glDrawElements(
+        GL_TRIANGLES, static_cast<GLsizei>(effect.vertices.size() / 4 * 6),
+        GL_UNSIGNED_SHORT, nullptr));
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,143 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_ZOOSHI_COMPONENTS_PARTICLES_H_
+#define FPL_ZOOSHI_COMPONENTS_PARTICLES_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "components/services.h"
+#include "components_generated.h"
+#include "corgi/component.h"
+#include "corgi_component_library/camera_interface.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "fplbase/shader.h"
+#include "mathfu/constants.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct ParticleEmitterData {
+  ParticleEmitterData()
+      : count(0),
+        lifetime(0.0f),
+        speed(0.0f),
+        spread(0.0f),
+        gravity(0.0f),
+        start_size(0.0f),
+        end_size(0.0f),
+        start_color(mathfu::kOnes4f),
+        end_color(mathfu::kOnes4f),
+        offset(mathfu::kZeros3f) {}
+
+  std::string effect;
+  int count;
+  float lifetime;
+  float speed;
+  float spread;
+  float gravity;
+  float start_size;
+  float end_size;
+  mathfu::vec4 start_color;
+  mathfu::vec4 end_color;
+  mathfu::vec3 offset;
+};
+
+// Spawns bursts of particles that fly out from an entity and fall, such as
+// the sparkles when a patron is fed. Each particle only records where and
+// when it was launched, and the vertex shader works out where it is now, so
+// a burst costs no entities and nothing per frame on the CPU. Every burst of
+// an effect is drawn in one call.
+class ParticleEmitterComponent
+    : public corgi::Component<ParticleEmitterData> {
+ public:
+  ParticleEmitterComponent()
+      : services_(nullptr),
+        time_(0.0f),
+        shader_(nullptr),
+        index_buffer_(0),
+        index_buffer_quads_(0) {}
+  virtual ~ParticleEmitterComponent();
+
+  virtual void Init();
+  virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
+  virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
+  virtual void InitEntity(corgi::EntityRef& entity);
+  virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+
+  // Launch a burst of `entity`'s effect from where it is now, moved by
+  // `offset` as well as the emitter's own. Does nothing if `entity` has no
+  // emitter.
+  void Burst(const corgi::EntityRef& entity,
+             const mathfu::vec3& offset = mathfu::kZeros3f);
+
+  // Draw every live burst, one draw per effect. Must be called on the render
+  // thread, after the opaque meshes, as particles don't write depth.
+  void Render(const corgi::CameraInterface& camera,
+              fplbase::Renderer& renderer);
+
+  // Drop every burst, such as when the level is reset.
+  void ClearBursts();
+
+ private:
+  // One corner of one particle's quad.
+  struct Vertex {
+    // Where the particle was launched from, and the time it was launched.
+    float origin[4];
+    float velocity[3];
+    // Which corner of the quad this is, from (0, 0) to (1, 1).
+    float corner[2];
+  };
+  struct Effect {
+    Effect() : vertex_buffer(0), uploaded(false) {}
+
+    // The parameters of the first emitter loaded with this effect.
+    ParticleEmitterData params;
+    // When each live burst was launched, oldest first. Every burst of an
+    // effect lives as long, so expired ones are always at the front.
+    std::vector<float> burst_times;
+    std::vector<Vertex> vertices;
+    GLuint vertex_buffer;
+    bool uploaded;
+  };
+
+  void ExpireBursts();
+  void UploadIndices(size_t num_quads);
+  // Draw every effect for one view, whose attributes have been enabled.
+  void RenderView(const corgi::CameraInterface& camera,
+                  const mathfu::mat4& view_projection,
+                  fplbase::Renderer& renderer);
+
+  ServicesComponent* services_;
+  // Seconds since the first live burst, so launch times stay small enough
+  // for the shader's floats.
+  float time_;
+  std::map<std::string, Effect> effects_;
+  fplbase::Shader* shader_;
+  // Two triangles for each particle, for as many particles as one effect
+  // has had alive at once.
+  GLuint index_buffer_;
+  size_t index_buffer_quads_;
+};
+
+}  // zooshi
+}  // fpl
+
+CORGI_REGISTER_COMPONENT(fpl::zooshi::ParticleEmitterComponent,
+                         fpl::zooshi::ParticleEmitterData)
+
+#endif  // FPL_ZOOSHI_COMPONENTS_PARTICLES_H_
@@ -14,9 +14,12 @@
 
 #include "components/patron.h"
 
+#include <algorithm>
 #include <vector>
 #include "analytics.h"
 #include "components/attributes.h"
+#include "components/export_builder.h"
+#include "components/particles.h"
 #include "components/player.h"
 #include "components/player_projectile.h"
 #include "components/services.h"
@@ -67,6 +70,10 @@ using motive::kMotiveTimeEndless;
 static const float kLapWaitAmount = 0.5f;
 static const float kHeightRangeBuffer = 0.05f;
 
+// How many times the raft's rail is sampled to find the stretches of it near
+// each patron.
+static const size_t kAppearRailSamples = 1024;
+
 static inline vec3 ZeroHeight(const vec3& v) {
   vec3 v_copy = v;
   v_copy.z = 0.0f;
@@ -101,11 +108,17 @@ static inline void SetMoveState(PatronMoveState move_state,
 }
 
 void PatronComponent::Init() {
-  config_ = entity_manager_->GetComponent<ServicesComponent>()->config();
-  auto services = entity_manager_->GetComponent<ServicesComponent>();
+  // These are registered before us, and are looked up for every patron.
+  services_ = entity_manager_->GetComponent<ServicesComponent>();
+  render_mesh_component_ = entity_manager_->GetComponent<RenderMeshComponent>();
+  physics_component_ = entity_manager_->GetComponent<PhysicsComponent>();
+  assert(render_mesh_component_ != nullptr && physics_component_ != nullptr);
+
+  config_ = services_->config();
+  update_lod_.Init(config_->update_lod());
   // Scene Lab is not guaranteed to be present in all versions of the game.
   // Only set up callbacks if we actually have a Scene Lab.
-  SceneLab* scene_lab = services->scene_lab();
+  SceneLab* scene_lab = services_->scene_lab();
   if (scene_lab) {
     scene_lab->AddOnEnterEditorCallback([this]() { UpdateAndEnablePhysics(); });
     scene_lab->AddOnExitEditorCallback([this]() { PostLoadFixup(); });
@@ -123,6 +136,7 @@ void PatronComponent::AddFromRawData(corgi::EntityRef& entity,
                                      const void* raw_data) {
   auto patron_def = static_cast<const PatronDef*>(raw_data);
   PatronData* patron_data = AddEntity(entity);
+  update_lod_.InitState(&patron_data->lod);
   patron_data->anim_object = patron_def->anim_object();
 
   patron_data->pop_in_radius = LoadInterpolants(patron_def->pop_in_radius());
@@ -186,7 +200,8 @@ corgi::ComponentInterface::RawDataUniquePtr PatronComponent::ExportRawData(
   const PatronData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
   auto target_tag = fbb.CreateString(data->target_tag);
 
   auto patience_fb = SaveInterpolants(fbb, data->patience);
@@ -233,71 +248,376 @@ corgi::ComponentInterface::RawDataUniquePtr PatronComponent::ExportRawData(
       data->time_exasperated_before_disappearing);
   builder.add_exasperated_playback_rate(data->exasperated_playback_rate);
   fbb.Finish(builder.Finish());
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
+}
+
+void PatronComponent::InitEntity(corgi::EntityRef& entity) {
+  (void)entity;
+  num_patrons_++;
+}
+
+void PatronComponent::CleanupEntity(corgi::EntityRef& entity) {
+  const PatronData* patron_data = GetComponentData(entity);
+  num_patrons_--;
+  if (patron_data->recently_fed) num_recently_fed_--;
+  if (patron_data->last_lap_fed == 0.0f) num_fed_at_start_--;
+  appear_windows_dirty_ = true;
+}
+
+void PatronComponent::RecordFed(const corgi::EntityRef& patron,
+                                PatronData* patron_data, float lap) {
+  if (patron_data->last_lap_fed == 0.0f) num_fed_at_start_--;
+  patron_data->last_lap_fed = lap;
+  if (lap == 0.0f) {
+    num_fed_at_start_++;
+    // Its earlier feeding is left in the queue, but no longer counts.
+    if (patron_data->recently_fed) {
+      patron_data->recently_fed = false;
+      num_recently_fed_--;
+    }
+    return;
+  }
+  if (!patron_data->recently_fed) {
+    patron_data->recently_fed = true;
+    num_recently_fed_++;
+  }
+  Feeding feeding;
+  feeding.patron = patron;
+  feeding.lap = lap;
+  // Restored feedings may be older than the latest.
+  auto position = recent_feedings_.end();
+  while (position != recent_feedings_.begin() && (position - 1)->lap > lap) {
+    --position;
+  }
+  recent_feedings_.insert(position, feeding);
+}
+
+int PatronComponent::CountFedSince(float min_lap) {
+  // Feedings are queued in lap order, so those before `min_lap` are at the
+  // front. A patron stops counting once its last feeding drops off.
+  while (!recent_feedings_.empty() && recent_feedings_.front().lap < min_lap) {
+    const Feeding& feeding = recent_feedings_.front();
+    PatronData* patron_data =
+        feeding.patron.IsValid() ? GetComponentData(feeding.patron) : nullptr;
+    if (patron_data != nullptr && patron_data->recently_fed &&
+        patron_data->last_lap_fed == feeding.lap) {
+      patron_data->recently_fed = false;
+      num_recently_fed_--;
+    }
+    recent_feedings_.pop_front();
+  }
+  const int num_unloaded_fed = static_cast<int>(
+      std::distance(unloaded_laps_fed_.lower_bound(std::max(min_lap, 0.0f)),
+                    unloaded_laps_fed_.end()) +
+      (min_lap > 0.0f ? unloaded_laps_fed_.count(0.0f) : 0));
+  return num_recently_fed_ + num_fed_at_start_ + num_unloaded_fed;
+}
+
+void PatronComponent::ResetFedCounts() {
+  recent_feedings_.clear();
+  num_recently_fed_ = 0;
+  num_fed_at_start_ = 0;
+  unloaded_patrons_.clear();
+  unloaded_laps_fed_.clear();
+}
+
+const std::string* PatronComponent::EntityId(
+    const corgi::EntityRef& entity) const {
+  const MetaData* meta_data = Data<MetaData>(entity);
+  return meta_data != nullptr && !meta_data->entity_id.empty()
+             ? &meta_data->entity_id
+             : nullptr;
+}
+
+void PatronComponent::AddUnloaded(const std::string& entity_id,
+                                  const SavedPatron& saved) {
+  RemoveUnloaded(entity_id);
+  unloaded_patrons_[entity_id] = saved;
+  if (saved.last_lap_fed >= 0.0f) unloaded_laps_fed_.insert(saved.last_lap_fed);
 }
 
-void PatronComponent::InitEntity(corgi::EntityRef& entity) { (void)entity; }
+bool PatronComponent::RemoveUnloaded(const std::string& entity_id,
+                                     SavedPatron* saved) {
+  auto unloaded = unloaded_patrons_.find(entity_id);
+  if (unloaded == unloaded_patrons_.end()) return false;
+  auto lap = unloaded_laps_fed_.find(unloaded->second.last_lap_fed);
+  if (lap != unloaded_laps_fed_.end()) unloaded_laps_fed_.erase(lap);
+  if (saved != nullptr) *saved = unloaded->second;
+  unloaded_patrons_.erase(unloaded);
+  return true;
+}
+
+void PatronComponent::ApplySaved(const corgi::EntityRef& patron,
+                                 PatronData* patron_data,
+                                 const SavedPatron& saved) {
+  patron_data->last_lap_upright = saved.last_lap_upright;
+  if (saved.last_lap_fed >= 0.0f) {
+    RecordFed(patron, patron_data, saved.last_lap_fed);
+  }
+}
+
+void PatronComponent::RetainUnloaded(
+    const std::vector<corgi::EntityRef>& entities) {
+  for (auto it = entities.begin(); it != entities.end(); ++it) {
+    const PatronData* patron_data =
+        it->IsValid() ? GetComponentData(*it) : nullptr;
+    const std::string* entity_id =
+        patron_data != nullptr ? EntityId(*it) : nullptr;
+    if (entity_id == nullptr) continue;
+    SavedPatron saved;
+    saved.last_lap_fed = patron_data->last_lap_fed;
+    saved.last_lap_upright = patron_data->last_lap_upright;
+    AddUnloaded(*entity_id, saved);
+  }
+}
+
+void PatronComponent::RestoreUnloaded(
+    const std::vector<corgi::EntityRef>& entities) {
+  if (unloaded_patrons_.empty()) return;
+  for (auto it = entities.begin(); it != entities.end(); ++it) {
+    PatronData* patron_data = GetComponentData(*it);
+    const std::string* entity_id =
+        patron_data != nullptr ? EntityId(*it) : nullptr;
+    SavedPatron saved;
+    if (entity_id != nullptr && RemoveUnloaded(*entity_id, &saved)) {
+      ApplySaved(*it, patron_data, saved);
+    }
+  }
+}
+
+void PatronComponent::SavePatrons(
+    std::map<std::string, SavedPatron>* patrons) const {
+  *patrons = unloaded_patrons_;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    const std::string* entity_id = EntityId(iter->entity);
+    if (entity_id == nullptr) continue;
+    SavedPatron& saved = (*patrons)[*entity_id];
+    saved.last_lap_fed = iter->data.last_lap_fed;
+    saved.last_lap_upright = iter->data.last_lap_upright;
+  }
+}
+
+void PatronComponent::RestorePatrons(
+    const std::map<std::string, SavedPatron>& patrons) {
+  std::map<std::string, SavedPatron> unloaded = patrons;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    const std::string* entity_id = EntityId(iter->entity);
+    auto saved = entity_id != nullptr ? unloaded.find(*entity_id)
+                                      : unloaded.end();
+    if (saved == unloaded.end()) continue;
+    ApplySaved(iter->entity, &iter->data, saved->second);
+    unloaded.erase(saved);
+  }
+  // The rest are given back as their sectors load.
+  for (auto it = unloaded.begin(); it != unloaded.end(); ++it) {
+    AddUnloaded(it->first, it->second);
+  }
+}
 
 void PatronComponent::UpdateAndEnablePhysics() {
   // Make the patrons stand up
-  RenderMeshComponent* render_mesh_component =
-      entity_manager_->GetComponent<RenderMeshComponent>();
-  auto physics_component = entity_manager_->GetComponent<PhysicsComponent>();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
     corgi::EntityRef patron = iter->entity;
-    physics_component->UpdatePhysicsFromTransform(patron);
-    physics_component->EnablePhysics(patron);
+    physics_component_->UpdatePhysicsFromTransform(patron);
+    physics_component_->EnablePhysics(patron);
 
-    render_mesh_component->SetVisibilityRecursively(patron, true);
+    render_mesh_component_->SetVisibilityRecursively(patron, true);
   }
 }
 
 void PatronComponent::PostLoadFixup() {
-  const TransformComponent* transform_component =
-      entity_manager_->GetComponent<TransformComponent>();
+  ResetFedCounts();
+  appear_windows_dirty_ = true;
 
   // Initialize each patron.
-  auto physics_component = entity_manager_->GetComponent<PhysicsComponent>();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    corgi::EntityRef patron = iter->entity;
-    PatronData* patron_data = Data<PatronData>(patron);
-
-    // Get reference to the first child with a rendermesh. We assume there will
-    // only be one such child.
-    patron_data->render_child = transform_component->ChildWithComponent(
-        patron, RenderMeshComponent::GetComponentId());
-    assert(patron_data->render_child);
-
-    // Animate the entity with the rendermesh.
-    entity_manager_->AddEntityToComponent<AnimationComponent>(
-        patron_data->render_child);
-    AnimationData* animation_data =
-        Data<AnimationData>(patron_data->render_child);
-    animation_data->anim_table_object = patron_data->anim_object;
-
-    // Initialize state machine.
-    SetState(kPatronStateLayingDown, patron_data);
+    FixupPatron(iter->entity);
+  }
+}
 
-    // Reset the last lap the patron stood up.
-    patron_data->last_lap_upright = -1.0f;
-    patron_data->last_lap_fed = -1.0f;
+void PatronComponent::PostLoadFixup(
+    const std::vector<corgi::EntityRef>& entities) {
+  for (auto it = entities.begin(); it != entities.end(); ++it) {
+    if (GetComponentData(*it) != nullptr) {
+      FixupPatron(*it);
+      appear_windows_dirty_ = true;
+    }
+  }
+}
 
-    // Cache the index into the physics target body.
-    const PhysicsData* physics_data = Data<PhysicsData>(patron);
-    const int target_index =
-        physics_data->RigidBodyIndex(patron_data->target_tag);
-    patron_data->target_rigid_body_index = target_index < 0 ? 0 : target_index;
+void PatronComponent::SampleAppearRail(const Rail* rail) {
+  appear_rail_ = rail;
+  appear_rail_samples_.clear();
+  appear_rail_padding_ = 0.0f;
+  if (rail == nullptr) return;
+  appear_rail_sample_time_ =
+      rail->EndTime() / static_cast<float>(kAppearRailSamples);
+  rail->Positions(appear_rail_sample_time_, &appear_rail_samples_);
+  for (size_t i = 1; i < appear_rail_samples_.size(); ++i) {
+    appear_rail_padding_ = std::max(
+        appear_rail_padding_, (vec3(appear_rail_samples_[i]) -
+                               vec3(appear_rail_samples_[i - 1])).Length());
+  }
+}
 
-    // Patrons that are done should not have physics enabled.
-    physics_component->DisablePhysics(patron);
-    // We don't want patrons moving until they are up.
-    RailDenizenData* rail_denizen_data = Data<RailDenizenData>(patron);
-    if (rail_denizen_data != nullptr) {
-      rail_denizen_data->enabled = false;
-      rail_denizen_data->SetSplinePlaybackRate(0.0f);
+void PatronComponent::AddAppearWindows(const corgi::EntityRef& patron,
+                                       const PatronData* patron_data,
+                                       const TransformData* transform_data) {
+  // Wherever the raft is between two samples, it's within the padding of
+  // both, so a window covers the samples in reach and one either side.
+  const float reach =
+      std::max(patron_data->pop_in_radius.values.start(),
+               patron_data->pop_in_radius.values.end()) +
+      appear_rail_padding_;
+  const float reach_squared = reach * reach;
+  const vec3 position = transform_data->position;
+  const size_t num_samples = appear_rail_samples_.size();
+  size_t i = 0;
+  while (i < num_samples) {
+    if ((vec3(appear_rail_samples_[i]) - position).LengthSquared() >
+        reach_squared) {
+      ++i;
+      continue;
     }
+    const size_t first = i;
+    while (i < num_samples &&
+           (vec3(appear_rail_samples_[i]) - position).LengthSquared() <=
+               reach_squared) {
+      ++i;
+    }
+    AppearWindow window;
+    window.start =
+        (static_cast<float>(first) - 1.0f) * appear_rail_sample_time_;
+    window.end = static_cast<float>(i) * appear_rail_sample_time_;
+    window.patron = patron;
+    appear_windows_.push_back(window);
+  }
+}
+
+bool PatronComponent::AppearWindowStartsBefore(const AppearWindow& a,
+                                               const AppearWindow& b) {
+  return a.start < b.start;
+}
+
+void PatronComponent::BuildAppearWindows() {
+  appear_windows_.clear();
+  open_appear_windows_.clear();
+  appear_windows_started_ = 0;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    iter->data.open_appear_windows = 0;
+    AddAppearWindows(iter->entity, &iter->data,
+                     Data<TransformData>(iter->entity));
+  }
+  std::sort(appear_windows_.begin(), appear_windows_.end(),
+            AppearWindowStartsBefore);
+  appear_windows_dirty_ = false;
+}
+
+void PatronComponent::CloseAppearWindows() {
+  for (auto it = open_appear_windows_.begin();
+       it != open_appear_windows_.end(); ++it) {
+    Data<PatronData>(appear_windows_[*it].patron)->open_appear_windows--;
+  }
+  open_appear_windows_.clear();
+  appear_windows_started_ = 0;
+}
+
+void PatronComponent::ReindexAppearWindows(const corgi::EntityRef& patron) {
+  if (appear_rail_ == nullptr || appear_windows_dirty_) return;
+  // The windows are opened again from the start on the next update.
+  CloseAppearWindows();
+  appear_windows_.erase(
+      std::remove_if(appear_windows_.begin(), appear_windows_.end(),
+                     [&patron](const AppearWindow& window) {
+        return window.patron == patron;
+      }),
+      appear_windows_.end());
+  AddAppearWindows(patron, Data<PatronData>(patron),
+                   Data<TransformData>(patron));
+  std::sort(appear_windows_.begin(), appear_windows_.end(),
+            AppearWindowStartsBefore);
+}
+
+void PatronComponent::UpdateAppearWindows(
+    const RailDenizenData* raft_rail_denizen) {
+  const Rail* rail =
+      raft_rail_denizen->motivator.Valid() ? raft_rail_denizen->rail : nullptr;
+  if (rail != appear_rail_) {
+    SampleAppearRail(rail);
+    appear_windows_dirty_ = true;
+  }
+  if (rail == nullptr) return;
+  if (appear_windows_dirty_) BuildAppearWindows();
+
+  // The spline time goes back to 0 at the start of each lap.
+  const float time =
+      static_cast<float>(raft_rail_denizen->motivator.SplineTime());
+  if (time < last_raft_spline_time_) CloseAppearWindows();
+  last_raft_spline_time_ = time;
+
+  while (appear_windows_started_ < appear_windows_.size() &&
+         appear_windows_[appear_windows_started_].start <= time) {
+    Data<PatronData>(appear_windows_[appear_windows_started_].patron)
+        ->open_appear_windows++;
+    open_appear_windows_.push_back(appear_windows_started_);
+    appear_windows_started_++;
+  }
+  for (size_t i = 0; i < open_appear_windows_.size();) {
+    const AppearWindow& window = appear_windows_[open_appear_windows_[i]];
+    if (window.end >= time) {
+      ++i;
+      continue;
+    }
+    Data<PatronData>(window.patron)->open_appear_windows--;
+    open_appear_windows_[i] = open_appear_windows_.back();
+    open_appear_windows_.pop_back();
+  }
+}
+
+void PatronComponent::FixupPatron(const corgi::EntityRef& patron) {
+  const TransformComponent* transform_component =
+      entity_manager_->GetComponent<TransformComponent>();
+  PatronData* patron_data = Data<PatronData>(patron);
+
+  // Get reference to the first child with a rendermesh. We assume there will
+  // only be one such child.
+  patron_data->render_child = transform_component->ChildWithComponent(
+      patron, RenderMeshComponent::GetComponentId());
+  assert(patron_data->render_child);
+
+  // Animate the entity with the rendermesh.
+  entity_manager_->AddEntityToComponent<AnimationComponent>(
+      patron_data->render_child);
+  AnimationData* animation_data =
+      Data<AnimationData>(patron_data->render_child);
+  animation_data->anim_table_object = patron_data->anim_object;
+
+  // Initialize state machine.
+  SetState(kPatronStateLayingDown, patron_data);
+
+  // Reset the last lap the patron stood up.
+  patron_data->last_lap_upright = -1.0f;
+  patron_data->last_lap_fed = -1.0f;
+  patron_data->recently_fed = false;
+
+  // Cache the index into the physics target body.
+  const PhysicsData* physics_data = Data<PhysicsData>(patron);
+  const int target_index =
+      physics_data->RigidBodyIndex(patron_data->target_tag);
+  patron_data->target_rigid_body_index = target_index < 0 ? 0 : target_index;
+
+  // Patrons that are done should not have physics enabled.
+  physics_component_->DisablePhysics(patron);
+  // We don't want patrons moving until they are up.
+  RailDenizenData* rail_denizen_data = Data<RailDenizenData>(patron);
+  if (rail_denizen_data != nullptr) {
+    rail_denizen_data->enabled = false;
+    rail_denizen_data->SetSplinePlaybackRate(0.0f);
   }
 }
 
@@ -366,8 +686,7 @@ void PatronComponent::UpdateMovement(const EntityRef& patron) {
   }
 
   // Start moving them faster if right before they disappear.
-  const corgi::EntityRef raft =
-      entity_manager_->GetComponent<ServicesComponent>()->raft_entity();
+  const corgi::EntityRef raft = services_->raft_entity();
   const RailDenizenData* raft_rail_denizen = Data<RailDenizenData>(raft);
   const bool agitated = patron_data->state == kPatronStateUpright &&
                         event_time_ < 0 &&
@@ -407,30 +726,147 @@ bool PatronComponent::AnimationEnding(const PatronData* patron_data,
 void PatronComponent::StartEvent(corgi::WorldTime event_start_time) {
   event_time_ = event_start_time;
 
-  // Reset the event index for all patrons.
+  // Merge every patron's timed events into one timeline, and reset the
+  // event index of the patrons that have events.
+  event_timeline_.clear();
+  next_timeline_event_ = 0;
+  event_waiters_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    corgi::EntityRef patron = iter->entity;
-    PatronData* patron_data = Data<PatronData>(patron);
+    PatronData* patron_data = &iter->data;
+    if (patron_data->events.empty()) continue;
     patron_data->event_index = 0;
+    for (size_t i = 0; i < patron_data->events.size(); ++i) {
+      if (patron_data->events[i].time < 0) continue;
+      TimelineEvent timeline_event;
+      timeline_event.time = patron_data->events[i].time;
+      timeline_event.patron = iter->entity;
+      timeline_event.index = static_cast<int>(i);
+      event_timeline_.push_back(timeline_event);
+    }
+    patron_data->event_waiting = WaitsForEventAnim(patron_data);
+    if (patron_data->event_waiting) event_waiters_.push_back(iter->entity);
   }
+  std::stable_sort(event_timeline_.begin(), event_timeline_.end(),
+                   [](const TimelineEvent& a, const TimelineEvent& b) {
+    return a.time < b.time;
+  });
 }
 
-bool PatronComponent::ShouldAppear(
-    const PatronData* patron_data, const TransformData* transform_data,
-    const RailDenizenData* raft_rail_denizen) const {
-  if (patron_data->state != kPatronStateLayingDown) return false;
+bool PatronComponent::WaitsForEventAnim(const PatronData* patron_data) const {
+  const int num_events = static_cast<int>(patron_data->events.size());
+  if (patron_data->event_index >= num_events) {
+    // After its last event, it lies down when the animation ends.
+    return patron_data->state == kPatronStateInEvent;
+  }
+  // A timed event can be overdue if it was waiting on an earlier event.
+  const PatronEvent& event = patron_data->events[patron_data->event_index];
+  return event.time < 0 || event.time <= event_time_;
+}
 
+bool PatronComponent::StepEvent(const corgi::EntityRef& patron,
+                                PatronData* patron_data,
+                                corgi::WorldTime delta_time) {
+  const int num_events = static_cast<int>(patron_data->events.size());
+  const bool anim_ending = AnimationEnding(patron_data, delta_time);
+  if (patron_data->event_index < num_events) {
+    const PatronEvent& event = patron_data->events[patron_data->event_index];
+    if ((event.time >= 0 && event.time <= event_time_) ||
+        (event.time < 0 && anim_ending)) {
+      // Start new animation.
+      Animate(patron_data, event.action);
+      patron_data->event_index++;
+      SetState(kPatronStateInEvent, patron_data);
+    }
+  } else if (anim_ending) {
+    // Disable event patron since we've played the last event.
+    SetState(kPatronStateLayingDown, patron_data);
+    StopAnimating(patron);
+  }
+  return WaitsForEventAnim(patron_data);
+}
+
+void PatronComponent::UpdateEventTimeline(corgi::WorldTime delta_time) {
+  // Patrons in the event are always updated fully. Each is stepped with the
+  // time the update loop gives it, which includes any time that built up
+  // while it was throttled before the event.
+
+  // Patrons waiting for an animation to end are checked every frame.
+  for (size_t i = 0; i < event_waiters_.size();) {
+    const corgi::EntityRef& patron = event_waiters_[i];
+    PatronData* patron_data = patron.IsValid() ? Data<PatronData>(patron)
+                                               : nullptr;
+    if (patron_data != nullptr &&
+        StepEvent(patron, patron_data,
+                  UpdateLod::FullDeltaTime(patron_data->lod, delta_time))) {
+      ++i;
+      continue;
+    }
+    if (patron_data != nullptr) patron_data->event_waiting = false;
+    event_waiters_[i] = event_waiters_.back();
+    event_waiters_.pop_back();
+  }
+
+  // The rest only when their next event is due. Events of a waiting patron
+  // are left to the loop above, so no patron is stepped twice in a frame.
+  while (next_timeline_event_ < event_timeline_.size() &&
+         event_timeline_[next_timeline_event_].time <= event_time_) {
+    const TimelineEvent& timeline_event =
+        event_timeline_[next_timeline_event_++];
+    const corgi::EntityRef& patron = timeline_event.patron;
+    PatronData* patron_data = patron.IsValid() ? Data<PatronData>(patron)
+                                               : nullptr;
+    if (patron_data == nullptr || patron_data->event_waiting ||
+        patron_data->event_index != timeline_event.index) {
+      continue;
+    }
+    if (StepEvent(patron, patron_data,
+                  UpdateLod::FullDeltaTime(patron_data->lod, delta_time))) {
+      patron_data->event_waiting = true;
+      event_waiters_.push_back(patron);
+    }
+  }
+}
+
+bool PatronComponent::CanAppearThisLap(
+    const PatronData* patron_data,
+    const RailDenizenData* raft_rail_denizen) const {
   // Only appear once per lap.
   const float lap = raft_rail_denizen->total_lap_progress;
   if (lap < patron_data->last_lap_upright + kLapWaitAmount) return false;
 
   // Only appear within min/max lap regions.
-  if (lap < patron_data->min_lap ||
-      (lap > patron_data->max_lap && patron_data->max_lap >= 0))
+  return lap >= patron_data->min_lap &&
+         (lap <= patron_data->max_lap || patron_data->max_lap < 0);
+}
+
+UpdateLodTier PatronComponent::LodTier(
+    const PatronData* patron_data, const TransformData* transform_data,
+    const RailDenizenData* raft_rail_denizen) const {
+  // Patrons in an event are following a timeline, so must always update.
+  if (!patron_data->events.empty()) return kUpdateLodFull;
+
+  // Patrons laying down can't be seen or interacted with until they stand up.
+  // If they can't stand up on this lap, they have nothing to do.
+  const bool laying_down = patron_data->state == kPatronStateLayingDown;
+  if (laying_down && !CanAppearThisLap(patron_data, raft_rail_denizen)) {
+    return kUpdateLodDormant;
+  }
+  return update_lod_.Tier(transform_data->position, laying_down);
+}
+
+bool PatronComponent::ShouldAppear(
+    const PatronData* patron_data, const TransformData* transform_data,
+    const RailDenizenData* raft_rail_denizen) const {
+  if (patron_data->state != kPatronStateLayingDown) return false;
+  if (!CanAppearThisLap(patron_data, raft_rail_denizen)) return false;
+  // Away from its windows, the raft is too far away to check.
+  if (appear_rail_ != nullptr && patron_data->open_appear_windows == 0) {
     return false;
+  }
 
   // Determine the patron's distance from the raft.
+  const float lap = raft_rail_denizen->total_lap_progress;
   const vec3 raft_position = raft_rail_denizen->Position();
   const vec3 raft_to_patron = transform_data->position - raft_position;
   const float dist_from_raft = raft_to_patron.Length();
@@ -462,44 +898,56 @@ bool PatronComponent::ShouldDisappear(
   return time_until_exasperated <= 0.0f;
 }
 
+// Whether the patron should look for sushi to catch.
+static bool WantsCatchSearch(const PatronData* patron_data) {
+  return patron_data->events.empty() &&
+         patron_data->state == kPatronStateUpright &&
+         (patron_data->move_state != kPatronMoveStateMoveToTarget ||
+          patron_data->time_in_move_state >
+              patron_data->time_between_catch_searches);
+}
+
+// Whether the patron should check that it's facing the raft.
+static bool WantsToFaceRaft(const PatronData* patron_data) {
+  return patron_data->events.empty() &&
+         (patron_data->state == kPatronStateUpright ||
+          patron_data->state == kPatronStateGettingUp) &&
+         patron_data->move_state == kPatronMoveStateIdle;
+}
+
 void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
-  corgi::EntityRef raft =
-      entity_manager_->GetComponent<ServicesComponent>()->raft_entity();
+  corgi::EntityRef raft = services_->raft_entity();
   if (!raft) return;
   const RailDenizenData* raft_rail_denizen = Data<RailDenizenData>(raft);
+  const PatronScheduleConfig* schedule = config_->patron_schedule();
+  const int catch_search_budget =
+      schedule != nullptr ? schedule->catch_searches_per_frame() : 0;
+  const int face_raft_budget =
+      schedule != nullptr ? schedule->face_raft_updates_per_frame() : 0;
+  update_lod_.AdvanceFrame(raft_rail_denizen->Position(), services_->camera());
+  UpdateAppearWindows(raft_rail_denizen);
+  if (event_time_ >= 0) UpdateEventTimeline(delta_time);
+  BuildProjectileGrid();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
     corgi::EntityRef patron = iter->entity;
     TransformData* transform_data = Data<TransformData>(patron);
-    PatronData* patron_data = Data<PatronData>(patron);
-    RenderMeshComponent* rm_component =
-        entity_manager_->GetComponent<RenderMeshComponent>();
-    PhysicsComponent* physics_component =
-        entity_manager_->GetComponent<PhysicsComponent>();
-
-    // Animate patrons in the event.
-    const int num_events = static_cast<int>(patron_data->events.size());
-    if (event_time_ >= 0 && num_events > 0) {
-      const bool anim_ending = AnimationEnding(patron_data, delta_time);
-      if (patron_data->event_index < num_events) {
-        const PatronEvent& event =
-            patron_data->events[patron_data->event_index];
-        if ((event.time >= 0 && event.time <= event_time_) ||
-            (event.time < 0 && anim_ending)) {
-          // Start new animation.
-          Animate(patron_data, event.action);
-          patron_data->event_index++;
-          SetState(kPatronStateInEvent, patron_data);
-        }
-      } else if (anim_ending) {
-        // Disable event patron since we've played the last event.
-        SetState(kPatronStateLayingDown, patron_data);
-      }
+    PatronData* patron_data = &iter->data;
+
+    // Patrons that can't be seen or interacted with update less often, with
+    // all the time that has passed since their last update.
+    corgi::WorldTime patron_delta_time = delta_time;
+    const UpdateLodTier tier =
+        LodTier(patron_data, transform_data, raft_rail_denizen);
+    if (!update_lod_.ShouldUpdate(tier, &patron_data->lod,
+                                  &patron_delta_time)) {
+      continue;
     }
-
+    // Patrons in the event are animated by UpdateEventTimeline().
+    const int num_events = static_cast<int>(patron_data->events.size());
     const PatronState state = patron_data->state;
-    rm_component->SetVisibilityRecursively(patron,
-                                           state != kPatronStateLayingDown);
+    render_mesh_component_->SetVisibilityRecursively(
+        patron, state != kPatronStateLayingDown);
     if (num_events > 0) continue;
 
     // Remember the last idle position so we can return to later.
@@ -510,16 +958,23 @@ void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
     // Move patron towards the target.
     UpdateMovement(patron);
 
-    // Set the patron's movement target.
-    if (state == kPatronStateUpright &&
-        (patron_data->move_state != kPatronMoveStateMoveToTarget ||
-         patron_data->time_in_move_state >
-             patron_data->time_between_catch_searches)) {
-      FindProjectileAndCatch(patron);
+    // Set the patron's movement target. When the number of patrons that can
+    // do so each frame is limited, wait for a turn instead.
+    if (WantsCatchSearch(patron_data)) {
+      if (catch_search_budget <= 0) {
+        FindProjectileAndCatch(patron);
+      } else if (!patron_data->catch_search_queued) {
+        patron_data->catch_search_queued = true;
+        catch_search_queue_.push_back(patron);
+      }
     }
-    if ((state == kPatronStateUpright || state == kPatronStateGettingUp) &&
-        patron_data->move_state == kPatronMoveStateIdle) {
-      FaceRaft(patron);
+    if (WantsToFaceRaft(patron_data)) {
+      if (face_raft_budget <= 0) {
+        FaceRaft(patron);
+      } else if (!patron_data->face_raft_queued) {
+        patron_data->face_raft_queued = true;
+        face_raft_queue_.push_back(patron);
+      }
     }
 
     if (ShouldAppear(patron_data, transform_data, raft_rail_denizen)) {
@@ -532,7 +987,7 @@ void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
       SetState(kPatronStateFalling, patron_data);
       Animate(patron_data, PatronAction_Fall);
 
-      entity_manager_->GetComponent<PhysicsComponent>()->DisablePhysics(patron);
+      physics_component_->DisablePhysics(patron);
       auto rail_denizen_data = Data<RailDenizenData>(patron);
       if (rail_denizen_data != nullptr) {
         rail_denizen_data->enabled = false;
@@ -542,7 +997,7 @@ void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
 
     // Transition to the next state if we're at the end of the current
     // animation.
-    const bool anim_ending = AnimationEnding(patron_data, delta_time);
+    const bool anim_ending = AnimationEnding(patron_data, patron_delta_time);
     if (anim_ending) {
       switch (patron_data->state) {
         case kPatronStateEating:
@@ -558,13 +1013,17 @@ void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
         case kPatronStateFalling:
           // After the patron has finished their falling animation, turn off
           // the physics, as they are no longer in the world.
-          physics_component->DisablePhysics(patron);
+          physics_component_->DisablePhysics(patron);
           SetState(kPatronStateLayingDown, patron_data);
+          StopAnimating(patron);
+          // It may have moved on a rail, or to catch sushi, since it was
+          // last up.
+          ReindexAppearWindows(patron);
           break;
 
         case kPatronStateGettingUp: {
           SetState(kPatronStateUpright, patron_data);
-          physics_component->EnablePhysics(patron);
+          physics_component_->EnablePhysics(patron);
           auto rail_denizen_data = Data<RailDenizenData>(patron);
           if (rail_denizen_data != nullptr) {
             rail_denizen_data->enabled = true;
@@ -586,18 +1045,52 @@ void PatronComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
 
     // Update timers.
     const float delta_seconds =
-        static_cast<float>(delta_time) / corgi::kMillisecondsPerSecond;
+        static_cast<float>(patron_delta_time) / corgi::kMillisecondsPerSecond;
     patron_data->time_in_move_state += delta_seconds;
     patron_data->time_in_state += delta_seconds;
     if (IgnoredMoveState(patron_data->move_state)) {
       patron_data->time_being_ignored += delta_seconds;
     }
   }
+  RunScheduledCatchSearches(catch_search_budget);
+  RunScheduledFaceRafts(face_raft_budget);
   if (event_time_ >= 0) {
     event_time_ += delta_time;
   }
 }
 
+void PatronComponent::RunScheduledCatchSearches(int budget) {
+  int num_searches = 0;
+  while (num_searches < budget && !catch_search_queue_.empty()) {
+    const EntityRef patron = catch_search_queue_.front();
+    catch_search_queue_.pop_front();
+    PatronData* patron_data = patron ? GetComponentData(patron) : nullptr;
+    if (patron_data == nullptr) continue;
+    patron_data->catch_search_queued = false;
+
+    // The patron may have changed state since it was queued.
+    if (!WantsCatchSearch(patron_data)) continue;
+    FindProjectileAndCatch(patron);
+    num_searches++;
+  }
+}
+
+void PatronComponent::RunScheduledFaceRafts(int budget) {
+  int num_updates = 0;
+  while (num_updates < budget && !face_raft_queue_.empty()) {
+    const EntityRef patron = face_raft_queue_.front();
+    face_raft_queue_.pop_front();
+    PatronData* patron_data = patron ? GetComponentData(patron) : nullptr;
+    if (patron_data == nullptr) continue;
+    patron_data->face_raft_queued = false;
+
+    // The patron may have changed state since it was queued.
+    if (!WantsToFaceRaft(patron_data)) continue;
+    FaceRaft(patron);
+    num_updates++;
+  }
+}
+
 bool PatronComponent::HasAnim(const PatronData* patron_data,
                               PatronAction action) const {
   return entity_manager_->GetComponent<AnimationComponent>()->HasAnim(
@@ -624,6 +1117,18 @@ void PatronComponent::Animate(PatronData* patron_data, PatronAction action) {
       patron_data->render_child, action);
 }
 
+// Patrons laying down are hidden, so stop evaluating their rig until they
+// get up and are animated again, the way they start out after loading. Hide
+// them now, since throttled patrons may not update again for a few frames.
+void PatronComponent::StopAnimating(const corgi::EntityRef& patron) {
+  render_mesh_component_->SetVisibilityRecursively(patron, false);
+  const PatronData* patron_data = Data<PatronData>(patron);
+  AnimationData* anim = Data<AnimationData>(patron_data->render_child);
+  if (anim->motivator.Valid()) {
+    anim->motivator.Invalidate();
+  }
+}
+
 // Note:  This function is static (because it's a collision handler) so we
 // have to explicitly get a pointer to a component if want to use component
 // methods.
@@ -634,38 +1139,90 @@ void PatronComponent::CollisionHandler(CollisionData* collision_data,
           collision_data->this_entity)) {
     patron_component->HandleCollision(collision_data->this_entity,
                                       collision_data->other_entity,
-                                      collision_data->this_tag);
+                                      &collision_data->this_tag);
   } else if (patron_component->IsRegisteredWithComponent<PatronComponent>(
                  collision_data->other_entity)) {
     patron_component->HandleCollision(collision_data->other_entity,
                                       collision_data->this_entity,
-                                      collision_data->other_tag);
+                                      &collision_data->other_tag);
   }
 }
 
+// Whether the segment from `start` to `end` passes through the box.
+static bool SegmentIntersectsBox(const vec3& start, const vec3& end,
+                                 const vec3& box_min, const vec3& box_max) {
+  const vec3 delta = end - start;
+  float enter = 0.0f;
+  float exit = 1.0f;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (delta[axis] == 0.0f) {
+      if (start[axis] < box_min[axis] || start[axis] > box_max[axis]) {
+        return false;
+      }
+      continue;
+    }
+    float t0 = (box_min[axis] - start[axis]) / delta[axis];
+    float t1 = (box_max[axis] - start[axis]) / delta[axis];
+    if (t0 > t1) std::swap(t0, t1);
+    enter = std::max(enter, t0);
+    exit = std::min(exit, t1);
+    if (enter > exit) return false;
+  }
+  return true;
+}
+
+bool PatronComponent::SweepProjectile(const corgi::EntityRef& projectile,
+                                      const vec3& start, const vec3& end,
+                                      float radius) {
+  // Growing the targets by the radius makes the sphere a point. That's a
+  // little generous at the corners, which players won't notice.
+  const vec3 padding(radius);
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    const PatronData* patron_data = &iter->data;
+    if (patron_data->state != kPatronStateUpright) continue;
+    const PhysicsData* physics_data = Data<PhysicsData>(iter->entity);
+    if (physics_data == nullptr) continue;
+    vec3 target_min;
+    vec3 target_max;
+    physics_data->GetAabb(patron_data->target_rigid_body_index, &target_min,
+                          &target_max);
+    if (SegmentIntersectsBox(start, end, target_min - padding,
+                             target_max + padding)) {
+      HandleCollision(iter->entity, projectile, nullptr);
+      return true;
+    }
+  }
+  return false;
+}
+
 void PatronComponent::HandleCollision(const corgi::EntityRef& patron_entity,
                                       const corgi::EntityRef& proj_entity,
-                                      const std::string& part_tag) {
-  // We only care about collisions with projectiles that haven't been deleted.
+                                      const std::string* part_tag) {
+  // We only care about collisions with projectiles that haven't been deleted,
+  // or released to their pool.
   PlayerProjectileData* projectile_data =
       Data<PlayerProjectileData>(proj_entity);
-  if (projectile_data == nullptr || proj_entity->marked_for_deletion()) {
+  if (projectile_data == nullptr || proj_entity->marked_for_deletion() ||
+      !services_->entity_pool()->IsActive(proj_entity)) {
     return;
   }
-  corgi::EntityRef raft =
-      entity_manager_->GetComponent<ServicesComponent>()->raft_entity();
+  corgi::EntityRef raft = services_->raft_entity();
   RailDenizenData* raft_rail_denizen = Data<RailDenizenData>(raft);
   PatronData* patron_data = Data<PatronData>(patron_entity);
   if (patron_data->state == kPatronStateUpright) {
-    // If the target tag was hit, consider it being fed
-    if (patron_data->target_tag == "" || patron_data->target_tag == part_tag) {
+    // If the target tag was hit, consider it being fed. The tags are only
+    // compared once everything cheaper has been checked.
+    if (part_tag == nullptr || patron_data->target_tag.empty() ||
+        patron_data->target_tag == *part_tag) {
       SetState(patron_data->play_eating_animation ? kPatronStateEating
                                                   : kPatronStateSatisfied,
                patron_data);
       Animate(patron_data,
               patron_data->play_eating_animation ? PatronAction_Eat
                                                  : PatronAction_Satisfied);
-      patron_data->last_lap_fed = raft_rail_denizen->total_lap_progress;
+      RecordFed(patron_entity, patron_data,
+                raft_rail_denizen->total_lap_progress);
 
       // Disable rail movement after they have been fed
       auto rail_denizen_data = Data<RailDenizenData>(patron_entity);
@@ -674,19 +1231,17 @@ void PatronComponent::HandleCollision(const corgi::EntityRef& patron_entity,
         rail_denizen_data->SetSplinePlaybackRate(0.0f);
       }
       SpawnPointDisplay(patron_entity);
-      // Delete the projectile, as it has been consumed.
-      entity_manager_->DeleteEntity(proj_entity);
+      // Recycle the projectile, as it has been consumed.
+      services_->entity_pool()->Release(proj_entity);
 
-      // Track in Analytics that the patron was fed.
+      // Track in Analytics that the patron was fed. This runs inside the
+      // physics step, so it's only counted here, and sent after the game.
       MetaData* meta_data = Data<MetaData>(patron_entity);
-      firebase::analytics::Parameter parameters[] = {
-          firebase::analytics::Parameter(kParameterPatronType,
-                                         meta_data->prototype.c_str()),
-          AnalyticsControlParameter(
-              entity_manager_->GetComponent<ServicesComponent>()->world()),
-      };
-      firebase::analytics::LogEvent(kEventPatronFed, parameters,
-                                    sizeof(parameters) / sizeof(parameters[0]));
+      World* world = services_->world();
+      if (world->analytics != nullptr) {
+        world->analytics->CountPatronFed(meta_data->prototype,
+                                         AnalyticsControlValue(world));
+      }
     }
   }
 }
@@ -695,11 +1250,9 @@ void PatronComponent::SpawnPointDisplay(const corgi::EntityRef& patron) {
   // We need the raft, so we can orient towards it:
   if (!RaftExists()) return;
 
-  // Spawn from prototype:
+  // Reuse one from the pool, or spawn from prototype:
   corgi::EntityRef point_display =
-      entity_manager_->GetComponent<ServicesComponent>()
-          ->entity_factory()
-          ->CreateEntityFromPrototype("FloatingPointDisplay", entity_manager_);
+      services_->entity_pool()->Acquire("FloatingPointDisplay");
 
   // Make the point display a child of the patron. We want it to move with
   // the patron.
@@ -713,6 +1266,10 @@ void PatronComponent::SpawnPointDisplay(const corgi::EntityRef& patron) {
   TransformData* points_transform = Data<TransformData>(point_display);
   points_transform->position =
       patron_data->point_display_height * mathfu::kAxisZ3f;
+
+  // Sparkles from the heart, for patrons that have them.
+  GetComponent<ParticleEmitterComponent>()->Burst(
+      patron, points_transform->position);
 }
 
 static float CalculateClosestTimeInHeightRange(
@@ -769,26 +1326,47 @@ motive::Range PatronComponent::TargetHeightRange(
 }
 
 bool PatronComponent::RaftExists() const {
-  return entity_manager_->GetComponent<ServicesComponent>()
-      ->raft_entity()
-      .IsValid();
+  return services_->raft_entity().IsValid();
 }
 
 vec3 PatronComponent::RaftPosition() const {
   assert(RaftExists());
-  const EntityRef raft =
-      entity_manager_->GetComponent<ServicesComponent>()->raft_entity();
+  const EntityRef raft = services_->raft_entity();
   const TransformData* raft_transform = Data<TransformData>(raft);
   return raft_transform->position;
 }
 
+void PatronComponent::BuildProjectileGrid() {
+  // Only patrons that are upright search for projectiles. Bucket each
+  // projectile over the union of their search times, in cells the size of
+  // their largest search distance.
+  float cell_size = 0.0f;
+  float min_time = 0.0f;
+  float max_time = 0.0f;
+  bool searching = false;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    const PatronData* patron_data = &iter->data;
+    if (patron_data->state != kPatronStateUpright) continue;
+    cell_size =
+        std::max(cell_size, patron_data->max_catch_distance_for_search);
+    min_time = std::min(min_time, patron_data->catch_time_for_search.start());
+    max_time = std::max(max_time, patron_data->catch_time_for_search.end());
+    searching = true;
+  }
+  if (searching) {
+    projectile_snapshot_.Capture(entity_manager_);
+    projectile_grid_.Build(projectile_snapshot_, cell_size, min_time,
+                           max_time);
+  } else {
+    projectile_snapshot_.Clear();
+    projectile_grid_.Clear();
+  }
+}
+
 const EntityRef* PatronComponent::ClosestProjectile(
     const EntityRef& patron, vec3* closest_position,
-    motive::Angle* closest_face_angle, float* closest_time) const {
-  // TODO: change projectile_component to const when Component gets a
-  //       const_iterator.
-  PlayerProjectileComponent* projectile_component =
-      entity_manager_->GetComponent<PlayerProjectileComponent>();
+    motive::Angle* closest_face_angle, float* closest_time) {
   const TransformData* patron_transform = Data<TransformData>(patron);
   const PatronData* patron_data = GetComponentData(patron);
 
@@ -800,45 +1378,32 @@ const EntityRef* PatronComponent::ClosestProjectile(
   // Gather data about the raft, which is needed in the calculations.
   const vec3 raft_position_xy = ZeroHeight(RaftPosition());
 
-  // Loop through every projectile. Keep a reference to the closest one.
+  // Loop through every projectile that passes near the patron. Keep a
+  // reference to the closest one.
   const EntityRef* closest_ref = nullptr;
   float max_dist_sq = patron_data->max_catch_distance_for_search *
                       patron_data->max_catch_distance_for_search;
   float closest_dist_sq = max_dist_sq;
   vec3 closest_position_xy = mathfu::kZeros3f;
-  auto physics_component = entity_manager_->GetComponent<PhysicsComponent>();
-  for (auto it = projectile_component->begin();
-       it != projectile_component->end(); ++it) {
+  projectile_grid_.Query(patron_position_xy,
+                         patron_data->max_catch_distance_for_search,
+                         &nearby_projectiles_);
+  projectile_snapshot_.Approaches(patron_position_xy, max_dist_sq,
+                                  nearby_projectiles_, &approaches_);
+  for (auto it = approaches_.begin(); it != approaches_.end(); ++it) {
+    // Early reject if the distance is already too far.
+    if (it->dist_sq > closest_dist_sq) continue;
+
     // Get movement state of projectile.
-    const TransformData* projectile_transform =
-        entity_manager_->GetComponentData<TransformData>(it->entity);
-    const PhysicsData* projectile_physics =
-        entity_manager_->GetComponentData<PhysicsData>(it->entity);
-    const vec3 projectile_position = projectile_transform->position;
-    const vec3 projectile_velocity = projectile_physics->Velocity();  // In m/s.
+    const vec3 projectile_position = projectile_snapshot_.Position(it->index);
+    const vec3 projectile_velocity =
+        projectile_snapshot_.Velocity(it->index);  // In m/s.
     const vec3 projectile_position_xy = ZeroHeight(projectile_position);
     const vec3 projectile_velocity_xy = ZeroHeight(projectile_velocity);
-
-    // Get horizontal unit vector and distance to patron.
-    vec3 to_patron_xy = patron_position_xy - projectile_position_xy;
-    const float dist_to_patron_xy = to_patron_xy.Normalize();
-
-    // Get time to closest point on horizontal trajectory.
-    // Dot product is projectile speet along
-    const float projectile_speed_to_patron =
-        vec3::DotProduct(projectile_velocity, to_patron_xy);
-    if (projectile_speed_to_patron <= 0.0f) continue;
-    const float closest_t_ignore_height =
-        dist_to_patron_xy / projectile_speed_to_patron;  // In seconds.
-
-    // Early reject if the distance is already too far.
+    const float closest_t_ignore_height = it->time;  // In seconds.
     const vec3 closest_position_ignore_height_xy =
         projectile_position_xy +
         projectile_velocity_xy * closest_t_ignore_height;
-    const float dist_sq_ignore_height =
-        (patron_position_xy - closest_position_ignore_height_xy)
-            .LengthSquared();
-    if (dist_sq_ignore_height > closest_dist_sq) continue;
 
     // If returning from a previous attempt, limit how far from the initial
     // position to leave from again.
@@ -853,7 +1418,7 @@ const EntityRef* PatronComponent::ClosestProjectile(
     const float closest_t = CalculateClosestTimeInHeightRange(
         closest_t_ignore_height, patron_data->catch_time_for_search,
         target_height_range, projectile_position.z, projectile_velocity.z,
-        physics_component->GravityForEntity(it->entity));
+        projectile_snapshot_.gravity(it->index));
     if (!patron_data->catch_time_for_search.Contains(closest_t)) continue;
 
     // Calculate the projectile position at `closest_t`.
@@ -877,7 +1442,7 @@ const EntityRef* PatronComponent::ClosestProjectile(
     *closest_time = closest_t;
     *closest_face_angle = motive::Angle::FromYXVector(projectile_position_xy -
                                                       intercept_position_xy);
-    closest_ref = &it->entity;
+    closest_ref = &projectile_snapshot_.entity(it->index);
     closest_dist_sq = dist_sq;
   }
 
@@ -15,6 +15,11 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_PATRON_H_
 #define FPL_ZOOSHI_COMPONENTS_PATRON_H_
 
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
 #include "breadboard/event.h"
 #include "breadboard/graph.h"
 #include "breadboard/graph_state.h"
@@ -25,16 +30,23 @@
 #include "corgi/entity_manager.h"
 #include "corgi_component_library/graph.h"
 #include "corgi_component_library/physics.h"
+#include "corgi_component_library/rendermesh.h"
 #include "corgi_component_library/transform.h"
 #include "mathfu/constants.h"
 #include "mathfu/glsl_mappings.h"
 #include "motive/math/angle.h"
 #include "motive/math/range.h"
 #include "motive/motivator.h"
+#include "projectile_grid.h"
+#include "projectile_snapshot.h"
+#include "update_lod.h"
 
 namespace fpl {
 namespace zooshi {
 
+class Microbenchmark;
+class ServicesComponent;
+
 enum PatronState {
   // Laying down in wait for the raft to come in range. If this patron has been
   // fed this lap, it will not stand up again until the next lap.
@@ -104,29 +116,37 @@ struct PatronData {
   PatronData()
       : state(kPatronStateLayingDown),
         move_state(kPatronMoveStateIdle),
-        anim_object(AnimObject_HungryHippo),
+        time_in_state(0.0f),
+        time_in_move_state(0.0f),
+        time_being_ignored(0.0f),
         last_lap_upright(-1.0f),
         last_lap_fed(-1.0f),
-        pop_out_radius(0.0f),
         min_lap(0.0f),
         max_lap(0.0f),
-        event_index(0),
-        target_rigid_body_index(0),
+        pop_out_radius(0.0f),
+        time_exasperated_before_disappearing(1.0f),
+        exasperated_playback_rate(2.0f),
         prev_delta_position(mathfu::kZeros3f),
         return_position(mathfu::kZeros3f),
+        catch_search_queued(false),
+        face_raft_queued(false),
+        recently_fed(false),
+        open_appear_windows(0),
+        anim_object(AnimObject_HungryHippo),
+        event_index(0),
+        event_waiting(false),
+        target_rigid_body_index(0),
         point_display_height(0.0f),
-        time_in_state(0.0f),
-        time_in_move_state(0.0f),
-        time_being_ignored(0.0f),
         max_catch_distance(0.0f),
         max_catch_distance_for_search(0.0f),
         max_catch_angle(0.0f),
         time_between_catch_searches(0.0f),
         return_time(0.0f),
         rail_accelerate_time(0.0f),
-        time_to_face_raft(0.0f),
-        time_exasperated_before_disappearing(1.0f),
-        exasperated_playback_rate(2.0f) {}
+        time_to_face_raft(0.0f) {}
+
+  // The state that's read or updated on most updates comes first, so an
+  // update touches as few cache lines as possible.
 
   // Whether the patron is standing up or falling down.
   PatronState state;
@@ -134,45 +154,48 @@ struct PatronData {
   // Describes the behavior of the patron moving to catch sushi.
   PatronMoveState move_state;
 
-  // The type of patron being animated. Each patron has its own set of
-  // animations.
-  AnimObject anim_object;
+  // The time since `state` was changed, in seconds.
+  float time_in_state;
+
+  // The time since `move_state` was changed, in seconds.
+  float time_in_move_state;
+
+  // The time since the patron was moving towards a piece of sushi.
+  float time_being_ignored;
+
+  // How often the patron is updated. See UpdateLod.
+  UpdateLodState lod;
 
   // Keep track of the last time this patron was fed so we know when they
   // can pop back up.
   float last_lap_upright;
   float last_lap_fed;
 
-  // If the raft entity is within the pop_in_range it will stand up. If it is
-  // once up, if it's not in the pop out range, it will fall down. As a minor
-  // optimization, it's stored here as the square of the distance.
-  Interpolants pop_in_radius;
-  float pop_out_radius;
-
   // Each time the raft makes a lap around the river, its lap counter is
   // incremented. Patrons will only stand up when the lap counter is in the
   // range [min_lap, max_lap]. A negative value indicates no limits.
   float min_lap;
   float max_lap;
 
+  // If the raft entity is within the pop_in_range it will stand up. If it is
+  // once up, if it's not in the pop out range, it will fall down. As a minor
+  // optimization, it's stored here as the square of the distance.
+  Interpolants pop_in_radius;
+  float pop_out_radius;
+
   // Time, in seconds, that patron is willing to wait until sushi is throw
   // within catching distance. Decreases as the lap increases.
   Interpolants patience;
 
-  // Sequence of animations to follow once StartEvent() has been called.
-  std::vector<PatronEvent> events;
-
-  // Current index into the `events` array.
-  int event_index;
-
-  // The tag of the body part that needs to be hit to trigger a fall.
-  // Note that an empty name means any collision counts.
-  std::string target_tag;
+  // After being ignored for a while, the patron will get exasperated and idle
+  // at a faster playback rate. If still no sushi is thrown at the patron,
+  // the patron will disappear. This is the amount of time before disappearing
+  // that the patron will be exasperated. Time in seconds.
+  float time_exasperated_before_disappearing;
 
-  // The index into physics data's `rigid_bodies` that corresponds to
-  // `target_tag`. Cache here so we don't have to loop through all the rigid
-  // bodies doing string compares.
-  int target_rigid_body_index;
+  // When exasperated, we play the idle animation faster. Therefore, this
+  // number should be > 1.
+  float exasperated_playback_rate;
 
   // The child of the patron entity that has a RenderMeshComponent and
   // an AnimationComponent.
@@ -185,9 +208,6 @@ struct PatronData {
   // Set to delta_position.Value() after movement is updated.
   mathfu::vec3_packed prev_delta_position;
 
-  // The position that the patron left when going to catch the sushi.
-  mathfu::vec3 return_position;
-
   // Face angle to add onto patron's trajectory.
   // Face angle is rotation about z-axis, with y-axis = 0, x-axis = 90 degrees
   // Units are radians.
@@ -197,17 +217,53 @@ struct PatronData {
   // Set to delta_face_angle.Value() after movement is updated.
   motive::Angle prev_delta_face_angle;
 
-  // The height above the patron at which to spawn the happy-indicator.
-  float point_display_height;
+  // The position that the patron left when going to catch the sushi.
+  mathfu::vec3 return_position;
 
-  // The time since `state` was changed, in seconds.
-  float time_in_state;
+  // The sushi entity trying to be caught.
+  corgi::EntityRef catch_sushi;
 
-  // The time since `move_state` was changed, in seconds.
-  float time_in_move_state;
+  // Whether the patron is waiting for its turn in PatronComponent's
+  // `catch_search_queue_` or `face_raft_queue_`.
+  bool catch_search_queued;
+  bool face_raft_queued;
 
-  // The time since the patron was moving towards a piece of sushi.
-  float time_being_ignored;
+  // Whether PatronComponent counts the patron's last feeding as recent. See
+  // PatronComponent::CountFedSince().
+  bool recently_fed;
+
+  // How many of PatronComponent's appear windows the raft is in for this
+  // patron. It can only appear while this is positive.
+  int open_appear_windows;
+
+  // Tuning and event data, which is only read when the patron changes
+  // state, searches for sushi, is hit or plays an event.
+
+  // The type of patron being animated. Each patron has its own set of
+  // animations.
+  AnimObject anim_object;
+
+  // Sequence of animations to follow once StartEvent() has been called.
+  std::vector<PatronEvent> events;
+
+  // Current index into the `events` array.
+  int event_index;
+
+  // Whether the patron is in the event's list of patrons waiting for an
+  // animation to end, which steps it every frame.
+  bool event_waiting;
+
+  // The tag of the body part that needs to be hit to trigger a fall.
+  // Note that an empty name means any collision counts.
+  std::string target_tag;
+
+  // The index into physics data's `rigid_bodies` that corresponds to
+  // `target_tag`. Cache here so we don't have to loop through all the rigid
+  // bodies doing string compares.
+  int target_rigid_body_index;
+
+  // The height above the patron at which to spawn the happy-indicator.
+  float point_display_height;
 
   // The maximum distance that the patron will move when trying to catch sushi.
   float max_catch_distance;
@@ -233,9 +289,6 @@ struct PatronData {
   // Average speed at which to travel towards the sushi catch position.
   motive::Range catch_speed;
 
-  // The sushi entity trying to be caught.
-  corgi::EntityRef catch_sushi;
-
   // When moving towards a sushi, wait this amount of time before adjusting
   // the search for another sushi.
   float time_between_catch_searches;
@@ -254,30 +307,39 @@ struct PatronData {
   // The time to take turning to face the raft, in seconds.
   float time_to_face_raft;
 
-  // After being ignored for a while, the patron will get exasperated and idle
-  // at a faster playback rate. If still no sushi is thrown at the patron,
-  // the patron will disappear. This is the amount of time before disappearing
-  // that the patron will be exasperated. Time in seconds.
-  float time_exasperated_before_disappearing;
-
-  // When exasperated, we play the idle animation faster. Therefore, this
-  // number should be > 1.
-  float exasperated_playback_rate;
-
   // If true: when fed play eat, satisfied, disappear animations.
   // If false: when fed play satisfied, disappear animations.
   bool play_eating_animation;
 };
 
 class PatronComponent : public corgi::Component<PatronData> {
+  // Times the catch search on its own.
+  friend class Microbenchmark;
+
  public:
-  PatronComponent() : config_(nullptr), event_time_(-1) {}
+  PatronComponent()
+      : services_(nullptr),
+        render_mesh_component_(nullptr),
+        physics_component_(nullptr),
+        config_(nullptr),
+        event_time_(-1),
+        appear_rail_(nullptr),
+        appear_rail_sample_time_(0.0f),
+        appear_rail_padding_(0.0f),
+        appear_windows_started_(0),
+        last_raft_spline_time_(0.0f),
+        appear_windows_dirty_(true),
+        next_timeline_event_(0),
+        num_patrons_(0),
+        num_recently_fed_(0),
+        num_fed_at_start_(0) {}
   virtual ~PatronComponent() {}
 
   virtual void Init();
   virtual void AddFromRawData(corgi::EntityRef& parent, const void* raw_data);
   virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
   virtual void InitEntity(corgi::EntityRef& entity);
+  virtual void CleanupEntity(corgi::EntityRef& entity);
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
 
   void UpdateAndEnablePhysics();
@@ -285,9 +347,40 @@ class PatronComponent : public corgi::Component<PatronData> {
   // This needs to be called after the entities have been loaded from data.
   void PostLoadFixup();
 
+  // Like PostLoadFixup(), for `entities` loaded after the rest, such as a
+  // level sector. The other patrons are left as they are.
+  void PostLoadFixup(const std::vector<corgi::EntityRef>& entities);
+
+  // What's kept of a patron while it isn't loaded, or to resume a game.
+  struct SavedPatron {
+    SavedPatron() : last_lap_fed(-1.0f), last_lap_upright(-1.0f) {}
+    float last_lap_fed;
+    float last_lap_upright;
+  };
+
+  // Keep counting the patrons among `entities`, a level sector about to be
+  // unloaded, in num_patrons() and CountFedSince(). They're kept by entity
+  // id, so patrons without one are dropped.
+  void RetainUnloaded(const std::vector<corgi::EntityRef>& entities);
+
+  // Give the patrons among `entities`, loaded again and fixed up, back the
+  // laps they had when they were unloaded, or that RestorePatrons() gave
+  // them, and stop counting them as unloaded.
+  void RestoreUnloaded(const std::vector<corgi::EntityRef>& entities);
+
+  // Set `patrons` to the laps of every patron of the level, by entity id,
+  // whether it's loaded or not.
+  void SavePatrons(std::map<std::string, SavedPatron>* patrons) const;
+
+  // Give the loaded patrons the laps SavePatrons() saved for them. The rest
+  // count as unloaded until their sectors load. Call after PostLoadFixup().
+  void RestorePatrons(const std::map<std::string, SavedPatron>& patrons);
+
   // Each patron (optionally) holds a sequence of animations in
   // `PatronData::events`. These events are followed after StartEvent() is
-  // called.
+  // called. Timed events are merged into one timeline, so each update only
+  // looks at the events that are due, and the patrons waiting for an
+  // animation to end.
   void StartEvent(corgi::WorldTime event_start_time);
 
   // Stop playback of event timeline, and resume normal operation.
@@ -297,19 +390,99 @@ class PatronComponent : public corgi::Component<PatronData> {
   // StartEvent().
   corgi::WorldTime event_time() const { return event_time_; }
 
+  // Scale the distances within which patrons are updated fully.
+  void set_update_lod_distance_scale(float scale) {
+    update_lod_.set_distance_scale(scale);
+  }
+
   static void CollisionHandler(
       corgi::component_library::CollisionData* collision_data, void* user_data);
 
+  // Sweep a sphere of `radius` from `start` to `end` against the targets of
+  // the upright patrons, and treat the first one it touches as being hit by
+  // `projectile`. Returns true if it touched one.
+  bool SweepProjectile(const corgi::EntityRef& projectile,
+                       const mathfu::vec3& start, const mathfu::vec3& end,
+                       float radius);
+
+  // The level's patrons, including those of sectors that have been unloaded.
+  int num_patrons() const {
+    return num_patrons_ + static_cast<int>(unloaded_patrons_.size());
+  }
+
+  // The number of patrons whose last feeding was at `min_lap` or later, plus
+  // those fed before the raft started moving, including those of unloaded
+  // sectors. Kept up to date as patrons are fed, so this doesn't look at
+  // every patron. `min_lap` must not decrease between calls, until
+  // PostLoadFixup() resets the patrons.
+  int CountFedSince(float min_lap);
+
  private:
+  struct Feeding {
+    corgi::EntityRef patron;
+    float lap;
+  };
+  // One of a patron's events with a time, in StartEvent()'s timeline.
+  struct TimelineEvent {
+    corgi::WorldTime time;
+    corgi::EntityRef patron;
+    // Into the patron's `events`.
+    int index;
+  };
+  // Spline times of the raft's rail between which a patron may be close
+  // enough to the raft to appear.
+  struct AppearWindow {
+    float start;
+    float end;
+    corgi::EntityRef patron;
+  };
+
+  void FixupPatron(const corgi::EntityRef& patron);
+  void RecordFed(const corgi::EntityRef& patron, PatronData* patron_data,
+                 float lap);
+  void ResetFedCounts();
+  // Null if `entity` has no entity id.
+  const std::string* EntityId(const corgi::EntityRef& entity) const;
+  void AddUnloaded(const std::string& entity_id, const SavedPatron& saved);
+  // Returns false if `entity_id` wasn't unloaded.
+  bool RemoveUnloaded(const std::string& entity_id,
+                      SavedPatron* saved = nullptr);
+  void ApplySaved(const corgi::EntityRef& patron, PatronData* patron_data,
+                  const SavedPatron& saved);
+  void SampleAppearRail(const Rail* rail);
+  void AddAppearWindows(const corgi::EntityRef& patron,
+                        const PatronData* patron_data,
+                        const corgi::component_library::TransformData*
+                            transform_data);
+  static bool AppearWindowStartsBefore(const AppearWindow& a,
+                                       const AppearWindow& b);
+  void BuildAppearWindows();
+  void CloseAppearWindows();
+  void ReindexAppearWindows(const corgi::EntityRef& patron);
+  void UpdateAppearWindows(const RailDenizenData* raft_rail_denizen);
+  // `part_tag` is the tag of the patron's body that was hit, or null if the
+  // target is already known to have been hit.
   void HandleCollision(const corgi::EntityRef& patron_entity,
                        const corgi::EntityRef& proj_entity,
-                       const std::string& part_tag);
+                       const std::string* part_tag);
   void UpdateMovement(const corgi::EntityRef& patron);
+  bool WaitsForEventAnim(const PatronData* patron_data) const;
+  // Play the patron's next event if it's time to. Returns whether it's left
+  // waiting for an animation to end.
+  bool StepEvent(const corgi::EntityRef& patron, PatronData* patron_data,
+                 corgi::WorldTime delta_time);
+  void UpdateEventTimeline(corgi::WorldTime delta_time);
   void SpawnPointDisplay(const corgi::EntityRef& patron);
   bool ShouldAppear(
       const PatronData* patron_data,
       const corgi::component_library::TransformData* transform_data,
       const RailDenizenData* raft_rail_denizen) const;
+  bool CanAppearThisLap(const PatronData* patron_data,
+                        const RailDenizenData* raft_rail_denizen) const;
+  UpdateLodTier LodTier(
+      const PatronData* patron_data,
+      const corgi::component_library::TransformData* transform_data,
+      const RailDenizenData* raft_rail_denizen) const;
   bool ShouldDisappear(
       const PatronData* patron_data,
       const corgi::component_library::TransformData* transform_data,
@@ -320,25 +493,86 @@ class PatronComponent : public corgi::Component<PatronData> {
   float AnimLength(const PatronData* patron_data, PatronAction action) const;
   void SetAnimPlaybackRate(const PatronData* patron_data, float playback_rate);
   void Animate(PatronData* patron_data, PatronAction action);
+  void StopAnimating(const corgi::EntityRef& patron);
   motive::Range TargetHeightRange(const corgi::EntityRef& patron) const;
   bool RaftExists() const;
   mathfu::vec3 RaftPosition() const;
+  void BuildProjectileGrid();
+  // Not const, since it fills the scratch buffers below.
   const corgi::EntityRef* ClosestProjectile(const corgi::EntityRef& patron,
                                             mathfu::vec3* closest_position,
                                             motive::Angle* closest_face_angle,
-                                            float* closest_time) const;
+                                            float* closest_time);
   void FindProjectileAndCatch(const corgi::EntityRef& patron);
   void MoveToTarget(const corgi::EntityRef& patron,
                     const mathfu::vec3& target_position,
                     motive::Angle target_face_angle, float target_time);
   bool ShouldReturnToIdle(const corgi::EntityRef& patron) const;
   void FaceRaft(const corgi::EntityRef& patron);
+  void RunScheduledCatchSearches(int budget);
+  void RunScheduledFaceRafts(int budget);
   motive::Angle ReturnAngle(const corgi::EntityRef& patron) const;
 
+  // Resolved once in Init(), rather than per patron.
+  ServicesComponent* services_;
+  corgi::component_library::RenderMeshComponent* render_mesh_component_;
+  corgi::component_library::PhysicsComponent* physics_component_;
   const Config* config_;
 
   // Current time into the "event". i.e. the set-up sequence of animations.
   corgi::WorldTime event_time_;
+
+  // Every patron's timed events, soonest first, and the next to be due.
+  std::vector<TimelineEvent> event_timeline_;
+  size_t next_timeline_event_;
+  // Patrons in the event whose next step is when their animation ends.
+  std::vector<corgi::EntityRef> event_waiters_;
+
+  // Throttles updates of patrons that can't be seen or interacted with.
+  UpdateLod update_lod_;
+
+  // The raft's rail, sampled every `appear_rail_sample_time_`. Consecutive
+  // samples are at most `appear_rail_padding_` apart.
+  const Rail* appear_rail_;
+  std::vector<mathfu::vec3_packed> appear_rail_samples_;
+  float appear_rail_sample_time_;
+  float appear_rail_padding_;
+  // Every patron's appear windows, sorted by start. As the raft moves along
+  // its rail, the windows it reaches are opened, and closed once it's past
+  // them, so only patrons in an open window are checked for appearing.
+  std::vector<AppearWindow> appear_windows_;
+  // The windows before this index have been opened on this lap.
+  size_t appear_windows_started_;
+  std::vector<size_t> open_appear_windows_;
+  float last_raft_spline_time_;
+  // Set when patrons are added, removed or moved, to build the windows again.
+  bool appear_windows_dirty_;
+
+  // The player's projectiles this update, bucketed so that each catch search
+  // only tests those that pass nearby.
+  ProjectileSnapshot projectile_snapshot_;
+  ProjectileGrid projectile_grid_;
+
+  // Patrons waiting for their turn to search for sushi, or to face the raft,
+  // when the number per frame is limited by PatronScheduleConfig.
+  std::deque<corgi::EntityRef> catch_search_queue_;
+  std::deque<corgi::EntityRef> face_raft_queue_;
+
+  // Scratch buffers for the projectiles near the patron being searched.
+  std::vector<int> nearby_projectiles_;
+  std::vector<ProjectileApproach> approaches_;
+
+  int num_patrons_;
+  // Feedings, oldest first, that may still be counted by CountFedSince().
+  std::deque<Feeding> recent_feedings_;
+  // Patrons whose last feeding is in `recent_feedings_`.
+  int num_recently_fed_;
+  // Patrons whose last feeding was at lap 0, before the raft moved.
+  int num_fed_at_start_;
+  // Patrons that aren't loaded, by entity id, and the laps those that were
+  // fed were last fed on.
+  std::map<std::string, SavedPatron> unloaded_patrons_;
+  std::multiset<float> unloaded_laps_fed_;
 };
 
 }  // zooshi
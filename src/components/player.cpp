@@ -13,8 +13,11 @@
 // limitations under the License.
 
 #include "components/player.h"
+
+#include <algorithm>
 #include "camera.h"
 #include "components/attributes.h"
+#include "components/export_builder.h"
 #include "components/player_projectile.h"
 #include "components/rail_denizen.h"
 #include "components/services.h"
@@ -36,8 +39,6 @@ namespace zooshi {
 BREADBOARD_DEFINE_EVENT(kOnFireEventId)
 
 using corgi::component_library::CommonServicesComponent;
-using corgi::component_library::GraphComponent;
-using corgi::component_library::GraphData;
 using corgi::component_library::PhysicsComponent;
 using corgi::component_library::PhysicsData;
 using corgi::component_library::TransformComponent;
@@ -46,13 +47,16 @@ using corgi::component_library::TransformData;
 void PlayerComponent::Init() {
   config_ = entity_manager_->GetComponent<ServicesComponent>()->config();
 }
-void PlayerComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
+void PlayerComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
     PlayerData* player_data = Data<PlayerData>(iter->entity);
     TransformData* transform_data = Data<TransformData>(iter->entity);
     if (state_ != kPlayerState_Disabled) {
       player_data->input_controller()->Update();
+      if (input_recorder_ != nullptr) {
+        input_recorder_->Record(delta_time, *player_data->input_controller());
+      }
     }
     transform_data->orientation =
         mathfu::quat::RotateFromTo(player_data->GetFacing(), mathfu::kAxisY3f);
@@ -61,10 +65,8 @@ void PlayerComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
         player_data->input_controller()->Button(kFireProjectile).HasChanged()) {
       SpawnProjectile(iter->entity);
 
-      GraphData* graph_data = Data<GraphData>(iter->entity);
-      if (graph_data) {
-        graph_data->broadcaster.BroadcastEvent(kOnFireEventId);
-      }
+      entity_manager_->GetComponent<ServicesComponent>()->graph_events()->Post(
+          iter->entity, kOnFireEventId);
     }
   }
 }
@@ -103,12 +105,8 @@ corgi::EntityRef PlayerComponent::SpawnProjectile(corgi::EntityRef source) {
           ->data());
   corgi::EntityRef projectile =
       entity_manager_->GetComponent<ServicesComponent>()
-          ->entity_factory()
-          ->CreateEntityFromPrototype(current_sushi->prototype()->c_str(),
-                                      entity_manager_);
-  GraphComponent* graph_component =
-      entity_manager_->GetComponent<GraphComponent>();
-  graph_component->EntityPostLoadFixup(projectile);
+          ->entity_pool()
+          ->Acquire(current_sushi->prototype()->c_str());
 
   TransformData* transform_data = Data<TransformData>(projectile);
   PhysicsData* physics_data = Data<PhysicsData>(projectile);
@@ -131,12 +129,38 @@ corgi::EntityRef PlayerComponent::SpawnProjectile(corgi::EntityRef source) {
   auto raft_rail = raft_entity ? Data<RailDenizenData>(raft_entity) : nullptr;
   if (raft_rail != nullptr) velocity += raft_rail->Velocity();
 
-  physics_data->SetVelocity(velocity);
-  physics_data->SetAngularVelocity(RandomProjectileAngularVelocity());
-  auto physics_component = entity_manager_->GetComponent<PhysicsComponent>();
-  physics_component->UpdatePhysicsFromTransform(projectile);
+  // Move the sushi as far as it would have flown since the tap, so the
+  // frames between the tap and this update don't delay the throw.
+  const uint32_t fire_age = std::min(
+      Data<PlayerData>(source)->input_controller()->fire_age(),
+      static_cast<uint32_t>(std::max(config_->projectile_max_backdate(), 0)));
+  transform_data->position +=
+      velocity * (static_cast<float>(fire_age) / corgi::kMillisecondsPerSecond);
 
+  auto physics_component = entity_manager_->GetComponent<PhysicsComponent>();
   projectile_data->owner = source;
+  projectile_data->continuous_collision = current_sushi->continuous_collision();
+  projectile_data->has_previous_position = false;
+  projectile_data->analytic = current_sushi->analytic_trajectory();
+  projectile_data->landed = false;
+  if (projectile_data->analytic) {
+    // The rigid body only supplies the projectile's size and gravity. It
+    // stays out of the physics world while the projectile flies.
+    projectile_data->velocity = velocity;
+    projectile_data->angular_velocity = RandomProjectileAngularVelocity();
+    projectile_data->gravity = physics_component->GravityForEntity(projectile);
+    mathfu::vec3 body_min;
+    mathfu::vec3 body_max;
+    physics_data->GetAabb(0, &body_min, &body_max);
+    const mathfu::vec3 extent = body_max - body_min;
+    projectile_data->radius =
+        0.5f * std::min(extent.x, std::min(extent.y, extent.z));
+    physics_component->DisablePhysics(projectile);
+  } else {
+    physics_data->SetVelocity(velocity);
+    physics_data->SetAngularVelocity(RandomProjectileAngularVelocity());
+    physics_component->UpdatePhysicsFromTransform(projectile);
+  }
 
   // TODO: Preferably, this should be a step in the entity creation.
   transform_component->UpdateChildLinks(projectile);
@@ -189,12 +213,13 @@ corgi::ComponentInterface::RawDataUniquePtr PlayerComponent::ExportRawData(
   const PlayerData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
 
   PlayerDefBuilder builder(fbb);
 
   fbb.Finish(builder.Finish());
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 }  // zooshi
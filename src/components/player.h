@@ -22,6 +22,7 @@
 #include "config_generated.h"
 #include "corgi/component.h"
 #include "inputcontrollers/base_player_controller.h"
+#include "inputcontrollers/input_recording.h"
 #include "mathfu/constants.h"
 #include "mathfu/glsl_mappings.h"
 #include "pindrop/pindrop.h"
@@ -62,7 +63,7 @@ class PlayerData {
 
 class PlayerComponent : public corgi::Component<PlayerData> {
  public:
-  PlayerComponent() {}
+  PlayerComponent() : input_recorder_(nullptr) {}
   virtual ~PlayerComponent() {}
 
   virtual void Init();
@@ -77,11 +78,18 @@ class PlayerComponent : public corgi::Component<PlayerData> {
 
   void set_state(PlayerState state) { state_ = state; }
 
+  // While set, each update's input is recorded by `input_recorder`.
+  void set_input_recorder(InputRecorder* input_recorder) {
+    input_recorder_ = input_recorder;
+  }
+  InputRecorder* input_recorder() const { return input_recorder_; }
+
  private:
   mathfu::vec3 RandomProjectileAngularVelocity() const;
 
   const Config* config_;
   PlayerState state_;
+  InputRecorder* input_recorder_;
 };
 
 }  // zooshi
@@ -14,12 +14,19 @@
 
 #include "components/player_projectile.h"
 
+#include <algorithm>
+#include "components/patron.h"
+#include "components/river.h"
 #include "components/services.h"
 #include "corgi_component_library/common_services.h"
+#include "corgi_component_library/graph.h"
+#include "corgi_component_library/physics.h"
 #include "corgi_component_library/transform.h"
 #include "flatbuffers/flatbuffers.h"
 #include "flatbuffers/reflection.h"
+#include "mathfu/constants.h"
 #include "pindrop/pindrop.h"
+#include "world.h"
 
 CORGI_DEFINE_COMPONENT(fpl::zooshi::PlayerProjectileComponent,
                        fpl::zooshi::PlayerProjectileData)
@@ -27,9 +34,20 @@ CORGI_DEFINE_COMPONENT(fpl::zooshi::PlayerProjectileComponent,
 namespace fpl {
 namespace zooshi {
 
+using corgi::component_library::CollisionData;
 using corgi::component_library::CommonServicesComponent;
+using corgi::component_library::GraphData;
+using corgi::component_library::PhysicsComponent;
+using corgi::component_library::PhysicsData;
 using corgi::component_library::TransformComponent;
 using corgi::component_library::TransformData;
+using mathfu::quat;
+using mathfu::vec3;
+
+// Spin slower than this, in radians per second, isn't worth turning for.
+static const float kMinAngularSpeed = 1e-3f;
+// The user tag of the water plane, which shares the banks' collision type.
+static const char* kWaterTag = "Water";
 
 void PlayerProjectileComponent::AddFromRawData(corgi::EntityRef& entity,
                                                const void* /*raw_data*/) {
@@ -37,5 +55,131 @@ void PlayerProjectileComponent::AddFromRawData(corgi::EntityRef& entity,
   entity_manager_->AddEntityToComponent<TransformComponent>(entity);
 }
 
+void PlayerProjectileComponent::UpdateAllEntities(
+    corgi::WorldTime delta_time) {
+  ServicesComponent* services =
+      entity_manager_->GetComponent<ServicesComponent>();
+  EntityPoolComponent* entity_pool = services->entity_pool();
+  PatronComponent* patron_component =
+      entity_manager_->GetComponent<PatronComponent>();
+  TransformComponent* transform_component =
+      entity_manager_->GetComponent<TransformComponent>();
+  const RiverConfig* river = services->world()->CurrentLevel()->river_config();
+  const float seconds =
+      static_cast<float>(delta_time) / corgi::kMillisecondsPerSecond;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    PlayerProjectileData* projectile_data = &iter->data;
+    if (!projectile_data->continuous_collision && !projectile_data->analytic) {
+      continue;
+    }
+    if (!entity_pool->IsActive(iter->entity)) {
+      projectile_data->has_previous_position = false;
+      continue;
+    }
+    if (projectile_data->analytic) {
+      AdvanceAnalytic(iter->entity, projectile_data, seconds, river);
+      continue;
+    }
+
+    const vec3 position = transform_component->WorldPosition(iter->entity);
+    const PhysicsData* physics_data = Data<PhysicsData>(iter->entity);
+    if (projectile_data->has_previous_position && physics_data != nullptr) {
+      // The projectile spins, so its smallest extent is the radius of the
+      // sphere it always covers.
+      vec3 body_min;
+      vec3 body_max;
+      physics_data->GetAabb(0, &body_min, &body_max);
+      const vec3 extent = body_max - body_min;
+      const float radius =
+          0.5f * std::min(extent.x, std::min(extent.y, extent.z));
+      patron_component->SweepProjectile(
+          iter->entity, projectile_data->previous_position, position, radius);
+    }
+    projectile_data->previous_position = position;
+    projectile_data->has_previous_position = true;
+  }
+}
+
+bool PlayerProjectileComponent::IsRiverBank(
+    const corgi::EntityRef& entity) const {
+  // The banks' collision is split into sectors, each a child of the river.
+  const TransformData* transform_data = Data<TransformData>(entity);
+  return transform_data != nullptr && transform_data->parent &&
+         Data<RiverData>(transform_data->parent) != nullptr;
+}
+
+void PlayerProjectileComponent::SendCollision(
+    corgi::EntityRef& entity, const PlayerProjectileData& projectile_data,
+    const corgi::EntityRef& other, const vec3& position, const char* tag) {
+  // The graphs read the velocity of the body, which isn't simulated.
+  PhysicsData* physics_data = Data<PhysicsData>(entity);
+  if (physics_data != nullptr) {
+    physics_data->SetVelocity(projectile_data.velocity);
+  }
+  // As PhysicsComponent would report it, were the body in the world.
+  CollisionData& collision_data =
+      GetComponent<PhysicsComponent>()->collision_data();
+  collision_data.this_entity = entity;
+  collision_data.this_position = position;
+  collision_data.this_tag.clear();
+  collision_data.other_entity = other;
+  collision_data.other_position = position;
+  collision_data.other_tag = tag;
+  GraphData* graph_data = Data<GraphData>(entity);
+  if (graph_data != nullptr) {
+    graph_data->broadcaster.BroadcastEvent(
+        corgi::component_library::kCollisionEventId);
+  }
+}
+
+void PlayerProjectileComponent::AdvanceAnalytic(
+    corgi::EntityRef& entity, PlayerProjectileData* projectile_data,
+    float seconds, const RiverConfig* river) {
+  if (projectile_data->landed) return;
+  TransformData* transform_data = Data<TransformData>(entity);
+
+  // Gravity only acts on the height, so the arc is exact for any step.
+  vec3 start = transform_data->position;
+  vec3 end = start + projectile_data->velocity * seconds +
+             mathfu::kAxisZ3f * (0.5f * projectile_data->gravity * seconds *
+                                 seconds);
+  projectile_data->velocity.z += projectile_data->gravity * seconds;
+
+  // Projectiles that reach a bank stop there, and wait for their time limit.
+  // The water plane has the banks' collision type, but isn't a bank; its
+  // graph handler removes the projectile instead.
+  if (river != nullptr && river->collision_type() != 0) {
+    vec3 hit_point;
+    PhysicsComponent* physics_component = GetComponent<PhysicsComponent>();
+    const corgi::EntityRef hit = physics_component->RaycastSingle(
+        start, end, static_cast<short>(river->collision_type()), &hit_point);
+    if (hit.IsValid()) {
+      end = hit_point;
+      const char* tag = kWaterTag;
+      if (IsRiverBank(hit)) {
+        tag = river->user_tag() != nullptr ? river->user_tag()->c_str() : "";
+      }
+      SendCollision(entity, *projectile_data, hit, end, tag);
+      projectile_data->landed = true;
+      projectile_data->velocity = mathfu::kZeros3f;
+      projectile_data->gravity = 0.0f;
+    }
+  }
+
+  transform_data->position = end;
+  const vec3& spin = projectile_data->angular_velocity;
+  const float angular_speed = spin.Length();
+  if (!projectile_data->landed && angular_speed > kMinAngularSpeed) {
+    transform_data->orientation =
+        transform_data->orientation *
+        quat::FromAngleAxis(angular_speed * seconds, spin / angular_speed);
+  }
+
+  // This may release the projectile, so it's the last thing done with it.
+  entity_manager_->GetComponent<PatronComponent>()->SweepProjectile(
+      entity, start, end, projectile_data->radius);
+}
+
 }  // zooshi
 }  // fpl
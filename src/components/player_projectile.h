@@ -18,9 +18,11 @@
 #include <string>
 
 #include "components_generated.h"
+#include "config_generated.h"
 #include "corgi/component.h"
 #include "corgi_component_library/graph.h"
 #include "fplbase/utilities.h"
+#include "mathfu/glsl_mappings.h"
 #include "pindrop/pindrop.h"
 
 using corgi::component_library::SerializableGraphState;
@@ -31,10 +33,37 @@ static const corgi::WorldTime kMaxProjectileDuration = 3000;
 
 // Data for scene object components.
 struct PlayerProjectileData {
+  PlayerProjectileData()
+      : continuous_collision(false),
+        has_previous_position(false),
+        analytic(false),
+        gravity(0.0f),
+        radius(0.0f),
+        landed(false) {}
+
   corgi::EntityRef owner;  // The player that "owns" this projectile.
 
   // The graph that may trigger when colliding with another entity.
   std::map<std::string, SerializableGraphState> on_collision;
+
+  // From SushiConfig. If set, the projectile is swept against patrons from
+  // where it was at the last update.
+  bool continuous_collision;
+  bool has_previous_position;
+  mathfu::vec3 previous_position;
+
+  // From SushiConfig's analytic_trajectory. If set, the projectile's rigid
+  // body is disabled, and it's moved along its arc from the values below,
+  // which are set when it's thrown.
+  bool analytic;
+  mathfu::vec3 velocity;
+  // Radians per second about each axis. Only turns the mesh.
+  mathfu::vec3 angular_velocity;
+  float gravity;
+  // Of the sphere swept against patrons.
+  float radius;
+  // Set once the projectile hits a river bank, where it then stays.
+  bool landed;
 };
 
 class PlayerProjectileComponent
@@ -46,7 +75,21 @@ class PlayerProjectileComponent
   virtual void CleanupEntity(corgi::EntityRef& /*entity*/) {}
 
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
-  virtual void UpdateAllEntities(corgi::WorldTime /*delta_time*/) {}
+  // Move the analytic projectiles, and sweep them and the ones that use
+  // continuous collision against patrons.
+  virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+
+ private:
+  void AdvanceAnalytic(corgi::EntityRef& entity,
+                       PlayerProjectileData* projectile_data, float seconds,
+                       const RiverConfig* river);
+  bool IsRiverBank(const corgi::EntityRef& entity) const;
+  // Tell the projectile's graphs it hit `other`, the way a collision between
+  // rigid bodies would, so their sounds play and water removes it.
+  void SendCollision(corgi::EntityRef& entity,
+                     const PlayerProjectileData& projectile_data,
+                     const corgi::EntityRef& other,
+                     const mathfu::vec3& position, const char* tag);
 };
 
 }  // zooshi
@@ -18,6 +18,7 @@
 #include <cmath>
 #include <limits>
 #include "breadboard/event.h"
+#include "components/export_builder.h"
 #include "components/rail_node.h"
 #include "components/services.h"
 #include "components_generated.h"
@@ -38,7 +39,6 @@
 #include "scene_lab/corgi/corgi_adapter.h"
 
 using mathfu::vec3;
-using corgi::component_library::GraphData;
 
 CORGI_DEFINE_COMPONENT(fpl::zooshi::RailDenizenComponent,
                        fpl::zooshi::RailDenizenData)
@@ -54,12 +54,33 @@ using corgi::component_library::TransformData;
 using corgi::component_library::TransformComponent;
 using scene_lab::SceneLab;
 
+// Entities per job when updating in parallel. Each update is cheap, so the
+// chunks are large enough to cover the cost of queueing a job.
+static const int kEntitiesPerJob = 32;
+
 void Rail::Positions(float delta_time,
                      std::vector<mathfu::vec3_packed>* positions) const {
   const size_t num_positions =
       static_cast<size_t>(std::floor(EndTime() / delta_time)) + 1;
+
+  // Reuse the lookup table when it was sampled at the same rate.
+  if (delta_time == lookup_delta_time_ &&
+      num_positions <= lookup_positions_.size()) {
+    positions->assign(lookup_positions_.begin(),
+                      lookup_positions_.begin() + num_positions);
+    return;
+  }
   positions->resize(num_positions);
 
+  // Otherwise resample it, which is much cheaper than evaluating the splines.
+  // The river and the patrons' appear windows sample no finer than the table.
+  if (HasLookupTable()) {
+    for (size_t i = 0; i < num_positions; ++i) {
+      (*positions)[i] = Position(static_cast<float>(i) * delta_time);
+    }
+    return;
+  }
+
   motive::CompactSpline::BulkYs<3>(Splines(), 0.0f, delta_time, num_positions,
                                    &(*positions)[0]);
 }
@@ -81,13 +102,17 @@ void RailDenizenData::Initialize(const Rail& r,
   // The interpolated orientation converges towards the target orientation
   // at a non-linear rate that is affected by delta-time and
   // orientation_convergence_rate, this hack estimates the look-ahead for the
-  // convergence time given roughly a 60Hz update rate.
-  orientation_motivator.Initialize(motive::SplineInit(), &engine);
-  orientation_motivator.SetSplines(r.Splines(), playback);
-  if (orientation_convergence_rate != 0.0f) {
+  // convergence time given roughly a 60Hz update rate. Without convergence,
+  // the look-ahead would be at the same point on the rail as `motivator`, so
+  // the one spline playhead is shared rather than evaluated twice.
+  if (update_orientation && orientation_convergence_rate != 0.0f) {
+    orientation_motivator.Initialize(motive::SplineInit(), &engine);
+    orientation_motivator.SetSplines(r.Splines(), playback);
     orientation_motivator.SetSplineTime(static_cast<motive::MotiveTime>(
         1.0f / logf(0.5f + orientation_convergence_rate) *
         corgi::kMillisecondsPerSecond));
+  } else {
+    orientation_motivator.Invalidate();
   }
   playback_rate.InitializeWithTarget(motive::SplineInit(), &engine,
                                      motive::Current1f(initial_playback_rate));
@@ -122,83 +147,115 @@ void RailDenizenComponent::Init() {
   }
 }
 
+bool RailDenizenComponent::UpdateEntity(const corgi::EntityRef& entity,
+                                        RailDenizenData* rail_denizen_data,
+                                        corgi::WorldTime delta_time) {
+  rail_denizen_data->SetSplinePlaybackRate(rail_denizen_data->PlaybackRate());
+  TransformData* transform_data = Data<TransformData>(entity);
+  vec3 position = rail_denizen_data->rail_orientation.Inverse() *
+                  rail_denizen_data->Position();
+  position *= rail_denizen_data->rail_scale;
+  position += rail_denizen_data->rail_offset;
+  transform_data->position = position;
+  if (rail_denizen_data->update_orientation) {
+    float convergence_rate = rail_denizen_data->orientation_convergence_rate;
+    const motive::Motivator3f& motivator =
+        rail_denizen_data->OrientationMotivator();
+
+    // Rotating towards the Z axis is a bit complicated, because we want that
+    // rotation to happen in local space (so the front of the raft goes up),
+    // but rotation on the XY plane should happen in world space. So we need
+    // to separate the two rotations from each other to accomplish this.
+    vec3 world_direction = motivator.Direction();
+    const float z_length = world_direction.z;
+    world_direction.z = 0.0f;
+    const float xy_length = world_direction.Length();
+    float z_angle(atan2f(z_length, xy_length));
+    if (z_angle < -M_PI) {
+      z_angle = M_PI;
+    }
+
+    mathfu::quat target_orientation =
+        rail_denizen_data->rail_orientation *
+        mathfu::quat::FromAngleAxis(z_angle, -mathfu::kAxisX3f) *
+        mathfu::quat::RotateFromTo(world_direction, mathfu::kAxisY3f);
+    // Convergence is disabled when the playback rate is zero as
+    // it's possible for the slerp to yield an invalid quaternion
+    // with angles approaching zero.
+    if (convergence_rate != 0.0f && rail_denizen_data->PlaybackRate() > 0.0f) {
+      rail_denizen_data->interpolated_orientation = mathfu::quat::Slerp(
+          rail_denizen_data->interpolated_orientation, target_orientation,
+          std::min(convergence_rate * static_cast<float>(delta_time) /
+                       static_cast<float>(corgi::kMillisecondsPerSecond),
+                   1.0f));
+      transform_data->orientation = rail_denizen_data->interpolated_orientation;
+    } else {
+      transform_data->orientation = target_orientation;
+    }
+  }
+
+  bool new_lap = false;
+  float previous_progress = rail_denizen_data->lap_progress;
+  motive::MotiveTime total = rail_denizen_data->motivator.SplineTime() +
+                             rail_denizen_data->motivator.TargetTime();
+  rail_denizen_data->lap_progress =
+      static_cast<float>(rail_denizen_data->motivator.SplineTime()) / total;
+
+  bool use_lap_end =
+      rail_denizen_data->lap_end > 0 && rail_denizen_data->lap_end < 1;
+  // When the motivator has looped all the way back to the beginning of the
+  // spline, the SplineTime returns back to 0. We can exploit this fact to
+  // determine when a lap has been completed, by comparing against the
+  // previous lap amount.
+  if ((use_lap_end && previous_progress < rail_denizen_data->lap_end &&
+       rail_denizen_data->lap_progress >= rail_denizen_data->lap_end) ||
+      (!use_lap_end && rail_denizen_data->lap_progress < previous_progress)) {
+    new_lap = true;
+    rail_denizen_data->lap_number++;
+  }
+  rail_denizen_data->total_lap_progress =
+      rail_denizen_data->lap_progress + rail_denizen_data->lap_number;
+  return new_lap;
+}
+
 void RailDenizenComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
+  // Disabled denizens don't move, so only enabled ones are handed out to
+  // the workers. Many are disabled at once, such as patrons that have been
+  // fed.
+  updates_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    RailDenizenData* rail_denizen_data = GetComponentData(iter->entity);
-    if (!rail_denizen_data->enabled) {
-      continue;
-    }
-    rail_denizen_data->SetSplinePlaybackRate(rail_denizen_data->PlaybackRate());
-    TransformData* transform_data = Data<TransformData>(iter->entity);
-    vec3 position = rail_denizen_data->rail_orientation.Inverse() *
-                    rail_denizen_data->Position();
-    position *= rail_denizen_data->rail_scale;
-    position += rail_denizen_data->rail_offset;
-    transform_data->position = position;
-    if (rail_denizen_data->update_orientation) {
-      float convergence_rate = rail_denizen_data->orientation_convergence_rate;
-      const motive::Motivator3f& motivator =
-          convergence_rate == 0.0f ? rail_denizen_data->motivator
-                                   : rail_denizen_data->orientation_motivator;
-
-      // Rotating towards the Z axis is a bit complicated, because we want that
-      // rotation to happen in local space (so the front of the raft goes up),
-      // but rotation on the XY plane should happen in world space. So we need
-      // to separate the two rotations from each other to accomplish this.
-      vec3 world_direction = motivator.Direction();
-      const float z_length = world_direction.z;
-      world_direction.z = 0.0f;
-      const float xy_length = world_direction.Length();
-      float z_angle(atan2f(z_length, xy_length));
-      if (z_angle < -M_PI) {
-        z_angle = M_PI;
-      }
+    if (!iter->data.enabled) continue;
+    EntityUpdate update;
+    update.entity = iter->entity;
+    update.data = &iter->data;
+    update.new_lap = false;
+    updates_.push_back(update);
+  }
 
-      mathfu::quat target_orientation =
-          rail_denizen_data->rail_orientation *
-          mathfu::quat::FromAngleAxis(z_angle, -mathfu::kAxisX3f) *
-          mathfu::quat::RotateFromTo(world_direction, mathfu::kAxisY3f);
-      // Convergence is disabled when the playback rate is zero as
-      // it's possible for the slerp to yield an invalid quaternion
-      // with angles approaching zero.
-      if (convergence_rate != 0.0f &&
-          rail_denizen_data->PlaybackRate() > 0.0f) {
-        rail_denizen_data->interpolated_orientation = mathfu::quat::Slerp(
-            rail_denizen_data->interpolated_orientation, target_orientation,
-            std::min(convergence_rate * static_cast<float>(delta_time) /
-                         static_cast<float>(corgi::kMillisecondsPerSecond),
-                     1.0f));
-        transform_data->orientation =
-            rail_denizen_data->interpolated_orientation;
-      } else {
-        transform_data->orientation = target_orientation;
-      }
+  // Each entity only touches its own data, so they can be split between the
+  // job system's workers.
+  auto update_range = [this, delta_time](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      updates_[i].new_lap =
+          UpdateEntity(updates_[i].entity, updates_[i].data, delta_time);
     }
+  };
+  JobSystem* job_system =
+      entity_manager_->GetComponent<ServicesComponent>()->job_system();
+  if (job_system != nullptr) {
+    job_system->ParallelFor(static_cast<int>(updates_.size()),
+                            kEntitiesPerJob, update_range);
+  } else {
+    update_range(0, static_cast<int>(updates_.size()));
+  }
 
-    float previous_progress = rail_denizen_data->lap_progress;
-    motive::MotiveTime total = rail_denizen_data->motivator.SplineTime() +
-                               rail_denizen_data->motivator.TargetTime();
-    rail_denizen_data->lap_progress =
-        static_cast<float>(rail_denizen_data->motivator.SplineTime()) / total;
-
-    bool use_lap_end =
-        rail_denizen_data->lap_end > 0 && rail_denizen_data->lap_end < 1;
-    // When the motivator has looped all the way back to the beginning of the
-    // spline, the SplineTime returns back to 0. We can exploit this fact to
-    // determine when a lap has been completed, by comparing against the
-    // previous lap amount.
-    if ((use_lap_end && previous_progress < rail_denizen_data->lap_end &&
-         rail_denizen_data->lap_progress >= rail_denizen_data->lap_end) ||
-        (!use_lap_end && rail_denizen_data->lap_progress < previous_progress)) {
-      rail_denizen_data->lap_number++;
-      GraphData* graph_data = Data<GraphData>(iter->entity);
-      if (graph_data) {
-        graph_data->broadcaster.BroadcastEvent(kNewLapEventId);
-      }
-    }
-    rail_denizen_data->total_lap_progress =
-        rail_denizen_data->lap_progress + rail_denizen_data->lap_number;
+  // Graphs can do anything in response to an event, so lap events are
+  // broadcast once every component has updated.
+  GraphEventQueue* graph_events =
+      entity_manager_->GetComponent<ServicesComponent>()->graph_events();
+  for (auto it = updates_.begin(); it != updates_.end(); ++it) {
+    if (it->new_lap) graph_events->Post(it->entity, kNewLapEventId);
   }
 }
 
@@ -250,7 +307,7 @@ void RailDenizenComponent::AddFromRawData(corgi::EntityRef& entity,
 
   data->interpolated_orientation =
       data->rail_orientation *
-      mathfu::quat::RotateFromTo(data->orientation_motivator.Direction(),
+      mathfu::quat::RotateFromTo(data->OrientationMotivator().Direction(),
                                  mathfu::kAxisY3f);
 }
 
@@ -274,7 +331,8 @@ corgi::ComponentInterface::RawDataUniquePtr RailDenizenComponent::ExportRawData(
   const RailDenizenData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
   fplbase::Vec3 rail_offset(data->internal_rail_offset.x,
                             data->internal_rail_offset.y,
                             data->internal_rail_offset.z);
@@ -303,7 +361,7 @@ corgi::ComponentInterface::RawDataUniquePtr RailDenizenComponent::ExportRawData(
   builder.add_lap_end(data->lap_end);
 
   fbb.Finish(builder.Finish());
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 void RailDenizenComponent::InitEntity(corgi::EntityRef& entity) {
@@ -327,16 +385,27 @@ void RailDenizenComponent::UpdateRailNodeData(corgi::EntityRef entity) {
 void RailDenizenComponent::PostLoadFixup() {
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    RailDenizenData* rail_data = Data<RailDenizenData>(iter->entity);
-    if (rail_data->inherit_transform_data) {
-      TransformData* transform_data = Data<TransformData>(iter->entity);
-      rail_data->rail_offset =
-          transform_data->position + rail_data->internal_rail_offset;
-      rail_data->rail_orientation =
-          transform_data->orientation * rail_data->internal_rail_orientation;
-      rail_data->rail_scale =
-          transform_data->scale * rail_data->internal_rail_scale;
-    }
+    FixupEntity(iter->entity);
+  }
+}
+
+void RailDenizenComponent::PostLoadFixup(
+    const std::vector<corgi::EntityRef>& entities) {
+  for (auto it = entities.begin(); it != entities.end(); ++it) {
+    if (GetComponentData(*it) != nullptr) FixupEntity(*it);
+  }
+}
+
+void RailDenizenComponent::FixupEntity(const corgi::EntityRef& entity) {
+  RailDenizenData* rail_data = Data<RailDenizenData>(entity);
+  if (rail_data->inherit_transform_data) {
+    TransformData* transform_data = Data<TransformData>(entity);
+    rail_data->rail_offset =
+        transform_data->position + rail_data->internal_rail_offset;
+    rail_data->rail_orientation =
+        transform_data->orientation * rail_data->internal_rail_orientation;
+    rail_data->rail_scale =
+        transform_data->scale * rail_data->internal_rail_scale;
   }
 }
 
@@ -71,7 +71,14 @@ struct RailDenizenData {
 
   void SetSplinePlaybackRate(float rate) {
     motivator.SetSplinePlaybackRate(rate);
-    orientation_motivator.SetSplinePlaybackRate(rate);
+    if (orientation_motivator.Valid()) {
+      orientation_motivator.SetSplinePlaybackRate(rate);
+    }
+  }
+
+  // The playhead that orientation is taken from.
+  const motive::Motivator3f& OrientationMotivator() const {
+    return orientation_motivator.Valid() ? orientation_motivator : motivator;
   }
 
   // The total number of laps completed so far.
@@ -86,6 +93,8 @@ struct RailDenizenData {
   float start_time;
   motive::Motivator3f motivator;
   // Look ahead used to calculate the interpolated orientation of the denizen.
+  // Only valid when the orientation converges, and `motivator` is used
+  // otherwise.
   motive::Motivator3f orientation_motivator;
   motive::Motivator1f playback_rate;
   std::string rail_name;
@@ -128,12 +137,31 @@ class RailDenizenComponent : public corgi::Component<RailDenizenData> {
   // This needs to be called after the entities have been loaded from data.
   void PostLoadFixup();
 
+  // Like PostLoadFixup(), for `entities` loaded after the rest, such as a
+  // level sector.
+  void PostLoadFixup(const std::vector<corgi::EntityRef>& entities);
+
   // When a Rail is reloaded, we need to reinitialize any data that uses it.
   void ChangeRail(const Rail* old_rail, const Rail* new_rail);
 
  private:
+  // An entity to update this frame, and whether it finished a lap.
+  struct EntityUpdate {
+    corgi::EntityRef entity;
+    RailDenizenData* data;
+    bool new_lap;
+  };
+
   void InitializeRail(corgi::EntityRef&);
+  void FixupEntity(const corgi::EntityRef& entity);
   void OnEnterEditor();
+  // Returns true if the enabled entity finished a lap. Only touches the
+  // entity's own data, so entities can be updated in parallel.
+  bool UpdateEntity(const corgi::EntityRef& entity,
+                    RailDenizenData* rail_denizen_data,
+                    corgi::WorldTime delta_time);
+
+  std::vector<EntityUpdate> updates_;
 };
 
 }  // zooshi
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "components/rail_node.h"
+#include <algorithm>
+#include "components/export_builder.h"
 #include "flatbuffers/flatbuffers.h"
 #include "fplbase/utilities.h"
 
@@ -27,6 +29,9 @@ void RailNodeComponent::AddFromRawData(corgi::EntityRef& entity,
   auto rail_node_def = static_cast<const RailNodeDef*>(raw_data);
 
   RailNodeData* data = AddEntity(entity);
+  // Scene Lab re-adds nodes when they're edited, which may move them to a
+  // different rail or position along it.
+  RemoveFromRail(data->rail_name, entity);
   data->rail_name = rail_node_def->rail_name()->c_str();
   data->ordering = rail_node_def->ordering();
   if (rail_node_def->total_time())
@@ -34,6 +39,36 @@ void RailNodeComponent::AddFromRawData(corgi::EntityRef& entity,
   if (rail_node_def->reliable_distance())
     data->reliable_distance = rail_node_def->reliable_distance();
   data->wraps = rail_node_def->wraps();
+
+  std::vector<corgi::EntityRef>& nodes = rails_[data->rail_name];
+  const float ordering = data->ordering;
+  auto insert_at = std::upper_bound(
+      nodes.begin(), nodes.end(), ordering,
+      [this](float value, const corgi::EntityRef& node) {
+        return value < GetComponentData(node)->ordering;
+      });
+  nodes.insert(insert_at, entity);
+}
+
+void RailNodeComponent::CleanupEntity(corgi::EntityRef& entity) {
+  const RailNodeData* data = GetComponentData(entity);
+  if (data != nullptr) RemoveFromRail(data->rail_name, entity);
+}
+
+const std::vector<corgi::EntityRef>* RailNodeComponent::RailNodes(
+    const std::string& rail_name) const {
+  auto rail = rails_.find(rail_name);
+  return rail == rails_.end() || rail->second.empty() ? nullptr
+                                                      : &rail->second;
+}
+
+void RailNodeComponent::RemoveFromRail(const std::string& rail_name,
+                                       const corgi::EntityRef& entity) {
+  auto rail = rails_.find(rail_name);
+  if (rail == rails_.end()) return;
+  std::vector<corgi::EntityRef>& nodes = rail->second;
+  nodes.erase(std::remove(nodes.begin(), nodes.end(), entity), nodes.end());
+  if (nodes.empty()) rails_.erase(rail);
 }
 
 corgi::ComponentInterface::RawDataUniquePtr RailNodeComponent::ExportRawData(
@@ -41,7 +76,8 @@ corgi::ComponentInterface::RawDataUniquePtr RailNodeComponent::ExportRawData(
   const RailNodeData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
 
   auto rail_name = fbb.CreateString(data->rail_name);
 
@@ -57,7 +93,7 @@ corgi::ComponentInterface::RawDataUniquePtr RailNodeComponent::ExportRawData(
   builder.add_wraps(data->wraps);
 
   fbb.Finish(builder.Finish());
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 }  // zooshi
@@ -16,6 +16,8 @@
 #define FPL_ZOOSHI_COMPONENTS_RAIL_NODE_H_
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "rail_def_generated.h"
@@ -41,6 +43,20 @@ class RailNodeComponent : public corgi::Component<RailNodeData> {
 
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
   virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
+  virtual void CleanupEntity(corgi::EntityRef& entity);
+
+  // Returns the nodes of the rail `rail_name`, sorted by ordering, or nullptr
+  // if there are none.
+  const std::vector<corgi::EntityRef>* RailNodes(
+      const std::string& rail_name) const;
+
+ private:
+  void RemoveFromRail(const std::string& rail_name,
+                      const corgi::EntityRef& entity);
+
+  // The nodes of each rail, sorted by ordering, so that rails can be built
+  // without searching every node.
+  std::unordered_map<std::string, std::vector<corgi::EntityRef>> rails_;
 };
 
 }  // zooshi
@@ -0,0 +1,197 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "components/remote_entity.h"
+
+#include <math.h>
+#include <algorithm>
+#include "components/export_builder.h"
+#include "corgi_component_library/physics.h"
+#include "corgi_component_library/transform.h"
+
+CORGI_DEFINE_COMPONENT(fpl::zooshi::RemoteEntityComponent,
+                       fpl::zooshi::RemoteEntityData)
+
+namespace fpl {
+namespace zooshi {
+
+using corgi::component_library::PhysicsComponent;
+using corgi::component_library::PhysicsData;
+using corgi::component_library::TransformData;
+using mathfu::quat;
+using mathfu::vec3;
+
+// The most states to buffer for one entity.
+static const size_t kMaxSamples = 32;
+
+// Samples that arrive later than the least delayed one so far raise the
+// clock offset by this fraction of the difference, so that it recovers if
+// the network gets slower for good.
+static const float kClockOffsetRelaxation = 0.01f;
+
+// Corrections shorter than this are finished in one go.
+static const float kSnapCorrectionSq = 0.01f * 0.01f;
+
+static const float kPi = 3.14159265359f;
+
+// The difference from `from` to `to`, the short way around.
+static float AngleDifference(float from, float to) {
+  float difference = fmodf(to - from, 2.0f * kPi);
+  if (difference > kPi) difference -= 2.0f * kPi;
+  if (difference < -kPi) difference += 2.0f * kPi;
+  return difference;
+}
+
+void RemoteEntityComponent::AddFromRawData(corgi::EntityRef& entity,
+                                           const void* raw_data) {
+  auto remote_entity_def = static_cast<const RemoteEntityDef*>(raw_data);
+  RemoteEntityData* data = AddEntity(entity);
+  data->interpolation_delay = remote_entity_def->interpolation_delay();
+  data->max_extrapolation = remote_entity_def->max_extrapolation();
+  data->correction_time = remote_entity_def->correction_time();
+}
+
+corgi::ComponentInterface::RawDataUniquePtr
+RemoteEntityComponent::ExportRawData(const corgi::EntityRef& entity) const {
+  const RemoteEntityData* data = GetComponentData(entity);
+  if (data == nullptr) return nullptr;
+
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
+  RemoteEntityDefBuilder builder(fbb);
+  builder.add_interpolation_delay(data->interpolation_delay);
+  builder.add_max_extrapolation(data->max_extrapolation);
+  builder.add_correction_time(data->correction_time);
+
+  fbb.Finish(builder.Finish());
+  return export_builder.Release();
+}
+
+void RemoteEntityComponent::AddSample(const corgi::EntityRef& entity,
+                                      corgi::WorldTime time,
+                                      const vec3& position, float heading) {
+  RemoteEntityData* data = GetComponentData(entity);
+  if (data == nullptr) return;
+  if (!data->samples.empty() && time <= data->samples.back().time) return;
+
+  // The least delayed sample shows the smallest offset between the clocks.
+  const float offset = static_cast<float>(time_ - time);
+  if (!data->has_clock_offset || offset < data->clock_offset) {
+    data->clock_offset = offset;
+    data->has_clock_offset = true;
+  } else {
+    data->clock_offset +=
+        (offset - data->clock_offset) * kClockOffsetRelaxation;
+  }
+
+  const RemoteSample sample = {time, position, heading};
+  data->samples.push_back(sample);
+  if (data->samples.size() > kMaxSamples) data->samples.pop_front();
+}
+
+void RemoteEntityComponent::Reconcile(corgi::EntityRef& entity,
+                                      const vec3& predicted_origin,
+                                      const vec3& confirmed_origin,
+                                      const vec3& confirmed_velocity) {
+  RemoteEntityData* data = GetComponentData(entity);
+  if (data == nullptr) data = AddEntity(entity);
+  data->correction += confirmed_origin - predicted_origin;
+
+  // Velocity changes are small and hard to see, so take the host's at once.
+  PhysicsData* physics_data = Data<PhysicsData>(entity);
+  if (physics_data != nullptr) physics_data->SetVelocity(confirmed_velocity);
+}
+
+void RemoteEntityComponent::Sample(RemoteEntityData* data, float time,
+                                   vec3* position, float* heading) {
+  std::deque<RemoteSample>& samples = data->samples;
+
+  // Samples before the one at or before `time` are no longer needed.
+  while (samples.size() > 2 && samples[1].time <= time) samples.pop_front();
+
+  const RemoteSample& first = samples.front();
+  if (time <= first.time || samples.size() == 1) {
+    *position = first.position;
+    *heading = first.heading;
+    return;
+  }
+
+  const RemoteSample& second = samples[1];
+  const float span = static_cast<float>(second.time - first.time);
+  if (time <= second.time) {
+    // Interpolate between the two samples either side of `time`.
+    const float t = (time - first.time) / span;
+    *position = vec3::Lerp(first.position, second.position, t);
+    *heading =
+        first.heading + AngleDifference(first.heading, second.heading) * t;
+    return;
+  }
+
+  // Extrapolate from the newest two samples, for a while.
+  const float ahead = std::min(time - second.time,
+                               static_cast<float>(data->max_extrapolation));
+  const float t = ahead / span;
+  *position = second.position + (second.position - first.position) * t;
+  *heading =
+      second.heading + AngleDifference(first.heading, second.heading) * t;
+}
+
+void RemoteEntityComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
+  time_ += delta_time;
+  PhysicsComponent* physics_component =
+      entity_manager_->GetComponent<PhysicsComponent>();
+
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    RemoteEntityData* data = &iter->data;
+    TransformData* transform_data = Data<TransformData>(iter->entity);
+    if (transform_data == nullptr) continue;
+
+    if (!data->samples.empty()) {
+      // Draw the entity as it was a little while ago on the sender's clock,
+      // so there's usually a sample after it to interpolate towards.
+      const float time = static_cast<float>(time_) - data->clock_offset -
+                         static_cast<float>(data->interpolation_delay);
+      vec3 position;
+      float heading;
+      Sample(data, time, &position, &heading);
+      transform_data->position = position;
+      transform_data->orientation =
+          quat::FromAngleAxis(heading, mathfu::kAxisZ3f);
+    }
+
+    // Move predicted entities part of the way to where the host has them.
+    if (data->correction.LengthSquared() > 0.0f) {
+      const float fraction =
+          data->correction_time > 0
+              ? std::min(static_cast<float>(delta_time) /
+                             static_cast<float>(data->correction_time),
+                         1.0f)
+              : 1.0f;
+      const vec3 step =
+          fraction >= 1.0f ||
+                  data->correction.LengthSquared() < kSnapCorrectionSq
+              ? data->correction
+              : data->correction * fraction;
+      transform_data->position += step;
+      data->correction -= step;
+      if (physics_component != nullptr &&
+          Data<PhysicsData>(iter->entity) != nullptr) {
+        physics_component->UpdatePhysicsFromTransform(iter->entity);
+      }
+    }
+  }
+}
+
+}  // zooshi
+}  // fpl
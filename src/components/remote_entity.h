@@ -0,0 +1,106 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef FPL_ZOOSHI_COMPONENTS_REMOTE_ENTITY_H_
+#define FPL_ZOOSHI_COMPONENTS_REMOTE_ENTITY_H_
+
+#include <deque>
+#include "components_generated.h"
+#include "corgi/component.h"
+#include "mathfu/constants.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A state received from another player, timed by their clock.
+struct RemoteSample {
+  corgi::WorldTime time;
+  mathfu::vec3 position;
+  float heading;
+};
+
+struct RemoteEntityData {
+  RemoteEntityData()
+      : interpolation_delay(100),
+        max_extrapolation(250),
+        correction_time(150),
+        has_clock_offset(false),
+        clock_offset(0.0f),
+        correction(mathfu::kZeros3f) {}
+
+  corgi::WorldTime interpolation_delay;
+  corgi::WorldTime max_extrapolation;
+  corgi::WorldTime correction_time;
+
+  // The jitter buffer, oldest first.
+  std::deque<RemoteSample> samples;
+
+  // Our clock minus the sender's, for the least delayed sample so far.
+  bool has_clock_offset;
+  float clock_offset;
+
+  // How far a predicted entity still has to move to reach where the host
+  // says it is.
+  mathfu::vec3 correction;
+};
+
+// Moves entities that other players control smoothly, in spite of packets
+// arriving unevenly or not at all. Received states are buffered, and each
+// entity is drawn a little in the past, between the two states either side
+// of that time. If states stop arriving, entities keep moving for a short
+// while at their last velocity.
+//
+// Projectiles thrown locally are shown straight away, rather than waiting
+// for the host, and are moved gradually to where the host says they are
+// once it confirms them.
+class RemoteEntityComponent : public corgi::Component<RemoteEntityData> {
+ public:
+  RemoteEntityComponent() : time_(0) {}
+  virtual ~RemoteEntityComponent() {}
+
+  virtual void AddFromRawData(corgi::EntityRef& entity, const void* raw_data);
+  virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
+  virtual void InitEntity(corgi::EntityRef& /*entity*/) {}
+  virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+
+  // Buffer a state for `entity`, received with the sender's world time.
+  // States older than the newest one buffered are ignored.
+  void AddSample(const corgi::EntityRef& entity, corgi::WorldTime time,
+                 const mathfu::vec3& position, float heading);
+
+  // Correct a projectile that was predicted locally, now that the host has
+  // confirmed it. `predicted_origin` is where it was spawned locally, and
+  // `confirmed_origin` and `confirmed_velocity` are where and how the host
+  // spawned it.
+  void Reconcile(corgi::EntityRef& entity,
+                 const mathfu::vec3& predicted_origin,
+                 const mathfu::vec3& confirmed_origin,
+                 const mathfu::vec3& confirmed_velocity);
+
+ private:
+  // Where `data`'s buffered samples put the entity at `time`.
+  static void Sample(RemoteEntityData* data, float time,
+                     mathfu::vec3* position, float* heading);
+
+  // Local time, accumulated from updates.
+  corgi::WorldTime time_;
+};
+
+}  // zooshi
+}  // fpl
+
+CORGI_REGISTER_COMPONENT(fpl::zooshi::RemoteEntityComponent,
+                         fpl::zooshi::RemoteEntityData)
+
+#endif  // FPL_ZOOSHI_COMPONENTS_REMOTE_ENTITY_H_
@@ -19,7 +19,9 @@
 #include "components_generated.h"
 #include "corgi_component_library/animation.h"
 #include "corgi_component_library/rendermesh.h"
+#include "flatui/font_manager.h"
 #include "fplbase/flatbuffer_utils.h"
+#include "fplbase/mesh.h"
 #include "motive/math/angle.h"
 
 CORGI_DEFINE_COMPONENT(fpl::zooshi::Render3dTextComponent,
@@ -31,13 +33,24 @@ using corgi::component_library::RenderMeshComponent;
 using corgi::component_library::TransformData;
 using corgi::EntityRef;
 using mathfu::mat4;
+using mathfu::vec2;
 using mathfu::vec2i;
 using mathfu::vec3;
+using mathfu::vec4;
 using motive::kDegreesToRadians;
 
 namespace fpl {
 namespace zooshi {
 
+// The shader flatui draws text with.
+static const char* kFontShaderName = "shaders/font";
+// Draws text that faces the camera, placed from the label's position and
+// scale alone.
+static const char* kBillboardShaderName = "shaders/font_billboard";
+
+static const fplbase::Attribute kFontVertexFormat[] = {
+    fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kEND};
+
 void Render3dTextComponent::AddFromRawData(EntityRef& entity,
                                            const void* raw_data) {
   auto render_3d_text_def = static_cast<const Render3dTextDef*>(raw_data);
@@ -50,7 +63,9 @@ void Render3dTextComponent::AddFromRawData(EntityRef& entity,
       LoadVec3(render_3d_text_def->translation());
   render_3d_text_data->rotation = LoadVec3(render_3d_text_def->rotation());
   render_3d_text_data->scale = LoadVec3(render_3d_text_def->scale());
-  render_3d_text_data->text = render_3d_text_def->text()->c_str();
+  render_3d_text_data->SetText(render_3d_text_def->text()->c_str());
+  render_3d_text_data->billboard = render_3d_text_def->billboard();
+  render_3d_text_data->buffer_valid = false;
 }
 
 const mat4 Render3dTextComponent::CalculateAnimationTransform(
@@ -113,6 +128,9 @@ const mat4 Render3dTextComponent::CalculateModelViewProjection(
 
 void Render3dTextComponent::Init() {
   services_ = entity_manager_->GetComponent<ServicesComponent>();
+  font_shader_ = nullptr;
+  billboard_shader_ = nullptr;
+  selected_font_ = nullptr;
 }
 
 void Render3dTextComponent::InitEntity(EntityRef& entity) {
@@ -121,47 +139,212 @@ void Render3dTextComponent::InitEntity(EntityRef& entity) {
 
 void Render3dTextComponent::Render(const EntityRef& entity,
                                    const corgi::CameraInterface& camera) {
-  SetModelViewProjectionMatrix(entity, camera);
-
   const RenderMeshData* rendermesh_data = Data<RenderMeshData>(entity);
-  const Render3dTextData* render_3d_text_data = Data<Render3dTextData>(entity);
-
   if (rendermesh_data && rendermesh_data->visible) {
-    // Create FlatUI in 3D space.
-    flatui::Run(*services_->asset_manager(), *services_->font_manager(),
-                *services_->input_system(), [&]() {
-                  const vec2i window_size =
-                      services_->asset_manager()->renderer().window_size();
-                  const float aspect_ratio =
-                      static_cast<float>(window_size.x) /
-                      static_cast<float>(window_size.y);
-
-                  flatui::SetDepthTest(true);
-                  flatui::UseExistingProjection(
-                      vec2i(static_cast<int>(render_3d_text_data->canvas_size *
-                                             aspect_ratio),
-                            render_3d_text_data->canvas_size));
-                  flatui::StartGroup(flatui::kLayoutOverlay);
-                  {
-                    flatui::PositionGroup(flatui::kAlignCenter,
-                                          flatui::kAlignCenter,
-                                          mathfu::kZeros2f);
-                    {
-                      flatui::SetTextFont(render_3d_text_data->font.c_str());
-                      flatui::Label(render_3d_text_data->text.c_str(),
-                                    render_3d_text_data->label_size);
-                    }
-                  }
-                  flatui::EndGroup();
-                });
+    RenderBatch(&entity, 1, camera);
   }
 }
 
 void Render3dTextComponent::RenderAllEntities(
     const corgi::CameraInterface& camera) {
+  visible_entities_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    Render(iter->entity, camera);
+    const RenderMeshData* rendermesh_data = Data<RenderMeshData>(iter->entity);
+    if (rendermesh_data && rendermesh_data->visible) {
+      visible_entities_.push_back(iter->entity);
+    }
+  }
+  if (!visible_entities_.empty()) {
+    RenderBatch(visible_entities_.data(), visible_entities_.size(), camera);
+  }
+}
+
+void Render3dTextComponent::UpdateBufferParameters(
+    Render3dTextData* render_3d_text_data) {
+  if (render_3d_text_data->buffer_valid &&
+      render_3d_text_data->buffer_version ==
+          render_3d_text_data->text_version) {
+    return;
+  }
+  flatui::FontManager* font_manager = services_->font_manager();
+  font_manager->SelectFont(render_3d_text_data->font.c_str());
+  const int label_size = static_cast<int>(render_3d_text_data->label_size);
+  render_3d_text_data->buffer_parameters = flatui::FontBufferParameters(
+      font_manager->GetCurrentFont()->GetFontId(), flatui::kNullHash,
+      static_cast<float>(label_size), vec2i(0, label_size),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, false, false);
+  render_3d_text_data->buffer_version = render_3d_text_data->text_version;
+  render_3d_text_data->buffer_valid = true;
+}
+
+vec2 Render3dTextComponent::CanvasCenter(
+    const Render3dTextData* render_3d_text_data) const {
+  const vec2i window_size =
+      services_->asset_manager()->renderer().window_size();
+  const float aspect_ratio =
+      static_cast<float>(window_size.x) / static_cast<float>(window_size.y);
+  return vec2(render_3d_text_data->canvas_size * aspect_ratio,
+              static_cast<float>(render_3d_text_data->canvas_size)) /
+         2.0f;
+}
+
+flatui::FontBuffer* Render3dTextComponent::LabelBuffer(
+    const Render3dTextData* render_3d_text_data) {
+  flatui::FontManager* font_manager = services_->font_manager();
+  if (selected_font_ != render_3d_text_data->font.c_str()) {
+    selected_font_ = render_3d_text_data->font.c_str();
+    font_manager->SelectFont(selected_font_);
+  }
+  return font_manager->GetBuffer(render_3d_text_data->text.c_str(),
+                                 render_3d_text_data->text.length(),
+                                 render_3d_text_data->buffer_parameters);
+}
+
+void Render3dTextComponent::DrawBuffer(flatui::FontBuffer* buffer) {
+  flatui::FontManager* font_manager = services_->font_manager();
+  const auto& vertices = buffer->get_vertices();
+  const auto& slices = buffer->get_slices();
+  for (size_t slice = 0; slice < slices.size(); ++slice) {
+    const auto& indices = buffer->get_indices(static_cast<int32_t>(slice));
+    font_manager->GetAtlasTexture(slices[slice].get_slice())->Set(0);
+    fplbase::RenderArray(fplbase::Mesh::kTriangles,
+                         static_cast<int>(indices.size()), kFontVertexFormat,
+                         sizeof(flatui::FontVertex), vertices.data(),
+                         indices.data());
+  }
+}
+
+void Render3dTextComponent::RenderBatch(const EntityRef* entities,
+                                        size_t count,
+                                        const corgi::CameraInterface& camera) {
+  fplbase::AssetManager* asset_manager = services_->asset_manager();
+  flatui::FontManager* font_manager = services_->font_manager();
+  fplbase::Renderer& renderer = asset_manager->renderer();
+  if (font_shader_ == nullptr) {
+    font_shader_ = asset_manager->LoadShader(kFontShaderName);
+    if (font_shader_ == nullptr) return;
+  }
+
+  // Like flatui::Run(), look every buffer up once to add any new glyphs to
+  // the glyph cache, and again once it has been uploaded. Buffers are cached
+  // by the FontManager, so text that hasn't changed isn't laid out again.
+  font_manager->StartLayoutPass();
+  selected_font_ = nullptr;
+  bool any_billboards = false;
+  for (size_t i = 0; i < count; ++i) {
+    Render3dTextData* render_3d_text_data = Data<Render3dTextData>(entities[i]);
+    UpdateBufferParameters(render_3d_text_data);
+    LabelBuffer(render_3d_text_data);
+    any_billboards |= render_3d_text_data->billboard;
+  }
+  font_manager->StartRenderPass();
+
+  // The state and shader are set up once for the whole batch. Only the
+  // transform and offset change between labels.
+  renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+  renderer.SetCulling(fplbase::kCullingModeNone);
+  renderer.set_color(mathfu::kOnes4f);
+  font_shader_->Set(renderer);
+  const fplbase::UniformHandle mvp_handle =
+      font_shader_->FindUniform("model_view_projection");
+  const fplbase::UniformHandle pos_offset_handle =
+      font_shader_->FindUniform("pos_offset");
+
+  for (size_t i = 0; i < count; ++i) {
+    const Render3dTextData* render_3d_text_data =
+        Data<Render3dTextData>(entities[i]);
+    if (render_3d_text_data->billboard) continue;
+    flatui::FontBuffer* buffer = LabelBuffer(render_3d_text_data);
+    if (buffer == nullptr) continue;
+
+    const mat4 mvp = CalculateModelViewProjection(entities[i], camera);
+    const vec3 pos_offset(
+        CanvasCenter(render_3d_text_data) - vec2(buffer->get_size()) / 2.0f,
+        0.0f);
+    if (fplbase::ValidUniformHandle(mvp_handle)) {
+      font_shader_->SetUniform(mvp_handle, &mvp[0], 16);
+    }
+    if (fplbase::ValidUniformHandle(pos_offset_handle)) {
+      font_shader_->SetUniform(pos_offset_handle, &pos_offset[0], 3);
+    }
+    DrawBuffer(buffer);
+  }
+
+  if (any_billboards) RenderBillboards(entities, count, camera);
+  renderer.SetCulling(fplbase::kCullingModeBack);
+}
+
+void Render3dTextComponent::RenderBillboards(
+    const EntityRef* entities, size_t count,
+    const corgi::CameraInterface& camera) {
+  fplbase::AssetManager* asset_manager = services_->asset_manager();
+  fplbase::Renderer& renderer = asset_manager->renderer();
+  if (billboard_shader_ == nullptr) {
+    billboard_shader_ = asset_manager->LoadShader(kBillboardShaderName);
+    if (billboard_shader_ == nullptr) return;
+  }
+
+  // The camera's axes are set once, and its view projection once per eye.
+  // Each label then only sends where it is, how big it is, and how to center
+  // its text. Both eyes share the axes, so the text stays flat to the view.
+  renderer.set_model_view_projection(camera.GetTransformMatrix());
+  billboard_shader_->Set(renderer);
+  const vec3 facing = camera.facing().Normalized();
+  const vec3 right = vec3::CrossProduct(facing, camera.up()).Normalized();
+  const vec3 up = vec3::CrossProduct(right, facing);
+  const fplbase::UniformHandle right_handle =
+      billboard_shader_->FindUniform("camera_right");
+  const fplbase::UniformHandle up_handle =
+      billboard_shader_->FindUniform("camera_up");
+  if (fplbase::ValidUniformHandle(right_handle)) {
+    billboard_shader_->SetUniform(right_handle, &right[0], 3);
+  }
+  if (fplbase::ValidUniformHandle(up_handle)) {
+    billboard_shader_->SetUniform(up_handle, &up[0], 3);
+  }
+
+  if (!camera.IsStereo()) {
+    RenderBillboardView(entities, count);
+  } else {
+    for (int view = 0; view < 2; ++view) {
+      renderer.SetViewport(camera.viewport(view));
+      renderer.set_model_view_projection(camera.GetTransformMatrix(view));
+      billboard_shader_->Set(renderer);
+      RenderBillboardView(entities, count);
+    }
+  }
+}
+
+void Render3dTextComponent::RenderBillboardView(const EntityRef* entities,
+                                                size_t count) {
+  const fplbase::UniformHandle billboard_handle =
+      billboard_shader_->FindUniform("billboard");
+  const fplbase::UniformHandle pos_offset_handle =
+      billboard_shader_->FindUniform("pos_offset");
+  for (size_t i = 0; i < count; ++i) {
+    const Render3dTextData* render_3d_text_data =
+        Data<Render3dTextData>(entities[i]);
+    if (!render_3d_text_data->billboard) continue;
+    flatui::FontBuffer* buffer = LabelBuffer(render_3d_text_data);
+    if (buffer == nullptr) continue;
+
+    const TransformData* transform_data = Data<TransformData>(entities[i]);
+    const vec3 bone_position =
+        CalculateAnimationTransform(entities[i],
+                                    render_3d_text_data->animation_bone) *
+        vec3(render_3d_text_data->translation);
+    const vec3 position = transform_data->world_transform * bone_position;
+    const vec4 billboard(position, render_3d_text_data->scale.data[0]);
+    const vec3 pos_offset(vec2(buffer->get_size()) / -2.0f, 0.0f);
+    if (fplbase::ValidUniformHandle(billboard_handle)) {
+      billboard_shader_->SetUniform(billboard_handle, &billboard[0], 4);
+    }
+    if (fplbase::ValidUniformHandle(pos_offset_handle)) {
+      billboard_shader_->SetUniform(pos_offset_handle, &pos_offset[0], 3);
+    }
+    DrawBuffer(buffer);
   }
 }
 
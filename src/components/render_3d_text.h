@@ -15,9 +15,14 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_RENDER_3D_TEXT_H_
 #define FPL_ZOOSHI_COMPONENTS_RENDER_3D_TEXT_H_
 
+#include <stdint.h>
+#include <string>
+#include <vector>
 #include "components/services.h"
 #include "corgi/component.h"
 #include "corgi_component_library/camera_interface.h"
+#include "flatui/font_buffer.h"
+#include "fplbase/shader.h"
 
 namespace fpl {
 namespace zooshi {
@@ -33,7 +38,12 @@ struct Render3dTextData {
         translation(mathfu::kZeros3f),
         rotation(mathfu::kZeros3f),
         scale(mathfu::kZeros3f),
-        text() {}
+        text(),
+        text_version(0),
+        billboard(false),
+        buffer_parameters(),
+        buffer_version(0),
+        buffer_valid(false) {}
 
   /// @brief For animated entities, this is the index of the bone to render the
   /// text onto.
@@ -63,7 +73,35 @@ struct Render3dTextData {
   mathfu::vec3_packed scale;
 
   /// @brief The text string to be rendered in 3D on the entity.
+  /// @note Change it through `SetText()`, so that `text_version` follows it.
   std::string text;
+
+  /// @brief Bumped whenever `text` changes, so that anything derived from the
+  /// text can tell it's stale without comparing strings.
+  uint32_t text_version;
+
+  /// @brief If true, the text always faces the camera, centered on
+  /// `translation` and scaled by `scale.x`. `rotation` is ignored. These are
+  /// placed by the vertex shader, from only the label's position and scale.
+  bool billboard;
+
+  /// @brief Replace `text`, if `new_text` differs from it.
+  /// @param[in] new_text The string to render.
+  /// @return Returns `true` if the text changed.
+  bool SetText(const std::string& new_text) {
+    if (new_text == text) return false;
+    text = new_text;
+    text_version++;
+    return true;
+  }
+
+  /// @cond FPL_ZOOSHI_COMPONENTS_INTERNAL
+  // The FontManager key for `text` laid out in `font`, rebuilt only when
+  // `text_version` moves past `buffer_version`.
+  flatui::FontBufferParameters buffer_parameters;
+  uint32_t buffer_version;
+  bool buffer_valid;
+  /// @endcond
 };
 
 /// @brief A Component that handles the rendering of text on an entity
@@ -125,6 +163,9 @@ class Render3dTextComponent : public corgi::Component<Render3dTextData> {
 
   /// @brief Renders the text on a given entity.
   ///
+  /// @note Rendering many entities is cheaper through `RenderAllEntities()`,
+  /// which sets up the text shader once for all of them.
+  ///
   /// @note If the text would not be visible by the camera, then it is not
   /// rendered.
   ///
@@ -139,7 +180,8 @@ class Render3dTextComponent : public corgi::Component<Render3dTextData> {
   /// is registered with the Render3dTextComponent.
   ///
   /// It is equivalent to iterating through all of the entities individually
-  /// and calling `Render()` on them.
+  /// and calling `Render()` on them, but draws them all in one batch. Each
+  /// entity's text is only laid out again when it changes.
   ///
   /// @note If the text would not be visible by the camera, then it is not
   /// rendered.
@@ -170,7 +212,37 @@ class Render3dTextComponent : public corgi::Component<Render3dTextData> {
   void SetText(const char* text, const int text_length);
 
  private:
+  // Draw the text of `count` entities, starting at `entities`.
+  void RenderBatch(const corgi::EntityRef* entities, size_t count,
+                   const corgi::CameraInterface& camera);
+
+  // Draw the billboard text of the `count` entities starting at `entities`.
+  // Needs RenderBatch()'s layout pass and render state.
+  void RenderBillboards(const corgi::EntityRef* entities, size_t count,
+                        const corgi::CameraInterface& camera);
+
+  // Draw the billboard text for one eye, with the billboard shader set.
+  void RenderBillboardView(const corgi::EntityRef* entities, size_t count);
+
+  // The laid out text of an entity, or null if it isn't ready yet.
+  flatui::FontBuffer* LabelBuffer(const Render3dTextData* render_3d_text_data);
+
+  // Draw every slice of `buffer`, with the current shader.
+  void DrawBuffer(flatui::FontBuffer* buffer);
+
+  // Rebuild the entity's buffer parameters if its text has changed.
+  void UpdateBufferParameters(Render3dTextData* render_3d_text_data);
+
+  // The center of the entity's canvas, where its text is centered.
+  mathfu::vec2 CanvasCenter(const Render3dTextData* render_3d_text_data) const;
+
   ServicesComponent* services_;
+  fplbase::Shader* font_shader_;
+  fplbase::Shader* billboard_shader_;
+  // The font last selected in the FontManager, to avoid selecting it again.
+  const char* selected_font_;
+  // Reused by RenderAllEntities(), to avoid allocating every frame.
+  std::vector<corgi::EntityRef> visible_entities_;
 };
 
 }  // zooshi
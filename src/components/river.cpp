@@ -14,8 +14,13 @@
 
 #include "components/river.h"
 #include <math.h>
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include "common.h"
+#include "components/entity_pool.h"
+#include "components/export_builder.h"
+#include "components/player_projectile.h"
 #include "components/rail_denizen.h"
 #include "components/rail_node.h"
 #include "components/services.h"
@@ -26,6 +31,10 @@
 #include "corgi_component_library/transform.h"
 #include "fplbase/debug_markers.h"
 #include "fplbase/utilities.h"
+#include "gl_uploader.h"
+#include "profiler.h"
+#include "residency_cache.h"
+#include "scene_lab/corgi/corgi_adapter.h"
 #include "scene_lab/scene_lab.h"
 #include "world.h"
 
@@ -35,6 +44,7 @@ using mathfu::vec3;
 using mathfu::vec3_packed;
 using mathfu::vec4;
 using mathfu::vec4_packed;
+using mathfu::mat4;
 using mathfu::quat;
 using mathfu::kAxisZ3f;
 using fplbase::Material;
@@ -48,26 +58,112 @@ namespace zooshi {
 using corgi::component_library::PhysicsComponent;
 using corgi::component_library::RenderMeshComponent;
 using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
 using scene_lab::SceneLab;
 
-static const size_t kNumIndicesPerQuad = 6;
+// Without the GlUploader's thread, creating the GL buffers for a chunk of
+// river stalls the render thread, so only upload this many per frame.
+static const int kMaxChunksUploadedPerFrame = 1;
 
-// A vertex definition specific to normalmapping with colors.
-struct NormalMappedColorVertex {
-  vec3_packed pos;
-  vec2_packed tc;
-  vec3_packed norm;
-  vec4_packed tangent;
-  unsigned char color[4];
+// Building a sector's collision mesh builds its BVH as well, so only build
+// this many per frame.
+static const int kMaxCollisionSectorsBuiltPerFrame = 2;
+
+static const RiverConfig* RiverConfigForLevel(
+    corgi::EntityManager* entity_manager) {
+  return entity_manager->GetComponent<ServicesComponent>()
+      ->world()
+      ->CurrentLevel()
+      ->river_config();
+}
+
+static ResidencyCache* ResidencyCacheForRivers(
+    corgi::EntityManager* entity_manager) {
+  return entity_manager->GetComponent<ServicesComponent>()
+      ->world()
+      ->residency_cache;
+}
+
+static GlUploader* GlUploaderForRivers(corgi::EntityManager* entity_manager) {
+  return entity_manager->GetComponent<ServicesComponent>()
+      ->world()
+      ->gl_uploader;
+}
+
+// Packed meshes are drawn with the variant of each shader that unpacks
+// them, which has this appended to its name.
+static const char kPackedShaderSuffix[] = "_packed";
+
+// The vertices of one of a chunk's meshes, whichever layout they're in.
+struct ChunkVertices {
+  template <typename T>
+  ChunkVertices(const std::vector<T>& verts,
+                const fplbase::Attribute* vertex_format)
+      : data(verts.data()),
+        count(verts.size()),
+        vertex_size(sizeof(T)),
+        format(vertex_format) {}
+  const void* data;
+  size_t count;
+  size_t vertex_size;
+  const fplbase::Attribute* format;
 };
 
+static const fplbase::Attribute kMeshFormat[] = {
+    fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
+    fplbase::kTangent4f, fplbase::kEND};
+static const fplbase::Attribute kBankMeshFormat[] = {
+    fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
+    fplbase::kTangent4f,  fplbase::kColor4ub,   fplbase::kEND};
+// The layout of PackedNormalMappedVertex, for the river and the banks.
+static const fplbase::Attribute kPackedMeshFormat[] = {
+    fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kColor4ub,
+    fplbase::kTexCoordAlt2f, fplbase::kEND};
+
+static ChunkVertices RiverVertices(const RiverChunkGeometry& geometry,
+                                   bool packed) {
+  return packed ? ChunkVertices(geometry.packed_river_verts, kPackedMeshFormat)
+                : ChunkVertices(geometry.river_verts, kMeshFormat);
+}
+
+static ChunkVertices BankVertices(const RiverChunkGeometry& geometry,
+                                  bool packed) {
+  return packed ? ChunkVertices(geometry.packed_bank_verts, kPackedMeshFormat)
+                : ChunkVertices(geometry.bank_verts, kBankMeshFormat);
+}
+
+// A copy of `verts` for the residency cache.
+static std::shared_ptr<const std::vector<uint8_t>> CopyVertices(
+    const ChunkVertices& verts) {
+  const uint8_t* data = static_cast<const uint8_t*>(verts.data);
+  return std::make_shared<const std::vector<uint8_t>>(
+      data, data + verts.count * verts.vertex_size);
+}
+
+RiverComponent::~RiverComponent() { DeletePendingMeshes(); }
+
+void RiverComponent::DeletePendingMeshes() {
+  for (auto it = meshes_pending_delete_.begin();
+       it != meshes_pending_delete_.end(); ++it) {
+    delete *it;
+  }
+  meshes_pending_delete_.clear();
+}
+
 void RiverComponent::Init() {
   auto services = entity_manager_->GetComponent<ServicesComponent>();
   SceneLab* scene_lab = services->scene_lab();
   if (scene_lab) {
     scene_lab->AddOnUpdateEntityCallback(
-        [this](const scene_lab::GenericEntityId& /*entity*/) {
-          TriggerRiverUpdate();
+        [this](const scene_lab::GenericEntityId& id) {
+          // Use CorgiAdapter to convert GenericEntityId to corgi::EntityRef.
+          corgi::EntityRef entity =
+              static_cast<scene_lab_corgi::CorgiAdapter*>(
+                  entity_manager_->GetComponent<ServicesComponent>()
+                      ->scene_lab()
+                      ->entity_system_adapter())
+                  ->GetEntityRef(id);
+          TriggerRiverUpdate(entity);
         });
   }
   river_offset_ = 0;
@@ -81,7 +177,7 @@ void RiverComponent::AddFromRawData(corgi::EntityRef& entity,
   river_data->random_seed = river_def->random_seed();
 
   entity_manager_->AddEntityToComponent<RenderMeshComponent>(entity);
-  TriggerRiverUpdate();
+  river_data->render_mesh_needs_update_ = true;
 }
 
 // The update function here really just handles keeping the river offset
@@ -97,15 +193,59 @@ void RiverComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
       services->world()->CurrentLevel()->river_config()->texture_repeats();
   river_offset_ += speed / (texture_repeats * texture_repeats);
   river_offset_ -= floor(river_offset_);
+
+  // Track which chunk the raft is in, so the render thread knows which chunks
+  // to generate. This assumes rivers follow the raft's rail, which is how the
+  // levels are laid out.
+  for (auto iter = begin(); iter != end(); ++iter) {
+    RiverData* river_data = Data<RiverData>(iter->entity);
+    const int num_chunks = NumChunks(river_data);
+    if (num_chunks <= 1) continue;
+    const int chunk_segments = ChunkSegments(river_data);
+    // Segments are spaced by how much the river bends, so find the last one
+    // the raft has passed.
+    const std::vector<float>& fractions =
+        river_data->contours->segment_fractions;
+    const int segment =
+        static_cast<int>(std::upper_bound(fractions.begin(), fractions.end(),
+                                          rd_raft_data->lap_progress) -
+                         fractions.begin()) -
+        1;
+    river_data->raft_chunk =
+        mathfu::Clamp(segment / chunk_segments, 0, num_chunks - 1);
+  }
 }
 
-void RiverComponent::TriggerRiverUpdate() {
-  // TODO - it would be nice if this only updated the river that we were editing
-  // (instead of marking all rivers as needing an update) but due to how river
-  // edit nodes interact with the river mesh, that's tricky.
+// Marks the rivers that depend on `entity` as needing to be regenerated:
+// the river itself, any river whose rail `entity` is or was a node of, and
+// any river whose rail nodes were moved along with it.
+void RiverComponent::TriggerRiverUpdate(const corgi::EntityRef& entity) {
+  const RailNodeData* node_data =
+      entity.IsValid() ? entity_manager_->GetComponentData<RailNodeData>(entity)
+                       : nullptr;
+  auto* transform_component =
+      GetComponent<corgi::component_library::TransformComponent>();
+  // Most edits are to props. Only rivers, rail nodes, and entities rail
+  // nodes may hang from can move a river's nodes.
+  if (entity.IsValid() && node_data == nullptr &&
+      GetComponentData(entity) == nullptr) {
+    const TransformData* transform_data =
+        entity_manager_->GetComponentData<TransformData>(entity);
+    if (transform_data == nullptr || transform_data->children.empty()) return;
+  }
   for (auto iter = begin(); iter != end(); ++iter) {
     RiverData* river_data = Data<RiverData>(iter->entity);
-    river_data->render_mesh_needs_update_ = true;
+    if (river_data->render_mesh_needs_update_) continue;
+    bool dirty = iter->entity == entity ||
+                 (node_data != nullptr &&
+                  node_data->rail_name == river_data->rail_name);
+    for (size_t i = 0; !dirty && i < river_data->rail_nodes.size(); ++i) {
+      const corgi::EntityRef& node = river_data->rail_nodes[i];
+      dirty = node == entity || !node.IsValid() ||
+              (transform_component->WorldPosition(node) -
+               river_data->rail_node_positions[i]).LengthSquared() > 0.0f;
+    }
+    river_data->render_mesh_needs_update_ = dirty;
   }
 }
 
@@ -114,7 +254,8 @@ corgi::ComponentInterface::RawDataUniquePtr RiverComponent::ExportRawData(
   const RiverData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
   auto rail_name =
       data->rail_name != "" ? fbb.CreateString(data->rail_name) : 0;
 
@@ -125,7 +266,7 @@ corgi::ComponentInterface::RawDataUniquePtr RiverComponent::ExportRawData(
   builder.add_random_seed(data->random_seed);
 
   fbb.Finish(builder.Finish().Union());
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 // Iterate through the river meshes and update any of them that need to be
@@ -134,375 +275,600 @@ corgi::ComponentInterface::RawDataUniquePtr RiverComponent::ExportRawData(
 // thread, because it doesn't have access to the opengl context!)
 void RiverComponent::UpdateRiverMeshes() {
   PushDebugMarker("UpdateRiverMeshes");
+  ProfileScope scope("UpdateRiverMeshes");
+  // Meshes released last frame are no longer referenced by any render pass.
+  DeletePendingMeshes();
+
+  finished_contours_.clear();
+  builder_.TakeResults(&finished_contours_, &finished_chunks_);
+  for (auto it = finished_contours_.begin(); it != finished_contours_.end();
+       ++it) {
+    ApplyContours(*it);
+  }
+  finished_contours_.clear();
+
   for (auto iter = begin(); iter != end(); ++iter) {
     RiverData* river_data = Data<RiverData>(iter->entity);
-    if (river_data->render_mesh_needs_update_) CreateRiverMesh(iter->entity);
+    if (river_data->render_mesh_needs_update_) QueueContours(iter->entity);
+    UpdateChunks(iter->entity);
+    UpdateCollision(iter->entity);
   }
+
+  // Uploads are spread out over several frames, unless they're made on the
+  // GlUploader's thread.
+  GlUploader* uploader = GlUploaderForRivers(entity_manager_);
+  const bool threaded = uploader != nullptr && uploader->threaded();
+  int num_uploaded = 0;
+  size_t i = 0;
+  for (; i < finished_chunks_.size() &&
+         (threaded || num_uploaded < kMaxChunksUploadedPerFrame);
+       ++i) {
+    RiverChunkGeometry& geometry = finished_chunks_[i];
+    if (!geometry.entity.IsValid()) continue;
+    RiverData* river_data = Data<RiverData>(geometry.entity);
+    if (river_data == nullptr || river_data->generation != geometry.generation)
+      continue;
+    for (auto chunk = river_data->chunks.begin();
+         chunk != river_data->chunks.end(); ++chunk) {
+      if (chunk->index == geometry.chunk_index && !chunk->entity.IsValid() &&
+          !chunk->uploading) {
+        StartChunkUpload(&geometry, &*chunk);
+        ++num_uploaded;
+        break;
+      }
+    }
+  }
+  finished_chunks_.erase(finished_chunks_.begin(),
+                         finished_chunks_.begin() + i);
   PopDebugMarker();
 }
 
-// Generates the actual mesh for the river, and adds it to this entitiy's
-// rendermesh component.
-void RiverComponent::CreateRiverMesh(corgi::EntityRef& entity) {
-  static const fplbase::Attribute kMeshFormat[] = {
-      fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
-      fplbase::kTangent4f, fplbase::kEND};
-  static const fplbase::Attribute kBankMeshFormat[] = {
-      fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
-      fplbase::kTangent4f,  fplbase::kColor4ub,   fplbase::kEND};
-  std::vector<vec3_packed> track;
-  const RiverConfig* river = entity_manager_->GetComponent<ServicesComponent>()
-                                 ->world()
-                                 ->CurrentLevel()
-                                 ->river_config();
-
+// Hands the river's rail off to the builder, to regenerate its contours. The
+// old chunks are kept until the new contours are ready, so the river doesn't
+// disappear while it's being rebuilt.
+void RiverComponent::QueueContours(corgi::EntityRef& entity) {
+  const RiverConfig* river = RiverConfigForLevel(entity_manager_);
   RiverData* river_data = Data<RiverData>(entity);
   river_data->render_mesh_needs_update_ = false;
-
-  // Initialize the static mesh that will be made around the river banks.
-  auto* physics_component = entity_manager_->GetComponent<PhysicsComponent>();
-  physics_component->InitStaticMesh(entity);
+  river_data->generation++;
 
   Rail* rail = entity_manager_->GetComponent<ServicesComponent>()
                    ->rail_manager()
                    ->GetRailFromComponents(river_data->rail_name.c_str(),
                                            entity_manager_);
-
-  // Generate the spline data and store it in our track vector:
-  rail->Positions(river->spline_stepsize(), &track);
+  if (rail == nullptr) return;
+
+  // Remember which rail nodes this river is built from, so that edits to
+  // anything else leave it alone.
+  auto* rail_node_component =
+      entity_manager_->GetComponent<RailNodeComponent>();
+  auto* transform_component =
+      GetComponent<corgi::component_library::TransformComponent>();
+  river_data->rail_nodes.clear();
+  river_data->rail_node_positions.clear();
+  for (auto node = rail_node_component->begin();
+       node != rail_node_component->end(); ++node) {
+    if (node->data.rail_name == river_data->rail_name) {
+      river_data->rail_nodes.push_back(node->entity);
+      river_data->rail_node_positions.push_back(
+          transform_component->WorldPosition(node->entity));
+    }
+  }
 
   fplbase::AssetManager* asset_manager =
       entity_manager_->GetComponent<ServicesComponent>()->asset_manager();
 
-  const size_t num_bank_contours = river->default_banks()->Length();
-  const size_t num_bank_quads = num_bank_contours - 2;
-  const size_t river_idx = river->river_index();
-  const size_t segment_count = track.size();
-  const size_t river_vert_max = segment_count * 2;
-  const size_t river_index_max = (segment_count - 1) * kNumIndicesPerQuad;
-  const size_t bank_vert_max = segment_count * num_bank_contours;
-  const size_t bank_index_max =
-      (segment_count - 1) * kNumIndicesPerQuad * num_bank_quads;
-  assert(num_bank_contours >= 2 && river_idx < num_bank_contours - 1);
-  const unsigned int num_zones = river->zones()->Length();
+  RiverContourJob job;
+  job.entity = entity;
+  job.generation = river_data->generation;
+  job.config = river;
+  job.random_seed = river_data->random_seed;
+  job.wraps = rail->wraps();
+  // Generate the spline data and store it in our track vector:
+  rail->Positions(river->spline_stepsize(), &job.track);
+  // Materials with a single texture don't blend into the next zone.
+  for (auto zone = river->zones()->begin(); zone != river->zones()->end();
+       ++zone) {
+    Material* material =
+        asset_manager->LoadMaterial(zone->material()->c_str());
+    job.zone_blends.push_back(material->textures().size() != 1);
+  }
+  builder_.QueueContours(&job);
+}
 
-  // Need to allocate some space to plan out our mesh in:
-  std::vector<NormalMappedVertex> river_verts(river_vert_max);
-  river_verts.clear();
-  std::vector<unsigned short> river_indices(river_index_max);
-  river_indices.clear();
-
-  std::vector<NormalMappedColorVertex> bank_verts(bank_vert_max);
-  bank_verts.clear();
-  std::vector<unsigned short> bank_indices(bank_index_max);
-  bank_indices.clear();
-  // Use one set of bank vertices for the entire riverbank, but separate out
-  // the zones via indices, so we can use different materials (and possibly
-  // shaders) per zone. We still keep bank_indices for the normal calculation,
-  // though.
-  std::vector<std::vector<unsigned short>> bank_indices_by_zone;
-  bank_indices_by_zone.resize(num_zones);
-
-  std::vector<unsigned int> bank_zones;  // indexed by segment
-  bank_zones.resize(segment_count, 0);   // default of 0
-  unsigned int zone_id = 0;
-
-  // TODO: Use a local random number generator. Resetting the global random
-  //       number generator is not a nice. Also, there's no guarantee that
-  //       mathfu::Random will continue to use rand().
-  srand(river_data->random_seed);
-
-  std::vector<float> actual_zone_end;
-  actual_zone_end.resize(segment_count, 1);
-  // Precalculate the actual zone end locations.
-  for (size_t i = 0; i < segment_count; i++) {
-    const float fraction =
-        static_cast<float>(i) / static_cast<float>(segment_count);
-    if (zone_id + 1 < river->zones()->Length() &&
-        fraction > river->zones()->Get(zone_id + 1)->zone_start()) {
-      actual_zone_end[zone_id] = fraction;
-      zone_id = zone_id + 1;
+// Swaps in newly built contours, replacing the chunks built from the old
+// ones.
+void RiverComponent::ApplyContours(const RiverContourResult& result) {
+  corgi::EntityRef entity = result.entity;
+  if (!entity.IsValid()) return;
+  RiverData* river_data = Data<RiverData>(entity);
+  if (river_data == nullptr || river_data->generation != result.generation)
+    return;
+
+  // Keep the chunks whose contours didn't change, so an edit only rebuilds the
+  // meshes around it. Chunks that were still being built
+  // are requested again from the new contours.
+  const RiverContours* old_contours = river_data->contours.get();
+  const RiverContours& new_contours = *result.contours;
+  const bool same_layout =
+      old_contours != nullptr &&
+      old_contours->NumSegments() == new_contours.NumSegments() &&
+      old_contours->contours_per_segment ==
+          new_contours.contours_per_segment &&
+      old_contours->wraps == new_contours.wraps;
+  const int chunk_segments = ChunkSegments(river_data);
+  std::vector<RiverChunk>& chunks = river_data->chunks;
+  for (size_t i = 0; i < chunks.size();) {
+    bool keep = same_layout && chunks[i].entity.IsValid();
+    if (keep) {
+      size_t first;
+      size_t last;
+      RiverMeshBuilder::ChunkSegmentRange(new_contours.NumSegments(),
+                                          chunks[i].index, chunk_segments,
+                                          &first, &last);
+      keep = new_contours.SegmentsEqual(*old_contours, first, last);
     }
-  }
-  // Start over from zone 0.
-  zone_id = 0;
-
-  const RiverZone* current_zone = river->zones()->Get(zone_id);
-  Material* current_bank_material =
-      asset_manager->LoadMaterial(current_zone->material()->c_str());
-  float river_width = current_zone->width() != 0 ? current_zone->width()
-                                                 : river->default_width();
-
-  // Construct the actual mesh data for the river:
-  std::vector<vec2> offsets(num_bank_contours);
-  for (size_t i = 0; i < segment_count; i++) {
-    // Get the current position on the track, and the normal (to the side).
-    vec3 track_delta;
-    if (i > 0) {
-      track_delta = vec3(track[i]) - vec3(track[i - 1]);
-    } else if (rail->wraps()) {
-      // River track is circular.
-      track_delta = vec3(track[i]) - vec3(track[segment_count - 1]);
+    if (keep) {
+      ++i;
     } else {
-      // Not circular, so point towards the next point.
-      track_delta = vec3(track[1]) - vec3(track[0]);
+      DestroyChunk(entity, &chunks[i]);
+      chunks[i] = chunks.back();
+      chunks.pop_back();
     }
-    const vec3 track_normal =
-        vec3::CrossProduct(track_delta, kAxisZ3f).Normalized();
-    const vec3 track_position =
-        vec3(track[i]) + river->track_height() * kAxisZ3f;
-
-    // The river texture is tiled several times along the course of the river.
-    // TODO: Change this from tile count to actual physical size for a tile.
-    //       Requires that we know the total path distance.
-    const float texture_v = river->texture_tile_size() * static_cast<float>(i) /
-                            static_cast<float>(segment_count);
-
-    // Fraction of the river we have gone through, approximately.
-    const float fraction =
-        static_cast<float>(i) / static_cast<float>(segment_count);
-
-    if (fraction >= actual_zone_end[zone_id]) {
-      zone_id = zone_id + 1;
-      current_zone = river->zones()->Get(zone_id);
-      // Each zone has its own texture.
-      current_bank_material =
-          asset_manager->LoadMaterial(current_zone->material()->c_str());
-      // Each zone has its own river width.
-      river_width = current_zone->width() != 0 ? current_zone->width()
-                                               : river->default_width();
-      current_bank_material = asset_manager->LoadMaterial(
-          river->zones()->Get(zone_id)->material()->c_str());
+  }
+
+  // Likewise keep the collision sectors that didn't change. The rest are
+  // rebuilt by UpdateCollision() if they're still needed.
+  const bool same_sectors =
+      same_layout && old_contours->collision_sector_segments ==
+                         new_contours.collision_sector_segments;
+  std::vector<RiverCollisionSector>& sectors = river_data->collision_sectors;
+  for (size_t i = 0; i < sectors.size();) {
+    bool keep = same_sectors;
+    if (keep) {
+      size_t first;
+      size_t last;
+      new_contours.CollisionSectorSegments(sectors[i].index, &first, &last);
+      keep = new_contours.SegmentsEqual(*old_contours, first, last);
     }
-    bank_zones[i] = zone_id;
-    float zone_start = zone_id == 0 ? 0 : actual_zone_end[zone_id - 1];
-    float zone_end = actual_zone_end[zone_id];
-    float within_fraction = (fraction - zone_start) / (zone_end - zone_start);
-    if (current_bank_material->textures().size() == 1) {
-      // Ensure we stay continuous with transitional zones.
-      within_fraction = within_fraction < 0.5f ? 1.0f : 0.0f;
+    if (keep) {
+      ++i;
+    } else {
+      entity_manager_->DeleteEntity(sectors[i].entity);
+      sectors[i] = sectors.back();
+      sectors.pop_back();
     }
+  }
+  river_data->contours = result.contours;
 
-    int within_color = static_cast<int>(255.0 * within_fraction);
-    // Cap the color to 0..255 byte.
-    unsigned char within_color_byte = static_cast<unsigned char>(
-        within_color < 0 ? 0 : (within_color > 255 ? 255 : within_color));
-
-    // Get the (side, up) offsets of the bank vertices.
-    // The offsets are relative to `track_position`.
-    // side == distance along `track_normal`
-    // up == distance along kAxisZ3f
-    for (size_t j = 0; j < num_bank_contours; ++j) {
-      flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(j);
-      const RiverBankContour* b = (current_zone->banks() != nullptr)
-                                      ? current_zone->banks()->Get(index)
-                                      : river->default_banks()->Get(index);
-      offsets[j] =
-          vec2(mathfu::Lerp(b->x_min(), b->x_max(), mathfu::Random<float>()),
-               mathfu::Lerp(b->z_min(), b->z_max(), mathfu::Random<float>()));
-    }
+  // When streaming, the chunks hold all the meshes, so the river entity itself
+  // has nothing to draw.
+  const bool streaming =
+      RiverConfigForLevel(entity_manager_)->chunk_segments() > 0;
+  Data<RenderMeshData>(entity)->visible = !streaming;
+}
+
+int RiverComponent::ChunkSegments(const RiverData* river_data) const {
+  if (!river_data->contours) return 0;
+  const int num_quads =
+      static_cast<int>(river_data->contours->NumSegments()) - 1;
+  const int chunk_segments =
+      RiverConfigForLevel(entity_manager_)->chunk_segments();
+  return chunk_segments > 0 ? std::min(chunk_segments, num_quads) : num_quads;
+}
+
+int RiverComponent::NumChunks(const RiverData* river_data) const {
+  const int chunk_segments = ChunkSegments(river_data);
+  if (chunk_segments <= 0) return 0;
+  const int num_quads =
+      static_cast<int>(river_data->contours->NumSegments()) - 1;
+  return (num_quads + chunk_segments - 1) / chunk_segments;
+}
 
-    // Create the bank vertices for this segment.
-    for (size_t j = 0; j < num_bank_contours; ++j) {
-      const bool left_bank = j <= river_idx;
-      const vec2 off = offsets[j];
-      const vec3 vertex =
-          track_position +
-          (off.x + river_width * (left_bank ? -1 : 1)) * track_normal +
-          off.y * kAxisZ3f;
-      // The texture is stretched from the side of the river to the far end
-      // of the bank. There are two banks, however, separated by the river.
-      // We need to know the width of the bank to caluate the `texture_u`
-      // coordinate.
-      const size_t bank_start = left_bank ? 0 : num_bank_contours - 1;
-      const size_t bank_end = left_bank ? river_idx : river_idx + 1;
-      const float bank_width = offsets[bank_start].x - offsets[bank_end].x;
-      const float texture_u = (off.x - offsets[bank_end].x) / bank_width;
-
-      bank_verts.push_back(NormalMappedColorVertex());
-      bank_verts.back().pos = vec3_packed(vertex);
-      bank_verts.back().tc = vec2_packed(vec2(texture_u, texture_v));
-      bank_verts.back().norm = vec3_packed(vec3(0, 1, 0));
-      bank_verts.back().tangent = vec4_packed(vec4(1, 0, 0, 1));
-      unsigned char color_bytes[4] = {255, 255, 255, within_color_byte};
-      memcpy(bank_verts.back().color, color_bytes, sizeof(color_bytes));
+// Make sure the chunks around the raft have meshes, or are being built, and
+// free the ones that are out of range.
+void RiverComponent::UpdateChunks(corgi::EntityRef& entity) {
+  RiverData* river_data = Data<RiverData>(entity);
+  const RiverConfig* river = RiverConfigForLevel(entity_manager_);
+  const int num_chunks = NumChunks(river_data);
+  if (num_chunks == 0) return;
+
+  // Gather the chunks we want, nearest to the raft first.
+  std::vector<int>& wanted = wanted_chunks_;
+  wanted.clear();
+  auto want = [&](int chunk_index) {
+    if (river_data->contours->wraps) {
+      chunk_index = (chunk_index % num_chunks + num_chunks) % num_chunks;
+    } else if (chunk_index < 0 || chunk_index >= num_chunks) {
+      return;
+    }
+    if (std::find(wanted.begin(), wanted.end(), chunk_index) == wanted.end()) {
+      wanted.push_back(chunk_index);
     }
+  };
+  if (river->chunk_segments() <= 0) {
+    want(0);
+  } else {
+    const int raft_chunk = std::min(river_data->raft_chunk, num_chunks - 1);
+    const int ahead = river->chunks_ahead();
+    const int behind = river->chunks_behind();
+    want(raft_chunk);
+    for (int distance = 1; distance <= std::max(ahead, behind); ++distance) {
+      if (distance <= ahead) want(raft_chunk + distance);
+      if (distance <= behind) want(raft_chunk - distance);
+    }
+  }
 
-    // Ensure vertices don't go behind previous vertices on the inside of
-    // a tight corner.
-    if (i > 0) {
-      const NormalMappedColorVertex* prev_verts =
-          &bank_verts[bank_verts.size() - 2 * num_bank_contours];
-      NormalMappedColorVertex* cur_verts =
-          &bank_verts[bank_verts.size() - num_bank_contours];
-      for (size_t j = 0; j < num_bank_contours; j++) {
-        const vec3 vert_delta =
-            vec3(cur_verts[j].pos) - vec3(prev_verts[j].pos);
-        const float dot = vec3::DotProduct(vert_delta, track_delta);
-        const bool cur_vert_goes_backwards_along_track = dot <= 0.0f;
-        if (cur_vert_goes_backwards_along_track) {
-          cur_verts[j].pos = vec3(prev_verts[j].pos) + 0.000001f * track_delta;
-        }
-      }
+  // Free the chunks that are no longer needed.
+  std::vector<RiverChunk>& chunks = river_data->chunks;
+  for (size_t i = 0; i < chunks.size();) {
+    if (std::find(wanted.begin(), wanted.end(), chunks[i].index) ==
+        wanted.end()) {
+      DestroyChunk(entity, &chunks[i]);
+      chunks[i] = chunks.back();
+      chunks.pop_back();
+    } else {
+      ++i;
     }
+  }
 
-    // Force the beginning and end to line up in their geometry:
-    if (i == segment_count - 1 && rail->wraps()) {
-      for (size_t j = 0; j < num_bank_contours; j++)
-        bank_verts[bank_verts.size() - (8 - j)].pos = bank_verts[j].pos;
+  // Ask the builder for the chunks that are missing.
+  for (auto it = wanted.begin(); it != wanted.end(); ++it) {
+    const int chunk_index = *it;
+    bool exists = false;
+    for (auto chunk = chunks.begin(); chunk != chunks.end(); ++chunk) {
+      exists |= chunk->index == chunk_index;
     }
+    if (exists) continue;
+    chunks.push_back(RiverChunk());
+    chunks.back().index = chunk_index;
+
+    RiverChunkJob job;
+    job.entity = entity;
+    job.generation = river_data->generation;
+    job.config = river;
+    job.contours = river_data->contours;
+    job.chunk_index = chunk_index;
+    job.chunk_segments = ChunkSegments(river_data);
+    builder_.QueueChunk(&job);
+  }
+}
+
+// Loads the materials for a chunk's meshes, and hands its geometry to the
+// GlUploader to make the meshes from. Without one, they're made right away.
+void RiverComponent::StartChunkUpload(RiverChunkGeometry* geometry,
+                                      RiverChunk* chunk) {
+  const RiverConfig* river = RiverConfigForLevel(entity_manager_);
+  fplbase::AssetManager* asset_manager =
+      entity_manager_->GetComponent<ServicesComponent>()->asset_manager();
+  const unsigned int num_zones = river->zones()->Length();
+
+  std::shared_ptr<ChunkUpload> upload(new ChunkUpload());
+  std::swap(upload->geometry, *geometry);
+  upload->packed = river->packed_vertices();
+  upload->river_material =
+      asset_manager->LoadMaterial(river->material()->c_str());
+  upload->bank_materials.resize(num_zones, nullptr);
+  for (unsigned int zone = 0; zone < num_zones; zone++) {
+    if (upload->geometry.bank_indices_by_zone[zone].empty()) continue;
+    upload->bank_materials[zone] = asset_manager->LoadMaterial(
+        river->zones()->Get(zone)->material()->c_str());
+  }
+  chunk->uploading = true;
+
+  GlUploader* uploader = GlUploaderForRivers(entity_manager_);
+  if (uploader == nullptr) {
+    CreateChunkMeshes(upload.get());
+    FinishChunkUpload(upload.get(), true);
+    return;
+  }
+  uploader->Queue([upload]() { CreateChunkMeshes(upload.get()); },
+                  [this, upload](bool uploaded) {
+                    FinishChunkUpload(upload.get(), uploaded);
+                  });
+}
+
+// Makes the GL buffers for a chunk's meshes. Only touches `upload`, so it can
+// run on the upload thread.
+void RiverComponent::CreateChunkMeshes(ChunkUpload* upload) {
+  const RiverChunkGeometry& geometry = upload->geometry;
+  const ChunkVertices river_verts = RiverVertices(geometry, upload->packed);
+  upload->river_mesh = new Mesh(river_verts.data, river_verts.count,
+                                river_verts.vertex_size, river_verts.format);
+  upload->river_mesh->AddIndices(
+      geometry.river_indices.data(),
+      static_cast<int>(geometry.river_indices.size()), upload->river_material);
+
+  const ChunkVertices bank_verts = BankVertices(geometry, upload->packed);
+  upload->bank_meshes.resize(upload->bank_materials.size(), nullptr);
+  for (size_t zone = 0; zone < upload->bank_materials.size(); zone++) {
+    if (upload->bank_materials[zone] == nullptr) continue;
+    const std::vector<unsigned short>& bank_indices =
+        geometry.bank_indices_by_zone[zone];
+    Mesh* bank_mesh = new Mesh(bank_verts.data, bank_verts.count,
+                               bank_verts.vertex_size, bank_verts.format);
+    bank_mesh->AddIndices(bank_indices.data(),
+                          static_cast<int>(bank_indices.size()),
+                          upload->bank_materials[zone]);
+    upload->bank_meshes[zone] = bank_mesh;
+  }
+}
 
-    // The river has two of the middle vertices of the bank.
-    // The texture coordinates are different, however.
-    const size_t river_vert = bank_verts.size() - num_bank_contours + river_idx;
-    float normalized_texture_v = i / static_cast<float>(segment_count);
-    river_verts.push_back(NormalMappedVertex());
-    river_verts.back().pos = bank_verts[river_vert].pos;
-    river_verts.back().tc = vec2(0.0f, normalized_texture_v);
-    river_verts.back().norm = bank_verts[river_vert].norm;
-    river_verts.back().tangent = bank_verts[river_vert].tangent;
-
-    river_verts.push_back(NormalMappedVertex());
-    river_verts.back().pos = bank_verts[river_vert + 1].pos;
-    river_verts.back().tc = vec2(1.0f, normalized_texture_v);
-    river_verts.back().norm = bank_verts[river_vert + 1].norm;
-    river_verts.back().tangent = bank_verts[river_vert + 1].tangent;
-  }
-
-  // Not counting the first segment, create triangles in our index
-  // list to represent this segment.
-  //
-  for (size_t i = 0; i < segment_count - 1; i++) {
-    auto make_quad = [&](std::vector<unsigned short>& indices, int base_index,
-                         int off1, int off2) {
-      indices.push_back(static_cast<unsigned short>(base_index + off1));
-      indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
-      indices.push_back(static_cast<unsigned short>(base_index + off2));
-
-      indices.push_back(static_cast<unsigned short>(base_index + off2));
-      indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
-      indices.push_back(static_cast<unsigned short>(base_index + off2 + 1));
-    };
-
-    // River only has one quad per segment.
-    make_quad(river_indices, 2 * static_cast<int>(i), 0, 2);
-
-    // Case when kNumBankCountours = 8, and river_idx = 3;
-    //
-    //  0___1___2___3   4___5___6___7
-    //  | _/| _/| _/|   | _/| _/| _/|
-    //  |/__|/__|/__|   |/__|/__|/__|
-    //  8   9  10  11  12  13  14  15
-    for (size_t j = 0; j <= num_bank_quads; ++j) {
-      // Do not create bank geo for the river.
-      if (j == river_idx) continue;
-      unsigned int zone = bank_zones[i];
-      int base_index = static_cast<int>(i * num_bank_contours);
-      int offset1 = static_cast<int>(j);
-      int offset2 = static_cast<int>(num_bank_contours + j);
-      make_quad(bank_indices, base_index, offset1, offset2);
-      make_quad(bank_indices_by_zone[zone], base_index, offset1, offset2);
-
-      // Add the same triangles to the static mesh associated with the entity.
-      physics_component->AddStaticMeshTriangle(
-          entity, vec3(bank_verts[base_index + offset1].pos),
-          vec3(bank_verts[base_index + offset1 + 1].pos),
-          vec3(bank_verts[base_index + offset2].pos));
-
-      physics_component->AddStaticMeshTriangle(
-          entity, vec3(bank_verts[base_index + offset2].pos),
-          vec3(bank_verts[base_index + offset1 + 1].pos),
-          vec3(bank_verts[base_index + offset2 + 1].pos));
+// Adds a chunk's meshes to it once the render thread can see them, unless
+// the chunk was freed or the river rebuilt in the meantime. If the GL context
+// was lost first, the chunk's geometry is uploaded again.
+void RiverComponent::FinishChunkUpload(ChunkUpload* upload, bool uploaded) {
+  corgi::EntityRef entity = upload->geometry.entity;
+  RiverData* river_data =
+      entity.IsValid() ? Data<RiverData>(entity) : nullptr;
+  RiverChunk* chunk = nullptr;
+  if (river_data != nullptr &&
+      river_data->generation == upload->geometry.generation) {
+    for (auto it = river_data->chunks.begin(); it != river_data->chunks.end();
+         ++it) {
+      if (it->index == upload->geometry.chunk_index && it->uploading) {
+        chunk = &*it;
+      }
     }
   }
 
-  // Make sure we used as much data as expected, and no more.
-  assert(river_indices.size() == river_index_max);
-  assert(river_verts.size() == river_vert_max);
-  assert(bank_indices.size() == bank_index_max);
-  assert(bank_verts.size() == bank_vert_max);
+  if (chunk == nullptr || !uploaded) {
+    // They've never been drawn, so they can be deleted right away.
+    delete upload->river_mesh;
+    for (auto it = upload->bank_meshes.begin();
+         it != upload->bank_meshes.end(); ++it) {
+      delete *it;
+    }
+    upload->river_mesh = nullptr;
+    upload->bank_meshes.clear();
+  }
+  if (chunk == nullptr) return;
+  chunk->uploading = false;
+  if (!uploaded) {
+    finished_chunks_.push_back(RiverChunkGeometry());
+    std::swap(finished_chunks_.back(), upload->geometry);
+    return;
+  }
+  AttachChunkMeshes(entity, *upload, chunk);
+}
 
-  Mesh::ComputeNormalsTangents(bank_verts.data(), bank_indices.data(),
-                               static_cast<int>(bank_verts.size()),
-                               static_cast<int>(bank_indices.size()));
+// Adds a chunk's meshes to its rendermesh components.
+void RiverComponent::AttachChunkMeshes(corgi::EntityRef& entity,
+                                       const ChunkUpload& upload,
+                                       RiverChunk* chunk) {
+  const RiverConfig* river = RiverConfigForLevel(entity_manager_);
+  fplbase::AssetManager* asset_manager =
+      entity_manager_->GetComponent<ServicesComponent>()->asset_manager();
+  const RiverChunkGeometry& geometry = upload.geometry;
 
-  // Load the material from files.
-  Material* river_material =
-      asset_manager->LoadMaterial(river->material()->c_str());
-  // Create the actual mesh objects, and stuff all the data we just
-  // generated into it.
-  Mesh* river_mesh =
-      new Mesh(river_verts.data(), river_verts.size(),
-               static_cast<int>(sizeof(NormalMappedVertex)), kMeshFormat);
+  if (river->chunk_segments() > 0) {
+    chunk->entity = AcquireMeshEntity(entity);
+  } else {
+    chunk->entity = entity;
+  }
 
-  river_mesh->AddIndices(river_indices.data(),
-                         static_cast<int>(river_indices.size()),
-                         river_material);
+  const char* shader_suffix = upload.packed ? kPackedShaderSuffix : "";
+  const ChunkVertices river_verts = RiverVertices(geometry, upload.packed);
+  const ChunkVertices bank_verts = BankVertices(geometry, upload.packed);
 
-  // Add the river mesh to the river entity.
-  RenderMeshData* mesh_data = Data<RenderMeshData>(entity);
+  // Add the river mesh to the chunk entity.
+  RenderMeshData* mesh_data = Data<RenderMeshData>(chunk->entity);
+  mesh_data->shaders.clear();
+  const std::string river_shader = river->shader()->str() + shader_suffix;
   mesh_data->shaders.push_back(
-      asset_manager->LoadShader(river->shader()->c_str()));
+      asset_manager->LoadShader(river_shader.c_str()));
   mesh_data->shaders.push_back(
       asset_manager->LoadShader("shaders/render_depth"));
-  if (mesh_data->mesh != nullptr) {
-    // Mesh's destructor handles cleaning up its GL buffers
-    delete mesh_data->mesh;
-    mesh_data->mesh = nullptr;
-  }
-  mesh_data->mesh = river_mesh;
+  assert(mesh_data->mesh == nullptr);
+  mesh_data->mesh = upload.river_mesh;
   mesh_data->culling_mask = 0;  // Never cull the river.
   mesh_data->pass_mask = 1 << corgi::RenderPass_Opaque;
   mesh_data->debug_name = "river";
 
-  river_data->banks.resize(num_zones, corgi::EntityRef());
-  for (unsigned int zone = 0; zone < num_zones; zone++) {
-    Material* bank_material = asset_manager->LoadMaterial(
-        river->zones()->Get(zone)->material()->c_str());
+  // Keep copies, so a lost GL context doesn't mean building the chunk again.
+  ResidencyCache* residency_cache = ResidencyCacheForRivers(entity_manager_);
+  const bool keep_copies =
+      residency_cache != nullptr && residency_cache->enabled();
+  if (keep_copies) {
+    MeshCopy copy;
+    copy.vertices = CopyVertices(river_verts);
+    copy.count = river_verts.count;
+    copy.vertex_size = river_verts.vertex_size;
+    copy.format = river_verts.format;
+    copy.indices = geometry.river_indices;
+    copy.material = upload.river_material;
+    residency_cache->Keep(chunk->entity, copy);
+  }
+  std::shared_ptr<const std::vector<uint8_t>> bank_copy;
 
-    Mesh* bank_mesh =
-        new Mesh(bank_verts.data(), static_cast<int>(bank_verts.size()),
-                 sizeof(NormalMappedColorVertex), kBankMeshFormat);
-
-    bank_mesh->AddIndices(bank_indices_by_zone[zone].data(),
-                          static_cast<int>(bank_indices_by_zone[zone].size()),
-                          bank_material);
-    if (!river_data->banks[zone]) {
-      // Now we make a new entity to hold the bank mesh.
-      river_data->banks[zone] = entity_manager_->AllocateNewEntity();
-      entity_manager_->AddEntityToComponent<RenderMeshComponent>(
-          river_data->banks[zone]);
-
-      // Then we stick it as a child of the river entity, so it always moves
-      // with it and stays aligned:
-      auto transform_component =
-          GetComponent<corgi::component_library::TransformComponent>();
-      transform_component->AddChild(river_data->banks[zone], entity);
-    }
+  const size_t num_zones = upload.bank_meshes.size();
+  chunk->banks.resize(num_zones, corgi::EntityRef());
+  for (size_t zone = 0; zone < num_zones; zone++) {
+    Mesh* bank_mesh = upload.bank_meshes[zone];
+    if (bank_mesh == nullptr) continue;
+    Material* bank_material = upload.bank_materials[zone];
+
+    // Now we get an entity to hold the bank mesh, as a child of the chunk
+    // entity.
+    chunk->banks[zone] = AcquireMeshEntity(chunk->entity);
 
     RenderMeshData* child_render_data =
-        Data<RenderMeshData>(river_data->banks[zone]);
-    if (bank_material->textures().size() == 1) {
-      child_render_data->shaders.push_back(
-          asset_manager->LoadShader("shaders/textured_lit"));
-    } else {
-      child_render_data->shaders.push_back(
-          asset_manager->LoadShader("shaders/bank"));
-    }
-    if (child_render_data->mesh != nullptr) {
-      // Mesh's destructor handles cleaning up its GL buffers
-      delete child_render_data->mesh;
-      child_render_data->mesh = nullptr;
-    }
+        Data<RenderMeshData>(chunk->banks[zone]);
+    const std::string bank_shader =
+        std::string(bank_material->textures().size() == 1
+                        ? "shaders/textured_lit"
+                        : "shaders/bank") +
+        shader_suffix;
+    child_render_data->shaders.push_back(
+        asset_manager->LoadShader(bank_shader.c_str()));
     child_render_data->mesh = bank_mesh;
     child_render_data->culling_mask = 0;  // Don't cull the banks for now.
     child_render_data->pass_mask = 1 << corgi::RenderPass_Opaque;
     std::ostringstream debug_name;
     debug_name << "river bank" << zone + 1;
     child_render_data->debug_name = debug_name.str();
+
+    if (keep_copies) {
+      if (!bank_copy) bank_copy = CopyVertices(bank_verts);
+      MeshCopy copy;
+      copy.vertices = bank_copy;
+      copy.count = bank_verts.count;
+      copy.vertex_size = bank_verts.vertex_size;
+      copy.format = bank_verts.format;
+      copy.indices = geometry.bank_indices_by_zone[zone];
+      copy.material = bank_material;
+      residency_cache->Keep(chunk->banks[zone], copy);
+    }
+  }
+}
+
+// After the GL context is lost, every chunk's meshes are stale. Chunks whose
+// meshes the residency cache kept copies of are uploaded again by the cache;
+// the rest are freed, to be built again as usual. Must be called before the
+// cache's Recover(), since the stale meshes are deleted here.
+void RiverComponent::RecoverMeshes(ResidencyCache* residency_cache) {
+  for (auto iter = begin(); iter != end(); ++iter) {
+    RiverData* river_data = Data<RiverData>(iter->entity);
+    std::vector<RiverChunk>& chunks = river_data->chunks;
+    for (size_t i = 0; i < chunks.size();) {
+      RiverChunk& chunk = chunks[i];
+      // Chunks still being built have nothing to lose.
+      bool kept = !chunk.entity.IsValid() ||
+                  (residency_cache != nullptr &&
+                   residency_cache->Contains(chunk.entity));
+      for (auto it = chunk.banks.begin(); kept && it != chunk.banks.end();
+           ++it) {
+        kept = !it->IsValid() || residency_cache->Contains(*it);
+      }
+      if (kept) {
+        ++i;
+      } else {
+        DestroyChunk(iter->entity, &chunk);
+        chunks[i] = chunks.back();
+        chunks.pop_back();
+      }
+    }
+  }
+  DeletePendingMeshes();
+}
+
+// Keeps the sectors of the banks' static physics mesh that are near the raft
+// or a thrown projectile, and builds the missing ones a few at a time. With
+// no raft, as in an empty editor scene, every sector is wanted.
+void RiverComponent::UpdateCollision(corgi::EntityRef& entity) {
+  RiverData* river_data = Data<RiverData>(entity);
+  const RiverContours* contours = river_data->contours.get();
+  if (contours == nullptr) return;
+  const float margin = RiverConfigForLevel(entity_manager_)->collision_margin();
+  GatherCollisionPoints(entity);
+  const bool want_all = collision_points_.empty();
+
+  // Whether a sector's bounds are within `distance` of any of the points.
+  auto in_range = [&](int sector, float distance) {
+    if (want_all) return true;
+    const vec3 sector_min =
+        contours->collision_sector_min[sector] - vec3(distance);
+    const vec3 sector_max =
+        contours->collision_sector_max[sector] + vec3(distance);
+    for (auto it = collision_points_.begin(); it != collision_points_.end();
+         ++it) {
+      if (it->x >= sector_min.x && it->y >= sector_min.y &&
+          it->z >= sector_min.z && it->x <= sector_max.x &&
+          it->y <= sector_max.y && it->z <= sector_max.z) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Sectors are kept until they're twice the margin away, so one on the edge
+  // isn't rebuilt over and over.
+  std::vector<RiverCollisionSector>& sectors = river_data->collision_sectors;
+  for (size_t i = 0; i < sectors.size();) {
+    if (in_range(sectors[i].index, 2.0f * margin)) {
+      ++i;
+    } else {
+      entity_manager_->DeleteEntity(sectors[i].entity);
+      sectors[i] = sectors.back();
+      sectors.pop_back();
+    }
+  }
+
+  int num_built = 0;
+  const int num_sectors = static_cast<int>(contours->NumCollisionSectors());
+  for (int index = 0;
+       index < num_sectors && num_built < kMaxCollisionSectorsBuiltPerFrame;
+       ++index) {
+    if (!in_range(index, margin)) continue;
+    bool exists = false;
+    for (auto it = sectors.begin(); it != sectors.end(); ++it) {
+      exists |= it->index == index;
+    }
+    if (exists) continue;
+    BuildCollisionSector(entity, index);
+    ++num_built;
+  }
+}
+
+// Fills `collision_points_` with the positions of the raft and the thrown
+// projectiles, in the space of `entity`'s river. Empty if there's no raft.
+void RiverComponent::GatherCollisionPoints(const corgi::EntityRef& entity) {
+  collision_points_.clear();
+  ServicesComponent* services =
+      entity_manager_->GetComponent<ServicesComponent>();
+  corgi::EntityRef raft = services->raft_entity();
+  if (!raft.IsValid()) return;
+  auto* transform_component =
+      GetComponent<corgi::component_library::TransformComponent>();
+  const mat4 to_river = transform_component->WorldTransform(entity).Inverse();
+  collision_points_.push_back(to_river *
+                              transform_component->WorldPosition(raft));
+
+  // TODO: change projectile_component to const when Component gets a
+  //       const_iterator.
+  PlayerProjectileComponent* projectile_component =
+      entity_manager_->GetComponent<PlayerProjectileComponent>();
+  const EntityPoolComponent* entity_pool = services->entity_pool();
+  for (auto it = projectile_component->begin();
+       it != projectile_component->end(); ++it) {
+    if (!entity_pool->IsActive(it->entity)) continue;
+    collision_points_.push_back(
+        to_river * transform_component->WorldPosition(it->entity));
+  }
+}
+
+// Creates the static physics mesh for one sector of the river's banks, from
+// its current contours.
+void RiverComponent::BuildCollisionSector(corgi::EntityRef& entity,
+                                          int index) {
+  RiverData* river_data = Data<RiverData>(entity);
+  const RiverContours& contours = *river_data->contours;
+  const RiverConfig* river = RiverConfigForLevel(entity_manager_);
+  auto* physics_component = entity_manager_->GetComponent<PhysicsComponent>();
+  auto* transform_component =
+      GetComponent<corgi::component_library::TransformComponent>();
+
+  size_t first;
+  size_t last;
+  contours.CollisionSectorSegments(index, &first, &last);
+  const std::vector<vec3>& verts = contours.collision_verts;
+  const size_t verts_begin = first * contours.collision_verts_per_segment;
+  const size_t verts_end = last * contours.collision_verts_per_segment;
+
+  RiverCollisionSector sector;
+  sector.index = index;
+  sector.entity = entity_manager_->AllocateNewEntity();
+  entity_manager_->AddEntityToComponent<
+      corgi::component_library::TransformComponent>(sector.entity);
+  // Stick it as a child of the river entity, so it stays aligned with it.
+  transform_component->AddChild(sector.entity, entity);
+
+  physics_component->InitStaticMesh(sector.entity);
+  for (size_t i = verts_begin; i + 2 < verts_end; i += 3) {
+    physics_component->AddStaticMeshTriangle(sector.entity, verts[i],
+                                             verts[i + 1], verts[i + 2]);
   }
 
-  // Finalize the static physics mesh created on the river bank.
   short collision_type = static_cast<short>(river->collision_type());
   short collides_with = 0;
   if (river->collides_with()) {
@@ -512,23 +878,113 @@ void RiverComponent::CreateRiverMesh(corgi::EntityRef& entity) {
     }
   }
   std::string user_tag = river->user_tag() ? river->user_tag()->c_str() : "";
-  physics_component->FinalizeStaticMesh(entity, collision_type, collides_with,
-                                        river->mass(), river->restitution(),
-                                        user_tag);
+  physics_component->FinalizeStaticMesh(sector.entity, collision_type,
+                                        collides_with, river->mass(),
+                                        river->restitution(), user_tag);
+  river_data->collision_sectors.push_back(sector);
+}
+
+// The meshes may still be in this frame's render lists, so they're deleted
+// at the start of the next UpdateRiverMeshes() rather than now.
+void RiverComponent::ReleaseMesh(corgi::EntityRef& entity) {
+  if (!entity.IsValid()) return;
+  RenderMeshData* mesh_data = Data<RenderMeshData>(entity);
+  if (mesh_data != nullptr && mesh_data->mesh != nullptr) {
+    meshes_pending_delete_.push_back(mesh_data->mesh);
+    mesh_data->mesh = nullptr;
+  }
+  ResidencyCache* residency_cache = ResidencyCacheForRivers(entity_manager_);
+  if (residency_cache != nullptr) residency_cache->Forget(entity);
+}
+
+// More spare entities than this are deleted. Enough for a few chunks' worth
+// of surface and bank entities.
+static const size_t kMaxSpareEntities = 32;
+
+// Gets an entity with a rendermesh, for a chunk's surface or banks, as a
+// child of `parent`.
+corgi::EntityRef RiverComponent::AcquireMeshEntity(corgi::EntityRef& parent) {
+  corgi::EntityRef entity;
+  while (!spare_entities_.empty() && !entity.IsValid()) {
+    entity = spare_entities_.back();
+    spare_entities_.pop_back();
+  }
+  if (entity.IsValid()) {
+    RenderMeshData* mesh_data = Data<RenderMeshData>(entity);
+    mesh_data->shaders.clear();
+    mesh_data->visible = true;
+  } else {
+    entity = entity_manager_->AllocateNewEntity();
+    entity_manager_->AddEntityToComponent<RenderMeshComponent>(entity);
+  }
+  // Stick it as a child of the parent, so it always moves with it and stays
+  // aligned.
+  GetComponent<corgi::component_library::TransformComponent>()->AddChild(
+      entity, parent);
+  return entity;
+}
 
-  // We don't want to keep the random number generator set to the same
-  // value every time we generate the river, so reset the seed back to time.
-  srand(static_cast<unsigned int>(time(nullptr)));
+// Frees an entity from AcquireMeshEntity(), keeping it for reuse if there's
+// room.
+void RiverComponent::RecycleMeshEntity(corgi::EntityRef& entity) {
+  ReleaseMesh(entity);
+  if (spare_entities_.size() >= kMaxSpareEntities) {
+    entity_manager_->DeleteEntity(entity);
+    return;
+  }
+  GetComponent<corgi::component_library::TransformComponent>()->RemoveChild(
+      entity);
+  Data<RenderMeshData>(entity)->visible = false;
+  spare_entities_.push_back(entity);
+}
+
+// Releases a chunk's meshes and entities. Chunks that are still being built
+// have nothing to release; their geometry is dropped when it arrives.
+void RiverComponent::DestroyChunk(corgi::EntityRef& entity,
+                                  RiverChunk* chunk) {
+  for (auto it = chunk->banks.begin(); it != chunk->banks.end(); ++it) {
+    if (it->IsValid()) RecycleMeshEntity(*it);
+  }
+  chunk->banks.clear();
+  if (chunk->entity.IsValid()) {
+    // Unchunked rivers keep their meshes on the river entity itself.
+    if (chunk->entity != entity) {
+      RecycleMeshEntity(chunk->entity);
+    } else {
+      ReleaseMesh(chunk->entity);
+    }
+  }
+  chunk->entity = corgi::EntityRef();
+  chunk->index = -1;
+}
+
+void RiverComponent::CleanupEntity(corgi::EntityRef& entity) {
+  RiverData* river_data = Data<RiverData>(entity);
+  // The chunk entities are torn down along with the rest of the world, so
+  // only hold on to their meshes until it's safe to free them.
+  for (auto chunk = river_data->chunks.begin();
+       chunk != river_data->chunks.end(); ++chunk) {
+    for (auto it = chunk->banks.begin(); it != chunk->banks.end(); ++it) {
+      ReleaseMesh(*it);
+    }
+    ReleaseMesh(chunk->entity);
+  }
+  river_data->chunks.clear();
+  river_data->collision_sectors.clear();
+  for (auto it = spare_entities_.begin(); it != spare_entities_.end(); ++it) {
+    if (it->IsValid()) entity_manager_->DeleteEntity(*it);
+  }
+  spare_entities_.clear();
 }
 
 void RiverComponent::UpdateRiverMeshes(corgi::EntityRef entity) {
   const RailNodeData* node_data =
       entity_manager_->GetComponentData<RailNodeData>(entity);
   if (node_data != nullptr) {
-    // For now, update all rivers. In the future only update rivers that
-    // have the same rail_name that just changed.
     for (auto iter = begin(); iter != end(); ++iter) {
-      CreateRiverMesh(iter->entity);
+      if (Data<RiverData>(iter->entity)->rail_name == node_data->rail_name) {
+        QueueContours(iter->entity);
+      }
     }
   }
 }
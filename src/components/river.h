@@ -15,8 +15,10 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_RIVER_H
 #define FPL_ZOOSHI_COMPONENTS_RIVER_H
 
+#include <memory>
 #include <string>
 #include <vector>
+#include "common.h"
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "fplbase/mesh.h"
@@ -24,50 +26,151 @@
 #include "mathfu/glsl_mappings.h"
 #include "mathfu/matrix_4x4.h"
 #include "rail_denizen.h"
+#include "river_mesh_builder.h"
 
 namespace fpl {
 namespace zooshi {
 
+class ResidencyCache;
+
+// A fixed-length run of the river, with its own surface mesh and bank
+// meshes. Chunks are generated as the raft approaches them and freed once the
+// raft has passed.
+struct RiverChunk {
+  RiverChunk() : index(-1), uploading(false) {}
+  // Position of this chunk along the river.
+  int index;
+  // Holds the river surface mesh.
+  // When the river isn't chunked, this is the river entity itself. Invalid
+  // while the chunk's geometry is still being built.
+  corgi::EntityRef entity;
+  // Holds the bank meshes, indexed by zone. Zones that don't intersect this
+  // chunk have an invalid entity.
+  std::vector<corgi::EntityRef> banks;
+  // True while the GlUploader is making the chunk's meshes.
+  bool uploading;
+};
+
+// A piece of the static physics mesh of the banks, covering the track
+// segments RiverContours::CollisionSectorSegments() gives for `index`.
+struct RiverCollisionSector {
+  RiverCollisionSector() : index(-1) {}
+  int index;
+  corgi::EntityRef entity;
+};
+
 // All the relevent data for rivers ends up tossed into other components.
 // (Mostly rendermesh at the moment.)  This will probably be less empty
 // once the river gets more animated.
 struct RiverData {
   RiverData()
       : render_mesh_needs_update_(false),
-        random_seed(static_cast<unsigned int>(rand())) {}
-  std::vector<corgi::EntityRef> banks;
+        random_seed(static_cast<unsigned int>(rand())),
+        generation(0),
+        raft_chunk(0) {}
   std::string rail_name;
   // Flag for whether this river needs its meshes updated.
   bool render_mesh_needs_update_;
   // River generation has random elements, so we seed the random number
   // generator the same way every time we reload the river.
   unsigned int random_seed;
+  // Incremented each time the river is regenerated, so that geometry built
+  // for an older version of the river can be discarded.
+  int generation;
+  // The rail nodes this river was last built from, and their world positions
+  // at the time, so that edits which don't touch them can be ignored.
+  std::vector<corgi::EntityRef> rail_nodes;
+  std::vector<mathfu::vec3> rail_node_positions;
+  // The bank cross-section along the river. Chunk meshes are built from
+  // these, so the random offsets are consistent between chunks. Null until
+  // the first generation has been built.
+  std::shared_ptr<const RiverContours> contours;
+  // The chunks that have meshes, or are waiting on the builder for them.
+  std::vector<RiverChunk> chunks;
+  // The sectors of the banks' static physics mesh that are built. Only the
+  // ones near the raft or a thrown projectile are kept.
+  std::vector<RiverCollisionSector> collision_sectors;
+  // The chunk that the raft is in. Written by the update thread and read by
+  // the render thread when deciding which chunks to keep.
+  int raft_chunk;
 };
 
 class RiverComponent : public corgi::Component<RiverData> {
  public:
-  virtual ~RiverComponent() {}
+  virtual ~RiverComponent();
 
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* raw_data);
   virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
 
   virtual void Init();
   virtual void UpdateAllEntities(corgi::WorldTime /*delta_time*/);
+  virtual void CleanupEntity(corgi::EntityRef& entity);
 
   void UpdateRiverMeshes(corgi::EntityRef entity);
 
-  // Updates the meshes for the river.
+  // Updates the meshes for the river. The geometry is built on a worker
+  // thread; this queues the work and uploads whatever has finished.
   // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
   // IMPORTANT:  This will break if called from any thread other than
   // the main render thread.  Do not call from the update thread!
   void UpdateRiverMeshes();
 
+  // Replace the meshes lost along with the GL context. Render thread only.
+  void RecoverMeshes(ResidencyCache* residency_cache);
+
   float river_offset() const { return river_offset_; }
 
  private:
-  void TriggerRiverUpdate();
-  void CreateRiverMesh(corgi::EntityRef& entity);
+  void TriggerRiverUpdate(const corgi::EntityRef& entity);
+  void QueueContours(corgi::EntityRef& entity);
+  void ApplyContours(const RiverContourResult& result);
+  void UpdateChunks(corgi::EntityRef& entity);
+  // A chunk's finished geometry on its way to the GPU, with the materials its
+  // meshes use, and the meshes once they've been made.
+  struct ChunkUpload {
+    ChunkUpload()
+        : packed(false), river_material(nullptr), river_mesh(nullptr) {}
+    RiverChunkGeometry geometry;
+    bool packed;
+    fplbase::Material* river_material;
+    // Indexed by zone. Null for zones that don't intersect the chunk.
+    std::vector<fplbase::Material*> bank_materials;
+    fplbase::Mesh* river_mesh;
+    std::vector<fplbase::Mesh*> bank_meshes;
+  };
+
+  void StartChunkUpload(RiverChunkGeometry* geometry, RiverChunk* chunk);
+  static void CreateChunkMeshes(ChunkUpload* upload);
+  void FinishChunkUpload(ChunkUpload* upload, bool uploaded);
+  void AttachChunkMeshes(corgi::EntityRef& entity, const ChunkUpload& upload,
+                         RiverChunk* chunk);
+  void UpdateCollision(corgi::EntityRef& entity);
+  void GatherCollisionPoints(const corgi::EntityRef& entity);
+  void BuildCollisionSector(corgi::EntityRef& entity, int index);
+  void DestroyChunk(corgi::EntityRef& entity, RiverChunk* chunk);
+  void ReleaseMesh(corgi::EntityRef& entity);
+  void DeletePendingMeshes();
+  corgi::EntityRef AcquireMeshEntity(corgi::EntityRef& parent);
+  void RecycleMeshEntity(corgi::EntityRef& entity);
+  int ChunkSegments(const RiverData* river_data) const;
+  int NumChunks(const RiverData* river_data) const;
   float river_offset_;
+  // Builds river contours and chunk geometry off the render thread.
+  RiverMeshBuilder builder_;
+  // Chunk geometry that's been built but not yet handed to the GlUploader.
+  std::vector<RiverChunkGeometry> finished_chunks_;
+  // Meshes of freed chunks, deleted once no render pass can reference them.
+  std::vector<fplbase::Mesh*> meshes_pending_delete_;
+  // Hidden entities from freed chunks, kept to hold the meshes of the next
+  // chunks that stream in rather than deleting and allocating entities.
+  std::vector<corgi::EntityRef> spare_entities_;
+  // Scratch buffers for UpdateRiverMeshes(), kept to reuse their allocations
+  // from frame to frame.
+  std::vector<RiverContourResult> finished_contours_;
+  std::vector<int> wanted_chunks_;
+  // Where the raft and projectiles are, in the space of the river being
+  // updated.
+  std::vector<mathfu::vec3> collision_points_;
 };
 
 }  // zooshi
@@ -14,6 +14,8 @@
 
 #include "components/scenery.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include "components/services.h"
 #include "components_generated.h"
@@ -22,6 +24,7 @@
 #include "corgi_component_library/transform.h"
 #include "mathfu/glsl_mappings.h"
 #include "motive/io/flatbuffers.h"
+#include "render_culler.h"
 #include "world.h"
 
 CORGI_DEFINE_COMPONENT(fpl::zooshi::SceneryComponent, fpl::zooshi::SceneryData)
@@ -40,8 +43,24 @@ using mathfu::quat;
 using mathfu::vec3;
 using mathfu::kZeros3f;
 
+// Scenery per job when updating in parallel.
+static const int kSceneryPerJob = 32;
+
+// Grid cells further out than this are clamped, to keep cell keys in range.
+static const float kMaxCellCoord = 1.0e6f;
+
+// If the raft is so fast that more cells than this would need to be looked
+// at, all the hidden scenery is updated instead.
+static const int64_t kMaxCellsPerQuery = 1024;
+
+static bool CellLess(const std::pair<uint64_t, corgi::EntityRef>& a,
+                     const std::pair<uint64_t, corgi::EntityRef>& b) {
+  return a.first < b.first;
+}
+
 void SceneryComponent::Init() {
   config_ = entity_manager_->GetComponent<ServicesComponent>()->config();
+  update_lod_.Init(config_->update_lod());
 
   // Scene Lab is not guaranteed to be present in all versions of the game.
   // Only set up callbacks if we actually have a Scene Lab.
@@ -57,6 +76,7 @@ void SceneryComponent::AddFromRawData(corgi::EntityRef& scenery,
                                       const void* raw_data) {
   auto scenery_def = static_cast<const SceneryDef*>(raw_data);
   SceneryData* scenery_data = AddEntity(scenery);
+  update_lod_.InitState(&scenery_data->lod);
   scenery_data->anim_object = scenery_def->anim_object();
   // Trees should rotate to face the player.
   if (scenery_def->faces_raft()) {
@@ -72,33 +92,117 @@ corgi::ComponentInterface::RawDataUniquePtr SceneryComponent::ExportRawData(
 void SceneryComponent::InitEntity(corgi::EntityRef& /*scenery*/) {}
 
 void SceneryComponent::PostLoadFixup() {
+  // Initialize each scenery.
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    FixupScenery(iter->entity);
+  }
+  unhidden_.clear();
+  BuildGrid();
+}
+
+void SceneryComponent::PostLoadFixup(
+    const std::vector<corgi::EntityRef>& entities) {
+  for (auto it = entities.begin(); it != entities.end(); ++it) {
+    if (GetComponentData(*it) != nullptr) FixupScenery(*it);
+  }
+  BuildGrid();
+}
+
+void SceneryComponent::FixupScenery(const corgi::EntityRef& scenery) {
   const TransformComponent* transform_component =
       entity_manager_->GetComponent<TransformComponent>();
 
-  // Initialize each scenery.
+  // Get reference to the first child with a rendermesh. We assume there will
+  // only be one such child.
+  SceneryData* scenery_data = Data<SceneryData>(scenery);
+  scenery_data->render_child = transform_component->ChildWithComponent(
+      scenery, RenderMeshComponent::GetComponentId());
+  assert(scenery_data->render_child);
+
+  // Add animation to the entity with the rendermesh.
+  entity_manager_->AddEntityToComponent<AnimationComponent>(
+      scenery_data->render_child);
+  AnimationData* animation_data =
+      Data<AnimationData>(scenery_data->render_child);
+  animation_data->anim_table_object = scenery_data->anim_object;
+
+  // Everything starts off-screen.
+  scenery_data->state = kSceneryHide;
+  scenery_data->anim_paused = false;
+  scenery_data->disappear_time = AnimLength(scenery_data, kSceneryDisappear);
+
+  // Ensure all scenery starts hidden.
+  Show(scenery, false);
+}
+
+int SceneryComponent::CellCoord(float x) const {
+  const float coord = std::floor(x / cell_size_);
+  return static_cast<int>(
+      std::max(-kMaxCellCoord, std::min(coord, kMaxCellCoord)));
+}
+
+uint64_t SceneryComponent::CellKey(int x, int y) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+         static_cast<uint64_t>(static_cast<uint32_t>(y));
+}
+
+void SceneryComponent::BuildGrid() {
+  cell_size_ =
+      std::max(config_->rendering_config()->pop_in_distance(), 1.0f);
+  max_disappear_time_ = 0.0f;
+  cells_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    corgi::EntityRef scenery = iter->entity;
+    const TransformData* transform_data = Data<TransformData>(iter->entity);
+    const vec3& position = transform_data->position;
+    cells_.push_back(CellEntry(
+        CellKey(CellCoord(position.x), CellCoord(position.y)), iter->entity));
+    max_disappear_time_ =
+        std::max(max_disappear_time_, iter->data.disappear_time);
+  }
+  std::sort(cells_.begin(), cells_.end(), CellLess);
+}
+
+void SceneryComponent::AddUpdate(const corgi::EntityRef& scenery) {
+  EntityUpdate update;
+  update.scenery = scenery;
+  update.updated = false;
+  update.unseen = false;
+  update.next_state = kSceneryInvalid;
+  updates_.push_back(update);
+}
 
-    // Get reference to the first child with a rendermesh. We assume there will
-    // only be one such child.
-    SceneryData* scenery_data = Data<SceneryData>(scenery);
-    scenery_data->render_child = transform_component->ChildWithComponent(
-        scenery, RenderMeshComponent::GetComponentId());
-    assert(scenery_data->render_child);
-
-    // Add animation to the entity with the rendermesh.
-    entity_manager_->AddEntityToComponent<AnimationComponent>(
-        scenery_data->render_child);
-    AnimationData* animation_data =
-        Data<AnimationData>(scenery_data->render_child);
-    animation_data->anim_table_object = scenery_data->anim_object;
-
-    // Everything starts off-screen.
-    scenery_data->state = kSceneryHide;
-
-    // Ensure all scenery starts hidden.
-    Show(scenery, false);
+// Queue updates for the hidden scenery whose XY position may be within
+// `radius` of `position`.
+void SceneryComponent::AddHiddenNear(const vec3& position, float radius) {
+  const int min_x = CellCoord(position.x - radius);
+  const int max_x = CellCoord(position.x + radius);
+  const int min_y = CellCoord(position.y - radius);
+  const int max_y = CellCoord(position.y + radius);
+  const int64_t num_cells = static_cast<int64_t>(max_x - min_x + 1) *
+                            static_cast<int64_t>(max_y - min_y + 1);
+  auto add_hidden = [this](std::vector<CellEntry>::const_iterator begin,
+                           std::vector<CellEntry>::const_iterator end) {
+    for (auto it = begin; it != end; ++it) {
+      if (!it->second.IsValid()) continue;
+      const SceneryData* scenery_data = GetComponentData(it->second);
+      if (scenery_data != nullptr && scenery_data->state == kSceneryHide) {
+        AddUpdate(it->second);
+      }
+    }
+  };
+  if (num_cells > kMaxCellsPerQuery) {
+    add_hidden(cells_.begin(), cells_.end());
+    return;
+  }
+  for (int x = min_x; x <= max_x; ++x) {
+    for (int y = min_y; y <= max_y; ++y) {
+      const CellEntry key(CellKey(x, y), corgi::EntityRef());
+      auto range = std::equal_range(cells_.begin(), cells_.end(), key,
+                                    CellLess);
+      add_hidden(range.first, range.second);
+    }
   }
 }
 
@@ -110,15 +214,31 @@ const RailDenizenData& SceneryComponent::Raft() const {
   return *rail_data;
 }
 
+void SceneryComponent::FitPopDistancesToFog() {
+  pop_scale_ = pop_distance_scale_;
+  const Camera* camera =
+      entity_manager_->GetComponent<ServicesComponent>()->camera();
+  if (camera == nullptr) return;
+  auto render_config = config_->rendering_config();
+  const float fog_distance =
+      RenderCuller::FogHiddenDistance(render_config, *camera);
+  // Both distances shrink together, so scenery still pops out farther away
+  // than it pops in.
+  const float pop_out_distance = render_config->pop_out_distance();
+  if (fog_distance > 0.0f && fog_distance < pop_out_distance * pop_scale_) {
+    pop_scale_ = fog_distance / pop_out_distance;
+  }
+}
+
 float SceneryComponent::PopInDistSq() const {
   auto render_config = config_->rendering_config();
-  const float dist = render_config->pop_in_distance();
+  const float dist = render_config->pop_in_distance() * pop_scale_;
   return dist * dist;
 }
 
 float SceneryComponent::PopOutDistSq() const {
   auto render_config = config_->rendering_config();
-  const float dist = render_config->pop_out_distance();
+  const float dist = render_config->pop_out_distance() * pop_scale_;
   return dist * dist;
 }
 
@@ -126,9 +246,8 @@ float SceneryComponent::DistSq(const corgi::EntityRef& scenery,
                                const RailDenizenData& raft) const {
   const SceneryData* scenery_data = Data<SceneryData>(scenery);
   const TransformData* transform_data = Data<TransformData>(scenery);
-  const float disappear_time = AnimLength(scenery_data, kSceneryDisappear);
   const vec3 pop_out_position =
-      raft.Position() + raft.Velocity() * static_cast<float>(disappear_time);
+      raft.Position() + raft.Velocity() * scenery_data->disappear_time;
   return (transform_data->position - pop_out_position).LengthSquared();
 }
 
@@ -227,6 +346,7 @@ void SceneryComponent::ShowAll(bool show) {
 void SceneryComponent::AnimateScenery(const corgi::EntityRef& scenery,
                                       SceneryData* scenery_data,
                                       SceneryState state) {
+  scenery_data->anim_paused = false;
   if (HasAnim(scenery_data, state)) {
     Animate(scenery, state);
   } else {
@@ -234,6 +354,29 @@ void SceneryComponent::AnimateScenery(const corgi::EntityRef& scenery,
   }
 }
 
+// Identical props showing together all play the same idle loop, and each
+// evaluates its own rig. Those that can't be seen don't need to, so their rig
+// is stopped until they can be, and then restarts its show animation. This is
+// checked every frame, even for throttled scenery, so a prop is animated again
+// as soon as it comes into view.
+void SceneryComponent::PauseIfUnseen(const corgi::EntityRef& scenery,
+                                     bool unseen) {
+  SceneryData* scenery_data = Data<SceneryData>(scenery);
+  if (scenery_data->state != kSceneryShow ||
+      scenery_data->anim_paused == unseen) {
+    return;
+  }
+  if (unseen) {
+    StopAnimating(scenery);
+    scenery_data->anim_paused = true;
+  } else {
+    AnimateScenery(scenery, scenery_data,
+                   scenery_data->show_override != kSceneryInvalid
+                       ? scenery_data->show_override
+                       : kSceneryShow);
+  }
+}
+
 void SceneryComponent::SetVisibilityOnOtherChildren(
     const corgi::EntityRef& scenery, bool visible) {
   const SceneryData* scenery_data = Data<SceneryData>(scenery);
@@ -347,23 +490,89 @@ void SceneryComponent::UpdateMovement(const corgi::EntityRef& scenery) {
   }
 }
 
-void SceneryComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
+// Only touches the scenery's own data, so scenery can be updated in parallel.
+// Anything that starts animations or changes visibility is left to
+// UpdateAllEntities().
+void SceneryComponent::UpdateEntity(const RailDenizenData& raft,
+                                    corgi::WorldTime delta_time,
+                                    EntityUpdate* update) {
+  const corgi::EntityRef& scenery = update->scenery;
+  SceneryData* scenery_data = Data<SceneryData>(scenery);
+
+  // Scenery that is out of view, or far from the raft, updates less often.
+  // Hidden scenery only needs to notice when the raft is close enough for it
+  // to appear, so it can go dormant.
+  const TransformData* transform_data = Data<TransformData>(scenery);
+  update->unseen = scenery_data->state == kSceneryShow &&
+                   (update_lod_.Unseen(transform_data->position) ||
+                    visibility_->Hidden(scenery));
+  const UpdateLodTier tier = update_lod_.Tier(
+      transform_data->position, scenery_data->state == kSceneryHide);
+  corgi::WorldTime scenery_delta_time = delta_time;
+  update->updated = update_lod_.ShouldUpdate(tier, &scenery_data->lod,
+                                             &scenery_delta_time);
+  if (!update->updated) return;
+
+  UpdateMovement(scenery);
+  update->next_state = NextState(scenery, raft);
+}
+
+void SceneryComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
   const RailDenizenData& raft = Raft();
-  for (auto iter = component_data_.begin(); iter != component_data_.end();
-       ++iter) {
-    corgi::EntityRef scenery = iter->entity;
-    const SceneryData* scenery_data = Data<SceneryData>(scenery);
+  update_lod_.AdvanceFrame(
+      raft.Position(),
+      entity_manager_->GetComponent<ServicesComponent>()->camera());
+  FitPopDistancesToFog();
+  visibility_ = &entity_manager_->GetComponent<ServicesComponent>()
+                     ->world()
+                     ->rail_visibility;
+
+  // Scenery that's showing, or on its way in or out, is always updated.
+  // Hidden scenery only needs to be when the raft is close enough that it
+  // may appear.
+  updates_.clear();
+  for (auto it = unhidden_.begin(); it != unhidden_.end(); ++it) {
+    if (it->IsValid() && GetComponentData(*it) != nullptr) AddUpdate(*it);
+  }
+  const float pop_in_distance =
+      config_->rendering_config()->pop_in_distance() * pop_scale_;
+  AddHiddenNear(raft.Position(),
+                pop_in_distance + raft.Velocity().Length() *
+                                      max_disappear_time_);
+
+  auto update_range = [this, &raft, delta_time](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      UpdateEntity(raft, delta_time, &updates_[i]);
+    }
+  };
+  JobSystem* job_system =
+      entity_manager_->GetComponent<ServicesComponent>()->job_system();
+  if (job_system != nullptr) {
+    job_system->ParallelFor(static_cast<int>(updates_.size()),
+                            kSceneryPerJob, update_range);
+  } else {
+    update_range(0, static_cast<int>(updates_.size()));
+  }
 
-    UpdateMovement(scenery);
+  for (auto it = updates_.begin(); it != updates_.end(); ++it) {
+    PauseIfUnseen(it->scenery, it->unseen);
+    if (!it->updated) continue;
+    SceneryData* scenery_data = Data<SceneryData>(it->scenery);
 
     if (scenery_data->move_state == kSceneryMoveFaceRaft) {
-      FaceRaft(scenery);
+      FaceRaft(it->scenery);
     }
 
     // Execute state machine for each piece of scenery.
-    const SceneryState next_state = NextState(scenery, raft);
-    if (scenery_data->state != next_state) {
-      TransitionState(scenery, next_state);
+    if (scenery_data->state != it->next_state) {
+      TransitionState(it->scenery, it->next_state);
+    }
+  }
+
+  unhidden_.clear();
+  for (auto it = updates_.begin(); it != updates_.end(); ++it) {
+    if (Data<SceneryData>(it->scenery)->state != kSceneryHide) {
+      unhidden_.push_back(it->scenery);
     }
   }
 }
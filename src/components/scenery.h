@@ -15,6 +15,9 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_SCENERY_H_
 #define FPL_ZOOSHI_COMPONENTS_SCENERY_H_
 
+#include <stdint.h>
+#include <utility>
+#include <vector>
 #include "components/rail_denizen.h"
 #include "config_generated.h"
 #include "corgi/component.h"
@@ -22,10 +25,13 @@
 #include "motive/math/angle.h"
 #include "motive/math/range.h"
 #include "motive/motivator.h"
+#include "update_lod.h"
 
 namespace fpl {
 namespace zooshi {
 
+class RailVisibility;
+
 enum SceneryState {
   kSceneryInvalid = -1,  // An invalid scenery state.
   kSceneryHide,          // Can be culled without visual glitches.
@@ -44,7 +50,9 @@ struct SceneryData {
   SceneryData()
     : state(kSceneryHide),
       move_state(kSceneryMoveStateStatic),
-      show_override(kSceneryInvalid) {}
+      show_override(kSceneryInvalid),
+      disappear_time(0.0f),
+      anim_paused(false) {}
 
   // The child of the scenery entity that has a RenderMeshComponent and
   // an AnimationComponent.
@@ -69,11 +77,26 @@ struct SceneryData {
   // the show state. The scenery override is reset when the scenery object
   // disappears.
   SceneryState show_override;
+
+  // The length of the disappear animation, cached by PostLoadFixup().
+  float disappear_time;
+
+  // True while the scenery is showing but unseen, so its rig isn't animated.
+  bool anim_paused;
+
+  // How often the scenery is updated. See UpdateLod.
+  UpdateLodState lod;
 };
 
 class SceneryComponent : public corgi::Component<SceneryData> {
  public:
-  SceneryComponent() {}
+  SceneryComponent()
+      : config_(nullptr),
+        cell_size_(1.0f),
+        max_disappear_time_(0.0f),
+        pop_scale_(1.0f),
+        pop_distance_scale_(1.0f),
+        visibility_(nullptr) {}
   virtual ~SceneryComponent() {}
 
   virtual void Init();
@@ -85,13 +108,32 @@ class SceneryComponent : public corgi::Component<SceneryData> {
   // This needs to be called after the entities have been loaded from data.
   void PostLoadFixup();
 
+  // Like PostLoadFixup(), for `entities` loaded after the rest, such as a
+  // level sector. The other scenery is left as it is.
+  void PostLoadFixup(const std::vector<corgi::EntityRef>& entities);
+
   // Apply an override animation to an entity that only applies in the `Show`
   // state.
   void ApplyShowOverride(const corgi::EntityRef& scenery,
                          SceneryState show_override);
 
+  // Scale the configured pop in and out distances, to trade how far ahead
+  // scenery appears for how much of it there is to update and draw.
+  void set_pop_distance_scale(float scale) { pop_distance_scale_ = scale; }
+
  private:
+  // A piece of scenery to update this frame, and the results of the part of
+  // its update that can run in parallel.
+  struct EntityUpdate {
+    corgi::EntityRef scenery;
+    bool updated;
+    bool unseen;
+    SceneryState next_state;
+  };
+
+  void FixupScenery(const corgi::EntityRef& scenery);
   const RailDenizenData& Raft() const;
+  void FitPopDistancesToFog();
   float PopInDistSq() const;
   float PopOutDistSq() const;
   float DistSq(const corgi::EntityRef& scenery,
@@ -109,12 +151,46 @@ class SceneryComponent : public corgi::Component<SceneryData> {
                        SceneryState next_state);
   void AnimateScenery(const corgi::EntityRef& scenery,
                       SceneryData* scenery_data, SceneryState state);
+  void PauseIfUnseen(const corgi::EntityRef& scenery, bool unseen);
   void SetVisibilityOnOtherChildren(const corgi::EntityRef& scenery,
                                     bool visible);
   void FaceRaft(const corgi::EntityRef& scenery);
   void UpdateMovement(const corgi::EntityRef& scenery);
+  void UpdateEntity(const RailDenizenData& raft, corgi::WorldTime delta_time,
+                    EntityUpdate* update);
+  void AddUpdate(const corgi::EntityRef& scenery);
+  void BuildGrid();
+  void AddHiddenNear(const mathfu::vec3& position, float radius);
+  int CellCoord(float x) const;
+  static uint64_t CellKey(int x, int y);
 
   const Config* config_;
+
+  // Throttles updates of scenery that can't be seen.
+  UpdateLod update_lod_;
+
+  std::vector<EntityUpdate> updates_;
+
+  // The scenery, bucketed by position into a grid in the XY plane, and sorted
+  // by cell. Scenery doesn't move, so this is built once it's loaded, and
+  // each update only looks at the hidden scenery near the raft. Scenery
+  // that's been unloaded since is skipped until it's rebuilt.
+  typedef std::pair<uint64_t, corgi::EntityRef> CellEntry;
+  std::vector<CellEntry> cells_;
+  float cell_size_;
+  // The longest disappear animation, which limits how far ahead of the raft
+  // its position is predicted.
+  float max_disappear_time_;
+  // Scales the pop in and out distances, so scenery doesn't appear or
+  // disappear where fully saturated fog already hides it.
+  float pop_scale_;
+  float pop_distance_scale_;
+
+  // What can be seen from where the raft is, for the update in progress.
+  const RailVisibility* visibility_;
+
+  // Scenery that isn't hidden, which is updated every frame.
+  std::vector<corgi::EntityRef> unhidden_;
 };
 
 }  // zooshi
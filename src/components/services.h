@@ -15,15 +15,19 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_SERVICES_H_
 #define FPL_ZOOSHI_COMPONENTS_SERVICES_H_
 
+#include "audio_thread.h"
 #include "camera.h"
 #include "components_generated.h"
 #include "config_generated.h"
 #include "corgi/component.h"
+#include "components/entity_pool.h"
 #include "corgi_component_library/entity_factory.h"
 #include "flatui/font_manager.h"
 #include "fplbase/asset_manager.h"
 #include "fplbase/input.h"
 #include "fplbase/utilities.h"
+#include "graph_event_queue.h"
+#include "job_system.h"
 #include "motive/engine.h"
 #include "pindrop/pindrop.h"
 #include "railmanager.h"
@@ -65,6 +69,10 @@ class ServicesComponent : public corgi::Component<ServicesData> {
     scene_lab_ = scene_lab;
     // The camera is set seperately dependent on the game state.
     camera_ = nullptr;
+    job_system_ = nullptr;
+    audio_thread_ = nullptr;
+    entity_pool_ = nullptr;
+    graph_events_ = nullptr;
   }
 
   const Config* config() { return config_; }
@@ -85,6 +93,26 @@ class ServicesComponent : public corgi::Component<ServicesData> {
   scene_lab::SceneLab* scene_lab() { return scene_lab_; }
   void set_camera(Camera* camera) { camera_ = camera; }
   Camera* camera() { return camera_; }
+  // May be null, in which case updates should run serially.
+  void set_job_system(JobSystem* job_system) { job_system_ = job_system; }
+  JobSystem* job_system() { return job_system_; }
+  // Where the components send their plays, stops and moves, rather than
+  // calling audio_engine() from the update thread.
+  void set_audio_thread(AudioThread* audio_thread) {
+    audio_thread_ = audio_thread;
+  }
+  AudioThread* audio_thread() { return audio_thread_; }
+  // Reuses transient entities, such as projectiles, rather than creating them
+  // from their prototypes each time.
+  void set_entity_pool(EntityPoolComponent* entity_pool) {
+    entity_pool_ = entity_pool;
+  }
+  EntityPoolComponent* entity_pool() { return entity_pool_; }
+  // Events for graphs that are broadcast once every component has updated.
+  void set_graph_events(GraphEventQueue* graph_events) {
+    graph_events_ = graph_events;
+  }
+  GraphEventQueue* graph_events() { return graph_events_; }
 
   const void* component_def_binary_schema() const {
     if (component_def_binary_schema_ == "") {
@@ -122,6 +150,10 @@ class ServicesComponent : public corgi::Component<ServicesData> {
   World* world_;
   scene_lab::SceneLab* scene_lab_;
   Camera* camera_;
+  JobSystem* job_system_;
+  AudioThread* audio_thread_;
+  EntityPoolComponent* entity_pool_;
+  GraphEventQueue* graph_events_;
 };
 
 }  // zooshi
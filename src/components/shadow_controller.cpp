@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "components/shadow_controller.h"
+#include "components/export_builder.h"
 #include "corgi_component_library/transform.h"
 #include "fplbase/utilities.h"
 
@@ -38,6 +39,11 @@ void ShadowControllerComponent::AddFromRawData(corgi::EntityRef& entity,
 }
 
 void ShadowControllerComponent::UpdateAllEntities(
+    corgi::WorldTime delta_time) {
+  UpdateOrDefer(delta_time);
+}
+
+void ShadowControllerComponent::ScheduledUpdate(
     corgi::WorldTime /*delta_time*/) {
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
@@ -59,10 +65,17 @@ void ShadowControllerComponent::UpdateAllEntities(
 
     TransformData* parent_transform_data =
         Data<TransformData>(shadow_data->shadow_caster);
+    const mathfu::vec2 caster_position(parent_transform_data->position.x,
+                                       parent_transform_data->position.y);
+    if (shadow_data->placed &&
+        caster_position.x == shadow_data->caster_position.x &&
+        caster_position.y == shadow_data->caster_position.y) {
+      continue;
+    }
+    shadow_data->caster_position = caster_position;
+    shadow_data->placed = true;
 
-    transform_data->position =
-        mathfu::vec3(parent_transform_data->position.x,
-                     parent_transform_data->position.y, kShadowHeight);
+    transform_data->position = mathfu::vec3(caster_position, kShadowHeight);
   }
 }
 
@@ -70,9 +83,10 @@ corgi::ComponentInterface::RawDataUniquePtr
 ShadowControllerComponent::ExportRawData(const corgi::EntityRef& entity) const {
   if (GetComponentData(entity) == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
   fbb.Finish(CreateShadowControllerDef(fbb));
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 }  // zooshi
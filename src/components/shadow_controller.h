@@ -15,6 +15,7 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_SHADOWCONTROLLER_H_
 #define FPL_ZOOSHI_COMPONENTS_SHADOWCONTROLLER_H_
 
+#include "component_scheduler.h"
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "mathfu/constants.h"
@@ -26,17 +27,29 @@ namespace zooshi {
 
 // Data for scene object components.
 struct ShadowControllerData {
+  ShadowControllerData() : placed(false) {}
+
   corgi::EntityRef shadow_caster;
+  // Where the caster was when the shadow was last placed beneath it, so
+  // shadows of casters that haven't moved are left alone.
+  mathfu::vec2 caster_position;
+  bool placed;
 };
 
+// Keeps a blob shadow entity on the ground beneath the entity that was its
+// parent. The shadows are ordinary render meshes. None of the shipped
+// entity data uses this; the game's shadows come from WorldRenderer's
+// shadow map.
 class ShadowControllerComponent
-    : public corgi::Component<ShadowControllerData> {
+    : public corgi::Component<ShadowControllerData>,
+      public ScheduledComponent {
  public:
   virtual ~ShadowControllerComponent() {}
 
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
   virtual RawDataUniquePtr ExportRawData(const corgi::EntityRef& entity) const;
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+  virtual void ScheduledUpdate(corgi::WorldTime delta_time);
 };
 
 }  // zooshi
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "components/simple_movement.h"
+#include "components/export_builder.h"
 #include "corgi_component_library/transform.h"
 #include "fplbase/flatbuffer_utils.h"
 #include "fplbase/utilities.h"
@@ -49,12 +50,13 @@ SimpleMovementComponent::ExportRawData(const corgi::EntityRef& entity) const {
   const SimpleMovementData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
   fplbase::Vec3 velocity(data->velocity.x, data->velocity.y,
                          data->velocity.z);
 
   fbb.Finish(CreateSimpleMovementDef(fbb, &velocity));
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 void SimpleMovementComponent::InitEntity(corgi::EntityRef& entity) {
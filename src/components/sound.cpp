@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "components/sound.h"
+
+#include <algorithm>
+#include "components/audio_listener.h"
 #include "components/services.h"
 #include "corgi_component_library/transform.h"
 #include "pindrop/pindrop.h"
@@ -33,26 +36,104 @@ using corgi::component_library::TransformComponent;
 using corgi::component_library::TransformData;
 
 void SoundComponent::Init() {
-  audio_engine_ =
-      entity_manager_->GetComponent<ServicesComponent>()->audio_engine();
+  ServicesComponent* services =
+      entity_manager_->GetComponent<ServicesComponent>();
+  audio_engine_ = services->audio_engine();
+  audio_thread_ = services->audio_thread();
+}
+
+bool SoundComponent::ListenerPosition(mathfu::vec3* position) const {
+  AudioListenerComponent* listeners =
+      entity_manager_->GetComponent<AudioListenerComponent>();
+  if (listeners == nullptr || listeners->begin() == listeners->end()) {
+    return false;
+  }
+  *position = entity_manager_->GetComponent<TransformComponent>()
+                  ->WorldTransform(listeners->begin()->entity)
+                  .TranslationVector3D();
+  return true;
+}
+
+void SoundComponent::StopVoice(SoundData* sound_data) {
+  audio_thread_->Stop(sound_data->voice);
+  sound_data->voice = 0;
 }
 
 void SoundComponent::UpdateAllEntities(corgi::WorldTime /*delta_time*/) {
+  mathfu::vec3 listener_position;
+  const bool has_listener = ListenerPosition(&listener_position);
+
+  voices_.clear();
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
     SoundData* sound_data = Data<SoundData>(iter->entity);
-    if (sound_data->channel.Valid()) {
-      TransformData* transform_data = Data<TransformData>(iter->entity);
-      sound_data->channel.SetLocation(transform_data->position);
+    TransformData* transform_data = Data<TransformData>(iter->entity);
+    // Free the voices of sounds that have finished.
+    if (sound_data->voice != 0 && !audio_thread_->Playing(sound_data->voice)) {
+      StopVoice(sound_data);
+    }
+    if (sound_data->audible_distance_sq <= 0.0f) {
+      audio_thread_->SetLocation(sound_data->voice, transform_data->position);
+      continue;
+    }
+    if (!sound_data->playing) continue;
+
+    // Out of range sounds are silent anyway, so they give up their voice.
+    const float distance_sq =
+        has_listener
+            ? (transform_data->position - listener_position).LengthSquared()
+            : 0.0f;
+    if (distance_sq > sound_data->audible_distance_sq) {
+      StopVoice(sound_data);
+      continue;
     }
+    Voice voice;
+    voice.importance = sound_data->priority / (1.0f + distance_sq);
+    voice.entity = iter->entity;
+    voices_.push_back(voice);
   }
-}
 
-void SoundComponent::CleanupEntity(corgi::EntityRef& entity) {
-  SoundData* sound_data = Data<SoundData>(entity);
-  if (sound_data->channel.Valid()) {
-    sound_data->channel.Stop();
+  // Keep the most important voices, and stop the rest.
+  const size_t max_voices = static_cast<size_t>(std::max(max_voices_, 0));
+  if (voices_.size() > max_voices) {
+    std::nth_element(voices_.begin(), voices_.begin() + max_voices,
+                     voices_.end());
+    for (size_t i = max_voices; i < voices_.size(); ++i) {
+      StopVoice(Data<SoundData>(voices_[i].entity));
+    }
+    voices_.resize(max_voices);
   }
+  for (auto it = voices_.begin(); it != voices_.end(); ++it) {
+    SoundData* sound_data = Data<SoundData>(it->entity);
+    TransformData* transform_data = Data<TransformData>(it->entity);
+    if (sound_data->voice != 0) {
+      audio_thread_->SetLocation(sound_data->voice, transform_data->position);
+    } else {
+      sound_data->voice = audio_thread_->PlaySound(sound_data->sound,
+                                                   transform_data->position);
+    }
+  }
+}
+
+void SoundComponent::CleanupEntity(corgi::EntityRef& entity) { Stop(entity); }
+
+void SoundComponent::Play(const corgi::EntityRef& entity) {
+  SoundData* sound_data = GetComponentData(entity);
+  if (sound_data == nullptr) return;
+  Stop(entity);
+  sound_data->playing = true;
+  // Managed sounds start when they next get a voice.
+  if (sound_data->audible_distance_sq > 0.0f) return;
+  TransformData* transform_data = Data<TransformData>(entity);
+  sound_data->voice =
+      audio_thread_->PlaySound(sound_data->sound, transform_data->position);
+}
+
+void SoundComponent::Stop(const corgi::EntityRef& entity) {
+  SoundData* sound_data = GetComponentData(entity);
+  if (sound_data == nullptr) return;
+  sound_data->playing = false;
+  StopVoice(sound_data);
 }
 
 void SoundComponent::AddFromRawData(corgi::EntityRef& entity,
@@ -63,8 +144,15 @@ void SoundComponent::AddFromRawData(corgi::EntityRef& entity,
   entity_manager_->AddEntityToComponent<TransformComponent>(entity);
 
   TransformData* transform_data = Data<TransformData>(entity);
-  sound_data->channel = audio_engine_->PlaySound(sound_def->sound()->c_str(),
-                                                 transform_data->position);
+  sound_data->sound =
+      audio_engine_->GetSoundHandle(sound_def->sound()->c_str());
+  sound_data->audible_distance_sq =
+      sound_def->audible_distance() * sound_def->audible_distance();
+  sound_data->priority = sound_def->priority();
+  sound_data->playing = true;
+  if (sound_data->audible_distance_sq > 0.0f) return;
+  sound_data->voice =
+      audio_thread_->PlaySound(sound_data->sound, transform_data->position);
 }
 
 }  // zooshi
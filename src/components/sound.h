@@ -15,6 +15,8 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_SOUND_H_
 #define FPL_ZOOSHI_COMPONENTS_SOUND_H_
 
+#include <vector>
+#include "audio_thread.h"
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "corgi/entity_manager.h"
@@ -25,11 +27,30 @@ namespace zooshi {
 
 // Data for scene object components.
 struct SoundData {
-  pindrop::Channel channel;
+  SoundData()
+      : voice(0), audible_distance_sq(0.0f), priority(1.0f), playing(false) {}
+
+  pindrop::SoundHandle sound;
+  AudioVoice voice;
+  // Zero if the sound always plays, rather than by distance.
+  float audible_distance_sq;
+  float priority;
+  // Whether the sound should be heard when in range. Its voice is only set
+  // while it has one.
+  bool playing;
 };
 
+// Plays each entity's sound at its position.
+//
+// Sounds with an audible distance are managed: only the most important
+// in range of the listener are given voices, up to max_voices(). The others
+// are stopped, and cost nothing to mix or update until they get a voice
+// back.
+
 class SoundComponent : public corgi::Component<SoundData> {
  public:
+  SoundComponent()
+      : audio_engine_(nullptr), audio_thread_(nullptr), max_voices_(16) {}
   virtual ~SoundComponent() {}
 
   virtual void Init();
@@ -38,8 +59,32 @@ class SoundComponent : public corgi::Component<SoundData> {
   virtual void CleanupEntity(corgi::EntityRef& entity);
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
 
+  // Play an entity's sound again from the start, or stop it, for entities
+  // that are reused.
+  void Play(const corgi::EntityRef& entity);
+  void Stop(const corgi::EntityRef& entity);
+
+  void set_max_voices(int max_voices) { max_voices_ = max_voices; }
+  int max_voices() const { return max_voices_; }
+
  private:
+  struct Voice {
+    float importance;
+    corgi::EntityRef entity;
+    bool operator<(const Voice& other) const {
+      return importance > other.importance;
+    }
+  };
+
+  bool ListenerPosition(mathfu::vec3* position) const;
+  // Stop the sound's voice, and clear it.
+  void StopVoice(SoundData* sound_data);
+
   pindrop::AudioEngine* audio_engine_;
+  AudioThread* audio_thread_;
+  int max_voices_;
+  // The managed sounds in range this frame. Kept to avoid reallocating.
+  std::vector<Voice> voices_;
 };
 
 }  // zooshi
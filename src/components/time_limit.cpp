@@ -13,6 +13,10 @@
 // limitations under the License.
 
 #include "components/time_limit.h"
+
+#include <algorithm>
+#include "components/export_builder.h"
+#include "components/services.h"
 #include "corgi_component_library/transform.h"
 #include "fplbase/utilities.h"
 
@@ -33,28 +37,88 @@ void TimeLimitComponent::AddFromRawData(corgi::EntityRef& entity,
   // Time limit is specified in seconds in the data files.
   time_limit_data->time_limit =
       static_cast<corgi::WorldTime>(time_limit_def->timelimit() * 1000);
+  if (time_limit_data->enabled) Start(entity, time_limit_data);
 }
 
 void TimeLimitComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
-  for (auto iter = component_data_.begin(); iter != component_data_.end();
-       ++iter) {
-    TimeLimitData* time_limit_data = Data<TimeLimitData>(iter->entity);
-    time_limit_data->time_elapsed += delta_time;
-    if (time_limit_data->time_elapsed >=
-        time_limit_data->time_limit - kShrinkTime) {
-      corgi::component_library::TransformData* transform_data =
-          Data<corgi::component_library::TransformData>(iter->entity);
-      if (transform_data) {
-        float scale_factor =
-            (time_limit_data->time_limit - time_limit_data->time_elapsed) /
-            static_cast<float>(kShrinkTime);
-        transform_data->scale = time_limit_data->original_scale * scale_factor;
-      }
+  UpdateOrDefer(delta_time);
+}
+
+void TimeLimitComponent::ScheduledUpdate(corgi::WorldTime delta_time) {
+  time_ += delta_time;
+
+  // Move the entities whose time has come to start shrinking.
+  while (!waiting_.empty() && waiting_.front().time <= time_) {
+    std::pop_heap(waiting_.begin(), waiting_.end(), Later);
+    if (Current(waiting_.back()) != nullptr) {
+      shrinking_.push_back(waiting_.back());
     }
-    if (time_limit_data->time_elapsed >= time_limit_data->time_limit) {
-      entity_manager_->DeleteEntity(iter->entity);
+    waiting_.pop_back();
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < shrinking_.size(); ++i) {
+    const Entry& entry = shrinking_[i];
+    TimeLimitData* time_limit_data = Current(entry);
+    if (time_limit_data == nullptr) continue;
+
+    const corgi::WorldTime time_elapsed = time_ - time_limit_data->start_time;
+    corgi::component_library::TransformData* transform_data =
+        Data<corgi::component_library::TransformData>(entry.entity);
+    if (transform_data) {
+      float scale_factor =
+          (time_limit_data->time_limit - time_elapsed) /
+          static_cast<float>(kShrinkTime);
+      transform_data->scale = time_limit_data->original_scale * scale_factor;
     }
+    if (time_elapsed >= time_limit_data->time_limit) {
+      // Pooled entities are reused, and others deleted.
+      entity_manager_->GetComponent<ServicesComponent>()
+          ->entity_pool()
+          ->Release(entry.entity);
+      continue;
+    }
+    shrinking_[kept++] = entry;
+  }
+  shrinking_.resize(kept);
+}
+
+void TimeLimitComponent::Start(const corgi::EntityRef& entity,
+                               TimeLimitData* data) {
+  data->generation++;
+  data->start_time = time_;
+  Entry entry;
+  entry.time = time_ + data->time_limit - kShrinkTime;
+  entry.entity = entity;
+  entry.generation = data->generation;
+  waiting_.push_back(entry);
+  std::push_heap(waiting_.begin(), waiting_.end(), Later);
+}
+
+TimeLimitData* TimeLimitComponent::Current(const Entry& entry) {
+  if (!entry.entity.IsValid()) return nullptr;
+  TimeLimitData* data = GetComponentData(entry.entity);
+  if (data == nullptr || !data->enabled ||
+      data->generation != entry.generation) {
+    return nullptr;
   }
+  return data;
+}
+
+void TimeLimitComponent::Restart(const corgi::EntityRef& entity,
+                                 bool enabled) {
+  TimeLimitData* time_limit_data = GetComponentData(entity);
+  if (time_limit_data == nullptr) return;
+  time_limit_data->enabled = enabled;
+  if (enabled) {
+    Start(entity, time_limit_data);
+  } else {
+    // Forget its place in the heap, until it's restarted.
+    time_limit_data->generation++;
+  }
+  corgi::component_library::TransformData* transform_data =
+      Data<corgi::component_library::TransformData>(entity);
+  if (transform_data) transform_data->scale = time_limit_data->original_scale;
 }
 
 corgi::ComponentInterface::RawDataUniquePtr TimeLimitComponent::ExportRawData(
@@ -62,10 +126,11 @@ corgi::ComponentInterface::RawDataUniquePtr TimeLimitComponent::ExportRawData(
   const TimeLimitData* data = GetComponentData(entity);
   if (data == nullptr) return nullptr;
 
-  flatbuffers::FlatBufferBuilder fbb;
+  ExportBuilder export_builder;
+  flatbuffers::FlatBufferBuilder& fbb = export_builder.fbb();
 
   fbb.Finish(CreateTimeLimitDef(fbb, static_cast<float>(data->time_limit)));
-  return fbb.ReleaseBufferPointer();
+  return export_builder.Release();
 }
 
 void TimeLimitComponent::InitEntity(corgi::EntityRef& entity) {
@@ -75,6 +140,7 @@ void TimeLimitComponent::InitEntity(corgi::EntityRef& entity) {
   if (transform_data) {
     time_limit_data->original_scale = transform_data->scale;
   }
+  Start(entity, time_limit_data);
 }
 
 }  // zooshi
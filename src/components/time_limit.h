@@ -15,6 +15,9 @@
 #ifndef FPL_ZOOSHI_COMPONENTS_TIMELIMIT_H_
 #define FPL_ZOOSHI_COMPONENTS_TIMELIMIT_H_
 
+#include <stdint.h>
+#include <vector>
+#include "component_scheduler.h"
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "mathfu/constants.h"
@@ -25,18 +28,30 @@ namespace fpl {
 namespace zooshi {
 
 struct TimeLimitData {
-  TimeLimitData() : time_elapsed(0), time_limit(0) {}
-  corgi::WorldTime time_elapsed;
+  TimeLimitData()
+      : start_time(0), time_limit(0), generation(0), enabled(true) {}
+  // When the time limit started, on TimeLimitComponent's clock.
+  corgi::WorldTime start_time;
   corgi::WorldTime time_limit;
   mathfu::vec3 original_scale;
+  // Incremented whenever the time limit is restarted, so entries for its
+  // earlier starts can be told apart and ignored.
+  uint32_t generation;
+  // While false, the time limit doesn't count down.
+  bool enabled;
 };
 
 // Component for limiting how long things stay in the world.  If they have
 // a transform component, they'll scale away to nothing.  Otherwise, they'll
 // just be removed when their time is up.
-class TimeLimitComponent : public corgi::Component<TimeLimitData> {
+//
+// Entities wait in a min-heap keyed by when they start to shrink, so each
+// update only touches the entities that are shrinking, rather than every
+// entity with a time limit.
+class TimeLimitComponent : public corgi::Component<TimeLimitData>,
+                           public ScheduledComponent {
  public:
-  TimeLimitComponent() {}
+  TimeLimitComponent() : time_(0) {}
   virtual ~TimeLimitComponent() {}
 
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
@@ -44,6 +59,33 @@ class TimeLimitComponent : public corgi::Component<TimeLimitData> {
 
   virtual void InitEntity(corgi::EntityRef& entity);
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
+  virtual void ScheduledUpdate(corgi::WorldTime delta_time);
+
+  // Reset an entity's time limit and scale, for an entity that's being
+  // reused. If `enabled` is false, the limit is paused until restarted.
+  void Restart(const corgi::EntityRef& entity, bool enabled);
+
+ private:
+  // An entity's time limit, from the start identified by `generation`.
+  struct Entry {
+    corgi::WorldTime time;
+    corgi::EntityRef entity;
+    uint32_t generation;
+  };
+
+  static bool Later(const Entry& a, const Entry& b) { return a.time > b.time; }
+
+  // Start the entity's time limit from now.
+  void Start(const corgi::EntityRef& entity, TimeLimitData* data);
+  // The entry's entity, if it hasn't been restarted or paused since.
+  TimeLimitData* Current(const Entry& entry);
+
+  // The time that's passed in updates.
+  corgi::WorldTime time_;
+  // Entities that haven't started shrinking, keyed by when they will.
+  std::vector<Entry> waiting_;
+  // Entities that are shrinking, or are about to be removed.
+  std::vector<Entry> shrinking_;
 };
 
 }  // zooshi
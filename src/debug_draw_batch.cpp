@@ -0,0 +1,169 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "debug_draw_batch.h"
+
+#include <stddef.h>
+#include <algorithm>
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+#include "mathfu/utilities.h"
+#include "profiler.h"
+
+using fplbase::LogError;
+using mathfu::vec3;
+
+namespace fpl {
+namespace zooshi {
+
+static const char* kDebugDrawShaderName = "shaders/debug_draw";
+// How long the line drawn along a contact's normal is, in world units.
+static const float kContactNormalLength = 0.5f;
+
+static vec3 ToVec3(const btVector3& v) { return vec3(v.x(), v.y(), v.z()); }
+
+DebugDrawBatch::DebugDrawBatch()
+    : shader_(nullptr),
+      debug_mode_(btIDebugDraw::DBG_DrawWireframe),
+      camera_position_(mathfu::kZeros3f),
+      camera_facing_(mathfu::kAxisY3f),
+      max_distance_(0.0f),
+      vertex_buffer_(0) {}
+
+DebugDrawBatch::~DebugDrawBatch() {
+  if (vertex_buffer_ != 0) GL_CALL(glDeleteBuffers(1, &vertex_buffer_));
+}
+
+void DebugDrawBatch::Initialize(fplbase::AssetManager* asset_manager) {
+  shader_ = asset_manager->FindShader(kDebugDrawShaderName);
+}
+
+void DebugDrawBatch::Begin(const corgi::CameraInterface& camera,
+                           float max_distance) {
+  lines_.clear();
+  triangles_.clear();
+  camera_position_ = camera.position();
+  camera_facing_ = camera.facing();
+  max_distance_ = max_distance;
+}
+
+bool DebugDrawBatch::MayBeSeen(const vec3& center, float radius) const {
+  const vec3 to_center = center - camera_position_;
+  if (max_distance_ > 0.0f &&
+      to_center.LengthSquared() >
+          (max_distance_ + radius) * (max_distance_ + radius)) {
+    return false;
+  }
+  return vec3::DotProduct(to_center, camera_facing_) >= -radius;
+}
+
+void DebugDrawBatch::AddVertex(const btVector3& position,
+                               const btVector3& color, float alpha,
+                               std::vector<Vertex>* vertices) {
+  Vertex vertex;
+  vertex.position[0] = position.x();
+  vertex.position[1] = position.y();
+  vertex.position[2] = position.z();
+  const float channels[] = {color.x(), color.y(), color.z(), alpha};
+  for (int i = 0; i < 4; ++i) {
+    vertex.color[i] = static_cast<uint8_t>(
+        mathfu::Clamp(channels[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+  }
+  vertices->push_back(vertex);
+}
+
+void DebugDrawBatch::drawLine(const btVector3& from, const btVector3& to,
+                              const btVector3& color) {
+  const vec3 a = ToVec3(from);
+  const vec3 b = ToVec3(to);
+  if (!MayBeSeen((a + b) * 0.5f, (b - a).Length() * 0.5f)) return;
+  AddVertex(from, color, 1.0f, &lines_);
+  AddVertex(to, color, 1.0f, &lines_);
+}
+
+void DebugDrawBatch::drawTriangle(const btVector3& v0, const btVector3& v1,
+                                  const btVector3& v2, const btVector3& color,
+                                  btScalar alpha) {
+  const vec3 a = ToVec3(v0);
+  const vec3 b = ToVec3(v1);
+  const vec3 c = ToVec3(v2);
+  const vec3 center = (a + b + c) / 3.0f;
+  const float radius = sqrtf(std::max(
+      std::max((a - center).LengthSquared(), (b - center).LengthSquared()),
+      (c - center).LengthSquared()));
+  if (!MayBeSeen(center, radius)) return;
+  AddVertex(v0, color, alpha, &triangles_);
+  AddVertex(v1, color, alpha, &triangles_);
+  AddVertex(v2, color, alpha, &triangles_);
+}
+
+void DebugDrawBatch::drawContactPoint(const btVector3& point,
+                                      const btVector3& normal,
+                                      btScalar /*distance*/,
+                                      int /*life_time*/,
+                                      const btVector3& color) {
+  drawLine(point, point + normal * kContactNormalLength, color);
+}
+
+void DebugDrawBatch::reportErrorWarning(const char* warning) {
+  LogError("Bullet: %s", warning);
+}
+
+void DebugDrawBatch::Render(const corgi::CameraInterface& camera,
+                            fplbase::Renderer& renderer) {
+  if (shader_ == nullptr || (lines_.empty() && triangles_.empty())) return;
+  ProfileScope scope("DebugDrawPhysics");
+  if (vertex_buffer_ == 0) GL_CALL(glGenBuffers(1, &vertex_buffer_));
+
+  // The lines go first in the buffer, then the triangles.
+  const size_t num_lines = lines_.size();
+  lines_.insert(lines_.end(), triangles_.begin(), triangles_.end());
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, lines_.size() * sizeof(Vertex),
+                       lines_.data(), GL_STREAM_DRAW));
+
+  renderer.set_model_view_projection(camera.GetTransformMatrix());
+  renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+  renderer.SetCulling(fplbase::kCullingModeNone);
+  shader_->Set(renderer);
+
+  const GLuint position = fplbase::Mesh::kAttributePosition;
+  const GLuint color = fplbase::Mesh::kAttributeColor;
+  GL_CALL(glEnableVertexAttribArray(position));
+  GL_CALL(glEnableVertexAttribArray(color));
+  GL_CALL(glVertexAttribPointer(
+      position, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      reinterpret_cast<const void*>(offsetof(Vertex, position))));
+  GL_CALL(glVertexAttribPointer(
+      color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+      reinterpret_cast<const void*>(offsetof(Vertex, color))));
+  if (num_lines > 0) {
+    GL_CALL(glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(num_lines)));
+  }
+  if (lines_.size() > num_lines) {
+    GL_CALL(glDrawArrays(GL_TRIANGLES, static_cast<GLint>(num_lines),
+                         static_cast<GLsizei>(lines_.size() - num_lines)));
+  }
+  GL_CALL(glDisableVertexAttribArray(position));
+  GL_CALL(glDisableVertexAttribArray(color));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+  renderer.SetCulling(fplbase::kCullingModeBack);
+  renderer.SetBlendMode(fplbase::kBlendModeOff);
+  lines_.resize(num_lines);
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,88 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_DEBUG_DRAW_BATCH_H_
+#define ZOOSHI_DEBUG_DRAW_BATCH_H_
+
+#include <stdint.h>
+#include <vector>
+#include "LinearMath/btIDebugDraw.h"
+#include "corgi_component_library/camera_interface.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A Bullet debug drawer that collects the lines and triangles of the physics
+// world, rather than drawing each as it's given, and draws them all at once.
+// Anything too far from the camera to be seen, or behind it, is dropped as
+// it's collected.
+class DebugDrawBatch : public btIDebugDraw {
+ public:
+  DebugDrawBatch();
+  virtual ~DebugDrawBatch();
+
+  void Initialize(fplbase::AssetManager* asset_manager);
+
+  // Drop what was collected, and collect for `camera` from now on, dropping
+  // anything more than `max_distance` from it.
+  void Begin(const corgi::CameraInterface& camera, float max_distance);
+
+  // Draw what was collected since Begin(), with a draw for the lines and one
+  // for the triangles. Call on the render thread.
+  void Render(const corgi::CameraInterface& camera,
+              fplbase::Renderer& renderer);
+
+  virtual void drawLine(const btVector3& from, const btVector3& to,
+                        const btVector3& color);
+  virtual void drawTriangle(const btVector3& v0, const btVector3& v1,
+                            const btVector3& v2, const btVector3& color,
+                            btScalar alpha);
+  virtual void drawContactPoint(const btVector3& point,
+                                const btVector3& normal, btScalar distance,
+                                int life_time, const btVector3& color);
+  virtual void reportErrorWarning(const char* warning);
+  virtual void draw3dText(const btVector3& /*location*/,
+                          const char* /*text*/) {}
+  virtual void setDebugMode(int debug_mode) { debug_mode_ = debug_mode; }
+  virtual int getDebugMode() const { return debug_mode_; }
+
+ private:
+  struct Vertex {
+    float position[3];
+    uint8_t color[4];
+  };
+
+  // False if a shape within `radius` of `center` can't be seen.
+  bool MayBeSeen(const mathfu::vec3& center, float radius) const;
+  void AddVertex(const btVector3& position, const btVector3& color,
+                 float alpha, std::vector<Vertex>* vertices);
+
+  fplbase::Shader* shader_;
+  int debug_mode_;
+  mathfu::vec3 camera_position_;
+  mathfu::vec3 camera_facing_;
+  float max_distance_;
+  std::vector<Vertex> lines_;
+  std::vector<Vertex> triangles_;
+  GLuint vertex_buffer_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_DEBUG_DRAW_BATCH_H_
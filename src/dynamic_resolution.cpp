@@ -0,0 +1,82 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+
+namespace fpl {
+namespace zooshi {
+
+DynamicResolution::DynamicResolution()
+    : enabled_(false),
+      min_scale_(1.0f),
+      max_scale_(1.0f),
+      scale_step_(0.1f),
+      scale_down_fraction_(0.9f),
+      scale_up_fraction_(0.7f),
+      smoothing_(0.1f),
+      cooldown_frames_(30),
+      scale_(1.0f),
+      smoothed_ms_(0.0f),
+      frames_since_change_(0) {}
+
+void DynamicResolution::Initialize(const DynamicResolutionConfig* config) {
+  enabled_ = config != nullptr && config->enabled();
+  scale_ = 1.0f;
+  smoothed_ms_ = 0.0f;
+  frames_since_change_ = 0;
+  if (!enabled_) return;
+
+  min_scale_ = std::min(std::max(config->min_scale(), 0.1f), 1.0f);
+  max_scale_ = std::min(std::max(config->max_scale(), min_scale_), 1.0f);
+  scale_step_ = std::max(config->scale_step(), 0.01f);
+  scale_down_fraction_ = config->scale_down_fraction();
+  scale_up_fraction_ = config->scale_up_fraction();
+  smoothing_ = std::min(std::max(config->smoothing(), 0.01f), 1.0f);
+  cooldown_frames_ = config->cooldown_frames();
+  scale_ = max_scale_;
+}
+
+void DynamicResolution::Update(float cpu_ms, float gpu_ms, float budget_ms) {
+  if (!enabled_ || budget_ms <= 0.0f) return;
+
+  // Resolution mostly changes the GPU's work. Without GPU timings, the render
+  // thread's time stands in, since it includes waiting on the driver.
+  const float frame_ms = gpu_ms >= 0.0f ? gpu_ms : cpu_ms;
+  smoothed_ms_ += smoothing_ * (frame_ms - smoothed_ms_);
+
+  // Give each change time to show in the smoothed time before the next.
+  if (++frames_since_change_ < cooldown_frames_) return;
+  float scale = scale_;
+  if (smoothed_ms_ > scale_down_fraction_ * budget_ms) {
+    scale = std::max(scale_ - scale_step_, min_scale_);
+  } else if (smoothed_ms_ < scale_up_fraction_ * budget_ms) {
+    scale = std::min(scale_ + scale_step_, max_scale_);
+  }
+  if (scale != scale_) {
+    scale_ = scale;
+    frames_since_change_ = 0;
+  }
+}
+
+mathfu::vec2i DynamicResolution::ScaledSize(
+    const mathfu::vec2i& screen_size) const {
+  return mathfu::vec2i(
+      std::max(static_cast<int>(screen_size.x * scale_ + 0.5f), 1),
+      std::max(static_cast<int>(screen_size.y * scale_ + 0.5f), 1));
+}
+
+}  // zooshi
+}  // fpl
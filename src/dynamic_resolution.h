@@ -0,0 +1,67 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_DYNAMIC_RESOLUTION_H_
+#define ZOOSHI_DYNAMIC_RESOLUTION_H_
+
+#include "config_generated.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Picks the resolution to render the world at, from how long recent frames
+// took. When frames run over their budget, as on thermally throttled phones,
+// the resolution steps down so the frame rate holds, and it steps back up
+// once there's time to spare. The UI is always drawn at full resolution.
+class DynamicResolution {
+ public:
+  DynamicResolution();
+
+  // `config` may be null, in which case the world is always drawn at full
+  // resolution.
+  void Initialize(const DynamicResolutionConfig* config);
+
+  bool enabled() const { return enabled_; }
+
+  // Add the last frame's times, in milliseconds: `cpu_ms` on the render
+  // thread, and `gpu_ms` on the GPU, or a negative value if it wasn't
+  // measured. `budget_ms` is the frame time being aimed for.
+  void Update(float cpu_ms, float gpu_ms, float budget_ms);
+
+  // The fraction of the screen's width and height the world is drawn at.
+  float scale() const { return scale_; }
+
+  // The size to draw the world at, for a screen of `screen_size`.
+  mathfu::vec2i ScaledSize(const mathfu::vec2i& screen_size) const;
+
+ private:
+  bool enabled_;
+  float min_scale_;
+  float max_scale_;
+  float scale_step_;
+  float scale_down_fraction_;
+  float scale_up_fraction_;
+  float smoothing_;
+  int cooldown_frames_;
+
+  float scale_;
+  float smoothed_ms_;
+  int frames_since_change_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_DYNAMIC_RESOLUTION_H_
@@ -0,0 +1,383 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "entity_bvh.h"
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include "corgi_component_library/rendermesh.h"
+#include "corgi_component_library/transform.h"
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+
+using corgi::EntityRef;
+using corgi::component_library::RenderMeshComponent;
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+using mathfu::mat4;
+using mathfu::vec3;
+using mathfu::vec4;
+
+namespace fpl {
+namespace zooshi {
+
+// How far each entity's bounds are padded, in world units, so that nudging
+// it in the editor doesn't move it in the tree.
+static const float kMargin = 0.5f;
+
+static float SurfaceArea(const vec3& min, const vec3& max) {
+  const vec3 size = max - min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static bool Contains(const vec3& outer_min, const vec3& outer_max,
+                     const vec3& min, const vec3& max) {
+  return outer_min.x <= min.x && outer_min.y <= min.y &&
+         outer_min.z <= min.z && max.x <= outer_max.x &&
+         max.y <= outer_max.y && max.z <= outer_max.z;
+}
+
+static bool Overlaps(const vec3& a_min, const vec3& a_max, const vec3& b_min,
+                     const vec3& b_max) {
+  return a_min.x <= b_max.x && b_min.x <= a_max.x && a_min.y <= b_max.y &&
+         b_min.y <= a_max.y && a_min.z <= b_max.z && b_min.z <= a_max.z;
+}
+
+// Where the ray enters the box, as a distance along it, or -1 if it misses.
+static float RayDistance(const vec3& origin, const vec3& inverse_direction,
+                         const vec3& min, const vec3& max) {
+  const vec3 t1 = (min - origin) * inverse_direction;
+  const vec3 t2 = (max - origin) * inverse_direction;
+  const vec3 t_min = vec3::Min(t1, t2);
+  const vec3 t_max = vec3::Max(t1, t2);
+  const float enter = std::max(std::max(t_min.x, t_min.y), t_min.z);
+  const float exit = std::min(std::min(t_max.x, t_max.y), t_max.z);
+  if (exit < 0.0f || enter > exit) return -1.0f;
+  return std::max(enter, 0.0f);
+}
+
+void EntityBvh::Build() {
+  Clear();
+  RenderMeshComponent* render_mesh_component =
+      entity_manager_->GetComponent<RenderMeshComponent>();
+  for (auto iter = render_mesh_component->begin();
+       iter != render_mesh_component->end(); ++iter) {
+    UpdateEntity(iter->entity);
+  }
+}
+
+void EntityBvh::Clear() {
+  nodes_.clear();
+  leaves_.clear();
+  root_ = kNone;
+  free_nodes_ = kNone;
+}
+
+bool EntityBvh::EntityBounds(const EntityRef& entity, vec3* min,
+                             vec3* max) const {
+  const RenderMeshData* render_mesh_data =
+      entity_manager_->GetComponentData<RenderMeshData>(entity);
+  const TransformData* transform_data =
+      entity_manager_->GetComponentData<TransformData>(entity);
+  if (render_mesh_data == nullptr || render_mesh_data->mesh == nullptr ||
+      transform_data == nullptr) {
+    return false;
+  }
+
+  // Transform the mesh's box, and fit a world space box around that.
+  const fplbase::Mesh* mesh = render_mesh_data->mesh;
+  const vec3 center = (mesh->min_position() + mesh->max_position()) * 0.5f;
+  const vec3 extent = (mesh->max_position() - mesh->min_position()) * 0.5f;
+  const mat4& world_transform = transform_data->world_transform;
+  const vec3 world_center = world_transform * center;
+  vec3 world_extent;
+  for (int i = 0; i < 3; ++i) {
+    world_extent[i] = fabsf(world_transform(i, 0)) * extent.x +
+                      fabsf(world_transform(i, 1)) * extent.y +
+                      fabsf(world_transform(i, 2)) * extent.z;
+  }
+  *min = world_center - world_extent;
+  *max = world_center + world_extent;
+  return true;
+}
+
+void EntityBvh::Update(const EntityRef& entity) {
+  if (!entity.IsValid()) return;
+  UpdateEntity(entity);
+  const TransformData* transform_data =
+      entity_manager_->GetComponentData<TransformData>(entity);
+  if (transform_data == nullptr) return;
+  for (auto iter = transform_data->children.begin();
+       iter != transform_data->children.end(); ++iter) {
+    Update(iter->owner);
+  }
+}
+
+void EntityBvh::UpdateEntity(const EntityRef& entity) {
+  auto existing = leaves_.find(entity.ToPointer());
+  vec3 min, max;
+  if (!EntityBounds(entity, &min, &max)) {
+    if (existing != leaves_.end()) {
+      RemoveLeaf(existing->second);
+      FreeNode(existing->second);
+      leaves_.erase(existing);
+    }
+    return;
+  }
+
+  int leaf;
+  if (existing != leaves_.end()) {
+    // A new entity in a deleted one's slot takes over its leaf.
+    leaf = existing->second;
+    if (nodes_[leaf].entity == entity &&
+        Contains(nodes_[leaf].min, nodes_[leaf].max, min, max)) {
+      return;
+    }
+    RemoveLeaf(leaf);
+  } else {
+    leaf = AllocateNode();
+    leaves_[entity.ToPointer()] = leaf;
+  }
+  nodes_[leaf].entity = entity;
+  nodes_[leaf].min = min - vec3(kMargin);
+  nodes_[leaf].max = max + vec3(kMargin);
+  InsertLeaf(leaf);
+}
+
+void EntityBvh::RemoveDeleted() {
+  for (auto iter = leaves_.begin(); iter != leaves_.end();) {
+    const int leaf = iter->second;
+    if (nodes_[leaf].entity.IsValid()) {
+      ++iter;
+      continue;
+    }
+    RemoveLeaf(leaf);
+    FreeNode(leaf);
+    iter = leaves_.erase(iter);
+  }
+}
+
+int EntityBvh::AllocateNode() {
+  int node;
+  if (free_nodes_ != kNone) {
+    node = free_nodes_;
+    free_nodes_ = nodes_[node].parent;
+  } else {
+    node = static_cast<int>(nodes_.size());
+    nodes_.push_back(Node());
+  }
+  nodes_[node].parent = kNone;
+  nodes_[node].left = kNone;
+  nodes_[node].right = kNone;
+  nodes_[node].entity = EntityRef();
+  return node;
+}
+
+void EntityBvh::FreeNode(int node) {
+  nodes_[node].entity = EntityRef();
+  nodes_[node].parent = free_nodes_;
+  free_nodes_ = node;
+}
+
+void EntityBvh::InsertLeaf(int leaf) {
+  if (root_ == kNone) {
+    root_ = leaf;
+    nodes_[leaf].parent = kNone;
+    return;
+  }
+
+  // Walk down to the sibling that adds the least surface area to the tree,
+  // counting what every node on the way grows by.
+  const vec3 leaf_min = nodes_[leaf].min;
+  const vec3 leaf_max = nodes_[leaf].max;
+  auto descend_cost = [&](int child) {
+    const Node& node = nodes_[child];
+    const float combined = SurfaceArea(vec3::Min(node.min, leaf_min),
+                                       vec3::Max(node.max, leaf_max));
+    return IsLeaf(child) ? combined
+                         : combined - SurfaceArea(node.min, node.max);
+  };
+  int sibling = root_;
+  while (!IsLeaf(sibling)) {
+    const Node& node = nodes_[sibling];
+    const float area = SurfaceArea(node.min, node.max);
+    const float combined = SurfaceArea(vec3::Min(node.min, leaf_min),
+                                       vec3::Max(node.max, leaf_max));
+    const float cost = 2.0f * combined;
+    const float inherited = 2.0f * (combined - area);
+    const float left_cost = descend_cost(node.left) + inherited;
+    const float right_cost = descend_cost(node.right) + inherited;
+    if (cost < left_cost && cost < right_cost) break;
+    sibling = left_cost < right_cost ? node.left : node.right;
+  }
+
+  // Give the sibling and the leaf a new parent, in the sibling's place.
+  const int old_parent = nodes_[sibling].parent;
+  const int parent = AllocateNode();
+  nodes_[parent].parent = old_parent;
+  nodes_[parent].left = sibling;
+  nodes_[parent].right = leaf;
+  nodes_[sibling].parent = parent;
+  nodes_[leaf].parent = parent;
+  if (old_parent == kNone) {
+    root_ = parent;
+  } else if (nodes_[old_parent].left == sibling) {
+    nodes_[old_parent].left = parent;
+  } else {
+    nodes_[old_parent].right = parent;
+  }
+  Refit(parent);
+}
+
+void EntityBvh::RemoveLeaf(int leaf) {
+  if (leaf == root_) {
+    root_ = kNone;
+    return;
+  }
+
+  // The leaf's sibling takes its parent's place.
+  const int parent = nodes_[leaf].parent;
+  const int grandparent = nodes_[parent].parent;
+  const int sibling = nodes_[parent].left == leaf ? nodes_[parent].right
+                                                  : nodes_[parent].left;
+  nodes_[sibling].parent = grandparent;
+  if (grandparent == kNone) {
+    root_ = sibling;
+  } else {
+    if (nodes_[grandparent].left == parent) {
+      nodes_[grandparent].left = sibling;
+    } else {
+      nodes_[grandparent].right = sibling;
+    }
+    Refit(grandparent);
+  }
+  FreeNode(parent);
+  nodes_[leaf].parent = kNone;
+}
+
+void EntityBvh::Refit(int node) {
+  while (node != kNone) {
+    Node& parent = nodes_[node];
+    const Node& left = nodes_[parent.left];
+    const Node& right = nodes_[parent.right];
+    parent.min = vec3::Min(left.min, right.min);
+    parent.max = vec3::Max(left.max, right.max);
+    node = parent.parent;
+  }
+}
+
+void EntityBvh::AddEntities(int node, std::vector<EntityRef>* entities) const {
+  std::vector<int> stack(1, node);
+  while (!stack.empty()) {
+    const int top = stack.back();
+    stack.pop_back();
+    const Node& current = nodes_[top];
+    if (IsLeaf(top)) {
+      if (current.entity.IsValid()) entities->push_back(current.entity);
+    } else {
+      stack.push_back(current.left);
+      stack.push_back(current.right);
+    }
+  }
+}
+
+EntityRef EntityBvh::Raycast(const vec3& origin, const vec3& direction) const {
+  EntityRef nearest;
+  if (root_ == kNone) return nearest;
+  const vec3 inverse_direction = vec3(1.0f) / direction;
+  float nearest_distance = std::numeric_limits<float>::max();
+
+  // Boxes further than the nearest hit so far are skipped.
+  std::vector<int> stack(1, root_);
+  while (!stack.empty()) {
+    const int top = stack.back();
+    stack.pop_back();
+    const Node& node = nodes_[top];
+    const float distance =
+        RayDistance(origin, inverse_direction, node.min, node.max);
+    if (distance < 0.0f || distance >= nearest_distance) continue;
+    if (!IsLeaf(top)) {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    } else if (node.entity.IsValid()) {
+      nearest = node.entity;
+      nearest_distance = distance;
+    }
+  }
+  return nearest;
+}
+
+void EntityBvh::QueryBox(const vec3& min, const vec3& max,
+                         std::vector<EntityRef>* entities) const {
+  if (root_ == kNone) return;
+  std::vector<int> stack(1, root_);
+  while (!stack.empty()) {
+    const int top = stack.back();
+    stack.pop_back();
+    const Node& node = nodes_[top];
+    if (!Overlaps(node.min, node.max, min, max)) continue;
+    if (!IsLeaf(top)) {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    } else if (node.entity.IsValid()) {
+      entities->push_back(node.entity);
+    }
+  }
+}
+
+void EntityBvh::QueryOutsideView(const mat4& view_projection,
+                                 std::vector<EntityRef>* entities) const {
+  if (root_ == kNone) return;
+
+  // The view's six planes, facing inwards, from the rows of its matrix.
+  vec4 rows[4];
+  for (int i = 0; i < 4; ++i) {
+    rows[i] = vec4(view_projection(i, 0), view_projection(i, 1),
+                   view_projection(i, 2), view_projection(i, 3));
+  }
+  const vec4 planes[] = {rows[3] + rows[0], rows[3] - rows[0],
+                         rows[3] + rows[1], rows[3] - rows[1],
+                         rows[3] + rows[2], rows[3] - rows[2]};
+
+  std::vector<int> stack(1, root_);
+  while (!stack.empty()) {
+    const int top = stack.back();
+    stack.pop_back();
+    const Node& node = nodes_[top];
+
+    // A box is outside if its corner furthest along a plane's normal is
+    // behind that plane. Everything under it is then outside too.
+    bool outside = false;
+    for (size_t i = 0; i < FPL_ARRAYSIZE(planes); ++i) {
+      const vec4& plane = planes[i];
+      const vec3 corner(plane.x >= 0.0f ? node.max.x : node.min.x,
+                        plane.y >= 0.0f ? node.max.y : node.min.y,
+                        plane.z >= 0.0f ? node.max.z : node.min.z);
+      if (vec3::DotProduct(plane.xyz(), corner) + plane.w < 0.0f) {
+        outside = true;
+        break;
+      }
+    }
+    if (outside) {
+      AddEntities(top, entities);
+    } else if (!IsLeaf(top)) {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+}
+
+}  // zooshi
+}  // fpl
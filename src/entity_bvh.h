@@ -0,0 +1,111 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_ENTITY_BVH_H_
+#define ZOOSHI_ENTITY_BVH_H_
+
+#include <unordered_map>
+#include <vector>
+#include "corgi/entity_manager.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A bounding volume hierarchy over the world space bounds of every entity
+// with a render mesh, so the editor can find what's under the cursor, in a
+// box, or in view without testing every entity in the level.
+//
+// Each entity's bounds are padded, so it can move a little without the tree
+// changing. Once it leaves them, it's taken out and put back in where it
+// adds the least surface area.
+class EntityBvh {
+ public:
+  EntityBvh() : entity_manager_(nullptr), root_(kNone), free_nodes_(kNone) {}
+
+  void Initialize(corgi::EntityManager* entity_manager) {
+    entity_manager_ = entity_manager;
+  }
+
+  // Put every entity with a render mesh in a new tree.
+  void Build();
+  void Clear();
+
+  // Update the bounds of `entity` and its children, whose transforms may
+  // have changed. Entities that have gained or lost a mesh are added or
+  // removed.
+  void Update(const corgi::EntityRef& entity);
+
+  // Remove the leaves of entities that have been deleted. The queries skip
+  // them, but until they're removed they still take up the tree.
+  void RemoveDeleted();
+
+  // The entity with the nearest bounds that the ray from `origin` along
+  // `direction` hits, or an invalid entity if it hits none.
+  corgi::EntityRef Raycast(const mathfu::vec3& origin,
+                           const mathfu::vec3& direction) const;
+
+  // Add the entities whose bounds overlap the box to `entities`.
+  void QueryBox(const mathfu::vec3& min, const mathfu::vec3& max,
+                std::vector<corgi::EntityRef>* entities) const;
+
+  // Add the entities whose bounds are entirely outside the view of
+  // `view_projection` to `entities`.
+  void QueryOutsideView(const mathfu::mat4& view_projection,
+                        std::vector<corgi::EntityRef>* entities) const;
+
+  size_t size() const { return leaves_.size(); }
+
+ private:
+  static const int kNone = -1;
+
+  struct Node {
+    mathfu::vec3 min;
+    mathfu::vec3 max;
+    int parent;
+    // Both are kNone for leaves, which hold an entity instead.
+    int left;
+    int right;
+    corgi::EntityRef entity;
+  };
+
+  bool IsLeaf(int node) const { return nodes_[node].left == kNone; }
+
+  // The world space bounds of the entity's mesh. Returns false if it has
+  // none.
+  bool EntityBounds(const corgi::EntityRef& entity, mathfu::vec3* min,
+                    mathfu::vec3* max) const;
+  void UpdateEntity(const corgi::EntityRef& entity);
+
+  int AllocateNode();
+  void FreeNode(int node);
+  void InsertLeaf(int leaf);
+  void RemoveLeaf(int leaf);
+  // Refit the bounds of `node` and its ancestors to their children.
+  void Refit(int node);
+  // Add every entity under `node` to `entities`.
+  void AddEntities(int node, std::vector<corgi::EntityRef>* entities) const;
+
+  corgi::EntityManager* entity_manager_;
+  std::vector<Node> nodes_;
+  int root_;
+  // Unused nodes, linked through their `parent`.
+  int free_nodes_;
+  std::unordered_map<const corgi::Entity*, int> leaves_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_ENTITY_BVH_H_
@@ -0,0 +1,125 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fixed_timestep.h"
+
+#include <assert.h>
+#include <algorithm>
+
+using corgi::component_library::TransformComponent;
+using corgi::component_library::TransformData;
+using mathfu::mat4;
+
+namespace fpl {
+namespace zooshi {
+
+void FixedTimestep::Initialize(const FixedTimestepConfig* config) {
+  step_time_ = 0;
+  accumulated_time_ = 0;
+  if (config == nullptr || config->step_rate() <= 0) return;
+
+  step_time_ = std::max(corgi::kMillisecondsPerSecond / config->step_rate(),
+                        static_cast<corgi::WorldTime>(1));
+  max_steps_ = std::max(config->max_steps_per_frame(), 1);
+  interpolate_ = config->interpolate();
+}
+
+int FixedTimestep::Accumulate(corgi::WorldTime delta_time) {
+  if (!enabled()) return 1;
+
+  // Drop time beyond what `max_steps_` can use. After a long hitch, we'd
+  // rather slow down briefly than fall further behind trying to catch up.
+  accumulated_time_ =
+      std::min(accumulated_time_ + std::max(delta_time, 0),
+               step_time_ * static_cast<corgi::WorldTime>(max_steps_));
+  const int steps = static_cast<int>(accumulated_time_ / step_time_);
+  accumulated_time_ -= steps * step_time_;
+  return steps;
+}
+
+float FixedTimestep::alpha() const {
+  if (!enabled()) return 1.0f;
+  return static_cast<float>(accumulated_time_) /
+         static_cast<float>(step_time_);
+}
+
+void TransformInterpolator::Initialize(const FixedTimestepConfig* config) {
+  const float snap_distance =
+      config == nullptr ? 0.0f : config->snap_distance();
+  snap_distance_sq_ = snap_distance * snap_distance;
+}
+
+void TransformInterpolator::set_enabled(bool enabled) {
+  assert(!applied_);
+  enabled_ = enabled;
+  if (!enabled_) samples_.clear();
+}
+
+void TransformInterpolator::Capture(TransformComponent* transforms) {
+  if (!enabled_) return;
+
+  // Entities are usually in the same order as the last capture. Any that
+  // aren't, such as ones that were just created, start with no motion.
+  size_t index = 0;
+  for (auto iter = transforms->begin(); iter != transforms->end();
+       ++iter, ++index) {
+    const mat4& world_transform = iter->data.world_transform;
+    if (index < samples_.size() && samples_[index].entity == iter->entity) {
+      samples_[index].previous = samples_[index].current;
+    } else {
+      if (index >= samples_.size()) samples_.resize(index + 1);
+      samples_[index].entity = iter->entity;
+      samples_[index].previous = world_transform;
+    }
+    samples_[index].current = world_transform;
+  }
+  samples_.resize(index);
+}
+
+void TransformInterpolator::Apply(TransformComponent* transforms) {
+  if (!enabled_ || applied_) return;
+  applied_ = true;
+
+  const float alpha = std::min(std::max(alpha_, 0.0f), 1.0f);
+  for (auto it = samples_.begin(); it != samples_.end(); ++it) {
+    if (!it->entity.IsValid()) continue;
+    TransformData* transform_data = transforms->GetComponentData(it->entity);
+    if (transform_data == nullptr) continue;
+
+    // Steps are short, so their rotations are small enough to blend the
+    // matrices directly.
+    const float moved_sq = (it->current.TranslationVector3D() -
+                            it->previous.TranslationVector3D())
+                               .LengthSquared();
+    if (snap_distance_sq_ > 0.0f && moved_sq > snap_distance_sq_) continue;
+    transform_data->world_transform =
+        it->previous * (1.0f - alpha) + it->current * alpha;
+  }
+}
+
+void TransformInterpolator::Restore(TransformComponent* transforms) {
+  if (!applied_) return;
+  applied_ = false;
+
+  for (auto it = samples_.begin(); it != samples_.end(); ++it) {
+    if (!it->entity.IsValid()) continue;
+    TransformData* transform_data = transforms->GetComponentData(it->entity);
+    if (transform_data != nullptr) {
+      transform_data->world_transform = it->current;
+    }
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,113 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_FIXED_TIMESTEP_H_
+#define ZOOSHI_FIXED_TIMESTEP_H_
+
+#include <vector>
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/transform.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Splits the time that passes between frames into simulation steps of a
+// fixed length, so physics and splines behave the same however fast frames
+// are rendered. Time left over is carried into the next frame.
+class FixedTimestep {
+ public:
+  FixedTimestep()
+      : step_time_(0),
+        max_steps_(1),
+        accumulated_time_(0),
+        interpolate_(false) {}
+
+  // `config` may be null, in which case fixed steps are disabled.
+  void Initialize(const FixedTimestepConfig* config);
+
+  // If disabled, the game runs one step per frame, as long as the frame.
+  bool enabled() const { return step_time_ > 0; }
+
+  // Add `delta_time` milliseconds, and return the number of steps to run.
+  int Accumulate(corgi::WorldTime delta_time);
+
+  // The length of each step, in milliseconds.
+  corgi::WorldTime step_time() const { return step_time_; }
+
+  // How far the leftover time is into the next step, from 0 to 1.
+  float alpha() const;
+
+  // True if transforms should be rendered between the last two steps.
+  bool interpolate() const { return enabled() && interpolate_; }
+
+ private:
+  corgi::WorldTime step_time_;
+  int max_steps_;
+  corgi::WorldTime accumulated_time_;
+  bool interpolate_;
+};
+
+// Remembers each entity's world transform from the last two simulation steps,
+// and blends between them while rendering. Frames then move smoothly even
+// when they're rendered more often than the game is stepped.
+class TransformInterpolator {
+ public:
+  TransformInterpolator()
+      : enabled_(false),
+        alpha_(1.0f),
+        snap_distance_sq_(0.0f),
+        applied_(false) {}
+
+  void Initialize(const FixedTimestepConfig* config);
+
+  void set_enabled(bool enabled);
+  bool enabled() const { return enabled_; }
+
+  // Record the current world transforms. Call before and after the last
+  // step of each update, after TransformComponent has updated.
+  void Capture(corgi::component_library::TransformComponent* transforms);
+
+  // Set how far between the last two steps to render, from 0 to 1.
+  void set_alpha(float alpha) { alpha_ = alpha; }
+
+  // Replace world transforms with ones blended between the last two steps.
+  // Restore() must be called before the next update.
+  void Apply(corgi::component_library::TransformComponent* transforms);
+  void Restore(corgi::component_library::TransformComponent* transforms);
+
+  // True between Apply() and Restore().
+  bool applied() const { return applied_; }
+
+ private:
+  struct Sample {
+    corgi::EntityRef entity;
+    mathfu::mat4 previous;
+    mathfu::mat4 current;
+  };
+
+  bool enabled_;
+  float alpha_;
+  // Entities that move farther than this in one step have teleported, and
+  // are drawn where they are now rather than blended.
+  float snap_distance_sq_;
+  bool applied_;
+  std::vector<Sample> samples_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_FIXED_TIMESTEP_H_
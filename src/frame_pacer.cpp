@@ -0,0 +1,234 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include "SDL_power.h"
+#include "SDL_timer.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+const int FramePacer::kFrameRates[] = {30, 60, 90, 120};
+const int FramePacer::kNumFrameRates =
+    sizeof(FramePacer::kFrameRates) / sizeof(FramePacer::kFrameRates[0]);
+
+// SDL_Delay() can oversleep by a millisecond or two, so the last part of a
+// wait is done by yielding instead.
+static const double kYieldMilliseconds = 2.0;
+
+// Updates never simulate less than this frame rate's frame time at once,
+// however high the frame rate, so brief hitches don't slow the game down.
+static const int kMinSimulatedFrameRate = 30;
+
+FramePacer::FramePacer()
+    : battery_rate_index_(FrameRateIndex(30)),
+      max_missed_fraction_(0.1f),
+      headroom_fraction_(0.7f),
+      stats_interval_(5.0f),
+      log_stats_(false),
+      has_vsync_(false),
+      target_rate_index_(FrameRateIndex(60)),
+      rate_index_(target_rate_index_),
+      on_battery_(false),
+      behind_(false),
+      frequency_(1),
+      frame_start_(0),
+      deadline_(0),
+      stats_start_(0),
+      frames_(0),
+      missed_frames_(0),
+      total_frame_ticks_(0),
+      max_frame_ticks_(0),
+      total_work_ticks_(0),
+      last_frame_ticks_(0),
+      last_work_ticks_(0) {
+  SetRateIndex(rate_index_);
+}
+
+void FramePacer::Initialize(const FramePacingConfig* config, bool has_vsync) {
+  frequency_ = SDL_GetPerformanceFrequency();
+  has_vsync_ = has_vsync;
+  if (config != nullptr) {
+    target_rate_index_ = FrameRateIndex(config->target_frame_rate());
+    battery_rate_index_ = FrameRateIndex(config->battery_frame_rate());
+    max_missed_fraction_ = config->max_missed_fraction();
+    headroom_fraction_ = config->headroom_fraction();
+    stats_interval_ = config->stats_interval();
+    log_stats_ = config->log_stats();
+  }
+  CheckPower();
+  SetRateIndex(MaxRateIndex());
+}
+
+int FramePacer::FrameRateIndex(int frame_rate) {
+  int best = 0;
+  for (int i = 1; i < kNumFrameRates; ++i) {
+    if (std::abs(kFrameRates[i] - frame_rate) <
+        std::abs(kFrameRates[best] - frame_rate)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+int FramePacer::SupportedFrameRate(int frame_rate) {
+  return kFrameRates[FrameRateIndex(frame_rate)];
+}
+
+uint64_t FramePacer::FrameTicks(int rate_index) const {
+  return frequency_ / static_cast<uint64_t>(kFrameRates[rate_index]);
+}
+
+double FramePacer::TicksToMilliseconds(uint64_t ticks) const {
+  return static_cast<double>(ticks) * 1000.0 / static_cast<double>(frequency_);
+}
+
+void FramePacer::SleepUntil(uint64_t deadline) const {
+  for (;;) {
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (now >= deadline) return;
+    const double remaining = TicksToMilliseconds(deadline - now);
+    SDL_Delay(remaining > kYieldMilliseconds
+                  ? static_cast<Uint32>(remaining - kYieldMilliseconds)
+                  : 0);
+  }
+}
+
+void FramePacer::CheckPower() {
+  on_battery_ =
+      SDL_GetPowerInfo(nullptr, nullptr) == SDL_POWERSTATE_ON_BATTERY;
+  if (rate_index_ > MaxRateIndex()) SetRateIndex(MaxRateIndex());
+}
+
+int FramePacer::MaxRateIndex() const {
+  return on_battery_ ? std::min(target_rate_index_, battery_rate_index_)
+                     : target_rate_index_;
+}
+
+void FramePacer::SetRateIndex(int rate_index) {
+  rate_index_ = rate_index;
+  const int frame_rate = kFrameRates[rate_index_];
+  const int min_time = corgi::kMillisecondsPerSecond / frame_rate;
+  const int max_time =
+      std::max(2 * corgi::kMillisecondsPerSecond / frame_rate,
+               corgi::kMillisecondsPerSecond / kMinSimulatedFrameRate);
+  SDL_AtomicSet(&min_update_time_, min_time);
+  SDL_AtomicSet(&max_update_time_, max_time);
+}
+
+void FramePacer::SetTargetFrameRate(int frame_rate) {
+  target_rate_index_ = FrameRateIndex(frame_rate);
+  SetRateIndex(MaxRateIndex());
+}
+
+corgi::WorldTime FramePacer::min_update_time() const {
+  return SDL_AtomicGet(&min_update_time_);
+}
+
+corgi::WorldTime FramePacer::max_update_time() const {
+  return SDL_AtomicGet(&max_update_time_);
+}
+
+void FramePacer::WaitForNextFrame() {
+  if (frame_start_ == 0) return;
+  last_work_ticks_ = SDL_GetPerformanceCounter() - frame_start_;
+  total_work_ticks_ += last_work_ticks_;
+
+  // With vsync, wake a quarter of a frame early so the frame can start on
+  // the vsync at the deadline, rather than the one after it.
+  const uint64_t slack = has_vsync_ ? FrameTicks(rate_index_) / 4 : 0;
+  SleepUntil(deadline_ > slack ? deadline_ - slack : 0);
+}
+
+void FramePacer::StartFrame() {
+  const uint64_t now = SDL_GetPerformanceCounter();
+  const uint64_t frame_ticks = FrameTicks(rate_index_);
+  if (frame_start_ != 0) {
+    const uint64_t interval = now - frame_start_;
+    last_frame_ticks_ = interval;
+    frames_++;
+    total_frame_ticks_ += interval;
+    max_frame_ticks_ = std::max(max_frame_ticks_, interval);
+    behind_ = now > deadline_ + frame_ticks / 2;
+    if (behind_) missed_frames_++;
+  }
+  frame_start_ = now;
+
+  // Without vsync, keep to a steady cadence by scheduling from the last
+  // deadline, unless we're so far behind that catching up would rush frames.
+  if (has_vsync_ || deadline_ == 0 || now > deadline_ + frame_ticks) {
+    deadline_ = now + frame_ticks;
+  } else {
+    deadline_ += frame_ticks;
+  }
+
+  if (stats_start_ == 0) {
+    stats_start_ = now;
+  } else if (TicksToMilliseconds(now - stats_start_) >=
+             stats_interval_ * corgi::kMillisecondsPerSecond) {
+    EndStatsInterval(now);
+  }
+}
+
+void FramePacer::EndStatsInterval(uint64_t now) {
+  stats_.frame_rate = frame_rate();
+  stats_.on_battery = on_battery_;
+  stats_.frames = frames_;
+  stats_.missed_frames = missed_frames_;
+  if (frames_ > 0) {
+    stats_.average_frame_time =
+        static_cast<float>(TicksToMilliseconds(total_frame_ticks_) / frames_);
+    stats_.max_frame_time =
+        static_cast<float>(TicksToMilliseconds(max_frame_ticks_));
+    stats_.average_work_time =
+        static_cast<float>(TicksToMilliseconds(total_work_ticks_) / frames_);
+  }
+  if (log_stats_) {
+    LogInfo(
+        "Frame pacing: %d fps target%s, %d frames, %d missed, "
+        "frame %.2fms avg %.2fms max, work %.2fms avg",
+        stats_.frame_rate, stats_.on_battery ? " (battery)" : "",
+        stats_.frames, stats_.missed_frames, stats_.average_frame_time,
+        stats_.max_frame_time, stats_.average_work_time);
+  }
+
+  // Step down if we can't keep up, and back up once there's room to spare.
+  if (frames_ > 0) {
+    if (missed_frames_ > max_missed_fraction_ * frames_ && rate_index_ > 0) {
+      SetRateIndex(rate_index_ - 1);
+    } else if (rate_index_ < MaxRateIndex() &&
+               stats_.average_work_time <
+                   headroom_fraction_ * corgi::kMillisecondsPerSecond /
+                       kFrameRates[rate_index_ + 1]) {
+      SetRateIndex(rate_index_ + 1);
+    }
+  }
+  CheckPower();
+
+  stats_start_ = now;
+  frames_ = 0;
+  missed_frames_ = 0;
+  total_frame_ticks_ = 0;
+  max_frame_ticks_ = 0;
+  total_work_ticks_ = 0;
+}
+
+}  // zooshi
+}  // fpl
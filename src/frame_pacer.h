@@ -0,0 +1,156 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_FRAME_PACER_H_
+#define ZOOSHI_FRAME_PACER_H_
+
+#include <stdint.h>
+#include "SDL_atomic.h"
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+
+namespace fpl {
+namespace zooshi {
+
+// How well frames kept to their deadlines over the last stats interval.
+struct FramePacingStats {
+  FramePacingStats()
+      : frame_rate(0),
+        on_battery(false),
+        frames(0),
+        missed_frames(0),
+        average_frame_time(0.0f),
+        max_frame_time(0.0f),
+        average_work_time(0.0f) {}
+
+  // The frame rate that was being aimed for.
+  int frame_rate;
+  bool on_battery;
+  int frames;
+  // Frames that started more than half a frame late.
+  int missed_frames;
+  // Milliseconds from the start of one frame to the start of the next.
+  float average_frame_time;
+  float max_frame_time;
+  // Milliseconds each frame spent working, rather than waiting.
+  float average_work_time;
+};
+
+// Decides when the render thread starts each frame. Rather than polling, it
+// sleeps until shortly before the frame is due. If frames keep missing their
+// deadline, it steps down to a lower frame rate, and it steps back up once
+// there's enough headroom. On battery power it aims for a lower rate.
+//
+// Call the frame functions from the render thread only. The update times can
+// be read from any thread.
+class FramePacer {
+ public:
+  FramePacer();
+
+  // `config` may be null, in which case the defaults are used. If `has_vsync`
+  // the caller waits for vsync after WaitForNextFrame(), so it wakes up a
+  // little early to leave time for that.
+  void Initialize(const FramePacingConfig* config, bool has_vsync);
+
+  // Sleep until the next frame is due.
+  void WaitForNextFrame();
+
+  // Call at the start of each frame, after any wait for vsync.
+  void StartFrame();
+
+  // Choose a new frame rate to aim for. Rounded to a supported rate.
+  void SetTargetFrameRate(int frame_rate);
+  int target_frame_rate() const { return kFrameRates[target_rate_index_]; }
+
+  // The frame rate currently being aimed for, after adapting to missed frames
+  // and battery power.
+  int frame_rate() const { return kFrameRates[rate_index_]; }
+
+  // True if the last frame started after its deadline. There's no point
+  // waiting for vsync until it catches up.
+  bool behind() const { return behind_; }
+
+  bool on_battery() const { return on_battery_; }
+  const FramePacingStats& stats() const { return stats_; }
+
+  // Milliseconds from the start of the frame before the current one to its
+  // start.
+  float last_frame_time() const {
+    return static_cast<float>(TicksToMilliseconds(last_frame_ticks_));
+  }
+
+  // Milliseconds the last frame spent working, rather than waiting.
+  float last_work_time() const {
+    return static_cast<float>(TicksToMilliseconds(last_work_ticks_));
+  }
+
+  // The shortest and longest time an update should simulate, in
+  // milliseconds. These follow the current frame rate.
+  corgi::WorldTime min_update_time() const;
+  corgi::WorldTime max_update_time() const;
+
+  // The supported frame rate nearest to `frame_rate`.
+  static int SupportedFrameRate(int frame_rate);
+
+ private:
+  static const int kFrameRates[];
+  static const int kNumFrameRates;
+
+  static int FrameRateIndex(int frame_rate);
+  uint64_t FrameTicks(int rate_index) const;
+  double TicksToMilliseconds(uint64_t ticks) const;
+  void SleepUntil(uint64_t deadline) const;
+  void CheckPower();
+  int MaxRateIndex() const;
+  void SetRateIndex(int rate_index);
+  void EndStatsInterval(uint64_t now);
+
+  // Settings, from the config.
+  int battery_rate_index_;
+  float max_missed_fraction_;
+  float headroom_fraction_;
+  float stats_interval_;
+  bool log_stats_;
+  bool has_vsync_;
+
+  int target_rate_index_;
+  int rate_index_;
+  bool on_battery_;
+  bool behind_;
+
+  // Times are in performance counter ticks.
+  uint64_t frequency_;
+  uint64_t frame_start_;
+  uint64_t deadline_;
+  uint64_t stats_start_;
+
+  // Totals for the current stats interval.
+  int frames_;
+  int missed_frames_;
+  uint64_t total_frame_ticks_;
+  uint64_t max_frame_ticks_;
+  uint64_t total_work_ticks_;
+  uint64_t last_frame_ticks_;
+  uint64_t last_work_ticks_;
+  FramePacingStats stats_;
+
+  // Read by the update thread.
+  mutable SDL_atomic_t min_update_time_;
+  mutable SDL_atomic_t max_update_time_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_FRAME_PACER_H_
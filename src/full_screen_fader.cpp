@@ -15,9 +15,6 @@
 #include "full_screen_fader.h"
 
 #include "fplbase/material.h"
-#include "fplbase/mesh.h"
-#include "fplbase/renderer.h"
-#include "fplbase/shader.h"
 
 namespace fpl {
 namespace zooshi {
@@ -27,28 +24,21 @@ FullScreenFader::FullScreenFader()
       total_fade_time_(0),
       end_fade_time_(0),
       material_(NULL),
-      shader_(NULL),
       opaque_(false) {}
 
-void FullScreenFader::Init(fplbase::Material* material,
-                           fplbase::Shader* shader) {
+void FullScreenFader::Init(fplbase::Material* material) {
   material_ = material;
-  shader_ = shader;
 }
 
 // Starts the fade.
 void FullScreenFader::Start(corgi::WorldTime fade_time,
-                            const mathfu::vec3& color, FadeType fade_type,
-                            const mathfu::vec3& bottom_left,
-                            const mathfu::vec3& top_right) {
-  assert(material_ && shader_);
+                            const mathfu::vec3& color, FadeType fade_type) {
+  assert(material_);
   current_fade_time_ = fade_type == kFadeIn ? fade_time : 0;
   total_fade_time_ = fade_type == kFadeIn || fade_type == kFadeOut ?
     2 * fade_time : fade_time;
   end_fade_time_ = fade_type == kFadeOut ? fade_time : total_fade_time_;
   color_ = color;
-  bottom_left_ = bottom_left;
-  top_right_ = top_right;
   opaque_ = false;
 }
 
@@ -66,18 +56,15 @@ bool FullScreenFader::AdvanceFrame(int delta_time) {
 }
 
 // Renders the fade overlay.
-void FullScreenFader::Render(fplbase::Renderer* renderer) {
+void FullScreenFader::Render(SpriteBatch* batch) {
   float t = std::min(static_cast<float>(std::min(current_fade_time_,
                                                  end_fade_time_)) /
                          static_cast<float>(total_fade_time_), 1.0f);
   float alpha = sin(t * static_cast<float>(M_PI));
   // Render the overlay in front on the screen.
-  renderer->set_color(mathfu::vec4(color_, alpha));
-  material_->Set(*renderer);
-  shader_->Set(*renderer);
-  // Clear depth buffer to prevent z-fight issues.
-  renderer->ClearDepthBuffer();
-  fplbase::Mesh::RenderAAQuadAlongX(bottom_left_, top_right_);
+  batch->Add(material_->textures()[0], mathfu::kZeros2f,
+             mathfu::vec2(batch->window_size()), mathfu::vec4(color_, alpha),
+             SpriteBatch::kLayerFade);
 }
 
 // Returns true when the fade is complete (overlay is transparent).
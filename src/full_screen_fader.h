@@ -17,10 +17,9 @@
 
 #include "corgi/entity_common.h"
 #include "fplbase/material.h"
-#include "fplbase/renderer.h"
-#include "fplbase/shader.h"
 #include "fplbase/utilities.h"
 #include "mathfu/glsl_mappings.h"
+#include "sprite_batch.h"
 
 namespace fpl {
 namespace zooshi {
@@ -39,19 +38,18 @@ class FullScreenFader {
   ~FullScreenFader() {}
 
   // Initialize the fader's internal state. Call before Start().
-  void Init(fplbase::Material* material, fplbase::Shader* shader);
+  void Init(fplbase::Material* material);
 
   // Start the fullscreen fading effect with a duration of the given
   // fade_time and the given overlay color.
   void Start(corgi::WorldTime fade_time, const mathfu::vec3& color,
-             FadeType fade_type, const mathfu::vec3& bottom_left,
-             const mathfu::vec3& top_right);
+             FadeType fade_type);
 
   // Update the fade color returning true on the frame the overlay
   // is fully opaque.
   bool AdvanceFrame(int delta_time);
-  // Renders the fullscreen fading overlay.
-  void Render(fplbase::Renderer* renderer);
+  // Queues the fullscreen fading overlay, over everything else in `batch`.
+  void Render(SpriteBatch* batch);
   // Returns true when the fullscreen fading effect is complete.
   bool Finished() const;
   // Get the fraction (0..1) elapsed through the fader's fade time.
@@ -70,14 +68,8 @@ class FullScreenFader {
   // Color of the overlay (the alpha component is ignored), constant, set with
   // Start().
   mathfu::vec3 color_;
-  // Extent of the fade texture. Specified externally because the
-  // view-projection-matrix is also specified externally.
-  mathfu::vec3 bottom_left_;
-  mathfu::vec3 top_right_;
   // Material used to render the overlay, set with Init().
   fplbase::Material* material_;
-  // Shader used to render the overlay material, set with Init().
-  fplbase::Shader* shader_;
   // Opaque flag, variable state, true once the effect transition back
   // from opaque.
   bool opaque_;
@@ -39,9 +39,11 @@
 #include "fplbase/systrace.h"
 #include "fplbase/utilities.h"
 #include "graph_generated.h"
+#include "init_phases.h"
 #include "input_config_generated.h"
 #include "mathfu/glsl_mappings.h"
 #include "mathfu/vector.h"
+#include "memory_tracker.h"
 #include "module_library/animation.h"
 #include "module_library/audio.h"
 #include "module_library/default_graph_factory.h"
@@ -63,6 +65,7 @@
 #include "motive/math/angle.h"
 #include "motive/util/benchmark.h"
 #include "pindrop/pindrop.h"
+#include "profiler.h"
 #include "remote_config.h"
 #include "world.h"
 
@@ -98,6 +101,11 @@ static const char kAssetsDir[] = "assets";
 static const char kConfigFileName[] = "config.zooconfig";
 
 std::string Game::overlay_name_;
+std::string Game::texture_format_directory_;
+OverlayIndex Game::overlay_index_;
+TrustedAssets Game::trusted_assets_;
+
+static const char kMaterialExtension[] = ".fplmat";
 
 #ifdef __ANDROID__
 static const int kAndroidMaxScreenWidth = 1280;
@@ -107,9 +115,6 @@ static const int kAndroidTvMaxScreenWidth = 1920;
 static const int kAndroidTvMaxScreenHeight = 1080;
 #endif  // __ANDROID__
 
-static const int kMinUpdateTime = 1000 / 60;
-static const int kMaxUpdateTime = 1000 / 30;
-
 // Codes used in systrace logging.  Their values don't
 // actually matter much as long as they're unique.
 static const int kUpdateGameStateCode = 555;
@@ -130,10 +135,14 @@ GameSynchronization::GameSynchronization()
       updatethread_mutex_(SDL_CreateMutex()),
       gameupdate_mutex_(SDL_CreateMutex()),
       start_render_cv_(SDL_CreateCond()),
-      start_update_cv_(SDL_CreateCond()) {}
+      start_update_cv_(SDL_CreateCond()),
+      update_requested_(false) {}
 
 Game::Game()
-    : asset_manager_(renderer_),
+    : config_(nullptr),
+      input_config_(nullptr),
+      asset_manifest_(nullptr),
+      asset_manager_(renderer_),
       graph_factory_(&module_registry_, &LoadFile),
       shader_textured_(nullptr),
       game_exiting_(false),
@@ -143,6 +152,7 @@ Game::Game()
       version_(kVersion),
       unlockable_manager_() {
   fplbase::SetLoadFileFunction(Game::LoadFile);
+  SetMapFileFunction(Game::MapFile);
 }
 
 #ifdef __ANDROID__
@@ -239,10 +249,20 @@ bool Game::InitializeAssets() {
   // Load the loading-material first, since we display that while the others
   // load.
   const AssetManifest &asset_manifest = GetAssetManifest();
-
-  if (fplbase::GetSystemRamSize() <= kLowRamProfileThreshold) {
-    // Reduce material size.
-    asset_manager_.SetTextureScale(kLowRamDeviceTextureScale);
+  SelectTextureFormat(asset_manifest);
+
+  // Devices with little RAM get their own budgets, which generally scale
+  // textures down and keep fewer asset groups loaded.
+  const MemoryConfig *memory = GetConfig().memory();
+  const MemoryBudgets *budgets = nullptr;
+  if (memory != nullptr) {
+    const bool low_ram =
+        fplbase::GetSystemRamSize() <= memory->low_ram_threshold();
+    budgets = low_ram ? memory->low_ram_budgets() : memory->default_budgets();
+  }
+  MemoryTracker::Get().SetBudgets(budgets);
+  if (budgets != nullptr && budgets->texture_scale() != 1.0f) {
+    asset_manager_.SetTextureScale(mathfu::vec2(budgets->texture_scale()));
   }
 
   asset_manager_.LoadMaterial(asset_manifest.loading_material()->c_str());
@@ -274,27 +294,44 @@ bool Game::InitializeAssets() {
   }
   asset_manager_.StartLoadingTextures();
 
-  shader_textured_ = asset_manager_.LoadShader("shaders/textured");
-
-  // Load the animation table and all animations it references.
-  motive::AnimTable &anim_table = world_.animation_component.anim_table();
-  const bool anim_ok =
-      anim_table.InitFromFlatBuffers(*asset_manifest.anims(), LoadAnimFn);
-  if (!anim_ok) return false;
+  // Everything else is streamed in once the above has loaded.
+  asset_loader_.Initialize(&asset_manifest, &asset_manager_, &audio_engine_,
+                           &audio_thread_,
+                           budgets != nullptr && budgets->evict_other_levels());
 
+  shader_textured_ = asset_manager_.LoadShader("shaders/textured");
   return true;
 }
 
-const Config &Game::GetConfig() const {
-  return *fpl::zooshi::GetConfig(config_source_.c_str());
+void Game::SelectTextureFormat(const AssetManifest &asset_manifest) {
+  texture_format_directory_.clear();
+  auto formats = asset_manifest.texture_formats();
+  if (formats == nullptr) return;
+  for (auto it = formats->begin(); it != formats->end(); ++it) {
+    bool supported = false;
+#ifdef __ANDROID__
+    supported =
+        it->gles3() && renderer_.feature_level() >= fplbase::kFeatureLevel30;
+#endif  // __ANDROID__
+    auto extensions = it->gl_extensions();
+    for (flatbuffers::uoffset_t i = 0;
+         extensions != nullptr && i < extensions->size() && !supported; ++i) {
+      supported = SDL_GL_ExtensionSupported(extensions->Get(i)->c_str());
+    }
+    if (supported) {
+      LogInfo("Using %s compressed textures.", it->name()->c_str());
+      texture_format_directory_ = it->directory()->c_str();
+      return;
+    }
+  }
 }
 
-const InputConfig &Game::GetInputConfig() const {
-  return *fpl::zooshi::GetInputConfig(input_config_source_.c_str());
-}
+const Config &Game::GetConfig() const { return *config_; }
+
+const InputConfig &Game::GetInputConfig() const { return *input_config_; }
 
 const AssetManifest &Game::GetAssetManifest() const {
-  return *fpl::zooshi::GetAssetManifest(asset_manifest_source_.c_str());
+  return *asset_manifest_;
 }
 
 void BreadboardLogFunc(const char *fmt, va_list args) { LogError(fmt, args); }
@@ -337,12 +374,41 @@ void Game::InitializeBreadboardModules() {
                          &world_.graph_component, &world_.scenery_component);
 }
 
+// Read the save file and bring up Firebase and its services. Only needs the
+// config, so it runs alongside the renderer's initialization.
+void Game::InitializeServices() {
+  // Read the save file once. From here on, settings and progress are saved
+  // in batches, rather than a write for every change.
+  save_store_.Load(kSaveAppName, kSaveFileName);
+  invites_listener_.Initialize(&save_store_);
+  resume_snapshot_.Load(kSaveAppName, kResumeFileName,
+                        GetConfig().resume_max_age());
+
+// Initialize Firebase and the services.
+#ifdef __ANDROID__
+  firebase_app_ =
+      firebase::App::Create(firebase::AppOptions(), fplbase::AndroidGetJNIEnv(),
+                            fplbase::AndroidGetActivity());
+#else
+  firebase_app_ = firebase::App::Create(firebase::AppOptions());
+#endif  // __ANDROID__
+  admob_helper_.Initialize(*firebase_app_);
+  firebase::analytics::Initialize(*firebase_app_);
+  firebase::invites::Initialize(*firebase_app_);
+  firebase::invites::SetListener(&invites_listener_);
+  firebase::messaging::Initialize(*firebase_app_, &message_listener_);
+  InitializeRemoteConfig(*firebase_app_);
+}
+
 // Pause the audio when the game loses focus.
 class AudioEngineVolumeControl {
  public:
-  AudioEngineVolumeControl(pindrop::AudioEngine *audio) : audio_(audio) {}
+  AudioEngineVolumeControl(pindrop::AudioEngine *audio,
+                           AudioThread *audio_thread)
+      : audio_(audio), audio_thread_(audio_thread) {}
   void operator()(void *userdata) {
     SDL_Event *event = static_cast<SDL_Event *>(userdata);
+    AudioEngineLock lock(audio_thread_);
     switch (event->type) {
       case SDL_APP_WILLENTERBACKGROUND:
         audio_->Pause(true);
@@ -357,11 +423,68 @@ class AudioEngineVolumeControl {
 
  private:
   pindrop::AudioEngine *audio_;
+  AudioThread *audio_thread_;
+};
+
+// Android may replace the GL context while the app is in the background, so
+// check for that when it comes back.
+class ResidencyCacheContextCheck {
+ public:
+  ResidencyCacheContextCheck(ResidencyCache *residency_cache)
+      : residency_cache_(residency_cache) {}
+  void operator()(void *userdata) {
+    SDL_Event *event = static_cast<SDL_Event *>(userdata);
+    if (event->type == SDL_APP_DIDENTERFOREGROUND) {
+      residency_cache_->set_check_context();
+    }
+  }
+
+ private:
+  ResidencyCache *residency_cache_;
+};
+
+// Save the game in progress when the app goes into the background, in case
+// it's killed there. If it comes back instead, the snapshot isn't needed.
+// App events arrive on the render thread with gameupdate_mutex_ held.
+class ResumeSnapshotControl {
+ public:
+  ResumeSnapshotControl(ResumeSnapshot *snapshot, World *world,
+                        StateMachine<kGameStateCount> *state_machine,
+                        fplbase::InputSystem *input)
+      : snapshot_(snapshot),
+        world_(world),
+        state_machine_(state_machine),
+        input_(input) {}
+  void operator()(void *userdata) {
+    SDL_Event *event = static_cast<SDL_Event *>(userdata);
+    switch (event->type) {
+      case SDL_APP_WILLENTERBACKGROUND: {
+        const int state = state_machine_->current_state_id();
+        // Cardboard sessions aren't resumed, since the headset is likely off.
+        if ((state == kGameStateGameplay || state == kGameStatePause) &&
+            world_->rendering_mode() == kRenderingMonoscopic) {
+          snapshot_->Save(world_, input_->Time() - world_->gameplay_start_time);
+        }
+        break;
+      }
+      case SDL_APP_DIDENTERFOREGROUND:
+        snapshot_->Clear();
+        break;
+      default:
+        break;
+    }
+  }
+
+ private:
+  ResumeSnapshot *snapshot_;
+  World *world_;
+  StateMachine<kGameStateCount> *state_machine_;
+  fplbase::InputSystem *input_;
 };
 
-// Initialize each member in turn. This is logically just one function, since
-// the order of initialization cannot be changed. However, it's nice for
-// debugging and readability to have each section lexographically separate.
+// Initialize each member in turn. The phases that are independent of the
+// renderer run in the background, and the rest in order. Each phase's time is
+// logged, since time to first frame is watched closely.
 bool Game::Initialize(const char *const binary_directory) {
   LogInfo("Zooshi Initializing...");
 #if defined(BENCHMARK_MOTIVE)
@@ -369,7 +492,11 @@ bool Game::Initialize(const char *const binary_directory) {
 #endif  // defined(BENCHMARK_MOTIVE)
 
   input_.Initialize();
-  input_.AddAppEventCallback(AudioEngineVolumeControl(&audio_engine_));
+  input_.AddAppEventCallback(
+      AudioEngineVolumeControl(&audio_engine_, &audio_thread_));
+  input_.AddAppEventCallback(ResumeSnapshotControl(
+      &resume_snapshot_, &world_, &state_machine_, &input_));
+  input_.AddAppEventCallback(ResidencyCacheContextCheck(&residency_cache_));
 #if FPLBASE_ANDROID_VR
   input_.head_mounted_display_input().EnableDeviceOrientationCorrection();
 #endif  // FPLBASE_ANDROID_VR
@@ -377,59 +504,100 @@ bool Game::Initialize(const char *const binary_directory) {
   SystraceInit();
 
   if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir)) return false;
+  overlay_index_.Load(overlay_name_);
+  trusted_assets_.Load();
 
-  if (!LoadFile(kConfigFileName, &config_source_)) return false;
-
-  if (!InitializeRenderer()) return false;
-
-  if (!LoadFile(GetConfig().input_config()->c_str(), &input_config_source_))
+  if (!MapFile(kConfigFileName, &config_file_)) return false;
+  config_ = fpl::zooshi::GetConfig(config_file_.data());
+  if (!MapFile(GetConfig().input_config()->c_str(), &input_config_file_))
     return false;
-
-  if (!LoadFile(GetConfig().assets_filename()->c_str(),
-                &asset_manifest_source_)) {
+  input_config_ = fpl::zooshi::GetInputConfig(input_config_file_.data());
+  if (!MapFile(GetConfig().assets_filename()->c_str(),
+               &asset_manifest_file_)) {
     return false;
   }
+  asset_manifest_ =
+      fpl::zooshi::GetAssetManifest(asset_manifest_file_.data());
   const auto &asset_manifest = GetAssetManifest();
 
-  if (!InitializeAssets()) return false;
-
-  if (!audio_engine_.Initialize(GetConfig().audio_config()->c_str())) {
+  // Audio, Firebase and the animations don't need the GL context or each
+  // other, so they're set up on workers while the main thread brings up the
+  // renderer and loads the assets that need it.
+  job_system_.Initialize(JobSystem::DefaultWorkerCount());
+  InitPhases phases(&job_system_);
+  // SDL's subsystems must be started on the main thread. Pindrop starts the
+  // audio one again when it opens the mixer, which then only counts it.
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+    LogError("SDL_InitSubSystem(SDL_INIT_AUDIO) failed: %s", SDL_GetError());
     return false;
   }
-  audio_engine_.LoadSoundBank(asset_manifest.sound_bank()->c_str());
-  audio_engine_.StartLoadingSoundFiles();
+  phases.RunInBackground("Audio", [this, &asset_manifest]() {
+    if (!audio_engine_.Initialize(GetConfig().audio_config()->c_str())) {
+      return false;
+    }
+    audio_engine_.LoadSoundBank(asset_manifest.sound_bank()->c_str());
+    audio_engine_.StartLoadingSoundFiles();
+    return true;
+  });
+  phases.RunInBackground("Services", [this]() {
+    InitializeServices();
+    return true;
+  });
+  phases.RunInBackground("Animations", [this, &asset_manifest]() {
+    // Load the animation table and all animations it references.
+    motive::AnimTable &anim_table = world_.animation_component.anim_table();
+    return anim_table.InitFromFlatBuffers(*asset_manifest.anims(),
+                                          LoadAnimFn);
+  });
+
+  bool initialized =
+      phases.Run("Renderer", [this]() { return InitializeRenderer(); }) &&
+      phases.Run("Assets", [this]() { return InitializeAssets(); }) &&
+      phases.Run("Fonts", [this, &asset_manifest]() {
+        for (size_t i = 0; i < asset_manifest.font_list()->size(); i++) {
+          flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
+          font_manager_.Open(asset_manifest.font_list()->Get(index)->c_str());
+        }
+        font_manager_.SetupHyphenationPatternPath("hyphen-data");
+        return true;
+      });
+  // The background phases use members, so they must finish even if the
+  // main thread's failed.
+  initialized = phases.Wait() && initialized;
+  if (!initialized) return false;
 
   InitializeBreadboardModules();
 
-  for (size_t i = 0; i < asset_manifest.font_list()->size(); i++) {
-    flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
-    font_manager_.Open(asset_manifest.font_list()->Get(index)->c_str());
-  }
-  font_manager_.SetupHyphenationPatternPath("hyphen-data");
-
-  SetPerformanceMode(fplbase::kHighPerformance);
-
-  scene_lab_.reset(new scene_lab::SceneLab());
-
-// Initialize Firebase and the services.
 #ifdef __ANDROID__
-  firebase_app_ =
-      firebase::App::Create(firebase::AppOptions(), fplbase::AndroidGetJNIEnv(),
-                            fplbase::AndroidGetActivity());
+  frame_pacer_.Initialize(GetConfig().frame_pacing(), true);
 #else
-  firebase_app_ = firebase::App::Create(firebase::AppOptions());
+  frame_pacer_.Initialize(GetConfig().frame_pacing(), false);
 #endif  // __ANDROID__
-  admob_helper_.Initialize(*firebase_app_);
-  firebase::analytics::Initialize(*firebase_app_);
-  firebase::invites::Initialize(*firebase_app_);
-  firebase::invites::SetListener(&invites_listener_);
-  firebase::messaging::Initialize(*firebase_app_, &message_listener_);
-  InitializeRemoteConfig(*firebase_app_);
+  fixed_timestep_.Initialize(GetConfig().fixed_timestep());
+  quality_governor_.Initialize(GetConfig().quality_governor());
+  SetPerformanceMode(frame_pacer_.on_battery() ? fplbase::kNormalPerformance
+                                               : fplbase::kHighPerformance);
+
+  scene_lab_.reset(new scene_lab::SceneLab());
 
+  audio_thread_.Initialize(&audio_engine_);
   world_.Initialize(GetConfig(), &input_, &asset_manager_, &world_renderer_,
                     &font_manager_, &audio_engine_, &graph_factory_, &renderer_,
                     scene_lab_.get(), &unlockable_manager_, &xp_system_,
-                    &invites_listener_, &message_listener_, &admob_helper_);
+                    &invites_listener_, &message_listener_, &admob_helper_,
+                    &job_system_, &audio_thread_);
+  world_.transform_interpolator.set_enabled(fixed_timestep_.interpolate());
+  world_.fixed_timestep = &fixed_timestep_;
+  world_.asset_loader = &asset_loader_;
+  world_.analytics = &analytics_;
+  world_.save_store = &save_store_;
+  world_.resume_snapshot = &resume_snapshot_;
+  world_.residency_cache = &residency_cache_;
+  world_.gl_uploader = &gl_uploader_;
+
+  // Record taps from here on, as SDL receives them.
+  tap_queue_.Initialize();
+  world_.player_component.set_input_recorder(&input_recorder_);
 
 #if FPLBASE_ANDROID_VR
   if (fplbase::SupportsHeadMountedDisplay()) {
@@ -449,6 +617,7 @@ bool Game::Initialize(const char *const binary_directory) {
     OnscreenController *onscreen_controller = new OnscreenController();
     onscreen_controller->set_input_config(&GetInputConfig());
     onscreen_controller->set_input_system(&input_);
+    onscreen_controller->set_tap_queue(&tap_queue_);
     onscreen_controller->set_enabled(!fplbase::SupportsHeadMountedDisplay() ||
                                      ZOOSHI_FORCE_ONSCREEN_CONTROLLER);
     world_.AddController(onscreen_controller);
@@ -464,6 +633,7 @@ bool Game::Initialize(const char *const binary_directory) {
     BasePlayerController *controller = new MouseController();
     controller->set_input_config(&GetInputConfig());
     controller->set_input_system(&input_);
+    controller->set_tap_queue(&tap_queue_);
     world_.AddController(controller);
   }
 #endif  // !defined(__ANDROID__) && !ZOOSHI_FORCE_ONSCREEN_CONTROLLER
@@ -477,7 +647,13 @@ bool Game::Initialize(const char *const binary_directory) {
   }
 #endif  // ANDROID_GAMEPAD
 
-  world_renderer_.Initialize(&world_);
+  world_renderer_.Initialize(&world_, renderer_);
+  asset_loader_.set_on_unload_mesh([this](fplbase::Mesh* mesh) {
+    world_renderer_.ReleaseMesh(mesh);
+  });
+  quality_governor_.Apply(&world_);
+  residency_cache_.Initialize(GetConfig().memory());
+  gl_uploader_.Initialize();
 
   scene_lab_->Initialize(GetConfig().scene_lab_config(), &asset_manager_,
                          &input_, &renderer_, &font_manager_);
@@ -496,14 +672,28 @@ bool Game::Initialize(const char *const binary_directory) {
 
   gpg_manager_.Initialize(false);
 
+  // Sign in and multiplayer can block on Java and the network, so they're
+  // updated on their own thread.
+  services_thread_.AddFrameTask([this]() { gpg_manager_.Update(); });
+#ifdef USING_GOOGLE_PLAY_GAMES
+  services_thread_.AddFrameTask([this]() {
+    if (world_.gpg_multiplayer != nullptr) world_.gpg_multiplayer->Update();
+  });
+#endif  // USING_GOOGLE_PLAY_GAMES
+  services_thread_.Initialize();
+  analytics_.set_services_thread(&services_thread_);
+  save_store_.set_services_thread(&services_thread_);
+  resume_snapshot_.set_services_thread(&services_thread_);
+
   auto fader_material =
       asset_manager_.FindMaterial(asset_manifest.fader_material()->c_str());
   assert(fader_material);
-  fader_.Init(fader_material, shader_textured_);
+  fader_.Init(fader_material);
+  world_.sprite_batch.Initialize(&asset_manager_);
 
   const Config *config = &GetConfig();
   loading_state_.Initialize(&input_, &world_, asset_manifest, &asset_manager_,
-                            &audio_engine_, shader_textured_, &fader_);
+                            shader_textured_, &fader_, &game_menu_state_);
   pause_state_.Initialize(&input_, &world_, config, &asset_manager_,
                           &font_manager_, &audio_engine_);
   gameplay_state_.Initialize(&input_, &world_, config, &GetInputConfig(),
@@ -525,10 +715,11 @@ bool Game::Initialize(const char *const binary_directory) {
   state_machine_.AssignState(kGameStateSceneLab, &scene_lab_state_);
   state_machine_.SetCurrentStateId(kGameStateLoading);
 
+  unlockable_manager_.set_save_store(&save_store_);
   unlockable_manager_.InitializeType(UnlockableType_Sushi,
                                      config->sushi_config());
 
-  xp_system_.Initialize(config);
+  xp_system_.Initialize(config, &save_store_);
 
 #if FPLBASE_ANDROID_VR
   if (fplbase::AndroidGetActivityName() ==
@@ -537,6 +728,8 @@ bool Game::Initialize(const char *const binary_directory) {
   }
 #endif  // FPLBASE_ANDROID_VR
 
+  phases.LogTimings();
+  analytics_.set_startup_time(phases.ElapsedTime());
   LogInfo("Initialization complete\n");
   return true;
 }
@@ -567,22 +760,27 @@ struct UpdateThreadData {
                    StateMachine<kGameStateCount> *statemachine_ptr,
                    fplbase::Renderer *renderer_ptr,
                    fplbase::InputSystem *input_ptr,
-                   pindrop::AudioEngine *audio_engine_ptr,
-                   GameSynchronization *sync_ptr)
+                   AudioThread *audio_thread_ptr,
+                   GameSynchronization *sync_ptr, FramePacer *frame_pacer_ptr,
+                   ServicesThread *services_thread_ptr)
       : game_exiting(exiting),
         world(world_ptr),
         state_machine(statemachine_ptr),
         renderer(renderer_ptr),
         input(input_ptr),
-        audio_engine(audio_engine_ptr),
-        sync(sync_ptr) {}
+        audio_thread(audio_thread_ptr),
+        sync(sync_ptr),
+        frame_pacer(frame_pacer_ptr),
+        services_thread(services_thread_ptr) {}
   bool *game_exiting;
   World *world;
   StateMachine<kGameStateCount> *state_machine;
   fplbase::Renderer *renderer;
   fplbase::InputSystem *input;
-  pindrop::AudioEngine *audio_engine;
+  AudioThread *audio_thread;
   GameSynchronization *sync;
+  FramePacer *frame_pacer;
+  ServicesThread *services_thread;
   corgi::WorldTime frame_start;
 };
 
@@ -591,7 +789,8 @@ static int UpdateThread(void *data) {
   UpdateThreadData *rt_data = static_cast<UpdateThreadData *>(data);
   GameSynchronization &sync = *rt_data->sync;
   int prev_update_time;
-  prev_update_time = CurrentWorldTime(*rt_data->input) - kMinUpdateTime;
+  prev_update_time = CurrentWorldTime(*rt_data->input) -
+                     rt_data->frame_pacer->min_update_time();
 #ifdef __ANDROID__
   JavaVM *jvm;
   JNIEnv *env = fplbase::AndroidGetJNIEnv();
@@ -606,10 +805,17 @@ static int UpdateThread(void *data) {
       nullptr;  // you might want to assign the java thread to a ThreadGroup
   jvm->AttachCurrentThread(&update_env, &args);
 #endif  // __ANDROID__
+  Profiler::Get().SetThreadName("Update");
 
-  SDL_LockMutex(sync.updatethread_mutex_);
   while (!*(rt_data->game_exiting)) {
-    SDL_CondWait(sync.start_update_cv_, sync.updatethread_mutex_);
+    // Only hold updatethread_mutex_ while waiting, so the render thread can
+    // request the next update while this one is still running.
+    SDL_LockMutex(sync.updatethread_mutex_);
+    while (!sync.update_requested_) {
+      SDL_CondWait(sync.start_update_cv_, sync.updatethread_mutex_);
+    }
+    sync.update_requested_ = false;
+    SDL_UnlockMutex(sync.updatethread_mutex_);
 
     // -------------------------------------------
     // Step 5b.  (See comment at the start of Run()
@@ -619,28 +825,46 @@ static int UpdateThread(void *data) {
     // -------------------------------------------
     SDL_LockMutex(sync.gameupdate_mutex_);
     const corgi::WorldTime world_time = CurrentWorldTime(*rt_data->input);
+    const corgi::WorldTime elapsed_time = world_time - prev_update_time;
     const corgi::WorldTime delta_time =
-        std::min(world_time - prev_update_time, kMaxUpdateTime);
+        std::min(elapsed_time, rt_data->frame_pacer->max_update_time());
     prev_update_time = world_time;
 
+    // Apply what the services thread has finished since the last update.
+    rt_data->services_thread->RunResults();
+
     SystraceAsyncBegin("UpdateGameState", kUpdateGameStateCode);
-    rt_data->state_machine->AdvanceFrame(delta_time);
+    Profiler::Get().Begin("UpdateGameState");
+    // The states run once a frame, so each input edge is handled once. The
+    // world splits the time into fixed steps itself. The states and graphs
+    // call pindrop directly, so the audio thread waits for them.
+    {
+      AudioEngineLock audio_lock(rt_data->audio_thread);
+      rt_data->state_machine->AdvanceFrame(delta_time);
+    }
+    Profiler::Get().End();
     SystraceAsyncEnd("UpdateGameState", kUpdateGameStateCode);
 
     SystraceAsyncBegin("UpdateRenderPrep", kUpdateRenderPrepCode);
+    Profiler::Get().Begin("UpdateRenderPrep");
     rt_data->state_machine->RenderPrep();
+    Profiler::Get().End();
     SystraceAsyncEnd("UpdateRenderPrep", kUpdateRenderPrepCode);
 
-    rt_data->audio_engine->AdvanceFrame(delta_time / 1000.0f);
+    // Only queues the frame; pindrop advances on the audio thread.
+    rt_data->audio_thread->AdvanceFrame(delta_time / 1000.0f);
 
     *(rt_data->game_exiting) |= rt_data->state_machine->done();
+
+    // Save everything this update changed in one write.
+    rt_data->world->save_store->Commit();
     SDL_UnlockMutex(sync.gameupdate_mutex_);
+    Profiler::Get().EndFrame();
   }
 
 #ifdef __ANDROID__
   jvm->DetachCurrentThread();
 #endif  // __ANDROID__
-  SDL_UnlockMutex(sync.updatethread_mutex_);
 
   return 0;
 }
@@ -651,19 +875,11 @@ void HandleVsync() {
   SDL_CondBroadcast(global_vsync_context->start_render_cv_);
 }
 
-// Hack, to simulate vsync events on non-android devices.
-static int VsyncSimulatorThread(void * /*data*/) {
-  while (true) {
-    HandleVsync();
-    SDL_Delay(2);
-  }
-  return 0;
-}
-
 // For performance, we're using multiple threads so that the game state can
 // be updating in the background while openGL renders.
 // The general plan is:
-// 1. Vsync happens.  Everything begins.
+// 1. The frame pacer decides the next frame is due, and on android, vsync
+//    happens.  Everything begins.
 // 2. Renderthread activates.  (The update thread is currently blocked.)
 // 3. Renderthread dumps everything into opengl, via RenderAllEntities.  (And
 //    any other similar calls, such as calls to IMGUI)  Updatethread is
@@ -671,19 +887,30 @@ static int VsyncSimulatorThread(void * /*data*/) {
 //    everything, and we can safely change world state data.
 // 4. Renderthread signals updatethread to wake up.
 // 5a.Renderthread calls gl_flush, (via Renderer.advanceframe) and waits for
-//    everything render.  Once complete, it goes to sleep and waits for the
-//    next vsync event.
+//    everything render.  Once complete, it goes to sleep until the next
+//    frame is due.
 // 5b.Updatethread goes and updates the game state and gets us all ready for
 //    next frame.  Once complete, it also goes to sleep and waits for the next
 //    vsync event.
+// Only step 5a overlaps the next update. Skinned and alpha meshes, the
+// river, particles and the UI are drawn from live component data, so steps 2
+// and 3 need the world to themselves. The update thread is woken through
+// GameSynchronization::update_requested_, so a wakeup sent before it waits
+// isn't lost.
+// TODO: Extract transforms, visibility and uniforms into a double-buffered
+// snapshot at the end of each update, and render from that without
+// gameupdate_mutex_, so the update fully overlaps Render(). That needs corgi's
+// RenderMeshComponent to draw from extracted state.
 void Game::Run() {
   // Start the update thread:
   UpdateThreadData rt_data(&game_exiting_, &world_, &state_machine_, &renderer_,
-                           &input_, &audio_engine_, &sync_);
+                           &input_, &audio_thread_, &sync_, &frame_pacer_,
+                           &services_thread_);
 
   input_.AdvanceFrame(&renderer_.window_size());
   state_machine_.AdvanceFrame(16);
 
+  audio_thread_.Start();
   SDL_Thread *update_thread =
       SDL_CreateThread(UpdateThread, "Zooshi Update Thread", &rt_data);
   if (!update_thread) {
@@ -698,69 +925,39 @@ void Game::Run() {
   last_printout = 0;
 #endif  // DISPLAY_FRAMERATE_HISTOGRAM
 
-  // variables used for regulating our framerate:
-  // Total size of our history, in frames:
-  const int kHistorySize = 60 * 5;
-  // Max number of frames we can have dropped in our history, before we
-  // switch to queue-stuffing mode, and ignore vsync pauses.
-  const int kMaxDroppedFrames = 3;
-  // Variable
-  bool missed_frame_history[kHistorySize];
-  for (int i = 0; i < kHistorySize; i++) {
-    missed_frame_history[i] = false;
-  }
-  int history_index = 0;
-  int total_dropped_frames = 0;
-
-  global_vsync_context = &sync_;
 #ifdef __ANDROID__
+  global_vsync_context = &sync_;
   fplbase::RegisterVsyncCallback(HandleVsync);
-#else
-  // We don't need this on android because we'll just get vsync events directly.
-  SDL_Thread *vsync_simulator_thread = SDL_CreateThread(
-      VsyncSimulatorThread, "Zooshi Simulated Vsync Thread", nullptr);
-  if (!vsync_simulator_thread) {
-    LogError("Error creating vsync simulator thread.");
-    assert(false);
-  }
 #endif  // __ANDROID__
-  int last_frame_id = 0;
+  bool on_battery = frame_pacer_.on_battery();
+  Profiler &profiler = Profiler::Get();
+  profiler.SetThreadName("Render");
 
   // We basically own the lock all the time, except when we're waiting
   // for a vsync event.
   SDL_LockMutex(sync_.renderthread_mutex_);
   while (!game_exiting_) {
-#ifdef __ANDROID__
-    int current_frame_id = fplbase::GetVsyncFrameId();
-#else
-    int current_frame_id = 0;
-#endif  // __ANDROID__
-    // Update our framerate history:
-    // The oldest value falls off and is replaced with the most recent frame.
-    // Also, we update our counts.
-    if (missed_frame_history[history_index]) {
-      total_dropped_frames--;
-    }
-    // We count it as a dropped frame if more than one vsync event passed since
-    // we started rendering it.  The check is implemented via equality
-    // comparisons because current_frame_id will eventually wrap.)
-    missed_frame_history[history_index] =
-        (current_frame_id != last_frame_id + 1) &&
-        (current_frame_id != last_frame_id);
-    if (missed_frame_history[history_index]) {
-      total_dropped_frames++;
-    }
-    history_index = (history_index + 1) % kHistorySize;
-    last_frame_id = current_frame_id;
-
     // -------------------------------------------
     // Steps 1, 2.
-    // Wait for start of frame.  (triggered at vsync start on android.)
-    // For performance, we only wait if we're not dropping frames.  Otherwise,
-    // we just keep rendering as fast as we can and stuff the render queue.
-    if (total_dropped_frames <= kMaxDroppedFrames) {
+    // Sleep until the next frame is due.  On android, the frame then starts
+    // on the next vsync.  If the last frame ran late, we skip that wait and
+    // stuff the render queue until we catch up.
+    frame_pacer_.WaitForNextFrame();
+#ifdef __ANDROID__
+    if (!frame_pacer_.behind()) {
       SDL_CondWait(sync_.start_render_cv_, sync_.renderthread_mutex_);
     }
+#endif  // __ANDROID__
+    frame_pacer_.StartFrame();
+    analytics_.CountFrame(frame_pacer_.last_frame_time(),
+                          frame_pacer_.behind());
+
+    // Save power when running on battery.
+    if (frame_pacer_.on_battery() != on_battery) {
+      on_battery = frame_pacer_.on_battery();
+      SetPerformanceMode(on_battery ? fplbase::kNormalPerformance
+                                    : fplbase::kHighPerformance);
+    }
 
     // Grab the lock to make sure the game isn't still updating.
     SDL_LockMutex(sync_.gameupdate_mutex_);
@@ -775,16 +972,46 @@ void Game::Run() {
     SystraceBegin("Input::AdvanceFrame()");
     input_.AdvanceFrame(&renderer_.window_size());
     game_exiting_ |= input_.exit_requested();
+    tap_queue_.set_window_size(renderer_.window_size());
     SystraceEnd();
 
     // Milliseconds elapsed since last update.
     rt_data.frame_start = CurrentWorldTimeSubFrame(input_);
 
+    // Put back the generated meshes before anything else makes GL objects in
+    // a replaced context.
+    if (residency_cache_.ContextLost()) {
+      gl_uploader_.ContextLost();
+      world_.river_component.RecoverMeshes(&residency_cache_);
+      residency_cache_.Recover(&world_.entity_manager);
+      // This frame was recorded with the meshes that were just replaced.
+      world_renderer_.ClearCollected();
+      world_renderer_.ContextLost();
+    }
+
+    asset_loader_.Update();
+    gl_uploader_.RunReady();
+
+    // Change quality level while the update thread can't be using it.
+    if (quality_governor_.Update(
+            frame_pacer_.last_work_time(),
+            1000.0f / static_cast<float>(frame_pacer_.frame_rate()))) {
+      quality_governor_.Apply(&world_);
+    }
+
+    // The update thread records input, so recording is toggled while it's
+    // locked out.
+    if (input_.GetButton(fplbase::FPLK_F7).went_down()) {
+      ToggleInputRecording();
+    }
+
     // -------------------------------------------
     // Step 3.
     // Render everything.
     // -------------------------------------------
+    const uint64_t render_start = SDL_GetPerformanceCounter();
     SystraceBegin("StateMachine::Render()");
+    profiler.Begin("Render");
 
     PushDebugMarker("Setup");
     fplbase::RenderTarget::ScreenRenderTarget(renderer_).SetAsRenderTarget();
@@ -792,21 +1019,38 @@ void Game::Run() {
     renderer_.SetCulling(fplbase::kCullingModeBack);
     PopDebugMarker();
 
+    world_.sprite_batch.Begin(renderer_.window_size());
+    world_.transform_interpolator.Apply(&world_.transform_component);
     state_machine_.Render(&renderer_);
+    world_.transform_interpolator.Restore(&world_.transform_component);
+    profiler.End();
     SystraceEnd();
+    const uint64_t render_ticks = SDL_GetPerformanceCounter() - render_start;
 
     SDL_UnlockMutex(sync_.gameupdate_mutex_);
 
     SystraceBegin("StateMachine::HandleUI()");
+    profiler.Begin("HandleUI");
     state_machine_.HandleUI(&renderer_);
+    // The HUD and fades that were queued go over everything else.
+    world_.sprite_batch.End(renderer_);
+    profiler.End();
     SystraceEnd();
 
+    if (profiler.enabled()) {
+      profiler.RenderOverlay(&asset_manager_, &font_manager_, &input_,
+                             GetConfig().license_font()->c_str());
+    }
+
     // -------------------------------------------
     // Step 4.
     // Signal the update thread that it is safe to start messing with
     // data, now that we've already handed it all off to openGL.
     // -------------------------------------------
+    SDL_LockMutex(sync_.updatethread_mutex_);
+    sync_.update_requested_ = true;
     SDL_CondBroadcast(sync_.start_update_cv_);
+    SDL_UnlockMutex(sync_.updatethread_mutex_);
 
     // -------------------------------------------
     // Step 5a.
@@ -816,18 +1060,38 @@ void Game::Run() {
     // preparing the world state for next frame.
     // -------------------------------------------
     SystraceBegin("AdvanceFrame");
+    profiler.Begin("AdvanceFrame");
     renderer_.AdvanceFrame(input_.minimized(), input_.Time());
+    world_renderer_.gpu_timer().EndFrame();
+    profiler.End();
     SystraceEnd();  // AdvanceFrame
 
+    // Trade resolution for frame time. The swap is left out of the CPU time,
+    // since with vsync it waits out the rest of the frame.
+    world_renderer_.dynamic_resolution().Update(
+        static_cast<float>(render_ticks * 1000.0 /
+                           SDL_GetPerformanceFrequency()),
+        world_renderer_.gpu_timer().frame_ms(),
+        1000.0f / static_cast<float>(frame_pacer_.frame_rate()));
+
     SystraceEnd();  // RenderFrame
 
-    gpg_manager_.Update();
+    services_thread_.Tick();
 
     // Process input device messages since the last game loop.
     // Update render window size.
     if (input_.GetButton(fplbase::FPLK_BACKQUOTE).went_down()) {
       ToggleRelativeMouseMode();
     }
+    if (input_.GetButton(fplbase::FPLK_F5).went_down()) {
+      profiler.set_enabled(!profiler.enabled());
+    }
+    if (input_.GetButton(fplbase::FPLK_F6).went_down()) {
+      ExportProfile();
+    }
+    if (input_.GetButton(fplbase::FPLK_F4).went_down()) {
+      MemoryTracker::Get().LogReport();
+    }
 
     int new_time = CurrentWorldTimeSubFrame(input_);
     int frame_time = new_time - rt_data.frame_start;
@@ -836,8 +1100,17 @@ void Game::Run() {
 #endif  // DISPLAY_FRAMERATE_HISTOGRAM
 
     SystraceCounter("FrameTime", frame_time);
+    profiler.EndFrame();
   }
   SDL_UnlockMutex(sync_.renderthread_mutex_);
+  services_thread_.Shutdown();
+  tap_queue_.Shutdown();
+  // Write whatever the services thread didn't get to. The update thread
+  // queues audio with the lock held, so that thread stops under it too.
+  SDL_LockMutex(sync_.gameupdate_mutex_);
+  audio_thread_.Shutdown();
+  save_store_.Flush();
+  SDL_UnlockMutex(sync_.gameupdate_mutex_);
 // Clean up asynchronous callbacks to prevent crashing on garbage data.
 #ifdef __ANDROID__
   fplbase::RegisterVsyncCallback(nullptr);
@@ -845,6 +1118,61 @@ void Game::Run() {
   input_.AddAppEventCallback(nullptr);
 }
 
+bool Game::RunBenchmark(const BenchmarkOptions &options) {
+  BenchmarkOptions bench_options = options;
+  if (bench_options.step_time <= 0 && fixed_timestep_.enabled()) {
+    bench_options.step_time = fixed_timestep_.step_time();
+  }
+  Benchmark benchmark;
+  benchmark.Initialize(&world_, &asset_manager_, &audio_engine_);
+  const bool ok = benchmark.Run(bench_options);
+  input_.AddAppEventCallback(nullptr);
+  return ok;
+}
+
+bool Game::RunMicrobenchmarks(const MicrobenchmarkOptions &options) {
+  Microbenchmark microbenchmark;
+  microbenchmark.Initialize(&world_, &asset_manager_, &audio_engine_);
+  const bool ok = microbenchmark.Run(options);
+  input_.AddAppEventCallback(nullptr);
+  return ok;
+}
+
+// Write the profiler's recent frames where the user can find them, to load
+// into chrome://tracing.
+void Game::ExportProfile() {
+  char *pref_path = SDL_GetPrefPath("Fun Propulsion Labs", "Zooshi");
+  if (pref_path == nullptr) {
+    LogError("Couldn't find a directory to write the profile to: %s",
+             SDL_GetError());
+    return;
+  }
+  const std::string filename = std::string(pref_path) + "trace.json";
+  SDL_free(pref_path);
+  Profiler::Get().ExportChromeTrace(filename.c_str());
+}
+
+void Game::ToggleInputRecording() {
+  if (!input_recorder_.recording()) {
+    input_recorder_.set_armed(!input_recorder_.armed());
+    LogInfo(input_recorder_.armed()
+                ? "Recording input from the start of the next game."
+                : "Not recording input.");
+    return;
+  }
+  char *pref_path = SDL_GetPrefPath("Fun Propulsion Labs", "Zooshi");
+  if (pref_path == nullptr) {
+    LogError("Couldn't find a directory to write the recording to: %s",
+             SDL_GetError());
+    return;
+  }
+  const std::string filename = std::string(pref_path) + "input.zooinput";
+  SDL_free(pref_path);
+  if (input_recorder_.Stop(filename.c_str())) {
+    LogInfo("Wrote input recording to %s", filename.c_str());
+  }
+}
+
 #if DISPLAY_FRAMERATE_HISTOGRAM
 static const int kSampleDuration = 5;  // in seconds
 static const int kTargetFPS = 60;      // Used for calculating dropped frames
@@ -904,19 +1232,40 @@ void Game::UpdateProfiling(corgi::WorldTime frame_time) {
 }
 #endif  // DISPLAY_FRAMERATE_HISTOGRAM
 
+static bool IsMaterial(const std::string &filename) {
+  const size_t length = sizeof(kMaterialExtension) - 1;
+  return filename.size() >= length &&
+         filename.compare(filename.size() - length, length,
+                          kMaterialExtension) == 0;
+}
+
+bool Game::MapOverride(const char *filename, MappedFile *file) {
+  // An overlay's own material overrides the base game's compressed one.
+  const bool compressed =
+      !texture_format_directory_.empty() && IsMaterial(filename);
+  if (compressed &&
+      overlay_index_.Map(texture_format_directory_ + filename, file)) {
+    return true;
+  }
+  if (overlay_index_.Map(filename, file)) return true;
+  return compressed &&
+         file->Open((texture_format_directory_ + filename).c_str());
+}
+
 bool Game::LoadFile(const char *filename, std::string *dest) {
-  const char *read_filename = filename;
-  std::string overlay;
-  if (!overlay_name_.empty()) {
-    overlay = "overlays/" + overlay_name_ + "/" + std::string(filename);
-    const char *overlay_filename = overlay.c_str();
-    auto handle = SDL_RWFromFile(overlay_filename, "rb");
-    if (handle) {
-      SDL_RWclose(handle);
-      read_filename = overlay_filename;
-    }
+  MappedFile file;
+  if (MapOverride(filename, &file)) {
+    dest->assign(file.data(), file.size());
+    return true;
   }
-  return fplbase::LoadFileRaw(read_filename, dest);
+  return fplbase::LoadFileRaw(filename, dest);
+}
+
+bool Game::MapFile(const char *filename, MappedFile *file) {
+  if (MapOverride(filename, file)) return true;
+  if (!file->Open(filename)) return false;
+  file->set_trusted(trusted_assets_.Contains(filename));
+  return true;
 }
 
 #if defined(__ANDROID__)
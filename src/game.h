@@ -18,28 +18,46 @@
 #include <math.h>
 
 #include "SDL_thread.h"
+#include "analytics.h"
+#include "asset_loader.h"
+#include "audio_thread.h"
+#include "benchmark.h"
 #include "breadboard/graph.h"
 #include "breadboard/module_registry.h"
 #include "camera.h"
 #include "config_generated.h"
 #include "corgi/entity_manager.h"
+#include "fixed_timestep.h"
 #include "flatbuffers/flatbuffers.h"
 #include "flatui/font_manager.h"
+#include "frame_pacer.h"
 #include "fplbase/asset_manager.h"
 #include "fplbase/input.h"
 #include "fplbase/renderer.h"
 #include "fplbase/utilities.h"
 #include "full_screen_fader.h"
+#include "gl_uploader.h"
+#include "inputcontrollers/input_recording.h"
+#include "inputcontrollers/tap_event_queue.h"
+#include "mapped_file.h"
 #include "mathfu/glsl_mappings.h"
+#include "microbenchmark.h"
 #include "module_library/default_graph_factory.h"
+#include "overlay_index.h"
 #include "pindrop/pindrop.h"
+#include "quality_governor.h"
 #include "rail_def_generated.h"
+#include "residency_cache.h"
+#include "resume_snapshot.h"
+#include "save_store.h"
+#include "services_thread.h"
 #include "states/intro_state.h"
 #include "states/loading_state.h"
 #include "states/pause_state.h"
 #include "states/scene_lab_state.h"
 #include "states/state_machine.h"
 #include "states/states.h"
+#include "trusted_assets.h"
 #include "world.h"
 #include "xp_system.h"
 
@@ -74,11 +92,6 @@ namespace zooshi {
 
 const auto kGPGDefaultLeaderboard = "LeaderboardMain";
 
-// On low RAM devices below the threshould value, the game applies a texture
-// scaling to reduce a memory footprint.
-const auto kLowRamProfileThreshold = 512;
-const auto kLowRamDeviceTextureScale = mathfu::vec2(0.5f, 0.5f);
-
 struct Config;
 struct InputConfig;
 struct AssetManifest;
@@ -90,6 +103,11 @@ struct GameSynchronization {
   SDL_mutex* gameupdate_mutex_;
   SDL_cond* start_render_cv_;
   SDL_cond* start_update_cv_;
+  // Set by the render thread once it has handed the world off to OpenGL, and
+  // cleared by the update thread when it starts updating. Guarded by
+  // updatethread_mutex_, so a request made while the update thread isn't yet
+  // waiting on start_update_cv_ isn't lost.
+  bool update_requested_;
   GameSynchronization();
 };
 
@@ -99,6 +117,14 @@ class Game {
   bool Initialize(const char* const binary_directory);
   void Run();
 
+  // Instead of Run(), play a level headlessly and report how long the
+  // simulation took. Returns false if the level couldn't be run.
+  bool RunBenchmark(const BenchmarkOptions& options);
+
+  // Instead of Run(), time the game's core kernels one at a time. Returns
+  // false if the level couldn't be loaded.
+  bool RunMicrobenchmarks(const MicrobenchmarkOptions& options);
+
   // Set the overlay directory name to optionally load assets from.
   static void SetOverlayName(const char* overlay_name) {
     overlay_name_ = overlay_name;
@@ -114,7 +140,9 @@ class Game {
  private:
   bool InitializeRenderer();
   bool InitializeAssets();
+  void SelectTextureFormat(const AssetManifest& asset_manifest);
   void InitializeBreadboardModules();
+  void InitializeServices();
 
   void Update(corgi::WorldTime delta_time);
   void UpdateMainCamera();
@@ -130,22 +158,36 @@ class Game {
   void ToggleRelativeMouseMode();
 
   void UpdateProfiling(corgi::WorldTime frame_time);
+  void ExportProfile();
+  // Record the player's input from the start of the next game, or stop and
+  // write the recording where ExportProfile() writes, for the benchmark to
+  // replay.
+  void ToggleInputRecording();
 
   // Overrides fplbase::LoadFile() in order to optionally load files from
-  // overlay directories.
+  // overlay directories, and materials with compressed textures.
   static bool LoadFile(const char* filename, std::string* dest);
 
+  // Like LoadFile(), but maps the file rather than copying it. Used by
+  // zooshi::MapFile().
+  static bool MapFile(const char* filename, MappedFile* file);
+
   // Mutexes/CVs used in synchronizing the render and update threads:
   GameSynchronization sync_;
 
   // Hold configuration binary data.
-  std::string config_source_;
+  MappedFile config_file_;
 
   // Hold the configuration for the input system data.
-  std::string input_config_source_;
+  MappedFile input_config_file_;
 
   // Hold the configuration for the asset manifest source.
-  std::string asset_manifest_source_;
+  MappedFile asset_manifest_file_;
+
+  // The root tables of the files above, found once when they're mapped.
+  const Config* config_;
+  const InputConfig* input_config_;
+  const AssetManifest* asset_manifest_;
 
   // The top level state machine that drives the game.
   StateMachine<kGameStateCount> state_machine_;
@@ -171,6 +213,9 @@ class Game {
   // Manage ownership and playing of audio assets.
   pindrop::AudioEngine audio_engine_;
 
+  // Advances audio_engine_ off the update thread. Must outlive world_.
+  AudioThread audio_thread_;
+
   // The event system.
   breadboard::ModuleRegistry module_registry_;
   breadboard::module_library::DefaultGraphFactory graph_factory_;
@@ -196,9 +241,32 @@ class Game {
 
   pindrop::AudioConfig* audio_config_;
 
+  // Decides when the render thread starts each frame.
+  FramePacer frame_pacer_;
+
+  // Splits the time between frames into simulation steps.
+  FixedTimestep fixed_timestep_;
+
+  // Trades rendering and simulation quality for frame time and heat.
+  QualityGovernor quality_governor_;
+
+  // Streams in the manifest's asset groups. Must outlive world_.
+  AssetLoader asset_loader_;
+
+  // Worker threads for the update thread. Must outlive world_.
+  JobSystem job_system_;
+
+  // Copies of the river's meshes, to upload again if the GL context is lost.
+  // Must outlive world_.
+  ResidencyCache residency_cache_;
+
   World world_;
   WorldRenderer world_renderer_;
 
+  // Makes the river's GL buffers on a thread with a shared context. Declared
+  // after world_, so its thread stops before the world is destroyed.
+  GlUploader gl_uploader_;
+
   // Fade the screen to back and from black.
   FullScreenFader fader_;
 
@@ -212,9 +280,45 @@ class Game {
   // Google Play Game Services Manager.
   GPGManager gpg_manager_;
 
+  // Taps as they happen, for the controllers that throw on taps.
+  TapEventQueue tap_queue_;
+
+  // Records gameplay input while toggled on. Only touched with
+  // gameupdate_mutex_ held.
+  InputRecorder input_recorder_;
+
+  // The player's settings and progress, written from services_thread_.
+  SaveStore save_store_;
+
+  // The game in progress, written from services_thread_ when the app goes
+  // into the background.
+  ResumeSnapshot resume_snapshot_;
+
+  // Updates gpg_manager_ and multiplayer off the render thread, and writes
+  // save_store_ and resume_snapshot_. Declared after them, so it stops before
+  // they're destroyed.
+  ServicesThread services_thread_;
+
+  // Gameplay's analytics counts, sent from services_thread_.
+  AnalyticsBuffer analytics_;
+
   // Name of the optional overlay to load assets from.
   static std::string overlay_name_;
 
+  // Directory of the materials that use textures compressed for this GPU, or
+  // empty if none of the compressed formats are supported.
+  static std::string texture_format_directory_;
+
+  // The files in the overlay, indexed once the assets directory is found.
+  static OverlayIndex overlay_index_;
+
+  // The game's own files that needn't be verified when they're loaded.
+  static TrustedAssets trusted_assets_;
+
+  // Open the file in the overlay or the compressed texture directory that
+  // overrides `filename`, if there is one.
+  static bool MapOverride(const char* filename, MappedFile* file);
+
   // The progression system to track unlockables.
   UnlockableManager unlockable_manager_;
 
@@ -0,0 +1,328 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gl_uploader.h"
+
+#include <stdint.h>
+#include <string>
+#include "fplbase/glplatform.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+#if defined(_WIN32)
+#define ZOOSHI_GL_APIENTRY __stdcall
+#else
+#define ZOOSHI_GL_APIENTRY
+#endif  // defined(_WIN32)
+
+// Enums from sync objects (GLES 3, GL 3.2 and GL_APPLE_sync), which aren't in
+// every GL header.
+static const GLenum kSyncGpuCommandsComplete = 0x9117;
+static const GLenum kAlreadySignaled = 0x911A;
+static const GLenum kConditionSatisfied = 0x911C;
+
+typedef void*(ZOOSHI_GL_APIENTRY* FenceSyncFunc)(GLenum condition,
+                                                 GLbitfield flags);
+typedef GLenum(ZOOSHI_GL_APIENTRY* ClientWaitSyncFunc)(void* sync,
+                                                       GLbitfield flags,
+                                                       uint64_t timeout);
+typedef void(ZOOSHI_GL_APIENTRY* DeleteSyncFunc)(void* sync);
+
+// The functions are the same for every context, so they're shared.
+static FenceSyncFunc fence_sync = nullptr;
+static ClientWaitSyncFunc client_wait_sync = nullptr;
+static DeleteSyncFunc delete_sync = nullptr;
+
+// Look up the sync functions, with `suffix` appended to their names.
+static bool LoadSyncFunctions(const char* suffix) {
+  std::string name;
+#define ZOOSHI_LOAD_GL_FUNCTION(var, type, function) \
+  name = std::string(function) + suffix;             \
+  var = reinterpret_cast<type>(SDL_GL_GetProcAddress(name.c_str()));
+  ZOOSHI_LOAD_GL_FUNCTION(fence_sync, FenceSyncFunc, "glFenceSync");
+  ZOOSHI_LOAD_GL_FUNCTION(client_wait_sync, ClientWaitSyncFunc,
+                          "glClientWaitSync");
+  ZOOSHI_LOAD_GL_FUNCTION(delete_sync, DeleteSyncFunc, "glDeleteSync");
+#undef ZOOSHI_LOAD_GL_FUNCTION
+  if (fence_sync && client_wait_sync && delete_sync) return true;
+  fence_sync = nullptr;
+  client_wait_sync = nullptr;
+  delete_sync = nullptr;
+  return false;
+}
+
+GlUploader::GlUploader()
+    : thread_(nullptr),
+      mutex_(SDL_CreateMutex()),
+      work_cv_(SDL_CreateCond()),
+      exiting_(false),
+      started_(false),
+      current_(false) {
+#ifdef __ANDROID__
+  display_ = EGL_NO_DISPLAY;
+  surface_ = EGL_NO_SURFACE;
+  context_ = EGL_NO_CONTEXT;
+#else
+  window_ = nullptr;
+  context_ = nullptr;
+#endif  // __ANDROID__
+}
+
+GlUploader::~GlUploader() {
+  Shutdown();
+  SDL_DestroyCond(work_cv_);
+  SDL_DestroyMutex(mutex_);
+}
+
+bool GlUploader::Initialize() {
+  Shutdown();
+  if (SDL_GL_ExtensionSupported("GL_APPLE_sync")) {
+    LoadSyncFunctions("APPLE");
+  } else {
+    LoadSyncFunctions("");
+  }
+  if (!CreateContext()) {
+    LogInfo("Couldn't share a GL context; uploading on the render thread.");
+    return false;
+  }
+
+  exiting_ = false;
+  started_ = false;
+  current_ = false;
+  thread_ = SDL_CreateThread(ThreadMain, "Zooshi Upload Thread", this);
+  if (thread_ == nullptr) {
+    DestroyContext();
+    return false;
+  }
+  // Wait to hear whether the context could be made current on the thread.
+  SDL_LockMutex(mutex_);
+  while (!started_) SDL_CondWait(work_cv_, mutex_);
+  const bool current = current_;
+  SDL_UnlockMutex(mutex_);
+  if (!current) {
+    LogInfo("Couldn't use a shared GL context; uploading on the render "
+            "thread.");
+    StopThread();
+    DestroyContext();
+    return false;
+  }
+  return true;
+}
+
+void GlUploader::Shutdown() {
+  StopThread();
+  std::vector<Job> failed(finished_.begin(), finished_.end());
+  failed.insert(failed.end(), queued_.begin(), queued_.end());
+  finished_.clear();
+  queued_.clear();
+  for (auto it = failed.begin(); it != failed.end(); ++it) {
+    if (it->fence != nullptr) delete_sync(it->fence);
+  }
+  DestroyContext();
+  // Their callbacks own what was being uploaded, so they're still called to
+  // free it.
+  for (auto it = failed.begin(); it != failed.end(); ++it) it->ready(false);
+}
+
+void GlUploader::StopThread() {
+  if (thread_ == nullptr) return;
+  SDL_LockMutex(mutex_);
+  exiting_ = true;
+  SDL_CondSignal(work_cv_);
+  SDL_UnlockMutex(mutex_);
+  SDL_WaitThread(thread_, nullptr);
+  thread_ = nullptr;
+}
+
+void GlUploader::Queue(const Upload& upload, const Ready& ready) {
+  if (thread_ == nullptr) {
+    upload();
+    ready(true);
+    return;
+  }
+  SDL_LockMutex(mutex_);
+  queued_.push_back(Job());
+  queued_.back().upload = upload;
+  queued_.back().ready = ready;
+  SDL_CondSignal(work_cv_);
+  SDL_UnlockMutex(mutex_);
+}
+
+void GlUploader::RunReady() {
+  ready_.clear();
+  SDL_LockMutex(mutex_);
+  while (!finished_.empty()) {
+    Job& job = finished_.front();
+    if (job.fence != nullptr) {
+      const GLenum status = client_wait_sync(job.fence, 0, 0);
+      if (status != kAlreadySignaled && status != kConditionSatisfied) break;
+      delete_sync(job.fence);
+      job.fence = nullptr;
+    }
+    ready_.push_back(Job());
+    std::swap(ready_.back(), job);
+    finished_.pop_front();
+  }
+  SDL_UnlockMutex(mutex_);
+  // Called back without the lock, so the callbacks can queue more.
+  for (auto it = ready_.begin(); it != ready_.end(); ++it) it->ready(true);
+  ready_.clear();
+}
+
+void GlUploader::ContextLost() {
+  if (thread_ == nullptr) return;
+  // Let the upload in progress finish, so nothing more goes to the old
+  // context.
+  StopThread();
+  // Fences from the lost context mean nothing in the new one, so they're
+  // dropped along with the jobs.
+  std::vector<Job> failed(finished_.begin(), finished_.end());
+  failed.insert(failed.end(), queued_.begin(), queued_.end());
+  finished_.clear();
+  queued_.clear();
+  // The old context's objects are gone, so it's abandoned rather than
+  // destroyed along with them.
+#ifdef __ANDROID__
+  context_ = EGL_NO_CONTEXT;
+  surface_ = EGL_NO_SURFACE;
+#else
+  context_ = nullptr;
+#endif  // __ANDROID__
+
+  for (auto it = failed.begin(); it != failed.end(); ++it) it->ready(false);
+  Initialize();
+}
+
+int GlUploader::ThreadMain(void* data) {
+  GlUploader* uploader = static_cast<GlUploader*>(data);
+  const bool current = uploader->MakeCurrent();
+  SDL_LockMutex(uploader->mutex_);
+  uploader->started_ = true;
+  uploader->current_ = current;
+  SDL_CondBroadcast(uploader->work_cv_);
+  while (current && !uploader->exiting_) {
+    if (uploader->queued_.empty()) {
+      SDL_CondWait(uploader->work_cv_, uploader->mutex_);
+      continue;
+    }
+    Job job;
+    std::swap(job, uploader->queued_.front());
+    uploader->queued_.pop_front();
+    SDL_UnlockMutex(uploader->mutex_);
+
+    job.upload();
+    if (fence_sync != nullptr) {
+      job.fence = fence_sync(kSyncGpuCommandsComplete, 0);
+      // The fence can't signal until it's been sent to the GPU.
+      glFlush();
+    } else {
+      glFinish();
+    }
+
+    SDL_LockMutex(uploader->mutex_);
+    uploader->finished_.push_back(Job());
+    std::swap(uploader->finished_.back(), job);
+  }
+  SDL_UnlockMutex(uploader->mutex_);
+  if (current) uploader->ReleaseCurrent();
+  return 0;
+}
+
+#ifdef __ANDROID__
+
+bool GlUploader::CreateContext() {
+  display_ = eglGetCurrentDisplay();
+  const EGLContext shared = eglGetCurrentContext();
+  if (display_ == EGL_NO_DISPLAY || shared == EGL_NO_CONTEXT) return false;
+
+  // Share the render thread's config and GLES version.
+  EGLint config_id = 0;
+  EGLint client_version = 2;
+  eglQueryContext(display_, shared, EGL_CONFIG_ID, &config_id);
+  eglQueryContext(display_, shared, EGL_CONTEXT_CLIENT_VERSION,
+                  &client_version);
+  const EGLint config_attributes[] = {EGL_CONFIG_ID, config_id, EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display_, config_attributes, &config, 1,
+                       &num_configs) ||
+      num_configs < 1) {
+    return false;
+  }
+
+  const EGLint surface_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+  surface_ = eglCreatePbufferSurface(display_, config, surface_attributes);
+  const EGLint context_attributes[] = {EGL_CONTEXT_CLIENT_VERSION,
+                                       client_version, EGL_NONE};
+  if (surface_ != EGL_NO_SURFACE) {
+    context_ =
+        eglCreateContext(display_, config, shared, context_attributes);
+  }
+  if (context_ == EGL_NO_CONTEXT) {
+    DestroyContext();
+    return false;
+  }
+  return true;
+}
+
+void GlUploader::DestroyContext() {
+  if (context_ != EGL_NO_CONTEXT) eglDestroyContext(display_, context_);
+  if (surface_ != EGL_NO_SURFACE) eglDestroySurface(display_, surface_);
+  context_ = EGL_NO_CONTEXT;
+  surface_ = EGL_NO_SURFACE;
+}
+
+bool GlUploader::MakeCurrent() {
+  return eglMakeCurrent(display_, surface_, surface_, context_) == EGL_TRUE;
+}
+
+void GlUploader::ReleaseCurrent() {
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglReleaseThread();
+}
+
+#else
+
+bool GlUploader::CreateContext() {
+  window_ = SDL_GL_GetCurrentWindow();
+  const SDL_GLContext shared = SDL_GL_GetCurrentContext();
+  if (window_ == nullptr || shared == nullptr) return false;
+  // Creating the context makes it current, so the render thread's is made
+  // current again straight after.
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+  context_ = SDL_GL_CreateContext(window_);
+  SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+  SDL_GL_MakeCurrent(window_, shared);
+  return context_ != nullptr;
+}
+
+void GlUploader::DestroyContext() {
+  if (context_ != nullptr) SDL_GL_DeleteContext(context_);
+  context_ = nullptr;
+}
+
+bool GlUploader::MakeCurrent() {
+  return SDL_GL_MakeCurrent(window_, context_) == 0;
+}
+
+void GlUploader::ReleaseCurrent() { SDL_GL_MakeCurrent(window_, nullptr); }
+
+#endif  // __ANDROID__
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,118 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_GL_UPLOADER_H_
+#define ZOOSHI_GL_UPLOADER_H_
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
+#include "SDL_video.h"
+
+#ifdef __ANDROID__
+#include <EGL/egl.h>
+#endif  // __ANDROID__
+
+namespace fpl {
+namespace zooshi {
+
+// Uploads buffers and textures on a thread of its own, with a GL context
+// that shares objects with the render thread's, so big uploads don't hold up
+// a frame. Each upload is followed by a fence, and its `ready` callback only
+// runs once the render thread can see what was uploaded.
+//
+// On Android the context draws to a small pbuffer, as the window's surface
+// can only be current on one thread. If a shared context can't be made,
+// uploads run on the render thread as soon as they're queued.
+class GlUploader {
+ public:
+  // Runs on the upload thread, or the render thread without one. Must only
+  // create GL objects and fill them; the render thread may be drawing.
+  typedef std::function<void()> Upload;
+  // Runs on the render thread. `uploaded` is false if the GL context was lost
+  // before the upload could be used, so any objects it made are stale.
+  typedef std::function<void(bool uploaded)> Ready;
+
+  GlUploader();
+  ~GlUploader();
+
+  // Make the shared context and start the thread. Call on the render thread,
+  // with its context current. Returns false if uploads will be done on the
+  // render thread instead.
+  bool Initialize();
+  // Stop the thread. Uploads that haven't been called back are failed.
+  void Shutdown();
+
+  // True if uploads run on the upload thread.
+  bool threaded() const { return thread_ != nullptr; }
+
+  void Queue(const Upload& upload, const Ready& ready);
+
+  // Call the `ready` callbacks of finished uploads, in the order they were
+  // queued. Call once a frame on the render thread, while the update thread
+  // is waiting.
+  void RunReady();
+
+  // Fail every queued upload after the GL context was lost, and share a new
+  // context with the current one. Call on the render thread, before anything
+  // is uploaded to the new context.
+  void ContextLost();
+
+ private:
+  struct Job {
+    Job() : fence(nullptr) {}
+    Upload upload;
+    Ready ready;
+    // Signalled once the upload has reached the GPU. Null if fences aren't
+    // supported, in which case the upload thread waits with glFinish().
+    void* fence;
+  };
+
+  bool CreateContext();
+  void DestroyContext();
+  bool MakeCurrent();
+  void ReleaseCurrent();
+  void StopThread();
+  static int ThreadMain(void* data);
+
+  SDL_Thread* thread_;
+  SDL_mutex* mutex_;
+  SDL_cond* work_cv_;
+  // Guarded by `mutex_`.
+  bool exiting_;
+  // Set once the thread has tried to make its context current.
+  bool started_;
+  bool current_;
+  std::deque<Job> queued_;
+  std::deque<Job> finished_;
+
+  // Jobs RunReady() is calling back, kept to reuse the allocation.
+  std::vector<Job> ready_;
+
+#ifdef __ANDROID__
+  EGLDisplay display_;
+  EGLSurface surface_;
+  EGLContext context_;
+#else
+  SDL_Window* window_;
+  SDL_GLContext context_;
+#endif  // __ANDROID__
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_GL_UPLOADER_H_
@@ -21,9 +21,9 @@
 namespace fpl {
 
 GPGMultiplayer::GPGMultiplayer()
-    : message_mutex_(PTHREAD_MUTEX_INITIALIZER),
-      instance_mutex_(PTHREAD_MUTEX_INITIALIZER),
-      state_mutex_(PTHREAD_MUTEX_INITIALIZER) {}
+    : incoming_messages_(kIncomingMessageCapacity),
+      next_states_(kNextStateCapacity),
+      instance_mutex_(PTHREAD_MUTEX_INITIALIZER) {}
 
 bool GPGMultiplayer::Initialize(const std::string& service_id) {
   state_ = kIdle;
@@ -89,15 +89,13 @@ void GPGMultiplayer::ResetToIdle() {
 
   pthread_mutex_lock(&instance_mutex_);
   connected_instances_.clear();
-  connected_instances_reverse_.clear();
+  UpdateConnectedInstances();
   instance_names_.clear();
   pending_instances_.clear();
   discovered_instances_.clear();
   pthread_mutex_unlock(&instance_mutex_);
 
-  pthread_mutex_lock(&message_mutex_);
-  while (!incoming_messages_.empty()) incoming_messages_.pop();
-  pthread_mutex_unlock(&message_mutex_);
+  while (incoming_messages_.Front() != nullptr) incoming_messages_.Pop();
 }
 
 void GPGMultiplayer::DisconnectInstance(const std::string& instance_id) {
@@ -226,17 +224,14 @@ void GPGMultiplayer::RejectAllConnectionRequests() {
 
 // Call me once a frame!
 void GPGMultiplayer::Update() {
-  pthread_mutex_lock(&state_mutex_);  // unlocked in two places below
-  if (!next_states_.empty()) {
+  const MultiplayerState* queued_state = next_states_.Front();
+  if (queued_state != nullptr) {
     // Transition at most one state per frame.
-    MultiplayerState next_state = next_states_.front();
-    next_states_.pop();
-    pthread_mutex_unlock(&state_mutex_);
+    MultiplayerState next_state = *queued_state;
+    next_states_.Pop();
     LogInfo("GPGMultiplayer: Exiting state %d to enter state %d", state(),
              next_state);
     TransitionState(state(), next_state);
-  } else {
-    pthread_mutex_unlock(&state_mutex_);
   }
 
   // Now update based on what state we are in.
@@ -487,9 +482,11 @@ void GPGMultiplayer::TransitionState(MultiplayerState old_state,
 }
 
 void GPGMultiplayer::QueueNextState(MultiplayerState next_state) {
-  pthread_mutex_lock(&state_mutex_);
-  next_states_.push(next_state);
-  pthread_mutex_unlock(&state_mutex_);
+  if (!next_states_.Push(
+          [next_state](MultiplayerState* state) { *state = next_state; })) {
+    LogError("GPGMultiplayer: Too many queued states, dropped state %d",
+             next_state);
+  }
 }
 
 bool GPGMultiplayer::SendMessage(const std::string& instance_id,
@@ -511,30 +508,43 @@ bool GPGMultiplayer::SendMessage(const std::string& instance_id,
 
 void GPGMultiplayer::BroadcastMessage(const std::vector<uint8_t>& payload,
                                       bool reliable) {
+  // Hold a reference to the recipient list rather than copying it, so
+  // broadcasting doesn't allocate.
   pthread_mutex_lock(&instance_mutex_);
-  std::vector<std::string> all_instances{connected_instances_.begin(),
-                                         connected_instances_.end()};
+  std::shared_ptr<const std::vector<std::string>> all_instances =
+      broadcast_instances_;
   pthread_mutex_unlock(&instance_mutex_);
+  if (all_instances == nullptr || all_instances->empty()) return;
+
   if (reliable) {
-    nearby_connections_->SendReliableMessage(all_instances, payload);
+    nearby_connections_->SendReliableMessage(*all_instances, payload);
   } else {
-    nearby_connections_->SendUnreliableMessage(all_instances, payload);
+    nearby_connections_->SendUnreliableMessage(*all_instances, payload);
   }
 }
 
+bool GPGMultiplayer::SendMessage(const std::string& instance_id,
+                                 const uint8_t* data, size_t size,
+                                 bool reliable) {
+  send_buffer_.assign(data, data + size);
+  return SendMessage(instance_id, send_buffer_, reliable);
+}
+
+void GPGMultiplayer::BroadcastMessage(const uint8_t* data, size_t size,
+                                      bool reliable) {
+  send_buffer_.assign(data, data + size);
+  BroadcastMessage(send_buffer_, reliable);
+}
+
 bool GPGMultiplayer::HasMessage() {
-  pthread_mutex_lock(&message_mutex_);
-  bool empty = incoming_messages_.empty();
-  pthread_mutex_unlock(&message_mutex_);
-  return !empty;
+  return incoming_messages_.Front() != nullptr;
 }
 
 GPGMultiplayer::SenderAndMessage GPGMultiplayer::GetNextMessage() {
-  if (HasMessage()) {
-    pthread_mutex_lock(&message_mutex_);
-    auto message = incoming_messages_.front();
-    incoming_messages_.pop();
-    pthread_mutex_unlock(&message_mutex_);
+  SenderAndMessage* queued = incoming_messages_.Front();
+  if (queued != nullptr) {
+    SenderAndMessage message = std::move(*queued);
+    incoming_messages_.Pop();
     return message;
   } else {
     SenderAndMessage blank{"", {}};
@@ -542,6 +552,22 @@ GPGMultiplayer::SenderAndMessage GPGMultiplayer::GetNextMessage() {
   }
 }
 
+size_t GPGMultiplayer::DrainMessages(
+    std::vector<SenderAndMessage>* messages) {
+  size_t count = 0;
+  for (SenderAndMessage* queued = incoming_messages_.Front(); queued != nullptr;
+       queued = incoming_messages_.Front()) {
+    if (count == messages->size()) messages->resize(count + 1);
+    // Swap rather than copy, so the queue's slot keeps the caller's old
+    // buffers to fill next time.
+    std::swap((*messages)[count], *queued);
+    incoming_messages_.Pop();
+    count++;
+  }
+  messages->resize(count);
+  return count;
+}
+
 bool GPGMultiplayer::HasReconnectedPlayer() {
   pthread_mutex_lock(&instance_mutex_);
   bool has_reconnected_player = !reconnected_players_.empty();
@@ -644,9 +670,16 @@ void GPGMultiplayer::ConnectionResponseCallback(
 void GPGMultiplayer::MessageReceivedCallback(
     const std::string& instance_id, std::vector<uint8_t> const& payload,
     bool is_reliable) {
-  pthread_mutex_lock(&message_mutex_);
-  incoming_messages_.push({instance_id, payload});
-  pthread_mutex_unlock(&message_mutex_);
+  // Reuse the slot's buffers, which only grow to fit the largest message.
+  const bool queued =
+      incoming_messages_.Push([&](SenderAndMessage* message) {
+        message->first.assign(instance_id);
+        message->second.assign(payload.begin(), payload.end());
+      });
+  if (!queued) {
+    LogError("GPGMultiplayer: Incoming message queue full, dropped a message "
+             "from %s", instance_id.c_str());
+  }
 }
 
 // Callback on host or client when a connected instance disconnects.
@@ -690,9 +723,16 @@ void GPGMultiplayer::DisconnectedCallback(const std::string& instance_id) {
 // Important: make sure you lock instance_mutex_ before calling this.
 void GPGMultiplayer::UpdateConnectedInstances() {
   connected_instances_reverse_.clear();
+  std::shared_ptr<std::vector<std::string>> broadcast_instances(
+      new std::vector<std::string>());
   for (unsigned int i = 0; i < connected_instances_.size(); i++) {
     connected_instances_reverse_[connected_instances_[i]] = i;
+    // Skip the placeholders left for disconnected instances.
+    if (connected_instances_[i] != "") {
+      broadcast_instances->push_back(connected_instances_[i]);
+    }
   }
+  broadcast_instances_ = broadcast_instances;
 }
 
 // Important: make sure you lock instance_mutex_ before calling this.
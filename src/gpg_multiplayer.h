@@ -46,14 +46,20 @@
 // send a message to all other users (as either host or client), call
 // BroadcastMessage. Only the host can see all the players.
 //
-// To receive, call HasMessage() to check if there are any messages available,
-// then GetNextMessage() to get the next incoming message from the queue.
+// To receive, call DrainMessages() once a frame to take every message that
+// has arrived, or HasMessage() and GetNextMessage() to take them one at a
+// time. Incoming messages are passed from the callback threads through a
+// lock-free queue, and their buffers are reused, so receiving doesn't lock or
+// allocate once the queue has warmed up.
 
 #ifndef GPG_MULTIPLAYER_H
 #define GPG_MULTIPLAYER_H
 
+#include <stdint.h>
+#include <atomic>
 #include <list>
 #include <map>
+#include <memory>
 #include <queue>
 #include <string>
 #include <vector>
@@ -96,7 +102,7 @@ class GPGMultiplayer {
     kDialogWaiting,
   };
 
-  // Initializes mutexes only.
+  // Initializes mutexes and queues only.
   GPGMultiplayer();
 
   // Initialize the connection manager, set up callbacks, etc.
@@ -185,6 +191,13 @@ class GPGMultiplayer {
   // For the host: broadcast to all clients. For the client, sends just to host.
   void BroadcastMessage(const std::vector<uint8_t>& payload, bool reliable);
 
+  // As above, but send `size` bytes straight from `data`, such as a
+  // FlatBufferBuilder's finished buffer. The bytes are copied into a buffer
+  // that's reused from send to send, so call these from one thread only.
+  bool SendMessage(const std::string& instance_id, const uint8_t* data,
+                   size_t size, bool reliable);
+  void BroadcastMessage(const uint8_t* data, size_t size, bool reliable);
+
   // Returns true if there are one or more messages available in the queue.
   // You would then call GetNextMessage() to retrieve the next message.
   bool HasMessage();
@@ -193,6 +206,12 @@ class GPGMultiplayer {
   // none.
   SenderAndMessage GetNextMessage();
 
+  // Move every message in the queue into `messages`, in the order they were
+  // received, and return how many there were. `messages` is resized to fit.
+  // Its old buffers are handed back to the queue, so keep the same vector
+  // from frame to frame to avoid allocating.
+  size_t DrainMessages(std::vector<SenderAndMessage>* messages);
+
   // Returns true if a player has just reconnected.
   bool HasReconnectedPlayer();
 
@@ -227,7 +246,81 @@ class GPGMultiplayer {
   bool allow_reconnecting() const { return allow_reconnecting_; }
 
  private:
-  typedef std::queue<SenderAndMessage> MessageQueue;
+  // How many messages can wait to be received. Messages that arrive while the
+  // queue is full are dropped.
+  static const size_t kIncomingMessageCapacity = 1024;
+  // How many state changes can wait for Update().
+  static const size_t kNextStateCapacity = 16;
+
+  // A fixed-size queue that any thread can push to without locking, and one
+  // thread pops from. Each slot's value stays in place between uses, so
+  // values that own buffers keep them.
+  template <typename T>
+  class BoundedQueue {
+   public:
+    // `capacity` must be a power of two.
+    explicit BoundedQueue(size_t capacity)
+        : slots_(new Slot[capacity]), mask_(capacity - 1), head_(0), tail_(0) {
+      for (size_t i = 0; i < capacity; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    // Claim a slot and pass its value to `fill`. Returns false, without
+    // calling `fill`, if the queue is full.
+    template <typename Fill>
+    bool Push(const Fill& fill) {
+      Slot* slot;
+      size_t position = tail_.load(std::memory_order_relaxed);
+      for (;;) {
+        slot = &slots_[position & mask_];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) -
+                                    static_cast<intptr_t>(position);
+        if (difference == 0) {
+          if (tail_.compare_exchange_weak(position, position + 1,
+                                          std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (difference < 0) {
+          return false;
+        } else {
+          position = tail_.load(std::memory_order_relaxed);
+        }
+      }
+      fill(&slot->value);
+      slot->sequence.store(position + 1, std::memory_order_release);
+      return true;
+    }
+
+    // The oldest value, or null if the queue is empty. Consumer only.
+    T* Front() {
+      Slot& slot = slots_[head_ & mask_];
+      if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+        return nullptr;
+      }
+      return &slot.value;
+    }
+
+    // Give the oldest value's slot back to producers. Consumer only, and only
+    // after Front() returned a value.
+    void Pop() {
+      slots_[head_ & mask_].sequence.store(head_ + mask_ + 1,
+                                           std::memory_order_release);
+      head_++;
+    }
+
+   private:
+    struct Slot {
+      std::atomic<size_t> sequence;
+      T value;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    const size_t mask_;
+    size_t head_;
+    std::atomic<size_t> tail_;
+  };
 
   // Listens for hosts that are advertising.
   class DiscoveryListener : public gpg::IEndpointDiscoveryListener {
@@ -313,8 +406,8 @@ class GPGMultiplayer {
   bool DisplayConnectionDialog(const char* title, const char* question_text,
                                const char* yes_text, const char* no_text);
 
-  // Update connected_instances_reverse_ to match to connected_instances_.
-  // Make sure instance_mutex_ is locked when calling.
+  // Update connected_instances_reverse_ and broadcast_instances_ to match to
+  // connected_instances_. Make sure instance_mutex_ is locked when calling.
   void UpdateConnectedInstances();
 
   // Add a new connected instance to the connected_instances_ list.
@@ -342,6 +435,10 @@ class GPGMultiplayer {
   // Keep a reverse map of instance IDs to vector indices. Lock instance_mutex_
   // before using.
   std::map<std::string, int> connected_instances_reverse_;
+  // The connected instances that are still there, to broadcast to. Replaced,
+  // never changed, so a broadcast can send to it after unlocking. Lock
+  // instance_mutex_ before using.
+  std::shared_ptr<const std::vector<std::string>> broadcast_instances_;
   // The host keeps track of instances that are trying to connect. Lock
   // instance_mutex_ before using.
   std::list<std::string> pending_instances_;
@@ -359,28 +456,24 @@ class GPGMultiplayer {
   // so the user code can send them a game state update.
   std::queue<int> reconnected_players_;
 
-  // List of incoming messages. Lock message_mutex_ before using.
-  MessageQueue incoming_messages_;
+  // Messages pushed by the callback threads, and taken by the game thread.
+  BoundedQueue<SenderAndMessage> incoming_messages_;
 
   // Our current state.
   MultiplayerState state_;
   // Our next state(s). Will enter the next one during the next Update().
-  std::queue<MultiplayerState> next_states_;
+  BoundedQueue<MultiplayerState> next_states_;
+
+  // Holds messages sent from raw bytes, for the SDK, which takes vectors.
+  std::vector<uint8_t> send_buffer_;
 
   std::string my_instance_name_;
   int max_connected_players_allowed_;  // 0 to allow any number
 
-  // Mutex for the incoming_messages_ queue.
-  pthread_mutex_t message_mutex_;
-
   // Mutex for instance management: connected_instances_, pending_instances_,
   // discovered_instances, and instance_names_.
   pthread_mutex_t instance_mutex_;
 
-  // Mutex for the next_states_ queue. Needed only in rare occasions like a
-  // callback setting an error condition.
-  pthread_mutex_t state_mutex_;
-
   bool is_hosting_;    // This is set to true if we are the host.
   bool auto_connect_;  // If this is true, connections will be automatically
                        // approved without prompting.
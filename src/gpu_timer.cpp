@@ -0,0 +1,174 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gpu_timer.h"
+
+#include <assert.h>
+#include <string>
+#include "SDL_video.h"
+#include "fplbase/utilities.h"
+#include "profiler.h"
+
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+#if defined(_WIN32)
+#define ZOOSHI_GL_APIENTRY __stdcall
+#else
+#define ZOOSHI_GL_APIENTRY
+#endif  // defined(_WIN32)
+
+// Enums from the timer query extensions, which aren't in every GL header.
+static const GLenum kTimeElapsed = 0x88BF;
+static const GLenum kQueryResult = 0x8866;
+static const GLenum kQueryResultAvailable = 0x8867;
+static const GLenum kGpuDisjoint = 0x8FBB;
+
+typedef void(ZOOSHI_GL_APIENTRY* GenQueriesFunc)(GLsizei n, GLuint* ids);
+typedef void(ZOOSHI_GL_APIENTRY* DeleteQueriesFunc)(GLsizei n,
+                                                     const GLuint* ids);
+typedef void(ZOOSHI_GL_APIENTRY* BeginQueryFunc)(GLenum target, GLuint id);
+typedef void(ZOOSHI_GL_APIENTRY* EndQueryFunc)(GLenum target);
+typedef void(ZOOSHI_GL_APIENTRY* GetQueryObjectuivFunc)(GLuint id,
+                                                         GLenum pname,
+                                                         GLuint* params);
+typedef void(ZOOSHI_GL_APIENTRY* GetQueryObjectui64vFunc)(GLuint id,
+                                                           GLenum pname,
+                                                           uint64_t* params);
+
+// The functions are the same for every context, so they're shared.
+static GenQueriesFunc gen_queries = nullptr;
+static DeleteQueriesFunc delete_queries = nullptr;
+static BeginQueryFunc begin_query = nullptr;
+static EndQueryFunc end_query = nullptr;
+static GetQueryObjectuivFunc get_query_objectuiv = nullptr;
+static GetQueryObjectui64vFunc get_query_objectui64v = nullptr;
+
+// Look up each function, with `suffix` appended to its name.
+static bool LoadQueryFunctions(const char* suffix) {
+  std::string name;
+#define ZOOSHI_LOAD_GL_FUNCTION(var, type, function) \
+  name = std::string(function) + suffix;             \
+  var = reinterpret_cast<type>(SDL_GL_GetProcAddress(name.c_str()));
+  ZOOSHI_LOAD_GL_FUNCTION(gen_queries, GenQueriesFunc, "glGenQueries");
+  ZOOSHI_LOAD_GL_FUNCTION(delete_queries, DeleteQueriesFunc,
+                          "glDeleteQueries");
+  ZOOSHI_LOAD_GL_FUNCTION(begin_query, BeginQueryFunc, "glBeginQuery");
+  ZOOSHI_LOAD_GL_FUNCTION(end_query, EndQueryFunc, "glEndQuery");
+  ZOOSHI_LOAD_GL_FUNCTION(get_query_objectuiv, GetQueryObjectuivFunc,
+                          "glGetQueryObjectuiv");
+  ZOOSHI_LOAD_GL_FUNCTION(get_query_objectui64v, GetQueryObjectui64vFunc,
+                          "glGetQueryObjectui64v");
+#undef ZOOSHI_LOAD_GL_FUNCTION
+  return gen_queries && delete_queries && begin_query && end_query &&
+         get_query_objectuiv && get_query_objectui64v;
+}
+
+GpuTimer::GpuTimer()
+    : supported_(false),
+      has_disjoint_(false),
+      active_(false),
+      required_(false),
+      frame_index_(0),
+      frame_ms_(-1.0f) {}
+
+GpuTimer::~GpuTimer() { DeleteQueries(); }
+
+void GpuTimer::Initialize() {
+  if (SDL_GL_ExtensionSupported("GL_EXT_disjoint_timer_query")) {
+    supported_ = LoadQueryFunctions("EXT");
+    has_disjoint_ = supported_;
+  } else if (SDL_GL_ExtensionSupported("GL_ARB_timer_query")) {
+    supported_ = LoadQueryFunctions("");
+  }
+  if (!supported_) {
+    LogInfo("GPU timer queries aren't supported; GPU times won't be shown.");
+  }
+}
+
+void GpuTimer::DeleteQueries() {
+  for (int i = 0; i < kFramesInFlight; ++i) {
+    Frame& frame = frames_[i];
+    for (auto it = frame.queries.begin(); it != frame.queries.end(); ++it) {
+      delete_queries(1, &it->id);
+    }
+    frame.queries.clear();
+    frame.used = 0;
+  }
+}
+
+void GpuTimer::Begin(const char* name) {
+  if (!supported_ || !(required_ || Profiler::Get().enabled())) return;
+  assert(!active_);
+  Frame& frame = frames_[frame_index_];
+  if (frame.used == frame.queries.size()) {
+    Query query;
+    query.name = name;
+    gen_queries(1, &query.id);
+    frame.queries.push_back(query);
+  }
+  Query& query = frame.queries[frame.used++];
+  query.name = name;
+  begin_query(kTimeElapsed, query.id);
+  active_ = true;
+}
+
+void GpuTimer::End() {
+  if (!active_) return;
+  end_query(kTimeElapsed);
+  active_ = false;
+}
+
+void GpuTimer::ReadResults(Frame* frame) {
+  // A disjoint event, such as the GPU changing clock speed, makes every
+  // query in flight meaningless.
+  GLint disjoint = 0;
+  if (has_disjoint_) glGetIntegerv(kGpuDisjoint, &disjoint);
+
+  Profiler& profiler = Profiler::Get();
+  const bool profile = profiler.enabled();
+  bool complete = frame->used > 0 && !disjoint;
+  float total_ms = 0.0f;
+  for (size_t i = 0; i < frame->used && !disjoint; ++i) {
+    const Query& query = frame->queries[i];
+    GLuint available = 0;
+    get_query_objectuiv(query.id, kQueryResultAvailable, &available);
+    // Don't wait for the GPU. The query is simply reused.
+    if (!available) {
+      complete = false;
+      continue;
+    }
+    uint64_t nanoseconds = 0;
+    get_query_objectui64v(query.id, kQueryResult, &nanoseconds);
+    const float ms = static_cast<float>(nanoseconds) / 1000000.0f;
+    total_ms += ms;
+    if (profile) profiler.AddGpuTime(query.name, ms);
+  }
+  frame_ms_ = complete ? total_ms : -1.0f;
+  frame->used = 0;
+}
+
+void GpuTimer::EndFrame() {
+  if (!supported_) return;
+  End();
+  frame_index_ = (frame_index_ + 1) % kFramesInFlight;
+  // The oldest frame's queries have had a frame to finish.
+  ReadResults(&frames_[frame_index_]);
+  Profiler::Get().EndGpuFrame();
+}
+
+}  // zooshi
+}  // fpl
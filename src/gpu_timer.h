@@ -0,0 +1,103 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_GPU_TIMER_H_
+#define ZOOSHI_GPU_TIMER_H_
+
+#include <stdint.h>
+#include <vector>
+#include "fplbase/glplatform.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Measures how long the GPU spends on named parts of a frame, with timer
+// queries (GL_EXT_disjoint_timer_query on GLES, GL_ARB_timer_query on
+// desktop). Results are read a frame late so the CPU never waits for the
+// GPU, and are reported to the Profiler.
+//
+// Timer queries can't overlap, so regions mustn't nest. All calls must be
+// made on the render thread.
+class GpuTimer {
+ public:
+  GpuTimer();
+  ~GpuTimer();
+
+  // Look up the timer query functions. Needs a current GL context. If they
+  // aren't supported, every other call does nothing.
+  void Initialize();
+
+  bool supported() const { return supported_; }
+
+  // Time regions even while the profiler is disabled, for callers that use
+  // frame_ms().
+  void set_required(bool required) { required_ = required; }
+
+  // The total of the last frame's timings that were read back, in
+  // milliseconds, or a negative value if they're unavailable.
+  float frame_ms() const { return frame_ms_; }
+
+  // Time the GL commands between Begin() and End(). `name` must be a string
+  // literal.
+  void Begin(const char* name);
+  void End();
+
+  // Call once the frame has been submitted. Reads back the previous frame's
+  // timings, and starts recording the next frame.
+  void EndFrame();
+
+ private:
+  struct Query {
+    const char* name;
+    GLuint id;
+  };
+
+  // The queries issued in one frame. Queries are pooled, and reused once
+  // their results have been read.
+  struct Frame {
+    Frame() : used(0) {}
+    std::vector<Query> queries;
+    size_t used;
+  };
+
+  static const int kFramesInFlight = 2;
+
+  void ReadResults(Frame* frame);
+  void DeleteQueries();
+
+  bool supported_;
+  bool has_disjoint_;
+  bool active_;
+  bool required_;
+  int frame_index_;
+  float frame_ms_;
+  Frame frames_[kFramesInFlight];
+};
+
+// Times the GPU work issued in the enclosing scope.
+class GpuTimerScope {
+ public:
+  GpuTimerScope(GpuTimer* timer, const char* name) : timer_(timer) {
+    timer_->Begin(name);
+  }
+  ~GpuTimerScope() { timer_->End(); }
+
+ private:
+  GpuTimer* timer_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_GPU_TIMER_H_
@@ -0,0 +1,58 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "graph_event_queue.h"
+
+#include "profiler.h"
+
+using corgi::component_library::GraphData;
+
+namespace fpl {
+namespace zooshi {
+
+// Listeners that keep posting events to each other are cut off after this
+// many rounds a frame.
+static const int kMaxDispatchRounds = 4;
+
+void GraphEventQueue::Post(const corgi::EntityRef& entity,
+                           breadboard::EventId event) {
+  // Only a handful of events are posted each frame, so a linear search is
+  // cheaper than keeping a set.
+  for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+    if (it->id == event && it->entity == entity) return;
+  }
+  Event queued;
+  queued.entity = entity;
+  queued.id = event;
+  pending_.push_back(queued);
+}
+
+void GraphEventQueue::Dispatch() {
+  if (pending_.empty() || graph_component_ == nullptr) return;
+  ProfileScope scope("GraphEvents");
+  for (int round = 0; round < kMaxDispatchRounds && !pending_.empty();
+       ++round) {
+    dispatching_.swap(pending_);
+    for (auto it = dispatching_.begin(); it != dispatching_.end(); ++it) {
+      if (!it->entity.IsValid()) continue;
+      GraphData* graph_data = graph_component_->GetComponentData(it->entity);
+      if (graph_data != nullptr) {
+        graph_data->broadcaster.BroadcastEvent(it->id);
+      }
+    }
+    dispatching_.clear();
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,64 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_GRAPH_EVENT_QUEUE_H_
+#define ZOOSHI_GRAPH_EVENT_QUEUE_H_
+
+#include <vector>
+#include "breadboard/event.h"
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/graph.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Collects events for entities' graphs while components update, and
+// broadcasts them together once every component has updated. Listeners can
+// do anything, so running them in the middle of another component's update
+// would stop that update from being split between threads.
+//
+// An event posted to the same entity more than once before it's broadcast
+// is only broadcast once.
+class GraphEventQueue {
+ public:
+  GraphEventQueue() : graph_component_(nullptr) {}
+
+  void Initialize(corgi::component_library::GraphComponent* graph_component) {
+    graph_component_ = graph_component;
+  }
+
+  // Queue `event` for `entity`'s graphs. Safe to call from listeners, while
+  // events are being broadcast, but only from the update thread.
+  void Post(const corgi::EntityRef& entity, breadboard::EventId event);
+
+  // Broadcast the queued events. Events posted by their listeners are
+  // broadcast too, up to a few rounds, after which they wait for the next
+  // call. Entities deleted in the meantime are skipped.
+  void Dispatch();
+
+ private:
+  struct Event {
+    corgi::EntityRef entity;
+    breadboard::EventId id;
+  };
+
+  corgi::component_library::GraphComponent* graph_component_;
+  std::vector<Event> pending_;
+  // The events being broadcast. Kept to reuse its allocation.
+  std::vector<Event> dispatching_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_GRAPH_EVENT_QUEUE_H_
@@ -46,9 +46,23 @@ using mathfu::vec3;
 namespace fpl {
 namespace zooshi {
 
+// The characters the menus are written in, laid out by PrewarmText().
+static const char kPrewarmCharacters[] =
+    " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+    "abcdefghijklmnopqrstuvwxyz{|}~";
+
+// The sizes the menus use the menu font at. Glyphs are cached per size.
+static const float kPrewarmMenuSizes[] = {
+    kMenuSize,      kButtonSize,     kAudioOptionButtonSize,
+    kScoreTextSize, kScoreSmallSize, 60.0f};
+static const int kNumPrewarmMenuSizes =
+    sizeof(kPrewarmMenuSizes) / sizeof(kPrewarmMenuSizes[0]);
+
 flatui::Event GameMenuState::PlayButtonSound(flatui::Event event,
                                           pindrop::SoundHandle& sound) {
   if (event & flatui::kEventWentUp) {
+    // The UI is handled alongside the update, which also calls pindrop.
+    AudioEngineLock lock(world_->services_component.audio_thread());
     audio_engine_->PlaySound(sound);
   }
   return event;
@@ -106,6 +120,33 @@ flatui::Event GameMenuState::ImageButtonWithLabel(const fplbase::Texture& tex,
   return event;
 }
 
+bool GameMenuState::PrewarmText() {
+  // One size of the menu font a frame, then the about and license text,
+  // which are laid out just as their screens lay them out. Whatever is drawn
+  // is cleared by the loading screen.
+  if (prewarm_step_ > kNumPrewarmMenuSizes + 1) return true;
+  flatui::Run(*asset_manager_, *font_manager_, *input_system_, [&]() {
+    flatui::StartGroup(flatui::kLayoutVerticalLeft, 0);
+    if (prewarm_step_ < kNumPrewarmMenuSizes) {
+      flatui::SetTextFont(config_->menu_font()->c_str());
+      flatui::Label(kPrewarmCharacters, kPrewarmMenuSizes[prewarm_step_]);
+    } else if (prewarm_step_ == kNumPrewarmMenuSizes) {
+      flatui::SetTextFont(config_->license_font()->c_str());
+      flatui::Label(about_text_.c_str(), 35, vec2(kScrollAreaSize.x, 0),
+                    flatui::kTextAlignmentLeftJustify);
+    } else {
+      flatui::SetTextFont(config_->license_font()->c_str());
+      flatui::EnableTextHyphenation(true);
+      flatui::Label(license_text_.c_str(), 25, vec2(kScrollAreaSize.x, 0),
+                    flatui::kTextAlignmentLeftJustify);
+      flatui::EnableTextHyphenation(false);
+    }
+    flatui::EndGroup();
+  });
+  ++prewarm_step_;
+  return false;
+}
+
 MenuState GameMenuState::StartMenu(fplbase::AssetManager& assetman,
                                    flatui::FontManager& fontman,
                                    fplbase::InputSystem& input) {
@@ -202,11 +243,7 @@ MenuState GameMenuState::StartMenu(fplbase::AssetManager& assetman,
       // The exit sound is actually around 1.2s but since we fade out the
       // audio as well as the screen it's reasonable to shorten the duration.
       static const int kFadeOutTimeMilliseconds = 1000;
-      fader_->Start(
-          kFadeOutTimeMilliseconds, mathfu::kZeros3f, kFadeOut,
-          vec3(vec2(flatui::VirtualToPhysical(mathfu::kZeros2f)), 0.0f),
-          vec3(vec2(flatui::VirtualToPhysical(flatui::GetVirtualResolution())),
-               0.0f));
+      fader_->Start(kFadeOutTimeMilliseconds, mathfu::kZeros3f, kFadeOut);
       next_state = kMenuStateQuit;
     }
     flatui::EndGroup();
@@ -519,6 +556,7 @@ void GameMenuState::OptionMenuAudio() {
   auto event = flatui::Slider(*slider_back_, *slider_knob_, vec2(400, 60), 0.6f,
                            "EffectVolume", &slider_value_effect_);
   if (event & (flatui::kEventWentUp | flatui::kEventEndDrag)) {
+    AudioEngineLock lock(world_->services_component.audio_thread());
     audio_engine_->PlaySound(sound_adjust_);
   }
   flatui::EndGroup();
@@ -688,7 +726,7 @@ void GameMenuState::OptionMenuLevel() {
             static_cast<flatbuffers::uoffset_t>(index))->name()->c_str());
       if (event & flatui::kEventWentUp && index != world_->level_index) {
         world_->level_index = index;
-        LoadWorldDef(world_, world_def_);
+        LoadLevelDef(world_, world_def_);
       }
     }
     flatui::EndGroup();
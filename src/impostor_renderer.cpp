@@ -0,0 +1,452 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "impostor_renderer.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include "corgi_component_library/transform.h"
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+#include "mathfu/constants.h"
+#include "mathfu/utilities.h"
+#include "profiler.h"
+
+using corgi::component_library::RenderMeshComponent;
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+using fplbase::LogInfo;
+using mathfu::mat4;
+using mathfu::vec2;
+using mathfu::vec2i;
+using mathfu::vec3;
+using mathfu::vec4;
+using mathfu::vec4i;
+
+namespace fpl {
+namespace zooshi {
+
+static const char* kBakeShaderName = "shaders/textured";
+static const char* kImpostorShaderName = "shaders/impostor";
+static const float kPi = 3.14159265f;
+// Drawing an atlas takes a draw per view, so only a few are drawn a frame,
+// to keep the first sight of a new prop from hitching.
+static const size_t kMaxBakesPerFrame = 2;
+// Billboards are indexed with 16 bits.
+static const size_t kMaxQuads = 0x10000 / 4;
+
+// Build a matrix from its rows, the last being (0, 0, 0, 1).
+static mat4 FromRows(const vec4& x, const vec4& y, const vec4& z) {
+  return mat4(x.x, y.x, z.x, 0.0f, x.y, y.y, z.y, 0.0f, x.z, y.z, z.z, 0.0f,
+              x.w, y.w, z.w, 1.0f);
+}
+
+ImpostorRenderer::ImpostorRenderer()
+    : enabled_(false),
+      distance_(0.0f),
+      fade_distance_(0.0f),
+      views_(0),
+      resolution_(0),
+      entity_manager_(nullptr),
+      bake_shader_(nullptr),
+      shader_(nullptr),
+      vertex_buffer_(0),
+      index_buffer_(0),
+      index_buffer_quads_(0) {}
+
+ImpostorRenderer::~ImpostorRenderer() {
+  for (auto it = atlases_.begin(); it != atlases_.end(); ++it) {
+    if (it->second.target.initialized()) it->second.target.Delete();
+  }
+  if (vertex_buffer_ != 0) GL_CALL(glDeleteBuffers(1, &vertex_buffer_));
+  if (index_buffer_ != 0) GL_CALL(glDeleteBuffers(1, &index_buffer_));
+}
+
+void ImpostorRenderer::Initialize(const RenderConfig* config,
+                                  fplbase::AssetManager* asset_manager,
+                                  corgi::EntityManager* entity_manager) {
+  entity_manager_ = entity_manager;
+  distance_ = config->impostor_distance();
+  fade_distance_ = std::max(config->impostor_fade_distance(), 0.0f);
+  views_ = std::max(config->impostor_views(), 1);
+  resolution_ = std::max(config->impostor_resolution(), 1);
+  enabled_ = false;
+  Clear();
+
+  shaders_.clear();
+  auto names = config->impostor_shaders();
+  if (names != nullptr) {
+    for (auto it = names->begin(); it != names->end(); ++it) {
+      const fplbase::Shader* shader = asset_manager->FindShader(it->c_str());
+      if (shader != nullptr) shaders_.push_back(shader);
+    }
+  }
+  if (distance_ <= 0.0f || shaders_.empty()) return;
+
+  bake_shader_ = asset_manager->FindShader(kBakeShaderName);
+  shader_ = asset_manager->FindShader(kImpostorShaderName);
+  if (bake_shader_ == nullptr || shader_ == nullptr) {
+    LogInfo("No impostor shaders; distant props will be drawn as meshes.");
+    return;
+  }
+  enabled_ = true;
+}
+
+void ImpostorRenderer::Collect(RenderMeshComponent* render_mesh_component,
+                               const corgi::CameraInterface& camera,
+                               const RenderCuller& culler) {
+  ProfileScope scope("CollectImpostors");
+  Clear();
+  if (!enabled_) return;
+
+  // Billboards start fading in this far away.
+  const float fade_start = std::max(distance_ - fade_distance_, 0.0f);
+  for (auto iter = render_mesh_component->begin();
+       iter != render_mesh_component->end(); ++iter) {
+    const RenderMeshData& data = iter->data;
+    if (!data.visible || data.mesh == nullptr ||
+        data.pass_mask != 1 << corgi::RenderPass_Opaque ||
+        data.shaders.empty() ||
+        std::find(shaders_.begin(), shaders_.end(),
+                  data.shaders[ShaderIndex_Lit]) == shaders_.end()) {
+      continue;
+    }
+    const TransformData* transform_data =
+        entity_manager_->GetComponentData<TransformData>(iter->entity);
+    if (transform_data == nullptr) continue;
+    // Anything else, such as the river's banks, may be too big to flatten,
+    // and scenery that's growing or shrinking doesn't match its atlas.
+    const SceneryData* scenery = FindScenery(iter->entity, *transform_data);
+    if (scenery == nullptr || scenery->state != kSceneryShow) continue;
+    const mat4& world_transform = transform_data->world_transform;
+
+    const float distance_squared =
+        (world_transform.TranslationVector3D() - camera.position())
+            .LengthSquared();
+    if (distance_squared < fade_start * fade_start ||
+        !culler.MayBeInView(data, world_transform, camera)) {
+      continue;
+    }
+
+    auto atlas = atlases_.find(data.mesh);
+    if (atlas == atlases_.end() || !atlas->second.baked) {
+      if (std::find(to_bake_.begin(), to_bake_.end(), data.mesh) ==
+          to_bake_.end()) {
+        to_bake_.push_back(data.mesh);
+      }
+      continue;
+    }
+    // Meshes with no height or width have nothing to show.
+    if (atlas->second.half_height <= 0.0f) continue;
+
+    Billboard billboard;
+    billboard.entity = iter->entity;
+    billboard.atlas = &atlas->second;
+    billboard.tint = data.tint;
+    billboards_.push_back(billboard);
+    if (distance_squared >= distance_ * distance_) {
+      collected_.push_back(iter->entity);
+    }
+  }
+
+  // Billboards sharing an atlas are drawn together.
+  std::sort(billboards_.begin(), billboards_.end(),
+            [](const Billboard& a, const Billboard& b) {
+              return a.atlas < b.atlas;
+            });
+  HideCollected(render_mesh_component);
+}
+
+const SceneryData* ImpostorRenderer::FindScenery(
+    const corgi::EntityRef& entity,
+    const TransformData& transform_data) const {
+  const SceneryData* scenery =
+      entity_manager_->GetComponentData<SceneryData>(entity);
+  if (scenery == nullptr && transform_data.parent) {
+    scenery = entity_manager_->GetComponentData<SceneryData>(
+        transform_data.parent);
+  }
+  return scenery;
+}
+
+void ImpostorRenderer::HideCollected(
+    RenderMeshComponent* render_mesh_component) {
+  for (auto it = collected_.begin(); it != collected_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(*it);
+    if (data != nullptr) data->visible = false;
+  }
+}
+
+void ImpostorRenderer::ShowCollected(
+    RenderMeshComponent* render_mesh_component) {
+  for (auto it = collected_.begin(); it != collected_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(*it);
+    if (data != nullptr) data->visible = true;
+  }
+}
+
+void ImpostorRenderer::ContextLost() {
+  Clear();
+  // The names mean nothing in the new context, so they're not deleted.
+  atlases_.clear();
+  to_bake_.clear();
+  vertex_buffer_ = 0;
+  index_buffer_ = 0;
+  index_buffer_quads_ = 0;
+}
+
+void ImpostorRenderer::ReleaseMesh(const fplbase::Mesh* mesh) {
+  to_bake_.erase(std::remove(to_bake_.begin(), to_bake_.end(), mesh),
+                 to_bake_.end());
+  auto atlas = atlases_.find(mesh);
+  if (atlas == atlases_.end()) return;
+  const Atlas* released = &atlas->second;
+  billboards_.erase(
+      std::remove_if(billboards_.begin(), billboards_.end(),
+                     [released](const Billboard& billboard) {
+                       return billboard.atlas == released;
+                     }),
+      billboards_.end());
+  if (atlas->second.target.initialized()) atlas->second.target.Delete();
+  atlases_.erase(atlas);
+}
+
+void ImpostorRenderer::Bake(fplbase::Mesh* mesh, Atlas* atlas,
+                            fplbase::Renderer& renderer) {
+  atlas->baked = true;
+  const vec3 min_position = mesh->min_position();
+  const vec3 max_position = mesh->max_position();
+  const vec3 extent = (max_position - min_position) * 0.5f;
+  atlas->center = (min_position + max_position) * 0.5f;
+  // Wide enough for the mesh seen from any angle about its up axis.
+  atlas->half_width = vec2(extent.x, extent.y).Length();
+  atlas->half_height = extent.z;
+  const float half_depth = extent.Length();
+  if (atlas->half_width <= 0.0f || atlas->half_height <= 0.0f) {
+    atlas->half_height = 0.0f;
+    return;
+  }
+
+  atlas->target.Initialize(vec2i(resolution_ * views_, resolution_));
+  atlas->target.SetAsRenderTarget();
+  renderer.ClearFrameBuffer(mathfu::kZeros4f);
+  renderer.set_color(mathfu::kOnes4f);
+  renderer.SetBlendMode(fplbase::kBlendModeOff);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+  renderer.SetCulling(fplbase::kCullingModeBack);
+
+  // Each view looks at the middle of the mesh from `toward` the camera, with
+  // the mesh's bounds fit to its part of the atlas.
+  const vec3 up = mathfu::kAxisZ3f;
+  const vec3& center = atlas->center;
+  for (int view = 0; view < views_; ++view) {
+    const float angle = 2.0f * kPi * static_cast<float>(view) /
+                        static_cast<float>(views_);
+    const vec3 toward(cosf(angle), sinf(angle), 0.0f);
+    const vec3 right = vec3::CrossProduct(up, toward);
+    const mat4 view_projection = FromRows(
+        vec4(right / atlas->half_width,
+             -vec3::DotProduct(right, center) / atlas->half_width),
+        vec4(up / atlas->half_height, -center.z / atlas->half_height),
+        vec4(-toward / half_depth,
+             vec3::DotProduct(toward, center) / half_depth));
+
+    renderer.SetViewport(vec4i(view * resolution_, 0, resolution_,
+                               resolution_));
+    renderer.set_model_view_projection(view_projection);
+    bake_shader_->Set(renderer);
+    mesh->Render(renderer);
+  }
+}
+
+void ImpostorRenderer::UploadIndices(size_t num_quads) {
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_));
+  if (num_quads <= index_buffer_quads_) return;
+  std::vector<uint16_t> indices;
+  indices.reserve(num_quads * 6);
+  static const uint16_t kQuadIndices[] = {0, 1, 2, 2, 1, 3};
+  for (size_t quad = 0; quad < num_quads; ++quad) {
+    for (int i = 0; i < 6; ++i) {
+      indices.push_back(static_cast<uint16_t>(quad * 4 + kQuadIndices[i]));
+    }
+  }
+  GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                       indices.size() * sizeof(uint16_t), indices.data(),
+                       GL_STATIC_DRAW));
+  index_buffer_quads_ = num_quads;
+}
+
+void ImpostorRenderer::Render(const corgi::CameraInterface& camera,
+                              fplbase::Renderer& renderer) {
+  if (!enabled_) return;
+
+  if (!to_bake_.empty()) {
+    ProfileScope scope("BakeImpostors");
+    // The atlases are drawn in the middle of the scene, so whatever it's
+    // being drawn into is put back afterwards.
+    GLint framebuffer = 0;
+    GLint viewport[4];
+    GL_CALL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer));
+    GL_CALL(glGetIntegerv(GL_VIEWPORT, viewport));
+    const size_t count = std::min(to_bake_.size(), kMaxBakesPerFrame);
+    for (size_t i = 0; i < count; ++i) {
+      Atlas& atlas = atlases_[to_bake_[i]];
+      if (!atlas.baked) Bake(to_bake_[i], &atlas, renderer);
+    }
+    to_bake_.erase(to_bake_.begin(), to_bake_.begin() + count);
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER,
+                              static_cast<GLuint>(framebuffer)));
+    renderer.SetViewport(
+        vec4i(viewport[0], viewport[1], viewport[2], viewport[3]));
+  }
+
+  if (billboards_.empty()) return;
+  ProfileScope scope("DrawImpostors");
+  if (vertex_buffer_ == 0) GL_CALL(glGenBuffers(1, &vertex_buffer_));
+  if (index_buffer_ == 0) GL_CALL(glGenBuffers(1, &index_buffer_));
+
+  // The dither stands in for blending, so billboards write depth like the
+  // meshes they replace. Either side of a billboard may face the camera.
+  renderer.set_color(mathfu::kOnes4f);
+  renderer.SetBlendMode(fplbase::kBlendModeOff);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+  renderer.SetCulling(fplbase::kCullingModeNone);
+
+  // Each eye draws every billboard into its viewport in turn.
+  if (!camera.IsStereo()) {
+    RenderView(camera.GetTransformMatrix(), camera.position(), renderer);
+  } else {
+    for (int view = 0; view < 2; ++view) {
+      renderer.SetViewport(camera.viewport(view));
+      RenderView(camera.GetTransformMatrix(view), camera.position(view),
+                 renderer);
+    }
+  }
+
+  renderer.SetCulling(fplbase::kCullingModeBack);
+}
+
+void ImpostorRenderer::RenderView(const mat4& view_projection,
+                                  const vec3& camera_position,
+                                  fplbase::Renderer& renderer) {
+  // The billboards are built in world space.
+  renderer.set_model_view_projection(view_projection);
+  shader_->Set(renderer);
+
+  const GLuint position = fplbase::Mesh::kAttributePosition;
+  const GLuint tex_coord = fplbase::Mesh::kAttributeTexCoord;
+  const GLuint color = fplbase::Mesh::kAttributeColor;
+  GL_CALL(glEnableVertexAttribArray(position));
+  GL_CALL(glEnableVertexAttribArray(tex_coord));
+  GL_CALL(glEnableVertexAttribArray(color));
+
+  const float fade_start = distance_ - fade_distance_;
+  const float view_angle = 2.0f * kPi / static_cast<float>(views_);
+  const float tile_width = 1.0f / static_cast<float>(views_);
+  size_t begin = 0;
+  while (begin < billboards_.size()) {
+    Atlas* atlas = billboards_[begin].atlas;
+    size_t end = begin;
+    vertices_.clear();
+    while (end < billboards_.size() && billboards_[end].atlas == atlas &&
+           vertices_.size() < kMaxQuads * 4) {
+      const Billboard& billboard = billboards_[end++];
+      if (!billboard.entity.IsValid()) continue;
+      // Read the transforms now, rather than when collected, so they're
+      // interpolated like everything else.
+      const TransformData* transform_data =
+          entity_manager_->GetComponentData<TransformData>(billboard.entity);
+      if (transform_data == nullptr) continue;
+      const mat4& world_transform = transform_data->world_transform;
+
+      const vec3 axis_x = world_transform.GetColumn(0).xyz();
+      const vec3 axis_y = world_transform.GetColumn(1).xyz();
+      const vec3 axis_z = world_transform.GetColumn(2).xyz();
+      const vec3 center = world_transform * atlas->center;
+      const vec3 to_camera = camera_position - center;
+      const vec3 up = axis_z.Normalized();
+      vec3 right = vec3::CrossProduct(up, to_camera);
+      right = right.LengthSquared() > 0.0f ? right.Normalized()
+                                           : axis_y.Normalized();
+
+      // The view drawn from nearest the camera's angle about the up axis.
+      const float angle = atan2f(vec3::DotProduct(to_camera, axis_y),
+                                 vec3::DotProduct(to_camera, axis_x));
+      int tile = static_cast<int>(floorf(angle / view_angle + 0.5f)) % views_;
+      if (tile < 0) tile += views_;
+      const float u = static_cast<float>(tile) * tile_width;
+
+      const float fade =
+          fade_distance_ > 0.0f
+              ? mathfu::Clamp((to_camera.Length() - fade_start) /
+                                  fade_distance_,
+                              0.0f, 1.0f)
+              : 1.0f;
+      const float scale = std::max(axis_x.Length(), axis_y.Length());
+      const vec3 across = right * (atlas->half_width * scale);
+      const vec3 along = axis_z * atlas->half_height;
+
+      static const float kCorners[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f},
+                                           {-1.0f, 1.0f}, {1.0f, 1.0f}};
+      for (int corner = 0; corner < 4; ++corner) {
+        const vec3 corner_position = center + across * kCorners[corner][0] +
+                                     along * kCorners[corner][1];
+        Vertex vertex;
+        vertex.position[0] = corner_position.x;
+        vertex.position[1] = corner_position.y;
+        vertex.position[2] = corner_position.z;
+        vertex.tex_coord[0] =
+            u + tile_width * 0.5f * (kCorners[corner][0] + 1.0f);
+        vertex.tex_coord[1] = 0.5f * (kCorners[corner][1] + 1.0f);
+        vertex.color[0] = billboard.tint.x;
+        vertex.color[1] = billboard.tint.y;
+        vertex.color[2] = billboard.tint.z;
+        vertex.color[3] = billboard.tint.w * fade;
+        vertices_.push_back(vertex);
+      }
+    }
+    begin = end;
+    if (vertices_.empty()) continue;
+
+    const size_t num_quads = vertices_.size() / 4;
+    UploadIndices(num_quads);
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_));
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(Vertex),
+                         vertices_.data(), GL_STREAM_DRAW));
+    GL_CALL(glVertexAttribPointer(
+        position, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        reinterpret_cast<const void*>(offsetof(Vertex, position))));
+    GL_CALL(glVertexAttribPointer(
+        tex_coord, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        reinterpret_cast<const void*>(offsetof(Vertex, tex_coord))));
+    GL_CALL(glVertexAttribPointer(
+        color, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        reinterpret_cast<const void*>(offsetof(Vertex, color))));
+    atlas->target.BindAsTexture(0);
+    GL_CALL(glDrawElements(GL_TRIANGLES,
+                           static_cast<GLsizei>(num_quads * 6),
+                           GL_UNSIGNED_SHORT, nullptr));
+  }
+
+  GL_CALL(glDisableVertexAttribArray(position));
+  GL_CALL(glDisableVertexAttribArray(tex_coord));
+  GL_CALL(glDisableVertexAttribArray(color));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,157 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_IMPOSTOR_RENDERER_H_
+#define ZOOSHI_IMPOSTOR_RENDERER_H_
+
+#include <map>
+#include <vector>
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/camera_interface.h"
+#include "corgi_component_library/rendermesh.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/render_target.h"
+#include "fplbase/renderer.h"
+#include "mathfu/glsl_mappings.h"
+#include "components/scenery.h"
+#include "render_culler.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Draws distant scenery, such as the trees and rocks along the river, as flat
+// billboards instead of their meshes. Each mesh is drawn once from several
+// angles around its up axis into an atlas, and each billboard shows the view
+// nearest to the camera's, turning about the prop's up axis to face it. Only
+// entities with a SceneryDef, or the mesh child of one, become billboards,
+// and only while they're fully shown.
+//
+// Billboards fade in, with a dither, over a band before the impostor
+// distance, while the meshes are still drawn, so props don't pop when they
+// switch. Beyond it, the meshes are hidden from RenderMeshComponent.
+class ImpostorRenderer {
+ public:
+  ImpostorRenderer();
+  ~ImpostorRenderer();
+
+  // Does nothing more if the config doesn't set an impostor distance, or
+  // doesn't list any shaders whose props may become billboards.
+  void Initialize(const RenderConfig* config,
+                  fplbase::AssetManager* asset_manager,
+                  corgi::EntityManager* entity_manager);
+
+  bool enabled() const { return enabled_; }
+
+  // Record the visible, distant props that `culler` says `camera` may see,
+  // and hide those past the impostor distance from RenderMeshComponent.
+  // Props whose mesh hasn't been drawn into an atlas yet are left alone, and
+  // their meshes are drawn into one by the next Render(). Needs no GL
+  // context. ShowCollected() shows them again, and HideCollected() hides
+  // them again for as long as render lists are built from `camera`.
+  void Collect(
+      corgi::component_library::RenderMeshComponent* render_mesh_component,
+      const corgi::CameraInterface& camera, const RenderCuller& culler);
+  void HideCollected(
+      corgi::component_library::RenderMeshComponent* render_mesh_component);
+  void ShowCollected(
+      corgi::component_library::RenderMeshComponent* render_mesh_component);
+
+  // Forget the collected props, so Render() draws nothing.
+  void Clear() {
+    billboards_.clear();
+    collected_.clear();
+  }
+
+  // Forget the atlases without deleting them, as their textures went with
+  // the old GL context. They're drawn again as their props are seen.
+  void ContextLost();
+
+  // Delete the atlas of `mesh`, which is about to be deleted. Call on the
+  // render thread.
+  void ReleaseMesh(const fplbase::Mesh* mesh);
+
+  // Draw any atlases that are waiting, then the collected billboards. Call
+  // during the opaque render pass.
+  void Render(const corgi::CameraInterface& camera,
+              fplbase::Renderer& renderer);
+
+ private:
+  // A mesh drawn from `views_` angles, side by side.
+  struct Atlas {
+    Atlas() : baked(false), half_width(0.0f), half_height(0.0f) {}
+
+    bool baked;
+    fplbase::RenderTarget target;
+    // The middle of the mesh's bounds, in model space, and how far the
+    // billboard reaches from it, across and up.
+    mathfu::vec3 center;
+    float half_width;
+    float half_height;
+  };
+
+  struct Billboard {
+    corgi::EntityRef entity;
+    Atlas* atlas;
+    mathfu::vec4 tint;
+  };
+
+  // One corner of one billboard.
+  struct Vertex {
+    float position[3];
+    float tex_coord[2];
+    // The prop's tint, with how far the billboard has faded in in alpha.
+    float color[4];
+  };
+
+  void Bake(fplbase::Mesh* mesh, Atlas* atlas,
+            fplbase::Renderer& renderer);
+  void RenderView(const mathfu::mat4& view_projection,
+                  const mathfu::vec3& camera_position,
+                  fplbase::Renderer& renderer);
+  void UploadIndices(size_t num_quads);
+
+  bool enabled_;
+  float distance_;
+  float fade_distance_;
+  int views_;
+  int resolution_;
+  corgi::EntityManager* entity_manager_;
+  std::vector<const fplbase::Shader*> shaders_;
+  fplbase::Shader* bake_shader_;
+  fplbase::Shader* shader_;
+
+  // Scenery entity, if `entity` is one or the mesh child of one.
+  const SceneryData* FindScenery(
+      const corgi::EntityRef& entity,
+      const corgi::component_library::TransformData& transform_data) const;
+
+  std::map<const fplbase::Mesh*, Atlas> atlases_;
+  // Meshes seen by Collect() without an atlas, to be drawn by Render().
+  std::vector<fplbase::Mesh*> to_bake_;
+  std::vector<Billboard> billboards_;
+  // The props past the impostor distance, which only their billboard draws.
+  std::vector<corgi::EntityRef> collected_;
+
+  std::vector<Vertex> vertices_;
+  GLuint vertex_buffer_;
+  GLuint index_buffer_;
+  size_t index_buffer_quads_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_IMPOSTOR_RENDERER_H_
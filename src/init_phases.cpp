@@ -0,0 +1,81 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "init_phases.h"
+
+#include "SDL_timer.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+InitPhases::InitPhases(JobSystem* job_system)
+    : job_system_(job_system), start_(SDL_GetPerformanceCounter()) {}
+
+InitPhases::Timing* InitPhases::AddTiming(const char* name,
+                                          bool background) {
+  Timing timing = {name, background, false, 0, 0};
+  timings_.push_back(timing);
+  return &timings_.back();
+}
+
+void InitPhases::RunTimed(const Phase& phase, Timing* timing) {
+  timing->start = SDL_GetPerformanceCounter();
+  timing->succeeded = phase();
+  timing->end = SDL_GetPerformanceCounter();
+  if (!timing->succeeded) LogError("Init: %s failed", timing->name);
+}
+
+void InitPhases::RunInBackground(const char* name, const Phase& phase) {
+  Timing* timing = AddTiming(name, true);
+  job_system_->Run([phase, timing]() { RunTimed(phase, timing); },
+                   &background_);
+}
+
+bool InitPhases::Run(const char* name, const Phase& phase) {
+  Timing* timing = AddTiming(name, false);
+  RunTimed(phase, timing);
+  return timing->succeeded;
+}
+
+bool InitPhases::Wait() {
+  job_system_->Wait(&background_);
+  bool succeeded = true;
+  for (auto it = timings_.begin(); it != timings_.end(); ++it) {
+    succeeded &= it->succeeded || !it->background;
+  }
+  return succeeded;
+}
+
+void InitPhases::LogTimings() const {
+  const double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+  for (auto it = timings_.begin(); it != timings_.end(); ++it) {
+    LogInfo("Init: %s took %.1fms, from %.1fms%s", it->name,
+            (it->end - it->start) * ms_per_tick,
+            (it->start - start_) * ms_per_tick,
+            it->background ? " (background)" : "");
+  }
+  LogInfo("Init: done after %.1fms", ElapsedTime());
+}
+
+float InitPhases::ElapsedTime() const {
+  return static_cast<float>((SDL_GetPerformanceCounter() - start_) * 1000.0 /
+                            SDL_GetPerformanceFrequency());
+}
+
+}  // zooshi
+}  // fpl
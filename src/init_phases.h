@@ -0,0 +1,75 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_INIT_PHASES_H_
+#define ZOOSHI_INIT_PHASES_H_
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include "job_system.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Runs the phases of startup and times each of them. Phases that don't need
+// the GL context, or anything another phase sets up, are run on the job
+// system's workers while the main thread carries on with the rest.
+class InitPhases {
+ public:
+  typedef std::function<bool()> Phase;
+
+  explicit InitPhases(JobSystem* job_system);
+
+  // Start `phase` on a worker. Whether it succeeded is reported by Wait(),
+  // which must be called before anything it uses is destroyed.
+  void RunInBackground(const char* name, const Phase& phase);
+
+  // Run `phase` on the calling thread, and return whether it succeeded.
+  bool Run(const char* name, const Phase& phase);
+
+  // Wait for the background phases. Returns false if any of them failed.
+  bool Wait();
+
+  // Log when each phase started and how long it took, relative to when
+  // the InitPhases was made.
+  void LogTimings() const;
+
+  // Milliseconds since the InitPhases was made.
+  float ElapsedTime() const;
+
+ private:
+  struct Timing {
+    // Must be a string literal.
+    const char* name;
+    bool background;
+    bool succeeded;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  // Add a timing for `name`, which stays where it is as more are added.
+  Timing* AddTiming(const char* name, bool background);
+  static void RunTimed(const Phase& phase, Timing* timing);
+
+  JobSystem* job_system_;
+  JobCounter background_;
+  std::deque<Timing> timings_;
+  uint64_t start_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_INIT_PHASES_H_
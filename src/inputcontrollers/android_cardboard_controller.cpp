@@ -36,17 +36,11 @@ void AndroidCardboardController::UpdateOrientation() {
   up_.Update();
 
 #if FPLBASE_ANDROID_VR
-  // Cardboard uses a different coordinate space than we use, so we have to
-  // remap the axes and swap the handedness before we can use the
-  // vectors as our facing/up vectors:
   const fplbase::HeadMountedDisplayInput& head_mounted_display_input =
     input_system_->head_mounted_display_input();
-  const vec3 hmd_forward = head_mounted_display_input.forward();
-  const vec3 forward = vec3(hmd_forward.x, -hmd_forward.z, hmd_forward.y);
-  const vec3 hmd_up = head_mounted_display_input.up();
-  const vec3 up = vec3(hmd_up.x, -hmd_up.z, hmd_up.y);
-  facing_.SetValue(forward);
-  up_.SetValue(up);
+  facing_.SetValue(
+      FromHeadMountedDisplay(head_mounted_display_input.forward()));
+  up_.SetValue(FromHeadMountedDisplay(head_mounted_display_input.up()));
 #endif  // FPLBASE_ANDROID_VR
 }
 
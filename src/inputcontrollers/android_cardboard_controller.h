@@ -29,6 +29,12 @@ class AndroidCardboardController : public BasePlayerController {
 
   virtual void Update();
 
+  // Cardboard uses a different coordinate space than we use, so its vectors
+  // need their axes remapped and handedness swapped before we can use them.
+  static mathfu::vec3 FromHeadMountedDisplay(const mathfu::vec3& hmd_vector) {
+    return mathfu::vec3(hmd_vector.x, -hmd_vector.z, hmd_vector.y);
+  }
+
  private:
   void UpdateOrientation();
   void UpdateButtons();
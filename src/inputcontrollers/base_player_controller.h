@@ -18,6 +18,7 @@
 #include "camera.h"
 #include "fplbase/input.h"
 #include "input_config_generated.h"
+#include "inputcontrollers/tap_event_queue.h"
 #include "mathfu/glsl_mappings.h"
 
 namespace fpl {
@@ -53,12 +54,20 @@ enum LogicalButtonTypes {
   kLogicalButtonCount  // This needs to be last.
 };
 
-enum ControllerType { kControllerDefault, kControllerGamepad };
+enum ControllerType {
+  kControllerDefault,
+  kControllerGamepad,
+  kControllerScripted
+};
 
 class BasePlayerController {
  public:
   BasePlayerController(ControllerType controller_type = kControllerDefault)
-      : last_position_(-1), controller_type_(controller_type), enabled_(true) {
+      : last_position_(-1),
+        fire_age_(0),
+        controller_type_(controller_type),
+        tap_queue_(nullptr),
+        enabled_(true) {
     facing_.SetValue(kCameraForward);
     facing_.Update();
     up_.SetValue(kCameraUp);
@@ -77,14 +86,27 @@ class BasePlayerController {
     up_.SetValue(kCameraUp);
   }
 
+  // Ignore any taps so far, such as the one that closed a menu.
+  void DiscardTaps() {
+    if (tap_queue_ != nullptr) tap_queue_->Clear();
+  }
+
   LogicalButton& Button(int index) { return buttons_[index]; }
+  const LogicalButton& Button(int index) const { return buttons_[index]; }
 
   LogicalVector& facing() { return facing_; }
+  const LogicalVector& facing() const { return facing_; }
 
   LogicalVector& up() { return up_; }
+  const LogicalVector& up() const { return up_; }
 
   const mathfu::vec2i& last_position() const { return last_position_; }
 
+  // How many milliseconds before this update the input that last pressed
+  // kFireProjectile happened, if the controller knows. Projectiles are
+  // thrown as if they left that long ago.
+  uint32_t fire_age() const { return fire_age_; }
+
   ControllerType controller_type() const { return controller_type_; }
 
   void set_input_system(fplbase::InputSystem* input_system) {
@@ -93,6 +115,9 @@ class BasePlayerController {
   void set_input_config(const InputConfig* input_config) {
     input_config_ = input_config;
   }
+  // Controllers that fire on taps read them from `tap_queue`, when it's set,
+  // rather than polling the input system.
+  void set_tap_queue(TapEventQueue* tap_queue) { tap_queue_ = tap_queue; }
 
   void set_enabled(bool enabled) { enabled_ = enabled; }
   bool enabled() const { return enabled_; }
@@ -109,8 +134,15 @@ class BasePlayerController {
   // position defined.
   mathfu::vec2i last_position_;
 
+  uint32_t fire_age_;
+
+  // Taps older than this, in milliseconds, are ignored.
+  static const uint32_t kMaxTapAge = 250;
+
   ControllerType controller_type_;
 
+  TapEventQueue* tap_queue_;
+
   fplbase::InputSystem* input_system_;
   const InputConfig* input_config_;
 
@@ -0,0 +1,234 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "inputcontrollers/input_recording.h"
+
+#include <string.h>
+#include <algorithm>
+#include "SDL_rwops.h"
+#include "camera.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+
+namespace fpl {
+namespace zooshi {
+
+// Recordings start with kMagic, kVersion, the level index as a uint16, and
+// the level and start seeds as uint32s. Each update is then a uint16 delta
+// time and a byte of kFrame flags, followed by the values the flags say
+// changed, in the order below. Values are in the host's byte order;
+// recordings are for profiling on the same kind of machine, not for sharing.
+static const char kMagic[] = {'Z', 'I', 'N', 'P'};
+static const uint8_t kVersion = 2;
+
+enum FrameFlags {
+  // The fire button was pressed. Followed by its age, as a uint16.
+  kFrameFire = 1 << 0,
+  // Followed by three floats.
+  kFrameFacing = 1 << 1,
+  kFrameUp = 1 << 2,
+  // Followed by two int16s.
+  kFramePosition = 1 << 3,
+};
+
+template <typename T>
+static void Append(const T& value, std::vector<uint8_t>* data) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  data->insert(data->end(), bytes, bytes + sizeof(value));
+}
+
+static void AppendVec3(const mathfu::vec3& value, std::vector<uint8_t>* data) {
+  for (int i = 0; i < 3; ++i) Append(value[i], data);
+}
+
+// Read a T from `data` at `*read`, and advance it. Returns false if the
+// data is too short.
+template <typename T>
+static bool Read(const std::string& data, size_t* read, T* value) {
+  if (data.size() - *read < sizeof(T)) return false;
+  memcpy(value, data.data() + *read, sizeof(T));
+  *read += sizeof(T);
+  return true;
+}
+
+static bool ReadVec3(const std::string& data, size_t* read,
+                     mathfu::vec3* value) {
+  float x, y, z;
+  if (!Read(data, read, &x) || !Read(data, read, &y) ||
+      !Read(data, read, &z)) {
+    return false;
+  }
+  *value = mathfu::vec3(x, y, z);
+  return true;
+}
+
+static uint16_t ClampToUint16(int value) {
+  return static_cast<uint16_t>(std::min(std::max(value, 0), 0xFFFF));
+}
+
+void InputRecorder::Start(size_t level_index, uint32_t level_seed,
+                          uint32_t start_seed) {
+  data_.assign(kMagic, kMagic + sizeof(kMagic));
+  Append(kVersion, &data_);
+  Append(ClampToUint16(static_cast<int>(level_index)), &data_);
+  Append(level_seed, &data_);
+  Append(start_seed, &data_);
+  // Match the defaults a ReplayController starts with.
+  facing_ = kCameraForward;
+  up_ = kCameraUp;
+  last_position_ = mathfu::vec2i(-1);
+  armed_ = false;
+  recording_ = true;
+}
+
+void InputRecorder::Record(corgi::WorldTime delta_time,
+                           const BasePlayerController& controller) {
+  if (!recording_) return;
+  const bool fire = controller.Button(kFireProjectile).Value() &&
+                    controller.Button(kFireProjectile).HasChanged();
+  const mathfu::vec3 facing = controller.facing().Value();
+  const mathfu::vec3 up = controller.up().Value();
+  const mathfu::vec2i& last_position = controller.last_position();
+
+  uint8_t flags = 0;
+  if (fire) flags |= kFrameFire;
+  if (facing[0] != facing_[0] || facing[1] != facing_[1] ||
+      facing[2] != facing_[2]) {
+    flags |= kFrameFacing;
+  }
+  if (up[0] != up_[0] || up[1] != up_[1] || up[2] != up_[2]) {
+    flags |= kFrameUp;
+  }
+  if (last_position.x != last_position_.x ||
+      last_position.y != last_position_.y) {
+    flags |= kFramePosition;
+  }
+
+  Append(ClampToUint16(delta_time), &data_);
+  Append(flags, &data_);
+  if (flags & kFrameFire) {
+    Append(ClampToUint16(static_cast<int>(controller.fire_age())), &data_);
+  }
+  if (flags & kFrameFacing) AppendVec3(facing, &data_);
+  if (flags & kFrameUp) AppendVec3(up, &data_);
+  if (flags & kFramePosition) {
+    Append(static_cast<int16_t>(last_position.x), &data_);
+    Append(static_cast<int16_t>(last_position.y), &data_);
+  }
+  facing_ = facing;
+  up_ = up;
+  last_position_ = last_position;
+}
+
+bool InputRecorder::Stop(const char* filename) {
+  if (!recording_) return false;
+  recording_ = false;
+  SDL_RWops* file = SDL_RWFromFile(filename, "wb");
+  if (file == nullptr) {
+    LogError("Couldn't open %s to write the input recording: %s", filename,
+             SDL_GetError());
+    return false;
+  }
+  const bool ok =
+      SDL_RWwrite(file, data_.data(), 1, data_.size()) == data_.size();
+  SDL_RWclose(file);
+  data_.clear();
+  return ok;
+}
+
+bool ReplayController::Load(const char* filename) {
+  data_.clear();
+  read_ = 0;
+  SDL_RWops* file = SDL_RWFromFile(filename, "rb");
+  if (file == nullptr) {
+    LogError("Couldn't open input recording %s: %s", filename,
+             SDL_GetError());
+    return false;
+  }
+  char buffer[4096];
+  for (;;) {
+    const size_t size = SDL_RWread(file, buffer, 1, sizeof(buffer));
+    if (size == 0) break;
+    data_.append(buffer, size);
+  }
+  SDL_RWclose(file);
+
+  uint8_t version;
+  uint16_t level_index;
+  read_ = sizeof(kMagic);
+  if (data_.size() < sizeof(kMagic) ||
+      memcmp(data_.data(), kMagic, sizeof(kMagic)) != 0 ||
+      !Read(data_, &read_, &version) || version != kVersion ||
+      !Read(data_, &read_, &level_index) ||
+      !Read(data_, &read_, &level_seed_) ||
+      !Read(data_, &read_, &start_seed_)) {
+    LogError("%s isn't an input recording.", filename);
+    data_.clear();
+    read_ = 0;
+    return false;
+  }
+  level_index_ = level_index;
+  return true;
+}
+
+corgi::WorldTime ReplayController::next_delta_time() const {
+  size_t read = read_;
+  uint16_t delta_time = 0;
+  Read(data_, &read, &delta_time);
+  return delta_time;
+}
+
+void ReplayController::Update() {
+  facing_.Update();
+  up_.Update();
+  for (int i = 0; i < kLogicalButtonCount; i++) {
+    buttons_[i].Update();
+  }
+  fire_age_ = 0;
+  buttons_[kFireProjectile].SetValue(false);
+
+  uint16_t delta_time;
+  uint8_t flags;
+  if (!Read(data_, &read_, &delta_time) || !Read(data_, &read_, &flags)) {
+    read_ = data_.size();
+    return;
+  }
+  bool ok = true;
+  if (flags & kFrameFire) {
+    uint16_t fire_age = 0;
+    ok = Read(data_, &read_, &fire_age);
+    fire_age_ = fire_age;
+    buttons_[kFireProjectile].SetValue(true);
+  }
+  if (ok && (flags & kFrameFacing)) {
+    mathfu::vec3 facing;
+    ok = ReadVec3(data_, &read_, &facing);
+    if (ok) facing_.SetValue(facing);
+  }
+  if (ok && (flags & kFrameUp)) {
+    mathfu::vec3 up;
+    ok = ReadVec3(data_, &read_, &up);
+    if (ok) up_.SetValue(up);
+  }
+  if (ok && (flags & kFramePosition)) {
+    int16_t x, y;
+    ok = Read(data_, &read_, &x) && Read(data_, &read_, &y);
+    if (ok) last_position_ = mathfu::vec2i(x, y);
+  }
+  // A truncated recording ends at the last whole update.
+  if (!ok) read_ = data_.size();
+}
+
+}  // zooshi
+}  // fpl
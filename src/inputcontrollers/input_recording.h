@@ -0,0 +1,105 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_INPUT_RECORDING_H
+#define ZOOSHI_INPUT_RECORDING_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "corgi/entity_manager.h"
+#include "inputcontrollers/base_player_controller.h"
+#include "mathfu/utilities.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Records the player's logical input, and the time each update simulated,
+// to a compact binary file that ReplayController can play back. Each update
+// takes a few bytes, plus whatever changed. A recording covers one session
+// from the start of its level, along with the seeds rand() was given, so the
+// replay generates the same level and projectiles.
+class InputRecorder {
+ public:
+  InputRecorder() : armed_(false), recording_(false) {}
+
+  // While armed, the next session to start calls Start().
+  void set_armed(bool armed) { armed_ = armed; }
+  bool armed() const { return armed_; }
+
+  // Start a new recording, of a session on `level_index`. The level was
+  // loaded after seeding rand() with `level_seed`, and the session starts
+  // with it seeded with `start_seed`.
+  void Start(size_t level_index, uint32_t level_seed, uint32_t start_seed);
+
+  // Stop recording, and write what was recorded to `filename`. Returns false
+  // if it couldn't be written.
+  bool Stop(const char* filename);
+
+  bool recording() const { return recording_; }
+
+  // Record `controller`'s state after an update of `delta_time`
+  // milliseconds.
+  void Record(corgi::WorldTime delta_time,
+              const BasePlayerController& controller);
+
+ private:
+  bool armed_;
+  bool recording_;
+  std::vector<uint8_t> data_;
+  mathfu::vec3 facing_;
+  mathfu::vec3 up_;
+  mathfu::vec2i last_position_;
+};
+
+// Plays back an InputRecorder recording, one recorded update per Update().
+class ReplayController : public BasePlayerController {
+ public:
+  ReplayController()
+      : BasePlayerController(kControllerScripted),
+        read_(0),
+        level_index_(0),
+        level_seed_(0),
+        start_seed_(0) {}
+  virtual ~ReplayController() {}
+
+  // Returns false if `filename` isn't a recording.
+  bool Load(const char* filename);
+
+  // The level the recording was made on, the seed rand() was given before
+  // loading it, and the seed it was given when the session started.
+  size_t level_index() const { return level_index_; }
+  uint32_t level_seed() const { return level_seed_; }
+  uint32_t start_seed() const { return start_seed_; }
+
+  // True once every recorded update has been played.
+  bool finished() const { return read_ >= data_.size(); }
+
+  // How long the next update should simulate, in milliseconds.
+  corgi::WorldTime next_delta_time() const;
+
+  virtual void Update();
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ private:
+  std::string data_;
+  size_t read_;
+  size_t level_index_;
+  uint32_t level_seed_;
+  uint32_t start_seed_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_INPUT_RECORDING_H
@@ -67,6 +67,14 @@ void MouseController::UpdateButtons() {
   for (int i = 0; i < kLogicalButtonCount; i++) {
     buttons_[i].Update();
   }
+  fire_age_ = 0;
+  if (tap_queue_ != nullptr) {
+    // Fire once per click, as soon after it as possible.
+    TapEvent tap;
+    buttons_[kFireProjectile].SetValue(
+        tap_queue_->TakeLatest(kMaxTapAge, &tap, &fire_age_));
+    return;
+  }
   const fplbase::Button& mouse_button = input_system_->GetPointerButton(0);
   if (mouse_button.went_down() || mouse_button.went_up()) {
     buttons_[kFireProjectile].SetValue(mouse_button.is_down());
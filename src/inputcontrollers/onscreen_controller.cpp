@@ -14,8 +14,8 @@
 
 #include "inputcontrollers/onscreen_controller.h"
 
-#include "flatui/flatui.h"
-#include "flatui/flatui_common.h"
+#include <algorithm>
+#include <cmath>
 #include "fplbase/asset_manager.h"
 #include "fplbase/material.h"
 #include "fplbase/utilities.h"
@@ -47,153 +47,145 @@ static const vec4 kForegroundColor = vec4(1.0f, 1.0f, 1.0f, 0.7f);
 // Whether to clamp the controller to a circular area
 // (default behavior clamps to a square).
 static const bool kClampToCircle = true;
-// Name of the group used to track interaction with the controller.
-static const char* kOnscreenController = "onscreen_controller";
+// How far a press has to move before it's a drag rather than a tap.
+static const float kDragStartDistance = 8.0f;
+// The sizes above are in virtual units, as in flatui: this many across the
+// screen's shorter side.
+static const float kVirtualResolution = 1000.0f;
 
 void OnscreenController::UpdateButtons() {
   // Save the position of the last touch of the last pointer (last finger down).
   bool fire = false;
-  const std::vector<fplbase::InputPointer>& pointers =
-      input_system_->get_pointers();
-  for (size_t i = 0; i < pointers.size(); ++i) {
-    const fplbase::InputPointer& pointer = pointers[i];
-    if (pointer.used &&
-        input_system_->GetPointerButton(pointer.id).went_down()) {
-      last_position_ = pointer.mousepos;
-      fire = true;
-      break;
+  fire_age_ = 0;
+  TapEvent tap;
+  if (tap_queue_ != nullptr) {
+    fire = tap_queue_->TakeLatest(kMaxTapAge, &tap, &fire_age_);
+    if (fire) last_position_ = tap.position;
+  } else {
+    const std::vector<fplbase::InputPointer>& pointers =
+        input_system_->get_pointers();
+    for (size_t i = 0; i < pointers.size(); ++i) {
+      const fplbase::InputPointer& pointer = pointers[i];
+      if (pointer.used &&
+          input_system_->GetPointerButton(pointer.id).went_down()) {
+        last_position_ = pointer.mousepos;
+        fire = true;
+        break;
+      }
     }
   }
   buttons_[kFireProjectile].SetValue(fire);
   delta_ = mathfu::kZeros2f;
 }
 
-void OnscreenControllerUI::Update(fplbase::AssetManager* asset_manager,
-                                  flatui::FontManager* font_manager,
-                                  const vec2i& window_size) {
-  if (controller_ && controller_->enabled()) {
-    assert(base_texture_);
-    assert(top_texture_);
-
-    bool* visible = &visible_;
-    const bool was_visible = visible_;
-    fplbase::Texture* base_texture_arg = base_texture_;
-    fplbase::Texture* top_texture_arg = top_texture_;
-    fplbase::InputSystem* input_system = controller_->input_system_;
-    vec2* delta = &controller_->delta_;
-    vec2* location_arg = &location_;
-    flatui::Run(*asset_manager, *font_manager, *input_system,
-                [&window_size, base_texture_arg, top_texture_arg, input_system,
-                 was_visible, visible, location_arg, delta]() {
-      fplbase::Texture* base_texture = base_texture_arg;
-      fplbase::Texture* top_texture = top_texture_arg;
-      vec2* location = location_arg;
-      vec2 pointer_position;
-      flatui::StartGroup(flatui::kLayoutOverlay);
-      {
-        flatui::StartGroup(flatui::kLayoutHorizontalTop, 0,
-                           kOnscreenController);
-        {
-          vec2 virtual_window_size = flatui::PhysicalToVirtual(window_size);
-          flatui::PositionGroup(flatui::kAlignLeft, flatui::kAlignTop,
-                                kHalfSize);
-          auto event = flatui::CheckEvent(false);
-          if (event & (flatui::kEventStartDrag | flatui::kEventIsDragging)) {
-            pointer_position = flatui::PhysicalToVirtual(
-                input_system->get_pointers()[flatui::GetCapturedPointerIndex()]
-                    .mousepos);
-          }
-          if (event & flatui::kEventStartDrag) {
-            flatui::CapturePointer(kOnscreenController);
-            *visible = true;
-            *location = pointer_position - kHalfSize;
-          }
-
-          if (event & flatui::kEventIsDragging) {
-            const vec2 extent = *location + kSize;
-            vec2 direction;
-            if (kClampToCircle) {
-              // Calculate the direction vector relative to the center of
-              // the controller to the extents of the controller.
-              direction =
-                  (pointer_position - (*location + kHalfSize)) / kHalfSize;
-              // Calculate the location on the unit circle to clamp to.
-              float direction_magnitude = direction.Length();
-              if (direction_magnitude > 1.0f) {
-                direction /= direction_magnitude;
-              }
-              // Calculate the pointer position from the direction vector.
-              pointer_position =
-                  (direction * kHalfSize) + *location + kHalfSize;
-            } else {
-              // Clamp the location of the pointer within the bounds of the
-              // control.
-              pointer_position = vec2(mathfu::Clamp(pointer_position.x,
-                                                    location->x, extent.x),
-                                      mathfu::Clamp(pointer_position.y,
-                                                    location->y, extent.y));
-
-              // Calculate position of the pointer relative to the middle of
-              // the control (the direction vector scaled -1.0 .. 1.0 in
-              // both directions).
-              direction =
-                  (pointer_position - (*location + kHalfSize)) / kHalfSize;
-            }
-
-            // Start moving from the dead-zone.
-            // Each direction is negated as screen coordinates go from zero
-            // to positive top->bottom, left->right where directional
-            // controls are inverted, i.e
-            // x positive = left, x negative = right,
-            // y positive = up, y negative = down.
-            delta->x = CalculateDelta(direction.x, kDeadZoneTolerance.x,
-                                      kSensitivity.x);
-            delta->y = CalculateDelta(direction.y, kDeadZoneTolerance.y,
-                                      kSensitivity.y);
-          } else if (event & flatui::kEventEndDrag) {
-            *visible = false;
-            *location = mathfu::kZeros2f;
-            flatui::ReleasePointer();
-          }
-          flatui::CustomElement(
-              virtual_window_size - kSize, "mouse_capture",
-              [base_texture](const vec2i& pos, const vec2i& size) {
+vec2 OnscreenControllerUI::TrackPointer(const vec2& virtual_window_size,
+                                        float scale) {
+  fplbase::InputSystem* input_system = controller_->input_system_;
+  const std::vector<fplbase::InputPointer>& pointers =
+      input_system->get_pointers();
+
+  // Pick up a pointer pressed in the touch area, which is inset by half the
+  // controller's size so the controller always fits on the screen.
+  if (pointer_ < 0) {
+    for (size_t i = 0; i < pointers.size(); ++i) {
+      const fplbase::InputPointer& pointer = pointers[i];
+      if (!pointer.used ||
+          !input_system->GetPointerButton(pointer.id).went_down()) {
+        continue;
+      }
+      const vec2 position = vec2(pointer.mousepos) / scale;
+      if (position.x >= kHalfSize.x && position.y >= kHalfSize.y &&
+          position.x < virtual_window_size.x - kHalfSize.x &&
+          position.y < virtual_window_size.y - kHalfSize.y) {
+        pointer_ = static_cast<int>(i);
+        press_position_ = position;
+        break;
+      }
+    }
+  }
+  if (pointer_ < 0) return mathfu::kZeros2f;
+
+  const fplbase::InputPointer& pointer = pointers[pointer_];
+  vec2 pointer_position = vec2(pointer.mousepos) / scale;
+  if (!pointer.used || !input_system->GetPointerButton(pointer.id).is_down()) {
+    pointer_ = -1;
+    visible_ = false;
+    location_ = mathfu::kZeros2f;
+    return pointer_position;
+  }
+
+  // Taps fire, so the controller only appears once the pointer is dragged,
+  // centered where the drag started.
+  if (!visible_ &&
+      (pointer_position - press_position_).Length() > kDragStartDistance) {
+    visible_ = true;
+    location_ = pointer_position - kHalfSize;
+  }
+  if (!visible_) return pointer_position;
+
+  const vec2 extent = location_ + kSize;
+  vec2 direction;
+  if (kClampToCircle) {
+    // Calculate the direction vector relative to the center of the
+    // controller to the extents of the controller.
+    direction = (pointer_position - (location_ + kHalfSize)) / kHalfSize;
+    // Calculate the location on the unit circle to clamp to.
+    float direction_magnitude = direction.Length();
+    if (direction_magnitude > 1.0f) {
+      direction /= direction_magnitude;
+    }
+    // Calculate the pointer position from the direction vector.
+    pointer_position = (direction * kHalfSize) + location_ + kHalfSize;
+  } else {
+    // Clamp the location of the pointer within the bounds of the control.
+    pointer_position =
+        vec2(mathfu::Clamp(pointer_position.x, location_.x, extent.x),
+             mathfu::Clamp(pointer_position.y, location_.y, extent.y));
+
+    // Calculate position of the pointer relative to the middle of the
+    // control (the direction vector scaled -1.0 .. 1.0 in both directions).
+    direction = (pointer_position - (location_ + kHalfSize)) / kHalfSize;
+  }
+
+  // Start moving from the dead-zone.
+  // Each direction is negated as screen coordinates go from zero to positive
+  // top->bottom, left->right where directional controls are inverted, i.e
+  // x positive = left, x negative = right,
+  // y positive = up, y negative = down.
+  vec2* delta = &controller_->delta_;
+  delta->x = CalculateDelta(direction.x, kDeadZoneTolerance.x, kSensitivity.x);
+  delta->y = CalculateDelta(direction.y, kDeadZoneTolerance.y, kSensitivity.y);
+  return pointer_position;
+}
+
+void OnscreenControllerUI::Update(SpriteBatch* batch) {
+  if (!controller_ || !controller_->enabled()) return;
+  assert(base_texture_);
+  assert(top_texture_);
+
+  // Sizes are in virtual units, so the controller is the same size relative
+  // to the screen on any display.
+  const vec2i window_size = batch->window_size();
+  const float scale =
+      static_cast<float>(std::min(window_size.x, window_size.y)) /
+      kVirtualResolution;
+  const vec2 virtual_window_size = vec2(window_size) / scale;
+
+  const bool was_visible = visible_;
+  const vec2 pointer_position = TrackPointer(virtual_window_size, scale);
+
 #if ZOOSHI_RENDERTOUCH_AREA
-            flatui::RenderTexture(*base_texture, pos, size, vec4(0.1f));
-#else
-            (void)pos;
-            (void)size;
+  batch->Add(base_texture_, kHalfSize * scale,
+             (virtual_window_size - kSize) * scale, vec4(0.1f));
 #endif  // ZOOSHI_RENDERTOUCH_AREA
-              });
-        }
-        flatui::EndGroup();
-        if (was_visible && *visible) {
-          flatui::StartGroup(flatui::kLayoutVerticalLeft);
-          {
-            flatui::PositionGroup(flatui::kAlignLeft, flatui::kAlignTop,
-                                  *location);
-            flatui::CustomElement(
-                kSize, "controller",
-                [&pointer_position, location, base_texture, top_texture](
-                    const vec2i& pos, const vec2i& size) {
-                  // Render the background.
-                  flatui::RenderTexture(*base_texture, pos, size,
-                                        kBackgroundColor);
-                  // Render the pointer location.
-                  const vec2i pointer_render_location =
-                      flatui::VirtualToPhysical(pointer_position -
-                                                kHalfPointerPositionSize);
-                  flatui::RenderTexture(
-                      *top_texture, pointer_render_location,
-                      flatui::VirtualToPhysical(kPointerPositionSize),
-                      kForegroundColor);
-                });
-          }
-          flatui::EndGroup();
-        }
-      }
-      flatui::EndGroup();
-    });
+  if (was_visible && visible_) {
+    // Render the background, then the pointer location.
+    batch->Add(base_texture_, location_ * scale, kSize * scale,
+               kBackgroundColor);
+    batch->Add(top_texture_,
+               (pointer_position - kHalfPointerPositionSize) * scale,
+               kPointerPositionSize * scale, kForegroundColor,
+               SpriteBatch::kLayerHudOverlay);
   }
 }
 
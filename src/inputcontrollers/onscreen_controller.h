@@ -15,11 +15,10 @@
 #ifndef ZOOSHI_ONSCREEN_CONTROLLER_H
 #define ZOOSHI_ONSCREEN_CONTROLLER_H
 
-#include "flatui/font_manager.h"
-#include "fplbase/asset_manager.h"
 #include "fplbase/material.h"
 #include "inputcontrollers/gamepad_controller.h"
 #include "mathfu/vector.h"
+#include "sprite_batch.h"
 
 namespace fpl {
 namespace zooshi {
@@ -50,6 +49,9 @@ class OnscreenController : public GamepadController {
 //
 // The UI rendering is separated from the controller logic so that it can
 // be rendered on a different thread to the game simulation.
+//
+// It's drawn every gameplay frame, so it tracks its pointer and draws its
+// quads itself, rather than running a flatui layout pass.
 class OnscreenControllerUI {
  public:
   OnscreenControllerUI()
@@ -57,12 +59,12 @@ class OnscreenControllerUI {
         location_(mathfu::kZeros2f),
         base_texture_(nullptr),
         top_texture_(nullptr),
-        visible_(false) {}
+        visible_(false),
+        pointer_(-1),
+        press_position_(mathfu::kZeros2f) {}
 
-  // Render the UI.
-  void Update(fplbase::AssetManager* asset_manager,
-              flatui::FontManager* font_manager,
-              const mathfu::vec2i& window_size);
+  // Track the pointer driving the controller, and queue the UI in `batch`.
+  void Update(SpriteBatch* batch);
 
   // Base of the controller (e.g base of the joystick).
   void set_base_texture(fplbase::Texture* base_texture) {
@@ -86,12 +88,21 @@ class OnscreenControllerUI {
   static float CalculateDelta(const float magnitude, const float dead_zone,
                               const float sensitivity);
 
+  // Update `location_`, `visible_` and the controller's delta from the
+  // pointers, and return where the tracked pointer is.
+  mathfu::vec2 TrackPointer(const mathfu::vec2& virtual_window_size,
+                            float scale);
+
  protected:
   OnscreenController* controller_;
   mathfu::vec2 location_;
   fplbase::Texture* base_texture_;
   fplbase::Texture* top_texture_;
   bool visible_;
+  // The index of the pointer pressed in the touch area, or -1, and where it
+  // was pressed. It only moves the controller once it's dragged.
+  int pointer_;
+  mathfu::vec2 press_position_;
 };
 
 }  // zooshi
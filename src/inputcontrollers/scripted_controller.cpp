@@ -0,0 +1,43 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "inputcontrollers/scripted_controller.h"
+
+#include <math.h>
+#include "camera.h"
+#include "mathfu/glsl_mappings.h"
+
+using mathfu::quat;
+
+namespace fpl {
+namespace zooshi {
+
+void ScriptedController::Update() {
+  facing_.Update();
+  up_.Update();
+  for (int i = 0; i < kLogicalButtonCount; i++) {
+    buttons_[i].Update();
+  }
+
+  const float phase = static_cast<float>(updates_ % sweep_period_) /
+                      static_cast<float>(sweep_period_);
+  const float yaw = sweep_angle_ * sin(phase * 2.0f * static_cast<float>(M_PI));
+  up_.SetValue(kCameraUp);
+  facing_.SetValue(quat::FromAngleAxis(yaw, kCameraUp) * kCameraForward);
+  buttons_[kFireProjectile].SetValue(updates_ % fire_interval_ == 0);
+  updates_++;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,53 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_SCRIPTED_CONTROLLER_H
+#define ZOOSHI_SCRIPTED_CONTROLLER_H
+
+#include "inputcontrollers/base_player_controller.h"
+#include "mathfu/utilities.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Plays the game without a person, for benchmarks. Fires at a steady rate
+// while sweeping the player's aim from side to side. Every run with the same
+// settings produces the same input.
+class ScriptedController : public BasePlayerController {
+ public:
+  // Fire once every `fire_interval` updates, sweeping the aim through
+  // `sweep_angle` radians either side of forward every `sweep_period`
+  // updates.
+  ScriptedController(int fire_interval, int sweep_period, float sweep_angle)
+      : BasePlayerController(kControllerScripted),
+        fire_interval_(fire_interval > 0 ? fire_interval : 1),
+        sweep_period_(sweep_period > 0 ? sweep_period : 1),
+        sweep_angle_(sweep_angle),
+        updates_(0) {}
+  virtual ~ScriptedController() {}
+
+  virtual void Update();
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ private:
+  int fire_interval_;
+  int sweep_period_;
+  float sweep_angle_;
+  int updates_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_SCRIPTED_CONTROLLER_H
@@ -0,0 +1,110 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "inputcontrollers/tap_event_queue.h"
+
+#include "SDL_timer.h"
+
+namespace fpl {
+namespace zooshi {
+
+// At most this many taps are kept until they're taken, so a backlog can't
+// build up while the game isn't reading them.
+static const size_t kMaxPendingTaps = 16;
+
+TapEventQueue::TapEventQueue()
+    : watching_(false), mutex_(SDL_CreateMutex()), window_size_(1) {}
+
+TapEventQueue::~TapEventQueue() {
+  Shutdown();
+  SDL_DestroyMutex(mutex_);
+}
+
+void TapEventQueue::Initialize() {
+  if (watching_) return;
+  SDL_AddEventWatch(EventWatch, this);
+  watching_ = true;
+}
+
+void TapEventQueue::Shutdown() {
+  if (!watching_) return;
+  SDL_DelEventWatch(EventWatch, this);
+  watching_ = false;
+}
+
+void TapEventQueue::set_window_size(const mathfu::vec2i& window_size) {
+  SDL_LockMutex(mutex_);
+  window_size_ = window_size;
+  SDL_UnlockMutex(mutex_);
+}
+
+int TapEventQueue::EventWatch(void* userdata, SDL_Event* event) {
+  TapEventQueue* queue = static_cast<TapEventQueue*>(userdata);
+  switch (event->type) {
+    case SDL_MOUSEBUTTONDOWN:
+      // Touches also send mouse events, which would be counted twice.
+      if (event->button.button == SDL_BUTTON_LEFT &&
+          event->button.which != SDL_TOUCH_MOUSEID) {
+        queue->Push(mathfu::vec2i(event->button.x, event->button.y),
+                    event->button.timestamp);
+      }
+      break;
+    case SDL_FINGERDOWN: {
+      SDL_LockMutex(queue->mutex_);
+      const mathfu::vec2 window_size(queue->window_size_);
+      SDL_UnlockMutex(queue->mutex_);
+      const mathfu::vec2 position =
+          mathfu::vec2(event->tfinger.x, event->tfinger.y) * window_size;
+      queue->Push(mathfu::vec2i(position), event->tfinger.timestamp);
+      break;
+    }
+    default:
+      break;
+  }
+  return 1;
+}
+
+void TapEventQueue::Push(const mathfu::vec2i& position, uint32_t timestamp) {
+  TapEvent tap;
+  tap.position = position;
+  tap.timestamp = timestamp;
+  SDL_LockMutex(mutex_);
+  if (taps_.size() >= kMaxPendingTaps) taps_.erase(taps_.begin());
+  taps_.push_back(tap);
+  SDL_UnlockMutex(mutex_);
+}
+
+void TapEventQueue::Clear() {
+  SDL_LockMutex(mutex_);
+  taps_.clear();
+  SDL_UnlockMutex(mutex_);
+}
+
+bool TapEventQueue::TakeLatest(uint32_t max_age, TapEvent* tap,
+                               uint32_t* age) {
+  SDL_LockMutex(mutex_);
+  const bool has_tap = !taps_.empty();
+  if (has_tap) *tap = taps_.back();
+  taps_.clear();
+  SDL_UnlockMutex(mutex_);
+  if (!has_tap) return false;
+
+  // Flooring at zero guards against a timestamp from a slightly later clock
+  // read than ours.
+  const uint32_t now = SDL_GetTicks();
+  *age = SDL_TICKS_PASSED(now, tap->timestamp) ? now - tap->timestamp : 0;
+  return *age <= max_age;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,77 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_TAP_EVENT_QUEUE_H
+#define ZOOSHI_TAP_EVENT_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+#include "SDL_events.h"
+#include "SDL_mutex.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A touch or left click, as SDL received it.
+struct TapEvent {
+  // In screen space, with 0,0 as top-left.
+  mathfu::vec2i position;
+  // SDL_GetTicks() when the tap happened.
+  uint32_t timestamp;
+};
+
+// Records taps the moment SDL receives them, with their timestamps, rather
+// than once a frame when the input system is polled. Controllers read taps
+// from here on the update thread, so a tap that arrives after the render
+// thread polled input is still seen by the next update, and how long ago it
+// happened is known.
+class TapEventQueue {
+ public:
+  TapEventQueue();
+  ~TapEventQueue();
+
+  // Start and stop watching SDL's events.
+  void Initialize();
+  void Shutdown();
+
+  // Touches are reported relative to the window, so the queue needs its
+  // size to place them.
+  void set_window_size(const mathfu::vec2i& window_size);
+
+  // Take every tap recorded so far. If the newest is no more than `max_age`
+  // milliseconds old, set `tap` and `age` to it and return true. Older taps
+  // happened while nothing was listening, such as in a menu, and are
+  // dropped.
+  bool TakeLatest(uint32_t max_age, TapEvent* tap, uint32_t* age);
+
+  // Forget every tap recorded so far.
+  void Clear();
+
+ private:
+  static int EventWatch(void* userdata, SDL_Event* event);
+  void Push(const mathfu::vec2i& position, uint32_t timestamp);
+
+  bool watching_;
+
+  // Guards everything below. SDL can deliver events from other threads,
+  // such as Android's UI thread.
+  SDL_mutex* mutex_;
+  mathfu::vec2i window_size_;
+  std::vector<TapEvent> taps_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_TAP_EVENT_QUEUE_H
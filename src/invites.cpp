@@ -24,8 +24,18 @@ const char* kInviteHandledKey = "zooshi:invite_handled";
 const char* kInviteSentKey = "zooshi:invite_sent";
 
 InvitesListener::InvitesListener()
-    : received_invite_(false), invitation_id_(), deep_link_() {
-  invite_handled_ = fplbase::LoadPreference(kInviteHandledKey, 0) != 0;
+    : received_invite_(false),
+      invitation_id_(),
+      deep_link_(),
+      invite_handled_(false),
+      save_store_(nullptr) {}
+
+void InvitesListener::Initialize(SaveStore* save_store) {
+  save_store_ = save_store;
+  invite_handled_ = save_store_->GetValue(kInviteHandledKey, 0) != 0;
+  // Read now, so older saves' count is migrated before the store's first
+  // commit.
+  save_store_->GetValue(kInviteSentKey, 0);
 }
 
 void SendInvite() {
@@ -36,7 +46,8 @@ void SendInvite() {
   firebase::invites::SendInvite(invite);
 }
 
-bool UpdateSentInviteStatus(bool* did_send, bool* first_sent) {
+bool UpdateSentInviteStatus(SaveStore* save_store, bool* did_send,
+                            bool* first_sent) {
   auto future = firebase::invites::SendInviteLastResult();
   if (future.Status() == firebase::kFutureStatusComplete) {
     bool were_sent =
@@ -45,11 +56,11 @@ bool UpdateSentInviteStatus(bool* did_send, bool* first_sent) {
       *did_send = were_sent;
     }
     if (were_sent) {
-      int invite_sent_count = fplbase::LoadPreference(kInviteSentKey, 0);
+      int invite_sent_count = save_store->GetValue(kInviteSentKey, 0);
       if (first_sent) {
         *first_sent = invite_sent_count == 0;
       }
-      fplbase::SavePreference(
+      save_store->SetValue(
           kInviteSentKey, static_cast<int32_t>(
               invite_sent_count + future.Result()->invitation_ids.size()));
     }
@@ -82,7 +93,7 @@ void InvitesListener::OnErrorReceived(int error_code,
 void InvitesListener::HandlePendingInvite() {
   if (!has_pending_invite()) return;
   invite_handled_ = true;
-  fplbase::SavePreference(kInviteHandledKey, 1);
+  save_store_->SetValue(kInviteHandledKey, 1);
   if (!invitation_id_.empty()) {
     firebase::invites::ConvertInvitation(invitation_id_.c_str());
   }
@@ -91,8 +102,8 @@ void InvitesListener::HandlePendingInvite() {
 void InvitesListener::Reset() {
   invite_handled_ = false;
   received_invite_ = false;
-  fplbase::SavePreference(kInviteHandledKey, 0);
-  fplbase::SavePreference(kInviteSentKey, 0);
+  save_store_->SetValue(kInviteHandledKey, 0);
+  save_store_->SetValue(kInviteSentKey, 0);
 }
 
 }  // zooshi
@@ -25,6 +25,8 @@
 
 #include "mathfu/internal/disable_warnings_end.h"
 
+#include "save_store.h"
+
 // This determines if only the first ever received invite is handled (when 1),
 // or if all invites are rewarded (when 0).
 #define ZOOSHI_FIRST_INVITE_ONLY 0
@@ -38,13 +40,17 @@ void SendInvite();
 // Returns true when finished (successfully or not).
 // Upon returning true, did_send is set to whether an invite was sent or not.
 // If did_send is true, first_sent is set to whether this was the first time
-// an invite was sent.
-bool UpdateSentInviteStatus(bool* did_send, bool* first_sent);
+// an invite was sent. The number sent is kept in save_store.
+bool UpdateSentInviteStatus(SaveStore* save_store, bool* did_send,
+                            bool* first_sent);
 
 class InvitesListener : public firebase::invites::Listener {
  public:
   InvitesListener();
 
+  // Read whether an invite was handled from `save_store`, where it's kept.
+  void Initialize(SaveStore* save_store);
+
   // Function called when an invite is received by Firebase.
   void OnInviteReceived(const char* invitation_id, const char* deep_link,
                         bool is_strong_match) override;
@@ -80,6 +86,7 @@ class InvitesListener : public firebase::invites::Listener {
   std::string deep_link_;
 
   bool invite_handled_;
+  SaveStore* save_store_;
 };
 
 }  // zooshi
@@ -0,0 +1,215 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "job_system.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "SDL_cpuinfo.h"
+#include "SDL_timer.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+
+namespace fpl {
+namespace zooshi {
+
+// Cores reserved for the render and update threads.
+static const int kReservedCores = 2;
+
+// More workers than this rarely help, since jobs are short.
+static const int kMaxWorkers = 6;
+
+JobSystem::JobSystem()
+    : sleep_mutex_(SDL_CreateMutex()),
+      wake_cv_(SDL_CreateCond()),
+      queued_tasks_(0),
+      exiting_(false) {
+  SDL_AtomicSet(&next_queue_, 0);
+}
+
+JobSystem::~JobSystem() {
+  Shutdown();
+  SDL_DestroyCond(wake_cv_);
+  SDL_DestroyMutex(sleep_mutex_);
+}
+
+int JobSystem::DefaultWorkerCount() {
+  return std::max(0,
+                  std::min(SDL_GetCPUCount() - kReservedCores, kMaxWorkers));
+}
+
+void JobSystem::Initialize(int num_workers) {
+  assert(workers_.empty());
+
+  // Workers hold a pointer to their start data, so it mustn't move.
+  worker_starts_.resize(num_workers);
+  for (int i = 0; i < num_workers; ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    const int index = static_cast<int>(workers_.size());
+    worker_starts_[index].system = this;
+    worker_starts_[index].index = index;
+    workers_.push_back(std::move(worker));
+    Worker* started = workers_.back().get();
+    started->thread = SDL_CreateThread(WorkerMain, "Zooshi Job Worker",
+                                       &worker_starts_[index]);
+    if (started->thread == nullptr) {
+      LogError("Error creating job worker thread: %s", SDL_GetError());
+      workers_.pop_back();
+      break;
+    }
+    started->id = SDL_GetThreadID(started->thread);
+  }
+}
+
+void JobSystem::Shutdown() {
+  SDL_LockMutex(sleep_mutex_);
+  exiting_ = true;
+  SDL_CondBroadcast(wake_cv_);
+  SDL_UnlockMutex(sleep_mutex_);
+  for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+    SDL_WaitThread((*it)->thread, nullptr);
+  }
+  workers_.clear();
+  worker_starts_.clear();
+  queued_tasks_ = 0;
+  exiting_ = false;
+}
+
+int JobSystem::WorkerMain(void* data) {
+  const WorkerStart* start = static_cast<const WorkerStart*>(data);
+  JobSystem* system = start->system;
+  const int index = start->index;
+  for (;;) {
+    if (system->RunOneTask(index)) continue;
+
+    SDL_LockMutex(system->sleep_mutex_);
+    while (system->queued_tasks_ == 0 && !system->exiting_) {
+      SDL_CondWait(system->wake_cv_, system->sleep_mutex_);
+    }
+    const bool exiting = system->exiting_;
+    SDL_UnlockMutex(system->sleep_mutex_);
+    if (exiting) break;
+  }
+  return 0;
+}
+
+int JobSystem::CurrentWorkerIndex() const {
+  const SDL_threadID id = SDL_ThreadID();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i]->id == id) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+void JobSystem::Run(const Job& job, JobCounter* counter) {
+  SDL_AtomicIncRef(&counter->count_);
+  Task task;
+  task.job = job;
+  task.counter = counter;
+  if (workers_.empty()) {
+    Execute(&task);
+    return;
+  }
+
+  // Jobs started by a worker go on its own queue, where it'll find them
+  // first. Others are spread between the workers.
+  int index = CurrentWorkerIndex();
+  if (index < 0) {
+    index = SDL_AtomicAdd(&next_queue_, 1) % num_workers();
+    if (index < 0) index += num_workers();
+  }
+  Worker* worker = workers_[index].get();
+  SDL_LockMutex(worker->mutex);
+  worker->tasks.push_back(task);
+  SDL_UnlockMutex(worker->mutex);
+
+  SDL_LockMutex(sleep_mutex_);
+  queued_tasks_++;
+  SDL_CondSignal(wake_cv_);
+  SDL_UnlockMutex(sleep_mutex_);
+}
+
+bool JobSystem::TakeTask(int worker_index, Task* task) {
+  const int num = num_workers();
+  for (int i = 0; i < num; ++i) {
+    // Start with our own queue, if we have one.
+    const int index = worker_index < 0 ? i : (worker_index + i) % num;
+    Worker* worker = workers_[index].get();
+    SDL_LockMutex(worker->mutex);
+    const bool found = !worker->tasks.empty();
+    if (found) {
+      // Take our own newest task, which is most likely still in cache, or
+      // steal someone else's oldest, which is likely to be the largest.
+      if (index == worker_index) {
+        *task = worker->tasks.back();
+        worker->tasks.pop_back();
+      } else {
+        *task = worker->tasks.front();
+        worker->tasks.pop_front();
+      }
+    }
+    SDL_UnlockMutex(worker->mutex);
+    if (found) {
+      SDL_LockMutex(sleep_mutex_);
+      queued_tasks_--;
+      SDL_UnlockMutex(sleep_mutex_);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool JobSystem::RunOneTask(int worker_index) {
+  Task task;
+  if (!TakeTask(worker_index, &task)) return false;
+  Execute(&task);
+  return true;
+}
+
+void JobSystem::Execute(Task* task) {
+  task->job();
+  SDL_AtomicDecRef(&task->counter->count_);
+}
+
+void JobSystem::Wait(JobCounter* counter) {
+  const int worker_index = CurrentWorkerIndex();
+  while (!counter->Done()) {
+    // Help out rather than sleep. If there's nothing left to take, the
+    // remaining jobs are already running on other threads.
+    if (!RunOneTask(worker_index)) {
+      SDL_Delay(0);
+    }
+  }
+}
+
+void JobSystem::ParallelFor(int count, int chunk_size, const RangeJob& job) {
+  if (count <= 0) return;
+  chunk_size = std::max(chunk_size, 1);
+  if (workers_.empty() || count <= chunk_size) {
+    job(0, count);
+    return;
+  }
+
+  JobCounter counter;
+  for (int begin = chunk_size; begin < count; begin += chunk_size) {
+    const int end = std::min(begin + chunk_size, count);
+    Run([&job, begin, end]() { job(begin, end); }, &counter);
+  }
+  job(0, chunk_size);
+  Wait(&counter);
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,122 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_JOB_SYSTEM_H_
+#define ZOOSHI_JOB_SYSTEM_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "SDL_atomic.h"
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Counts the jobs started with it that haven't finished yet.
+class JobCounter {
+ public:
+  JobCounter() { SDL_AtomicSet(&count_, 0); }
+  bool Done() const { return SDL_AtomicGet(&count_) == 0; }
+
+ private:
+  friend class JobSystem;
+  mutable SDL_atomic_t count_;
+};
+
+// A pool of worker threads that run short jobs for the update thread. Each
+// worker has its own queue. Workers take their newest job first, and when
+// their own queue is empty they steal the oldest job from another worker's.
+// Threads waiting on a JobCounter run queued jobs until it's done, so jobs can
+// start and wait on jobs of their own.
+//
+// With no workers, jobs are run immediately on the thread that starts them.
+class JobSystem {
+ public:
+  typedef std::function<void()> Job;
+  typedef std::function<void(int begin, int end)> RangeJob;
+
+  JobSystem();
+  ~JobSystem();
+
+  // Start `num_workers` worker threads. Workers that fail to start are
+  // skipped.
+  void Initialize(int num_workers);
+
+  // Stop the workers. Any jobs still queued are dropped.
+  void Shutdown();
+
+  // The number of workers to use, leaving a core each for the render and
+  // update threads.
+  static int DefaultWorkerCount();
+
+  // Queue `job`. `counter` is incremented now, and decremented once the job
+  // has run.
+  void Run(const Job& job, JobCounter* counter);
+
+  // Run queued jobs until every job started with `counter` has finished.
+  void Wait(JobCounter* counter);
+
+  // Call `job` on consecutive ranges of [0, count), each at most
+  // `chunk_size` long, and wait for them all to finish. The first range is
+  // run on the calling thread.
+  void ParallelFor(int count, int chunk_size, const RangeJob& job);
+
+  int num_workers() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  struct Task {
+    Job job;
+    JobCounter* counter;
+  };
+
+  struct Worker {
+    Worker() : thread(nullptr), id(0), mutex(SDL_CreateMutex()) {}
+    ~Worker() { SDL_DestroyMutex(mutex); }
+    SDL_Thread* thread;
+    SDL_threadID id;
+    SDL_mutex* mutex;
+    std::deque<Task> tasks;  // Guarded by `mutex`.
+  };
+
+  struct WorkerStart {
+    JobSystem* system;
+    int index;
+  };
+
+  static int WorkerMain(void* data);
+  int CurrentWorkerIndex() const;
+  bool TakeTask(int worker_index, Task* task);
+  bool RunOneTask(int worker_index);
+  void Execute(Task* task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<WorkerStart> worker_starts_;
+
+  // Workers sleep on `wake_cv_` when no task is queued anywhere.
+  SDL_mutex* sleep_mutex_;
+  SDL_cond* wake_cv_;
+  int queued_tasks_;  // Guarded by `sleep_mutex_`.
+  bool exiting_;      // Guarded by `sleep_mutex_`.
+
+  // Queue to give the next task started from outside the pool.
+  SDL_atomic_t next_queue_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_JOB_SYSTEM_H_
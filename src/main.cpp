@@ -16,8 +16,11 @@
 
 #include "fplbase/utilities.h"
 #include "game.h"
+#include "memory_tracker.h"
 
 extern "C" int FPL_main(int argc, char* argv[]) {
+  // Before the game creates anything with Bullet.
+  fpl::zooshi::MemoryTracker::InstallPhysicsHooks();
   fpl::zooshi::Game game;
   const char* binary_directory = argc > 0 ? argv[0] : "";
 #if defined(__ANDROID__)
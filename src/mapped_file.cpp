@@ -0,0 +1,154 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "mapped_file.h"
+
+#include "memory_tracker.h"
+
+#if defined(__ANDROID__) || defined(_WIN32)
+#include "fplbase/utilities.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fpl {
+namespace zooshi {
+
+static bool DefaultMapFile(const char* filename, MappedFile* file) {
+  return file->Open(filename);
+}
+
+static MapFileFunction map_file_function = DefaultMapFile;
+
+MappedFile::MappedFile()
+    : data_(nullptr), size_(0), owned_(false), trusted_(false) {
+#if defined(__ANDROID__)
+  asset_ = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+void MappedFile::OpenView(const char* data, size_t size) {
+  Close();
+  data_ = data;
+  size_ = size;
+}
+
+#if defined(__ANDROID__)
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+  AAsset* asset = AAssetManager_open(fplbase::GetAAssetManager(), filename,
+                                     AASSET_MODE_BUFFER);
+  if (asset == nullptr) return false;
+  // Compressed assets are inflated into a buffer the asset owns.
+  const void* buffer = AAsset_getBuffer(asset);
+  if (buffer == nullptr) {
+    AAsset_close(asset);
+    return false;
+  }
+  asset_ = asset;
+  data_ = static_cast<const char*>(buffer);
+  size_ = static_cast<size_t>(AAsset_getLength(asset));
+  owned_ = true;
+  MemoryTracker::Get().Allocate(kMemoryFiles, size_);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (owned_) MemoryTracker::Get().Free(kMemoryFiles, size_);
+  if (asset_ != nullptr) AAsset_close(asset_);
+  asset_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+  owned_ = false;
+  trusted_ = false;
+}
+
+#elif defined(_WIN32)
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+  if (!fplbase::LoadFileRaw(filename, &buffer_)) return false;
+  data_ = buffer_.c_str();
+  size_ = buffer_.size();
+  owned_ = true;
+  MemoryTracker::Get().Allocate(kMemoryFiles, size_);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (owned_) MemoryTracker::Get().Free(kMemoryFiles, size_);
+  std::string().swap(buffer_);
+  data_ = nullptr;
+  size_ = 0;
+  owned_ = false;
+  trusted_ = false;
+}
+
+#else
+
+// Empty files can't be mapped, so they're given this instead.
+static const char kEmptyFile[] = "";
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(file_stat.st_size);
+  if (size == 0) {
+    close(fd);
+    data_ = kEmptyFile;
+    return true;
+  }
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping holds its own reference to the file.
+  close(fd);
+  if (mapping == MAP_FAILED) return false;
+  data_ = static_cast<const char*>(mapping);
+  size_ = size;
+  owned_ = true;
+  MemoryTracker::Get().Allocate(kMemoryFiles, size_);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (owned_) MemoryTracker::Get().Free(kMemoryFiles, size_);
+  if (owned_ && size_ > 0) munmap(const_cast<char*>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+  owned_ = false;
+  trusted_ = false;
+}
+
+#endif
+
+bool MapFile(const char* filename, MappedFile* file) {
+  return map_file_function(filename, file);
+}
+
+void SetMapFileFunction(MapFileFunction function) {
+  map_file_function = function != nullptr ? function : DefaultMapFile;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,85 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_MAPPED_FILE_H_
+#define ZOOSHI_MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <string>
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#endif  // __ANDROID__
+
+namespace fpl {
+namespace zooshi {
+
+// A read-only view of a whole file, valid until the MappedFile is closed or
+// destroyed. Android assets are read straight from the APK where they're
+// stored uncompressed, and files elsewhere are memory mapped, so loading a
+// flatbuffer doesn't copy it onto the heap. Platforms without mapping read
+// the file into memory owned by the MappedFile.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  // Open and map `filename`, closing any file already open. Returns false,
+  // leaving the MappedFile closed, if the file couldn't be opened.
+  bool Open(const char* filename);
+
+  // Refer to `size` bytes owned by something else, such as an archive
+  // that's mapped, which must outlive the view.
+  void OpenView(const char* data, size_t size);
+
+  void Close();
+
+  bool is_open() const { return data_ != nullptr; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // True if the file was verified when the assets were built, so loaders
+  // needn't verify it again. See TrustedAssets.
+  bool trusted() const { return trusted_; }
+  void set_trusted(bool trusted) { trusted_ = trusted; }
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* data_;
+  size_t size_;
+  // False for views.
+  bool owned_;
+  bool trusted_;
+#if defined(__ANDROID__)
+  AAsset* asset_;
+#elif defined(_WIN32)
+  std::string buffer_;
+#endif
+};
+
+// Map `filename` through the function set with SetMapFileFunction(), which
+// may look for the file somewhere else first. Like fplbase::LoadFile().
+bool MapFile(const char* filename, MappedFile* file);
+
+typedef bool (*MapFileFunction)(const char* filename, MappedFile* file);
+
+// Replace the function MapFile() uses. Null restores the default, which
+// opens `filename` itself.
+void SetMapFileFunction(MapFileFunction map_file_function);
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_MAPPED_FILE_H_
@@ -0,0 +1,169 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "memory_tracker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "LinearMath/btAlignedAllocator.h"
+#include "config_generated.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+static const size_t kBytesPerMegabyte = 1024 * 1024;
+
+// Bullet's allocations are prefixed with their size, so they can be
+// uncounted when freed. Padded so what follows keeps malloc's alignment.
+static const size_t kPhysicsHeaderSize = 16;
+
+static const char* const kTagNames[] = {"Textures",   "Meshes",  "Files",
+                                        "Components", "Physics", "Residency"};
+static_assert(FPL_ARRAYSIZE(kTagNames) == kMemoryTagCount,
+              "Every MemoryTag needs a name.");
+
+static void* PhysicsAlloc(size_t size) {
+  char* block = static_cast<char*>(malloc(size + kPhysicsHeaderSize));
+  if (block == nullptr) return nullptr;
+  *reinterpret_cast<size_t*>(block) = size;
+  MemoryTracker::Get().Allocate(kMemoryPhysics, size);
+  return block + kPhysicsHeaderSize;
+}
+
+static void PhysicsFree(void* memory) {
+  if (memory == nullptr) return;
+  char* block = static_cast<char*>(memory) - kPhysicsHeaderSize;
+  MemoryTracker::Get().Free(kMemoryPhysics,
+                            *reinterpret_cast<size_t*>(block));
+  free(block);
+}
+
+MemoryTracker& MemoryTracker::Get() {
+  static MemoryTracker tracker;
+  return tracker;
+}
+
+MemoryTracker::MemoryTracker() {
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    SDL_AtomicSet(&bytes_[i], 0);
+    SDL_AtomicSet(&peaks_[i], 0);
+    budgets_[i] = 0;
+  }
+}
+
+void MemoryTracker::InstallPhysicsHooks() {
+  btAlignedAllocSetCustom(PhysicsAlloc, PhysicsFree);
+}
+
+void MemoryTracker::Allocate(MemoryTag tag, size_t bytes) {
+  const int delta = static_cast<int>(bytes);
+  const int old_bytes = SDL_AtomicAdd(&bytes_[tag], delta);
+  Updated(tag, old_bytes, old_bytes + delta);
+}
+
+void MemoryTracker::Free(MemoryTag tag, size_t bytes) {
+  SDL_AtomicAdd(&bytes_[tag], -static_cast<int>(bytes));
+}
+
+void MemoryTracker::Set(MemoryTag tag, size_t bytes) {
+  const int new_bytes = static_cast<int>(bytes);
+  const int old_bytes = SDL_AtomicSet(&bytes_[tag], new_bytes);
+  Updated(tag, old_bytes, new_bytes);
+}
+
+void MemoryTracker::Updated(MemoryTag tag, int old_bytes, int new_bytes) {
+  int peak = SDL_AtomicGet(&peaks_[tag]);
+  while (new_bytes > peak &&
+         !SDL_AtomicCAS(&peaks_[tag], peak, new_bytes)) {
+    peak = SDL_AtomicGet(&peaks_[tag]);
+  }
+  const size_t budget = budgets_[tag];
+  if (budget != 0 && static_cast<size_t>(old_bytes) <= budget &&
+      static_cast<size_t>(new_bytes) > budget) {
+    LogError("Memory: %s over budget, %.1fMB of %.1fMB", TagName(tag),
+             static_cast<double>(new_bytes) / kBytesPerMegabyte,
+             static_cast<double>(budget) / kBytesPerMegabyte);
+  }
+}
+
+size_t MemoryTracker::bytes(MemoryTag tag) const {
+  return static_cast<size_t>(
+      SDL_AtomicGet(const_cast<SDL_atomic_t*>(&bytes_[tag])));
+}
+
+size_t MemoryTracker::peak(MemoryTag tag) const {
+  return static_cast<size_t>(
+      SDL_AtomicGet(const_cast<SDL_atomic_t*>(&peaks_[tag])));
+}
+
+void MemoryTracker::SetBudgets(const MemoryBudgets* budgets) {
+  const int megabytes[] = {
+      budgets != nullptr ? budgets->textures() : 0,
+      budgets != nullptr ? budgets->meshes() : 0,
+      budgets != nullptr ? budgets->files() : 0,
+      budgets != nullptr ? budgets->components() : 0,
+      budgets != nullptr ? budgets->physics() : 0,
+      budgets != nullptr ? budgets->residency() : 0};
+  static_assert(FPL_ARRAYSIZE(megabytes) == kMemoryTagCount,
+                "Every MemoryTag needs a budget.");
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    budgets_[i] = static_cast<size_t>(megabytes[i]) * kBytesPerMegabyte;
+  }
+}
+
+bool MemoryTracker::OverBudget(MemoryTag tag) const {
+  return budgets_[tag] != 0 && bytes(tag) > budgets_[tag];
+}
+
+void MemoryTracker::AppendReport(std::vector<std::string>* lines) const {
+  char buffer[128];
+  size_t total = 0;
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    total += bytes(static_cast<MemoryTag>(i));
+  }
+  snprintf(buffer, sizeof(buffer), "Memory: %.1fMB",
+           static_cast<double>(total) / kBytesPerMegabyte);
+  lines->push_back(buffer);
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    const MemoryTag tag = static_cast<MemoryTag>(i);
+    const int written = snprintf(
+        buffer, sizeof(buffer), "  %s: %.1fMB (peak %.1fMB)", TagName(tag),
+        static_cast<double>(bytes(tag)) / kBytesPerMegabyte,
+        static_cast<double>(peak(tag)) / kBytesPerMegabyte);
+    if (budgets_[tag] != 0 && written > 0 &&
+        static_cast<size_t>(written) < sizeof(buffer)) {
+      snprintf(buffer + written, sizeof(buffer) - written, " of %.1fMB%s",
+               static_cast<double>(budgets_[tag]) / kBytesPerMegabyte,
+               OverBudget(tag) ? " OVER" : "");
+    }
+    lines->push_back(buffer);
+  }
+}
+
+void MemoryTracker::LogReport() const {
+  std::vector<std::string> lines;
+  AppendReport(&lines);
+  for (auto it = lines.begin(); it != lines.end(); ++it) {
+    LogInfo("%s", it->c_str());
+  }
+}
+
+const char* MemoryTracker::TagName(MemoryTag tag) { return kTagNames[tag]; }
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,101 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_MEMORY_TRACKER_H_
+#define ZOOSHI_MEMORY_TRACKER_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "SDL_atomic.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct MemoryBudgets;
+
+// The subsystems memory is accounted to.
+enum MemoryTag {
+  // Decoded textures, sampled from the loaded materials.
+  kMemoryTextures,
+  // Mesh data, sampled from the loaded meshes.
+  kMemoryMeshes,
+  // Files held open through MappedFile, such as flatbuffer sources.
+  kMemoryFiles,
+  // Per-entity component data, sampled from each component.
+  kMemoryComponents,
+  // Everything Bullet allocates.
+  kMemoryPhysics,
+  // CPU copies of generated meshes, kept to recover from a lost GL context.
+  kMemoryResidency,
+  kMemoryTagCount
+};
+
+// Counts the bytes each subsystem holds, against budgets from the config.
+// Allocations that pass through the game, such as Bullet's and mapped
+// files, are counted as they happen. Memory owned by libraries without an
+// allocation hook is sampled from what they have loaded instead.
+//
+// Like the profiler, the tracker is global, so it can be updated from
+// anywhere, on any thread.
+class MemoryTracker {
+ public:
+  static MemoryTracker& Get();
+
+  // Route Bullet's allocations through the tracker. Must be called before
+  // anything is allocated by Bullet.
+  static void InstallPhysicsHooks();
+
+  // Count `bytes` more, or fewer, against `tag`.
+  void Allocate(MemoryTag tag, size_t bytes);
+  void Free(MemoryTag tag, size_t bytes);
+
+  // Replace the count for a sampled `tag`.
+  void Set(MemoryTag tag, size_t bytes);
+
+  size_t bytes(MemoryTag tag) const;
+  size_t peak(MemoryTag tag) const;
+
+  // Take budgets from `budgets`, in megabytes. Null, or 0 for a tag, leaves
+  // it unlimited.
+  void SetBudgets(const MemoryBudgets* budgets);
+  size_t budget(MemoryTag tag) const { return budgets_[tag]; }
+  bool OverBudget(MemoryTag tag) const;
+
+  // Append a line per tag describing its usage to `lines`.
+  void AppendReport(std::vector<std::string>* lines) const;
+
+  // Write the report to the log.
+  void LogReport() const;
+
+  static const char* TagName(MemoryTag tag);
+
+ private:
+  MemoryTracker();
+  MemoryTracker(const MemoryTracker&);
+  MemoryTracker& operator=(const MemoryTracker&);
+
+  // Raise the peak, and warn if the count just went over budget.
+  void Updated(MemoryTag tag, int old_bytes, int new_bytes);
+
+  // Bytes, which are well within range of an int on the devices we target.
+  SDL_atomic_t bytes_[kMemoryTagCount];
+  SDL_atomic_t peaks_[kMemoryTagCount];
+  size_t budgets_[kMemoryTagCount];
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_MEMORY_TRACKER_H_
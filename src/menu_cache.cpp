@@ -0,0 +1,183 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "menu_cache.h"
+
+#include <algorithm>
+#include "SDL_video.h"
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+#include "mathfu/constants.h"
+
+using fplbase::LogInfo;
+using mathfu::mat4;
+using mathfu::vec2;
+using mathfu::vec2i;
+using mathfu::vec3;
+
+namespace fpl {
+namespace zooshi {
+
+#if defined(_WIN32)
+#define ZOOSHI_GL_APIENTRY __stdcall
+#else
+#define ZOOSHI_GL_APIENTRY
+#endif  // defined(_WIN32)
+
+typedef void(ZOOSHI_GL_APIENTRY* BlendFuncSeparateFunc)(GLenum src_rgb,
+                                                         GLenum dst_rgb,
+                                                         GLenum src_alpha,
+                                                         GLenum dst_alpha);
+
+// Core in GLES 2.0, but not exported by every desktop GL library.
+static BlendFuncSeparateFunc blend_func_separate = nullptr;
+
+MenuCache::MenuCache()
+    : enabled_(false),
+      max_age_frames_(30),
+      input_frames_(2),
+      shader_(nullptr),
+      target_size_(mathfu::kZeros2i),
+      valid_(false),
+      key_(0),
+      age_frames_(0),
+      frames_since_input_(0) {}
+
+void MenuCache::Initialize(const MenuCacheConfig* config,
+                           fplbase::AssetManager* asset_manager) {
+  enabled_ = config != nullptr && config->enabled();
+  valid_ = false;
+  if (!enabled_) return;
+
+  max_age_frames_ = std::max(config->max_age_frames(), 1);
+  input_frames_ = std::max(config->input_frames(), 1);
+  shader_ = asset_manager->LoadShader("shaders/textured");
+  blend_func_separate = reinterpret_cast<BlendFuncSeparateFunc>(
+      SDL_GL_GetProcAddress("glBlendFuncSeparate"));
+  if (shader_ == nullptr || blend_func_separate == nullptr) {
+    LogInfo("Menus can't be cached; they'll be drawn every frame.");
+    enabled_ = false;
+  }
+}
+
+bool MenuCache::HasInput(fplbase::InputSystem* input) {
+  const std::vector<fplbase::InputPointer>& pointers = input->get_pointers();
+  for (size_t i = 0; i < pointers.size(); ++i) {
+    const fplbase::InputPointer& pointer = pointers[i];
+    if (!pointer.used) continue;
+    const fplbase::Button& button = input->GetPointerButton(pointer.id);
+    if (pointer.mousedelta.x != 0 || pointer.mousedelta.y != 0 ||
+        button.is_down() || button.went_down() || button.went_up()) {
+      return true;
+    }
+  }
+
+  // Keys flatui navigates with.
+  static const fplbase::FPL_Keycode kNavigationKeys[] = {
+      fplbase::FPLK_UP,     fplbase::FPLK_DOWN,   fplbase::FPLK_LEFT,
+      fplbase::FPLK_RIGHT,  fplbase::FPLK_RETURN, fplbase::FPLK_ESCAPE,
+      fplbase::FPLK_AC_BACK};
+  for (size_t i = 0; i < sizeof(kNavigationKeys) / sizeof(kNavigationKeys[0]);
+       ++i) {
+    const fplbase::Button& button = input->GetButton(kNavigationKeys[i]);
+    if (button.is_down() || button.went_up()) return true;
+  }
+
+#ifdef ANDROID_GAMEPAD
+  static const fplbase::Gamepad::GamepadInputButton kGamepadButtons[] = {
+      fplbase::Gamepad::kUp, fplbase::Gamepad::kDown, fplbase::Gamepad::kLeft,
+      fplbase::Gamepad::kRight, fplbase::Gamepad::kButtonA};
+  for (auto it = input->GamepadMap().begin(); it != input->GamepadMap().end();
+       ++it) {
+    fplbase::Gamepad& gamepad = input->GetGamepad(it->first);
+    for (size_t i = 0;
+         i < sizeof(kGamepadButtons) / sizeof(kGamepadButtons[0]); ++i) {
+      const fplbase::Button& button = gamepad.GetButton(kGamepadButtons[i]);
+      if (button.is_down() || button.went_up()) return true;
+    }
+  }
+#endif  // ANDROID_GAMEPAD
+  return false;
+}
+
+bool MenuCache::NeedsUpdate(fplbase::Renderer& renderer,
+                            fplbase::InputSystem* input, int key) {
+  if (!enabled_) return true;
+
+  // Keep running the menu for a few frames after input stops, so widgets
+  // settle into their released and unhovered looks.
+  if (HasInput(input)) {
+    frames_since_input_ = 0;
+  } else if (frames_since_input_ < input_frames_) {
+    frames_since_input_++;
+  }
+
+  const vec2i window_size = renderer.window_size();
+  const bool stale = !valid_ || key != key_ ||
+                     window_size.x != target_size_.x ||
+                     window_size.y != target_size_.y ||
+                     frames_since_input_ < input_frames_ ||
+                     ++age_frames_ >= max_age_frames_;
+  key_ = key;
+  return stale;
+}
+
+void MenuCache::BeginUpdate(fplbase::Renderer& renderer) {
+  const vec2i window_size = renderer.window_size();
+  if (window_size.x != target_size_.x || window_size.y != target_size_.y) {
+    if (target_.initialized()) target_.Delete();
+    target_.Initialize(window_size);
+    target_size_ = window_size;
+  }
+  target_.SetAsRenderTarget();
+  renderer.ClearFrameBuffer(mathfu::kZeros4f);
+
+  // flatui blends everything with alpha blending. Accumulate coverage in the
+  // target's alpha, rather than squaring it, so the cache can be composited
+  // as premultiplied alpha. The renderer skips setting a blend mode that is
+  // already set, so this lasts until EndUpdate().
+  renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+  blend_func_separate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE,
+                      GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void MenuCache::EndUpdate(fplbase::Renderer& renderer) {
+  renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+  GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+  fplbase::RenderTarget::ScreenRenderTarget(renderer).SetAsRenderTarget();
+  valid_ = true;
+  age_frames_ = 0;
+}
+
+void MenuCache::Draw(fplbase::Renderer& renderer) {
+  const vec2 size = vec2(target_size_);
+  renderer.set_model_view_projection(
+      mat4::Ortho(0.0f, size.x, 0.0f, size.y, -1.0f, 1.0f));
+  renderer.set_color(mathfu::kOnes4f);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionDisabled);
+  renderer.SetCulling(fplbase::kCullingModeNone);
+  renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+  GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+
+  target_.BindAsTexture(0);
+  shader_->Set(renderer);
+  fplbase::Mesh::RenderAAQuadAlongX(vec3(0.0f, 0.0f, 0.0f),
+                                    vec3(size.x, size.y, 0.0f),
+                                    vec2(0.0f, 0.0f), vec2(1.0f, 1.0f));
+
+  GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,79 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_MENU_CACHE_H_
+#define ZOOSHI_MENU_CACHE_H_
+
+#include "config_generated.h"
+#include "fplbase/input.h"
+#include "fplbase/render_target.h"
+#include "fplbase/renderer.h"
+#include "fplbase/shader.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Keeps the last drawn frame of a flatui menu in a texture, so menus that
+// aren't being interacted with can be drawn without running flatui. The menu
+// is run again when its key or the window size changes, for a few frames
+// after any input that could hover or press its widgets, and every so often
+// to pick up changes that come from elsewhere.
+class MenuCache {
+ public:
+  MenuCache();
+
+  // `config` may be null, in which case menus are always run. Needs a
+  // current GL context.
+  void Initialize(const MenuCacheConfig* config,
+                  fplbase::AssetManager* asset_manager);
+
+  bool enabled() const { return enabled_; }
+
+  // Return true if the menu identified by `key` has to be run this frame,
+  // rather than drawn from the cache.
+  bool NeedsUpdate(fplbase::Renderer& renderer, fplbase::InputSystem* input,
+                   int key);
+
+  // Direct the menu's drawing into the cache. The menu must then be run, and
+  // EndUpdate() called.
+  void BeginUpdate(fplbase::Renderer& renderer);
+  void EndUpdate(fplbase::Renderer& renderer);
+
+  // Draw the cached menu over the screen.
+  void Draw(fplbase::Renderer& renderer);
+
+  // Run the menu on the next frame.
+  void Invalidate() { valid_ = false; }
+
+ private:
+  // True if there was input this frame that flatui could react to.
+  static bool HasInput(fplbase::InputSystem* input);
+
+  bool enabled_;
+  int max_age_frames_;
+  int input_frames_;
+
+  fplbase::Shader* shader_;
+  fplbase::RenderTarget target_;
+  mathfu::vec2i target_size_;
+  bool valid_;
+  int key_;
+  int age_frames_;
+  int frames_since_input_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_MENU_CACHE_H_
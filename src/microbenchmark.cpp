@@ -0,0 +1,354 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "microbenchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <ctime>
+#include "SDL_cpuinfo.h"
+#include "SDL_rwops.h"
+#include "SDL_timer.h"
+#include "camera.h"
+#include "components/rail_denizen.h"
+#include "fplbase/utilities.h"
+#include "inputcontrollers/scripted_controller.h"
+#include "river_mesh_builder.h"
+#include "save_store.h"
+#include "states/states_common.h"
+#include "xp_system.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+// The same seed as Benchmark, so the river and projectiles are the same
+// every run.
+static const unsigned int kRandomSeed = 1;
+
+// Step time used while throwing sushi for the patrons to search.
+static const corgi::WorldTime kStepTime = 16;
+
+// Stop throwing sushi after this many steps, even if fewer are in the air
+// than wanted.
+static const int kMaxThrowSteps = 2000;
+
+// Projectile and patron counts that ClosestProjectile() is timed with. A
+// patron count of 0 means all of the level's patrons.
+static const int kProjectileCounts[] = {16, 64, 256};
+static const int kPatronCounts[] = {1, 16, 0};
+
+// How many times PositionCalculatedSlowly() is sampled along the rail per
+// iteration.
+static const int kSlowPositionSamples = 256;
+
+// Results are written here, so the kernels can't be optimized away.
+static volatile float g_sink;
+
+void Microbenchmark::Initialize(World* world,
+                                fplbase::AssetManager* asset_manager,
+                                pindrop::AudioEngine* audio_engine) {
+  world_ = world;
+  asset_manager_ = asset_manager;
+  audio_engine_ = audio_engine;
+}
+
+bool Microbenchmark::Run(const MicrobenchmarkOptions& options) {
+  const WorldDef* world_def = world_->config->world_def();
+  if (options.level_index >= world_def->levels()->size()) {
+    LogError("Microbenchmark: there is no level %d.",
+             static_cast<int>(options.level_index));
+    return false;
+  }
+
+  // The loading state would normally finish loading on the render thread.
+  while (!(asset_manager_->TryFinalize() && audio_engine_->TryFinalize())) {
+    SDL_Delay(1);
+  }
+
+  min_seconds_ = options.min_seconds;
+  results_.clear();
+  srand(kRandomSeed);
+  world_->level_index = options.level_index;
+
+  // Loading runs first, and leaves the level loaded for everything else.
+  MeasureLoadWorldDef(world_def);
+  if (!world_->services_component.raft_entity()) {
+    LogError("Microbenchmark: the level has no raft.");
+    return false;
+  }
+  MeasureRail();
+  MeasureRiverMesh();
+  MeasureClosestProjectile();
+  MeasureApplyBonuses();
+
+  Report(options.report_filename);
+  return true;
+}
+
+void Microbenchmark::Measure(const std::string& name,
+                             const std::function<void()>& kernel) {
+  const double frequency =
+      static_cast<double>(SDL_GetPerformanceFrequency());
+  // Run in doubling batches, so reading the clock doesn't add to the time of
+  // the cheapest kernels.
+  int iterations = 0;
+  int batch = 1;
+  double seconds = 0.0;
+  const std::clock_t cpu_start = std::clock();
+  do {
+    const uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < batch; ++i) kernel();
+    seconds += static_cast<double>(SDL_GetPerformanceCounter() - start) /
+               frequency;
+    iterations += batch;
+    batch *= 2;
+  } while (seconds < min_seconds_);
+  const double cpu_seconds =
+      static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+  Result result;
+  result.name = name;
+  result.iterations = iterations;
+  result.real_ns = seconds * 1e9 / iterations;
+  result.cpu_ns = cpu_seconds * 1e9 / iterations;
+  results_.push_back(result);
+  LogInfo("%-40s %14.1f ns %10d iterations", name.c_str(), result.real_ns,
+          iterations);
+}
+
+void Microbenchmark::MeasureLoadWorldDef(const WorldDef* world_def) {
+  Measure("LoadWorldDef",
+          [this, world_def]() { LoadWorldDef(world_, world_def); });
+}
+
+void Microbenchmark::MeasureRail() {
+  const RailDenizenData* raft =
+      world_->rail_denizen_component.GetComponentData(
+          world_->services_component.raft_entity());
+  Rail* rail = raft == nullptr ? nullptr
+                               : world_->rail_manager.GetRailFromComponents(
+                                     raft->rail_name.c_str(),
+                                     &world_->entity_manager);
+  if (rail == nullptr) return;
+
+  // Sampled as finely as the river samples it.
+  const float step = world_->CurrentLevel()->river_config()->spline_stepsize();
+  std::vector<mathfu::vec3_packed> positions;
+  Measure("Rail::Positions", [rail, step, &positions]() {
+    rail->Positions(step, &positions);
+    g_sink = positions.back().data[0];
+  });
+
+  const float end_time = rail->EndTime();
+  Measure("Rail::PositionCalculatedSlowly", [rail, end_time]() {
+    float sum = 0.0f;
+    for (int i = 0; i < kSlowPositionSamples; ++i) {
+      sum += rail->PositionCalculatedSlowly(end_time * i / kSlowPositionSamples)
+                 .x();
+    }
+    g_sink = sum;
+  });
+}
+
+void Microbenchmark::MeasureRiverMesh() {
+  auto river = world_->river_component.begin();
+  if (river == world_->river_component.end()) return;
+  Rail* rail = world_->rail_manager.GetRailFromComponents(
+      river->data.rail_name.c_str(), &world_->entity_manager);
+  if (rail == nullptr) return;
+
+  // The same job RiverComponent::QueueContours() gives the builder.
+  const RiverConfig* config = world_->CurrentLevel()->river_config();
+  RiverContourJob contour_job;
+  contour_job.entity = river->entity;
+  contour_job.generation = 0;
+  contour_job.config = config;
+  contour_job.random_seed = river->data.random_seed;
+  contour_job.wraps = rail->wraps();
+  rail->Positions(config->spline_stepsize(), &contour_job.track);
+  for (auto zone = config->zones()->begin(); zone != config->zones()->end();
+       ++zone) {
+    fplbase::Material* material =
+        asset_manager_->LoadMaterial(zone->material()->c_str());
+    contour_job.zone_blends.push_back(material->textures().size() != 1);
+  }
+
+  std::shared_ptr<RiverContours> contours(new RiverContours());
+  Measure("RiverMeshBuilder::GenerateContours",
+          [&contour_job, &contours]() {
+            *contours = RiverContours();
+            RiverMeshBuilder::GenerateContours(contour_job, contours.get());
+            g_sink = static_cast<float>(contours->verts.size());
+          });
+
+  // Every chunk, as if the whole river were built at once.
+  const int num_quads = static_cast<int>(contours->NumSegments()) - 1;
+  if (num_quads <= 0) return;
+  RiverChunkJob chunk_job;
+  chunk_job.entity = river->entity;
+  chunk_job.generation = 0;
+  chunk_job.config = config;
+  chunk_job.contours = contours;
+  chunk_job.chunk_segments =
+      config->chunk_segments() > 0
+          ? std::min(static_cast<int>(config->chunk_segments()), num_quads)
+          : num_quads;
+  const int num_chunks =
+      (num_quads + chunk_job.chunk_segments - 1) / chunk_job.chunk_segments;
+  TangentSpaceBuilder tangent_space;
+  RiverChunkGeometry geometry;
+  Measure("RiverMeshBuilder::BuildChunk/all",
+          [&chunk_job, num_chunks, &tangent_space, &geometry]() {
+            for (int i = 0; i < num_chunks; ++i) {
+              chunk_job.chunk_index = i;
+              geometry = RiverChunkGeometry();
+              RiverMeshBuilder::BuildChunk(chunk_job, &tangent_space,
+                                           &geometry);
+            }
+            g_sink = static_cast<float>(geometry.river_indices.size());
+          });
+}
+
+void Microbenchmark::MeasureClosestProjectile() {
+  PatronComponent* patron_component = &world_->patron_component;
+  std::vector<corgi::EntityRef> patrons;
+  for (auto it = patron_component->begin(); it != patron_component->end();
+       ++it) {
+    patrons.push_back(it->entity);
+  }
+  if (patrons.empty()) return;
+
+  // Throw sushi every step until there's enough in the air for each count.
+  world_->AddController(new ScriptedController(1, 240, 0.5f));
+  world_->SetActiveController(kControllerScripted);
+  world_->player_component.set_state(kPlayerState_Active);
+  Camera camera;
+  world_->services_component.set_camera(&camera);
+  UpdateMainCamera(&camera, world_);
+
+  int steps = 0;
+  for (size_t i = 0; i < sizeof(kProjectileCounts) / sizeof(int); ++i) {
+    int num_projectiles = 0;
+    while (true) {
+      num_projectiles = 0;
+      for (auto it = world_->player_projectile_component.begin();
+           it != world_->player_projectile_component.end(); ++it) {
+        num_projectiles++;
+      }
+      if (num_projectiles >= kProjectileCounts[i] || steps >= kMaxThrowSteps) {
+        break;
+      }
+      world_->StepComponents(kStepTime);
+      UpdateMainCamera(&camera, world_);
+      steps++;
+    }
+
+    // Every patron searches, whatever state the simulation left it in.
+    std::vector<PatronState> states;
+    for (auto it = patron_component->begin(); it != patron_component->end();
+         ++it) {
+      states.push_back(it->data.state);
+      it->data.state = kPatronStateUpright;
+    }
+    patron_component->BuildProjectileGrid();
+
+    for (size_t j = 0; j < sizeof(kPatronCounts) / sizeof(int); ++j) {
+      const size_t num_patrons =
+          kPatronCounts[j] > 0
+              ? std::min(patrons.size(), static_cast<size_t>(kPatronCounts[j]))
+              : patrons.size();
+      char name[64];
+      snprintf(name, sizeof(name), "PatronComponent::ClosestProjectile/%d/%d",
+               static_cast<int>(num_patrons), num_projectiles);
+      Measure(name, [patron_component, &patrons, num_patrons]() {
+        float sum = 0.0f;
+        for (size_t k = 0; k < num_patrons; ++k) {
+          mathfu::vec3 position;
+          motive::Angle face_angle;
+          float time = 0.0f;
+          if (patron_component->ClosestProjectile(patrons[k], &position,
+                                                  &face_angle, &time)) {
+            sum += time;
+          }
+        }
+        g_sink = sum;
+      });
+    }
+
+    auto state = states.begin();
+    for (auto it = patron_component->begin(); it != patron_component->end();
+         ++it) {
+      it->data.state = *state++;
+    }
+  }
+  world_->services_component.set_camera(nullptr);
+}
+
+void Microbenchmark::MeasureApplyBonuses() {
+  // A store that's never loaded, so the player's real xp isn't touched.
+  SaveStore save_store;
+  XpSystem xp_system;
+  xp_system.Initialize(world_->config, &save_store);
+  for (int i = 0; i < XpSystem::kMaxBonuses; ++i) {
+    xp_system.AddBonus(BonusApplyType_Multiply, 1.01f, 1 << 30,
+                       XpSystem::kNonUniqueKey);
+    xp_system.AddBonus(BonusApplyType_Addition, 1.0f, 1 << 30,
+                       XpSystem::kNonUniqueKey);
+  }
+  Measure("XpSystem::ApplyBonuses", [&xp_system]() {
+    g_sink = static_cast<float>(xp_system.ApplyBonuses(100, false));
+  });
+}
+
+// Written in the format of Google Benchmark's --benchmark_format=json.
+void Microbenchmark::Report(const std::string& report_filename) const {
+  if (report_filename.empty()) return;
+
+  char buffer[256];
+  const std::time_t now = std::time(nullptr);
+  char date[32];
+  std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+  snprintf(buffer, sizeof(buffer),
+           "{\n  \"context\": {\n    \"date\": \"%s\",\n"
+           "    \"executable\": \"zooshi_microbench\",\n"
+           "    \"num_cpus\": %d\n  },\n  \"benchmarks\": [",
+           date, SDL_GetCPUCount());
+  std::string json = buffer;
+  for (auto it = results_.begin(); it != results_.end(); ++it) {
+    snprintf(buffer, sizeof(buffer),
+             "%s\n    {\"name\": \"%s\", \"run_name\": \"%s\", "
+             "\"run_type\": \"iteration\", \"iterations\": %d, "
+             "\"real_time\": %.3f, \"cpu_time\": %.3f, \"time_unit\": \"ns\"}",
+             it == results_.begin() ? "" : ",", it->name.c_str(),
+             it->name.c_str(), it->iterations, it->real_ns, it->cpu_ns);
+    json += buffer;
+  }
+  json += "\n  ]\n}\n";
+
+  SDL_RWops* file = SDL_RWFromFile(report_filename.c_str(), "w");
+  if (file == nullptr) {
+    LogError("Couldn't open %s to write the microbenchmark report: %s",
+             report_filename.c_str(), SDL_GetError());
+    return;
+  }
+  SDL_RWwrite(file, json.c_str(), 1, json.size());
+  SDL_RWclose(file);
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,88 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_MICROBENCHMARK_H_
+#define ZOOSHI_MICROBENCHMARK_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "fplbase/asset_manager.h"
+#include "pindrop/pindrop.h"
+#include "world.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct MicrobenchmarkOptions {
+  MicrobenchmarkOptions() : level_index(1), min_seconds(0.5) {}
+
+  // Index into the world def's levels, whose rail, river and patrons are
+  // measured.
+  size_t level_index;
+  // Each kernel is repeated until it has run for at least this long.
+  double min_seconds;
+  // If set, the results are also written here, as JSON in the format Google
+  // Benchmark writes, so its compare.py can diff two runs.
+  std::string report_filename;
+};
+
+// Times the game's hottest kernels in isolation, each on data from a loaded
+// level: sampling the rail, generating the river's mesh on the CPU, patrons'
+// searches for sushi at several patron and projectile counts, loading the
+// world, and applying xp bonuses. Unlike Benchmark, which times whole
+// simulation steps, each result is the cost of one call, so a change to one
+// kernel can be measured before and after.
+class Microbenchmark {
+ public:
+  Microbenchmark()
+      : world_(nullptr), asset_manager_(nullptr), audio_engine_(nullptr) {}
+
+  void Initialize(World* world, fplbase::AssetManager* asset_manager,
+                  pindrop::AudioEngine* audio_engine);
+
+  // Returns false if the level couldn't be loaded.
+  bool Run(const MicrobenchmarkOptions& options);
+
+ private:
+  struct Result {
+    std::string name;
+    int iterations;
+    double real_ns;
+    double cpu_ns;
+  };
+
+  // Call `kernel` until `min_seconds_` have passed, and record the mean time
+  // per call as `name`.
+  void Measure(const std::string& name, const std::function<void()>& kernel);
+
+  void MeasureLoadWorldDef(const WorldDef* world_def);
+  void MeasureRail();
+  void MeasureRiverMesh();
+  void MeasureClosestProjectile();
+  void MeasureApplyBonuses();
+
+  void Report(const std::string& report_filename) const;
+
+  World* world_;
+  fplbase::AssetManager* asset_manager_;
+  pindrop::AudioEngine* audio_engine_;
+  double min_seconds_;
+  std::vector<Result> results_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_MICROBENCHMARK_H_
@@ -0,0 +1,41 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string>
+
+#include "fplbase/utilities.h"
+#include "game.h"
+#include "memory_tracker.h"
+#include "microbenchmark.h"
+
+// Usage: zooshi_microbench [report.json] [level index] [min seconds]
+extern "C" int FPL_main(int argc, char* argv[]) {
+  // Before the game creates anything with Bullet.
+  fpl::zooshi::MemoryTracker::InstallPhysicsHooks();
+  fpl::zooshi::Game game;
+  const char* binary_directory = argc > 0 ? argv[0] : "";
+
+  fpl::zooshi::MicrobenchmarkOptions options;
+  if (argc > 1) options.report_filename = argv[1];
+  if (argc > 2) options.level_index = static_cast<size_t>(atoi(argv[2]));
+  if (argc > 3) options.min_seconds = atof(argv[3]);
+
+  if (!game.Initialize(binary_directory)) {
+    fplbase::LogError("FPL Game: init failed, exiting!");
+    return 1;
+  }
+
+  return game.RunMicrobenchmarks(options) ? 0 : 1;
+}
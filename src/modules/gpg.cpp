@@ -28,11 +28,21 @@ using mathfu::vec3;
 namespace fpl {
 namespace zooshi {
 
+// Resolve the achievement named by input 1 to its id, which points into the
+// config and so stays valid for the life of the node.
+static const char* LookupAchievementId(const Config* config,
+                                       NodeArguments* args) {
+  auto name = args->GetInput<std::string>(1);
+  auto achievement =
+      config->gpg_config()->achievements()->LookupByKey(name->c_str());
+  return achievement ? achievement->id()->c_str() : nullptr;
+}
+
 // Increment the given achievement count.
 class IncrementAchievementNode : public BaseNode {
  public:
   IncrementAchievementNode(const Config* config, GPGManager* gpg_manager)
-      : config_(config), gpg_manager_(gpg_manager) {}
+      : config_(config), gpg_manager_(gpg_manager), achievement_id_(nullptr) {}
   virtual ~IncrementAchievementNode() {}
 
   static void OnRegister(NodeSignature* node_sig) {
@@ -40,23 +50,32 @@ class IncrementAchievementNode : public BaseNode {
     node_sig->AddInput<std::string>();
   }
 
+  virtual void Initialize(NodeArguments* args) {
+    achievement_id_ = LookupAchievementId(config_, args);
+  }
+
   virtual void Execute(NodeArguments* args) {
-    auto name = args->GetInput<std::string>(1);
-    auto achievement =
-        config_->gpg_config()->achievements()->LookupByKey(name->c_str());
-    gpg_manager_->IncrementAchievement(achievement->id()->c_str());
+    // The name is almost always a constant, so it's only looked up again if
+    // it changes, rather than on every increment.
+    if (args->IsInputDirty(1)) {
+      achievement_id_ = LookupAchievementId(config_, args);
+    }
+    if (achievement_id_ != nullptr) {
+      gpg_manager_->IncrementAchievement(achievement_id_);
+    }
   }
 
  private:
   const Config* config_;
   GPGManager* gpg_manager_;
+  const char* achievement_id_;
 };
 
 // Grant specified achievement.
 class GrantAchievementNode : public BaseNode {
  public:
   GrantAchievementNode(const Config* config, GPGManager* gpg_manager)
-      : config_(config), gpg_manager_(gpg_manager) {}
+      : config_(config), gpg_manager_(gpg_manager), achievement_id_(nullptr) {}
   virtual ~GrantAchievementNode() {}
 
   static void OnRegister(NodeSignature* node_sig) {
@@ -64,26 +83,31 @@ class GrantAchievementNode : public BaseNode {
     node_sig->AddInput<std::string>();
   }
 
+  virtual void Initialize(NodeArguments* args) {
+    achievement_id_ = LookupAchievementId(config_, args);
+  }
+
   virtual void Execute(NodeArguments* args) {
+    if (args->IsInputDirty(1)) {
+      achievement_id_ = LookupAchievementId(config_, args);
+    }
     auto flag = args->GetInput<int32_t>(0);
-    if (*flag > 0) {
-      auto name = args->GetInput<std::string>(1);
-      auto achievement =
-          config_->gpg_config()->achievements()->LookupByKey(name->c_str());
-      gpg_manager_->UnlockAchievement(achievement->id()->c_str());
+    if (*flag > 0 && achievement_id_ != nullptr) {
+      gpg_manager_->UnlockAchievement(achievement_id_);
     }
   }
 
  private:
   const Config* config_;
   GPGManager* gpg_manager_;
+  const char* achievement_id_;
 };
 
 // Submit score to the specified leaderboard.
 class SubmitScoreNode : public BaseNode {
  public:
   SubmitScoreNode(const Config* config, GPGManager* gpg_manager)
-      : config_(config), gpg_manager_(gpg_manager) {}
+      : config_(config), gpg_manager_(gpg_manager), leaderboard_id_(nullptr) {}
   virtual ~SubmitScoreNode() {}
 
   static void OnRegister(NodeSignature* node_sig) {
@@ -92,21 +116,30 @@ class SubmitScoreNode : public BaseNode {
     node_sig->AddInput<float>();        // Score value.
   }
 
+  virtual void Initialize(NodeArguments* args) {
+    leaderboard_id_ = LookupLeaderboardId(args);
+  }
+
   virtual void Execute(NodeArguments* args) {
+    if (args->IsInputDirty(1)) leaderboard_id_ = LookupLeaderboardId(args);
     // Need the pulse check since input 2 can be active.
-    if (args->IsInputDirty(0)) {
-      auto name = args->GetInput<std::string>(1);
+    if (args->IsInputDirty(0) && leaderboard_id_ != nullptr) {
       auto score = static_cast<int64_t>(*args->GetInput<float>(2));
-
-      auto leaderboard_config = config_->gpg_config()->leaderboards();
-      auto leaderboard = leaderboard_config->LookupByKey(name->c_str());
-      gpg_manager_->SubmitScore(leaderboard->id()->c_str(), score);
+      gpg_manager_->SubmitScore(leaderboard_id_, score);
     }
   }
 
  private:
+  const char* LookupLeaderboardId(NodeArguments* args) const {
+    auto name = args->GetInput<std::string>(1);
+    auto leaderboard =
+        config_->gpg_config()->leaderboards()->LookupByKey(name->c_str());
+    return leaderboard ? leaderboard->id()->c_str() : nullptr;
+  }
+
   const Config* config_;
   GPGManager* gpg_manager_;
+  const char* leaderboard_id_;
 };
 
 void InitializeGpgModule(ModuleRegistry* module_registry,
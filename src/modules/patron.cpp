@@ -83,22 +83,10 @@ class CheckDeliciousCycleNode : public BaseNode {
         patron_component_->Data<RailDenizenData>(*raft)->total_lap_progress -
         kLapDuration;
 
-    auto num_patrons = 0;
-    auto patrons_fed = 0;
-
-    for (auto iter = patron_component_->begin();
-         iter != patron_component_->end(); ++iter) {
-      corgi::EntityRef patron = iter->entity;
-      PatronData* patron_data = patron_component_->GetComponentData(patron);
-
-      // Check if patrons are fed in the current lap.
-      // Also count the first hippo since it doesn't appear for 2nd/3rd lap.
-      if (patron_data->last_lap_fed >= current_lap ||
-          patron_data->last_lap_fed == 0.0f) {
-        patrons_fed++;
-      }
-      num_patrons++;
-    }
+    // Check if patrons are fed in the current lap. This also counts the
+    // first hippo, since it doesn't appear for 2nd/3rd lap.
+    const int num_patrons = patron_component_->num_patrons();
+    const int patrons_fed = patron_component_->CountFedSince(current_lap);
     fplbase::LogInfo("Total: %d patrons, Fed:%d patrons", num_patrons,
                      patrons_fed);
 
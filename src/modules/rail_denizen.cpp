@@ -51,7 +51,8 @@ class NewLapNode : public BaseNode {
   }
 
   virtual void Execute(NodeArguments* args) {
-    Initialize(args);
+    // Only rebind if the entity changed, not every time the event fires.
+    if (args->IsInputDirty(0)) Initialize(args);
     args->SetOutput(0);
   }
 
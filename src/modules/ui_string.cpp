@@ -31,6 +31,10 @@ namespace zooshi {
 
 /// @brief Sets a string as the 3D text to be rendered by the
 /// `Render3dTextComponent` for a given entity.
+///
+/// Graphs such as the score's fire this whenever their inputs are touched, so
+/// an unchanged string is ignored rather than copied, leaving the text's
+/// version, and the layout cached for it, as they were.
 class Set3dTextStringNode : public BaseNode {
  public:
   enum { kInputEntity, kInputString };
@@ -55,7 +59,7 @@ class Set3dTextStringNode : public BaseNode {
     Render3dTextData* render_3d_text_data =
         render_3d_text_component_->GetComponentData(*entity);
     if (render_3d_text_data) {
-      render_3d_text_data->text = *text;
+      render_3d_text_data->SetText(*text);
     }
   }
 
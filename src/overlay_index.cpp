@@ -0,0 +1,145 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "overlay_index.h"
+
+#include <string.h>
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+// Written by build_assets.py. See OVERLAY_INDEX_FILE and pack_overlay()
+// there.
+static const char kOverlayIndexFile[] = "overlay_files.txt";
+static const char kOverlayPackExtension[] = ".zoopack";
+static const char kOverlayPackMagic[] = "ZPAK";
+static const uint32_t kOverlayPackVersion = 1;
+
+// Reads little-endian uint32s from a buffer, failing past its end.
+class PackReader {
+ public:
+  PackReader(const char* data, size_t size)
+      : data_(data), size_(size), position_(0) {}
+
+  bool ReadUint32(uint32_t* value) {
+    if (size_ - position_ < 4) return false;
+    const uint8_t* bytes =
+        reinterpret_cast<const uint8_t*>(data_ + position_);
+    *value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+             (static_cast<uint32_t>(bytes[3]) << 24);
+    position_ += 4;
+    return true;
+  }
+
+  bool ReadString(size_t length, std::string* value) {
+    if (size_ - position_ < length) return false;
+    value->assign(data_ + position_, length);
+    position_ += length;
+    return true;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t position_;
+};
+
+bool OverlayIndex::Load(const std::string& name) {
+  Clear();
+  if (name.empty()) return false;
+  directory_ = "overlays/" + name + "/";
+  if (LoadPack("overlays/" + name + kOverlayPackExtension) ||
+      LoadFileList(directory_ + kOverlayIndexFile)) {
+    indexed_ = true;
+    LogInfo("Indexed %d files in overlay %s", static_cast<int>(files_.size()),
+            name.c_str());
+    return true;
+  }
+  LogInfo("Overlay %s has no index; its files will be searched for",
+          name.c_str());
+  return false;
+}
+
+void OverlayIndex::Clear() {
+  directory_.clear();
+  indexed_ = false;
+  files_.clear();
+  pack_.Close();
+}
+
+bool OverlayIndex::LoadPack(const std::string& filename) {
+  if (!pack_.Open(filename.c_str())) return false;
+
+  PackReader reader(pack_.data(), pack_.size());
+  std::string magic;
+  uint32_t version = 0;
+  uint32_t count = 0;
+  bool valid = reader.ReadString(4, &magic) && magic == kOverlayPackMagic &&
+               reader.ReadUint32(&version) &&
+               version == kOverlayPackVersion && reader.ReadUint32(&count);
+  for (uint32_t i = 0; valid && i < count; ++i) {
+    uint32_t length = 0;
+    std::string path;
+    PackedFile file;
+    valid = reader.ReadUint32(&length) && reader.ReadString(length, &path) &&
+            reader.ReadUint32(&file.offset) && reader.ReadUint32(&file.size) &&
+            file.offset <= pack_.size() &&
+            file.size <= pack_.size() - file.offset;
+    if (valid) files_[path] = file;
+  }
+  if (!valid) {
+    LogError("Overlay archive %s is corrupt", filename.c_str());
+    files_.clear();
+    pack_.Close();
+  }
+  return valid;
+}
+
+bool OverlayIndex::LoadFileList(const std::string& filename) {
+  MappedFile list;
+  if (!list.Open(filename.c_str())) return false;
+
+  const PackedFile loose = {0, 0};
+  const char* line = list.data();
+  const char* end = list.data() + list.size();
+  while (line < end) {
+    const char* line_end = static_cast<const char*>(
+        memchr(line, '\n', static_cast<size_t>(end - line)));
+    if (line_end == nullptr) line_end = end;
+    const char* path_end = line_end;
+    if (path_end > line && path_end[-1] == '\r') path_end--;
+    if (path_end > line) files_[std::string(line, path_end)] = loose;
+    line = line_end + 1;
+  }
+  return true;
+}
+
+bool OverlayIndex::Contains(const std::string& path) const {
+  if (directory_.empty()) return false;
+  return !indexed_ || files_.find(path) != files_.end();
+}
+
+bool OverlayIndex::Map(const std::string& path, MappedFile* file) const {
+  if (!Contains(path)) return false;
+  if (!pack_.is_open()) return file->Open((directory_ + path).c_str());
+  const PackedFile& packed = files_.find(path)->second;
+  file->OpenView(pack_.data() + packed.offset, packed.size);
+  return true;
+}
+
+}  // zooshi
+}  // fpl
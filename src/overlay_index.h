@@ -0,0 +1,69 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_OVERLAY_INDEX_H_
+#define ZOOSHI_OVERLAY_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include "mapped_file.h"
+
+namespace fpl {
+namespace zooshi {
+
+// The files in an overlay, read once when the overlay is chosen, so loading
+// an asset doesn't have to try opening it in the overlay first.
+//
+// An overlay is either the directory overlays/<name>/, listed by the
+// overlay_files.txt that build_assets.py writes into it, or a single
+// overlays/<name>.zoopack archive that build_assets.py writes when passed
+// 'pack_overlays'. Files in an archive are mapped along with it, and are
+// returned as views into it.
+class OverlayIndex {
+ public:
+  OverlayIndex() : indexed_(false) {}
+
+  // Index the overlay `name`, replacing any indexed before. Returns false if
+  // the overlay has no archive or file list, in which case Contains() is
+  // true for every path, so callers fall back to trying each one.
+  bool Load(const std::string& name);
+  void Clear();
+
+  // True if `path`, relative to the overlay, is in it.
+  bool Contains(const std::string& path) const;
+
+  // Open `path`, relative to the overlay. Fails if it isn't in the overlay.
+  bool Map(const std::string& path, MappedFile* file) const;
+
+ private:
+  struct PackedFile {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  bool LoadPack(const std::string& filename);
+  bool LoadFileList(const std::string& filename);
+
+  std::string directory_;
+  bool indexed_;
+  // Files in the overlay. Offsets are only set for packed overlays.
+  std::unordered_map<std::string, PackedFile> files_;
+  MappedFile pack_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_OVERLAY_INDEX_H_
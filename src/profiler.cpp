@@ -0,0 +1,425 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include "SDL_rwops.h"
+#include "SDL_timer.h"
+#include "flatui/flatui.h"
+#include "fplbase/utilities.h"
+#include "mathfu/constants.h"
+#include "memory_tracker.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+// Frames kept per thread: two seconds at 60 fps.
+static const int kFrameHistory = 120;
+
+// Events past this in a frame are dropped, in case a marker ends up in a
+// loop over entities.
+static const size_t kMaxEventsPerFrame = 512;
+
+// How much each new frame counts towards the smoothed timings.
+static const float kSmoothing = 0.05f;
+
+// Peaks decay by this much each frame, so they eventually forget old spikes.
+static const float kPeakDecay = 0.99f;
+
+static const float kOverlayTextSize = 28.0f;
+static const mathfu::vec4 kOverlayTextColor(1.0f, 1.0f, 0.6f, 1.0f);
+static const mathfu::vec4 kOverlayBackgroundColor(0.0f, 0.0f, 0.0f, 0.6f);
+
+Profiler::ThreadProfile::ThreadProfile()
+    : name(nullptr),
+      id(0),
+      frame_start(0),
+      mutex(SDL_CreateMutex()),
+      frames(kFrameHistory),
+      next_frame(0),
+      num_frames(0),
+      total_frames(0),
+      average_frame_ms(0.0f) {}
+
+Profiler::ThreadProfile::~ThreadProfile() { SDL_DestroyMutex(mutex); }
+
+Profiler& Profiler::Get() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler()
+    : enabled_(false),
+      frequency_(SDL_GetPerformanceFrequency()),
+      start_time_(SDL_GetPerformanceCounter()),
+      tls_id_(SDL_TLSCreate()),
+      threads_mutex_(SDL_CreateMutex()) {}
+
+Profiler::~Profiler() { SDL_DestroyMutex(threads_mutex_); }
+
+Profiler::ThreadProfile* Profiler::CurrentThread() {
+  ThreadProfile* thread = static_cast<ThreadProfile*>(SDL_TLSGet(tls_id_));
+  if (thread != nullptr) return thread;
+
+  SDL_LockMutex(threads_mutex_);
+  threads_.push_back(std::unique_ptr<ThreadProfile>(new ThreadProfile()));
+  thread = threads_.back().get();
+  thread->id = static_cast<int>(threads_.size());
+  SDL_UnlockMutex(threads_mutex_);
+
+  thread->frame_start = SDL_GetPerformanceCounter();
+  SDL_TLSSet(tls_id_, thread, nullptr);
+  return thread;
+}
+
+double Profiler::TicksToMilliseconds(uint64_t ticks) const {
+  return static_cast<double>(ticks) * 1000.0 / static_cast<double>(frequency_);
+}
+
+void Profiler::SetThreadName(const char* name) {
+  ThreadProfile* thread = CurrentThread();
+  SDL_LockMutex(thread->mutex);
+  thread->name = name;
+  SDL_UnlockMutex(thread->mutex);
+}
+
+void Profiler::Begin(const char* name) {
+  if (!enabled_) return;
+  ThreadProfile* thread = CurrentThread();
+  if (thread->events.size() >= kMaxEventsPerFrame) {
+    thread->open_events.push_back(-1);
+    return;
+  }
+  ProfileEvent event;
+  event.name = name;
+  event.depth = static_cast<int>(thread->open_events.size());
+  event.start = SDL_GetPerformanceCounter();
+  event.end = event.start;
+  thread->open_events.push_back(static_cast<int>(thread->events.size()));
+  thread->events.push_back(event);
+}
+
+void Profiler::End() {
+  if (!enabled_) return;
+  ThreadProfile* thread = CurrentThread();
+  // The profiler may have been enabled inside this region.
+  if (thread->open_events.empty()) return;
+  const int index = thread->open_events.back();
+  thread->open_events.pop_back();
+  if (index >= 0) thread->events[index].end = SDL_GetPerformanceCounter();
+}
+
+void Profiler::SetCounter(const char* name, int value) {
+  if (!enabled_) return;
+  ThreadProfile* thread = CurrentThread();
+  for (auto it = thread->counters.begin(); it != thread->counters.end();
+       ++it) {
+    if (strcmp(it->name, name) == 0) {
+      it->value = value;
+      return;
+    }
+  }
+  ProfileCounter counter;
+  counter.name = name;
+  counter.value = value;
+  thread->counters.push_back(counter);
+}
+
+void Profiler::Summarize(const ProfileFrame& frame, ThreadProfile* thread) {
+  const float frame_ms =
+      static_cast<float>(TicksToMilliseconds(frame.end - frame.start));
+  thread->average_frame_ms += (frame_ms - thread->average_frame_ms) *
+                              (thread->num_frames == 1 ? 1.0f : kSmoothing);
+
+  // Total this frame's time for each region.
+  std::vector<float> frame_totals(thread->summaries.size(), 0.0f);
+  for (auto event = frame.events.begin(); event != frame.events.end();
+       ++event) {
+    size_t i = 0;
+    while (i < thread->summaries.size() &&
+           (thread->summaries[i].name != event->name ||
+            thread->summaries[i].depth != event->depth)) {
+      ++i;
+    }
+    if (i == thread->summaries.size()) {
+      ProfileSummary summary;
+      summary.name = event->name;
+      summary.depth = event->depth;
+      summary.average_ms = 0.0f;
+      summary.peak_ms = 0.0f;
+      summary.total_ms = 0.0;
+      summary.max_ms = 0.0f;
+      thread->summaries.push_back(summary);
+      frame_totals.push_back(0.0f);
+    }
+    frame_totals[i] +=
+        static_cast<float>(TicksToMilliseconds(event->end - event->start));
+  }
+
+  for (size_t i = 0; i < thread->summaries.size(); ++i) {
+    UpdateSummary(frame_totals[i], &thread->summaries[i]);
+  }
+
+  for (auto counter = frame.counters.begin(); counter != frame.counters.end();
+       ++counter) {
+    auto latest = thread->latest_counters.begin();
+    while (latest != thread->latest_counters.end() &&
+           strcmp(latest->name, counter->name) != 0) {
+      ++latest;
+    }
+    if (latest == thread->latest_counters.end()) {
+      thread->latest_counters.push_back(*counter);
+    } else {
+      latest->value = counter->value;
+    }
+  }
+}
+
+void Profiler::UpdateSummary(float frame_ms, ProfileSummary* summary) {
+  summary->average_ms += (frame_ms - summary->average_ms) * kSmoothing;
+  summary->peak_ms = std::max(summary->peak_ms * kPeakDecay, frame_ms);
+  summary->total_ms += frame_ms;
+  summary->max_ms = std::max(summary->max_ms, frame_ms);
+}
+
+void Profiler::EndFrame() {
+  ThreadProfile* thread = CurrentThread();
+  const uint64_t now = SDL_GetPerformanceCounter();
+  if (enabled_) {
+    // Close anything left open, such as regions the profiler was disabled
+    // and re-enabled inside.
+    for (auto it = thread->open_events.begin();
+         it != thread->open_events.end(); ++it) {
+      if (*it >= 0) thread->events[*it].end = now;
+    }
+
+    SDL_LockMutex(thread->mutex);
+    ProfileFrame& frame = thread->frames[thread->next_frame];
+    frame.start = thread->frame_start;
+    frame.end = now;
+    frame.events.swap(thread->events);
+    frame.counters.swap(thread->counters);
+    thread->next_frame = (thread->next_frame + 1) % kFrameHistory;
+    thread->num_frames = std::min(thread->num_frames + 1, kFrameHistory);
+    thread->total_frames++;
+    Summarize(frame, thread);
+    SDL_UnlockMutex(thread->mutex);
+  }
+  thread->events.clear();
+  thread->open_events.clear();
+  thread->counters.clear();
+  thread->frame_start = now;
+}
+
+int Profiler::GetThreadSummaries(std::vector<ProfileSummary>* summaries) {
+  ThreadProfile* thread = CurrentThread();
+  SDL_LockMutex(thread->mutex);
+  *summaries = thread->summaries;
+  const int total_frames = thread->total_frames;
+  SDL_UnlockMutex(thread->mutex);
+  return total_frames;
+}
+
+void Profiler::ResetThread() {
+  ThreadProfile* thread = CurrentThread();
+  SDL_LockMutex(thread->mutex);
+  for (auto it = thread->frames.begin(); it != thread->frames.end(); ++it) {
+    it->events.clear();
+    it->counters.clear();
+  }
+  thread->next_frame = 0;
+  thread->num_frames = 0;
+  thread->total_frames = 0;
+  thread->summaries.clear();
+  thread->latest_counters.clear();
+  thread->average_frame_ms = 0.0f;
+  SDL_UnlockMutex(thread->mutex);
+  thread->events.clear();
+  thread->open_events.clear();
+  thread->counters.clear();
+  thread->frame_start = SDL_GetPerformanceCounter();
+}
+
+void Profiler::AddGpuTime(const char* name, float ms) {
+  SDL_LockMutex(threads_mutex_);
+  size_t i = 0;
+  while (i < gpu_summaries_.size() && gpu_summaries_[i].name != name) ++i;
+  if (i == gpu_summaries_.size()) {
+    ProfileSummary summary;
+    summary.name = name;
+    summary.depth = 0;
+    summary.average_ms = ms;
+    summary.peak_ms = 0.0f;
+    summary.total_ms = 0.0;
+    summary.max_ms = 0.0f;
+    gpu_summaries_.push_back(summary);
+    gpu_frame_ms_.push_back(0.0f);
+  }
+  gpu_frame_ms_[i] += ms;
+  SDL_UnlockMutex(threads_mutex_);
+}
+
+void Profiler::EndGpuFrame() {
+  SDL_LockMutex(threads_mutex_);
+  for (size_t i = 0; i < gpu_summaries_.size(); ++i) {
+    UpdateSummary(gpu_frame_ms_[i], &gpu_summaries_[i]);
+    gpu_frame_ms_[i] = 0.0f;
+  }
+  SDL_UnlockMutex(threads_mutex_);
+}
+
+bool Profiler::ExportChromeTrace(const char* filename) {
+  std::string json = "{\"traceEvents\":[\n";
+  bool first = true;
+  char buffer[256];
+  auto append = [&json, &first](const char* event) {
+    if (!first) json += ",\n";
+    json += event;
+    first = false;
+  };
+
+  SDL_LockMutex(threads_mutex_);
+  for (auto it = threads_.begin(); it != threads_.end(); ++it) {
+    ThreadProfile* thread = it->get();
+    SDL_LockMutex(thread->mutex);
+    if (thread->name != nullptr) {
+      snprintf(buffer, sizeof(buffer),
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+               "\"args\":{\"name\":\"%s\"}}",
+               thread->id, thread->name);
+      append(buffer);
+    }
+    // Oldest frame first.
+    for (int i = 0; i < thread->num_frames; ++i) {
+      const int index =
+          (thread->next_frame - thread->num_frames + i + kFrameHistory) %
+          kFrameHistory;
+      const ProfileFrame& frame = thread->frames[index];
+      for (auto event = frame.events.begin(); event != frame.events.end();
+           ++event) {
+        const double start_us =
+            TicksToMilliseconds(event->start - start_time_) * 1000.0;
+        const double duration_us =
+            TicksToMilliseconds(event->end - event->start) * 1000.0;
+        snprintf(buffer, sizeof(buffer),
+                 "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                 "\"ts\":%.3f,\"dur\":%.3f}",
+                 event->name, thread->id, start_us, duration_us);
+        append(buffer);
+      }
+      // Counters are sampled as the frame ends.
+      const double end_us =
+          TicksToMilliseconds(frame.end - start_time_) * 1000.0;
+      for (auto counter = frame.counters.begin();
+           counter != frame.counters.end(); ++counter) {
+        snprintf(buffer, sizeof(buffer),
+                 "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,"
+                 "\"ts\":%.3f,\"args\":{\"count\":%d}}",
+                 counter->name, thread->id, end_us, counter->value);
+        append(buffer);
+      }
+    }
+    SDL_UnlockMutex(thread->mutex);
+  }
+  SDL_UnlockMutex(threads_mutex_);
+  json += "\n]}\n";
+
+  SDL_RWops* file = SDL_RWFromFile(filename, "w");
+  if (file == nullptr) {
+    LogError("Couldn't open %s to write the profile: %s", filename,
+             SDL_GetError());
+    return false;
+  }
+  const size_t written = SDL_RWwrite(file, json.c_str(), 1, json.size());
+  SDL_RWclose(file);
+  if (written != json.size()) {
+    LogError("Couldn't write the profile to %s", filename);
+    return false;
+  }
+  LogInfo("Wrote profile to %s", filename);
+  return true;
+}
+
+void Profiler::RenderOverlay(fplbase::AssetManager* asset_manager,
+                             flatui::FontManager* font_manager,
+                             fplbase::InputSystem* input, const char* font) {
+  // Format everything first, since flatui runs the layout twice.
+  std::vector<std::string> lines;
+  char buffer[128];
+  SDL_LockMutex(threads_mutex_);
+  for (auto it = threads_.begin(); it != threads_.end(); ++it) {
+    ThreadProfile* thread = it->get();
+    SDL_LockMutex(thread->mutex);
+    if (thread->num_frames > 0) {
+      snprintf(buffer, sizeof(buffer), "%s: %.2fms",
+               thread->name != nullptr ? thread->name : "Thread",
+               thread->average_frame_ms);
+      lines.push_back(buffer);
+      for (auto summary = thread->summaries.begin();
+           summary != thread->summaries.end(); ++summary) {
+        snprintf(buffer, sizeof(buffer), "%*s%s: %.2fms (peak %.2fms)",
+                 2 * (summary->depth + 1), "", summary->name,
+                 summary->average_ms, summary->peak_ms);
+        lines.push_back(buffer);
+      }
+      for (auto counter = thread->latest_counters.begin();
+           counter != thread->latest_counters.end(); ++counter) {
+        snprintf(buffer, sizeof(buffer), "  %s: %d", counter->name,
+                 counter->value);
+        lines.push_back(buffer);
+      }
+    }
+    SDL_UnlockMutex(thread->mutex);
+  }
+  if (!gpu_summaries_.empty()) {
+    float gpu_ms = 0.0f;
+    for (auto summary = gpu_summaries_.begin();
+         summary != gpu_summaries_.end(); ++summary) {
+      gpu_ms += summary->average_ms;
+    }
+    snprintf(buffer, sizeof(buffer), "GPU: %.2fms", gpu_ms);
+    lines.push_back(buffer);
+    for (auto summary = gpu_summaries_.begin();
+         summary != gpu_summaries_.end(); ++summary) {
+      snprintf(buffer, sizeof(buffer), "  %s: %.2fms (peak %.2fms)",
+               summary->name, summary->average_ms, summary->peak_ms);
+      lines.push_back(buffer);
+    }
+  }
+  SDL_UnlockMutex(threads_mutex_);
+  MemoryTracker::Get().AppendReport(&lines);
+
+  flatui::Run(*asset_manager, *font_manager, *input, [&]() {
+    flatui::StartGroup(flatui::kLayoutVerticalLeft, 0, "ProfilerOverlay");
+    flatui::PositionGroup(flatui::kAlignLeft, flatui::kAlignTop,
+                          mathfu::kZeros2f);
+    flatui::ColorBackground(kOverlayBackgroundColor);
+    flatui::SetTextColor(kOverlayTextColor);
+    flatui::SetTextFont(font);
+    for (auto line = lines.begin(); line != lines.end(); ++line) {
+      flatui::Label(line->c_str(), kOverlayTextSize);
+    }
+    flatui::EndGroup();
+  });
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,181 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_PROFILER_H_
+#define ZOOSHI_PROFILER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
+#include "flatui/font_manager.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/input.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A timed region of a frame.
+struct ProfileEvent {
+  // Must be a string literal, or otherwise outlive the profiler.
+  const char* name;
+  // How many enclosing events were open when this one began.
+  int depth;
+  // Performance counter ticks.
+  uint64_t start;
+  uint64_t end;
+};
+
+// A named value sampled once a frame, such as how many of something are
+// alive.
+struct ProfileCounter {
+  // Must be a string literal, or otherwise outlive the profiler. Counters
+  // with equal names are the same counter.
+  const char* name;
+  int value;
+};
+
+// The time a named region took, smoothed over recent frames. Regions that
+// are entered more than once a frame are summed.
+struct ProfileSummary {
+  const char* name;
+  int depth;
+  float average_ms;
+  float peak_ms;
+  // Unsmoothed, over every frame since the thread was last reset.
+  double total_ms;
+  float max_ms;
+};
+
+// Records nested, named timings from any thread while the game runs, in
+// every build. Each thread that calls EndFrame() keeps a ring buffer of its
+// most recent frames, which can be shown on screen or exported as a Chrome
+// trace (chrome://tracing).
+//
+// Like systrace markers, the profiler is global, so markers can be placed
+// anywhere without passing it around. While disabled, markers cost a single
+// check.
+class Profiler {
+ public:
+  static Profiler& Get();
+
+  ~Profiler();
+
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+
+  // Name the calling thread, for the overlay and exported traces.
+  void SetThreadName(const char* name);
+
+  // Time a region of the calling thread's frame. Calls must be paired.
+  void Begin(const char* name);
+  void End();
+
+  // Record `value` as the counter `name` for the calling thread's frame.
+  // Setting it again in the same frame replaces the value.
+  void SetCounter(const char* name, int value);
+
+  // Finish the calling thread's frame, and start the next one.
+  void EndFrame();
+
+  // Copy the calling thread's region timings into `summaries`, and return
+  // how many frames they cover.
+  int GetThreadSummaries(std::vector<ProfileSummary>* summaries);
+
+  // Forget the calling thread's recorded frames, timings and counters.
+  void ResetThread();
+
+  // Add `ms` of GPU time to the region `name`, for the GPU's current frame.
+  // GPU times are measured by GpuTimer, and shown beside the threads'.
+  void AddGpuTime(const char* name, float ms);
+  void EndGpuFrame();
+
+  // Write every recorded frame to `filename` in the Chrome trace event
+  // format, with counters as counter tracks. Returns false if the file
+  // couldn't be written.
+  bool ExportChromeTrace(const char* filename);
+
+  // Draw each thread's frame time, smoothed region timings and latest
+  // counters, and the MemoryTracker's counts, with flatui.
+  void RenderOverlay(fplbase::AssetManager* asset_manager,
+                     flatui::FontManager* font_manager,
+                     fplbase::InputSystem* input, const char* font);
+
+ private:
+  struct ProfileFrame {
+    uint64_t start;
+    uint64_t end;
+    std::vector<ProfileEvent> events;
+    std::vector<ProfileCounter> counters;
+  };
+
+  struct ThreadProfile {
+    ThreadProfile();
+    ~ThreadProfile();
+
+    const char* name;
+    int id;
+    uint64_t frame_start;
+    // The frame being recorded, and indices of its open events. Only touched
+    // by the thread itself.
+    std::vector<ProfileEvent> events;
+    std::vector<int> open_events;
+    std::vector<ProfileCounter> counters;
+
+    // Guards everything below, which other threads read.
+    SDL_mutex* mutex;
+    std::vector<ProfileFrame> frames;
+    int next_frame;
+    int num_frames;
+    int total_frames;
+    std::vector<ProfileSummary> summaries;
+    // The last value each counter was set to, in the order first set.
+    std::vector<ProfileCounter> latest_counters;
+    float average_frame_ms;
+  };
+
+  Profiler();
+  ThreadProfile* CurrentThread();
+  double TicksToMilliseconds(uint64_t ticks) const;
+  void Summarize(const ProfileFrame& frame, ThreadProfile* thread);
+  static void UpdateSummary(float frame_ms, ProfileSummary* summary);
+
+  // Toggled by the render thread, and read by every thread that records.
+  std::atomic<bool> enabled_;
+  uint64_t frequency_;
+  uint64_t start_time_;
+  SDL_TLSID tls_id_;
+
+  // Guards `threads_`.
+  SDL_mutex* threads_mutex_;
+  std::vector<std::unique_ptr<ThreadProfile>> threads_;
+
+  // Also guarded by `threads_mutex_`.
+  std::vector<ProfileSummary> gpu_summaries_;
+  std::vector<float> gpu_frame_ms_;
+};
+
+// Times the enclosing scope.
+class ProfileScope {
+ public:
+  explicit ProfileScope(const char* name) { Profiler::Get().Begin(name); }
+  ~ProfileScope() { Profiler::Get().End(); }
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_PROFILER_H_
@@ -0,0 +1,121 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "projectile_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace fpl {
+namespace zooshi {
+
+using mathfu::vec3;
+
+// Projectiles whose path crosses more cells than this are not bucketed, and
+// are instead tested by every query.
+static const int64_t kMaxCellsPerProjectile = 64;
+
+// Queries that cover more cells than this test every projectile instead.
+static const int64_t kMaxCellsPerQuery = 256;
+
+// Keep cell coordinates well inside the range of an int.
+static const float kMaxCellCoord = 1.0e6f;
+
+int ProjectileGrid::CellCoord(float x) const {
+  const float coord = std::floor(x / cell_size_);
+  return static_cast<int>(
+      std::max(-kMaxCellCoord, std::min(coord, kMaxCellCoord)));
+}
+
+uint64_t ProjectileGrid::CellKey(int x, int y) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+         static_cast<uint64_t>(static_cast<uint32_t>(y));
+}
+
+int64_t ProjectileGrid::NumCells(int min_x, int max_x, int min_y,
+                                 int max_y) {
+  return static_cast<int64_t>(max_x - min_x + 1) *
+         static_cast<int64_t>(max_y - min_y + 1);
+}
+
+void ProjectileGrid::Build(const ProjectileSnapshot& snapshot,
+                           float cell_size, float min_time, float max_time) {
+  Clear();
+  cell_size_ = std::max(cell_size, 1.0f);
+  num_projectiles_ = snapshot.size();
+
+  for (int index = 0; index < num_projectiles_; ++index) {
+    const vec3 position = snapshot.Position(index);
+    const vec3 velocity = snapshot.Velocity(index);
+
+    // Bucket the bounding box of the horizontal path. Gravity only acts on
+    // the height, so the path is a straight line in XY.
+    const vec3 start = position + velocity * min_time;
+    const vec3 end = position + velocity * max_time;
+    const int min_x = CellCoord(std::min(start.x, end.x));
+    const int max_x = CellCoord(std::max(start.x, end.x));
+    const int min_y = CellCoord(std::min(start.y, end.y));
+    const int max_y = CellCoord(std::max(start.y, end.y));
+    if (NumCells(min_x, max_x, min_y, max_y) > kMaxCellsPerProjectile) {
+      unbucketed_.push_back(index);
+      continue;
+    }
+    for (int x = min_x; x <= max_x; ++x) {
+      for (int y = min_y; y <= max_y; ++y) {
+        cells_.push_back(CellEntry(CellKey(x, y), index));
+      }
+    }
+  }
+  std::sort(cells_.begin(), cells_.end());
+}
+
+void ProjectileGrid::Clear() {
+  num_projectiles_ = 0;
+  cells_.clear();
+  unbucketed_.clear();
+}
+
+void ProjectileGrid::Query(const vec3& position, float radius,
+                           std::vector<int>* indices) const {
+  indices->clear();
+  if (num_projectiles_ == 0) return;
+
+  const int min_x = CellCoord(position.x - radius);
+  const int max_x = CellCoord(position.x + radius);
+  const int min_y = CellCoord(position.y - radius);
+  const int max_y = CellCoord(position.y + radius);
+  if (NumCells(min_x, max_x, min_y, max_y) > kMaxCellsPerQuery) {
+    for (int i = 0; i < num_projectiles_; ++i) indices->push_back(i);
+    return;
+  }
+  for (int x = min_x; x <= max_x; ++x) {
+    for (int y = min_y; y <= max_y; ++y) {
+      const uint64_t key = CellKey(x, y);
+      auto cell = std::lower_bound(cells_.begin(), cells_.end(),
+                                   CellEntry(key, 0));
+      for (; cell != cells_.end() && cell->first == key; ++cell) {
+        indices->push_back(cell->second);
+      }
+    }
+  }
+  indices->insert(indices->end(), unbucketed_.begin(), unbucketed_.end());
+
+  // A projectile's path can cross several of the queried cells.
+  std::sort(indices->begin(), indices->end());
+  indices->erase(std::unique(indices->begin(), indices->end()),
+                 indices->end());
+}
+
+}  // zooshi
+}  // fpl
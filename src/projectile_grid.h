@@ -0,0 +1,72 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_PROJECTILE_GRID_H_
+#define ZOOSHI_PROJECTILE_GRID_H_
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "mathfu/glsl_mappings.h"
+#include "projectile_snapshot.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A ProjectileSnapshot, bucketed into a uniform grid in the XY plane. Each
+// projectile is added to every cell that its horizontal path crosses over the
+// search window, so a query only has to look at the cells around the point of
+// interest to find every projectile that will pass near it. Rebuilt once per
+// update, since projectiles move every frame.
+class ProjectileGrid {
+ public:
+  ProjectileGrid() : cell_size_(1.0f), num_projectiles_(0) {}
+
+  // Bucket the path each projectile in `snapshot` travels between `min_time`
+  // and `max_time` seconds from now. Indices returned by Query() are indices
+  // into `snapshot`.
+  void Build(const ProjectileSnapshot& snapshot, float cell_size,
+             float min_time, float max_time);
+
+  void Clear();
+
+  // Get the indices of projectiles whose path, over the times given to
+  // Build(), comes within `radius` of `position` in the XY plane. Also returns
+  // some that don't. Each index is returned at most once, in ascending order.
+  void Query(const mathfu::vec3& position, float radius,
+             std::vector<int>* indices) const;
+
+ private:
+  typedef std::pair<uint64_t, int> CellEntry;
+
+  int CellCoord(float x) const;
+  static uint64_t CellKey(int x, int y);
+  static int64_t NumCells(int min_x, int max_x, int min_y, int max_y);
+
+  float cell_size_;
+  int num_projectiles_;
+
+  // (cell key, projectile index) for each cell a projectile's path crosses.
+  // Sorted by key so each cell's projectiles are contiguous.
+  std::vector<CellEntry> cells_;
+
+  // Projectiles whose path crosses too many cells to bucket sensibly. These
+  // are returned from every query.
+  std::vector<int> unbucketed_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_PROJECTILE_GRID_H_
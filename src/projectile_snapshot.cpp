@@ -0,0 +1,162 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "projectile_snapshot.h"
+
+#include <algorithm>
+#include "components/entity_pool.h"
+#include "components/player_projectile.h"
+#include "corgi_component_library/physics.h"
+#include "corgi_component_library/transform.h"
+
+namespace fpl {
+namespace zooshi {
+
+using corgi::component_library::PhysicsComponent;
+using corgi::component_library::PhysicsData;
+using corgi::component_library::TransformData;
+using mathfu::vec3;
+using mathfu::vec4;
+
+// Projectiles are tested in groups of this many, one per SIMD lane.
+static const int kLanes = 4;
+
+// Lower bound on the approach speed, so lanes moving away from the target
+// don't divide by zero. Those lanes are rejected anyway.
+static const float kMinApproachSpeed = 1e-6f;
+
+void ProjectileSnapshot::Capture(corgi::EntityManager* entity_manager) {
+  Clear();
+
+  // TODO: change projectile_component to const when Component gets a
+  //       const_iterator.
+  PlayerProjectileComponent* projectile_component =
+      entity_manager->GetComponent<PlayerProjectileComponent>();
+  PhysicsComponent* physics_component =
+      entity_manager->GetComponent<PhysicsComponent>();
+  const EntityPoolComponent* entity_pool =
+      entity_manager->GetComponent<EntityPoolComponent>();
+  for (auto it = projectile_component->begin();
+       it != projectile_component->end(); ++it) {
+    // Pooled projectiles are waiting to be thrown.
+    if (!entity_pool->IsActive(it->entity)) continue;
+    const TransformData* transform =
+        entity_manager->GetComponentData<TransformData>(it->entity);
+    if (transform == nullptr) continue;
+
+    // Analytic projectiles keep their own velocity, since their rigid bodies
+    // are disabled.
+    const PlayerProjectileData& projectile = it->data;
+    vec3 velocity = projectile.velocity;
+    float gravity = projectile.gravity;
+    if (!projectile.analytic) {
+      const PhysicsData* physics =
+          entity_manager->GetComponentData<PhysicsData>(it->entity);
+      if (physics == nullptr) continue;
+      velocity = physics->Velocity();
+      gravity = physics_component->GravityForEntity(it->entity);
+    }
+    all_indices_.push_back(size());
+    entities_.push_back(it->entity);
+    position_x_.push_back(transform->position.x);
+    position_y_.push_back(transform->position.y);
+    position_z_.push_back(transform->position.z);
+    velocity_x_.push_back(velocity.x);
+    velocity_y_.push_back(velocity.y);
+    velocity_z_.push_back(velocity.z);
+    gravity_.push_back(gravity);
+  }
+}
+
+void ProjectileSnapshot::Clear() {
+  entities_.clear();
+  position_x_.clear();
+  position_y_.clear();
+  position_z_.clear();
+  velocity_x_.clear();
+  velocity_y_.clear();
+  velocity_z_.clear();
+  gravity_.clear();
+  all_indices_.clear();
+}
+
+void ProjectileSnapshot::Approaches(
+    const vec3& target, float max_dist_sq, const std::vector<int>& candidates,
+    std::vector<ProjectileApproach>* approaches) const {
+  approaches->clear();
+  const int num_candidates = static_cast<int>(candidates.size());
+  for (int i = 0; i < num_candidates; i += kLanes) {
+    ApproachesForLanes(target, max_dist_sq, &candidates[i],
+                       std::min(kLanes, num_candidates - i), approaches);
+  }
+}
+
+void ProjectileSnapshot::Approaches(
+    const vec3& target, float max_dist_sq,
+    std::vector<ProjectileApproach>* approaches) const {
+  Approaches(target, max_dist_sq, all_indices_, approaches);
+}
+
+void ProjectileSnapshot::ApproachesForLanes(
+    const vec3& target, float max_dist_sq, const int* indices, int count,
+    std::vector<ProjectileApproach>* approaches) const {
+  // Gather up to four projectiles, one per lane. Unused lanes repeat the
+  // first projectile and are ignored below.
+  int lane_index[kLanes];
+  for (int k = 0; k < kLanes; ++k) {
+    lane_index[k] = indices[k < count ? k : 0];
+  }
+  const vec4 position_x(
+      position_x_[lane_index[0]], position_x_[lane_index[1]],
+      position_x_[lane_index[2]], position_x_[lane_index[3]]);
+  const vec4 position_y(
+      position_y_[lane_index[0]], position_y_[lane_index[1]],
+      position_y_[lane_index[2]], position_y_[lane_index[3]]);
+  const vec4 velocity_x(
+      velocity_x_[lane_index[0]], velocity_x_[lane_index[1]],
+      velocity_x_[lane_index[2]], velocity_x_[lane_index[3]]);
+  const vec4 velocity_y(
+      velocity_y_[lane_index[0]], velocity_y_[lane_index[1]],
+      velocity_y_[lane_index[2]], velocity_y_[lane_index[3]]);
+
+  // Horizontal offset from each projectile to the target.
+  const vec4 to_target_x = vec4(target.x) - position_x;
+  const vec4 to_target_y = vec4(target.y) - position_y;
+  const vec4 dist_sq_now =
+      to_target_x * to_target_x + to_target_y * to_target_y;
+
+  // The projectile reaches the target's distance along its direction of
+  // travel after `time` seconds. This is the distance to the target divided by
+  // the projectile's speed towards it.
+  const vec4 approach = velocity_x * to_target_x + velocity_y * to_target_y;
+  const vec4 time =
+      dist_sq_now / vec4::Max(approach, vec4(kMinApproachSpeed));
+
+  // Horizontal distance squared from the target at `time`.
+  const vec4 offset_x = velocity_x * time - to_target_x;
+  const vec4 offset_y = velocity_y * time - to_target_y;
+  const vec4 dist_sq = offset_x * offset_x + offset_y * offset_y;
+
+  for (int k = 0; k < count; ++k) {
+    if (approach[k] <= 0.0f || dist_sq[k] > max_dist_sq) continue;
+    ProjectileApproach result;
+    result.index = lane_index[k];
+    result.time = time[k];
+    result.dist_sq = dist_sq[k];
+    approaches->push_back(result);
+  }
+}
+
+}  // zooshi
+}  // fpl
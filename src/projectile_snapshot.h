@@ -0,0 +1,87 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_PROJECTILE_SNAPSHOT_H_
+#define ZOOSHI_PROJECTILE_SNAPSHOT_H_
+
+#include <vector>
+#include "corgi/entity_manager.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Where a projectile passes closest to a target, ignoring height.
+struct ProjectileApproach {
+  int index;      // Index of the projectile in the snapshot.
+  float time;     // Time until the projectile is closest, in seconds.
+  float dist_sq;  // Horizontal distance squared from the target at `time`.
+};
+
+// The position, velocity and gravity of every player projectile, captured
+// once per update and stored as structure-of-arrays, so that questions like
+// "which projectile reaches me first" can be answered four projectiles at a
+// time without chasing component data pointers.
+class ProjectileSnapshot {
+ public:
+  // Capture every PlayerProjectileComponent entity.
+  void Capture(corgi::EntityManager* entity_manager);
+
+  // Release the captured projectiles.
+  void Clear();
+
+  // Find the projectiles in `candidates` that are moving towards `target` in
+  // the XY plane, and that pass within `max_dist_sq` of it. Gravity only acts
+  // on height, so it doesn't affect the result. Candidates are visited in
+  // order, so `approaches` is sorted if `candidates` is.
+  void Approaches(const mathfu::vec3& target, float max_dist_sq,
+                  const std::vector<int>& candidates,
+                  std::vector<ProjectileApproach>* approaches) const;
+
+  // Same as above, testing every projectile in the snapshot.
+  void Approaches(const mathfu::vec3& target, float max_dist_sq,
+                  std::vector<ProjectileApproach>* approaches) const;
+
+  int size() const { return static_cast<int>(entities_.size()); }
+  const corgi::EntityRef& entity(int i) const { return entities_[i]; }
+  mathfu::vec3 Position(int i) const {
+    return mathfu::vec3(position_x_[i], position_y_[i], position_z_[i]);
+  }
+  mathfu::vec3 Velocity(int i) const {
+    return mathfu::vec3(velocity_x_[i], velocity_y_[i], velocity_z_[i]);
+  }
+  float gravity(int i) const { return gravity_[i]; }
+
+ private:
+  void ApproachesForLanes(const mathfu::vec3& target, float max_dist_sq,
+                          const int* indices, int count,
+                          std::vector<ProjectileApproach>* approaches) const;
+
+  std::vector<corgi::EntityRef> entities_;
+  std::vector<float> position_x_;
+  std::vector<float> position_y_;
+  std::vector<float> position_z_;
+  std::vector<float> velocity_x_;  // In m/s.
+  std::vector<float> velocity_y_;
+  std::vector<float> velocity_z_;
+  std::vector<float> gravity_;
+
+  // 0 to size() - 1, for testing the whole snapshot.
+  std::vector<int> all_indices_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_PROJECTILE_SNAPSHOT_H_
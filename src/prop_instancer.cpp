@@ -0,0 +1,281 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "prop_instancer.h"
+
+#include <algorithm>
+#include "SDL_video.h"
+#include "corgi_component_library/transform.h"
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+#include "profiler.h"
+
+using corgi::component_library::RenderMeshComponent;
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+using fplbase::LogInfo;
+using mathfu::mat4;
+using mathfu::vec3;
+using mathfu::vec4;
+
+namespace fpl {
+namespace zooshi {
+
+#if defined(_WIN32)
+#define ZOOSHI_GL_APIENTRY __stdcall
+#else
+#define ZOOSHI_GL_APIENTRY
+#endif  // defined(_WIN32)
+
+typedef void(ZOOSHI_GL_APIENTRY* VertexAttribDivisorFunc)(GLuint index,
+                                                           GLuint divisor);
+
+// Core in GLES 3.0 and OpenGL 3.3, which are needed for instanced draws
+// anyway, so it's shared by every context.
+static VertexAttribDivisorFunc vertex_attrib_divisor = nullptr;
+
+// The instance transform attribute in the INSTANCED uber shader. A mat4
+// attribute takes up four consecutive locations, one per column.
+static const char* kInstanceAttributeName = "aInstanceModel";
+static const int kInstanceAttributeColumns = 4;
+static const int kFloatsPerInstance = 16;
+
+static bool SameTint(const vec4& a, const vec4& b) {
+  return a.x() == b.x() && a.y() == b.y() && a.z() == b.z() && a.w() == b.w();
+}
+
+PropInstancer::PropInstancer()
+    : enabled_(false),
+      min_instances_(0),
+      entity_manager_(nullptr),
+      num_groups_(0),
+      instance_buffer_(0) {}
+
+PropInstancer::~PropInstancer() {
+  if (instance_buffer_ != 0) GL_CALL(glDeleteBuffers(1, &instance_buffer_));
+}
+
+void PropInstancer::Initialize(const RenderConfig* config,
+                               fplbase::AssetManager* asset_manager,
+                               fplbase::Renderer& renderer,
+                               corgi::EntityManager* entity_manager) {
+  entity_manager_ = entity_manager;
+  min_instances_ = std::max(config->min_instances(), 2);
+
+  instanced_shaders_.clear();
+  auto defs = config->instanced_shaders();
+  if (defs != nullptr) {
+    for (auto it = defs->begin(); it != defs->end(); ++it) {
+      fplbase::Shader* shader =
+          asset_manager->FindShader(it->shader()->c_str());
+      fplbase::Shader* instanced =
+          asset_manager->FindShader(it->instanced_shader()->c_str());
+      if (shader != nullptr && instanced != nullptr) {
+        instanced_shaders_.push_back(std::make_pair(shader, instanced));
+      }
+    }
+  }
+  if (instanced_shaders_.empty()) return;
+
+  if (renderer.feature_level() >= fplbase::kFeatureLevel30) {
+    vertex_attrib_divisor = reinterpret_cast<VertexAttribDivisorFunc>(
+        SDL_GL_GetProcAddress("glVertexAttribDivisor"));
+  }
+  if (vertex_attrib_divisor == nullptr) {
+    LogInfo("Instancing isn't supported; props will be drawn one by one.");
+    return;
+  }
+  GL_CALL(glGenBuffers(1, &instance_buffer_));
+  enabled_ = true;
+}
+
+fplbase::Shader* PropInstancer::InstancedShader(
+    const fplbase::Shader* shader) const {
+  for (auto it = instanced_shaders_.begin(); it != instanced_shaders_.end();
+       ++it) {
+    if (it->first == shader) return it->second;
+  }
+  return nullptr;
+}
+
+void PropInstancer::Collect(RenderMeshComponent* render_mesh_component,
+                            const corgi::CameraInterface& camera,
+                            const RenderCuller& culler) {
+  ProfileScope scope("CollectInstancedProps");
+  num_groups_ = 0;
+  collected_.clear();
+  if (!enabled_) return;
+
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    it->entities.clear();
+  }
+
+  for (auto iter = render_mesh_component->begin();
+       iter != render_mesh_component->end(); ++iter) {
+    const RenderMeshData& data = iter->data;
+    if (!data.visible || data.mesh == nullptr ||
+        data.pass_mask != 1 << corgi::RenderPass_Opaque ||
+        data.shaders.empty()) {
+      continue;
+    }
+    fplbase::Shader* shader = InstancedShader(data.shaders[ShaderIndex_Lit]);
+    if (shader == nullptr) continue;
+    const TransformData* transform_data =
+        entity_manager_->GetComponentData<TransformData>(iter->entity);
+    if (transform_data == nullptr) continue;
+
+    if (!culler.MayBeInView(data, transform_data->world_transform, camera)) {
+      continue;
+    }
+
+    size_t index = 0;
+    while (index < num_groups_ &&
+           (groups_[index].mesh != data.mesh ||
+            groups_[index].shader != shader ||
+            !SameTint(groups_[index].tint, data.tint))) {
+      index++;
+    }
+    if (index == num_groups_) {
+      if (num_groups_ == groups_.size()) groups_.push_back(Group());
+      Group& group = groups_[num_groups_++];
+      group.mesh = data.mesh;
+      group.shader = shader;
+      group.tint = data.tint;
+    }
+    groups_[index].entities.push_back(iter->entity);
+  }
+
+  // Leave groups too small to be worth instancing to RenderMeshComponent,
+  // and hide the rest from it.
+  size_t kept = 0;
+  for (size_t i = 0; i < num_groups_; ++i) {
+    if (static_cast<int>(groups_[i].entities.size()) < min_instances_) {
+      continue;
+    }
+    if (kept != i) std::swap(groups_[kept], groups_[i]);
+    Group& group = groups_[kept++];
+    collected_.insert(collected_.end(), group.entities.begin(),
+                      group.entities.end());
+  }
+  num_groups_ = kept;
+  HideCollected(render_mesh_component);
+}
+
+void PropInstancer::HideCollected(RenderMeshComponent* render_mesh_component) {
+  for (auto it = collected_.begin(); it != collected_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(*it);
+    if (data != nullptr) data->visible = false;
+  }
+}
+
+void PropInstancer::ShowCollected(RenderMeshComponent* render_mesh_component) {
+  for (auto it = collected_.begin(); it != collected_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(*it);
+    if (data != nullptr) data->visible = true;
+  }
+}
+
+GLint PropInstancer::InstanceAttribute() {
+  GLint program = 0;
+  GL_CALL(glGetIntegerv(GL_CURRENT_PROGRAM, &program));
+  for (auto it = attribute_locations_.begin();
+       it != attribute_locations_.end(); ++it) {
+    if (it->first == program) return it->second;
+  }
+  const GLint location = glGetAttribLocation(
+      static_cast<GLuint>(program), kInstanceAttributeName);
+  attribute_locations_.push_back(std::make_pair(program, location));
+  return location;
+}
+
+void PropInstancer::Render(const corgi::CameraInterface& camera,
+                           fplbase::Renderer& renderer,
+                           const vec3& light_position) {
+  if (num_groups_ == 0) return;
+  ProfileScope scope("DrawInstancedProps");
+
+  // Each eye draws every group into its viewport in turn.
+  if (!camera.IsStereo()) {
+    RenderView(camera.GetTransformMatrix(), camera.position(), renderer,
+               light_position);
+    return;
+  }
+  for (int view = 0; view < 2; ++view) {
+    renderer.SetViewport(camera.viewport(view));
+    RenderView(camera.GetTransformMatrix(view), camera.position(view),
+               renderer, light_position);
+  }
+}
+
+void PropInstancer::RenderView(const mat4& view_projection,
+                               const vec3& camera_position,
+                               fplbase::Renderer& renderer,
+                               const vec3& light_position) {
+  // The instanced shaders work in world space, so the model matrix is left
+  // out of model_view_projection, and the light and camera aren't moved into
+  // each model's space.
+  renderer.set_model_view_projection(view_projection);
+  renderer.set_camera_pos(camera_position);
+  renderer.set_light_pos(light_position);
+
+  for (size_t i = 0; i < num_groups_; ++i) {
+    Group& group = groups_[i];
+    instance_data_.clear();
+    for (auto it = group.entities.begin(); it != group.entities.end(); ++it) {
+      if (!it->IsValid()) continue;
+      // Read the transforms now, rather than when collected, so they're
+      // interpolated like everything else.
+      const TransformData* transform_data =
+          entity_manager_->GetComponentData<TransformData>(*it);
+      if (transform_data == nullptr) continue;
+      const mat4& world_transform = transform_data->world_transform;
+      for (int j = 0; j < kFloatsPerInstance; ++j) {
+        instance_data_.push_back(world_transform[j]);
+      }
+    }
+    const size_t num_instances = instance_data_.size() / kFloatsPerInstance;
+    if (num_instances == 0) continue;
+
+    renderer.set_color(group.tint);
+    group.shader->Set(renderer);
+    const GLint location = InstanceAttribute();
+    if (location < 0) continue;
+
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_));
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER,
+                         instance_data_.size() * sizeof(float),
+                         instance_data_.data(), GL_STREAM_DRAW));
+    for (int column = 0; column < kInstanceAttributeColumns; ++column) {
+      const GLuint index = static_cast<GLuint>(location + column);
+      GL_CALL(glEnableVertexAttribArray(index));
+      GL_CALL(glVertexAttribPointer(
+          index, 4, GL_FLOAT, GL_FALSE, kFloatsPerInstance * sizeof(float),
+          reinterpret_cast<const void*>(column * 4 * sizeof(float))));
+      vertex_attrib_divisor(index, 1);
+    }
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    group.mesh->Render(renderer, false, num_instances);
+
+    // Other draws expect every attribute to advance per vertex.
+    for (int column = 0; column < kInstanceAttributeColumns; ++column) {
+      const GLuint index = static_cast<GLuint>(location + column);
+      vertex_attrib_divisor(index, 0);
+      GL_CALL(glDisableVertexAttribArray(index));
+    }
+  }
+}
+
+}  // zooshi
+}  // fpl
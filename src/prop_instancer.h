@@ -0,0 +1,122 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_PROP_INSTANCER_H_
+#define ZOOSHI_PROP_INSTANCER_H_
+
+#include <utility>
+#include <vector>
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/camera_interface.h"
+#include "corgi_component_library/rendermesh.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "mathfu/glsl_mappings.h"
+#include "render_culler.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Draws props that share a mesh, shader and tint, such as the trees and rocks
+// placed along the river, with one instanced draw call per group instead of
+// one per entity. Each instance's world transform is streamed in a vertex
+// buffer, and read by the INSTANCED variant of the prop's shader.
+//
+// Where instancing isn't available (GLES2 devices), or a group is too small
+// to be worth it, the props are left to RenderMeshComponent to draw as usual.
+// Stereo cameras draw each group once per eye.
+class PropInstancer {
+ public:
+  PropInstancer();
+  ~PropInstancer();
+
+  // Needs a current GL context. Does nothing more if instancing isn't
+  // supported, or the config doesn't list any instanced shaders.
+  void Initialize(const RenderConfig* config,
+                  fplbase::AssetManager* asset_manager,
+                  fplbase::Renderer& renderer,
+                  corgi::EntityManager* entity_manager);
+
+  bool enabled() const { return enabled_; }
+
+  // Group the visible props that can be instanced, and that `culler` says
+  // `camera` may see, and hide them from RenderMeshComponent. Needs no GL
+  // context. ShowCollected() shows them again, and HideCollected() hides
+  // them again for as long as render lists are built from `camera`.
+  void Collect(
+      corgi::component_library::RenderMeshComponent* render_mesh_component,
+      const corgi::CameraInterface& camera, const RenderCuller& culler);
+  void HideCollected(
+      corgi::component_library::RenderMeshComponent* render_mesh_component);
+  void ShowCollected(
+      corgi::component_library::RenderMeshComponent* render_mesh_component);
+
+  // Forget the collected props, so Render() draws nothing.
+  void Clear() {
+    num_groups_ = 0;
+    collected_.clear();
+  }
+
+  // Call whenever shaders are reloaded, since their programs may change.
+  void ResetShaders() { attribute_locations_.clear(); }
+
+  // Draw the collected props, lit from `light_position` in world space.
+  // Call during the opaque render pass.
+  void Render(const corgi::CameraInterface& camera,
+              fplbase::Renderer& renderer,
+              const mathfu::vec3& light_position);
+
+ private:
+  struct Group {
+    fplbase::Mesh* mesh;
+    fplbase::Shader* shader;
+    mathfu::vec4 tint;
+    std::vector<corgi::EntityRef> entities;
+  };
+
+  // The instanced variant of `shader`, or null if it hasn't got one.
+  fplbase::Shader* InstancedShader(const fplbase::Shader* shader) const;
+
+  // Where the current program reads each instance's world transform from.
+  GLint InstanceAttribute();
+
+  void RenderView(const mathfu::mat4& view_projection,
+                  const mathfu::vec3& camera_position,
+                  fplbase::Renderer& renderer,
+                  const mathfu::vec3& light_position);
+
+  bool enabled_;
+  int min_instances_;
+  corgi::EntityManager* entity_manager_;
+  std::vector<std::pair<const fplbase::Shader*, fplbase::Shader*>>
+      instanced_shaders_;
+
+  // Groups are reused between frames to save allocations. Only the first
+  // `num_groups_` are in use.
+  std::vector<Group> groups_;
+  size_t num_groups_;
+  std::vector<corgi::EntityRef> collected_;
+
+  GLuint instance_buffer_;
+  std::vector<float> instance_data_;
+  // The instance attribute's location in each program that's drawn with.
+  std::vector<std::pair<GLint, GLint>> attribute_locations_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_PROP_INSTANCER_H_
@@ -0,0 +1,146 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "prototype_cache.h"
+
+#include "components_generated.h"
+#include "flatbuffers/flatbuffers.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+
+namespace fpl {
+namespace zooshi {
+
+// Prototypes that inherit from this many others are assumed to have a cycle.
+static const int kMaxPrototypeDepth = 16;
+
+void PrototypeCache::SetComponentType(corgi::ComponentId component_id,
+                                      unsigned int data_type) {
+  if (data_type >= component_ids_.size()) {
+    component_ids_.resize(data_type + 1, corgi::kInvalidComponent);
+  }
+  component_ids_[data_type] = component_id;
+  if (data_type == ComponentDataUnion_corgi_MetaDef) {
+    meta_component_id_ = component_id;
+  }
+}
+
+bool PrototypeCache::LoadLibrary(const char* filename) {
+  entity_defs_.clear();
+  flattened_.clear();
+  if (!MapFile(filename, &library_)) {
+    LogError("Couldn't load entity library %s", filename);
+    return false;
+  }
+  const EntityListDef* list = GetEntityListDef(library_.data());
+  if (list->entity_list() == nullptr) return true;
+  for (auto entity = list->entity_list()->begin();
+       entity != list->entity_list()->end(); ++entity) {
+    if (entity->component_list() == nullptr) continue;
+    for (auto def = entity->component_list()->begin();
+         def != entity->component_list()->end(); ++def) {
+      if (def->data_type() != ComponentDataUnion_corgi_MetaDef) continue;
+      auto meta_def = static_cast<const corgi::MetaDef*>(def->data());
+      if (meta_def->entity_id() != nullptr) {
+        entity_defs_[meta_def->entity_id()->str()] = *entity;
+      }
+    }
+  }
+  return true;
+}
+
+const FlatPrototype* PrototypeCache::Find(const char* prototype) {
+  auto it = flattened_.find(prototype);
+  if (it != flattened_.end()) return it->second.get();
+  return Flatten(prototype, 0);
+}
+
+const FlatPrototype* PrototypeCache::Flatten(const std::string& prototype,
+                                             int depth) {
+  auto found = flattened_.find(prototype);
+  if (found != flattened_.end()) return found->second.get();
+
+  auto entity_def = entity_defs_.find(prototype);
+  if (entity_def == entity_defs_.end()) {
+    LogError("Unknown prototype %s", prototype.c_str());
+    return nullptr;
+  }
+  if (depth >= kMaxPrototypeDepth) {
+    LogError("Prototype %s inherits from too many others", prototype.c_str());
+    return nullptr;
+  }
+  auto entity = static_cast<const EntityDef*>(entity_def->second);
+
+  std::unique_ptr<FlatPrototype> flat(new FlatPrototype());
+  if (entity->component_list() != nullptr) {
+    // Start from the prototype this one inherits from, if any.
+    for (auto def = entity->component_list()->begin();
+         def != entity->component_list()->end(); ++def) {
+      if (def->data_type() != ComponentDataUnion_corgi_MetaDef) continue;
+      auto meta_def = static_cast<const corgi::MetaDef*>(def->data());
+      if (meta_def->prototype() == nullptr) continue;
+      const FlatPrototype* parent =
+          Flatten(meta_def->prototype()->str(), depth + 1);
+      if (parent != nullptr) flat->components = parent->components;
+    }
+    for (auto def = entity->component_list()->begin();
+         def != entity->component_list()->end(); ++def) {
+      const unsigned int data_type = def->data_type();
+      if (data_type >= component_ids_.size() ||
+          component_ids_[data_type] == corgi::kInvalidComponent) {
+        continue;
+      }
+      const corgi::ComponentId id = component_ids_[data_type];
+      if (id >= flat->components.size()) {
+        flat->components.resize(id + 1, nullptr);
+      }
+      flat->components[id] = def->data();
+    }
+  }
+
+  flatbuffers::FlatBufferBuilder fbb;
+  auto prototype_name = fbb.CreateString(prototype);
+  corgi::MetaDefBuilder meta_builder(fbb);
+  meta_builder.add_prototype(prototype_name);
+  fbb.Finish(meta_builder.Finish());
+  flat->meta_def.assign(fbb.GetBufferPointer(),
+                        fbb.GetBufferPointer() + fbb.GetSize());
+  if (meta_component_id_ != corgi::kInvalidComponent) {
+    if (meta_component_id_ >= flat->components.size()) {
+      flat->components.resize(meta_component_id_ + 1, nullptr);
+    }
+    flat->components[meta_component_id_] =
+        flatbuffers::GetRoot<corgi::MetaDef>(flat->meta_def.data());
+  }
+
+  const FlatPrototype* result = flat.get();
+  flattened_[prototype] = std::move(flat);
+  return result;
+}
+
+corgi::EntityRef PrototypeCache::Create(
+    const FlatPrototype& prototype,
+    corgi::EntityManager* entity_manager) const {
+  corgi::EntityRef entity = entity_manager->AllocateNewEntity();
+  // Add components in the order they were registered, as the factory does.
+  for (size_t id = 0; id < prototype.components.size(); ++id) {
+    if (prototype.components[id] == nullptr) continue;
+    entity_manager->GetComponent(static_cast<corgi::ComponentId>(id))
+        ->AddFromRawData(entity, prototype.components[id]);
+  }
+  return entity;
+}
+
+}  // zooshi
+}  // fpl
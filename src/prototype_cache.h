@@ -0,0 +1,80 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_PROTOTYPE_CACHE_H_
+#define ZOOSHI_PROTOTYPE_CACHE_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "corgi/entity_common.h"
+#include "corgi/entity_manager.h"
+#include "mapped_file.h"
+
+namespace fpl {
+namespace zooshi {
+
+// An entity prototype with every prototype it inherits from merged in, so
+// entities can be created from it without looking anything up.
+struct FlatPrototype {
+  // Raw component defs, indexed by component id. Null for components the
+  // prototype doesn't have.
+  std::vector<const void*> components;
+  // A MetaDef naming only the prototype, so created entities don't share
+  // the prototype's entity id.
+  std::vector<uint8_t> meta_def;
+};
+
+// Flattens the entities in the prototype library the first time each is
+// created, the way corgi's EntityFactory merges them for every entity it
+// creates. Components in an entity replace the same components in its
+// prototypes.
+//
+// Used for entities spawned while playing. Levels are still loaded through
+// the entity factory, which records where each entity came from for the
+// editor.
+class PrototypeCache {
+ public:
+  PrototypeCache() : meta_component_id_(corgi::kInvalidComponent) {}
+
+  // Mirrors EntityFactory::SetComponentType(). Call for every component.
+  void SetComponentType(corgi::ComponentId component_id,
+                        unsigned int data_type);
+
+  // Load the same library as EntityFactory::AddEntityLibrary().
+  bool LoadLibrary(const char* filename);
+
+  // Null if there's no prototype named `prototype`. The result stays valid
+  // until the library is loaded again.
+  const FlatPrototype* Find(const char* prototype);
+
+  // Create an entity with `prototype`'s components.
+  corgi::EntityRef Create(const FlatPrototype& prototype,
+                          corgi::EntityManager* entity_manager) const;
+
+ private:
+  const FlatPrototype* Flatten(const std::string& prototype, int depth);
+
+  std::vector<corgi::ComponentId> component_ids_;
+  corgi::ComponentId meta_component_id_;
+  MappedFile library_;
+  // Entity defs in the library, by entity id.
+  std::unordered_map<std::string, const void*> entity_defs_;
+  std::unordered_map<std::string, std::unique_ptr<FlatPrototype>> flattened_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_PROTOTYPE_CACHE_H_
@@ -0,0 +1,160 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "quality_governor.h"
+
+#include <algorithm>
+#include "SDL_timer.h"
+#include "fplbase/utilities.h"
+#include "world.h"
+#include "world_renderer.h"
+
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+#ifdef __ANDROID__
+// The API level PowerManager.getCurrentThermalStatus() was added in.
+static const int kThermalStatusApiLevel = 29;
+#endif  // __ANDROID__
+
+QualityGovernor::QualityGovernor()
+    : enabled_(false),
+      config_(nullptr),
+      level_(0),
+      num_levels_(0),
+      window_start_(0),
+      windows_fitting_(0) {}
+
+void QualityGovernor::Initialize(const QualityGovernorConfig* config) {
+  config_ = config;
+  num_levels_ = config != nullptr && config->levels() != nullptr
+                    ? static_cast<int>(config->levels()->size())
+                    : 0;
+  enabled_ = config != nullptr && config->enabled() && num_levels_ > 1;
+  level_ = 0;
+  frame_times_.clear();
+  window_start_ = 0;
+  windows_fitting_ = 0;
+}
+
+bool QualityGovernor::Update(float work_ms, float budget_ms) {
+  if (!enabled_) return false;
+  const uint64_t now = SDL_GetPerformanceCounter();
+  if (window_start_ == 0) window_start_ = now;
+  frame_times_.push_back(work_ms);
+
+  const double window_seconds =
+      static_cast<double>(now - window_start_) /
+      static_cast<double>(SDL_GetPerformanceFrequency());
+  if (window_seconds < config_->window()) return false;
+  window_start_ = now;
+
+  const int previous_level = level_;
+  EndWindow(budget_ms);
+  return level_ != previous_level;
+}
+
+void QualityGovernor::EndWindow(float budget_ms) {
+  const size_t rank = std::min(
+      static_cast<size_t>(config_->percentile() * frame_times_.size()),
+      frame_times_.size() - 1);
+  std::nth_element(frame_times_.begin(), frame_times_.begin() + rank,
+                   frame_times_.end());
+  const float frame_ms = frame_times_[rank];
+  frame_times_.clear();
+
+  const int thermal_status = ThermalStatus();
+  const bool too_hot = thermal_status >= config_->thermal_step_down_status();
+  const bool too_slow = frame_ms > config_->step_down_fraction() * budget_ms;
+  const bool fits = frame_ms < config_->step_up_fraction() * budget_ms &&
+                    thermal_status < config_->thermal_hold_status();
+
+  windows_fitting_ = fits ? windows_fitting_ + 1 : 0;
+  if ((too_hot || too_slow) && level_ < num_levels_ - 1) {
+    level_++;
+    windows_fitting_ = 0;
+  } else if (windows_fitting_ >= config_->step_up_windows() && level_ > 0) {
+    level_--;
+    windows_fitting_ = 0;
+  } else {
+    return;
+  }
+
+  if (config_->log_changes()) {
+    LogInfo("Quality: level %d, %.2fms frames (%.2fms budget), thermal %d",
+            level_, frame_ms, budget_ms, thermal_status);
+  }
+}
+
+void QualityGovernor::Apply(World* world) const {
+  if (!enabled_) return;
+  const QualityLevel* level = config_->levels()->Get(level_);
+
+  uint32_t suppressed = 0;
+  if (!level->shadows()) suppressed |= 1u << kShadowEffect;
+  if (!level->phong_shading()) suppressed |= 1u << kPhongShading;
+  if (!level->specular()) suppressed |= 1u << kSpecularEffect;
+  if (!level->normal_maps()) suppressed |= 1u << kNormalMaps;
+  world->SetSuppressedRenderingOptions(suppressed);
+
+  world->world_renderer->SetShadowMapScale(world, level->shadow_map_scale());
+  world->scenery_component.set_pop_distance_scale(
+      level->pop_distance_scale());
+  world->patron_component.set_update_lod_distance_scale(
+      level->update_lod_distance_scale());
+}
+
+int QualityGovernor::ThermalStatus() {
+#ifdef __ANDROID__
+  JNIEnv* env = fplbase::AndroidGetJNIEnv();
+  jclass version_class = env->FindClass("android/os/Build$VERSION");
+  const jint api_level = env->GetStaticIntField(
+      version_class, env->GetStaticFieldID(version_class, "SDK_INT", "I"));
+  env->DeleteLocalRef(version_class);
+  if (api_level < kThermalStatusApiLevel) return 0;
+
+  jobject activity = fplbase::AndroidGetActivity();
+  jclass activity_class = env->GetObjectClass(activity);
+  jmethodID get_system_service =
+      env->GetMethodID(activity_class, "getSystemService",
+                       "(Ljava/lang/String;)Ljava/lang/Object;");
+  jstring power_service = env->NewStringUTF("power");
+  jobject power_manager =
+      env->CallObjectMethod(activity, get_system_service, power_service);
+  int status = 0;
+  if (power_manager != nullptr) {
+    jclass power_manager_class = env->GetObjectClass(power_manager);
+    jmethodID get_thermal_status = env->GetMethodID(
+        power_manager_class, "getCurrentThermalStatus", "()I");
+    status = env->CallIntMethod(power_manager, get_thermal_status);
+    env->DeleteLocalRef(power_manager_class);
+    env->DeleteLocalRef(power_manager);
+  }
+  if (env->ExceptionCheck()) {
+    env->ExceptionClear();
+    status = 0;
+  }
+  env->DeleteLocalRef(power_service);
+  env->DeleteLocalRef(activity_class);
+  env->DeleteLocalRef(activity);
+  return status;
+#else
+  return 0;
+#endif  // __ANDROID__
+}
+
+}  // zooshi
+}  // fpl
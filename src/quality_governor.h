@@ -0,0 +1,78 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_QUALITY_GOVERNOR_H_
+#define ZOOSHI_QUALITY_GOVERNOR_H_
+
+#include <stdint.h>
+#include <vector>
+#include "config_generated.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct World;
+
+// Keeps the frame rate steady over long sessions by stepping down a ladder
+// of quality levels when frames take too long, or the device gets hot, and
+// back up once there's room to spare. Each level sets the shadow map
+// resolution, which rendering options may be on, how far ahead scenery pops
+// in, and how far away patrons are updated fully.
+//
+// Where DynamicResolution reacts to each frame, this looks at a percentile
+// of a few seconds of frames, since its changes are costlier to make.
+class QualityGovernor {
+ public:
+  QualityGovernor();
+
+  // `config` may be null, in which case quality never changes.
+  void Initialize(const QualityGovernorConfig* config);
+
+  bool enabled() const { return enabled_; }
+
+  // The rung of the ladder in use. 0 is the highest quality.
+  int level() const { return level_; }
+
+  // Add the last frame's work time, and its budget, in milliseconds. Returns
+  // true if the level changed, in which case Apply() should be called.
+  bool Update(float work_ms, float budget_ms);
+
+  // Set up `world` for the current level. Call on the render thread, while
+  // the update thread is locked out.
+  void Apply(World* world) const;
+
+ private:
+  // Android's PowerManager.getCurrentThermalStatus(), or 0 (none) where it
+  // isn't available.
+  static int ThermalStatus();
+
+  void EndWindow(float budget_ms);
+
+  bool enabled_;
+  const QualityGovernorConfig* config_;
+  int level_;
+  int num_levels_;
+
+  // Frame times in the current window, which started at `window_start_`
+  // in performance counter ticks.
+  std::vector<float> frame_times_;
+  uint64_t window_start_;
+  // Windows in a row that fit under the step up fraction.
+  int windows_fitting_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_QUALITY_GOVERNOR_H_
@@ -0,0 +1,114 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rail_visibility.h"
+
+#include <algorithm>
+#include <cmath>
+#include "corgi_component_library/rendermesh.h"
+#include "corgi_component_library/transform.h"
+#include "fplbase/utilities.h"
+
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+
+namespace fpl {
+namespace zooshi {
+
+bool RailVisibility::Load(const char* file_name) {
+  Clear();
+  if (!MapFile(file_name, &file_)) {
+    fplbase::LogError("Couldn't load visibility file %s", file_name);
+    return false;
+  }
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(file_.data()), file_.size());
+  if (!file_.trusted() && !VerifyRailVisibilityDefBuffer(verifier)) {
+    fplbase::LogError("Visibility file %s is corrupt", file_name);
+    file_.Close();
+    return false;
+  }
+  def_ = GetRailVisibilityDef(file_.data());
+  return true;
+}
+
+void RailVisibility::Clear() {
+  def_ = nullptr;
+  file_.Close();
+  segment_ = -1;
+  hidden_.clear();
+  hidden_meshes_.clear();
+}
+
+void RailVisibility::Update(
+    float rail_position, corgi::EntityManager* entity_manager,
+    corgi::component_library::MetaComponent* meta_component) {
+  if (def_ == nullptr || def_->entity_ids() == nullptr ||
+      def_->segments() == nullptr || def_->segments()->size() == 0) {
+    return;
+  }
+  const int num_segments = static_cast<int>(def_->segments()->size());
+  int segment =
+      def_->segment_length() > 0.0f
+          ? static_cast<int>(std::floor(rail_position / def_->segment_length()))
+          : 0;
+  segment = std::max(0, std::min(segment, num_segments - 1));
+  if (segment == segment_) return;
+  segment_ = segment;
+
+  auto entity_ids = def_->entity_ids();
+  visible_.assign(entity_ids->size(), false);
+  auto visible = def_->segments()->Get(segment)->visible();
+  if (visible != nullptr) {
+    for (auto it = visible->begin(); it != visible->end(); ++it) {
+      if (*it < visible_.size()) visible_[*it] = true;
+    }
+  }
+
+  hidden_.clear();
+  hidden_meshes_.clear();
+  for (flatbuffers::uoffset_t i = 0; i < entity_ids->size(); ++i) {
+    if (visible_[i]) continue;
+    // Entities in sectors that aren't loaded aren't found.
+    corgi::EntityRef entity =
+        meta_component->GetEntityFromDictionary(entity_ids->Get(i)->str());
+    if (!entity.IsValid()) continue;
+    hidden_.push_back(entity.ToPointer());
+    AddMeshes(entity, entity_manager);
+  }
+  std::sort(hidden_.begin(), hidden_.end());
+}
+
+void RailVisibility::AddMeshes(const corgi::EntityRef& entity,
+                               corgi::EntityManager* entity_manager) {
+  if (entity_manager->GetComponentData<RenderMeshData>(entity) != nullptr) {
+    hidden_meshes_.push_back(entity);
+  }
+  const TransformData* transform_data =
+      entity_manager->GetComponentData<TransformData>(entity);
+  if (transform_data == nullptr) return;
+  for (auto it = transform_data->children.begin();
+       it != transform_data->children.end(); ++it) {
+    AddMeshes(it->owner, entity_manager);
+  }
+}
+
+bool RailVisibility::Hidden(const corgi::EntityRef& entity) const {
+  return !hidden_.empty() &&
+         std::binary_search(hidden_.begin(), hidden_.end(),
+                            entity.ToPointer());
+}
+
+}  // zooshi
+}  // fpl
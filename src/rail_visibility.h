@@ -0,0 +1,84 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RAIL_VISIBILITY_H_
+#define ZOOSHI_RAIL_VISIBILITY_H_
+
+#include <vector>
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/meta.h"
+#include "mapped_file.h"
+#include "visibility_generated.h"
+
+namespace fpl {
+namespace zooshi {
+
+// The sets of static entities that can be seen from each stretch of the
+// raft's rail, as baked by build_assets.py. The camera never leaves the raft,
+// so anything that isn't in the set for where the raft is can be skipped
+// without testing it, including what's hidden behind the banks.
+//
+// Entities are looked up by their entity_id whenever the set changes, and
+// whenever Invalidate() says entities have come or gone, so sets can cover
+// entities that are streamed in and out.
+class RailVisibility {
+ public:
+  RailVisibility() : def_(nullptr), segment_(-1) {}
+
+  // Read the sets from `file_name`. Returns false, leaving everything
+  // visible, if it can't be read.
+  bool Load(const char* file_name);
+
+  // Forget the sets, leaving everything visible.
+  void Clear();
+
+  bool loaded() const { return def_ != nullptr; }
+
+  // Look up the set for `rail_position`, the raft's distance along its rail.
+  void Update(float rail_position, corgi::EntityManager* entity_manager,
+              corgi::component_library::MetaComponent* meta_component);
+
+  // Look the entities up again on the next Update(). Call when entities are
+  // created or deleted.
+  void Invalidate() { segment_ = -1; }
+
+  // Whether `entity` is one the sets cover, and can't be seen from where the
+  // raft is. Only looks at the entity itself, not what it's attached to.
+  // Safe to call from any thread between Update() calls.
+  bool Hidden(const corgi::EntityRef& entity) const;
+
+  // The entities with rendermeshes that are Hidden(), or attached to one
+  // that is.
+  const std::vector<corgi::EntityRef>& hidden_meshes() const {
+    return hidden_meshes_;
+  }
+
+ private:
+  void AddMeshes(const corgi::EntityRef& entity,
+                 corgi::EntityManager* entity_manager);
+
+  MappedFile file_;
+  const RailVisibilityDef* def_;
+  int segment_;
+  // Sorted, for binary searching.
+  std::vector<const corgi::Entity*> hidden_;
+  std::vector<corgi::EntityRef> hidden_meshes_;
+  // Scratch space for Update(), indexed like the def's entity_ids.
+  std::vector<bool> visible_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RAIL_VISIBILITY_H_
@@ -14,13 +14,17 @@
 
 #include "railmanager.h"
 
-#include <map>
+#include <algorithm>
+#include <cmath>
+#include <utility>
 #include "components/rail_denizen.h"
 #include "components/rail_node.h"
 #include "corgi_component_library/transform.h"
 #include "fplbase/flatbuffer_utils.h"
 #include "fplbase/utilities.h"
+#include "mapped_file.h"
 #include "mathfu/constants.h"
+#include "mathfu/utilities.h"
 #include "motive/math/spline_util.h"
 #include "rail_def_generated.h"
 
@@ -29,10 +33,69 @@ namespace zooshi {
 
 static const float kSplineGranularity = 10.0f;
 
+// Milliseconds between samples in each rail's lookup table.
+static const float kRailLookupDeltaTime = 50.0f;
+
 using mathfu::vec3;
 using mathfu::vec3_packed;
 
-void Rail::Initialize(const RailDef *rail_def, float spline_granularity) {
+#ifndef NDEBUG
+// How far a baked node may be from motive's fit of the same rail, relative to
+// the rail's total time or the node's speed.
+static const float kBakedRailTolerance = 0.01f;
+
+// Logs an error if the nodes that build_assets.py baked for `rail_def` aren't
+// the ones motive fits through its positions at runtime.
+static void CheckBakedRail(const RailDef &rail_def) {
+  const auto *nodes = rail_def.baked()->nodes();
+  const auto *positions_def = rail_def.positions();
+  const int num_positions =
+      positions_def == nullptr ? 0 : static_cast<int>(positions_def->Length());
+  if (num_positions != static_cast<int>(nodes->Length())) {
+    fplbase::LogError("Baked rail has %d nodes, but %d positions.",
+                      static_cast<int>(nodes->Length()), num_positions);
+    return;
+  }
+  std::vector<vec3_packed> positions(num_positions);
+  for (int i = 0; i < num_positions; ++i) {
+    positions[i] = LoadVec3(positions_def->Get(i));
+  }
+  std::vector<float> times(num_positions);
+  std::vector<vec3_packed> derivatives(num_positions);
+  motive::CalculateConstSpeedCurveFromPositions<3>(
+      &positions[0], num_positions, rail_def.total_time(),
+      rail_def.reliable_distance(), &times[0], &derivatives[0]);
+
+  for (int i = 0; i < num_positions; ++i) {
+    const BakedRailNode *node = nodes->Get(i);
+    const vec3 derivative(derivatives[i]);
+    const vec3 baked_derivative = LoadVec3(&node->derivative());
+    if (fabsf(node->time() - times[i]) >
+            kBakedRailTolerance * rail_def.total_time() ||
+        (baked_derivative - derivative).Length() >
+            kBakedRailTolerance * derivative.Length()) {
+      fplbase::LogError(
+          "Baked rail node %d doesn't match motive's fit: time %f vs %f, "
+          "derivative (%f, %f, %f) vs (%f, %f, %f).",
+          i, node->time(), times[i], baked_derivative.x, baked_derivative.y,
+          baked_derivative.z, derivative.x, derivative.y, derivative.z);
+      return;
+    }
+  }
+}
+#endif  // NDEBUG
+
+void Rail::Initialize(const RailDef *rail_def, float spline_granularity,
+                      float lookup_delta_time) {
+  if (rail_def->baked() != nullptr) {
+#ifndef NDEBUG
+    CheckBakedRail(*rail_def);
+#endif  // NDEBUG
+    InitializeFromBaked(*rail_def->baked(), spline_granularity,
+                        rail_def->wraps(), lookup_delta_time);
+    return;
+  }
+
   // Allocate temporary memory for the positions and derivative arrays.
   const int num_positions = static_cast<int>(rail_def->positions()->Length());
   std::vector<vec3_packed> positions;
@@ -44,13 +107,13 @@ void Rail::Initialize(const RailDef *rail_def, float spline_granularity) {
   }
   InitializeFromPositions(positions, spline_granularity,
                           rail_def->reliable_distance(), rail_def->total_time(),
-                          rail_def->wraps());
+                          rail_def->wraps(), lookup_delta_time);
 }
 
 void Rail::InitializeFromPositions(const std::vector<vec3_packed> &positions,
                                    float spline_granularity,
                                    float reliable_distance, float total_time,
-                                   bool wraps) {
+                                   bool wraps, float lookup_delta_time) {
   const size_t num_positions = positions.size();
   std::vector<float> times;
   std::vector<vec3_packed> derivatives;
@@ -96,83 +159,235 @@ void Rail::InitializeFromPositions(const std::vector<vec3_packed> &positions,
       Spline(i)->AddNode(t, position[i], derivative[i]);
     }
   }
+
+  if (lookup_delta_time > 0.0f) BuildLookupTable(lookup_delta_time);
+}
+
+void Rail::InitializeFromBaked(const BakedRail &baked,
+                               float spline_granularity, bool wraps,
+                               float lookup_delta_time) {
+  const auto *nodes = baked.nodes();
+  const motive::CompactSplineIndex num_nodes =
+      static_cast<motive::CompactSplineIndex>(nodes->Length());
+  wraps_ = wraps;
+
+  // Create array of splines. Destroyed in Rail's destructor.
+  splines_ = motive::CompactSpline::CreateArray(2 * num_nodes, kDimensions);
+
+  // The range has already been lengthened to be safe when it was baked.
+  const vec3 range_min = LoadVec3(baked.range_min());
+  const vec3 range_max = LoadVec3(baked.range_max());
+  for (motive::MotiveDimension i = 0; i < kDimensions; ++i) {
+    Spline(i)->Init(motive::Range(range_min[i], range_max[i]),
+                    spline_granularity);
+  }
+
+  for (auto node = nodes->begin(); node != nodes->end(); ++node) {
+    const vec3 position = LoadVec3(&node->position());
+    const vec3 derivative = LoadVec3(&node->derivative());
+    for (motive::MotiveDimension i = 0; i < kDimensions; ++i) {
+      Spline(i)->AddNode(node->time(), position[i], derivative[i]);
+    }
+  }
+
+  if (lookup_delta_time > 0.0f) BuildLookupTable(lookup_delta_time);
+}
+
+void Rail::BuildLookupTable(float delta_time) {
+  // Sample the splines, not an old table.
+  lookup_positions_.clear();
+  Positions(delta_time, &lookup_positions_);
+  // Make sure the table reaches all the way to the end of the rail.
+  const float end_time = EndTime();
+  const float last_time =
+      static_cast<float>(lookup_positions_.size() - 1) * delta_time;
+  if (last_time < end_time) {
+    lookup_positions_.push_back(PositionCalculatedSlowly(end_time));
+  }
+  lookup_delta_time_ = delta_time;
+
+  // Directions are the central difference of the neighbouring samples.
+  const size_t num_samples = lookup_positions_.size();
+  lookup_directions_.resize(num_samples);
+  vec3 direction = mathfu::kAxisY3f;
+  for (size_t i = 0; i < num_samples; ++i) {
+    const vec3 prev(lookup_positions_[i > 0 ? i - 1 : i]);
+    const vec3 next(lookup_positions_[i + 1 < num_samples ? i + 1 : i]);
+    const vec3 delta = next - prev;
+    // Keep the previous direction where the rail doesn't move.
+    if (delta.LengthSquared() > 0.0f) direction = delta.Normalized();
+    lookup_directions_[i] = direction;
+  }
+
+  lookup_distances_.resize(num_samples);
+  float distance = 0.0f;
+  for (size_t i = 0; i < num_samples; ++i) {
+    if (i > 0) {
+      distance +=
+          (vec3(lookup_positions_[i]) - vec3(lookup_positions_[i - 1]))
+              .Length();
+    }
+    lookup_distances_[i] = distance;
+  }
+}
+
+size_t Rail::LookupIndex(float time, float *fraction) const {
+  const float end_time = EndTime();
+  // The end of a wrapping rail is left at the end, rather than the start, so
+  // Positions() can resample all the way to it.
+  if (wraps_ && end_time > 0.0f && (time < 0.0f || time > end_time)) {
+    time = std::fmod(time, end_time);
+    if (time < 0.0f) time += end_time;
+  }
+  time = mathfu::Clamp(time, 0.0f, end_time);
+
+  const size_t last_index = lookup_positions_.size() - 1;
+  size_t index = static_cast<size_t>(time / lookup_delta_time_);
+  if (index >= last_index) {
+    index = last_index > 0 ? last_index - 1 : 0;
+  }
+  // The last interval may be shorter than the rest.
+  const float start_time = static_cast<float>(index) * lookup_delta_time_;
+  const float interval =
+      std::min(start_time + lookup_delta_time_, end_time) - start_time;
+  *fraction =
+      interval > 0.0f ? mathfu::Clamp((time - start_time) / interval, 0.0f,
+                                      1.0f)
+                      : 0.0f;
+  return index;
+}
+
+vec3 Rail::Position(float time) const {
+  if (!HasLookupTable()) return PositionCalculatedSlowly(time);
+  float fraction;
+  const size_t index = LookupIndex(time, &fraction);
+  const size_t next = std::min(index + 1, lookup_positions_.size() - 1);
+  return vec3::Lerp(vec3(lookup_positions_[index]),
+                    vec3(lookup_positions_[next]), fraction);
+}
+
+vec3 Rail::Direction(float time) const {
+  if (!HasLookupTable()) {
+    // Difference over roughly one spline granularity.
+    const vec3 delta = PositionCalculatedSlowly(time + kSplineGranularity) -
+                       PositionCalculatedSlowly(time - kSplineGranularity);
+    return delta.LengthSquared() > 0.0f ? delta.Normalized()
+                                        : mathfu::kAxisY3f;
+  }
+  float fraction;
+  const size_t index = LookupIndex(time, &fraction);
+  const size_t next = std::min(index + 1, lookup_directions_.size() - 1);
+  const vec3 direction = vec3::Lerp(vec3(lookup_directions_[index]),
+                                    vec3(lookup_directions_[next]), fraction);
+  return direction.LengthSquared() > 0.0f ? direction.Normalized()
+                                          : vec3(lookup_directions_[index]);
+}
+
+float Rail::Distance(float time) const {
+  assert(HasLookupTable());
+  float fraction;
+  const size_t index = LookupIndex(time, &fraction);
+  const size_t next = std::min(index + 1, lookup_distances_.size() - 1);
+  return mathfu::Lerp(lookup_distances_[index], lookup_distances_[next],
+                      fraction);
 }
 
 Rail *RailManager::GetRail(RailId rail_file) {
   if (rail_map.find(rail_file) == rail_map.end()) {
     // New rail, so we load it up:
-    std::string rail_def_source;
-    if (!fplbase::LoadFile(rail_file.c_str(), &rail_def_source)) {
+    MappedFile rail_def_file;
+    if (!MapFile(rail_file.c_str(), &rail_def_file)) {
       return nullptr;
     }
-    const RailDef *rail_def = GetRailDef(rail_def_source.c_str());
+    const RailDef *rail_def = GetRailDef(rail_def_file.data());
     rail_map[rail_file] = std::unique_ptr<Rail>(new Rail());
-    rail_map[rail_file]->Initialize(rail_def, kSplineGranularity);
+    rail_map[rail_file]->Initialize(rail_def, kSplineGranularity,
+                                    kRailLookupDeltaTime);
   }
   return rail_map[rail_file].get();
 }
 
 Rail *RailManager::GetRailFromComponents(const char *rail_name,
                                          corgi::EntityManager *entity_manager) {
-  std::map<float, corgi::EntityRef> rail_entities;
-
   auto *rail_component = entity_manager->GetComponent<RailNodeComponent>();
-  for (auto i = rail_component->begin(); i != rail_component->end(); ++i) {
-    if (i->data.rail_name == rail_name) {
-      rail_entities[i->data.ordering] = i->entity;
-    }
-  }
+  const std::vector<corgi::EntityRef> *rail_entities =
+      rail_component->RailNodes(rail_name);
 
-  if (rail_entities.size() == 0) {
+  if (rail_entities == nullptr) {
     fplbase::LogInfo(
         "RailManager: No RailNode entities with rail_name '%s' found",
         rail_name);
     return nullptr;  // invalid rail name
   }
 
-  std::vector<vec3_packed> positions;
-  const RailNodeData *first_data =
-      rail_component->GetComponentData(rail_entities.begin()->second);
   // Extract the total time and reliable distance from the first-listed
-  // RailNode for this rail name.
-  float total_time = first_data->total_time;
-  float reliable_distance = first_data->reliable_distance;
-  bool wraps = first_data->wraps;
-  positions.resize(rail_entities.size() + (wraps ? 1 : 0));
+  // RailNode for this rail name. The nodes are kept sorted by ordering.
+  RailSource source;
+  const RailNodeData *first_data =
+      rail_component->GetComponentData(rail_entities->front());
+  source.total_time = first_data->total_time;
+  source.reliable_distance = first_data->reliable_distance;
+  source.wraps = first_data->wraps;
+  source.positions.reserve(rail_entities->size() + (source.wraps ? 1 : 0));
 
   auto *transform_component =
       entity_manager
           ->GetComponent<corgi::component_library::TransformComponent>();
-  // map will sort by the key
-  int i = 0;
-  for (auto iter = rail_entities.begin(); iter != rail_entities.end(); ++iter) {
-    positions[i++] = transform_component->WorldPosition(iter->second);
+  for (auto iter = rail_entities->begin(); iter != rail_entities->end();
+       ++iter) {
+    source.positions.push_back(transform_component->WorldPosition(*iter));
   }
-  if (wraps) {
+  if (source.wraps) {
     // Repeat the first node at the end so we loop.
-    positions[i] =
-        transform_component->WorldPosition(rail_entities.begin()->second);
+    source.positions.push_back(source.positions.front());
+  }
+
+  // If none of the nodes have changed since the rail was last built, the
+  // existing rail is still good, and nothing using it needs to be updated.
+  auto old_rail = rail_map.find(rail_name);
+  auto old_source = rail_sources_.find(rail_name);
+  if (old_rail != rail_map.end() && old_source != rail_sources_.end() &&
+      old_source->second == source) {
+    return old_rail->second.get();
   }
 
   // Create a new rail with the requested positions.
   Rail *new_rail = new Rail();
   new_rail->InitializeFromPositions(
-      positions, kSplineGranularity, reliable_distance, total_time, wraps);
+      source.positions, kSplineGranularity, source.reliable_distance,
+      source.total_time, source.wraps, kRailLookupDeltaTime);
 
   // Update anything that may be using the old rail.
-  auto old_rail = rail_map.find(rail_name);
   if (old_rail != rail_map.end()) {
     auto *rail_denizen_component =
         entity_manager->GetComponent<RailDenizenComponent>();
     rail_denizen_component->ChangeRail(old_rail->second.get(), new_rail);
   }
 
-  // Cache this until we request the rail from these components again.
+  // Cache this until the nodes change.
   rail_map[rail_name] = std::unique_ptr<Rail>(new_rail);
+  rail_sources_[rail_name] = std::move(source);
   return new_rail;
 }
 
-void RailManager::Clear() { rail_map.clear(); }
+bool RailManager::RailSource::operator==(const RailSource &other) const {
+  if (total_time != other.total_time ||
+      reliable_distance != other.reliable_distance || wraps != other.wraps ||
+      positions.size() != other.positions.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < positions.size(); ++i) {
+    const vec3 a(positions[i]);
+    const vec3 b(other.positions[i]);
+    if (a.x != b.x || a.y != b.y || a.z != b.z) return false;
+  }
+  return true;
+}
+
+void RailManager::Clear() {
+  rail_map.clear();
+  rail_sources_.clear();
+}
 
 }  // zooshi
 }  // fpl
@@ -15,8 +15,10 @@
 #ifndef RAILMANAGER_H
 #define RAILMANAGER_H
 
+#include <assert.h>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include "components_generated.h"
 #include "corgi/entity_manager.h"
 #include "mathfu/glsl_mappings.h"
@@ -30,14 +32,19 @@ typedef std::string RailId;
 
 class Rail {
  public:
-  Rail() : splines_(nullptr), wraps_(true) {}
+  Rail() : splines_(nullptr), wraps_(true), lookup_delta_time_(0.0f) {}
   ~Rail() { motive::CompactSpline::DestroyArray(splines_, kDimensions); }
 
-  void Initialize(const RailDef* rail_def, float spline_granularity);
+  /// If `lookup_delta_time` is positive, the rail is also sampled every
+  /// `lookup_delta_time` into a lookup table, which Position(), Direction()
+  /// and Distance() interpolate.
+  void Initialize(const RailDef* rail_def, float spline_granularity,
+                  float lookup_delta_time);
 
   /// Return vector of `positions` that is the rail evaluated every `delta_time`
   /// for the entire course of the rail. This calculation is much faster than
-  /// calling PositionCalculatedSlowly() multiple times.
+  /// calling PositionCalculatedSlowly() multiple times. If the rail has a
+  /// lookup table, the positions are interpolated from it.
   void Positions(float delta_time,
                  std::vector<mathfu::vec3_packed>* positions) const;
 
@@ -46,6 +53,26 @@ class Rail {
   /// calling Positions() above instead.
   mathfu::vec3 PositionCalculatedSlowly(float time) const;
 
+  /// Return the rail position at `time`. Cheap if the rail has a lookup
+  /// table, otherwise the same as PositionCalculatedSlowly().
+  mathfu::vec3 Position(float time) const;
+
+  /// Return the normalized direction of travel at `time`.
+  mathfu::vec3 Direction(float time) const;
+
+  /// Return the distance travelled along the rail by `time`. Requires a
+  /// lookup table.
+  float Distance(float time) const;
+
+  /// Total distance along the rail. Requires a lookup table.
+  float Length() const {
+    assert(HasLookupTable());
+    return lookup_distances_.back();
+  }
+
+  /// Was the rail initialized with a lookup table.
+  bool HasLookupTable() const { return !lookup_positions_.empty(); }
+
   /// Length of the rail.
   float EndTime() const { return splines_->EndX(); }
 
@@ -55,7 +82,13 @@ class Rail {
   void InitializeFromPositions(
       const std::vector<mathfu::vec3_packed>& positions,
       float spline_granularity, float reliable_distance, float total_time,
-      bool wraps);
+      bool wraps, float lookup_delta_time);
+
+  /// Initialize from spline nodes baked by build_assets.py. The nodes are
+  /// read straight out of the flatbuffer, so there's no curve fitting and no
+  /// intermediate copy.
+  void InitializeFromBaked(const BakedRail& baked, float spline_granularity,
+                           bool wraps, float lookup_delta_time);
 
   /// Does the rail wrap around to itself at the end.
   bool wraps() const { return wraps_; }
@@ -63,6 +96,12 @@ class Rail {
  private:
   static const motive::MotiveDimension kDimensions = 3;
 
+  void BuildLookupTable(float delta_time);
+
+  // Find the lookup table sample at or before `time`, and how far `time` is
+  // towards the next sample, from 0 to 1.
+  size_t LookupIndex(float time, float* fraction) const;
+
   motive::CompactSpline* Spline(int idx) { return splines_->NextAtIdx(idx); }
   const motive::CompactSpline* Spline(int idx) const {
     return const_cast<Rail*>(this)->Spline(idx);
@@ -73,6 +112,13 @@ class Rail {
 
   // Does the rail wrap around to itself at the end.
   bool wraps_;
+
+  // The rail sampled every `lookup_delta_time_`, plus a final sample at
+  // EndTime(). Empty if the rail was initialized without a lookup table.
+  float lookup_delta_time_;
+  std::vector<mathfu::vec3_packed> lookup_positions_;
+  std::vector<mathfu::vec3_packed> lookup_directions_;
+  std::vector<float> lookup_distances_;
 };
 
 // Class for handling loading and storing of rails.
@@ -84,13 +130,25 @@ class RailManager {
   Rail* GetRail(RailId rail_file);
 
   // Returns the data for a rail specified by RailNodeComponent entities.
+  // The rail is only rebuilt if its nodes have changed since the last call.
   Rail* GetRailFromComponents(const char* rail_name,
                               corgi::EntityManager* entity_manager);
 
   void Clear();
 
  private:
+  // The node positions and settings that a rail from components was built
+  // from.
+  struct RailSource {
+    bool operator==(const RailSource& other) const;
+    std::vector<mathfu::vec3_packed> positions;
+    float total_time;
+    float reliable_distance;
+    bool wraps;
+  };
+
   std::unordered_map<RailId, std::unique_ptr<Rail>> rail_map;
+  std::unordered_map<RailId, RailSource> rail_sources_;
 };
 
 }  // zooshi
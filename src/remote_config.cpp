@@ -14,6 +14,8 @@
 
 #include "remote_config.h"
 
+#include <atomic>
+
 #include "mathfu/internal/disable_warnings_begin.h"
 
 #include "firebase/future.h"
@@ -26,9 +28,16 @@
 namespace fpl {
 namespace zooshi {
 
-// Ordinarily a longer cache time would be recommended, but for development
-// a shorter one is helpful.
-const int kRemoteConfigCacheTime = 0;
+// How long fetched values are kept before the service is asked again, in
+// seconds. A fetch within this time is answered from the cache.
+const int kRemoteConfigCacheTime = 12 * 60 * 60;
+// How often UpdateRemoteConfig() fetches, in milliseconds.
+const int kRemoteConfigRefreshTime = kRemoteConfigCacheTime * 1000;
+
+// Set while a fetch is in flight. Cleared on the thread it completes on.
+static std::atomic<bool> fetch_pending(false);
+// Milliseconds since the last fetch was started.
+static int time_since_fetch = 0;
 
 const char* kConfigRewardedVideoLocation = "rewarded_video_location";
 // The lookup keys for menu labels.
@@ -37,9 +46,21 @@ const char* kConfigMenuSendInvite = "menu_send_invite";
 const char* kConfigMenuOfferVideo = "menu_offer_video";
 
 // Can't use this lambda on Visual Studio 2010, so make a function.
-void FetchCompletion(const firebase::Future<void>& /*completed_future*/,
+// What was fetched is kept by the service, and activated at the next launch.
+void FetchCompletion(const firebase::Future<void>& completed_future,
                      void* /*data*/) {
-  firebase::remote_config::ActivateFetched();
+  if (completed_future.Error()) {
+    fplbase::LogError("Failed to fetch remote config: %s",
+                      completed_future.ErrorMessage());
+  }
+  fetch_pending = false;
+}
+
+static void FetchRemoteConfig() {
+  fetch_pending = true;
+  time_since_fetch = 0;
+  firebase::remote_config::Fetch(kRemoteConfigCacheTime).OnCompletion(
+      FetchCompletion, nullptr);
 }
 
 void InitializeRemoteConfig(const firebase::App& app) {
@@ -57,8 +78,18 @@ void InitializeRemoteConfig(const firebase::App& app) {
   size_t default_count = sizeof(defaults) / sizeof(defaults[0]);
   firebase::remote_config::SetDefaults(defaults, default_count);
 
-  firebase::remote_config::Fetch(kRemoteConfigCacheTime).OnCompletion(
-      FetchCompletion, nullptr);
+  // Use whatever the last session fetched straight away, rather than waiting
+  // on a round trip before the menus are right.
+  firebase::remote_config::ActivateFetched();
+  FetchRemoteConfig();
+}
+
+void UpdateRemoteConfig(int delta_time) {
+  if (fetch_pending) return;
+  time_since_fetch += delta_time;
+  if (time_since_fetch >= kRemoteConfigRefreshTime) {
+    FetchRemoteConfig();
+  }
 }
 
 }  // zooshi
@@ -28,8 +28,14 @@ extern const char* kConfigMenuPlayGame;
 extern const char* kConfigMenuSendInvite;
 extern const char* kConfigMenuOfferVideo;
 
+// Activate the values fetched in the last session, so the menus have them
+// without waiting on the network, and start fetching for the next session.
 void InitializeRemoteConfig(const firebase::App& app);
 
+// Fetch again in the background once the cache has expired. Fetched values
+// are activated at the next launch, so labels never change under the player.
+void UpdateRemoteConfig(int delta_time);
+
 }  // zooshi
 }  // fpl
 
@@ -0,0 +1,241 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "render_culler.h"
+
+#include <algorithm>
+#include <cmath>
+#include "components/patron.h"
+#include "components/player.h"
+#include "components/player_projectile.h"
+#include "components/rail_denizen.h"
+#include "components/scenery.h"
+#include "components/simple_movement.h"
+#include "corgi_component_library/animation.h"
+#include "corgi_component_library/transform.h"
+#include "profiler.h"
+
+using corgi::component_library::AnimationData;
+using corgi::component_library::RenderMeshComponent;
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+
+namespace fpl {
+namespace zooshi {
+
+// Distances are compared squared, so this stays well short of overflowing.
+static const float kNoCullDistance = 1e15f;
+
+void RenderCuller::Initialize(const RenderConfig* config,
+                              fplbase::AssetManager* asset_manager,
+                              corgi::EntityManager* entity_manager) {
+  entity_manager_ = entity_manager;
+  config_ = config;
+  view_cull_distance_ = config->cull_distance();
+  shadow_cull_distance_ = config->shadow_cull_distance() > 0.0f
+                              ? config->shadow_cull_distance()
+                              : kNoCullDistance;
+
+  non_casters_.clear();
+  auto names = config->non_shadow_casters();
+  if (names != nullptr) {
+    for (auto it = names->begin(); it != names->end(); ++it) {
+      const fplbase::Mesh* mesh = asset_manager->FindMesh(it->c_str());
+      if (mesh != nullptr) non_casters_.push_back(mesh);
+    }
+  }
+  std::sort(non_casters_.begin(), non_casters_.end());
+}
+
+void RenderCuller::FitToFog(const corgi::CameraInterface& camera) {
+  view_cull_distance_ = config_->cull_distance();
+  const float fog_distance = FogHiddenDistance(config_, camera);
+  if (fog_distance > 0.0f) {
+    view_cull_distance_ = std::min(view_cull_distance_, fog_distance);
+  }
+}
+
+float RenderCuller::FogHiddenDepth(const RenderConfig* config,
+                                   float near_plane, float far_plane) {
+  if (config->fog_max_saturation() < 1.0f || config->fog_max_dist() <= 0.0f) {
+    return 0.0f;
+  }
+  // The fog shaders measure depth as clip space z * w, which for a point
+  // `depth` in front of the camera is (a * depth - b) * depth.
+  const float a = (far_plane + near_plane) / (far_plane - near_plane);
+  const float b = 2.0f * far_plane * near_plane / (far_plane - near_plane);
+  return (b + std::sqrt(b * b + 4.0f * a * config->fog_max_dist())) /
+         (2.0f * a);
+}
+
+float RenderCuller::FogHiddenDistance(const RenderConfig* config,
+                                      const corgi::CameraInterface& camera) {
+  const float depth = FogHiddenDepth(config, camera.viewport_near_plane(),
+                                     camera.viewport_far_plane());
+  if (depth <= 0.0f) return 0.0f;
+
+  // Points off to the side are farther away than their depth, by up to the
+  // frustum's corners.
+  const float tan_y = std::tan(camera.viewport_angle() * 0.5f);
+  const mathfu::vec2 resolution = camera.viewport_resolution();
+  const float tan_x =
+      resolution.y > 0.0f ? tan_y * resolution.x / resolution.y : tan_y;
+  return depth * std::sqrt(1.0f + tan_x * tan_x + tan_y * tan_y);
+}
+
+bool RenderCuller::CastsShadows(const fplbase::Mesh* mesh) const {
+  return !std::binary_search(non_casters_.begin(), non_casters_.end(), mesh);
+}
+
+bool RenderCuller::IsDynamic(corgi::EntityRef entity) const {
+  while (entity) {
+    if (entity_manager_->GetComponentData<RailDenizenData>(entity) ||
+        entity_manager_->GetComponentData<PatronData>(entity) ||
+        entity_manager_->GetComponentData<PlayerData>(entity) ||
+        entity_manager_->GetComponentData<PlayerProjectileData>(entity) ||
+        entity_manager_->GetComponentData<SimpleMovementData>(entity)) {
+      return true;
+    }
+    // Scenery stays put once it's shown, unless it turns to face the raft.
+    // It only moves while popping in or out, or playing an animation.
+    const SceneryData* scenery_data =
+        entity_manager_->GetComponentData<SceneryData>(entity);
+    if (scenery_data != nullptr &&
+        (scenery_data->state == kSceneryAppear ||
+         scenery_data->state == kSceneryDisappear ||
+         scenery_data->move_state != kSceneryMoveStateStatic)) {
+      return true;
+    }
+    const AnimationData* anim_data =
+        entity_manager_->GetComponentData<AnimationData>(entity);
+    if (anim_data != nullptr && anim_data->motivator.Valid() &&
+        anim_data->motivator.TimeRemaining() > 0) {
+      return true;
+    }
+    const TransformData* transform_data =
+        entity_manager_->GetComponentData<TransformData>(entity);
+    if (transform_data == nullptr) break;
+    entity = transform_data->parent;
+  }
+  return false;
+}
+
+// Scrambles `key`, so that a sum of these is an order independent hash of a
+// set of keys.
+static uint64_t MixBits(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+void RenderCuller::CullForShadows(RenderMeshComponent* render_mesh_component,
+                                  const corgi::CameraInterface& light_camera,
+                                  ShadowCasters casters) {
+  ProfileScope scope("CullForShadows");
+
+  // Hide whatever doesn't cast shadows, or isn't wanted this time, while the
+  // lists are built, rather than drawing it into the shadow map for nothing.
+  hidden_.clear();
+  static_caster_hash_ = 0;
+  for (auto iter = render_mesh_component->begin();
+       iter != render_mesh_component->end(); ++iter) {
+    RenderMeshData& data = iter->data;
+    if (!data.visible) continue;
+    bool keep = CastsShadows(data.mesh);
+    if (keep) {
+      const bool dynamic = IsDynamic(iter->entity);
+      if (!dynamic) {
+        static_caster_hash_ += MixBits(
+            reinterpret_cast<uintptr_t>(iter->entity.ToPointer()) ^
+            MixBits(reinterpret_cast<uintptr_t>(data.mesh)));
+      }
+      keep = casters == kAllShadowCasters ||
+             dynamic == (casters == kDynamicShadowCasters);
+    }
+    if (!keep) {
+      data.visible = false;
+      hidden_.push_back(iter->entity);
+    }
+  }
+
+  // The light's camera frustum culls everything outside the shadow map.
+  render_mesh_component->SetCullDistance(shadow_cull_distance_);
+  render_mesh_component->RenderPrep(light_camera);
+  render_mesh_component->SetCullDistance(view_cull_distance_);
+
+  for (auto it = hidden_.begin(); it != hidden_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(*it);
+    if (data != nullptr) data->visible = true;
+  }
+}
+
+bool RenderCuller::MayBeInView(const RenderMeshData& data,
+                               const mathfu::mat4& world_transform,
+                               const corgi::CameraInterface& camera) const {
+  const mathfu::vec3 to_mesh =
+      world_transform.TranslationVector3D() - camera.position();
+  if ((data.culling_mask & corgi::CullingTest_Distance) &&
+      to_mesh.LengthSquared() > view_cull_distance_ * view_cull_distance_) {
+    return false;
+  }
+  if ((data.culling_mask & corgi::CullingTest_ViewAngle) &&
+      data.mesh != nullptr) {
+    // Only meshes entirely behind the camera are culled.
+    const float scale = std::max(
+        std::max(world_transform.GetColumn(0).xyz().Length(),
+                 world_transform.GetColumn(1).xyz().Length()),
+        world_transform.GetColumn(2).xyz().Length());
+    const float radius =
+        0.5f * scale *
+        (data.mesh->max_position() - data.mesh->min_position()).Length();
+    if (mathfu::vec3::DotProduct(to_mesh, camera.facing()) < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RenderCuller::HideUnseen(RenderMeshComponent* render_mesh_component,
+                              const RailVisibility& visibility) {
+  unseen_.clear();
+  const std::vector<corgi::EntityRef>& meshes = visibility.hidden_meshes();
+  for (auto it = meshes.begin(); it != meshes.end(); ++it) {
+    if (!it->IsValid()) continue;
+    RenderMeshData* data = render_mesh_component->GetComponentData(*it);
+    if (data == nullptr || !data->visible) continue;
+    data->visible = false;
+    unseen_.push_back(*it);
+  }
+}
+
+void RenderCuller::ShowUnseen(RenderMeshComponent* render_mesh_component) {
+  for (auto it = unseen_.begin(); it != unseen_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(*it);
+    if (data != nullptr) data->visible = true;
+  }
+  unseen_.clear();
+}
+
+void RenderCuller::CullForView(RenderMeshComponent* render_mesh_component,
+                               const corgi::CameraInterface& camera) {
+  ProfileScope scope("CullForView");
+  render_mesh_component->SetCullDistance(view_cull_distance_);
+  render_mesh_component->RenderPrep(camera);
+}
+
+}  // zooshi
+}  // fpl
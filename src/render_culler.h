@@ -0,0 +1,132 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RENDER_CULLER_H_
+#define ZOOSHI_RENDER_CULLER_H_
+
+#include <stdint.h>
+#include <vector>
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/camera_interface.h"
+#include "corgi_component_library/rendermesh.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/mesh.h"
+#include "mathfu/glsl_mappings.h"
+#include "rail_visibility.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Builds RenderMeshComponent's render lists separately for each camera that
+// draws the world, keeping only what that camera can actually see. The
+// shadow map gets the shadow casters in the light's view, and the main view
+// gets what's in its frustum and not lost in the fog.
+class RenderCuller {
+ public:
+  // Which shadow casters CullForShadows() keeps.
+  enum ShadowCasters {
+    kAllShadowCasters,
+    kStaticShadowCasters,
+    kDynamicShadowCasters
+  };
+
+  RenderCuller()
+      : entity_manager_(nullptr),
+        config_(nullptr),
+        view_cull_distance_(0.0f),
+        shadow_cull_distance_(0.0f),
+        static_caster_hash_(0) {}
+
+  void Initialize(const RenderConfig* config,
+                  fplbase::AssetManager* asset_manager,
+                  corgi::EntityManager* entity_manager);
+
+  // Prepare the render lists for drawing the shadow map from `light_camera`,
+  // with only the `casters` asked for.
+  void CullForShadows(
+      corgi::component_library::RenderMeshComponent* render_mesh_component,
+      const corgi::CameraInterface& light_camera, ShadowCasters casters);
+
+  // Pull the view's cull distance in to where fully saturated fog hides
+  // everything from `camera`. Call before culling anything for it.
+  void FitToFog(const corgi::CameraInterface& camera);
+
+  // Depth in front of a camera with these clip planes past which fully
+  // saturated fog hides everything, or 0 if the fog never does.
+  static float FogHiddenDepth(const RenderConfig* config, float near_plane,
+                              float far_plane);
+
+  // Like FogHiddenDepth(), but the distance in any direction `camera` sees.
+  static float FogHiddenDistance(const RenderConfig* config,
+                                 const corgi::CameraInterface& camera);
+
+  // Prepare the render lists for drawing the world from `camera`.
+  void CullForView(
+      corgi::component_library::RenderMeshComponent* render_mesh_component,
+      const corgi::CameraInterface& camera);
+
+  // Hide the rendermeshes `visibility` says can't be seen from where the
+  // raft is, until ShowUnseen(). They still cast shadows. Call before
+  // collecting anything for the main view.
+  void HideUnseen(
+      corgi::component_library::RenderMeshComponent* render_mesh_component,
+      const RailVisibility& visibility);
+
+  // Show what HideUnseen() hid, once the main view's render lists are built.
+  void ShowUnseen(
+      corgi::component_library::RenderMeshComponent* render_mesh_component);
+
+  // False for meshes in the config's non_shadow_casters list.
+  bool CastsShadows(const fplbase::Mesh* mesh) const;
+
+  // True if `entity`, or anything it's attached to, can move or change shape
+  // on its own, so its shadow can't be cached. Idle scenery is static; when
+  // it starts or stops animating, the set of static casters changes, and the
+  // cached map is rebuilt.
+  bool IsDynamic(corgi::EntityRef entity) const;
+
+  // False if RenderMeshComponent would certainly cull, from `camera`, a mesh
+  // with `data` placed at `world_transform`. For meshes drawn outside its
+  // render lists. Cheaper, and a little more generous, than its own tests.
+  bool MayBeInView(const corgi::component_library::RenderMeshData& data,
+                   const mathfu::mat4& world_transform,
+                   const corgi::CameraInterface& camera) const;
+
+  // How far from the camera the main view culls, as of the last FitToFog().
+  float view_cull_distance() const { return view_cull_distance_; }
+
+  // A hash of the visible shadow casters that were static, and their meshes,
+  // at the last CullForShadows(). It changes whenever one appears or goes
+  // away, even if another takes its place.
+  uint64_t static_caster_hash() const { return static_caster_hash_; }
+
+ private:
+  corgi::EntityManager* entity_manager_;
+  const RenderConfig* config_;
+  float view_cull_distance_;
+  float shadow_cull_distance_;
+  // Sorted, for binary searching.
+  std::vector<const fplbase::Mesh*> non_casters_;
+  // Entities hidden while culling for the shadow map.
+  std::vector<corgi::EntityRef> hidden_;
+  // Entities hidden by HideUnseen().
+  std::vector<corgi::EntityRef> unseen_;
+  uint64_t static_caster_hash_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RENDER_CULLER_H_
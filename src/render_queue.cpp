@@ -0,0 +1,355 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "render_queue.h"
+
+#include <string.h>
+#include <algorithm>
+#include "corgi_component_library/transform.h"
+#include "fplbase/mesh.h"
+#include "profiler.h"
+
+using corgi::component_library::RenderMeshComponent;
+using corgi::component_library::RenderMeshData;
+using corgi::component_library::TransformData;
+using mathfu::mat4;
+using mathfu::vec3;
+using mathfu::vec4;
+
+namespace fpl {
+namespace zooshi {
+
+// Sort key layout, from the most significant bit: render pass, shader, mesh
+// (which decides the material and textures), then depth.
+static const int kPassShift = 62;
+static const int kShaderShift = 48;
+static const int kMeshShift = 32;
+static const uint64_t kShaderMask = (1 << 14) - 1;
+static const uint64_t kMeshMask = (1 << 16) - 1;
+
+// Non-negative floats sort the same as their bit patterns.
+static uint64_t DepthBits(float depth) {
+  depth = std::max(depth, 0.0f);
+  uint32_t bits;
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits;
+}
+
+// Shader::SetUniform() takes arrays, and mathfu vectors may be padded.
+static void SetUniform(fplbase::Shader* shader, fplbase::UniformHandle handle,
+                       const vec3& value) {
+  if (!fplbase::ValidUniformHandle(handle)) return;
+  const float values[] = {value.x(), value.y(), value.z()};
+  shader->SetUniform(handle, values, 3);
+}
+
+static void SetUniform(fplbase::Shader* shader, fplbase::UniformHandle handle,
+                       const vec4& value) {
+  if (!fplbase::ValidUniformHandle(handle)) return;
+  const float values[] = {value.x(), value.y(), value.z(), value.w()};
+  shader->SetUniform(handle, values, 4);
+}
+
+static void SetUniform(fplbase::Shader* shader, fplbase::UniformHandle handle,
+                       const mat4& value) {
+  if (!fplbase::ValidUniformHandle(handle)) return;
+  shader->SetUniform(handle, &value[0], 16);
+}
+
+void RenderQueue::Initialize(const RenderConfig* config,
+                             corgi::EntityManager* entity_manager) {
+  config_ = config;
+  entity_manager_ = entity_manager;
+}
+
+void RenderQueue::ResetShaders(fplbase::AssetManager* asset_manager) {
+  handles_.clear();
+  for (auto it = commands_.begin(); it != commands_.end(); ++it) {
+    it->handles = nullptr;
+  }
+  for (auto it = depth_commands_.begin(); it != depth_commands_.end(); ++it) {
+    it->handles = nullptr;
+  }
+  skinned_shaders_.clear();
+  asset_manager->ForEachShaderWithDefine(
+      "SKINNED",
+      [&](fplbase::Shader* shader) { skinned_shaders_.push_back(shader); });
+  std::sort(skinned_shaders_.begin(), skinned_shaders_.end());
+
+  prepass_shaders_.clear();
+#ifdef __ANDROID__
+  const bool prepass = config_ != nullptr && config_->depth_prepass_mobile();
+#else
+  const bool prepass = config_ != nullptr && config_->depth_prepass();
+#endif  // __ANDROID__
+  if (prepass && config_->depth_prepass_shaders() != nullptr) {
+    auto names = config_->depth_prepass_shaders();
+    for (auto it = names->begin(); it != names->end(); ++it) {
+      const fplbase::Shader* shader = asset_manager->FindShader(it->c_str());
+      if (shader != nullptr) prepass_shaders_.push_back(shader);
+    }
+  }
+  std::sort(prepass_shaders_.begin(), prepass_shaders_.end());
+}
+
+bool RenderQueue::Prepassed(const fplbase::Shader* shader) const {
+  return std::binary_search(prepass_shaders_.begin(), prepass_shaders_.end(),
+                            shader);
+}
+
+uint64_t RenderQueue::Id(const void* pointer) {
+  auto it = ids_.find(pointer);
+  if (it != ids_.end()) return it->second;
+  const uint64_t id = ids_.size();
+  ids_[pointer] = id;
+  return id;
+}
+
+const RenderQueue::ShaderHandles& RenderQueue::Handles(
+    fplbase::Shader* shader) {
+  auto it = handles_.find(shader);
+  if (it != handles_.end()) return it->second;
+  ShaderHandles& handles = handles_[shader];
+  handles.model_view_projection = shader->FindUniform("model_view_projection");
+  handles.model = shader->FindUniform("model");
+  handles.color = shader->FindUniform("color");
+  handles.light_pos = shader->FindUniform("light_pos");
+  handles.camera_pos = shader->FindUniform("camera_pos");
+  return handles;
+}
+
+void RenderQueue::Collect(RenderMeshComponent* render_mesh_component,
+                          const corgi::CameraInterface& camera,
+                          const RenderCuller& culler) {
+  ProfileScope scope("CollectRenderQueue");
+  entries_.clear();
+  ids_.clear();
+
+  const uint64_t pass = corgi::RenderPass_Opaque;
+  for (auto iter = render_mesh_component->begin();
+       iter != render_mesh_component->end(); ++iter) {
+    const RenderMeshData& data = iter->data;
+    if (!data.visible || data.mesh == nullptr ||
+        data.pass_mask != 1 << pass || data.shaders.empty()) {
+      continue;
+    }
+    const fplbase::Shader* shader = data.shaders[ShaderIndex_Lit];
+    if (shader == nullptr ||
+        std::binary_search(skinned_shaders_.begin(), skinned_shaders_.end(),
+                           shader)) {
+      continue;
+    }
+    const TransformData* transform_data =
+        entity_manager_->GetComponentData<TransformData>(iter->entity);
+    if (transform_data == nullptr) continue;
+    const mat4& world_transform = transform_data->world_transform;
+    if (!culler.MayBeInView(data, world_transform, camera)) continue;
+
+    // Opaque meshes are drawn front to back, so the depth test rejects as
+    // much as possible.
+    const float depth = vec3::DotProduct(
+        world_transform.TranslationVector3D() - camera.position(),
+        camera.facing());
+    Entry entry;
+    entry.key = pass << kPassShift |
+                (Id(shader) & kShaderMask) << kShaderShift |
+                (Id(data.mesh) & kMeshMask) << kMeshShift | DepthBits(depth);
+    entry.entity = iter->entity;
+    entries_.push_back(entry);
+  }
+  std::sort(entries_.begin(), entries_.end());
+  Record();
+  HideCollected(render_mesh_component);
+}
+
+void RenderQueue::Record() {
+  draws_.clear();
+  commands_.clear();
+  depth_commands_.clear();
+  const fplbase::Shader* shader = nullptr;
+  const fplbase::Shader* depth_shader = nullptr;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    const RenderMeshData* data =
+        entity_manager_->GetComponentData<RenderMeshData>(it->entity);
+    const TransformData* transform_data =
+        entity_manager_->GetComponentData<TransformData>(it->entity);
+    DrawUniforms draw;
+    draw.world_transform = transform_data->world_transform;
+    draw.world_transform_inverse = draw.world_transform.Inverse();
+    draw.tint = data->tint;
+    draws_.push_back(draw);
+
+    fplbase::Shader* lit_shader = data->shaders[ShaderIndex_Lit];
+    const bool prepassed = Prepassed(lit_shader);
+    if (lit_shader != shader) {
+      // Meshes are sorted by shader, so the depth test only changes between
+      // runs of them. Prepassed meshes already have their depth drawn.
+      if (HasDepthPrepass()) {
+        Command command;
+        command.type = kCommandDepthFunction;
+        command.depth_function = prepassed ? fplbase::kDepthFunctionEqual
+                                           : fplbase::kDepthFunctionLess;
+        commands_.push_back(command);
+      }
+      AddBind(lit_shader, &commands_);
+      shader = lit_shader;
+    }
+    AddDraw(data->mesh, draws_.size() - 1, &commands_);
+
+    // The depth pass only draws prepassed meshes that have a depth shader.
+    if (!prepassed ||
+        data->shaders.size() <= static_cast<size_t>(ShaderIndex_Depth) ||
+        data->shaders[ShaderIndex_Depth] == nullptr) {
+      continue;
+    }
+    if (data->shaders[ShaderIndex_Depth] != depth_shader) {
+      AddBind(data->shaders[ShaderIndex_Depth], &depth_commands_);
+      depth_shader = data->shaders[ShaderIndex_Depth];
+    }
+    AddDraw(data->mesh, draws_.size() - 1, &depth_commands_);
+  }
+}
+
+void RenderQueue::AddBind(fplbase::Shader* shader,
+                          std::vector<Command>* commands) {
+  Command command;
+  command.type = kCommandBindShader;
+  command.shader = shader;
+  auto handles = handles_.find(shader);
+  command.handles = handles != handles_.end() ? &handles->second : nullptr;
+  commands->push_back(command);
+}
+
+void RenderQueue::AddDraw(fplbase::Mesh* mesh, size_t draw,
+                          std::vector<Command>* commands) {
+  Command command;
+  command.type = kCommandDraw;
+  command.mesh = mesh;
+  command.draw = draw;
+  commands->push_back(command);
+}
+
+void RenderQueue::HideCollected(RenderMeshComponent* render_mesh_component) {
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(it->entity);
+    if (data != nullptr) data->visible = false;
+  }
+}
+
+void RenderQueue::ShowCollected(RenderMeshComponent* render_mesh_component) {
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    RenderMeshData* data = render_mesh_component->GetComponentData(it->entity);
+    if (data != nullptr) data->visible = true;
+  }
+}
+
+void RenderQueue::Clear() {
+  entries_.clear();
+  draws_.clear();
+  commands_.clear();
+  depth_commands_.clear();
+}
+
+void RenderQueue::Render(int pass, const corgi::CameraInterface& camera,
+                         fplbase::Renderer& renderer,
+                         const vec3& light_position) {
+  if (pass != corgi::RenderPass_Opaque || commands_.empty()) return;
+  ProfileScope scope("DrawRenderQueue");
+
+  // Each eye draws the whole queue into its viewport in turn, rather than
+  // every mesh switching viewports and shaders twice.
+  if (!camera.IsStereo()) {
+    Replay(commands_, camera.GetTransformMatrix(), camera.position(),
+           renderer, light_position);
+  } else {
+    for (int view = 0; view < 2; ++view) {
+      renderer.SetViewport(camera.viewport(view));
+      Replay(commands_, camera.GetTransformMatrix(view),
+             camera.position(view), renderer, light_position);
+    }
+  }
+  // Prepassed meshes changed the depth test.
+  if (HasDepthPrepass()) renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+}
+
+void RenderQueue::RenderDepth(const corgi::CameraInterface& camera,
+                              fplbase::Renderer& renderer) {
+  if (depth_commands_.empty()) return;
+  ProfileScope scope("DrawDepthPrepass");
+
+  if (!camera.IsStereo()) {
+    Replay(depth_commands_, camera.GetTransformMatrix(), camera.position(),
+           renderer, mathfu::kZeros3f);
+    return;
+  }
+  for (int view = 0; view < 2; ++view) {
+    renderer.SetViewport(camera.viewport(view));
+    Replay(depth_commands_, camera.GetTransformMatrix(view),
+           camera.position(view), renderer, mathfu::kZeros3f);
+  }
+}
+
+void RenderQueue::Replay(const std::vector<Command>& commands,
+                         const mat4& view_projection,
+                         const vec3& camera_position,
+                         fplbase::Renderer& renderer,
+                         const vec3& light_position) {
+  fplbase::Shader* shader = nullptr;
+  const ShaderHandles* handles = nullptr;
+  bool bound = false;
+  for (auto it = commands.begin(); it != commands.end(); ++it) {
+    switch (it->type) {
+      case kCommandDepthFunction:
+        renderer.SetDepthFunction(it->depth_function);
+        break;
+      case kCommandBindShader:
+        shader = it->shader;
+        handles = it->handles != nullptr ? it->handles : &Handles(shader);
+        bound = false;
+        break;
+      case kCommandDraw: {
+        // Only the camera's part of the uniforms is left to work out.
+        const DrawUniforms& draw = draws_[it->draw];
+        const mat4 model_view_projection =
+            view_projection * draw.world_transform;
+        const vec3 object_light_position =
+            draw.world_transform_inverse * light_position;
+        const vec3 object_camera_position =
+            draw.world_transform_inverse * camera_position;
+        if (!bound) {
+          renderer.set_color(draw.tint);
+          renderer.set_model(draw.world_transform);
+          renderer.set_model_view_projection(model_view_projection);
+          renderer.set_light_pos(object_light_position);
+          renderer.set_camera_pos(object_camera_position);
+          shader->Set(renderer);
+          bound = true;
+        } else {
+          // The shader is still bound, so only the per-mesh uniforms change.
+          SetUniform(shader, handles->model_view_projection,
+                     model_view_projection);
+          SetUniform(shader, handles->model, draw.world_transform);
+          SetUniform(shader, handles->color, draw.tint);
+          SetUniform(shader, handles->light_pos, object_light_position);
+          SetUniform(shader, handles->camera_pos, object_camera_position);
+        }
+        it->mesh->Render(renderer);
+        break;
+      }
+    }
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,176 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RENDER_QUEUE_H_
+#define ZOOSHI_RENDER_QUEUE_H_
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/camera_interface.h"
+#include "corgi_component_library/rendermesh.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/mesh.h"
+#include "fplbase/renderer.h"
+#include "fplbase/shader.h"
+#include "mathfu/glsl_mappings.h"
+#include "render_culler.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Draws the main view's opaque meshes sorted by a 64-bit key of render pass,
+// shader, mesh and depth, rather than in the order RenderMeshComponent holds
+// them. Meshes that share a shader are drawn together, front to back, and
+// the shader is only set once for each run of them; after that only the
+// uniforms that differ per mesh are sent.
+//
+// Skinned meshes, and those drawn in the alpha pass, are left to
+// RenderMeshComponent, which already draws alpha back to front.
+//
+// Queued meshes are culled and sorted once even for stereo cameras, and each
+// eye then draws them in turn.
+//
+// Collect() runs on the update thread, in RenderPrep(), and records
+// everything about the draws that doesn't depend on the view into a command
+// list: depth test changes, shader binds, and each mesh with its world
+// transform, its inverse and its tint. The render thread only has to replay
+// the list, deriving the per-eye uniforms as it goes, without looking up any
+// component data.
+//
+// With a depth prepass, meshes drawn with the config's depth_prepass_shaders
+// can have their depth drawn first, and then only be colored where they're
+// nearest.
+class RenderQueue {
+ public:
+  RenderQueue() : entity_manager_(nullptr), config_(nullptr) {}
+
+  // The prepass is used if `config` enables it for this device.
+  void Initialize(const RenderConfig* config,
+                  corgi::EntityManager* entity_manager);
+
+  // Look up the skinned and prepass shaders, and forget each shader's
+  // uniform handles. Call whenever shaders are (re)loaded.
+  void ResetShaders(fplbase::AssetManager* asset_manager);
+
+  // True if RenderDepth() draws anything.
+  bool HasDepthPrepass() const { return !prepass_shaders_.empty(); }
+
+  // Queue the visible meshes that `culler` says `camera` may see, record
+  // the commands to draw them, and hide them from RenderMeshComponent. Needs
+  // no GL context. ShowCollected() shows them again, and HideCollected()
+  // hides them again for as long as render lists are built from `camera`.
+  void Collect(
+      corgi::component_library::RenderMeshComponent* render_mesh_component,
+      const corgi::CameraInterface& camera, const RenderCuller& culler);
+  void HideCollected(
+      corgi::component_library::RenderMeshComponent* render_mesh_component);
+  void ShowCollected(
+      corgi::component_library::RenderMeshComponent* render_mesh_component);
+
+  // Forget the queued meshes, so Render() draws nothing. Call if the meshes
+  // they were recorded with may have been deleted.
+  void Clear();
+
+  // Draw the queued meshes for `pass`, lit from `light_position` in world
+  // space. Stereo cameras draw each eye in turn.
+  void Render(int pass, const corgi::CameraInterface& camera,
+              fplbase::Renderer& renderer,
+              const mathfu::vec3& light_position);
+
+  // Draw the depth of the queued meshes that are prepassed, with their depth
+  // shader. Color writes should be off. Render() then colors them with an
+  // equal depth test.
+  void RenderDepth(const corgi::CameraInterface& camera,
+                   fplbase::Renderer& renderer);
+
+ private:
+  struct Entry {
+    uint64_t key;
+    corgi::EntityRef entity;
+    bool operator<(const Entry& other) const { return key < other.key; }
+  };
+
+  // The uniforms Shader::Set() sends that differ for each mesh.
+  struct ShaderHandles {
+    fplbase::UniformHandle model_view_projection;
+    fplbase::UniformHandle model;
+    fplbase::UniformHandle color;
+    fplbase::UniformHandle light_pos;
+    fplbase::UniformHandle camera_pos;
+  };
+
+  // A mesh's uniforms that are the same from every view.
+  struct DrawUniforms {
+    mathfu::mat4 world_transform;
+    mathfu::mat4 world_transform_inverse;
+    mathfu::vec4 tint;
+  };
+
+  enum CommandType {
+    kCommandDepthFunction,
+    // The shader is set with the uniforms of the next draw.
+    kCommandBindShader,
+    kCommandDraw,
+  };
+
+  struct Command {
+    CommandType type;
+    fplbase::DepthFunction depth_function;
+    fplbase::Shader* shader;
+    // Null if the shader's handles weren't known when it was recorded. Looking
+    // them up needs the GL context, so it's left for the render thread.
+    const ShaderHandles* handles;
+    fplbase::Mesh* mesh;
+    // Index into draws_.
+    size_t draw;
+  };
+
+  // Small, dense IDs for the key, assigned in the order they're seen each
+  // frame.
+  uint64_t Id(const void* pointer);
+  // Turn the sorted entries into commands.
+  void Record();
+  void AddBind(fplbase::Shader* shader, std::vector<Command>* commands);
+  void AddDraw(fplbase::Mesh* mesh, size_t draw,
+               std::vector<Command>* commands);
+  void Replay(const std::vector<Command>& commands,
+              const mathfu::mat4& view_projection,
+              const mathfu::vec3& camera_position,
+              fplbase::Renderer& renderer,
+              const mathfu::vec3& light_position);
+  const ShaderHandles& Handles(fplbase::Shader* shader);
+  bool Prepassed(const fplbase::Shader* shader) const;
+
+  corgi::EntityManager* entity_manager_;
+  const RenderConfig* config_;
+  std::vector<Entry> entries_;
+  std::unordered_map<const void*, uint64_t> ids_;
+  // Sorted, for binary searching.
+  std::vector<const fplbase::Shader*> skinned_shaders_;
+  std::vector<const fplbase::Shader*> prepass_shaders_;
+  std::unordered_map<const fplbase::Shader*, ShaderHandles> handles_;
+  // Recorded by Collect(). The depth prepass and the colored pass share the
+  // draws' uniforms.
+  std::vector<DrawUniforms> draws_;
+  std::vector<Command> commands_;
+  std::vector<Command> depth_commands_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RENDER_QUEUE_H_
@@ -0,0 +1,130 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "residency_cache.h"
+
+#include "config_generated.h"
+#include "corgi_component_library/rendermesh.h"
+#include "fplbase/utilities.h"
+#include "memory_tracker.h"
+
+using corgi::component_library::RenderMeshData;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+void ResidencyCache::Initialize(const MemoryConfig* config) {
+  Clear();
+  enabled_ = config != nullptr && config->keep_mesh_copies();
+  if (enabled_) CreateSentinel();
+}
+
+void ResidencyCache::CreateSentinel() {
+  GL_CALL(glGenTextures(1, &sentinel_));
+  // Names only become textures once they're bound.
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, sentinel_));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+bool ResidencyCache::Keep(const corgi::EntityRef& entity,
+                          const MeshCopy& copy) {
+  if (!enabled_ || !copy.vertices) return false;
+  Forget(entity);
+
+  MemoryTracker& tracker = MemoryTracker::Get();
+  const bool new_vertices =
+      vertex_users_.find(copy.vertices.get()) == vertex_users_.end();
+  const size_t bytes =
+      IndexBytes(copy) + (new_vertices ? copy.vertices->size() : 0);
+  const size_t budget = tracker.budget(kMemoryResidency);
+  if (budget != 0 && tracker.bytes(kMemoryResidency) + bytes > budget) {
+    return false;
+  }
+
+  tracker.Allocate(kMemoryResidency, bytes);
+  vertex_users_[copy.vertices.get()]++;
+  Entry& entry = copies_[entity.ToPointer()];
+  entry.entity = entity;
+  entry.copy = copy;
+  return true;
+}
+
+void ResidencyCache::Release(const Entry& entry) {
+  size_t bytes = IndexBytes(entry.copy);
+  auto users = vertex_users_.find(entry.copy.vertices.get());
+  if (--users->second == 0) {
+    bytes += entry.copy.vertices->size();
+    vertex_users_.erase(users);
+  }
+  MemoryTracker::Get().Free(kMemoryResidency, bytes);
+}
+
+void ResidencyCache::Forget(const corgi::EntityRef& entity) {
+  if (!entity.IsValid()) return;
+  auto it = copies_.find(entity.ToPointer());
+  if (it == copies_.end()) return;
+  Release(it->second);
+  copies_.erase(it);
+}
+
+void ResidencyCache::Clear() {
+  for (auto it = copies_.begin(); it != copies_.end(); ++it) {
+    Release(it->second);
+  }
+  copies_.clear();
+}
+
+bool ResidencyCache::ContextLost() {
+  if (!check_context_) return false;
+  check_context_ = false;
+  if (!enabled_ || glIsTexture(sentinel_)) return false;
+  // The old name means nothing in the new context, so it's not deleted.
+  CreateSentinel();
+  return true;
+}
+
+int ResidencyCache::Recover(corgi::EntityManager* entity_manager) {
+  // Every stale mesh is deleted before anything is uploaded. Deleting names
+  // the new context hasn't handed out yet does nothing, but once uploads
+  // start, they could belong to the new meshes.
+  for (auto it = copies_.begin(); it != copies_.end(); ++it) {
+    RenderMeshData* mesh_data =
+        entity_manager->GetComponentData<RenderMeshData>(it->second.entity);
+    if (mesh_data != nullptr && mesh_data->mesh != nullptr) {
+      delete mesh_data->mesh;
+      mesh_data->mesh = nullptr;
+    }
+  }
+
+  int uploaded = 0;
+  for (auto it = copies_.begin(); it != copies_.end(); ++it) {
+    RenderMeshData* mesh_data =
+        entity_manager->GetComponentData<RenderMeshData>(it->second.entity);
+    if (mesh_data == nullptr) continue;
+    const MeshCopy& copy = it->second.copy;
+    fplbase::Mesh* mesh =
+        new fplbase::Mesh(copy.vertices->data(), copy.count, copy.vertex_size,
+                          copy.format);
+    mesh->AddIndices(copy.indices.data(), static_cast<int>(copy.indices.size()),
+                     copy.material);
+    mesh_data->mesh = mesh;
+    ++uploaded;
+  }
+  LogInfo("Uploaded %d kept meshes after the GL context was lost", uploaded);
+  return uploaded;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,119 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RESIDENCY_CACHE_H_
+#define ZOOSHI_RESIDENCY_CACHE_H_
+
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "corgi/entity_manager.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/material.h"
+#include "fplbase/mesh.h"
+
+namespace fpl {
+namespace zooshi {
+
+struct MemoryConfig;
+
+// What's needed to upload a generated mesh again.
+struct MeshCopy {
+  MeshCopy()
+      : count(0), vertex_size(0), format(nullptr), material(nullptr) {}
+  // Meshes built from the same vertices, like each zone's banks in a chunk
+  // of river, share them.
+  std::shared_ptr<const std::vector<uint8_t>> vertices;
+  size_t count;
+  size_t vertex_size;
+  // Must outlive the copy, so is normally static.
+  const fplbase::Attribute* format;
+  std::vector<unsigned short> indices;
+  fplbase::Material* material;
+};
+
+// Keeps CPU copies of the meshes the game generates, such as the river's, so
+// that when Android loses the GL context they're uploaded again in one batch
+// rather than regenerated. Meshes are kept per entity, as the rendermesh
+// component holds them, within the residency memory budget. Those that don't
+// fit are left for their owner to rebuild.
+//
+// All calls must be made on the render thread.
+class ResidencyCache {
+ public:
+  ResidencyCache() : enabled_(false), sentinel_(0), check_context_(false) {}
+  ~ResidencyCache() { Clear(); }
+
+  // Turn the cache on if `config` asks for it. `config` may be null. Needs a
+  // current GL context.
+  void Initialize(const MemoryConfig* config);
+
+  bool enabled() const { return enabled_; }
+
+  // Keep `copy` for the mesh `entity`'s rendermesh was just given. Returns
+  // false if it doesn't fit in the budget.
+  bool Keep(const corgi::EntityRef& entity, const MeshCopy& copy);
+
+  // Drop the copy of `entity`'s mesh, when it's released.
+  void Forget(const corgi::EntityRef& entity);
+
+  bool Contains(const corgi::EntityRef& entity) const {
+    return copies_.find(entity.ToPointer()) != copies_.end();
+  }
+
+  void Clear();
+
+  // Check the context again on the next ContextLost(). Call when the app
+  // returns to the foreground.
+  void set_check_context() { check_context_ = true; }
+
+  // Whether the context was lost and replaced since it was last checked.
+  // Only looks when set_check_context() has been called.
+  bool ContextLost();
+
+  // Replace the mesh of every entity with a copy. Anything still holding
+  // names from the lost context must be released before this is called,
+  // since new objects may be given the same names. Returns how many meshes
+  // were uploaded.
+  int Recover(corgi::EntityManager* entity_manager);
+
+ private:
+  struct Entry {
+    corgi::EntityRef entity;
+    MeshCopy copy;
+  };
+
+  // A texture that's never used, to tell whether the context it was made in
+  // is still current.
+  void CreateSentinel();
+
+  static size_t IndexBytes(const MeshCopy& copy) {
+    return copy.indices.size() * sizeof(unsigned short);
+  }
+  void Release(const Entry& entry);
+
+  bool enabled_;
+  GLuint sentinel_;
+  bool check_context_;
+  // Keyed by the entity's data, which is stable while the entity lives.
+  std::unordered_map<const corgi::Entity*, Entry> copies_;
+  // How many kept meshes share each vertex buffer, so it's counted once.
+  std::unordered_map<const std::vector<uint8_t>*, int> vertex_users_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RESIDENCY_CACHE_H_
@@ -0,0 +1,209 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "resume_snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <vector>
+#include "fplbase/utilities.h"
+#include "services_thread.h"
+#include "world.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+ResumeSnapshot::ResumeSnapshot()
+    : services_thread_(nullptr), enabled_(false), saved_(false) {}
+
+void ResumeSnapshot::Load(const char* app_name, const char* file_name,
+                          int max_age) {
+  enabled_ = max_age > 0;
+  std::string storage_path;
+  if (!fplbase::GetStoragePath(app_name, &storage_path)) {
+    enabled_ = false;
+    return;
+  }
+  path_ = storage_path + file_name;
+
+  std::string contents;
+  if (!fplbase::LoadPreferences(path_.c_str(), &contents)) return;
+  // Whatever is there, it's only used this once.
+  saved_ = true;
+  Clear();
+  if (!enabled_) return;
+
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(contents.data()), contents.size());
+  if (!VerifyResumeDataBuffer(verifier)) {
+    LogError("Ignoring corrupt resume file %s", path_.c_str());
+    return;
+  }
+  const int64_t age =
+      static_cast<int64_t>(std::time(nullptr)) -
+      GetResumeData(contents.data())->saved_time();
+  if (age < 0 || age > max_age) return;
+  pending_.swap(contents);
+}
+
+const ResumeData* ResumeSnapshot::pending() const {
+  return pending_.empty() ? nullptr : GetResumeData(pending_.data());
+}
+
+void ResumeSnapshot::Save(World* world, double elapsed_time) {
+  if (!enabled_ || path_.empty()) return;
+  corgi::EntityRef raft = world->services_component.raft_entity();
+  const RailDenizenData* rail =
+      raft.IsValid() ? world->rail_denizen_component.GetComponentData(raft)
+                     : nullptr;
+  if (rail == nullptr || !rail->motivator.Valid() ||
+      world->player_component.begin() == world->player_component.end()) {
+    return;
+  }
+  const AttributesData* attributes =
+      world->attributes_component.GetComponentData(
+          world->player_component.begin()->entity);
+  if (attributes == nullptr) return;
+
+  flatbuffers::FlatBufferBuilder fbb;
+  auto player_attributes =
+      fbb.CreateVector(attributes->attributes, AttributeDef_Size);
+  std::map<std::string, PatronComponent::SavedPatron> saved_patrons;
+  world->patron_component.SavePatrons(&saved_patrons);
+  std::vector<flatbuffers::Offset<ResumePatron>> patron_offsets;
+  for (auto it = saved_patrons.begin(); it != saved_patrons.end(); ++it) {
+    patron_offsets.push_back(CreateResumePatron(
+        fbb, fbb.CreateString(it->first), it->second.last_lap_fed,
+        it->second.last_lap_upright));
+  }
+  auto patrons = fbb.CreateVector(patron_offsets);
+  ResumeDataBuilder builder(fbb);
+  builder.add_saved_time(static_cast<int64_t>(std::time(nullptr)));
+  builder.add_level_index(static_cast<int>(world->level_index));
+  builder.add_elapsed_time(static_cast<int>(elapsed_time * 1000.0));
+  builder.add_raft_spline_time(rail->motivator.SplineTime());
+  builder.add_raft_orientation_time(
+      rail->orientation_motivator.Valid()
+          ? rail->orientation_motivator.SplineTime()
+          : 0);
+  builder.add_raft_playback_rate(rail->PlaybackRate());
+  builder.add_raft_lap_number(rail->lap_number);
+  builder.add_raft_lap_progress(rail->lap_progress);
+  builder.add_raft_total_lap_progress(rail->total_lap_progress);
+  builder.add_player_attributes(player_attributes);
+  builder.add_patrons(patrons);
+  FinishResumeDataBuffer(fbb, builder.Finish());
+
+  saved_ = true;
+  Post(std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                   fbb.GetSize()));
+}
+
+bool ResumeSnapshot::Restore(World* world) {
+  const ResumeData* data = pending();
+  if (data == nullptr) return false;
+
+  corgi::EntityRef raft = world->services_component.raft_entity();
+  RailDenizenData* rail =
+      raft.IsValid() ? world->rail_denizen_component.GetComponentData(raft)
+                     : nullptr;
+  if (rail != nullptr && rail->motivator.Valid()) {
+    rail->motivator.SetSplineTime(data->raft_spline_time());
+    if (rail->orientation_motivator.Valid()) {
+      rail->orientation_motivator.SetSplineTime(data->raft_orientation_time());
+    }
+    rail->SetPlaybackRate(data->raft_playback_rate(), 0.0f);
+    rail->lap_number = data->raft_lap_number();
+    rail->lap_progress = data->raft_lap_progress();
+    rail->total_lap_progress = data->raft_total_lap_progress();
+  }
+
+  auto player_attributes = data->player_attributes();
+  if (player_attributes != nullptr &&
+      world->player_component.begin() != world->player_component.end()) {
+    AttributesData* attributes = world->attributes_component.GetComponentData(
+        world->player_component.begin()->entity);
+    const int count = std::min(static_cast<int>(player_attributes->size()),
+                               static_cast<int>(AttributeDef_Size));
+    for (int i = 0; attributes != nullptr && i < count; ++i) {
+      attributes->attributes[i] = player_attributes->Get(i);
+    }
+  }
+
+  if (data->patrons() != nullptr) {
+    std::map<std::string, PatronComponent::SavedPatron> saved_patrons;
+    for (auto it = data->patrons()->begin(); it != data->patrons()->end();
+         ++it) {
+      if (it->entity_id() == nullptr) continue;
+      PatronComponent::SavedPatron& saved =
+          saved_patrons[it->entity_id()->str()];
+      saved.last_lap_fed = it->last_lap_fed();
+      saved.last_lap_upright = it->last_lap_upright();
+    }
+    world->patron_component.RestorePatrons(saved_patrons);
+  }
+
+  world->gameplay_start_time -= data->elapsed_time() / 1000.0;
+  LogInfo("Resumed the game from %d seconds in",
+          data->elapsed_time() / 1000);
+  pending_.clear();
+  return true;
+}
+
+void ResumeSnapshot::Clear() {
+  pending_.clear();
+  if (!saved_ || path_.empty()) return;
+  saved_ = false;
+  Post(std::string());
+}
+
+void ResumeSnapshot::Post(const std::string& contents) {
+  if (services_thread_ == nullptr) {
+    Write(contents);
+    return;
+  }
+  // Jobs run in order, so a clear can't be overtaken by an earlier save.
+  services_thread_->Post([this, contents]() { Write(contents); });
+}
+
+// Empty `contents` deletes the snapshot.
+void ResumeSnapshot::Write(const std::string& contents) {
+  if (contents.empty()) {
+    std::remove(path_.c_str());
+    return;
+  }
+  // Write beside the snapshot, then swap it in, so a half-written one is
+  // never read.
+  const std::string temp_path = path_ + ".tmp";
+  if (!fplbase::SavePreferences(temp_path.c_str(), contents.data(),
+                                contents.size())) {
+    LogError("Couldn't write resume file %s", temp_path.c_str());
+    return;
+  }
+#ifdef _WIN32
+  // rename() won't replace an existing file on Windows.
+  std::remove(path_.c_str());
+#endif  // _WIN32
+  if (std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+    LogError("Couldn't replace resume file %s", path_.c_str());
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,84 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RESUME_SNAPSHOT_H_
+#define ZOOSHI_RESUME_SNAPSHOT_H_
+
+#include <string>
+#include "resume_data_generated.h"
+
+namespace fpl {
+namespace zooshi {
+
+class ServicesThread;
+struct World;
+
+const auto kResumeFileName = "resume_data.zooresume";
+
+// The game in progress, saved when the app goes into the background, so that
+// if Android kills the process, the next launch goes straight back into the
+// game instead of starting over from the menu. The level's entities are
+// loaded as usual. The snapshot holds what changed while playing: the
+// raft's place on its rail and its motivators' times, the player's
+// attributes, which laps each patron was fed and stood up on, and how long
+// the game had run.
+//
+// A snapshot is only used once. It's deleted when it's restored, when the
+// game it holds ends, and when the app comes back to the foreground without
+// having been killed.
+class ResumeSnapshot {
+ public:
+  ResumeSnapshot();
+
+  // Read the snapshot the last run left, if there is one, and it's no older
+  // than `max_age` seconds. A `max_age` of 0 turns snapshots off.
+  void Load(const char* app_name, const char* file_name, int max_age);
+
+  // Writes are posted here. If null, they happen on the calling thread.
+  void set_services_thread(ServicesThread* services_thread) {
+    services_thread_ = services_thread;
+  }
+
+  // The snapshot waiting to be restored, or null.
+  const ResumeData* pending() const;
+
+  // Capture the game being played in `world`, `elapsed_time` seconds in, and
+  // start writing it. Call with the update thread locked out.
+  void Save(World* world, double elapsed_time);
+
+  // Apply the pending snapshot to `world`, whose level has just been loaded
+  // and whose game has just started, then delete it. Returns false if there
+  // was nothing to restore.
+  bool Restore(World* world);
+
+  // Forget the saved game, and delete it from disk.
+  void Clear();
+
+ private:
+  void Write(const std::string& contents);
+  void Post(const std::string& contents);
+
+  ServicesThread* services_thread_;
+  std::string path_;
+  bool enabled_;
+  // The snapshot read at startup.
+  std::string pending_;
+  // Whether there may be a snapshot on disk.
+  bool saved_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RESUME_SNAPSHOT_H_
@@ -0,0 +1,635 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "river_mesh_builder.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include "mathfu/constants.h"
+#include "mathfu/utilities.h"
+
+using mathfu::vec2;
+using mathfu::vec2_packed;
+using mathfu::vec3;
+using mathfu::vec3_packed;
+using mathfu::vec4;
+using mathfu::vec4_packed;
+using mathfu::kAxisZ3f;
+
+namespace fpl {
+namespace zooshi {
+
+static const size_t kNumIndicesPerQuad = 6;
+
+// The vertical field of view of the gameplay camera, which the tessellation
+// tolerance is measured with.
+static const float kTessellationViewAngle = 0.7853975f;  // 45 degrees
+
+// Picks the samples of `job.track` to build the river from, and how far
+// along the river each is. A circular arc of length L and curvature k strays
+// L * L * k / 8 from the straight line between its ends, so samples are
+// skipped until the largest curvature passed over says the next one would
+// stray too far. The first and last samples are always kept, so wrapping
+// rivers still join up.
+static void TessellateTrack(const RiverContourJob& job,
+                            std::vector<vec3_packed>* track,
+                            std::vector<float>* fractions) {
+  const RiverConfig* river = job.config;
+  const std::vector<vec3_packed>& samples = job.track;
+  const size_t count = samples.size();
+  const float fraction_per_sample = 1.0f / static_cast<float>(count);
+  const float tolerance =
+      river->tessellation_tolerance() / river->tessellation_screen_height() *
+      2.0f * river->tessellation_view_distance() *
+      tan(kTessellationViewAngle * 0.5f);
+  track->clear();
+  fractions->clear();
+  auto keep = [&](size_t i) {
+    track->push_back(samples[i]);
+    fractions->push_back(static_cast<float>(i) * fraction_per_sample);
+  };
+  if (tolerance <= 0.0f || count < 3) {
+    for (size_t i = 0; i < count; ++i) keep(i);
+    return;
+  }
+
+  // How sharply the track turns at each sample, in radians per unit length.
+  std::vector<float> curvature(count, 0.0f);
+  for (size_t i = 1; i + 1 < count; ++i) {
+    const vec3 before = vec3(samples[i]) - vec3(samples[i - 1]);
+    const vec3 after = vec3(samples[i + 1]) - vec3(samples[i]);
+    const float length = 0.5f * (before.Length() + after.Length());
+    if (length <= 0.0f) continue;
+    const float cos_angle = mathfu::Clamp(
+        vec3::DotProduct(before.Normalized(), after.Normalized()), -1.0f,
+        1.0f);
+    curvature[i] = acos(cos_angle) / length;
+  }
+
+  const size_t max_span =
+      static_cast<size_t>(std::max(river->tessellation_max_skip(), 0)) + 1;
+  size_t last_kept = 0;
+  float length = 0.0f;
+  float max_curvature = 0.0f;
+  keep(0);
+  for (size_t i = 1; i < count; ++i) {
+    const float step = (vec3(samples[i]) - vec3(samples[i - 1])).Length();
+    if (i - 1 > last_kept) {
+      max_curvature = std::max(max_curvature, curvature[i - 1]);
+    }
+    length += step;
+    if (i - last_kept > max_span ||
+        length * length * max_curvature * 0.125f > tolerance) {
+      keep(i - 1);
+      last_kept = i - 1;
+      length = step;
+      max_curvature = 0.0f;
+    }
+  }
+  keep(count - 1);
+}
+
+bool RiverContours::SegmentsEqual(const RiverContours& other, size_t first,
+                                  size_t last) const {
+  if (contours_per_segment != other.contours_per_segment ||
+      last >= NumSegments() || last >= other.NumSegments()) {
+    return false;
+  }
+  for (size_t i = first; i <= last; ++i) {
+    if (segment_zones[i] != other.segment_zones[i]) return false;
+  }
+  const size_t begin = first * contours_per_segment;
+  const size_t count = (last - first + 1) * contours_per_segment;
+  return memcmp(&verts[begin], &other.verts[begin],
+                count * sizeof(NormalMappedColorVertex)) == 0;
+}
+
+void RiverContours::CollisionSectorSegments(size_t sector, size_t* first,
+                                            size_t* last) const {
+  *first = sector * collision_sector_segments;
+  *last = std::min(*first + collision_sector_segments, NumSegments() - 1);
+}
+
+RiverMeshBuilder::RiverMeshBuilder()
+    : thread_(nullptr),
+      mutex_(SDL_CreateMutex()),
+      work_cv_(SDL_CreateCond()),
+      thread_failed_(false),
+      exiting_(false) {}
+
+RiverMeshBuilder::~RiverMeshBuilder() {
+  if (thread_ != nullptr) {
+    SDL_LockMutex(mutex_);
+    exiting_ = true;
+    SDL_CondSignal(work_cv_);
+    SDL_UnlockMutex(mutex_);
+    SDL_WaitThread(thread_, nullptr);
+  }
+  SDL_DestroyCond(work_cv_);
+  SDL_DestroyMutex(mutex_);
+}
+
+bool RiverMeshBuilder::StartThread() {
+  if (thread_ == nullptr && !thread_failed_) {
+    thread_ = SDL_CreateThread(ThreadMain, "Zooshi River Thread", this);
+    thread_failed_ = thread_ == nullptr;
+  }
+  return thread_ != nullptr;
+}
+
+void RiverMeshBuilder::QueueContours(RiverContourJob* job) {
+  if (!StartThread()) {
+    RiverContourResult result = {job->entity, job->generation, nullptr};
+    RiverContours* contours = new RiverContours();
+    GenerateContours(*job, contours);
+    result.contours.reset(contours);
+    contour_results_.push_back(result);
+    return;
+  }
+  SDL_LockMutex(mutex_);
+  contour_jobs_.push_back(RiverContourJob());
+  std::swap(contour_jobs_.back(), *job);
+  SDL_CondSignal(work_cv_);
+  SDL_UnlockMutex(mutex_);
+}
+
+void RiverMeshBuilder::QueueChunk(RiverChunkJob* job) {
+  if (!StartThread()) {
+    chunk_results_.push_back(RiverChunkGeometry());
+    BuildChunk(*job, &tangent_space_, &chunk_results_.back());
+    return;
+  }
+  SDL_LockMutex(mutex_);
+  chunk_jobs_.push_back(RiverChunkJob());
+  std::swap(chunk_jobs_.back(), *job);
+  SDL_CondSignal(work_cv_);
+  SDL_UnlockMutex(mutex_);
+}
+
+void RiverMeshBuilder::TakeResults(std::vector<RiverContourResult>* contours,
+                                   std::vector<RiverChunkGeometry>* chunks) {
+  SDL_LockMutex(mutex_);
+  for (auto it = contour_results_.begin(); it != contour_results_.end();
+       ++it) {
+    contours->push_back(RiverContourResult());
+    std::swap(contours->back(), *it);
+  }
+  contour_results_.clear();
+  for (auto it = chunk_results_.begin(); it != chunk_results_.end(); ++it) {
+    chunks->push_back(RiverChunkGeometry());
+    std::swap(chunks->back(), *it);
+  }
+  chunk_results_.clear();
+  SDL_UnlockMutex(mutex_);
+}
+
+int RiverMeshBuilder::ThreadMain(void* data) {
+  RiverMeshBuilder* builder = static_cast<RiverMeshBuilder*>(data);
+  SDL_LockMutex(builder->mutex_);
+  for (;;) {
+    while (!builder->exiting_ && builder->contour_jobs_.empty() &&
+           builder->chunk_jobs_.empty()) {
+      SDL_CondWait(builder->work_cv_, builder->mutex_);
+    }
+    if (builder->exiting_) break;
+
+    // Contours go first, since chunks of the new river can't be requested
+    // until they're done.
+    if (!builder->contour_jobs_.empty()) {
+      RiverContourJob job;
+      std::swap(job, builder->contour_jobs_.front());
+      builder->contour_jobs_.pop_front();
+      SDL_UnlockMutex(builder->mutex_);
+
+      RiverContours* contours = new RiverContours();
+      GenerateContours(job, contours);
+      RiverContourResult result = {job.entity, job.generation,
+                                   std::shared_ptr<const RiverContours>(
+                                       contours)};
+
+      SDL_LockMutex(builder->mutex_);
+      builder->contour_results_.push_back(result);
+    } else {
+      RiverChunkJob job;
+      std::swap(job, builder->chunk_jobs_.front());
+      builder->chunk_jobs_.pop_front();
+      SDL_UnlockMutex(builder->mutex_);
+
+      RiverChunkGeometry geometry;
+      BuildChunk(job, &builder->tangent_space_, &geometry);
+
+      SDL_LockMutex(builder->mutex_);
+      builder->chunk_results_.push_back(RiverChunkGeometry());
+      std::swap(builder->chunk_results_.back(), geometry);
+    }
+  }
+  SDL_UnlockMutex(builder->mutex_);
+  return 0;
+}
+
+// Generates the cross-section of the banks along the entire river. This is
+// cheap compared to building the meshes, and needs to be done in order since
+// it consumes random numbers, so it's always done in one go.
+void RiverMeshBuilder::GenerateContours(const RiverContourJob& job,
+                                        RiverContours* contours) {
+  const RiverConfig* river = job.config;
+  std::vector<vec3_packed> track;
+  std::vector<float>& fractions = contours->segment_fractions;
+  TessellateTrack(job, &track, &fractions);
+
+  const size_t num_bank_contours = river->default_banks()->Length();
+  const size_t river_idx = river->river_index();
+  const size_t segment_count = track.size();
+  const size_t bank_vert_max = segment_count * num_bank_contours;
+  assert(num_bank_contours >= 2 && river_idx < num_bank_contours - 1);
+
+  contours->contours_per_segment = num_bank_contours;
+  contours->wraps = job.wraps;
+  std::vector<NormalMappedColorVertex>& bank_verts = contours->verts;
+  bank_verts.reserve(bank_vert_max);
+
+  std::vector<unsigned int>& bank_zones = contours->segment_zones;
+  bank_zones.resize(segment_count, 0);  // default of 0
+  unsigned int zone_id = 0;
+
+  // Use our own generator, seeded the same way every time, so the river comes
+  // out the same on every reload regardless of which thread builds it.
+  std::minstd_rand random(job.random_seed);
+  std::uniform_real_distribution<float> unit_random(0.0f, 1.0f);
+
+  std::vector<float> actual_zone_end;
+  actual_zone_end.resize(segment_count, 1);
+  // Precalculate the actual zone end locations.
+  for (size_t i = 0; i < segment_count; i++) {
+    const float fraction = fractions[i];
+    if (zone_id + 1 < river->zones()->Length() &&
+        fraction > river->zones()->Get(zone_id + 1)->zone_start()) {
+      actual_zone_end[zone_id] = fraction;
+      zone_id = zone_id + 1;
+    }
+  }
+  // Start over from zone 0.
+  zone_id = 0;
+
+  const RiverZone* current_zone = river->zones()->Get(zone_id);
+  float river_width = current_zone->width() != 0 ? current_zone->width()
+                                                 : river->default_width();
+
+  // Construct the cross-section of the river at every point of the track:
+  std::vector<vec2> offsets(num_bank_contours);
+  for (size_t i = 0; i < segment_count; i++) {
+    // Get the current position on the track, and the normal (to the side).
+    vec3 track_delta;
+    if (i > 0) {
+      track_delta = vec3(track[i]) - vec3(track[i - 1]);
+    } else if (job.wraps) {
+      // River track is circular.
+      track_delta = vec3(track[i]) - vec3(track[segment_count - 1]);
+    } else {
+      // Not circular, so point towards the next point.
+      track_delta = vec3(track[1]) - vec3(track[0]);
+    }
+    const vec3 track_normal =
+        vec3::CrossProduct(track_delta, kAxisZ3f).Normalized();
+    const vec3 track_position =
+        vec3(track[i]) + river->track_height() * kAxisZ3f;
+
+    // Fraction of the river we have gone through, approximately.
+    const float fraction = fractions[i];
+
+    // The river texture is tiled several times along the course of the river.
+    // TODO: Change this from tile count to actual physical size for a tile.
+    //       Requires that we know the total path distance.
+    const float texture_v = river->texture_tile_size() * fraction;
+
+    if (fraction >= actual_zone_end[zone_id]) {
+      zone_id = zone_id + 1;
+      current_zone = river->zones()->Get(zone_id);
+      // Each zone has its own river width.
+      river_width = current_zone->width() != 0 ? current_zone->width()
+                                               : river->default_width();
+    }
+    bank_zones[i] = zone_id;
+    float zone_start = zone_id == 0 ? 0 : actual_zone_end[zone_id - 1];
+    float zone_end = actual_zone_end[zone_id];
+    float within_fraction = (fraction - zone_start) / (zone_end - zone_start);
+    if (!job.zone_blends[zone_id]) {
+      // Ensure we stay continuous with transitional zones.
+      within_fraction = within_fraction < 0.5f ? 1.0f : 0.0f;
+    }
+
+    int within_color = static_cast<int>(255.0 * within_fraction);
+    // Cap the color to 0..255 byte.
+    unsigned char within_color_byte = static_cast<unsigned char>(
+        within_color < 0 ? 0 : (within_color > 255 ? 255 : within_color));
+
+    // Get the (side, up) offsets of the bank vertices.
+    // The offsets are relative to `track_position`.
+    // side == distance along `track_normal`
+    // up == distance along kAxisZ3f
+    for (size_t j = 0; j < num_bank_contours; ++j) {
+      flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(j);
+      const RiverBankContour* b = (current_zone->banks() != nullptr)
+                                      ? current_zone->banks()->Get(index)
+                                      : river->default_banks()->Get(index);
+      const float side = unit_random(random);
+      const float up = unit_random(random);
+      offsets[j] = vec2(mathfu::Lerp(b->x_min(), b->x_max(), side),
+                        mathfu::Lerp(b->z_min(), b->z_max(), up));
+    }
+
+    // Create the bank vertices for this segment.
+    for (size_t j = 0; j < num_bank_contours; ++j) {
+      const bool left_bank = j <= river_idx;
+      const vec2 off = offsets[j];
+      const vec3 vertex =
+          track_position +
+          (off.x + river_width * (left_bank ? -1 : 1)) * track_normal +
+          off.y * kAxisZ3f;
+      // The texture is stretched from the side of the river to the far end
+      // of the bank. There are two banks, however, separated by the river.
+      // We need to know the width of the bank to caluate the `texture_u`
+      // coordinate.
+      const size_t bank_start = left_bank ? 0 : num_bank_contours - 1;
+      const size_t bank_end = left_bank ? river_idx : river_idx + 1;
+      const float bank_width = offsets[bank_start].x - offsets[bank_end].x;
+      const float texture_u = (off.x - offsets[bank_end].x) / bank_width;
+
+      bank_verts.push_back(NormalMappedColorVertex());
+      bank_verts.back().pos = vec3_packed(vertex);
+      bank_verts.back().tc = vec2_packed(vec2(texture_u, texture_v));
+      bank_verts.back().norm = vec3_packed(vec3(0, 1, 0));
+      bank_verts.back().tangent = vec4_packed(vec4(1, 0, 0, 1));
+      unsigned char color_bytes[4] = {255, 255, 255, within_color_byte};
+      memcpy(bank_verts.back().color, color_bytes, sizeof(color_bytes));
+    }
+
+    // Ensure vertices don't go behind previous vertices on the inside of
+    // a tight corner.
+    if (i > 0) {
+      const NormalMappedColorVertex* prev_verts =
+          &bank_verts[bank_verts.size() - 2 * num_bank_contours];
+      NormalMappedColorVertex* cur_verts =
+          &bank_verts[bank_verts.size() - num_bank_contours];
+      for (size_t j = 0; j < num_bank_contours; j++) {
+        const vec3 vert_delta =
+            vec3(cur_verts[j].pos) - vec3(prev_verts[j].pos);
+        const float dot = vec3::DotProduct(vert_delta, track_delta);
+        const bool cur_vert_goes_backwards_along_track = dot <= 0.0f;
+        if (cur_vert_goes_backwards_along_track) {
+          cur_verts[j].pos = vec3(prev_verts[j].pos) + 0.000001f * track_delta;
+        }
+      }
+    }
+
+    // Force the beginning and end to line up in their geometry:
+    if (i == segment_count - 1 && job.wraps) {
+      for (size_t j = 0; j < num_bank_contours; j++)
+        bank_verts[bank_verts.size() - (num_bank_contours - j)].pos =
+            bank_verts[j].pos;
+    }
+  }
+
+  // Make sure we used as much data as expected, and no more.
+  assert(bank_verts.size() == bank_vert_max);
+
+  BuildCollision(river_idx, river->collision_sector_segments(), contours);
+}
+
+// Triangulates the banks along the whole river for its static collision
+// mesh, the same way BuildChunk() triangulates them for rendering.
+void RiverMeshBuilder::BuildCollision(size_t river_idx, int sector_segments,
+                                      RiverContours* contours) {
+  const size_t num_bank_contours = contours->contours_per_segment;
+  const size_t segment_count = contours->NumSegments();
+  const std::vector<NormalMappedColorVertex>& verts = contours->verts;
+  std::vector<vec3>& collision = contours->collision_verts;
+  if (segment_count < 2) return;
+  collision.reserve((segment_count - 1) * (num_bank_contours - 2) * 6);
+  for (size_t i = 0; i + 1 < segment_count; i++) {
+    for (size_t j = 0; j + 1 < num_bank_contours; ++j) {
+      if (j == river_idx) continue;
+      const size_t offset1 = i * num_bank_contours + j;
+      const size_t offset2 = offset1 + num_bank_contours;
+      collision.push_back(vec3(verts[offset1].pos));
+      collision.push_back(vec3(verts[offset1 + 1].pos));
+      collision.push_back(vec3(verts[offset2].pos));
+
+      collision.push_back(vec3(verts[offset2].pos));
+      collision.push_back(vec3(verts[offset1 + 1].pos));
+      collision.push_back(vec3(verts[offset2 + 1].pos));
+    }
+  }
+
+  // Bound each sector, so the component can tell which ones are needed
+  // without looking at their triangles.
+  const size_t num_quads = segment_count - 1;
+  const size_t verts_per_segment = collision.size() / num_quads;
+  contours->collision_verts_per_segment = verts_per_segment;
+  contours->collision_sector_segments =
+      sector_segments > 0
+          ? std::min(static_cast<size_t>(sector_segments), num_quads)
+          : num_quads;
+  const size_t num_sectors =
+      (num_quads + contours->collision_sector_segments - 1) /
+      contours->collision_sector_segments;
+  for (size_t sector = 0; sector < num_sectors; ++sector) {
+    size_t first;
+    size_t last;
+    contours->CollisionSectorSegments(sector, &first, &last);
+    vec3 sector_min(std::numeric_limits<float>::max());
+    vec3 sector_max(-std::numeric_limits<float>::max());
+    for (size_t i = first * verts_per_segment; i < last * verts_per_segment;
+         ++i) {
+      sector_min = vec3::Min(sector_min, collision[i]);
+      sector_max = vec3::Max(sector_max, collision[i]);
+    }
+    contours->collision_sector_min.push_back(sector_min);
+    contours->collision_sector_max.push_back(sector_max);
+  }
+}
+
+// Maps -1 to 1 onto 0 to 255, for PACKED_NORMALS shaders to map back.
+static unsigned char PackUnit(float value) {
+  const float clamped = mathfu::Clamp(value, -1.0f, 1.0f);
+  return static_cast<unsigned char>(
+      floorf((clamped * 0.5f + 0.5f) * 255.0f + 0.5f));
+}
+
+// Maps a unit vector onto the octahedron, unfolded into the unit square, so
+// it fits in two components.
+static vec2 OctahedronEncode(const vec3& direction) {
+  const vec3 v =
+      direction / (fabsf(direction.x()) + fabsf(direction.y()) +
+                   fabsf(direction.z()));
+  if (v.z() >= 0.0f) return vec2(v.x(), v.y());
+  return vec2((1.0f - fabsf(v.y())) * (v.x() >= 0.0f ? 1.0f : -1.0f),
+              (1.0f - fabsf(v.x())) * (v.y() >= 0.0f ? 1.0f : -1.0f));
+}
+
+template <typename Vertex>
+static void PackVertex(const Vertex& vertex,
+                       PackedNormalMappedVertex* packed) {
+  packed->pos = vertex.pos;
+  packed->tc = vertex.tc;
+  const vec3 normal(vertex.norm);
+  const vec4 tangent(vertex.tangent);
+  packed->norm[0] = PackUnit(normal.x());
+  packed->norm[1] = PackUnit(normal.y());
+  packed->norm[2] = PackUnit(normal.z());
+  packed->norm[3] = PackUnit(tangent.w());
+  // A degenerate triangle's zero tangent has no direction to keep.
+  const vec3 direction = tangent.xyz();
+  packed->tangent = direction.LengthSquared() > 0.0f
+                        ? OctahedronEncode(direction)
+                        : vec2(1.0f, 0.0f);
+}
+
+// Packs the finished vertices into the geometry's packed vectors, and frees
+// the originals.
+static void PackChunk(RiverChunkGeometry* geometry) {
+  geometry->packed_river_verts.resize(geometry->river_verts.size());
+  for (size_t i = 0; i < geometry->river_verts.size(); ++i) {
+    PackVertex(geometry->river_verts[i], &geometry->packed_river_verts[i]);
+  }
+  geometry->packed_bank_verts.resize(geometry->bank_verts.size());
+  for (size_t i = 0; i < geometry->bank_verts.size(); ++i) {
+    PackVertex(geometry->bank_verts[i], &geometry->packed_bank_verts[i]);
+  }
+  std::vector<NormalMappedVertex>().swap(geometry->river_verts);
+  std::vector<NormalMappedColorVertex>().swap(geometry->bank_verts);
+}
+
+// Generates the vertex and index buffers for one chunk of the river from its
+// contours, along with the triangles of its static collision mesh.
+void RiverMeshBuilder::BuildChunk(const RiverChunkJob& job,
+                                  TangentSpaceBuilder* tangent_space,
+                                  RiverChunkGeometry* geometry) {
+  const RiverConfig* river = job.config;
+  const RiverContours& contours = *job.contours;
+  geometry->entity = job.entity;
+  geometry->generation = job.generation;
+  geometry->chunk_index = job.chunk_index;
+
+  const size_t num_bank_contours = contours.contours_per_segment;
+  const size_t num_bank_quads = num_bank_contours - 2;
+  const size_t river_idx = river->river_index();
+  const size_t segment_count = contours.NumSegments();
+  const size_t chunk_segments = static_cast<size_t>(job.chunk_segments);
+  const unsigned int num_zones = river->zones()->Length();
+
+  // The chunk covers the quads between track segments `first` and `last`.
+  // Normals are calculated with an extra segment on either side, so that the
+  // lighting is continuous across chunk boundaries.
+  const size_t first = static_cast<size_t>(job.chunk_index) * chunk_segments;
+  const size_t last = std::min(first + chunk_segments, segment_count - 1);
+  size_t padded_first;
+  size_t padded_last;
+  ChunkSegmentRange(segment_count, job.chunk_index, job.chunk_segments,
+                    &padded_first, &padded_last);
+  assert((padded_last - padded_first + 1) * num_bank_contours <=
+         std::numeric_limits<unsigned short>::max());
+
+  std::vector<NormalMappedColorVertex>& bank_verts = geometry->bank_verts;
+  bank_verts.assign(
+      contours.verts.begin() + padded_first * num_bank_contours,
+      contours.verts.begin() + (padded_last + 1) * num_bank_contours);
+  // All bank triangles, including the padding, for the normal calculation.
+  std::vector<unsigned short> bank_indices;
+  // Use one set of bank vertices for the entire chunk, but separate out
+  // the zones via indices, so we can use different materials (and possibly
+  // shaders) per zone.
+  geometry->bank_indices_by_zone.resize(num_zones);
+
+  std::vector<NormalMappedVertex>& river_verts = geometry->river_verts;
+  river_verts.reserve((last - first + 1) * 2);
+  std::vector<unsigned short>& river_indices = geometry->river_indices;
+  river_indices.reserve((last - first) * kNumIndicesPerQuad);
+
+  auto make_quad = [](std::vector<unsigned short>& indices, int base_index,
+                      int off1, int off2) {
+    indices.push_back(static_cast<unsigned short>(base_index + off1));
+    indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
+    indices.push_back(static_cast<unsigned short>(base_index + off2));
+
+    indices.push_back(static_cast<unsigned short>(base_index + off2));
+    indices.push_back(static_cast<unsigned short>(base_index + off1 + 1));
+    indices.push_back(static_cast<unsigned short>(base_index + off2 + 1));
+  };
+
+  // Create triangles in our index lists between each segment and the next.
+  for (size_t i = padded_first; i < padded_last; i++) {
+    const bool in_chunk = i >= first && i < last;
+    // Case when kNumBankCountours = 8, and river_idx = 3;
+    //
+    //  0___1___2___3   4___5___6___7
+    //  | _/| _/| _/|   | _/| _/| _/|
+    //  |/__|/__|/__|   |/__|/__|/__|
+    //  8   9  10  11  12  13  14  15
+    for (size_t j = 0; j <= num_bank_quads; ++j) {
+      // Do not create bank geo for the river.
+      if (j == river_idx) continue;
+      int base_index = static_cast<int>((i - padded_first) * num_bank_contours);
+      int offset1 = static_cast<int>(j);
+      int offset2 = static_cast<int>(num_bank_contours + j);
+      make_quad(bank_indices, base_index, offset1, offset2);
+      if (!in_chunk) continue;
+
+      unsigned int zone = contours.segment_zones[i];
+      make_quad(geometry->bank_indices_by_zone[zone], base_index, offset1,
+                offset2);
+    }
+  }
+
+  // The river has two of the middle vertices of the bank.
+  // The texture coordinates are different, however.
+  for (size_t i = first; i <= last; i++) {
+    const NormalMappedColorVertex* contour =
+        &contours.verts[i * num_bank_contours + river_idx];
+    const float normalized_texture_v = contours.segment_fractions[i];
+    for (int side = 0; side < 2; ++side) {
+      river_verts.push_back(NormalMappedVertex());
+      river_verts.back().pos = contour[side].pos;
+      river_verts.back().tc =
+          vec2(static_cast<float>(side), normalized_texture_v);
+      river_verts.back().norm = contour[side].norm;
+      river_verts.back().tangent = contour[side].tangent;
+    }
+  }
+  // River only has one quad per segment.
+  for (size_t i = 0; i < last - first; i++) {
+    make_quad(river_indices, 2 * static_cast<int>(i), 0, 2);
+  }
+
+  tangent_space->Compute(bank_verts.data(), bank_verts.size(),
+                         bank_indices.data(), bank_indices.size());
+
+  if (river->packed_vertices()) PackChunk(geometry);
+}
+
+void RiverMeshBuilder::ChunkSegmentRange(size_t segment_count,
+                                         int chunk_index, int chunk_segments,
+                                         size_t* first, size_t* last) {
+  const size_t chunk_first =
+      static_cast<size_t>(chunk_index) * static_cast<size_t>(chunk_segments);
+  const size_t chunk_last = std::min(
+      chunk_first + static_cast<size_t>(chunk_segments), segment_count - 1);
+  *first = chunk_first > 0 ? chunk_first - 1 : 0;
+  *last = std::min(chunk_last + 1, segment_count - 1);
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,177 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_RIVER_MESH_BUILDER_H_
+#define ZOOSHI_RIVER_MESH_BUILDER_H_
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
+#include "common.h"
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "mathfu/glsl_mappings.h"
+#include "tangent_space.h"
+
+namespace fpl {
+namespace zooshi {
+
+// The bank cross-section for every segment of a river's track. Immutable once
+// built, so it can be shared between the render thread and the builder.
+struct RiverContours {
+  RiverContours()
+      : contours_per_segment(0),
+        wraps(true),
+        collision_verts_per_segment(0),
+        collision_sector_segments(0) {}
+  size_t NumSegments() const {
+    return contours_per_segment == 0 ? 0 : verts.size() / contours_per_segment;
+  }
+  // Whether the segments `first` through `last`, inclusive, are the same in
+  // both sets of contours.
+  bool SegmentsEqual(const RiverContours& other, size_t first,
+                     size_t last) const;
+  // `contours_per_segment` vertices for each segment of the track.
+  std::vector<NormalMappedColorVertex> verts;
+  size_t contours_per_segment;
+  // The zone that each segment of the track is in.
+  std::vector<unsigned int> segment_zones;
+  // How far along the river each segment is, from 0 to 1. Segments are
+  // closer together around bends.
+  std::vector<float> segment_fractions;
+  // Whether the river's rail loops back on itself.
+  bool wraps;
+  // Three vertices per triangle of the static collision mesh of the banks,
+  // along the whole river. The triangles are in track order, with
+  // `collision_verts_per_segment` vertices between each segment and the next.
+  std::vector<mathfu::vec3> collision_verts;
+  size_t collision_verts_per_segment;
+  // The collision mesh is built in sectors of this many segments. The bounds
+  // of each sector's triangles, in the river's space.
+  size_t collision_sector_segments;
+  std::vector<mathfu::vec3> collision_sector_min;
+  std::vector<mathfu::vec3> collision_sector_max;
+  size_t NumCollisionSectors() const { return collision_sector_min.size(); }
+  // Gets the range of track segments, inclusive, whose contours a collision
+  // sector is built from.
+  void CollisionSectorSegments(size_t sector, size_t* first,
+                               size_t* last) const;
+};
+
+// Everything needed to generate a river's contours. Captured on the render
+// thread, since it reads the rail and the asset manager.
+struct RiverContourJob {
+  corgi::EntityRef entity;
+  int generation;
+  const RiverConfig* config;
+  unsigned int random_seed;
+  // The rail sampled every `spline_stepsize`. Only the samples needed to
+  // follow its bends become segments.
+  std::vector<mathfu::vec3_packed> track;
+  bool wraps;
+  // Whether each zone's material blends between two textures.
+  std::vector<bool> zone_blends;
+};
+
+struct RiverContourResult {
+  corgi::EntityRef entity;
+  int generation;
+  std::shared_ptr<const RiverContours> contours;
+};
+
+// A request for the CPU-side geometry of one chunk of river.
+struct RiverChunkJob {
+  corgi::EntityRef entity;
+  int generation;
+  const RiverConfig* config;
+  std::shared_ptr<const RiverContours> contours;
+  int chunk_index;
+  int chunk_segments;
+};
+
+// The vertex and index buffers for one chunk of river, ready for upload.
+struct RiverChunkGeometry {
+  corgi::EntityRef entity;
+  int generation;
+  int chunk_index;
+  std::vector<NormalMappedVertex> river_verts;
+  std::vector<unsigned short> river_indices;
+  std::vector<NormalMappedColorVertex> bank_verts;
+  std::vector<std::vector<unsigned short>> bank_indices_by_zone;
+  // With the config's packed_vertices, the vertices are packed into these
+  // instead, and the ones above are left empty.
+  std::vector<PackedNormalMappedVertex> packed_river_verts;
+  std::vector<PackedNormalMappedVertex> packed_bank_verts;
+};
+
+// Generates river contours and chunk geometry on a worker thread, so that only
+// the GL upload has to happen on the render thread. Jobs are processed in
+// order, contours before chunks. If the worker thread can't be started, jobs
+// are done immediately on the calling thread.
+class RiverMeshBuilder {
+ public:
+  RiverMeshBuilder();
+  ~RiverMeshBuilder();
+
+  void QueueContours(RiverContourJob* job);
+  void QueueChunk(RiverChunkJob* job);
+
+  // Appends any finished work to the given vectors. Never waits on the
+  // worker.
+  void TakeResults(std::vector<RiverContourResult>* contours,
+                   std::vector<RiverChunkGeometry>* chunks);
+
+  static void GenerateContours(const RiverContourJob& job,
+                               RiverContours* contours);
+  // `tangent_space` is scratch space for the banks' normals and tangents.
+  static void BuildChunk(const RiverChunkJob& job,
+                         TangentSpaceBuilder* tangent_space,
+                         RiverChunkGeometry* geometry);
+  // `sector_segments` is the config's collision_sector_segments.
+  static void BuildCollision(size_t river_idx, int sector_segments,
+                             RiverContours* contours);
+
+  // Gets the range of track segments, inclusive, whose contours contribute
+  // to a chunk's geometry. This includes the neighbouring segments used to
+  // calculate the chunk's normals.
+  static void ChunkSegmentRange(size_t segment_count, int chunk_index,
+                                int chunk_segments, size_t* first,
+                                size_t* last);
+
+ private:
+  bool StartThread();
+  static int ThreadMain(void* data);
+
+  SDL_Thread* thread_;
+  SDL_mutex* mutex_;
+  SDL_cond* work_cv_;
+  bool thread_failed_;
+  bool exiting_;
+
+  // Guarded by `mutex_`.
+  std::deque<RiverContourJob> contour_jobs_;
+  std::deque<RiverChunkJob> chunk_jobs_;
+  std::vector<RiverContourResult> contour_results_;
+  std::vector<RiverChunkGeometry> chunk_results_;
+
+  // Only used by whichever thread builds the chunks.
+  TangentSpaceBuilder tangent_space_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_RIVER_MESH_BUILDER_H_
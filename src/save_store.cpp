@@ -0,0 +1,160 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "save_store.h"
+
+#include <cstdio>
+#include <vector>
+#include "fplbase/utilities.h"
+#include "services_thread.h"
+
+using fplbase::LogError;
+
+namespace fpl {
+namespace zooshi {
+
+SaveStore::SaveStore()
+    : services_thread_(nullptr), has_values_(false), dirty_(false) {
+  SDL_AtomicSet(&pending_writes_, 0);
+}
+
+void SaveStore::Load(const char* app_name, const char* file_name) {
+  std::string storage_path;
+  if (!fplbase::GetStoragePath(app_name, &storage_path)) return;
+  path_ = storage_path + file_name;
+
+  std::string contents;
+  if (!fplbase::LoadPreferences(path_.c_str(), &contents)) return;
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(contents.data()), contents.size());
+  if (!VerifySaveDataBuffer(verifier)) {
+    LogError("Ignoring corrupt save file %s", path_.c_str());
+    return;
+  }
+  settings_.swap(contents);
+
+  auto values = settings()->values();
+  if (values == nullptr) return;
+  has_values_ = true;
+  for (flatbuffers::uoffset_t i = 0; i < values->size(); ++i) {
+    auto value = values->Get(i);
+    if (value->key() != nullptr) values_[value->key()->str()] = value->value();
+  }
+}
+
+const SaveData* SaveStore::settings() const {
+  return settings_.empty() ? nullptr : GetSaveData(settings_.data());
+}
+
+void SaveStore::SetSettings(const uint8_t* data, size_t size) {
+  settings_.assign(reinterpret_cast<const char*>(data), size);
+  dirty_ = true;
+}
+
+int SaveStore::GetValue(const char* key, int default_value) {
+  auto it = values_.find(key);
+  if (it != values_.end()) return it->second;
+  if (has_values_) return default_value;
+
+  // Bring the value over from the old per-key preferences, so the next
+  // commit saves it with the rest.
+  const int value = fplbase::LoadPreference(key, default_value);
+  values_[key] = value;
+  dirty_ = true;
+  return value;
+}
+
+void SaveStore::SetValue(const char* key, int value) {
+  auto it = values_.find(key);
+  if (it != values_.end() && it->second == value) return;
+  values_[key] = value;
+  dirty_ = true;
+}
+
+std::string SaveStore::BuildSaveFile() const {
+  flatbuffers::FlatBufferBuilder fbb;
+  std::vector<flatbuffers::Offset<SaveValue>> values;
+  values.reserve(values_.size());
+  for (auto it = values_.begin(); it != values_.end(); ++it) {
+    values.push_back(
+        CreateSaveValue(fbb, fbb.CreateString(it->first), it->second));
+  }
+  auto values_offset = fbb.CreateVector(values);
+
+  SaveDataBuilder builder(fbb);
+  const SaveData* data = settings();
+  if (data != nullptr) {
+    builder.add_effect_volume(data->effect_volume());
+    builder.add_music_volume(data->music_volume());
+    builder.add_render_shadows(data->render_shadows());
+    builder.add_apply_phong(data->apply_phong());
+    builder.add_apply_specular(data->apply_specular());
+    builder.add_render_shadows_cardboard(data->render_shadows_cardboard());
+    builder.add_apply_phong_cardboard(data->apply_phong_cardboard());
+    builder.add_apply_specular_cardboard(data->apply_specular_cardboard());
+    builder.add_gyroscopic_controls_enabled(
+        data->gyroscopic_controls_enabled());
+  }
+  builder.add_values(values_offset);
+  FinishSaveDataBuffer(fbb, builder.Finish());
+  return std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                     fbb.GetSize());
+}
+
+void SaveStore::Write(const std::string& contents) {
+  // Write beside the save, then swap it in, so the save on disk is always
+  // either the old one or the new one.
+  const std::string temp_path = path_ + ".tmp";
+  if (!fplbase::SavePreferences(temp_path.c_str(), contents.data(),
+                                contents.size())) {
+    LogError("Couldn't write save file %s", temp_path.c_str());
+    return;
+  }
+#ifdef _WIN32
+  // rename() won't replace an existing file on Windows.
+  std::remove(path_.c_str());
+#endif  // _WIN32
+  if (std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+    LogError("Couldn't replace save file %s", path_.c_str());
+  }
+}
+
+void SaveStore::Commit() {
+  if (!dirty_ || path_.empty()) return;
+  dirty_ = false;
+
+  const std::string contents = BuildSaveFile();
+  if (services_thread_ == nullptr) {
+    Write(contents);
+    return;
+  }
+  SDL_AtomicIncRef(&pending_writes_);
+  services_thread_->Post([this, contents]() {
+    Write(contents);
+    SDL_AtomicDecRef(&pending_writes_);
+  });
+}
+
+void SaveStore::Flush() {
+  if (path_.empty()) return;
+  // Posted writes may have been dropped when the services thread shut down.
+  // The latest state includes them, so write it now.
+  if (dirty_ || SDL_AtomicGet(&pending_writes_) > 0) {
+    dirty_ = false;
+    SDL_AtomicSet(&pending_writes_, 0);
+    Write(BuildSaveFile());
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,93 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_SAVE_STORE_H_
+#define ZOOSHI_SAVE_STORE_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "SDL_atomic.h"
+#include "save_data_generated.h"
+
+namespace fpl {
+namespace zooshi {
+
+class ServicesThread;
+
+const auto kSaveFileName = "save_data.zoosave";
+const auto kSaveAppName = "zooshi";
+
+// Keeps the player's settings and progress in memory, in a single save file
+// that's read once at startup. Changes are batched, and Commit() writes them
+// all at once on the services thread, to a temporary file that then replaces
+// the save. A crash mid-write leaves the previous save intact.
+//
+// Everything but the write itself happens on the calling thread, which
+// should be the update thread once the game is running.
+class SaveStore {
+ public:
+  SaveStore();
+
+  // Read the save file, if there is one.
+  void Load(const char* app_name, const char* file_name);
+
+  // Writes are posted here. If null, they happen on the calling thread.
+  void set_services_thread(ServicesThread* services_thread) {
+    services_thread_ = services_thread;
+  }
+
+  // The saved settings, or null if there are none yet. Their `values` may be
+  // out of date; use GetValue() instead.
+  const SaveData* settings() const;
+
+  // Replace the saved settings with the SaveData in `data`. Its `values`
+  // are ignored.
+  void SetSettings(const uint8_t* data, size_t size);
+
+  // Get the value saved under `key`, or `default_value` if there isn't one.
+  // Saves from before the store existed are read from the old preferences,
+  // and migrated.
+  int GetValue(const char* key, int default_value);
+  void SetValue(const char* key, int value);
+
+  // True if there are changes that haven't been committed.
+  bool dirty() const { return dirty_; }
+
+  // Start writing the changes since the last commit, if there are any.
+  void Commit();
+
+  // Write any changes, and any commits that hadn't been written yet, before
+  // returning. Call after the services thread has shut down.
+  void Flush();
+
+ private:
+  std::string BuildSaveFile() const;
+  void Write(const std::string& contents);
+
+  ServicesThread* services_thread_;
+  std::string path_;
+  std::string settings_;
+  std::map<std::string, int> values_;
+  // False if the save file predates the store, or there wasn't one.
+  bool has_values_;
+  bool dirty_;
+
+  // Commits that have been posted, but not yet written.
+  SDL_atomic_t pending_writes_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_SAVE_STORE_H_
@@ -0,0 +1,152 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "services_thread.h"
+
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+
+namespace fpl {
+namespace zooshi {
+
+ServicesThread::ServicesThread()
+    : thread_(nullptr),
+      mutex_(SDL_CreateMutex()),
+      wake_cv_(SDL_CreateCond()),
+      tick_requested_(false),
+      exiting_(false),
+      results_mutex_(SDL_CreateMutex()) {}
+
+ServicesThread::~ServicesThread() {
+  Shutdown();
+  SDL_DestroyMutex(results_mutex_);
+  SDL_DestroyCond(wake_cv_);
+  SDL_DestroyMutex(mutex_);
+}
+
+void ServicesThread::Initialize() {
+  if (thread_ != nullptr) return;
+  thread_ = SDL_CreateThread(ThreadMain, "Zooshi Services Thread", this);
+  if (thread_ == nullptr) {
+    LogError("Error creating services thread: %s", SDL_GetError());
+  }
+}
+
+void ServicesThread::Shutdown() {
+  if (thread_ == nullptr) return;
+  SDL_LockMutex(mutex_);
+  exiting_ = true;
+  SDL_CondSignal(wake_cv_);
+  SDL_UnlockMutex(mutex_);
+  SDL_WaitThread(thread_, nullptr);
+  thread_ = nullptr;
+  jobs_.clear();
+  tick_requested_ = false;
+  exiting_ = false;
+}
+
+void ServicesThread::Tick() {
+  if (thread_ == nullptr) {
+    RunFrameTasks();
+    return;
+  }
+  SDL_LockMutex(mutex_);
+  tick_requested_ = true;
+  SDL_CondSignal(wake_cv_);
+  SDL_UnlockMutex(mutex_);
+}
+
+void ServicesThread::Post(const Job& job) {
+  if (thread_ == nullptr) {
+    job();
+    return;
+  }
+  SDL_LockMutex(mutex_);
+  jobs_.push_back(job);
+  SDL_CondSignal(wake_cv_);
+  SDL_UnlockMutex(mutex_);
+}
+
+void ServicesThread::PostResult(const Job& result) {
+  SDL_LockMutex(results_mutex_);
+  results_.push_back(result);
+  SDL_UnlockMutex(results_mutex_);
+}
+
+void ServicesThread::RunResults() {
+  // Swap the results out, so ones posted while these run wait for the next
+  // call rather than holding the lock.
+  SDL_LockMutex(results_mutex_);
+  running_results_.swap(results_);
+  SDL_UnlockMutex(results_mutex_);
+  for (auto it = running_results_.begin(); it != running_results_.end();
+       ++it) {
+    (*it)();
+  }
+  running_results_.clear();
+}
+
+void ServicesThread::RunFrameTasks() {
+  for (auto it = frame_tasks_.begin(); it != frame_tasks_.end(); ++it) {
+    (*it)();
+  }
+}
+
+int ServicesThread::ThreadMain(void* data) {
+  ServicesThread* services = static_cast<ServicesThread*>(data);
+#ifdef __ANDROID__
+  // Services call into Java, so the thread needs its own JNIEnv.
+  JavaVM* jvm;
+  JNIEnv* env = fplbase::AndroidGetJNIEnv();
+  env->GetJavaVM(&jvm);
+  JNIEnv* services_env;
+  JavaVMAttachArgs args;
+  args.version = JNI_VERSION_1_6;
+  args.name = "Zooshi Services";
+  args.group = nullptr;
+  jvm->AttachCurrentThread(&services_env, &args);
+#endif  // __ANDROID__
+
+  SDL_LockMutex(services->mutex_);
+  for (;;) {
+    while (services->jobs_.empty() && !services->tick_requested_ &&
+           !services->exiting_) {
+      SDL_CondWait(services->wake_cv_, services->mutex_);
+    }
+    if (services->exiting_) break;
+
+    // Run without the lock, so the render thread can keep posting.
+    if (!services->jobs_.empty()) {
+      Job job = services->jobs_.front();
+      services->jobs_.pop_front();
+      SDL_UnlockMutex(services->mutex_);
+      job();
+      SDL_LockMutex(services->mutex_);
+    } else {
+      services->tick_requested_ = false;
+      SDL_UnlockMutex(services->mutex_);
+      services->RunFrameTasks();
+      SDL_LockMutex(services->mutex_);
+    }
+  }
+  SDL_UnlockMutex(services->mutex_);
+
+#ifdef __ANDROID__
+  jvm->DetachCurrentThread();
+#endif  // __ANDROID__
+  return 0;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,86 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_SERVICES_THREAD_H_
+#define ZOOSHI_SERVICES_THREAD_H_
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include "SDL_mutex.h"
+#include "SDL_thread.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A thread for online services, such as Play Games sign in and multiplayer,
+// whose calls can block on the network or on Java. Keeping them here leaves
+// the render thread free to talk to OpenGL.
+//
+// Frame tasks run once each time Tick() is called, and posted jobs run once,
+// in order. Work that has to touch game state hands a result back with
+// PostResult(), which the update thread runs from RunResults().
+class ServicesThread {
+ public:
+  typedef std::function<void()> Job;
+
+  ServicesThread();
+  ~ServicesThread();
+
+  // Start the thread. If it can't start, jobs run on the calling thread.
+  void Initialize();
+
+  // Stop the thread. Any queued jobs are dropped.
+  void Shutdown();
+
+  // Run `task` on the services thread every time Tick() is called. Call
+  // before Initialize().
+  void AddFrameTask(const Job& task) { frame_tasks_.push_back(task); }
+
+  // Wake the services thread to run the frame tasks. Never blocks. If the
+  // last tick's tasks haven't finished, this one is skipped.
+  void Tick();
+
+  // Run `job` on the services thread.
+  void Post(const Job& job);
+
+  // Run `result` on the update thread, the next time it calls RunResults().
+  void PostResult(const Job& result);
+
+  // Run every result posted so far. Call from the update thread.
+  void RunResults();
+
+ private:
+  static int ThreadMain(void* data);
+  void RunFrameTasks();
+
+  SDL_Thread* thread_;
+  std::vector<Job> frame_tasks_;
+
+  // Guards everything below.
+  SDL_mutex* mutex_;
+  SDL_cond* wake_cv_;
+  std::deque<Job> jobs_;
+  bool tick_requested_;
+  bool exiting_;
+
+  // Guarded by its own mutex, so the update thread never waits for a job.
+  SDL_mutex* results_mutex_;
+  std::vector<Job> results_;
+  std::vector<Job> running_results_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_SERVICES_THREAD_H_
@@ -0,0 +1,257 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shader_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "SDL_video.h"
+#include "fplbase/utilities.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+#if defined(_WIN32)
+#define ZOOSHI_GL_APIENTRY __stdcall
+#else
+#define ZOOSHI_GL_APIENTRY
+#endif  // defined(_WIN32)
+
+// Enums from the program binary extensions, which aren't in every GL header.
+// The OES and ARB extensions share their values.
+static const GLenum kProgramBinaryLength = 0x8741;
+static const GLenum kNumProgramBinaryFormats = 0x87FE;
+
+typedef void(ZOOSHI_GL_APIENTRY* GetProgramBinaryFunc)(GLuint program,
+                                                        GLsizei buffer_size,
+                                                        GLsizei* length,
+                                                        GLenum* format,
+                                                        void* binary);
+typedef void(ZOOSHI_GL_APIENTRY* ProgramBinaryFunc)(GLuint program,
+                                                     GLenum format,
+                                                     const void* binary,
+                                                     GLsizei length);
+
+// The functions are the same for every context, so they're shared.
+static GetProgramBinaryFunc get_program_binary = nullptr;
+static ProgramBinaryFunc program_binary = nullptr;
+
+// Binaries are saved beside the save data.
+static const char kStorageAppName[] = "zooshi";
+static const uint32_t kFileMagic = 0x5A535042;  // "ZSPB"
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t format;
+};
+
+static const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+
+// 64-bit FNV-1a, continuing from `hash`.
+static uint64_t Hash(const void* data, size_t size,
+                     uint64_t hash = kFnvOffsetBasis) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t HashString(const GLubyte* string, uint64_t hash) {
+  const char* text = reinterpret_cast<const char*>(string);
+  return text == nullptr ? hash : Hash(text, strlen(text), hash);
+}
+
+// Look up each function, with `suffix` appended to its name.
+static bool LoadProgramBinaryFunctions(const char* suffix) {
+  const std::string get_name = std::string("glGetProgramBinary") + suffix;
+  const std::string set_name = std::string("glProgramBinary") + suffix;
+  get_program_binary = reinterpret_cast<GetProgramBinaryFunc>(
+      SDL_GL_GetProcAddress(get_name.c_str()));
+  program_binary = reinterpret_cast<ProgramBinaryFunc>(
+      SDL_GL_GetProcAddress(set_name.c_str()));
+  return get_program_binary && program_binary;
+}
+
+void ShaderCache::Initialize(const fplbase::Renderer& renderer) {
+  bool loaded = false;
+  if (renderer.feature_level() >= fplbase::kFeatureLevel30 ||
+      SDL_GL_ExtensionSupported("GL_ARB_get_program_binary")) {
+    loaded = LoadProgramBinaryFunctions("");
+  } else if (SDL_GL_ExtensionSupported("GL_OES_get_program_binary")) {
+    loaded = LoadProgramBinaryFunctions("OES");
+  }
+  // Some drivers expose the functions, but can't save any formats.
+  GLint num_formats = 0;
+  if (loaded) glGetIntegerv(kNumProgramBinaryFormats, &num_formats);
+  supported_ = num_formats > 0;
+  if (!supported_) {
+    LogInfo("Program binaries aren't supported; shaders will be recompiled "
+            "when rendering options change.");
+    return;
+  }
+
+  // A driver update can change what its binaries mean.
+  driver_hash_ = HashString(glGetString(GL_VENDOR), kFnvOffsetBasis);
+  driver_hash_ = HashString(glGetString(GL_RENDERER), driver_hash_);
+  driver_hash_ = HashString(glGetString(GL_VERSION), driver_hash_);
+
+  if (!fplbase::GetStoragePath(kStorageAppName, &storage_path_)) {
+    storage_path_.clear();
+  }
+}
+
+GLuint ShaderCache::Program(const fplbase::Shader* shader,
+                            const fplbase::Renderer& renderer) {
+  shader->Set(renderer);
+  GLint program = 0;
+  GL_CALL(glGetIntegerv(GL_CURRENT_PROGRAM, &program));
+  return static_cast<GLuint>(program);
+}
+
+uint64_t ShaderCache::SourceHash(GLuint program) {
+  GLuint shaders[2] = {0, 0};
+  GLsizei count = 0;
+  GL_CALL(glGetAttachedShaders(program, 2, &count, shaders));
+
+  // The order shaders are returned in isn't defined, so their hashes are
+  // combined in a way that doesn't depend on it.
+  uint64_t hash = 0;
+  std::string source;
+  for (GLsizei i = 0; i < count; ++i) {
+    GLint type = 0;
+    GLint length = 0;
+    GL_CALL(glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type));
+    GL_CALL(glGetShaderiv(shaders[i], GL_SHADER_SOURCE_LENGTH, &length));
+    source.resize(length > 0 ? length : 0);
+    if (length > 0) {
+      GL_CALL(glGetShaderSource(shaders[i], length, nullptr, &source[0]));
+    }
+    hash += Hash(source.data(), source.size(), Hash(&type, sizeof(type)));
+  }
+  return hash;
+}
+
+std::string ShaderCache::Filename(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "shader_%08x%08x.bin",
+           static_cast<unsigned int>(key >> 32),
+           static_cast<unsigned int>(key & 0xFFFFFFFF));
+  return storage_path_ + name;
+}
+
+bool ShaderCache::Find(uint64_t key, Binary* binary) {
+  auto it = binaries_.find(key);
+  if (it != binaries_.end()) {
+    *binary = it->second;
+    return true;
+  }
+  if (storage_path_.empty()) return false;
+
+  std::string contents;
+  if (!fplbase::LoadPreferences(Filename(key).c_str(), &contents) ||
+      contents.size() <= sizeof(FileHeader)) {
+    return false;
+  }
+  FileHeader header;
+  memcpy(&header, contents.data(), sizeof(header));
+  if (header.magic != kFileMagic) return false;
+  binary->format = header.format;
+  binary->data = contents.substr(sizeof(header));
+
+  // Try saved binaries in a scratch program first, since a program that
+  // fails to load one is left unusable.
+  const GLuint scratch = glCreateProgram();
+  program_binary(scratch, binary->format, binary->data.data(),
+                 static_cast<GLsizei>(binary->data.size()));
+  GLint linked = 0;
+  GL_CALL(glGetProgramiv(scratch, GL_LINK_STATUS, &linked));
+  GL_CALL(glDeleteProgram(scratch));
+  if (!linked) return false;
+
+  binaries_[key] = *binary;
+  return true;
+}
+
+void ShaderCache::Store(uint64_t key, GLuint program) {
+  GLint length = 0;
+  GL_CALL(glGetProgramiv(program, kProgramBinaryLength, &length));
+  if (length <= 0) return;
+
+  Binary binary;
+  binary.format = 0;
+  binary.data.resize(length);
+  GLsizei written = 0;
+  get_program_binary(program, length, &written, &binary.format,
+                     &binary.data[0]);
+  if (written <= 0) return;
+  binary.data.resize(written);
+  binaries_[key] = binary;
+
+  if (storage_path_.empty()) return;
+  FileHeader header;
+  header.magic = kFileMagic;
+  header.format = binary.format;
+  std::string contents(reinterpret_cast<const char*>(&header), sizeof(header));
+  contents += binary.data;
+  fplbase::SavePreferences(Filename(key).c_str(), contents.data(),
+                           contents.size());
+}
+
+void ShaderCache::Reload(fplbase::Shader* shader,
+                         const fplbase::Renderer& renderer) {
+  if (!supported_) {
+    shader->ReloadIfDirty();
+    return;
+  }
+
+  // Recompiling replaces the program's shaders, so the source is hashed the
+  // first time a shader is seen. Every launch sees the same first program.
+  GLuint program = Program(shader, renderer);
+  auto source = source_hashes_.find(shader);
+  if (source == source_hashes_.end()) {
+    source = source_hashes_.insert(std::make_pair(shader, SourceHash(program)))
+                 .first;
+  }
+  const uint64_t parts[] = {source->second, driver_hash_};
+  const uint64_t key = Hash(defines_.data(), defines_.size(),
+                            Hash(parts, sizeof(parts)));
+  auto current = current_keys_.find(shader);
+  if (current != current_keys_.end() && current->second == key) return;
+
+  Binary binary;
+  if (Find(key, &binary)) {
+    program_binary(program, binary.format, binary.data.data(),
+                   static_cast<GLsizei>(binary.data.size()));
+    GLint linked = 0;
+    GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+    if (linked) {
+      shader->InitializeUniforms();
+      current_keys_[shader] = key;
+      return;
+    }
+    LogError("Couldn't restore a cached shader program; recompiling.");
+    binaries_.erase(key);
+  }
+
+  shader->ReloadIfDirty();
+  Store(key, Program(shader, renderer));
+  current_keys_[shader] = key;
+}
+
+}  // zooshi
+}  // fpl
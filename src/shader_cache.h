@@ -0,0 +1,83 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_SHADER_CACHE_H_
+#define ZOOSHI_SHADER_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "fplbase/shader.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Keeps the program binaries shaders are linked into for each set of global
+// defines, and saves them between launches, so turning rendering options on
+// and off restores programs instead of compiling them again. Uses
+// GL_OES_get_program_binary on GLES 2.0, and GL_ARB_get_program_binary or
+// the core functions elsewhere. Without them, Reload() just recompiles.
+//
+// Binaries are keyed by the shader's source, the defines and the driver, so
+// they're never restored into a program they weren't built from. All calls
+// must be made on the render thread.
+class ShaderCache {
+ public:
+  ShaderCache() : supported_(false), driver_hash_(0) {}
+
+  // Look up the program binary functions. Needs a current GL context.
+  void Initialize(const fplbase::Renderer& renderer);
+
+  bool supported() const { return supported_; }
+
+  // Name the global defines shaders will be reloaded with. Call after
+  // fplbase::AssetManager::ResetGlobalShaderDefines().
+  void set_defines(const std::string& defines) { defines_ = defines; }
+
+  // Use in place of shader->ReloadIfDirty(). Restores the shader's program
+  // for the current defines if it's been built before, or else recompiles it
+  // and keeps the result.
+  void Reload(fplbase::Shader* shader, const fplbase::Renderer& renderer);
+
+ private:
+  struct Binary {
+    GLenum format;
+    std::string data;
+  };
+
+  static GLuint Program(const fplbase::Shader* shader,
+                        const fplbase::Renderer& renderer);
+  static uint64_t SourceHash(GLuint program);
+  std::string Filename(uint64_t key) const;
+  bool Find(uint64_t key, Binary* binary);
+  void Store(uint64_t key, GLuint program);
+
+  bool supported_;
+  uint64_t driver_hash_;
+  std::string defines_;
+  // Where binaries are saved. Empty if they can't be.
+  std::string storage_path_;
+  // The hash of each shader's source, from its first program, and the key
+  // its program was last built or restored with.
+  std::unordered_map<const fplbase::Shader*, uint64_t> source_hashes_;
+  std::unordered_map<const fplbase::Shader*, uint64_t> current_keys_;
+  std::unordered_map<uint64_t, Binary> binaries_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_SHADER_CACHE_H_
@@ -0,0 +1,94 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shader_uniforms.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace fpl {
+namespace zooshi {
+
+ShaderUniforms::UniformId ShaderUniforms::Register(const char* define,
+                                                   const char* name,
+                                                   int num_components) {
+  assert(num_components > 0 && num_components <= kMaxComponents);
+  Uniform uniform;
+  uniform.define = define;
+  uniform.name = name;
+  uniform.num_components = num_components;
+  memset(uniform.value, 0, sizeof(uniform.value));
+  uniform.dirty = true;
+  uniforms_.push_back(uniform);
+  return uniforms_.size() - 1;
+}
+
+void ShaderUniforms::Refresh(fplbase::AssetManager* asset_manager,
+                             ShaderCache* shader_cache,
+                             const fplbase::Renderer& renderer) {
+  for (auto it = uniforms_.begin(); it != uniforms_.end(); ++it) {
+    Uniform& uniform = *it;
+    uniform.shaders.clear();
+    uniform.handles.clear();
+    uniform.dirty = true;
+    asset_manager->ForEachShaderWithDefine(
+        uniform.define, [&](fplbase::Shader* shader) {
+          // Handles found before a pending reload would be stale.
+          shader_cache->Reload(shader, renderer);
+          fplbase::UniformHandle handle = shader->FindUniform(uniform.name);
+          if (!fplbase::ValidUniformHandle(handle)) return;
+          uniform.shaders.push_back(shader);
+          uniform.handles.push_back(handle);
+        });
+  }
+}
+
+void ShaderUniforms::Set(UniformId id, const float* value,
+                         int num_components) {
+  Uniform& uniform = uniforms_[id];
+  assert(uniform.num_components == num_components);
+  const size_t size = num_components * sizeof(float);
+  if (memcmp(uniform.value, value, size) == 0) return;
+  memcpy(uniform.value, value, size);
+  uniform.dirty = true;
+}
+
+void ShaderUniforms::Set(UniformId id, float value) { Set(id, &value, 1); }
+
+void ShaderUniforms::Set(UniformId id, const mathfu::vec4& value) {
+  // mathfu vectors may be padded, so copy them out first.
+  const float values[] = {value.x(), value.y(), value.z(), value.w()};
+  Set(id, values, 4);
+}
+
+void ShaderUniforms::Set(UniformId id, const mathfu::mat4& value) {
+  float values[16];
+  for (int i = 0; i < 16; ++i) values[i] = value[i];
+  Set(id, values, 16);
+}
+
+void ShaderUniforms::Apply() {
+  for (auto it = uniforms_.begin(); it != uniforms_.end(); ++it) {
+    Uniform& uniform = *it;
+    if (!uniform.dirty) continue;
+    for (size_t i = 0; i < uniform.shaders.size(); ++i) {
+      uniform.shaders[i]->SetUniform(uniform.handles[i], uniform.value,
+                                     uniform.num_components);
+    }
+    uniform.dirty = false;
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,82 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_SHADER_UNIFORMS_H_
+#define ZOOSHI_SHADER_UNIFORMS_H_
+
+#include <stddef.h>
+#include <vector>
+#include "fplbase/asset_manager.h"
+#include "fplbase/shader.h"
+#include "mathfu/glsl_mappings.h"
+#include "shader_cache.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Uniforms that are shared by every shader compiled with a given define, such
+// as the fog and lighting parameters. The shaders and each uniform's handle
+// in them are looked up once, rather than by name every frame, and a value is
+// only sent again once it changes.
+//
+// All calls must be made on the render thread.
+class ShaderUniforms {
+ public:
+  typedef size_t UniformId;
+
+  // Add a uniform with `num_components` floats (1 to 4, or 16 for a matrix),
+  // sent to every shader compiled with `define`. Both strings must outlive
+  // this object.
+  UniformId Register(const char* define, const char* name,
+                     int num_components);
+
+  // Look up the shaders and handles for every uniform. Call whenever shaders
+  // are (re)loaded, since that loses their uniforms' values and handles.
+  // Every uniform is sent again at the next Apply(). Shaders with pending
+  // reloads are reloaded through `shader_cache`.
+  void Refresh(fplbase::AssetManager* asset_manager, ShaderCache* shader_cache,
+               const fplbase::Renderer& renderer);
+
+  // Set a uniform's value, to be sent at the next Apply() if it changed.
+  void Set(UniformId id, float value);
+  void Set(UniformId id, const mathfu::vec4& value);
+  void Set(UniformId id, const mathfu::mat4& value);
+
+  // Send the uniforms that changed since the last Apply().
+  void Apply();
+
+ private:
+  static const int kMaxComponents = 16;
+
+  struct Uniform {
+    const char* define;
+    const char* name;
+    int num_components;
+    float value[kMaxComponents];
+    // True if `value` hasn't been sent since it was set.
+    bool dirty;
+    // The shaders compiled with `define`, and the uniform's handle in each.
+    std::vector<fplbase::Shader*> shaders;
+    std::vector<fplbase::UniformHandle> handles;
+  };
+
+  void Set(UniformId id, const float* value, int num_components);
+
+  std::vector<Uniform> uniforms_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_SHADER_UNIFORMS_H_
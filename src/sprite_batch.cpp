@@ -0,0 +1,203 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sprite_batch.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <algorithm>
+#include "fplbase/mesh.h"
+#include "fplbase/utilities.h"
+#include "mathfu/constants.h"
+
+using mathfu::mat4;
+using mathfu::vec2;
+using mathfu::vec4;
+
+namespace fpl {
+namespace zooshi {
+
+// 16 bit indices can reach this many quads' vertices.
+static const size_t kMaxQuads = 0x10000 / 4;
+
+static uint8_t ColorByte(float value) {
+  return static_cast<uint8_t>(mathfu::Clamp(value, 0.0f, 1.0f) * 255.0f +
+                              0.5f);
+}
+
+SpriteBatch::~SpriteBatch() {
+  if (vertex_buffer_ != 0) GL_CALL(glDeleteBuffers(1, &vertex_buffer_));
+  if (index_buffer_ != 0) GL_CALL(glDeleteBuffers(1, &index_buffer_));
+}
+
+void SpriteBatch::Initialize(fplbase::AssetManager* asset_manager) {
+  shader_ = asset_manager->LoadShader("shaders/sprite");
+  if (vertex_buffer_ == 0) GL_CALL(glGenBuffers(1, &vertex_buffer_));
+  if (index_buffer_ == 0) GL_CALL(glGenBuffers(1, &index_buffer_));
+}
+
+void SpriteBatch::Begin(const mathfu::vec2i& window_size) {
+  window_size_ = window_size;
+  quads_.clear();
+}
+
+void SpriteBatch::Add(fplbase::Texture* texture, const vec2& position,
+                      const vec2& size, const vec4& color, Layer layer) {
+  if (texture == nullptr) return;
+  AddQuad(texture, nullptr, position, size, color, layer, false);
+}
+
+void SpriteBatch::Add(fplbase::RenderTarget* target, const vec2& position,
+                      const vec2& size, const vec4& color, Layer layer) {
+  if (target == nullptr) return;
+  // Render targets are drawn upside down.
+  AddQuad(nullptr, target, position, size, color, layer, true);
+}
+
+void SpriteBatch::AddQuad(fplbase::Texture* texture,
+                          fplbase::RenderTarget* target, const vec2& position,
+                          const vec2& size, const vec4& color, Layer layer,
+                          bool flip_v) {
+  if (quads_.size() >= kMaxQuads) return;
+  quads_.push_back(Quad());
+  Quad& quad = quads_.back();
+  quad.layer = layer;
+  quad.texture = texture;
+  quad.target = target;
+
+  const vec2 corners[] = {position, position + vec2(size.x, 0.0f),
+                          position + vec2(0.0f, size.y), position + size};
+  const float top = flip_v ? 1.0f : 0.0f;
+  const vec2 uvs[] = {vec2(0.0f, top), vec2(1.0f, top),
+                      vec2(0.0f, 1.0f - top), vec2(1.0f, 1.0f - top)};
+  for (int i = 0; i < 4; ++i) {
+    Vertex& vertex = quad.vertices[i];
+    vertex.position[0] = corners[i].x;
+    vertex.position[1] = corners[i].y;
+    vertex.position[2] = 0.0f;
+    vertex.uv[0] = uvs[i].x;
+    vertex.uv[1] = uvs[i].y;
+    vertex.color[0] = ColorByte(color.x);
+    vertex.color[1] = ColorByte(color.y);
+    vertex.color[2] = ColorByte(color.z);
+    vertex.color[3] = ColorByte(color.w);
+  }
+}
+
+void SpriteBatch::Upload(size_t num_quads) {
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(Vertex),
+                       vertices_.data(), GL_STREAM_DRAW));
+
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_));
+  if (num_quads > index_buffer_quads_) {
+    std::vector<uint16_t> indices;
+    indices.reserve(num_quads * 6);
+    static const uint16_t kQuadIndices[] = {0, 1, 2, 2, 1, 3};
+    for (size_t quad = 0; quad < num_quads; ++quad) {
+      for (int i = 0; i < 6; ++i) {
+        indices.push_back(static_cast<uint16_t>(quad * 4 + kQuadIndices[i]));
+      }
+    }
+    GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                         indices.size() * sizeof(uint16_t), indices.data(),
+                         GL_STATIC_DRAW));
+    index_buffer_quads_ = num_quads;
+  }
+}
+
+void SpriteBatch::End(fplbase::Renderer& renderer) {
+  if (quads_.empty()) return;
+  assert(shader_ != nullptr && vertex_buffer_ != 0);
+
+  // Keep each layer's textures together, and otherwise the order the quads
+  // were added in.
+  std::stable_sort(quads_.begin(), quads_.end(),
+                   [](const Quad& a, const Quad& b) {
+    if (a.layer != b.layer) return a.layer < b.layer;
+    const void* a_key = a.texture != nullptr
+                            ? static_cast<const void*>(a.texture)
+                            : static_cast<const void*>(a.target);
+    const void* b_key = b.texture != nullptr
+                            ? static_cast<const void*>(b.texture)
+                            : static_cast<const void*>(b.target);
+    return a_key < b_key;
+  });
+  vertices_.clear();
+  for (auto it = quads_.begin(); it != quads_.end(); ++it) {
+    vertices_.insert(vertices_.end(), it->vertices, it->vertices + 4);
+  }
+
+  const vec2 size = vec2(window_size_);
+  renderer.SetViewport(mathfu::vec4i(0, 0, window_size_.x, window_size_.y));
+  renderer.set_model_view_projection(
+      mat4::Ortho(0.0f, size.x, size.y, 0.0f, -1.0f, 1.0f));
+  renderer.set_color(mathfu::kOnes4f);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionDisabled);
+  renderer.SetCulling(fplbase::kCullingModeNone);
+  renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+  shader_->Set(renderer);
+
+  Upload(quads_.size());
+  const GLuint position = fplbase::Mesh::kAttributePosition;
+  const GLuint uv = fplbase::Mesh::kAttributeTexCoord;
+  const GLuint color = fplbase::Mesh::kAttributeColor;
+  GL_CALL(glEnableVertexAttribArray(position));
+  GL_CALL(glEnableVertexAttribArray(uv));
+  GL_CALL(glEnableVertexAttribArray(color));
+  GL_CALL(glVertexAttribPointer(
+      position, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      reinterpret_cast<const void*>(offsetof(Vertex, position))));
+  GL_CALL(glVertexAttribPointer(
+      uv, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      reinterpret_cast<const void*>(offsetof(Vertex, uv))));
+  GL_CALL(glVertexAttribPointer(
+      color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+      reinterpret_cast<const void*>(offsetof(Vertex, color))));
+
+  // One draw for each run of quads with the same layer and texture.
+  size_t first = 0;
+  while (first < quads_.size()) {
+    const Quad& quad = quads_[first];
+    size_t end = first + 1;
+    while (end < quads_.size() && quads_[end].layer == quad.layer &&
+           quads_[end].texture == quad.texture &&
+           quads_[end].target == quad.target) {
+      ++end;
+    }
+    if (quad.texture != nullptr) {
+      quad.texture->Set(0);
+    } else {
+      quad.target->BindAsTexture(0);
+    }
+    GL_CALL(glDrawElements(
+        GL_TRIANGLES, static_cast<GLsizei>((end - first) * 6),
+        GL_UNSIGNED_SHORT,
+        reinterpret_cast<const void*>(first * 6 * sizeof(uint16_t))));
+    first = end;
+  }
+
+  GL_CALL(glDisableVertexAttribArray(position));
+  GL_CALL(glDisableVertexAttribArray(uv));
+  GL_CALL(glDisableVertexAttribArray(color));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  quads_.clear();
+
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+  renderer.SetCulling(fplbase::kCullingModeBack);
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,109 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_SPRITE_BATCH_H_
+#define ZOOSHI_SPRITE_BATCH_H_
+
+#include <stdint.h>
+#include <vector>
+#include "fplbase/asset_manager.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/render_target.h"
+#include "fplbase/renderer.h"
+#include "fplbase/shader.h"
+#include "fplbase/texture.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Collects the textured screen-space quads drawn over a frame, such as HUD
+// widgets and fades, and draws them all at once at the end of it. Quads are
+// sorted by layer and then texture, and uploaded to one stream vertex buffer,
+// so there's one draw call for each texture in each layer, rather than a
+// shader, texture and draw for each quad. Each quad's tint goes in its
+// vertices, so it doesn't break up the draws.
+class SpriteBatch {
+ public:
+  // Layers are drawn in order. Quads within a layer are drawn in whatever
+  // order keeps textures together, so they shouldn't overlap.
+  enum Layer { kLayerHud, kLayerHudOverlay, kLayerFade, kLayerCount };
+
+  SpriteBatch()
+      : shader_(nullptr),
+        window_size_(mathfu::kZeros2i),
+        vertex_buffer_(0),
+        index_buffer_(0),
+        index_buffer_quads_(0) {}
+  ~SpriteBatch();
+
+  // Needs a current GL context.
+  void Initialize(fplbase::AssetManager* asset_manager);
+
+  bool initialized() const { return shader_ != nullptr; }
+
+  // Start collecting quads for a window of `window_size` pixels, with the
+  // origin at its top left, like input pointers.
+  void Begin(const mathfu::vec2i& window_size);
+
+  const mathfu::vec2i& window_size() const { return window_size_; }
+
+  // Queue `texture` drawn over the rectangle at `position`, `size` pixels
+  // big, tinted by `color`.
+  void Add(fplbase::Texture* texture, const mathfu::vec2& position,
+           const mathfu::vec2& size, const mathfu::vec4& color,
+           Layer layer = kLayerHud);
+
+  // Like Add(), with what's been drawn into `target`.
+  void Add(fplbase::RenderTarget* target, const mathfu::vec2& position,
+           const mathfu::vec2& size, const mathfu::vec4& color,
+           Layer layer = kLayerHud);
+
+  // Draw the queued quads over the screen.
+  void End(fplbase::Renderer& renderer);
+
+ private:
+  struct Vertex {
+    float position[3];
+    float uv[2];
+    uint8_t color[4];
+  };
+  struct Quad {
+    Layer layer;
+    // One of these is set.
+    fplbase::Texture* texture;
+    fplbase::RenderTarget* target;
+    Vertex vertices[4];
+  };
+
+  void AddQuad(fplbase::Texture* texture, fplbase::RenderTarget* target,
+               const mathfu::vec2& position, const mathfu::vec2& size,
+               const mathfu::vec4& color, Layer layer, bool flip_v);
+  void Upload(size_t num_quads);
+
+  fplbase::Shader* shader_;
+  mathfu::vec2i window_size_;
+  std::vector<Quad> quads_;
+  std::vector<Vertex> vertices_;
+  GLuint vertex_buffer_;
+  // Two triangles for each quad, for as many quads as have been drawn at
+  // once, which only needs to grow.
+  GLuint index_buffer_;
+  size_t index_buffer_quads_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_SPRITE_BATCH_H_
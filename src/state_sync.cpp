@@ -0,0 +1,309 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "state_sync.h"
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+
+using mathfu::vec3;
+
+namespace fpl {
+namespace zooshi {
+
+// Positions and velocities are sent in hundredths of a unit.
+static const float kPositionScale = 100.0f;
+static const float kVelocityScale = 100.0f;
+// Headings are sent in 65536ths of a turn.
+static const float kHeadingSteps = 65536.0f;
+static const float kTwoPi = 6.28318530718f;
+
+// Marks patrons whose state hasn't been set.
+static const uint8_t kUnknownPatronState = 0xFF;
+
+// How many packets to remember on each side for use as baselines. At 60
+// packets a second, an acknowledgement older than about half a second falls
+// back to sending absolute state.
+static const size_t kHistorySize = 32;
+
+// Spawns the peer hasn't acknowledged after this many are queued are dropped,
+// as the peer has probably gone.
+static const size_t kMaxPendingSpawns = 128;
+
+static int32_t Quantize(float value, float scale) {
+  return static_cast<int32_t>(floorf(value * scale + 0.5f));
+}
+
+static int16_t QuantizeShort(float value, float scale) {
+  const int32_t quantized = Quantize(value, scale);
+  return static_cast<int16_t>(std::min(std::max(quantized, -32767), 32767));
+}
+
+StateSync::StateSync() { Reset(); }
+
+void StateSync::Reset() {
+  local_ = Snapshot();
+  sent_.clear();
+  pending_spawns_.clear();
+  pending_confirms_.clear();
+  next_spawn_id_ = 1;
+  acked_ = 0;
+  remote_ = Snapshot();
+  received_.clear();
+  last_remote_spawn_id_ = 0;
+  last_confirm_id_ = 0;
+  remote_spawns_.clear();
+  remote_confirms_.clear();
+}
+
+void StateSync::SetRaft(const vec3& position, float heading) {
+  for (int i = 0; i < 3; i++) {
+    local_.position[i] = Quantize(position[i], kPositionScale);
+  }
+  local_.heading = Quantize(heading / kTwoPi, kHeadingSteps) & 0xFFFF;
+}
+
+void StateSync::SetPatronState(int index, int state) {
+  if (index < 0) return;
+  if (static_cast<size_t>(index) >= local_.patron_states.size()) {
+    local_.patron_states.resize(index + 1, kUnknownPatronState);
+  }
+  local_.patron_states[index] = static_cast<uint8_t>(state);
+}
+
+static SyncProjectileSpawn QuantizeSpawn(uint32_t id, const vec3& position,
+                                         const vec3& velocity, int type) {
+  return SyncProjectileSpawn(id, Quantize(position.x(), kPositionScale),
+                             Quantize(position.y(), kPositionScale),
+                             Quantize(position.z(), kPositionScale),
+                             QuantizeShort(velocity.x(), kVelocityScale),
+                             QuantizeShort(velocity.y(), kVelocityScale),
+                             QuantizeShort(velocity.z(), kVelocityScale),
+                             static_cast<uint8_t>(type));
+}
+
+uint32_t StateSync::AddSpawn(const vec3& position, const vec3& velocity,
+                             int type) {
+  const uint32_t id = next_spawn_id_++;
+  AddPending(QuantizeSpawn(id, position, velocity, type), &pending_spawns_);
+  return id;
+}
+
+void StateSync::ConfirmSpawn(const SyncedSpawn& spawn) {
+  AddPending(QuantizeSpawn(spawn.id, spawn.position, spawn.velocity,
+                           spawn.type),
+             &pending_confirms_);
+}
+
+const uint8_t* StateSync::BuildPacket(size_t* size) {
+  local_.sequence++;
+
+  // Send differences from the newest packet the peer has, if we remember it.
+  static const Snapshot kZero;
+  const Snapshot* baseline = FindSnapshot(sent_, acked_);
+  const Snapshot& base = baseline != nullptr ? *baseline : kZero;
+
+  fbb_.Clear();
+  auto raft = CreateSyncRaft(
+      fbb_, local_.position[0] - base.position[0],
+      local_.position[1] - base.position[1],
+      local_.position[2] - base.position[2],
+      static_cast<int16_t>(
+          static_cast<uint16_t>(local_.heading - base.heading)));
+
+  GatherPending(local_.sequence, &pending_spawns_, &spawn_buffer_);
+  flatbuffers::Offset<flatbuffers::Vector<const SyncProjectileSpawn*>> spawns;
+  if (!spawn_buffer_.empty()) {
+    spawns = fbb_.CreateVectorOfStructs(spawn_buffer_);
+  }
+  GatherPending(local_.sequence, &pending_confirms_, &confirm_buffer_);
+  flatbuffers::Offset<flatbuffers::Vector<const SyncProjectileSpawn*>>
+      confirms;
+  if (!confirm_buffer_.empty()) {
+    confirms = fbb_.CreateVectorOfStructs(confirm_buffer_);
+  }
+
+  patron_buffer_.clear();
+  for (size_t i = 0; i < local_.patron_states.size(); i++) {
+    const uint8_t base_state = i < base.patron_states.size()
+                                   ? base.patron_states[i]
+                                   : kUnknownPatronState;
+    if (local_.patron_states[i] != base_state) {
+      patron_buffer_.push_back(SyncPatron(static_cast<uint16_t>(i),
+                                          local_.patron_states[i]));
+    }
+  }
+  flatbuffers::Offset<flatbuffers::Vector<const SyncPatron*>> patrons;
+  if (!patron_buffer_.empty()) {
+    patrons = fbb_.CreateVectorOfStructs(patron_buffer_);
+  }
+
+  fbb_.Finish(CreateSyncPacket(fbb_, local_.sequence,
+                               baseline != nullptr ? baseline->sequence : 0,
+                               remote_.sequence, local_.time, raft, spawns,
+                               patrons, confirms));
+  Remember(local_, &sent_);
+
+  *size = fbb_.GetSize();
+  return fbb_.GetBufferPointer();
+}
+
+bool StateSync::ReadPacket(const uint8_t* data, size_t size) {
+  flatbuffers::Verifier verifier(data, size);
+  if (!verifier.VerifyBuffer<SyncPacket>(nullptr)) return false;
+  const SyncPacket* packet = flatbuffers::GetRoot<SyncPacket>(data);
+
+  // Unreliable packets can arrive late. Only the newest state matters.
+  if (packet->sequence() <= remote_.sequence) return false;
+  const Snapshot* baseline = nullptr;
+  if (packet->baseline() != 0) {
+    baseline = FindSnapshot(received_, packet->baseline());
+    if (baseline == nullptr) return false;
+  }
+
+  // Rebuild the peer's state from the baseline and the differences.
+  if (baseline != nullptr) {
+    remote_ = *baseline;
+  } else {
+    std::fill(remote_.position, remote_.position + 3, 0);
+    remote_.heading = 0;
+    remote_.patron_states.clear();
+  }
+  remote_.sequence = packet->sequence();
+  remote_.time = packet->time();
+
+  const SyncRaft* raft = packet->raft();
+  if (raft != nullptr) {
+    remote_.position[0] += raft->x();
+    remote_.position[1] += raft->y();
+    remote_.position[2] += raft->z();
+    remote_.heading = (remote_.heading + raft->heading()) & 0xFFFF;
+  }
+  if (packet->patrons() != nullptr) {
+    for (flatbuffers::uoffset_t i = 0; i < packet->patrons()->size(); i++) {
+      const SyncPatron* patron = packet->patrons()->Get(i);
+      if (patron->index() >= remote_.patron_states.size()) {
+        remote_.patron_states.resize(patron->index() + 1, kUnknownPatronState);
+      }
+      remote_.patron_states[patron->index()] = patron->state();
+    }
+  }
+  ReadSpawns(packet->spawns(), &last_remote_spawn_id_, &remote_spawns_);
+  ReadSpawns(packet->confirms(), &last_confirm_id_, &remote_confirms_);
+  Remember(remote_, &received_);
+
+  // Stop resending spawns the peer has now seen.
+  if (packet->ack() > acked_ && packet->ack() <= local_.sequence) {
+    acked_ = packet->ack();
+  }
+  DropAcknowledged(acked_, &pending_spawns_);
+  DropAcknowledged(acked_, &pending_confirms_);
+  return true;
+}
+
+vec3 StateSync::remote_raft_position() const {
+  return vec3(static_cast<float>(remote_.position[0]),
+              static_cast<float>(remote_.position[1]),
+              static_cast<float>(remote_.position[2])) /
+         kPositionScale;
+}
+
+float StateSync::remote_raft_heading() const {
+  return static_cast<float>(remote_.heading) * kTwoPi / kHeadingSteps;
+}
+
+int StateSync::remote_patron_state(int index) const {
+  if (index < 0 ||
+      static_cast<size_t>(index) >= remote_.patron_states.size() ||
+      remote_.patron_states[index] == kUnknownPatronState) {
+    return -1;
+  }
+  return remote_.patron_states[index];
+}
+
+void StateSync::AddPending(const SyncProjectileSpawn& spawn,
+                           std::deque<PendingSpawn>* pending) {
+  if (pending->size() >= kMaxPendingSpawns) pending->pop_front();
+  PendingSpawn queued;
+  queued.sequence = 0;
+  queued.spawn = spawn;
+  pending->push_back(queued);
+}
+
+void StateSync::GatherPending(uint32_t sequence,
+                              std::deque<PendingSpawn>* pending,
+                              std::vector<SyncProjectileSpawn>* buffer) {
+  buffer->clear();
+  for (auto it = pending->begin(); it != pending->end(); ++it) {
+    if (it->sequence == 0) it->sequence = sequence;
+    buffer->push_back(it->spawn);
+  }
+}
+
+void StateSync::DropAcknowledged(uint32_t acked,
+                                 std::deque<PendingSpawn>* pending) {
+  while (!pending->empty() && pending->front().sequence != 0 &&
+         pending->front().sequence <= acked) {
+    pending->pop_front();
+  }
+}
+
+void StateSync::ReadSpawns(
+    const flatbuffers::Vector<const SyncProjectileSpawn*>* received,
+    uint32_t* last_id, std::vector<SyncedSpawn>* spawns) {
+  if (received == nullptr) return;
+  for (flatbuffers::uoffset_t i = 0; i < received->size(); i++) {
+    const SyncProjectileSpawn* quantized = received->Get(i);
+    // Spawns are repeated until acknowledged, so skip ones already read.
+    if (quantized->id() <= *last_id) continue;
+    *last_id = quantized->id();
+    SyncedSpawn spawn;
+    spawn.id = quantized->id();
+    spawn.position = vec3(static_cast<float>(quantized->x()),
+                          static_cast<float>(quantized->y()),
+                          static_cast<float>(quantized->z())) /
+                     kPositionScale;
+    spawn.velocity = vec3(static_cast<float>(quantized->vx()),
+                          static_cast<float>(quantized->vy()),
+                          static_cast<float>(quantized->vz())) /
+                     kVelocityScale;
+    spawn.type = quantized->type();
+    spawns->push_back(spawn);
+  }
+}
+
+const StateSync::Snapshot* StateSync::FindSnapshot(
+    const std::deque<Snapshot>& history, uint32_t sequence) {
+  if (sequence == 0) return nullptr;
+  for (auto it = history.rbegin(); it != history.rend(); ++it) {
+    if (it->sequence == sequence) return &*it;
+  }
+  return nullptr;
+}
+
+void StateSync::Remember(const Snapshot& snapshot,
+                         std::deque<Snapshot>* history) {
+  if (history->size() < kHistorySize) {
+    history->push_back(snapshot);
+    return;
+  }
+  // Reuse the oldest snapshot's buffer.
+  Snapshot recycled = std::move(history->front());
+  history->pop_front();
+  recycled = snapshot;
+  history->push_back(std::move(recycled));
+}
+
+}  // zooshi
+}  // fpl
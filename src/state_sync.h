@@ -0,0 +1,163 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ZOOSHI_STATE_SYNC_H_
+#define ZOOSHI_STATE_SYNC_H_
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "flatbuffers/flatbuffers.h"
+#include "gpg_generated.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// A projectile thrown by the other side, or the host's copy of one thrown by
+// this side.
+struct SyncedSpawn {
+  // The id the thrower gave it.
+  uint32_t id;
+  mathfu::vec3 position;
+  mathfu::vec3 velocity;
+  int type;
+};
+
+// Builds and reads the SyncPacket messages defined in gpg.fbs, which keep one
+// peer's raft, thrown projectiles and patrons in step with another's. Use one
+// StateSync for each connected peer, since baselines depend on what that peer
+// has acknowledged.
+//
+// Each frame, set the local state and add any spawns, then send the result of
+// BuildPacket() unreliably, as one message. Pass each message received from
+// the peer to ReadPacket(). Lost packets don't need resending: later packets
+// carry the latest state, and spawns are repeated until they're acknowledged.
+class StateSync {
+ public:
+  StateSync();
+
+  // Forget both sides' state, such as for a new session.
+  void Reset();
+
+  // Set the local state to send. `time` is the local world time.
+  void SetTime(uint32_t time) { local_.time = time; }
+  void SetRaft(const mathfu::vec3& position, float heading);
+  void SetPatronState(int index, int state);
+
+  // Send a projectile thrown locally, and return its id.
+  uint32_t AddSpawn(const mathfu::vec3& position, const mathfu::vec3& velocity,
+                    int type);
+
+  // On the host, send back where a spawn from the peer was really thrown, so
+  // the peer can correct its prediction.
+  void ConfirmSpawn(const SyncedSpawn& spawn);
+
+  // Build a packet holding the local state and every unacknowledged spawn.
+  // The buffer is valid until the next call.
+  const uint8_t* BuildPacket(size_t* size);
+
+  // Read a packet from the peer. Returns false if it can't be used: if it's
+  // malformed, older than one already read, or against a baseline that's no
+  // longer remembered.
+  bool ReadPacket(const uint8_t* data, size_t size);
+
+  // The peer's state, as of the newest packet read.
+  uint32_t remote_time() const { return remote_.time; }
+  mathfu::vec3 remote_raft_position() const;
+  float remote_raft_heading() const;
+  // Returns -1 for patrons the peer hasn't sent.
+  int remote_patron_state(int index) const;
+
+  // The peer's spawns read since the last call to ClearRemoteSpawns().
+  const std::vector<SyncedSpawn>& remote_spawns() const {
+    return remote_spawns_;
+  }
+  void ClearRemoteSpawns() { remote_spawns_.clear(); }
+
+  // The host's confirmations of local spawns, read since the last call to
+  // ClearRemoteConfirms().
+  const std::vector<SyncedSpawn>& remote_confirms() const {
+    return remote_confirms_;
+  }
+  void ClearRemoteConfirms() { remote_confirms_.clear(); }
+
+ private:
+  // A state, quantized as it's sent.
+  struct Snapshot {
+    Snapshot() : sequence(0), time(0), heading(0) {
+      position[0] = position[1] = position[2] = 0;
+    }
+    uint32_t sequence;
+    uint32_t time;
+    int32_t position[3];
+    int32_t heading;
+    std::vector<uint8_t> patron_states;
+  };
+
+  struct PendingSpawn {
+    // The first packet that carried this spawn.
+    uint32_t sequence;
+    SyncProjectileSpawn spawn;
+  };
+
+  // Queue `spawn` in `pending`, dropping the oldest if there are too many.
+  static void AddPending(const SyncProjectileSpawn& spawn,
+                         std::deque<PendingSpawn>* pending);
+  // Copy each pending spawn into `buffer`, marking new ones as first sent in
+  // packet `sequence`, and forget ones the peer has acknowledged.
+  static void GatherPending(uint32_t sequence,
+                            std::deque<PendingSpawn>* pending,
+                            std::vector<SyncProjectileSpawn>* buffer);
+  static void DropAcknowledged(uint32_t acked,
+                               std::deque<PendingSpawn>* pending);
+  // Append the spawns in `received` with ids after `last_id` to `spawns`.
+  static void ReadSpawns(
+      const flatbuffers::Vector<const SyncProjectileSpawn*>* received,
+      uint32_t* last_id, std::vector<SyncedSpawn>* spawns);
+
+  // Find the snapshot numbered `sequence` in `history`, or return null.
+  static const Snapshot* FindSnapshot(const std::deque<Snapshot>& history,
+                                      uint32_t sequence);
+  // Remember `snapshot`, and forget the oldest if there are too many.
+  static void Remember(const Snapshot& snapshot,
+                       std::deque<Snapshot>* history);
+
+  // The state to send next, and the packets already sent.
+  Snapshot local_;
+  std::deque<Snapshot> sent_;
+  std::deque<PendingSpawn> pending_spawns_;
+  std::deque<PendingSpawn> pending_confirms_;
+  uint32_t next_spawn_id_;
+  // The newest of our packets the peer has acknowledged.
+  uint32_t acked_;
+
+  // The peer's newest state, and the ones it may still use as baselines.
+  Snapshot remote_;
+  std::deque<Snapshot> received_;
+  uint32_t last_remote_spawn_id_;
+  uint32_t last_confirm_id_;
+  std::vector<SyncedSpawn> remote_spawns_;
+  std::vector<SyncedSpawn> remote_confirms_;
+
+  // Reused while building packets.
+  flatbuffers::FlatBufferBuilder fbb_;
+  std::vector<SyncProjectileSpawn> spawn_buffer_;
+  std::vector<SyncProjectileSpawn> confirm_buffer_;
+  std::vector<SyncPatron> patron_buffer_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_STATE_SYNC_H_
@@ -33,7 +33,9 @@
 #include "motive/init.h"
 #include "motive/math/angle.h"
 #include "rail_def_generated.h"
+#include "resume_snapshot.h"
 #include "save_data_generated.h"
+#include "save_store.h"
 #include "states/states.h"
 #include "states/states_common.h"
 #include "world.h"
@@ -67,13 +69,21 @@ void GameMenuState::Initialize(
   audio_engine_ = audio_engine;
   config_ = config;
   fader_ = fader;
+  prewarm_step_ = 0;
 
   sound_start_ = audio_engine->GetSoundHandle("start");
   sound_click_ = audio_engine->GetSoundHandle("click");
   sound_select_ = audio_engine->GetSoundHandle("select");
   sound_adjust_ = sound_select_;
   sound_exit_ = audio_engine->GetSoundHandle("exit");
-  music_menu_ = audio_engine->GetSoundHandle("music_menu");
+  music_menu_ = nullptr;
+  music_wanted_ = false;
+  world_->asset_loader->OnGroupLoaded(kMusicAssetGroup, [this]() {
+    music_menu_ = audio_engine_->GetSoundHandle("music_menu");
+    if (music_wanted_ && !music_channel_.Valid()) {
+      music_channel_ = audio_engine_->PlaySound(music_menu_);
+    }
+  });
 
   // Set menu state.
   menu_state_ = kMenuStateStart;
@@ -115,6 +125,7 @@ void GameMenuState::Initialize(
   }
 
   gpg_manager_ = gpg_manager;
+  menu_cache_.Initialize(config->menu_cache(), asset_manager_);
 
 #ifdef USING_GOOGLE_PLAY_GAMES
   image_gpg_ = asset_manager_->LoadTexture("textures/games_controller.webp");
@@ -141,7 +152,7 @@ void GameMenuState::Initialize(
 }
 
 void GameMenuState::AdvanceFrame(int delta_time, int *next_state) {
-  world_->entity_manager.UpdateComponents(delta_time);
+  world_->UpdateComponents(delta_time);
   UpdateMainCamera(&main_camera_, world_);
 
   if (rewarded_video_state_ == kRewardedVideoStateDisplaying) {
@@ -207,7 +218,7 @@ void GameMenuState::AdvanceFrame(int delta_time, int *next_state) {
     }
   } else if (menu_state_ == kMenuStateSendingInvite) {
     bool did_send, first_sent;
-    if (UpdateSentInviteStatus(&did_send, &first_sent)) {
+    if (UpdateSentInviteStatus(world_->save_store, &did_send, &first_sent)) {
       if (did_send) {
         // Put up a message thanking them for inviting others.
         // If it was the first time they've sent an invite, reward them.
@@ -246,7 +257,7 @@ void GameMenuState::RenderPrep() {
 void GameMenuState::Render(fplbase::Renderer *renderer) {
   // Ensure assets are instantiated after they've been loaded.
   // This must be called from the render thread.
-  loading_complete_ = asset_manager_->TryFinalize();
+  loading_complete_ = world_->asset_loader->TryFinalize();
 
   Camera *cardboard_camera = nullptr;
 #if FPLBASE_ANDROID_VR
@@ -267,8 +278,22 @@ void GameMenuState::HandleUI(fplbase::Renderer *renderer) {
   if (rewarded_video_state_ != kRewardedVideoStateIdle) {
     rewarded_video_state_ =
         RewardedVideoMenu(*asset_manager_, *font_manager_, *input_system_);
+    menu_cache_.Invalidate();
+    return;
+  }
+
+  // Menus are drawn from the cache until they can change. The quit menu
+  // fades out, so it's always run, as is the Cardboard UI.
+  const bool cacheable = menu_state_ != kMenuStateQuit &&
+                         world_->rendering_mode() != kRenderingStereoscopic;
+  const int menu_key = (menu_state_ << 8) | options_menu_state_;
+  if (cacheable &&
+      !menu_cache_.NeedsUpdate(*renderer, input_system_, menu_key)) {
+    menu_cache_.Draw(*renderer);
     return;
   }
+  const bool caching = cacheable && menu_cache_.enabled();
+  if (caching) menu_cache_.BeginUpdate(*renderer);
 
   switch (menu_state_) {
     case kMenuStateStart:
@@ -307,23 +332,22 @@ void GameMenuState::HandleUI(fplbase::Renderer *renderer) {
         received_message_ = "";
       }
       break;
-    case kMenuStateQuit: {
-      flatui::Run(*asset_manager_, *font_manager_, *input_system_, [&]() {
-        flatui::CustomElement(
-            flatui::GetVirtualResolution(), "fader",
-            [&](const vec2i & /*pos*/, const vec2i & /*size*/) {
-              fader_->Render(renderer);
-            });
-      });
+    case kMenuStateQuit:
+      fader_->Render(&world_->sprite_batch);
       break;
-    }
 
     default:
       break;
   }
+
+  if (caching) {
+    menu_cache_.EndUpdate(*renderer);
+    menu_cache_.Draw(*renderer);
+  }
 }
 
 void GameMenuState::OnEnter(int previous_state) {
+  menu_cache_.Invalidate();
   // If coming from the gameover state, we want to display the score review,
   // and preserve the values that we want to display, before resetting the
   // world.
@@ -365,12 +389,31 @@ void GameMenuState::OnEnter(int previous_state) {
     if (world_->rendering_mode() == kRenderingStereoscopic)
       menu_state_ = kMenuStateCardboard;
 #endif  // FPLBASE_ANDROID_VR
+
+    // If the last run was killed mid-game, go straight back into it. The
+    // gameplay state restores the rest once the level is loaded.
+    const ResumeData *resume = world_->resume_snapshot != nullptr
+                                   ? world_->resume_snapshot->pending()
+                                   : nullptr;
+    if (resume != nullptr && menu_state_ == kMenuStateStart) {
+      if (resume->level_index() >= 0 &&
+          static_cast<flatbuffers::uoffset_t>(resume->level_index()) <
+              world_def_->levels()->size()) {
+        world_->level_index = static_cast<size_t>(resume->level_index());
+        menu_state_ = kMenuStateFinished;
+      } else {
+        world_->resume_snapshot->Clear();
+      }
+    }
   }
 
   loading_complete_ = false;
   LoadWorldDef(world_, world_def_);
   UpdateMainCamera(&main_camera_, world_);
-  music_channel_ = audio_engine_->PlaySound(music_menu_);
+  music_wanted_ = true;
+  if (music_menu_ != nullptr) {
+    music_channel_ = audio_engine_->PlaySound(music_menu_);
+  }
   world_->player_component.set_state(kPlayerState_Disabled);
   input_system_->SetRelativeMouseMode(false);
   world_->ResetControllerFacing();
@@ -381,22 +424,27 @@ void GameMenuState::OnEnter(int previous_state) {
 }
 
 void GameMenuState::OnExit(int /*next_state*/) {
-  music_channel_.Stop();
+  music_wanted_ = false;
+  if (music_channel_.Valid()) music_channel_.Stop();
+  music_channel_ = pindrop::Channel();
   StopReceivingMessages();
 }
 
+void GameMenuState::Prefetch(int /*current_state*/) {
+  // OnEnter() reloads the world.
+  PrefetchWorldDef(world_, world_def_);
+}
+
 void GameMenuState::LoadData() {
   // Set default values.
   slider_value_effect_ = kEffectVolumeDefault;
   slider_value_music_ = kMusicVolumeDefault;
 
-  // Retrieve save file path.
-  std::string storage_path;
-  std::string data;
-  auto ret = fplbase::GetStoragePath(kSaveAppName, &storage_path);
-  if (ret &&
-      fplbase::LoadPreferences((storage_path + kSaveFileName).c_str(), &data)) {
-    auto save_data = GetSaveData(static_cast<const void *>(data.c_str()));
+  auto save_data = world_->save_store->settings();
+  if (save_data == nullptr) {
+    // Save the defaults, so there are settings to go with the progress.
+    SaveData();
+  } else {
     slider_value_effect_ = save_data->effect_volume();
     slider_value_music_ = save_data->music_volume();
 
@@ -444,16 +492,12 @@ void GameMenuState::SaveData() {
   auto offset = builder.Finish();
   FinishSaveDataBuffer(fbb, offset);
 
-  // Retrieve save file path.
-  std::string storage_path;
-  auto ret = fplbase::GetStoragePath(kSaveAppName, &storage_path);
-  if (ret) {
-    fplbase::SavePreferences((storage_path + kSaveFileName).c_str(),
-                             fbb.GetBufferPointer(), fbb.GetSize());
-  }
+  // The store writes it with the next commit.
+  world_->save_store->SetSettings(fbb.GetBufferPointer(), fbb.GetSize());
 }
 
 void GameMenuState::UpdateVolumes() {
+  AudioEngineLock lock(world_->services_component.audio_thread());
   sound_effects_bus_.SetGain(slider_value_effect_);
   voices_bus_.SetGain(slider_value_effect_);
   music_bus_.SetGain(slider_value_music_);
@@ -21,6 +21,7 @@
 #include "flatui/flatui_common.h"
 #include "fplbase/input.h"
 #include "gpg_manager.h"
+#include "menu_cache.h"
 #include "pindrop/pindrop.h"
 #include "states/gameplay_state.h"
 #include "states/state_machine.h"
@@ -92,8 +93,6 @@ const auto kScoreAccuracyFactor = 50.0f;
 
 const auto kEffectVolumeDefault = 1.0f;
 const auto kMusicVolumeDefault = 1.0f;
-const auto kSaveFileName = "save_data.zoosave";
-const auto kSaveAppName = "zooshi";
 
 class GameMenuState : public StateNode {
  public:
@@ -112,6 +111,12 @@ class GameMenuState : public StateNode {
   virtual void HandleUI(fplbase::Renderer* renderer);
   virtual void OnEnter(int previous_state);
   virtual void OnExit(int next_state);
+  virtual void Prefetch(int current_state);
+
+  // Lay out the next part of the menus' text, so its glyphs are rasterized
+  // and uploaded before the menus first show them. Call on the render thread
+  // once a frame until it returns true.
+  bool PrewarmText();
 
  private:
   MenuState StartMenu(fplbase::AssetManager& assetman,
@@ -241,6 +246,8 @@ class GameMenuState : public StateNode {
   // This will eventually be removed when there are events to handle this logic.
   pindrop::SoundHandle music_menu_;
   pindrop::Channel music_channel_;
+  // Whether the menu is up, so the music can start if it loads meanwhile.
+  bool music_wanted_;
 
   // Menu state.
   MenuState menu_state_;
@@ -269,6 +276,8 @@ class GameMenuState : public StateNode {
   mathfu::vec2 scroll_offset_;
   std::string license_text_;
   std::string about_text_;
+  // How much of the text PrewarmText() has laid out.
+  int prewarm_step_;
 
   // In-game menu state.
   OptionsMenuState options_menu_state_;
@@ -302,6 +311,9 @@ class GameMenuState : public StateNode {
   // Track the state of the UI managing rewarded video, which is done external
   // to the MenuState to allow rewarded video offered at different states.
   RewardedVideoState rewarded_video_state_;
+
+  // Draws the current menu from its last frame while it's left alone.
+  MenuCache menu_cache_;
 };
 
 }  // zooshi
@@ -81,7 +81,7 @@ void GameOverState::Initialize(fplbase::InputSystem* input_system, World* world,
 }
 
 void GameOverState::AdvanceFrame(int delta_time, int* next_state) {
-  world_->entity_manager.UpdateComponents(delta_time);
+  world_->UpdateComponents(delta_time);
   UpdateMainCamera(&main_camera_, world_);
 
   // Return to the title screen after any key is hit.
@@ -195,5 +195,13 @@ void GameOverState::OnExit(int next_state) {
   }
 }
 
+int GameOverState::NextStateHint() const {
+  // Either way out reloads the world, which can be read while the results
+  // are shown.
+  return world_->rendering_mode() == kRenderingStereoscopic
+             ? kGameStateGameplay
+             : kGameStateGameMenu;
+}
+
 }  // zooshi
 }  // fpl
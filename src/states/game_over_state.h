@@ -41,6 +41,7 @@ class GameOverState : public StateNode {
   virtual void Render(fplbase::Renderer* renderer);
   virtual void OnEnter(int previous_state);
   virtual void OnExit(int next_state);
+  virtual int NextStateHint() const;
 
  private:
   // The world to display in the background.
@@ -14,6 +14,7 @@
 
 #include "states/gameplay_state.h"
 
+#include <stdlib.h>
 #include "analytics.h"
 
 #include "mathfu/internal/disable_warnings_begin.h"
@@ -28,6 +29,8 @@
 #include "game.h"
 #include "input_config_generated.h"
 #include "mathfu/glsl_mappings.h"
+#include "remote_config.h"
+#include "resume_snapshot.h"
 #include "states/states.h"
 #include "states/states_common.h"
 #include "world.h"
@@ -45,13 +48,29 @@ using mathfu::vec2;
 namespace fpl {
 namespace zooshi {
 
+// Start every music stem together, so the looping stems stay in phase, with
+// only `stem` audible. Returns false if the music hasn't streamed in yet.
+static bool PlayMusicStems(pindrop::AudioEngine* audio_engine,
+                           const pindrop::SoundHandle* stems,
+                           pindrop::Channel* channels, int num_stems,
+                           int stem) {
+  for (int i = 0; i < num_stems; ++i) {
+    if (stems[i] == nullptr) return false;
+  }
+  for (int i = 0; i < num_stems; ++i) {
+    channels[i] = audio_engine->PlaySound(stems[i], mathfu::kZeros3f,
+                                          i == stem ? 1.0f : 0.0f);
+  }
+  return true;
+}
+
 // Update music gain based on lap number. This logic will eventually live in
 // an event graph.
 static void UpdateMusic(corgi::EntityManager* entity_manager, int* previous_lap,
                         float* percent, int delta_time,
-                        pindrop::Channel* music_channel_1,
-                        pindrop::Channel* music_channel_2,
-                        pindrop::Channel* music_channel_3) {
+                        pindrop::AudioEngine* audio_engine,
+                        const pindrop::SoundHandle* stems,
+                        pindrop::Channel* channels, int num_stems) {
   corgi::EntityRef raft =
       entity_manager->GetComponent<ServicesComponent>()->raft_entity();
   RailDenizenData* raft_rail_denizen =
@@ -60,14 +79,29 @@ static void UpdateMusic(corgi::EntityManager* entity_manager, int* previous_lap,
   int current_lap = raft_rail_denizen->lap_number;
   assert(current_lap >= 0);
   if (current_lap != *previous_lap) {
-    pindrop::Channel* channels[] = {music_channel_1, music_channel_2,
-                                    music_channel_3};
     const float kCrossFadeDuration = 5.0f;
     bool done = false;
     float seconds = delta_time / 1000.0f;
     float delta = seconds / kCrossFadeDuration;
-    pindrop::Channel* channel_previous = channels[*previous_lap % 3];
-    pindrop::Channel* channel_current = channels[current_lap % 3];
+    const int stem_previous = *previous_lap % num_stems;
+    const int stem_current = current_lap % num_stems;
+    pindrop::Channel* channel_previous = &channels[stem_previous];
+    pindrop::Channel* channel_current = &channels[stem_current];
+    if (stem_current == stem_previous) {
+      *previous_lap = current_lap;
+      *percent = 0.0f;
+      return;
+    }
+    // Until the music has streamed in, it starts with the next lap.
+    if (!channel_previous->Valid() &&
+        !PlayMusicStems(audio_engine, stems, channels, num_stems,
+                        stem_previous)) {
+      return;
+    }
+    // If the lap changed again mid-fade, silence the stem that was fading in.
+    for (int i = 0; i < num_stems; ++i) {
+      if (i != stem_previous && i != stem_current) channels[i].SetGain(0.0f);
+    }
     *percent += delta;
     if (*percent >= 1.0f) {
       *percent = 1.0f;
@@ -91,11 +125,16 @@ static void UpdateMusic(corgi::EntityManager* entity_manager, int* previous_lap,
 
 void GameplayState::AdvanceFrame(int delta_time, int* next_state) {
   // Update the world.
-  world_->entity_manager.UpdateComponents(delta_time);
+  world_->UpdateComponents(delta_time);
+  // Bring in the level ahead of the raft, and drop what it's left behind.
+  StreamLevelSectors(world_, false);
+  UpdateRailVisibility(world_);
   UpdateMainCamera(&main_camera_, world_);
   UpdateMusic(&world_->entity_manager, &previous_lap_, &percent_, delta_time,
-              &music_channel_lap_1_, &music_channel_lap_2_,
-              &music_channel_lap_3_);
+              audio_engine_, music_stems_, music_channels_, kNumMusicStems);
+  // Do any network work while the player is busy, so the menus don't wait.
+  world_->admob_helper->PrefetchRewardedVideo(delta_time);
+  UpdateRemoteConfig(delta_time);
 
   if (input_system_->GetButton(fplbase::FPLK_F9).went_down()) {
     world_->draw_debug_physics = !world_->draw_debug_physics;
@@ -143,18 +182,11 @@ void GameplayState::Render(fplbase::Renderer* renderer) {
   cardboard_camera = &cardboard_camera_;
 #endif
   RenderWorld(*renderer, world_, main_camera_, cardboard_camera, input_system_);
-  if (!fader_->Finished()) {
-    renderer->set_model_view_projection(
-        mathfu::mat4::Ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
-    fader_->Render(renderer);
-  }
+  if (!fader_->Finished()) fader_->Render(&world_->sprite_batch);
 }
 
-void GameplayState::HandleUI(fplbase::Renderer* renderer) {
-  ServicesComponent& services = world_->services_component;
-  world_->onscreen_controller_ui.Update(services.asset_manager(),
-                                        services.font_manager(),
-                                        renderer->window_size());
+void GameplayState::HandleUI(fplbase::Renderer* /*renderer*/) {
+  world_->onscreen_controller_ui.Update(&world_->sprite_batch);
 }
 
 void GameplayState::Initialize(
@@ -173,9 +205,12 @@ void GameplayState::Initialize(
   fader_ = fader;
 
   sound_pause_ = audio_engine->GetSoundHandle("pause");
-  music_gameplay_lap_1_ = audio_engine->GetSoundHandle("music_gameplay_lap_1");
-  music_gameplay_lap_2_ = audio_engine->GetSoundHandle("music_gameplay_lap_2");
-  music_gameplay_lap_3_ = audio_engine->GetSoundHandle("music_gameplay_lap_3");
+  for (int i = 0; i < kNumMusicStems; ++i) music_stems_[i] = nullptr;
+  world_->asset_loader->OnGroupLoaded(kMusicAssetGroup, [this]() {
+    music_stems_[0] = audio_engine_->GetSoundHandle("music_gameplay_lap_1");
+    music_stems_[1] = audio_engine_->GetSoundHandle("music_gameplay_lap_2");
+    music_stems_[2] = audio_engine_->GetSoundHandle("music_gameplay_lap_3");
+  });
 
 #if FPLBASE_ANDROID_VR
   cardboard_camera_.set_viewport_angle(config->cardboard_viewport_angle());
@@ -188,6 +223,7 @@ void GameplayState::OnEnter(int previous_state) {
   requested_state_ = kGameStateGameplay;
   world_->player_component.set_state(kPlayerState_Active);
   input_system_->SetRelativeMouseMode(true);
+  world_->DiscardControllerTaps();
   UpdateMainCamera(&main_camera_, world_);
 
   // Assign textures for the onscreen controller.
@@ -199,16 +235,15 @@ void GameplayState::OnEnter(int previous_state) {
       asset_manager->FindTexture("textures/joystick_tip.webp"));
 
   if (previous_state == kGameStatePause) {
-    music_channel_lap_1_.Resume();
-    music_channel_lap_2_.Resume();
-    music_channel_lap_3_.Resume();
+    ResumeMusic();
   } else {
-    music_channel_lap_1_ =
-        audio_engine_->PlaySound(music_gameplay_lap_1_, mathfu::kZeros3f, 1.0f);
-    music_channel_lap_2_ =
-        audio_engine_->PlaySound(music_gameplay_lap_2_, mathfu::kZeros3f, 0.0f);
-    music_channel_lap_3_ =
-        audio_engine_->PlaySound(music_gameplay_lap_3_, mathfu::kZeros3f, 0.0f);
+    // Each game starts on the first lap's stem.
+    StopMusic();
+    previous_lap_ = 0;
+    percent_ = 0.0f;
+    // Until the music has streamed in, it starts with the next lap.
+    PlayMusicStems(audio_engine_, music_stems_, music_channels_,
+                   kNumMusicStems, 0);
   }
 
   if (world_->rendering_mode() == kRenderingStereoscopic) {
@@ -226,6 +261,19 @@ void GameplayState::OnEnter(int previous_state) {
   if (previous_state != kGameStatePause) {
     // Set the start time, so elapsed time can be tracked.
     world_->gameplay_start_time = input_system_->Time();
+    // Pick up where a killed run left off.
+    if (world_->resume_snapshot != nullptr) {
+      world_->resume_snapshot->Restore(world_);
+    }
+    // An armed recording starts with the level, with rand() seeded afresh,
+    // so a replay launches the same projectiles.
+    InputRecorder* recorder = world_->player_component.input_recorder();
+    if (recorder != nullptr && recorder->armed()) {
+      const uint32_t start_seed = static_cast<uint32_t>(rand());
+      srand(start_seed);
+      recorder->Start(world_->level_index, world_->level_seed, start_seed);
+    }
+    if (world_->analytics != nullptr) world_->analytics->StartFrameCounts();
     firebase::analytics::LogEvent(kEventGameplayStart,
                                   kParameterControlScheme,
                                   AnalyticsControlValue(world_));
@@ -234,13 +282,42 @@ void GameplayState::OnEnter(int previous_state) {
 
 void GameplayState::OnExit(int next_state) {
   if (next_state == kGameStatePause) {
-    music_channel_lap_1_.Pause();
-    music_channel_lap_2_.Pause();
-    music_channel_lap_3_.Pause();
+    PauseMusic();
   } else {
-    music_channel_lap_1_.Stop();
-    music_channel_lap_2_.Stop();
-    music_channel_lap_3_.Stop();
+    StopMusic();
+
+    // Send the session's counted events. Sessions that are quit from the
+    // pause menu are sent with the next one.
+    if (world_->analytics != nullptr) world_->analytics->Flush();
+
+    // The game is over, so there's nothing left to resume.
+    if (world_->resume_snapshot != nullptr) world_->resume_snapshot->Clear();
+  }
+}
+
+void GameplayState::Prefetch(int current_state) {
+  // Leaving the results for another game reloads the world.
+  if (current_state == kGameStateGameOver) {
+    PrefetchWorldDef(world_, config_->world_def());
+  }
+}
+
+void GameplayState::ResumeMusic() {
+  for (int i = 0; i < kNumMusicStems; ++i) {
+    if (music_channels_[i].Valid()) music_channels_[i].Resume();
+  }
+}
+
+void GameplayState::PauseMusic() {
+  for (int i = 0; i < kNumMusicStems; ++i) {
+    if (music_channels_[i].Valid()) music_channels_[i].Pause();
+  }
+}
+
+void GameplayState::StopMusic() {
+  for (int i = 0; i < kNumMusicStems; ++i) {
+    if (music_channels_[i].Valid()) music_channels_[i].Stop();
+    music_channels_[i] = pindrop::Channel();
   }
 }
 
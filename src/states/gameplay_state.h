@@ -57,6 +57,7 @@ class GameplayState : public StateNode {
   virtual void HandleUI(fplbase::Renderer* renderer);
   virtual void OnEnter(int previous_state);
   virtual void OnExit(int next_state);
+  virtual void Prefetch(int current_state);
 
   int* requested_state() { return &requested_state_; }
 
@@ -91,16 +92,19 @@ class GameplayState : public StateNode {
   // Cache the common sounds that are going to be played.
   pindrop::SoundHandle sound_pause_;
 
+  // Start or stop every music stem that's playing.
+  void ResumeMusic();
+  void PauseMusic();
+  void StopMusic();
+
   // This will eventually be removed when there are events to handle this logic.
   // Crossfade between different music tracks based on what lap you're on. The
   // percent value tracks the transitions over time so the transition from one
-  // track to the other is smooth.
-  pindrop::SoundHandle music_gameplay_lap_1_;
-  pindrop::SoundHandle music_gameplay_lap_2_;
-  pindrop::SoundHandle music_gameplay_lap_3_;
-  pindrop::Channel music_channel_lap_1_;
-  pindrop::Channel music_channel_lap_2_;
-  pindrop::Channel music_channel_lap_3_;
+  // track to the other is smooth. The stems loop, so they're all started
+  // together and kept playing, silent until their lap.
+  static const int kNumMusicStems = 3;
+  pindrop::SoundHandle music_stems_[kNumMusicStems];
+  pindrop::Channel music_channels_[kNumMusicStems];
   int previous_lap_;
   float percent_;
 
@@ -64,7 +64,7 @@ void IntroState::SetBoxVisibility(bool visibility) {
 
 void IntroState::AdvanceFrame(int delta_time, int* next_state) {
   // Update components so that the player can throw sushi.
-  world_->entity_manager.UpdateComponents(delta_time);
+  world_->UpdateComponents(delta_time);
   // Update camera so that the player can look around.
   UpdateMainCamera(&main_camera_, world_);
 
@@ -82,8 +82,7 @@ void IntroState::AdvanceFrame(int delta_time, int* next_state) {
   // Fade to game.
   if (fade_timer_ <= 0) {
     fader_->Start(kIntroStateFadeTransitionDuration, mathfu::kZeros3f,
-                  kFadeOutThenIn, vec3(-1.0f, 1.0f, 0.0f),
-                  vec3(1.0f, -1.0f, 0.0f));
+                  kFadeOutThenIn);
     fade_timer_ = kFadeTimerComplete;
   }
 
@@ -115,11 +114,7 @@ void IntroState::Render(fplbase::Renderer* renderer) {
   cardboard_camera = &cardboard_camera_;
 #endif  // FPLBASE_ANDROID_VR
   RenderWorld(*renderer, world_, main_camera_, cardboard_camera, input_system_);
-  if (!fader_->Finished()) {
-    renderer->set_model_view_projection(
-          mat4::Ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
-    fader_->Render(renderer);
-  }
+  if (!fader_->Finished()) fader_->Render(&world_->sprite_batch);
 }
 
 void IntroState::OnEnter(int /*previous_state*/) {
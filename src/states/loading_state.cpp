@@ -16,6 +16,9 @@
 
 #include <cmath>
 
+#include "SDL_timer.h"
+#include "analytics.h"
+#include "asset_loader.h"
 #include "assets_generated.h"
 #include "camera.h"
 #include "fplbase/asset_manager.h"
@@ -33,7 +36,7 @@
 #include "mathfu/matrix.h"
 #include "mathfu/quaternion.h"
 #include "mathfu/vector.h"
-#include "pindrop/pindrop.h"
+#include "states/game_menu_state.h"
 #include "states/states.h"
 #include "states/states_common.h"
 #include "world.h"
@@ -59,17 +62,17 @@ static const corgi::WorldTime kLoadingScreenFadeOutTime = 200;
 void LoadingState::Initialize(fplbase::InputSystem* input_system, World* world,
                               const AssetManifest& asset_manifest,
                               fplbase::AssetManager* asset_manager,
-                              pindrop::AudioEngine* audio_engine,
                               fplbase::Shader* shader_textured,
-                              FullScreenFader* fader) {
+                              FullScreenFader* fader,
+                              GameMenuState* game_menu_state) {
   input_system_ = input_system;
   world_ = world;
   asset_manager_ = asset_manager;
-  audio_engine_ = audio_engine;
   asset_manifest_ = &asset_manifest;
   shader_textured_ = shader_textured;
   loading_complete_ = false;
   fader_ = fader;
+  game_menu_state_ = game_menu_state;
 }
 
 void LoadingState::AdvanceFrame(int delta_time, int* next_state) {
@@ -102,8 +105,12 @@ void LoadingState::AdvanceFrame(int delta_time, int* next_state) {
 void LoadingState::Render(fplbase::Renderer* renderer) {
   // Ensure assets are instantiated after they've been loaded.
   // This must be called from the render thread.
+  // Once they have, build the shader variants the game may switch to, and
+  // rasterize the menus' glyphs.
   loading_complete_ =
-      asset_manager_->TryFinalize() && audio_engine_->TryFinalize();
+      world_->asset_loader->TryFinalize() &&
+      world_->world_renderer->PrecompileShaderVariants(world_, *renderer) &&
+      game_menu_state_->PrewarmText();
 
   // Get a handle to the loading material.
   const char* loading_material_name =
@@ -189,30 +196,35 @@ void LoadingState::Render(fplbase::Renderer* renderer) {
     fplbase::Mesh::RenderAAQuadAlongX(bottom_left, top_right);
   }
 
-  const vec3 fade_bottom_left(-aspect_ratio, 1.0f, 0.0f);
-  const vec3 fade_top_right(aspect_ratio, -1.0f, 0.0f);
   if (fader_->current_fade_time() == 0) {
     // If this is the first frame the textures have been loaded, start fade-in.
-    fader_->Start(kLoadingScreenFadeInTime, kZeros3f, kFadeIn, fade_bottom_left,
-                  fade_top_right);
+    fader_->Start(kLoadingScreenFadeInTime, kZeros3f, kFadeIn);
   } else if (loading_complete_ && fader_->Finished()) {
     // If this is the first frame the textures have been loaded, start fade-out.
-    fader_->Start(kLoadingScreenFadeOutTime, kZeros3f, kFadeOutThenIn,
-                  fade_bottom_left, fade_top_right);
+    fader_->Start(kLoadingScreenFadeOutTime, kZeros3f, kFadeOutThenIn);
   }
 
   // Draw fader on top of everything.
-  if (!fader_->Finished()) {
-    fader_->Render(renderer);
-  }
+  if (!fader_->Finished()) fader_->Render(&world_->sprite_batch);
 }
 
 void LoadingState::OnEnter(int /*previous_state*/) {
+  loading_start_ = SDL_GetPerformanceCounter();
 #if FPLBASE_ANDROID_VR
   input_system_->head_mounted_display_input().ResetHeadTracker();
 #endif  // FPLBASE_ANDROID_VR
 }
 
+void LoadingState::OnExit(int /*next_state*/) {
+  if (world_->analytics != nullptr) {
+    // Timed with the clock, since the frame deltas are clamped.
+    const float loading_ms = static_cast<float>(
+        (SDL_GetPerformanceCounter() - loading_start_) * 1000.0 /
+        SDL_GetPerformanceFrequency());
+    world_->analytics->set_loading_time(loading_ms);
+  }
+}
+
 
 }  // zooshi
 }  // fpl
@@ -15,21 +15,20 @@
 #ifndef ZOOSHI_LOADING_STATE_H_
 #define ZOOSHI_LOADING_STATE_H_
 
+#include <stdint.h>
+
 #include "config_generated.h"
 #include "fplbase/asset_manager.h"
 #include "fplbase/input.h"  // For FPLBASE_ANDROID_VR definition.
 #include "states/state_machine.h"
 
-namespace pindrop {
-class AudioEngine;
-}
-
 namespace fpl {
 
 namespace zooshi {
 
 struct AssetManifest;
 class FullScreenFader;
+class GameMenuState;
 struct World;
 
 class LoadingState : public StateNode {
@@ -40,16 +39,19 @@ class LoadingState : public StateNode {
         asset_manifest_(nullptr),
         shader_textured_(nullptr),
         world_(nullptr),
-        banner_rotation_(0.0f){}
+        game_menu_state_(nullptr),
+        banner_rotation_(0.0f),
+        loading_start_(0) {}
   virtual ~LoadingState() {}
   void Initialize(fplbase::InputSystem* input_system, World* world,
                   const AssetManifest& asset_manifest,
                   fplbase::AssetManager* asset_manager,
-                  pindrop::AudioEngine* audio_engine,
-                  fplbase::Shader* shader_textured, FullScreenFader* fader);
+                  fplbase::Shader* shader_textured, FullScreenFader* fader,
+                  GameMenuState* game_menu_state);
   virtual void AdvanceFrame(int delta_time, int* next_state);
   virtual void Render(fplbase::Renderer* renderer);
   virtual void OnEnter(int previous_state);
+  virtual void OnExit(int next_state);
 
  protected:
   // Set to true when the render thread detetects that all assets have been
@@ -60,9 +62,6 @@ class LoadingState : public StateNode {
   // Also holds the loading texture that we display on screen.
   fplbase::AssetManager* asset_manager_;
 
-  // Holds the audio asynchronous loader thread that we are waiting for.
-  pindrop::AudioEngine* audio_engine_;
-
   // Holds the name of the loading texture that we display on screen.
   const AssetManifest* asset_manifest_;
 
@@ -73,11 +72,17 @@ class LoadingState : public StateNode {
 
   World *world_;
 
+  // The state loading goes on to, whose text is laid out while loading.
+  GameMenuState* game_menu_state_;
+
   // The input system so that we can get input.
   fplbase::InputSystem* input_system_;
 
   // Rotation around Y of the banner when a VR loading screen is in use.
   float banner_rotation_;
+
+  // Performance counter when the loading screen came up, for analytics.
+  uint64_t loading_start_;
 };
 
 }  // zooshi
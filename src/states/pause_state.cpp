@@ -144,5 +144,10 @@ void PauseState::OnEnter(int /*previous_state*/) {
   UpdateMainCamera(&main_camera_, world_);
 }
 
+int PauseState::NextStateHint() const {
+  // Quitting to the menu reloads the world, which can be read while paused.
+  return kGameStateGameMenu;
+}
+
 }  // zooshi
 }  // fpl
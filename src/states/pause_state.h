@@ -42,6 +42,7 @@ class PauseState : public StateNode {
   virtual void Render(fplbase::Renderer* renderer);
   virtual void HandleUI(fplbase::Renderer* renderer);
   virtual void OnEnter(int previous_state);
+  virtual int NextStateHint() const;
 
  protected:
   GameState PauseMenu(fplbase::AssetManager& assetman,
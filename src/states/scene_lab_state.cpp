@@ -15,10 +15,12 @@
 #include "states/scene_lab_state.h"
 
 #include "camera.h"
+#include "corgi_component_library/rendermesh.h"
 #include "mathfu/glsl_mappings.h"
 #include "states/states.h"
 #include "world.h"
 
+using corgi::component_library::RenderMeshData;
 using mathfu::vec2i;
 using mathfu::vec2;
 using mathfu::vec3;
@@ -45,6 +47,13 @@ void SceneLabState::Initialize(fplbase::Renderer* renderer,
   scene_lab_ = corgi_adapter_->scene_lab();
   corgi_adapter_->SetCorgiCamera(
       std::unique_ptr<corgi::CameraInterface>(camera_));
+
+  // Only what was edited is refit, rather than rebuilding the tree.
+  entity_bvh_.Initialize(&world->entity_manager);
+  scene_lab_->AddOnUpdateEntityCallback(
+      [this](const scene_lab::GenericEntityId& id) {
+        entity_bvh_.Update(corgi_adapter_->GetEntityRef(id));
+      });
 }
 
 void SceneLabState::AdvanceFrame(corgi::WorldTime delta_time, int* next_state) {
@@ -72,9 +81,39 @@ void SceneLabState::AdvanceFrame(corgi::WorldTime delta_time, int* next_state) {
   }
 }
 
+void SceneLabState::HideOutsideView(const corgi::CameraInterface& camera) {
+  outside_view_.clear();
+  hidden_.clear();
+  entity_bvh_.RemoveDeleted();
+  entity_bvh_.QueryOutsideView(camera.GetTransformMatrix(), &outside_view_);
+  for (auto it = outside_view_.begin(); it != outside_view_.end(); ++it) {
+    RenderMeshData* data =
+        world_->entity_manager.GetComponentData<RenderMeshData>(*it);
+    if (data != nullptr && data->visible) {
+      data->visible = false;
+      hidden_.push_back(*it);
+    }
+  }
+}
+
+void SceneLabState::ShowOutsideView() {
+  for (auto it = hidden_.begin(); it != hidden_.end(); ++it) {
+    if (!it->IsValid()) continue;
+    RenderMeshData* data =
+        world_->entity_manager.GetComponentData<RenderMeshData>(*it);
+    if (data != nullptr) data->visible = true;
+  }
+  hidden_.clear();
+}
+
 void SceneLabState::RenderPrep() {
   const corgi::CameraInterface* camera = corgi_adapter_->GetCorgiCamera();
+  // With shadows, the main view is culled in Render(), and the shadow map
+  // still needs casters that are out of view.
+  const bool cull = !world_->RenderingOptionEnabled(kShadowEffect);
+  if (cull) HideOutsideView(*camera);
   world_->world_renderer->RenderPrep(*camera, world_);
+  if (cull) ShowOutsideView();
 }
 
 void SceneLabState::Render(fplbase::Renderer* renderer) {
@@ -92,16 +131,25 @@ void SceneLabState::Render(fplbase::Renderer* renderer) {
   if (world_->RenderingOptionEnabled(kShadowEffect)) {
     world_->world_renderer->RenderShadowMap(*camera, *renderer, world_);
   }
+  const bool cull = world_->RenderingOptionEnabled(kShadowEffect);
+  if (cull) HideOutsideView(*camera);
   world_->world_renderer->RenderWorld(*camera, *renderer, world_);
+  if (cull) ShowOutsideView();
 }
 
 void SceneLabState::HandleUI(fplbase::Renderer* renderer) {
   scene_lab_->Render(renderer);
 }
 
-void SceneLabState::OnEnter(int /*previous_state*/) { scene_lab_->Activate(); }
+void SceneLabState::OnEnter(int /*previous_state*/) {
+  scene_lab_->Activate();
+  entity_bvh_.Build();
+}
 
-void SceneLabState::OnExit(int /*next_state*/) { scene_lab_->Deactivate(); }
+void SceneLabState::OnExit(int /*next_state*/) {
+  scene_lab_->Deactivate();
+  entity_bvh_.Clear();
+}
 
 }  // zooshi
 }  // fpl
@@ -15,7 +15,9 @@
 #ifndef ZOOSHI_SCENE_LAB_STATE_H_
 #define ZOOSHI_SCENE_LAB_STATE_H_
 
+#include <vector>
 #include "camera.h"
+#include "entity_bvh.h"
 #include "states/state_machine.h"
 #include "world.h"
 
@@ -56,13 +58,25 @@ class SceneLabState : public StateNode {
   virtual void OnEnter(int previous_state);
   virtual void OnExit(int next_state);
 
+  // The entities with render meshes, kept up to date as they're edited.
+  const EntityBvh& entity_bvh() const { return entity_bvh_; }
+
  private:
+  // Hide the visible entities that are entirely outside `camera`'s view, so
+  // the render lists skip them, until ShowOutsideView() is called.
+  void HideOutsideView(const corgi::CameraInterface& camera);
+  void ShowOutsideView();
+
   fplbase::Renderer* renderer_;
   World* world_;
   fplbase::InputSystem* input_system_;
   Camera* camera_;
   scene_lab::SceneLab* scene_lab_;
   scene_lab_corgi::CorgiAdapter* corgi_adapter_;
+  EntityBvh entity_bvh_;
+  // Reused by HideOutsideView(), to avoid allocating every frame.
+  std::vector<corgi::EntityRef> outside_view_;
+  std::vector<corgi::EntityRef> hidden_;
 };
 
 }  // zooshi
@@ -32,6 +32,14 @@ class StateNode {
   virtual void HandleUI(fplbase::Renderer* /*renderer*/) {}
   virtual void OnEnter(int /*previous_state*/) {}
   virtual void OnExit(int /*next_state*/) {}
+
+  // The state this one expects to change to soon, or -1 if it doesn't know.
+  virtual int NextStateHint() const { return -1; }
+
+  // Start preparing, on other threads, to be entered from `current_state`,
+  // without changing anything the running state relies on. Called once for
+  // each hint, which may not be followed by the change at all.
+  virtual void Prefetch(int /*current_state*/) {}
 };
 
 template <int state_count_>
@@ -41,7 +49,7 @@ class StateMachine {
 
   // Initializes the StateMachine. You must call SetCurrentStateId to a valid
   // state before running AdvanceFrame or Render.
-  StateMachine() : current_state_id_(-1) {}
+  StateMachine() : current_state_id_(-1), prefetched_state_id_(-1) {}
 
   StateNode* get_state(StateId state_id) { return &states_[state_id]; }
 
@@ -57,6 +65,7 @@ class StateMachine {
       StateId new_id = current_state_id_;
       states_[current_state_id_]->AdvanceFrame(delta_time, &new_id);
       SetCurrentStateId(new_id);
+      PrefetchNextState();
     }
   }
 
@@ -91,6 +100,7 @@ class StateMachine {
         states_[new_id]->OnEnter(current_state_id_);
       }
       current_state_id_ = new_id;
+      prefetched_state_id_ = -1;
     }
   }
 
@@ -103,7 +113,21 @@ class StateMachine {
  private:
   bool valid_id(StateId id) { return id >= 0 && id < state_count_; }
 
+  // Let the state the current one expects to change to start preparing, while
+  // the current one keeps running.
+  void PrefetchNextState() {
+    if (!valid_id(current_state_id_)) return;
+    const StateId next_id = states_[current_state_id_]->NextStateHint();
+    if (next_id != prefetched_state_id_ && next_id != current_state_id_ &&
+        valid_id(next_id)) {
+      states_[next_id]->Prefetch(current_state_id_);
+    }
+    prefetched_state_id_ = next_id;
+  }
+
   StateId current_state_id_;
+  // The state last hinted at, since the current state was entered.
+  StateId prefetched_state_id_;
   StateNode* states_[state_count_];
 };
 
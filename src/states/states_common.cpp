@@ -17,6 +17,7 @@
 
 #if FPLBASE_ANDROID_VR
 #include "fplbase/renderer_hmd.h"
+#include "inputcontrollers/android_cardboard_controller.h"
 #endif
 
 #include "flatui/flatui_common.h"
@@ -39,19 +40,45 @@ static vec3 CorrectTransform(const mat4& mat) {
   return corrected_translation;
 }
 
-static void RenderSettingsGear(fplbase::Renderer& renderer, World* world) {
-  vec2i res = renderer.window_size();
-  renderer.set_model_view_projection(mathfu::mat4::Ortho(
-      0.0f, static_cast<float>(res.x), static_cast<float>(res.y), 0.0f,
-      -1.0f, 1.0f));
-  renderer.set_color(mathfu::kOnes4f);
-  auto shader = world->asset_manager->LoadShader("shaders/textured");
-  world->cardboard_settings_gear->Set(renderer);
-  shader->Set(renderer);
-
-  fplbase::Mesh::RenderAAQuadAlongX(
-      vec3((res.x - kGearSize) / 2.0f, res.y - kGearSize, 0.0f),
-      vec3((res.x + kGearSize) / 2.0f, res.y, 0.0f));
+// Turn `facing` and `up` by however far the head has turned since the HMD
+// controller last read its pose, which the update built the camera from.
+// The head's pose is read again here, on the render thread, just before
+// drawing.
+static void LateLatchHeadPose(World* world,
+                              fplbase::InputSystem* input_system,
+                              vec3* facing, vec3* up) {
+  fplbase::HeadMountedDisplayInput& hmd =
+      input_system->head_mounted_display_input();
+  hmd.UpdateTransforms();
+  const vec3 latest_forward =
+      AndroidCardboardController::FromHeadMountedDisplay(hmd.forward());
+  const vec3 latest_up =
+      AndroidCardboardController::FromHeadMountedDisplay(hmd.up());
+
+  // Express the latest pose in the axes of the one the update read, then
+  // rebuild it from the camera's axes, which they were turned into.
+  const vec3 read_forward = world->hmd_controller->facing().Value();
+  const vec3 read_up = world->hmd_controller->up().Value();
+  const vec3 read_side =
+      vec3::CrossProduct(read_forward, read_up).Normalized();
+  const vec3 camera_side = vec3::CrossProduct(*facing, *up).Normalized();
+  const vec3 camera_facing = *facing;
+  const vec3 camera_up = *up;
+  const vec3* latest[] = {&latest_forward, &latest_up};
+  vec3* turned[] = {facing, up};
+  for (int i = 0; i < 2; ++i) {
+    *turned[i] = (camera_facing * vec3::DotProduct(*latest[i], read_forward) +
+                  camera_up * vec3::DotProduct(*latest[i], read_up) +
+                  camera_side * vec3::DotProduct(*latest[i], read_side))
+                     .Normalized();
+  }
+}
+
+static void RenderSettingsGear(World* world) {
+  const vec2 res(world->sprite_batch.window_size());
+  world->sprite_batch.Add(world->cardboard_settings_gear->textures()[0],
+                          vec2((res.x - kGearSize) / 2.0f, res.y - kGearSize),
+                          vec2(kGearSize), mathfu::kOnes4f);
 }
 #endif  // FPLBASE_ANDROID_VR
 
@@ -65,7 +92,8 @@ static void RenderStereoscopic(fplbase::Renderer& renderer, World* world,
   }
   fplbase::HeadMountedDisplayViewSettings view_settings;
   HeadMountedDisplayRenderStart(input_system->head_mounted_display_input(),
-                                &renderer, mathfu::kZeros4f, true,
+                                &renderer,
+                                world->world_renderer->ClearColor(world), true,
                                 &view_settings);
   // Update the Cardboard camera with the translation changes from the given
   // transform, which contains the shifts for the eyes.
@@ -74,8 +102,15 @@ static void RenderStereoscopic(fplbase::Renderer& renderer, World* world,
   const vec3 corrected_translation_right =
     CorrectTransform(view_settings.viewport_transforms[1]);
 
-  cardboard_camera->set_facing(camera.facing());
-  cardboard_camera->set_up(camera.up());
+  vec3 facing = camera.facing();
+  vec3 up = camera.up();
+  if (world->config->rendering_config()->cardboard_late_latch_margin() >
+          0.0f &&
+      world->GetHmdControllerEnabled()) {
+    LateLatchHeadPose(world, input_system, &facing, &up);
+  }
+  cardboard_camera->set_facing(facing);
+  cardboard_camera->set_up(up);
 
   // Set up stereoscopic rendering parameters.
   cardboard_camera->set_stereo(true);
@@ -89,7 +124,7 @@ static void RenderStereoscopic(fplbase::Renderer& renderer, World* world,
   world->world_renderer->RenderWorld(*cardboard_camera, renderer, world);
 
   HeadMountedDisplayRenderEnd(&renderer, true);
-  RenderSettingsGear(renderer, world);
+  RenderSettingsGear(world);
 #else
   (void)renderer;
   (void)world;
@@ -101,26 +136,38 @@ static void RenderStereoscopic(fplbase::Renderer& renderer, World* world,
 
 void RenderWorld(fplbase::Renderer& renderer, World* world, Camera& camera,
                  Camera* cardboard_camera, fplbase::InputSystem* input_system) {
+  // Follow the player to where it's drawn, between simulation steps.
+  if (world->transform_interpolator.applied()) {
+    UpdateMainCamera(&camera, world);
+  }
   vec2 window_size = vec2(renderer.window_size());
   world->river_component.UpdateRiverMeshes();
   if (world->rendering_mode() == kRenderingStereoscopic) {
     window_size.x = window_size.x / 2;
     cardboard_camera->set_viewport_resolution(window_size);
+    world->world_renderer->FitCameraToFog(world, cardboard_camera);
   }
   camera.set_viewport_resolution(window_size);
+  world->world_renderer->FitCameraToFog(world, &camera);
   if (world->rendering_mode() == kRenderingStereoscopic) {
     // This takes care of setting/clearing the framebuffer for us.
     RenderStereoscopic(renderer, world, camera, cardboard_camera, input_system);
   } else {
+    WorldRenderer* world_renderer = world->world_renderer;
+    if (world->RenderingOptionEnabled(kShadowEffect)) {
+      world_renderer->RenderShadowMap(camera, renderer, world);
+    }
+    // At a reduced resolution, the world is drawn offscreen and then
+    // stretched over the screen.
+    const bool scaled = world_renderer->BeginScene(renderer);
+
     // Always clear the framebuffer, even though we overwrite it with the
     // skybox, since it's a speedup on tile-based architectures, see .e.g.:
     // http://www.seas.upenn.edu/~pcozzi/OpenGLInsights/OpenGLInsights-TileBasedArchitectures.pdf
-    renderer.ClearFrameBuffer(mathfu::kZeros4f);
+    renderer.ClearFrameBuffer(world_renderer->ClearColor(world));
 
-    if (world->RenderingOptionEnabled(kShadowEffect)) {
-      world->world_renderer->RenderShadowMap(camera, renderer, world);
-    }
-    world->world_renderer->RenderWorld(camera, renderer, world);
+    world_renderer->RenderWorld(camera, renderer, world);
+    if (scaled) world_renderer->EndScene(renderer);
   }
 }
 
@@ -23,6 +23,10 @@
 namespace fpl {
 namespace zooshi {
 
+// The asset group with the music's sound bank. The music can't be played
+// until it has streamed in, some time after loading finishes.
+static const char kMusicAssetGroup[] = "Music";
+
 // Update the camera to the location of the player in the given world.
 void UpdateMainCamera(Camera* camera, World* world);
 
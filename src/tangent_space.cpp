@@ -0,0 +1,190 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tangent_space.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace fpl {
+namespace zooshi {
+
+using mathfu::vec2;
+using mathfu::vec3;
+using mathfu::vec4;
+
+// Triangles and vertices are processed in groups of this many, one per SIMD
+// lane.
+static const size_t kLanes = 4;
+
+// Triangles whose texture coordinates cover less area than this (squared)
+// add nothing to their vertices' tangents, rather than dividing by zero.
+static const float kMinTextureAreaSq = 1e-12f;
+
+// The values of `values` at each lane's index.
+static vec4 Gather(const std::vector<float>& values, const size_t* lanes) {
+  return vec4(values[lanes[0]], values[lanes[1]], values[lanes[2]],
+              values[lanes[3]]);
+}
+
+static vec4 Load(const std::vector<float>& values, size_t i) {
+  return vec4(values[i], values[i + 1], values[i + 2], values[i + 3]);
+}
+
+static void Store(const vec4& lanes, size_t i, std::vector<float>* values) {
+  for (size_t k = 0; k < kLanes; ++k) (*values)[i + k] = lanes[k];
+}
+
+// 1 / the square root of each lane, or 0 where it's 0.
+static vec4 InverseLength(const vec4& length_sq) {
+  vec4 result;
+  for (size_t k = 0; k < kLanes; ++k) {
+    result[k] = length_sq[k] > 0.0f ? 1.0f / sqrt(length_sq[k]) : 0.0f;
+  }
+  return result;
+}
+
+void TangentSpaceBuilder::Resize(size_t num_vertices) {
+  const size_t padded = (num_vertices + kLanes - 1) / kLanes * kLanes;
+  std::vector<float>* buffers[] = {
+      &position_x_, &position_y_,  &position_z_,  &texture_u_,
+      &texture_v_,  &normal_x_,    &normal_y_,    &normal_z_,
+      &tangent_x_,  &tangent_y_,   &tangent_z_,   &bitangent_x_,
+      &bitangent_y_, &bitangent_z_, &handedness_};
+  for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i) {
+    buffers[i]->assign(padded, 0.0f);
+  }
+}
+
+void TangentSpaceBuilder::SetVertex(size_t i, const vec3& pos,
+                                    const vec2& tc) {
+  position_x_[i] = pos.x;
+  position_y_[i] = pos.y;
+  position_z_[i] = pos.z;
+  texture_u_[i] = tc.x;
+  texture_v_[i] = tc.y;
+}
+
+void TangentSpaceBuilder::Accumulate(const unsigned short* indices,
+                                     size_t num_indices) {
+  const size_t num_triangles = num_indices / 3;
+  for (size_t t = 0; t < num_triangles; t += kLanes) {
+    // Gather up to four triangles, one per lane. Unused lanes repeat the
+    // first triangle and aren't written back.
+    const size_t count = std::min(kLanes, num_triangles - t);
+    size_t corners[3][kLanes];
+    for (size_t k = 0; k < kLanes; ++k) {
+      const size_t triangle = t + (k < count ? k : 0);
+      for (size_t c = 0; c < 3; ++c) {
+        corners[c][k] = indices[triangle * 3 + c];
+      }
+    }
+    const vec4 x0 = Gather(position_x_, corners[0]);
+    const vec4 y0 = Gather(position_y_, corners[0]);
+    const vec4 z0 = Gather(position_z_, corners[0]);
+    const vec4 u0 = Gather(texture_u_, corners[0]);
+    const vec4 v0 = Gather(texture_v_, corners[0]);
+    const vec4 edge1_x = Gather(position_x_, corners[1]) - x0;
+    const vec4 edge1_y = Gather(position_y_, corners[1]) - y0;
+    const vec4 edge1_z = Gather(position_z_, corners[1]) - z0;
+    const vec4 edge1_u = Gather(texture_u_, corners[1]) - u0;
+    const vec4 edge1_v = Gather(texture_v_, corners[1]) - v0;
+    const vec4 edge2_x = Gather(position_x_, corners[2]) - x0;
+    const vec4 edge2_y = Gather(position_y_, corners[2]) - y0;
+    const vec4 edge2_z = Gather(position_z_, corners[2]) - z0;
+    const vec4 edge2_u = Gather(texture_u_, corners[2]) - u0;
+    const vec4 edge2_v = Gather(texture_v_, corners[2]) - v0;
+
+    // The cross product of the edges is as long as twice the triangle's
+    // area, which weights its contribution.
+    const vec4 normal_x = edge1_y * edge2_z - edge1_z * edge2_y;
+    const vec4 normal_y = edge1_z * edge2_x - edge1_x * edge2_z;
+    const vec4 normal_z = edge1_x * edge2_y - edge1_y * edge2_x;
+
+    // Solve for the directions of increasing u and v. `scale` is
+    // 1 / `area`, without dividing by zero for degenerate texture mappings.
+    const vec4 area = edge1_u * edge2_v - edge2_u * edge1_v;
+    const vec4 scale = area / vec4::Max(area * area, vec4(kMinTextureAreaSq));
+    const vec4 tangent_x = (edge1_x * edge2_v - edge2_x * edge1_v) * scale;
+    const vec4 tangent_y = (edge1_y * edge2_v - edge2_y * edge1_v) * scale;
+    const vec4 tangent_z = (edge1_z * edge2_v - edge2_z * edge1_v) * scale;
+    const vec4 bitangent_x = (edge2_x * edge1_u - edge1_x * edge2_u) * scale;
+    const vec4 bitangent_y = (edge2_y * edge1_u - edge1_y * edge2_u) * scale;
+    const vec4 bitangent_z = (edge2_z * edge1_u - edge1_z * edge2_u) * scale;
+
+    for (size_t k = 0; k < count; ++k) {
+      for (size_t c = 0; c < 3; ++c) {
+        const size_t i = corners[c][k];
+        normal_x_[i] += normal_x[k];
+        normal_y_[i] += normal_y[k];
+        normal_z_[i] += normal_z[k];
+        tangent_x_[i] += tangent_x[k];
+        tangent_y_[i] += tangent_y[k];
+        tangent_z_[i] += tangent_z[k];
+        bitangent_x_[i] += bitangent_x[k];
+        bitangent_y_[i] += bitangent_y[k];
+        bitangent_z_[i] += bitangent_z[k];
+      }
+    }
+  }
+}
+
+void TangentSpaceBuilder::Normalize() {
+  for (size_t i = 0; i < normal_x_.size(); i += kLanes) {
+    const vec4 sum_x = Load(normal_x_, i);
+    const vec4 sum_y = Load(normal_y_, i);
+    const vec4 sum_z = Load(normal_z_, i);
+    const vec4 normal_scale =
+        InverseLength(sum_x * sum_x + sum_y * sum_y + sum_z * sum_z);
+    const vec4 normal_x = sum_x * normal_scale;
+    const vec4 normal_y = sum_y * normal_scale;
+    const vec4 normal_z = sum_z * normal_scale;
+
+    // Remove the part of the tangent along the normal (Gram-Schmidt).
+    const vec4 sum_tangent_x = Load(tangent_x_, i);
+    const vec4 sum_tangent_y = Load(tangent_y_, i);
+    const vec4 sum_tangent_z = Load(tangent_z_, i);
+    const vec4 along = normal_x * sum_tangent_x + normal_y * sum_tangent_y +
+                       normal_z * sum_tangent_z;
+    const vec4 flat_x = sum_tangent_x - normal_x * along;
+    const vec4 flat_y = sum_tangent_y - normal_y * along;
+    const vec4 flat_z = sum_tangent_z - normal_z * along;
+    const vec4 tangent_scale =
+        InverseLength(flat_x * flat_x + flat_y * flat_y + flat_z * flat_z);
+
+    // The bitangent the shader derives, normal x tangent, may point against
+    // the texture's v. The handedness flips it back.
+    const vec4 derived_x = normal_y * sum_tangent_z - normal_z * sum_tangent_y;
+    const vec4 derived_y = normal_z * sum_tangent_x - normal_x * sum_tangent_z;
+    const vec4 derived_z = normal_x * sum_tangent_y - normal_y * sum_tangent_x;
+    const vec4 agreement = derived_x * Load(bitangent_x_, i) +
+                           derived_y * Load(bitangent_y_, i) +
+                           derived_z * Load(bitangent_z_, i);
+    vec4 handedness;
+    for (size_t k = 0; k < kLanes; ++k) {
+      handedness[k] = agreement[k] < 0.0f ? -1.0f : 1.0f;
+    }
+
+    Store(normal_x, i, &normal_x_);
+    Store(normal_y, i, &normal_y_);
+    Store(normal_z, i, &normal_z_);
+    Store(flat_x * tangent_scale, i, &tangent_x_);
+    Store(flat_y * tangent_scale, i, &tangent_y_);
+    Store(flat_z * tangent_scale, i, &tangent_z_);
+    Store(handedness, i, &handedness_);
+  }
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,94 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_TANGENT_SPACE_H_
+#define ZOOSHI_TANGENT_SPACE_H_
+
+#include <stddef.h>
+#include <vector>
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// Computes smooth normals and tangents for procedurally generated meshes.
+// Positions and texture coordinates are copied out into structure-of-arrays
+// buffers, so triangles and vertices can be processed four at a time, one
+// per SIMD lane. The buffers are kept between calls, so reuse a builder
+// rather than making one per mesh. Not thread safe.
+class TangentSpaceBuilder {
+ public:
+  // Set the `norm` and `tangent` of each of `vertices` from the triangles in
+  // `indices`. Vertices need `pos`, `tc`, `norm` and `tangent` members, like
+  // NormalMappedVertex. Each triangle's contribution is weighted by its
+  // area. The tangent's w is the handedness of the bitangent.
+  template <typename T>
+  void Compute(T* vertices, size_t num_vertices,
+               const unsigned short* indices, size_t num_indices) {
+    Resize(num_vertices);
+    for (size_t i = 0; i < num_vertices; ++i) {
+      SetVertex(i, mathfu::vec3(vertices[i].pos),
+                mathfu::vec2(vertices[i].tc));
+    }
+    Accumulate(indices, num_indices);
+    Normalize();
+    for (size_t i = 0; i < num_vertices; ++i) {
+      vertices[i].norm = mathfu::vec3_packed(Normal(i));
+      vertices[i].tangent = mathfu::vec4_packed(Tangent(i));
+    }
+  }
+
+ private:
+  // Size the buffers for `num_vertices`, padded to a whole number of lanes,
+  // and clear the sums.
+  void Resize(size_t num_vertices);
+  void SetVertex(size_t i, const mathfu::vec3& pos, const mathfu::vec2& tc);
+
+  // Sum each triangle's normal and texture space directions into its
+  // vertices.
+  void Accumulate(const unsigned short* indices, size_t num_indices);
+
+  // Normalize the sums, and make the tangents perpendicular to the normals.
+  void Normalize();
+
+  mathfu::vec3 Normal(size_t i) const {
+    return mathfu::vec3(normal_x_[i], normal_y_[i], normal_z_[i]);
+  }
+  mathfu::vec4 Tangent(size_t i) const {
+    return mathfu::vec4(tangent_x_[i], tangent_y_[i], tangent_z_[i],
+                        handedness_[i]);
+  }
+
+  std::vector<float> position_x_;
+  std::vector<float> position_y_;
+  std::vector<float> position_z_;
+  std::vector<float> texture_u_;
+  std::vector<float> texture_v_;
+  std::vector<float> normal_x_;
+  std::vector<float> normal_y_;
+  std::vector<float> normal_z_;
+  // The direction of increasing u, and of increasing v, across the surface.
+  std::vector<float> tangent_x_;
+  std::vector<float> tangent_y_;
+  std::vector<float> tangent_z_;
+  std::vector<float> bitangent_x_;
+  std::vector<float> bitangent_y_;
+  std::vector<float> bitangent_z_;
+  std::vector<float> handedness_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_TANGENT_SPACE_H_
@@ -0,0 +1,61 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "trusted_assets.h"
+
+#include <string.h>
+#include "fplbase/utilities.h"
+#include "mapped_file.h"
+
+using fplbase::LogInfo;
+
+namespace fpl {
+namespace zooshi {
+
+// Written by build_assets.py. See TRUSTED_ASSETS_FILE and
+// write_trusted_assets() there.
+static const char kTrustedAssetsFile[] = "trusted_assets.txt";
+
+bool TrustedAssets::Load() {
+  Clear();
+  // Opened directly, so an overlay can't replace it.
+  MappedFile list;
+  if (!list.Open(kTrustedAssetsFile)) return false;
+
+  const char* line = list.data();
+  const char* end = list.data() + list.size();
+  while (line < end) {
+    const char* line_end = static_cast<const char*>(
+        memchr(line, '\n', static_cast<size_t>(end - line)));
+    if (line_end == nullptr) line_end = end;
+    const char* path_end = line_end;
+    if (path_end > line && path_end[-1] == '\r') path_end--;
+    const char* path = static_cast<const char*>(
+        memchr(line, ' ', static_cast<size_t>(path_end - line)));
+    if (path != nullptr && path + 1 < path_end) {
+      paths_.insert(std::string(path + 1, path_end));
+    }
+    line = line_end + 1;
+  }
+  LogInfo("Trusting %d assets verified when they were built",
+          static_cast<int>(paths_.size()));
+  return true;
+}
+
+bool TrustedAssets::Contains(const char* path) const {
+  return paths_.find(path) != paths_.end();
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,50 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_TRUSTED_ASSETS_H_
+#define ZOOSHI_TRUSTED_ASSETS_H_
+
+#include <string>
+#include <unordered_set>
+
+namespace fpl {
+namespace zooshi {
+
+// The flatbuffer binaries that build_assets.py verified when it built them,
+// listed in the trusted_assets.txt it writes when passed 'trusted_bundle'.
+// Loaders skip verifying these when they come from the game's own assets,
+// as their MappedFile::trusted() says. Files from overlays, downloads and
+// saves are always verified.
+//
+// Each line of the list is a file's SHA-1 and its path, so a package can be
+// checked against the build that verified it. The game only reads the
+// paths, as hashing a file costs as much as verifying it.
+class TrustedAssets {
+ public:
+  // Read the list, replacing any read before. Returns false, trusting
+  // nothing, if the assets weren't built as a trusted bundle.
+  bool Load();
+  void Clear() { paths_.clear(); }
+
+  // True if `path`, relative to the assets directory, was verified.
+  bool Contains(const char* path) const;
+
+ private:
+  std::unordered_set<std::string> paths_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_TRUSTED_ASSETS_H_
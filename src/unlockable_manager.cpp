@@ -37,7 +37,7 @@ void UnlockableManager::InitializeType(
     bool unlocked = true;
     if (!config->Get(i)->starts_unlocked()) {
       GetPreferenceString(buffer, kBufferSize, type, i);
-      unlocked = fplbase::LoadPreference(buffer, 0) != 0;
+      unlocked = save_store_->GetValue(buffer, 0) != 0;
     }
     unlockables_[type][i] = unlocked;
     if (!unlocked) {
@@ -59,7 +59,7 @@ void UnlockableManager::SetUnlock(UnlockableType type, size_t index,
     remaining_locked_total_ += unlocked ? -1 : 1;
     char buffer[kBufferSize];
     GetPreferenceString(buffer, kBufferSize, type, index);
-    fplbase::SavePreference(buffer, unlocked ? 1 : 0);
+    save_store_->SetValue(buffer, unlocked ? 1 : 0);
   }
 }
 
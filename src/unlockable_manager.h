@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "config_generated.h"
+#include "save_store.h"
 #include "unlockables_generated.h"
 
 namespace fpl {
@@ -38,6 +39,9 @@ struct Unlockable {
 // Tracks the unlockables of the game.
 class UnlockableManager {
  public:
+  // Unlocks are kept in `save_store`. Call before InitializeType().
+  void set_save_store(SaveStore* save_store) { save_store_ = save_store; }
+
   // Initialize the given type with the provided config data.
   void InitializeType(
       UnlockableType type,
@@ -76,6 +80,7 @@ class UnlockableManager {
   int remaining_locked_[UnlockableType_Size];
   // The total of the above array.
   int remaining_locked_total_;
+  SaveStore* save_store_;
 };
 
 }  // zooshi
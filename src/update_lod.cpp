@@ -0,0 +1,105 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "update_lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace fpl {
+namespace zooshi {
+
+using mathfu::vec2;
+using mathfu::vec3;
+
+void UpdateLod::AdvanceFrame(const vec3& raft_position,
+                             const corgi::CameraInterface* camera) {
+  frame_++;
+  raft_position_ = raft_position;
+  camera_ = camera;
+  if (camera_ != nullptr) {
+    // The viewport angle is the full vertical field of view. Widen it to
+    // reach the corners of the view.
+    const vec2 resolution = camera_->viewport_resolution();
+    const float aspect = resolution.y > 0.0f ? resolution.x / resolution.y
+                                             : 1.0f;
+    tan_half_view_angle_ = std::tan(camera_->viewport_angle() * 0.5f) *
+                           std::sqrt(1.0f + aspect * aspect);
+  }
+}
+
+bool UpdateLod::InView(const vec3& position) const {
+  if (camera_ == nullptr) return true;
+
+  // Test a sphere of radius `frustum_margin` against the cone that encloses
+  // the view frustum.
+  const float margin = config_->frustum_margin();
+  const vec3 to_position = position - camera_->position();
+  const vec3 facing = camera_->facing().Normalized();
+  const float forward = vec3::DotProduct(to_position, facing);
+  if (forward < -margin) return false;
+  const float side_sq =
+      std::max(to_position.LengthSquared() - forward * forward, 0.0f);
+  const float side_limit = (forward + margin) * tan_half_view_angle_ + margin;
+  return side_sq <= side_limit * side_limit;
+}
+
+UpdateLodTier UpdateLod::Tier(const vec3& position,
+                              bool dormant_allowed) const {
+  if (config_ == nullptr) return kUpdateLodFull;
+
+  const float dist_sq = (position - raft_position_).LengthSquared();
+  const float full_distance = config_->full_distance() * distance_scale_;
+  const float reduced_distance = config_->reduced_distance() * distance_scale_;
+  if (dist_sq <= full_distance * full_distance) return kUpdateLodFull;
+
+  const bool in_view = InView(position);
+  const bool in_range = dist_sq <= reduced_distance * reduced_distance;
+  if (in_view && in_range) return kUpdateLodFull;
+  if (in_view || in_range || !dormant_allowed) return kUpdateLodReduced;
+  return kUpdateLodDormant;
+}
+
+bool UpdateLod::Unseen(const vec3& position) const {
+  if (config_ == nullptr) return false;
+  const float full_distance = config_->full_distance() * distance_scale_;
+  return (position - raft_position_).LengthSquared() >
+             full_distance * full_distance &&
+         !InView(position);
+}
+
+bool UpdateLod::ShouldUpdate(UpdateLodTier tier, UpdateLodState* state,
+                             corgi::WorldTime* delta_time) const {
+  state->pending_time += *delta_time;
+
+  int interval = 1;
+  if (config_ != nullptr) {
+    if (tier == kUpdateLodReduced) {
+      interval = config_->reduced_interval();
+    } else if (tier == kUpdateLodDormant) {
+      interval = config_->dormant_interval();
+    }
+  }
+  if (interval > 1 &&
+      (frame_ + state->phase) % static_cast<unsigned int>(interval) != 0) {
+    return false;
+  }
+
+  *delta_time = state->pending_time;
+  state->pending_time = 0;
+  return true;
+}
+
+}  // zooshi
+}  // fpl
@@ -0,0 +1,111 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ZOOSHI_UPDATE_LOD_H_
+#define ZOOSHI_UPDATE_LOD_H_
+
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "corgi_component_library/camera_interface.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace zooshi {
+
+// How often an entity's game logic should be updated.
+enum UpdateLodTier {
+  kUpdateLodFull,     // Every frame.
+  kUpdateLodReduced,  // Every `reduced_interval` frames.
+  kUpdateLodDormant,  // Every `dormant_interval` frames.
+};
+
+// Per-entity bookkeeping for throttled updates.
+struct UpdateLodState {
+  UpdateLodState() : phase(0), pending_time(0) {}
+
+  // Offsets the frames on which this entity is updated, so that throttled
+  // entities don't all update on the same frame.
+  unsigned int phase;
+
+  // Time that has passed since the entity was last updated.
+  corgi::WorldTime pending_time;
+};
+
+// Chooses how often entities update, based on their distance to the raft and
+// whether they're in the camera's view. Entities that can't be seen or
+// interacted with can be updated less often, and are handed the time that
+// accumulated since their last update when they are.
+class UpdateLod {
+ public:
+  UpdateLod()
+      : config_(nullptr),
+        camera_(nullptr),
+        frame_(0),
+        next_phase_(0),
+        distance_scale_(1.0f),
+        tan_half_view_angle_(0.0f) {}
+
+  void Init(const UpdateLodConfig* config) { config_ = config; }
+
+  // Scale the configured full and reduced distances.
+  void set_distance_scale(float scale) { distance_scale_ = scale; }
+
+  // Call once per frame, before any calls to Tier() or ShouldUpdate().
+  // `camera` may be null, in which case everything is considered in view.
+  void AdvanceFrame(const mathfu::vec3& raft_position,
+                    const corgi::CameraInterface* camera);
+
+  // Give a new entity an update phase.
+  void InitState(UpdateLodState* state) { state->phase = next_phase_++; }
+
+  // The tier for an entity at `position`. Entities that can't be interacted
+  // with until the raft gets closer may be `dormant_allowed`. Otherwise, they
+  // are never given a rate below kUpdateLodReduced.
+  UpdateLodTier Tier(const mathfu::vec3& position, bool dormant_allowed) const;
+
+  // Add `delta_time` to the entity's pending time, and return whether it
+  // should update this frame. If it should, `delta_time` is set to all of the
+  // time since its last update.
+  bool ShouldUpdate(UpdateLodTier tier, UpdateLodState* state,
+                    corgi::WorldTime* delta_time) const;
+
+  // The time ShouldUpdate() gives an entity at kUpdateLodFull this frame,
+  // without changing its state.
+  static corgi::WorldTime FullDeltaTime(const UpdateLodState& state,
+                                        corgi::WorldTime delta_time) {
+    return state.pending_time + delta_time;
+  }
+
+  // True if an entity at `position` is beyond `full_distance` of the raft and
+  // out of the camera's view, so nothing about it can be seen.
+  bool Unseen(const mathfu::vec3& position) const;
+
+ private:
+  bool InView(const mathfu::vec3& position) const;
+
+  const UpdateLodConfig* config_;
+  const corgi::CameraInterface* camera_;
+  mathfu::vec3 raft_position_;
+  unsigned int frame_;
+  unsigned int next_phase_;
+  float distance_scale_;
+
+  // Tangent of the angle from the center of the view to its corners.
+  float tan_half_view_angle_;
+};
+
+}  // zooshi
+}  // fpl
+
+#endif  // ZOOSHI_UPDATE_LOD_H_
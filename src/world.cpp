@@ -14,6 +14,11 @@
 
 #include "world.h"
 
+#include <stdlib.h>
+#include <cmath>
+
+#include "asset_loader.h"
+
 #include "breadboard/graph_factory.h"
 #include "components_generated.h"
 #include "config_generated.h"
@@ -29,9 +34,11 @@
 #include "flatbuffers/flatbuffers.h"
 #include "fplbase/input.h"
 #include "fplbase/render_target.h"
+#include "fplbase/utilities.h"
 #include "input_config_generated.h"
 #include "mathfu/constants.h"
 #include "mathfu/glsl_mappings.h"
+#include "memory_tracker.h"
 #include "motive/init.h"
 #include "motive/math/angle.h"
 #include "rail_def_generated.h"
@@ -56,6 +63,12 @@ static const char kEntityLibraryFile[] = "entity_prototypes.zooentity";
 static const char kComponentDefBinarySchema[] =
     "flatbufferschemas/components.bfbs";
 
+const vec3 kMeshLightPosition(-10, -20, 20);
+
+// How often, in updates, the components' memory is counted. Counting walks
+// every component's entities.
+static const int kMemorySampleFrames = 60;
+
 void World::Initialize(
     const Config& config_, fplbase::InputSystem* input_system,
     fplbase::AssetManager* asset_mgr, WorldRenderer* worldrenderer,
@@ -63,7 +76,7 @@ void World::Initialize(
     breadboard::GraphFactory* graph_factory, fplbase::Renderer* renderer,
     SceneLab* scene_lab, UnlockableManager* unlockable_mgr, XpSystem* xpsystem,
     InvitesListener* invites_lstr, MessageListener* message_lstr,
-    AdMobHelper* admob_hlpr) {
+    AdMobHelper* admob_hlpr, JobSystem* jobsystem, AudioThread* audio_thread) {
   entity_factory.reset(new corgi::component_library::DefaultEntityFactory());
   motive::SplineInit::Register();
   motive::MatrixInit::Register();
@@ -76,6 +89,8 @@ void World::Initialize(
   xp_system = xpsystem;
 
   config = &config_;
+  job_system = jobsystem;
+  transform_interpolator.Initialize(config->fixed_timestep());
 
   physics_component.set_gravity(config->gravity());
   physics_component.set_max_steps(config->bullet_max_steps());
@@ -88,83 +103,93 @@ void World::Initialize(
   services_component.Initialize(config, asset_manager, input_system,
                                 audio_engine, font_manager, &rail_manager,
                                 entity_factory.get(), this, scene_lab);
-
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&common_services_component),
-      ComponentDataUnion_ServicesDef, "corgi.CommonServicesDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&services_component),
-      ComponentDataUnion_ServicesDef, "corgi.ServicesDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&graph_component),
-      ComponentDataUnion_corgi_GraphDef, "corgi.GraphDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&attributes_component),
-      ComponentDataUnion_AttributesDef, "fpl.AttributesDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&rail_denizen_component),
-      ComponentDataUnion_RailDenizenDef, "fpl.RailDenizenDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&simple_movement_component),
-      ComponentDataUnion_SimpleMovementDef, "fpl.SimpleMovementDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&lap_dependent_component),
-      ComponentDataUnion_LapDependentDef, "fpl.LapDependentDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&player_component),
-      ComponentDataUnion_PlayerDef, "fpl.PlayerDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&player_projectile_component),
-      ComponentDataUnion_PlayerProjectileDef, "fpl.PlayerProjectileDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&render_mesh_component),
-      ComponentDataUnion_corgi_RenderMeshDef, "corgi.RenderMeshDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&physics_component),
-      ComponentDataUnion_corgi_PhysicsDef, "corgi.PhysicsDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&patron_component),
-      ComponentDataUnion_PatronDef, "fpl.PatronDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&time_limit_component),
-      ComponentDataUnion_TimeLimitDef, "fpl.TimeLimitDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&audio_listener_component),
-      ComponentDataUnion_ListenerDef, "fpl.ListenerDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&sound_component),
-      ComponentDataUnion_SoundDef, "fpl.SoundDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&river_component),
-      ComponentDataUnion_RiverDef, "fpl.RiverDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&shadow_controller_component),
-      ComponentDataUnion_ShadowControllerDef, "fpl.ShadowControllerDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&meta_component),
-      ComponentDataUnion_corgi_MetaDef, "corgi.MetaDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&edit_options_component),
-      ComponentDataUnion_scene_lab_EditOptionsDef, "scene_lab.EditOptionsDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&scenery_component),
-      ComponentDataUnion_SceneryDef, "fpl.SceneryDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&animation_component),
-      ComponentDataUnion_corgi_AnimationDef, "corgi.AnimationDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&rail_node_component),
-      ComponentDataUnion_RailNodeDef, "fpl.RailNodeDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&render_3d_text_component),
-      ComponentDataUnion_Render3dTextDef, "fpl.Render3dTextDef");
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&light_component),
-      ComponentDataUnion_LightDef, "fpl.LightDef");
+  services_component.set_job_system(job_system);
+  services_component.set_audio_thread(audio_thread);
+  services_component.set_entity_pool(&entity_pool_component);
+  services_component.set_graph_events(&graph_events);
+  graph_events.Initialize(&graph_component);
+  entity_pool_component.Configure(config->entity_pool());
+
+  RegisterComponent(&common_services_component, ComponentDataUnion_ServicesDef,
+                    "corgi.CommonServicesDef");
+  RegisterComponent(&services_component, ComponentDataUnion_ServicesDef,
+                    "corgi.ServicesDef");
+  // Like the services, the pool isn't loaded from entity data.
+  RegisterComponent(&entity_pool_component, ComponentDataUnion_ServicesDef,
+                    "corgi.ServicesDef");
+  RegisterComponent(&graph_component, ComponentDataUnion_corgi_GraphDef,
+                    "corgi.GraphDef");
+  RegisterComponent(&attributes_component, ComponentDataUnion_AttributesDef,
+                    "fpl.AttributesDef");
+  RegisterComponent(&rail_denizen_component, ComponentDataUnion_RailDenizenDef,
+                    "fpl.RailDenizenDef");
+  RegisterComponent(&simple_movement_component,
+                    ComponentDataUnion_SimpleMovementDef,
+                    "fpl.SimpleMovementDef");
+  RegisterComponent(&lap_dependent_component,
+                    ComponentDataUnion_LapDependentDef, "fpl.LapDependentDef");
+  RegisterComponent(&player_component, ComponentDataUnion_PlayerDef,
+                    "fpl.PlayerDef");
+  RegisterComponent(&player_projectile_component,
+                    ComponentDataUnion_PlayerProjectileDef,
+                    "fpl.PlayerProjectileDef");
+  RegisterComponent(&render_mesh_component,
+                    ComponentDataUnion_corgi_RenderMeshDef,
+                    "corgi.RenderMeshDef");
+  RegisterComponent(&physics_component, ComponentDataUnion_corgi_PhysicsDef,
+                    "corgi.PhysicsDef");
+  RegisterComponent(&patron_component, ComponentDataUnion_PatronDef,
+                    "fpl.PatronDef");
+  RegisterComponent(&time_limit_component, ComponentDataUnion_TimeLimitDef,
+                    "fpl.TimeLimitDef");
+  RegisterComponent(&audio_listener_component, ComponentDataUnion_ListenerDef,
+                    "fpl.ListenerDef");
+  RegisterComponent(&shadow_controller_component,
+                    ComponentDataUnion_ShadowControllerDef,
+                    "fpl.ShadowControllerDef");
+  RegisterComponent(&sound_component, ComponentDataUnion_SoundDef,
+                    "fpl.SoundDef");
+  sound_component.set_max_voices(config->max_sound_voices());
+  RegisterComponent(&river_component, ComponentDataUnion_RiverDef,
+                    "fpl.RiverDef");
+  RegisterComponent(&meta_component, ComponentDataUnion_corgi_MetaDef,
+                    "corgi.MetaDef");
+  RegisterComponent(&edit_options_component,
+                    ComponentDataUnion_scene_lab_EditOptionsDef,
+                    "scene_lab.EditOptionsDef");
+  RegisterComponent(&scenery_component, ComponentDataUnion_SceneryDef,
+                    "fpl.SceneryDef");
+  RegisterComponent(&animation_component, ComponentDataUnion_corgi_AnimationDef,
+                    "corgi.AnimationDef");
+  RegisterComponent(&rail_node_component, ComponentDataUnion_RailNodeDef,
+                    "fpl.RailNodeDef");
+  RegisterComponent(&render_3d_text_component,
+                    ComponentDataUnion_Render3dTextDef, "fpl.Render3dTextDef");
+  RegisterComponent(&light_component, ComponentDataUnion_LightDef,
+                    "fpl.LightDef");
+  RegisterComponent(&particle_emitter_component,
+                    ComponentDataUnion_ParticleEmitterDef,
+                    "fpl.ParticleEmitterDef");
+  // After physics, so corrections to predicted projectiles move their bodies.
+  RegisterComponent(&remote_entity_component,
+                    ComponentDataUnion_RemoteEntityDef, "fpl.RemoteEntityDef");
   // Make sure you register TransformComponent after any components that use it.
-  entity_factory->SetComponentType(
-      entity_manager.RegisterComponent(&transform_component),
-      ComponentDataUnion_corgi_TransformDef, "corgi.TransformDef");
+  RegisterComponent(&transform_component, ComponentDataUnion_corgi_TransformDef,
+                    "corgi.TransformDef");
+
+  // These are registered next to each other, after the components whose
+  // results they use, and before SoundComponent, which plays from the
+  // listener, and TransformComponent.
+  component_scheduler.Initialize(job_system);
+  component_scheduler.Add(&time_limit_component, 0,
+                          kUpdateResourceTransformLocal |
+                              kUpdateResourceEntityDeletion);
+  component_scheduler.Add(&audio_listener_component,
+                          kUpdateResourceTransformWorld, kUpdateResourceAudio);
+  component_scheduler.Add(&shadow_controller_component,
+                          kUpdateResourceTransformLocal,
+                          kUpdateResourceTransformLocal |
+                              kUpdateResourceTransformHierarchy);
 
   physics_component.set_collision_callback(&PatronComponent::CollisionHandler,
                                            &patron_component);
@@ -173,10 +198,12 @@ void World::Initialize(
   entity_factory->set_debug_entity_creation(false);
   entity_factory->SetFlatbufferSchema(kComponentDefBinarySchema);
   entity_factory->AddEntityLibrary(kEntityLibraryFile);
+  prototype_cache.LoadLibrary(kEntityLibraryFile);
+  entity_pool_component.set_prototype_cache(&prototype_cache);
 
   entity_manager.set_entity_factory(entity_factory.get());
 
-  render_mesh_component.set_light_position(vec3(-10, -20, 20));
+  render_mesh_component.set_light_position(kMeshLightPosition);
   render_mesh_component.SetCullDistance(
       config->rendering_config()->cull_distance());
 
@@ -202,6 +229,88 @@ void World::Initialize(
   admob_helper = admob_hlpr;
 }
 
+void World::UpdateComponents(corgi::WorldTime delta_time) {
+  if (fixed_timestep == nullptr || !fixed_timestep->enabled()) {
+    StepComponents(delta_time);
+    return;
+  }
+  // Run whole steps, and render the leftover time by interpolating between
+  // the last two. The interpolator needs the transforms from before and
+  // after the last step.
+  const int steps = fixed_timestep->Accumulate(delta_time);
+  for (int i = 0; i < steps; ++i) {
+    if (i == steps - 1) transform_interpolator.Capture(&transform_component);
+    StepComponents(fixed_timestep->step_time());
+  }
+  if (steps > 0) transform_interpolator.Capture(&transform_component);
+  transform_interpolator.set_alpha(fixed_timestep->alpha());
+}
+
+void World::StepComponents(corgi::WorldTime delta_time) {
+  ProfileScope scope("UpdateComponents");
+  for (auto it = registered_components_.begin();
+       it != registered_components_.end(); ++it) {
+    // corgi's AnimationComponent update is the shared motive engine's
+    // AdvanceFrame(), which moves every motivator, not only the rigs.
+    ProfileScope component_scope(it->component == &animation_component
+                                     ? "MotiveEngine::AdvanceFrame"
+                                     : it->name);
+    it->component->UpdateAllEntities(delta_time);
+  }
+  graph_events.Dispatch();
+  ProfileScope delete_scope("DeleteMarkedEntities");
+  entity_manager.DeleteMarkedEntities();
+  if (--frames_until_memory_sample_ <= 0) {
+    MeasureComponentMemory();
+    frames_until_memory_sample_ = kMemorySampleFrames;
+  }
+  if (Profiler::Get().enabled()) CountMotivators();
+}
+
+void World::MeasureComponentMemory() {
+  size_t bytes = 0;
+  for (auto it = registered_components_.begin();
+       it != registered_components_.end(); ++it) {
+    bytes += it->data_bytes(it->component);
+  }
+  MemoryTracker::Get().Set(kMemoryComponents, bytes);
+}
+
+void World::CountMotivators() {
+  int rail_splines = 0;
+  for (auto it = rail_denizen_component.begin();
+       it != rail_denizen_component.end(); ++it) {
+    const RailDenizenData& data = it->data;
+    rail_splines += data.motivator.Valid() +
+                    data.orientation_motivator.Valid() +
+                    data.playback_rate.Valid();
+  }
+  int patron_splines = 0;
+  for (auto it = patron_component.begin(); it != patron_component.end();
+       ++it) {
+    const PatronData& data = it->data;
+    patron_splines +=
+        data.delta_position.Valid() + data.delta_face_angle.Valid();
+  }
+  int scenery_overshoots = 0;
+  for (auto it = scenery_component.begin(); it != scenery_component.end();
+       ++it) {
+    scenery_overshoots += it->data.delta_face_angle.Valid();
+  }
+  int rigs = 0;
+  for (auto it = animation_component.begin(); it != animation_component.end();
+       ++it) {
+    rigs += it->data.motivator.Valid();
+  }
+
+  Profiler& profiler = Profiler::Get();
+  profiler.SetCounter("Spline motivators (RailDenizenDef)", rail_splines);
+  profiler.SetCounter("Spline motivators (PatronDef)", patron_splines);
+  profiler.SetCounter("Overshoot motivators (SceneryDef)",
+                      scenery_overshoots);
+  profiler.SetCounter("Rig motivators (AnimationDef)", rigs);
+}
+
 void World::AddController(BasePlayerController* controller) {
   input_controllers.push_back(
       std::unique_ptr<BasePlayerController>(controller));
@@ -234,6 +343,13 @@ void World::ResetControllerFacing() {
   }
 }
 
+void World::DiscardControllerTaps() {
+  for (auto it = input_controllers.begin(); it != input_controllers.end();
+       ++it) {
+    it->get()->DiscardTaps();
+  }
+}
+
 void World::SetRenderingMode(RenderingMode rendering_mode) {
   if (rendering_mode == rendering_mode_) return;
 
@@ -261,9 +377,16 @@ void World::SetRenderingOption(RenderingMode rendering_mode, ShaderDefines s,
   }
 }
 
+void World::SetSuppressedRenderingOptions(uint32_t options) {
+  if (options == suppressed_rendering_options_) return;
+  suppressed_rendering_options_ = options;
+  rendering_dirty_ = true;
+}
+
 bool World::RenderingOptionEnabled(ShaderDefines s) const {
   assert(0 <= s && s < kNumShaderDefines);
-  return rendering_options_[rendering_mode_][s];
+  return rendering_options_[rendering_mode_][s] &&
+         (suppressed_rendering_options_ & (1u << s)) == 0;
 }
 
 bool World::RenderingOptionEnabled(RenderingMode rendering_mode,
@@ -273,28 +396,115 @@ bool World::RenderingOptionEnabled(RenderingMode rendering_mode,
   return rendering_options_[rendering_mode][s];
 }
 
-void LoadWorldDef(World* world, const WorldDef* world_def) {
-  for (auto iter = world->entity_manager.begin();
-       iter != world->entity_manager.end(); ++iter) {
-    world->entity_manager.DeleteEntity(iter.ToReference());
+// Read and verify an entity file, unless it's trusted. Safe to run on any
+// thread.
+static void ReadEntityFile(World::EntityFile* file) {
+  file->read = true;
+  file->valid = MapFile(file->filename.c_str(), &file->file);
+  if (!file->valid) {
+    fplbase::LogError("Couldn't load entity file %s", file->filename.c_str());
+    return;
   }
-  world->entity_manager.DeleteMarkedEntities();
-  assert(world->entity_manager.begin() == world->entity_manager.end());
-  for (size_t i = 0; i < world_def->entity_files()->size(); i++) {
-    flatbuffers::uoffset_t index = static_cast<flatbuffers::uoffset_t>(i);
-    const char* filename = world_def->entity_files()->Get(index)->c_str();
-    world->entity_factory->LoadEntitiesFromFile(filename,
-                                                &world->entity_manager);
+  if (file->file.trusted()) return;
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(file->file.data()), file->file.size());
+  file->valid = VerifyEntityListDefBuffer(verifier);
+  if (!file->valid) {
+    fplbase::LogError("Entity file %s is corrupt", file->filename.c_str());
   }
-  const LevelDef* level_def = world_def->levels()->Get(
-    static_cast<flatbuffers::uoffset_t>(world->level_index));
-  for (size_t i = 0; i < level_def->entity_files()->size(); i++) {
-    const char* filename = level_def->entity_files()->Get(
-      static_cast<flatbuffers::uoffset_t>(i))->c_str();
-    world->entity_factory->LoadEntitiesFromFile(filename,
-                                                &world->entity_manager);
+}
+
+// Create the entities in `file`, which has been read, and append them to
+// `entities`.
+static void CreateEntities(World* world, const World::EntityFile& file,
+                           std::vector<corgi::EntityRef>* entities) {
+  if (!file.valid) return;
+  const size_t first = entities->size();
+  world->entity_factory->LoadEntityListFromMemory(
+      file.file.data(), &world->entity_manager, entities);
+  // LoadEntitiesFromFile() records where entities came from, so the editor
+  // can save them back.
+  for (size_t i = first; i < entities->size(); ++i) {
+    corgi::component_library::MetaData* meta_data =
+        world->meta_component.GetComponentData((*entities)[i]);
+    if (meta_data != nullptr) meta_data->source_file = file.filename;
   }
+}
+
+// Read the entity files from `first` on, and create their entities.
+static void LoadEntityFiles(World* world, size_t first) {
+  // Read every file on the workers, then create their entities in order on
+  // this thread, since the entity manager isn't thread-safe. Prefetched files
+  // have been read already.
+  std::deque<World::EntityFile>& files = world->entity_files;
+  JobCounter reads;
+  for (size_t i = first; i < files.size(); ++i) {
+    World::EntityFile* file = &files[i];
+    if (file->read) continue;
+    if (world->job_system != nullptr) {
+      world->job_system->Run([file]() { ReadEntityFile(file); }, &reads);
+    } else {
+      ReadEntityFile(file);
+    }
+  }
+  if (world->job_system != nullptr) world->job_system->Wait(&reads);
+
+  std::vector<corgi::EntityRef> entities;
+  for (size_t i = first; i < files.size(); ++i) {
+    entities.clear();
+    CreateEntities(world, files[i], &entities);
+  }
+}
+
+static const LevelDef* CurrentLevelDef(const World* world,
+                                       const WorldDef* world_def) {
+  return world_def->levels()->Get(
+      static_cast<flatbuffers::uoffset_t>(world->level_index));
+}
 
+// Queue the files named in `filenames` to be read into `files`.
+static void AddEntityFiles(
+    const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>*
+        filenames,
+    std::deque<World::EntityFile>* files) {
+  for (auto it = filenames->begin(); it != filenames->end(); ++it) {
+    files->emplace_back();
+    files->back().filename = it->str();
+  }
+}
+
+// Tell the asset loader which level is loaded.
+static void SetLoadedLevel(World* world, const WorldDef* world_def) {
+  if (world->asset_loader != nullptr) {
+    world->asset_loader->set_loaded_level(
+        CurrentLevelDef(world, world_def)->name()->c_str());
+  }
+}
+
+// Queue the current level's entity files after the world's, and tell the
+// asset loader which level it's for.
+static void AddLevelFiles(World* world, const WorldDef* world_def) {
+  SetLoadedLevel(world, world_def);
+  AddEntityFiles(CurrentLevelDef(world, world_def)->entity_files(),
+                 &world->entity_files);
+}
+
+// Wait for any prefetched files, and move them into `world->entity_files` if
+// they're the ones `world_def` needs. Returns false if they weren't.
+static bool TakePrefetchedFiles(World* world, const WorldDef* world_def) {
+  if (world->prefetched_world_def == nullptr) return false;
+  world->job_system->Wait(&world->prefetch_reads);
+  const bool match = world->prefetched_world_def == world_def &&
+                     world->prefetched_level_index == world->level_index;
+  // Swapping leaves each file's mapping where it is.
+  if (match) world->entity_files.swap(world->prefetched_files);
+  world->prefetched_files.clear();
+  world->prefetched_world_def = nullptr;
+  return match;
+}
+
+// Link up the entities that were just loaded, and refill the entity pools.
+static void FinishLoading(World* world) {
   world->SetActiveController(kControllerDefault);
   world->active_player_entity = world->player_component.begin()->entity;
 
@@ -311,6 +521,278 @@ void LoadWorldDef(World* world, const WorldDef* world_def) {
   world->services_component.set_raft_entity(raft_entity);
 
   world->graph_component.PostLoadFixup();
+
+  // Loading deleted any pooled entities, so make new ones up front.
+  const EntityPoolConfig* pool_config = world->config->entity_pool();
+  if (pool_config != nullptr && pool_config->log_stats()) {
+    world->entity_pool_component.LogStats();
+  }
+  world->entity_pool_component.ResetStats();
+  world->entity_pool_component.PrewarmConfigured();
+  for (auto it = world->config->sushi_config()->begin();
+       it != world->config->sushi_config()->end(); ++it) {
+    const SushiConfig* sushi = static_cast<const SushiConfig*>(it->data());
+    world->entity_pool_component.Prewarm(
+        sushi->prototype()->c_str(), world->config->projectile_pool_size());
+  }
+}
+
+// Start reading `sector`'s entity files.
+static void ReadSector(World* world, World::LevelSector* sector) {
+  AddEntityFiles(sector->def->entity_files(), &sector->files);
+  for (auto it = sector->files.begin(); it != sector->files.end(); ++it) {
+    World::EntityFile* file = &*it;
+    if (world->job_system != nullptr) {
+      world->job_system->Run([file]() { ReadEntityFile(file); },
+                             &sector->reads);
+    } else {
+      ReadEntityFile(file);
+    }
+  }
+  sector->reading = true;
+}
+
+// Create the entities of `sector`, whose files have been read, and fix them
+// up the way FinishLoading() does the level's, without touching the rest.
+static void CreateSectorEntities(World* world, World::LevelSector* sector) {
+  std::vector<corgi::EntityRef>& entities = sector->entities;
+  for (auto it = sector->files.begin(); it != sector->files.end(); ++it) {
+    CreateEntities(world, *it, &entities);
+  }
+  for (auto it = entities.begin(); it != entities.end(); ++it) {
+    world->transform_component.UpdateChildLinks(*it);
+  }
+  world->rail_denizen_component.PostLoadFixup(entities);
+  world->patron_component.PostLoadFixup(entities);
+  world->patron_component.RestoreUnloaded(entities);
+  world->scenery_component.PostLoadFixup(entities);
+  for (auto it = entities.begin(); it != entities.end(); ++it) {
+    world->graph_component.EntityPostLoadFixup(*it);
+  }
+  world->rail_visibility.Invalidate();
+  sector->reading = false;
+  sector->loaded = true;
+}
+
+// Delete `sector`'s entities, along with their children, and drop its files.
+static void UnloadSector(World* world, World::LevelSector* sector) {
+  // The sector's patrons still count towards the level's.
+  world->patron_component.RetainUnloaded(sector->entities);
+  for (auto it = sector->entities.begin(); it != sector->entities.end();
+       ++it) {
+    if (it->IsValid()) world->entity_manager.DeleteEntity(*it);
+  }
+  // The entities may refer to the files' data until they're gone.
+  world->entity_manager.DeleteMarkedEntities();
+  sector->entities.clear();
+  sector->files.clear();
+  sector->loaded = false;
+  world->rail_visibility.Invalidate();
+}
+
+// Forget the loaded level's sectors. Their entities must have been deleted
+// already.
+static void ClearLevelSectors(World* world) {
+  for (auto it = world->level_sectors.begin();
+       it != world->level_sectors.end(); ++it) {
+    if (world->job_system != nullptr) world->job_system->Wait(&it->reads);
+  }
+  world->level_sectors.clear();
+  world->sectored_level = nullptr;
+}
+
+// Set up the current level's sectors, and load those around the raft's
+// starting point.
+static void AddLevelSectors(World* world, const WorldDef* world_def) {
+  const LevelDef* level = CurrentLevelDef(world, world_def);
+  if (level->sectors() == nullptr || level->sectors()->size() == 0) return;
+  for (auto it = level->sectors()->begin(); it != level->sectors()->end();
+       ++it) {
+    world->level_sectors.emplace_back();
+    world->level_sectors.back().def = *it;
+  }
+  world->sectored_level = level;
+  StreamLevelSectors(world, true);
+}
+
+// Read the current level's visibility sets, if it has them.
+static void LoadRailVisibility(World* world, const WorldDef* world_def) {
+  const LevelDef* level = CurrentLevelDef(world, world_def);
+  world->rail_visibility.Clear();
+  if (level->visibility_file() != nullptr) {
+    world->rail_visibility.Load(level->visibility_file()->c_str());
+  }
+}
+
+// The raft's rail, if it can measure distances along it, and how far along
+// it the raft is. Returns null otherwise.
+static const Rail* RaftRailPosition(World* world, float* position) {
+  const RailDenizenData* raft = world->rail_denizen_component.GetComponentData(
+      world->services_component.raft_entity());
+  if (raft == nullptr || raft->rail == nullptr ||
+      !raft->rail->HasLookupTable()) {
+    return nullptr;
+  }
+  *position = raft->rail->Distance(raft->lap_progress * raft->rail->EndTime());
+  return raft->rail;
+}
+
+// `distance` along a rail `length` long, wrapped to [0, length).
+static float WrapRailDistance(float distance, float length) {
+  return distance - std::floor(distance / length) * length;
+}
+
+void StreamLevelSectors(World* world, bool wait) {
+  if (world->level_sectors.empty()) return;
+  float position = 0.0f;
+  const Rail* raft_rail = RaftRailPosition(world, &position);
+  if (raft_rail == nullptr) return;
+  const Rail& rail = *raft_rail;
+  const float length = rail.Length();
+  const LevelDef* level = world->sectored_level;
+
+  int loads = 0;
+  for (auto it = world->level_sectors.begin();
+       it != world->level_sectors.end(); ++it) {
+    World::LevelSector* sector = &*it;
+    const LevelSectorDef* def = sector->def;
+    // How far the raft is from reaching the sector, and from its end.
+    float ahead = def->start() - position;
+    float behind = position - def->end();
+    if (rail.wraps() && length > 0.0f) {
+      ahead = WrapRailDistance(ahead, length);
+      behind = WrapRailDistance(behind, length);
+    }
+    const bool inside = def->start() <= position && position < def->end();
+    const bool load = inside || ahead <= level->sector_load_ahead();
+    const bool keep = load || behind <= level->sector_unload_behind();
+
+    if (!sector->reading && !sector->loaded) {
+      if (!load) continue;
+      ReadSector(world, sector);
+    }
+    if (sector->reading) {
+      if (wait && world->job_system != nullptr) {
+        world->job_system->Wait(&sector->reads);
+      }
+      // Files still being read can't be dropped.
+      if (!sector->reads.Done()) continue;
+      if (!keep) {
+        sector->files.clear();
+        sector->reading = false;
+      } else if (wait || loads < level->sector_loads_per_frame()) {
+        ProfileScope scope("CreateSectorEntities");
+        CreateSectorEntities(world, sector);
+        loads++;
+      }
+    } else if (!keep) {
+      UnloadSector(world, sector);
+    }
+  }
+}
+
+void UpdateRailVisibility(World* world) {
+  if (!world->rail_visibility.loaded()) return;
+  float position = 0.0f;
+  if (RaftRailPosition(world, &position) == nullptr) return;
+  world->rail_visibility.Update(position, &world->entity_manager,
+                                &world->meta_component);
+}
+
+// Seed rand() for loading a level, keeping the seed.
+static void SeedLevel(World* world) {
+  if (!world->keep_level_seed) {
+    world->level_seed = static_cast<uint32_t>(rand());
+  }
+  srand(world->level_seed);
+}
+
+void LoadWorldDef(World* world, const WorldDef* world_def) {
+  SeedLevel(world);
+  for (auto iter = world->entity_manager.begin();
+       iter != world->entity_manager.end(); ++iter) {
+    world->entity_manager.DeleteEntity(iter.ToReference());
+  }
+  world->entity_manager.DeleteMarkedEntities();
+  assert(world->entity_manager.begin() == world->entity_manager.end());
+  ClearLevelSectors(world);
+  world->particle_emitter_component.ClearBursts();
+
+  world->entity_files.clear();
+  if (TakePrefetchedFiles(world, world_def)) {
+    world->num_world_entity_files = world_def->entity_files()->size();
+    SetLoadedLevel(world, world_def);
+  } else {
+    AddEntityFiles(world_def->entity_files(), &world->entity_files);
+    world->num_world_entity_files = world->entity_files.size();
+    AddLevelFiles(world, world_def);
+  }
+  LoadEntityFiles(world, 0);
+  world->loaded_world_def = world_def;
+  FinishLoading(world);
+  LoadRailVisibility(world, world_def);
+  AddLevelSectors(world, world_def);
+}
+
+void PrefetchWorldDef(World* world, const WorldDef* world_def) {
+  if (world->job_system == nullptr || world->job_system->num_workers() == 0) {
+    return;
+  }
+  if (world->prefetched_world_def == world_def &&
+      world->prefetched_level_index == world->level_index) {
+    return;
+  }
+  // Files still being read can't be dropped.
+  if (world->prefetched_world_def != nullptr) {
+    world->job_system->Wait(&world->prefetch_reads);
+  }
+  world->prefetched_files.clear();
+  AddEntityFiles(world_def->entity_files(), &world->prefetched_files);
+  AddEntityFiles(CurrentLevelDef(world, world_def)->entity_files(),
+                 &world->prefetched_files);
+  for (auto it = world->prefetched_files.begin();
+       it != world->prefetched_files.end(); ++it) {
+    World::EntityFile* file = &*it;
+    world->job_system->Run([file]() { ReadEntityFile(file); },
+                           &world->prefetch_reads);
+  }
+  world->prefetched_world_def = world_def;
+  world->prefetched_level_index = world->level_index;
+}
+
+void LoadLevelDef(World* world, const WorldDef* world_def) {
+  if (world->loaded_world_def != world_def) {
+    LoadWorldDef(world, world_def);
+    return;
+  }
+  SeedLevel(world);
+
+  // Keep the entities from the world's own files. Everything else came from
+  // the level, or was spawned while playing.
+  const size_t num_world_files = world->num_world_entity_files;
+  for (auto iter = world->entity_manager.begin();
+       iter != world->entity_manager.end(); ++iter) {
+    corgi::EntityRef entity = iter.ToReference();
+    const corgi::component_library::MetaData* meta_data =
+        world->meta_component.GetComponentData(entity);
+    bool keep = false;
+    for (size_t i = 0; meta_data != nullptr && i < num_world_files; ++i) {
+      keep = keep || meta_data->source_file == world->entity_files[i].filename;
+    }
+    if (!keep) world->entity_manager.DeleteEntity(entity);
+  }
+  world->entity_manager.DeleteMarkedEntities();
+  ClearLevelSectors(world);
+  world->particle_emitter_component.ClearBursts();
+
+  while (world->entity_files.size() > num_world_files) {
+    world->entity_files.pop_back();
+  }
+  AddLevelFiles(world, world_def);
+  LoadEntityFiles(world, num_world_files);
+  FinishLoading(world);
+  LoadRailVisibility(world, world_def);
+  AddLevelSectors(world, world_def);
 }
 
 }  // zooshi
@@ -15,20 +15,25 @@
 #ifndef ZOOSHI_WORLD_H_
 #define ZOOSHI_WORLD_H_
 
+#include <deque>
 #include <map>
 #include <memory>
 #include <string>
 
 #include "admob.h"
+#include "component_scheduler.h"
 #include "components/attributes.h"
 #include "components/audio_listener.h"
+#include "components/entity_pool.h"
 #include "components/lap_dependent.h"
 #include "components/light.h"
+#include "components/particles.h"
 #include "components/patron.h"
 #include "components/player.h"
 #include "components/player_projectile.h"
 #include "components/rail_denizen.h"
 #include "components/rail_node.h"
+#include "components/remote_entity.h"
 #include "components/render_3d_text.h"
 #include "components/river.h"
 #include "components/scenery.h"
@@ -47,6 +52,9 @@
 #include "corgi_component_library/physics.h"
 #include "corgi_component_library/rendermesh.h"
 #include "corgi_component_library/transform.h"
+#include "fixed_timestep.h"
+#include "graph_event_queue.h"
+#include "rail_visibility.h"
 
 #include "mathfu/internal/disable_warnings_begin.h"
 
@@ -60,11 +68,16 @@
 #include "inputcontrollers/gamepad_controller.h"
 #include "inputcontrollers/onscreen_controller.h"
 #include "invites.h"
+#include "job_system.h"
+#include "mapped_file.h"
 #include "messaging.h"
+#include "profiler.h"
+#include "prototype_cache.h"
 #include "railmanager.h"
 #include "scene_lab/corgi/corgi_adapter.h"
 #include "scene_lab/corgi/edit_options.h"
 #include "scene_lab/scene_lab.h"
+#include "sprite_batch.h"
 #include "unlockable_manager.h"
 #include "world_renderer.h"
 #include "xp_system.h"
@@ -91,6 +104,9 @@ enum ShaderDefines {
   kNumShaderDefines
 };
 
+// Where RenderMeshComponent lights meshes from, in world space.
+extern const mathfu::vec3 kMeshLightPosition;
+
 // Different rendering modes can have different values for shader defines.
 enum RenderingMode {
   kRenderingMonoscopic,
@@ -98,24 +114,50 @@ enum RenderingMode {
   kNumRenderingModes
 };
 
+class AnalyticsBuffer;
+class AssetLoader;
+class GlUploader;
+class ResidencyCache;
+class ResumeSnapshot;
+class SaveStore;
 class WorldRenderer;
 struct Config;
 
 struct World {
  public:
   World()
-      : draw_debug_physics(false),
+      : num_world_entity_files(0),
+        loaded_world_def(nullptr),
+        prefetched_world_def(nullptr),
+        prefetched_level_index(0),
+        sectored_level(nullptr),
+        fixed_timestep(nullptr),
+        asset_loader(nullptr),
+        analytics(nullptr),
+        save_store(nullptr),
+        resume_snapshot(nullptr),
+        residency_cache(nullptr),
+        gl_uploader(nullptr),
+        draw_debug_physics(false),
         skip_rendermesh_rendering(false),
         is_single_stepping(false),
         sushi_index(0),
         // Start on the Easy level, which is at 1.
         level_index(1),
+        level_seed(0),
+        keep_level_seed(false),
         rendering_mode_(kRenderingMonoscopic),
-        rendering_dirty_(true) {
+        rendering_dirty_(true),
+        suppressed_rendering_options_(0),
+        frames_until_memory_sample_(0) {
 #if FPLBASE_ANDROID_VR
     hmd_controller = nullptr;
     onscreen_controller = nullptr;
 #endif  // FPLBASE_ANDROID_VR
+#ifdef USING_GOOGLE_PLAY_GAMES
+    gpg_manager = nullptr;
+    gpg_multiplayer = nullptr;
+#endif  // USING_GOOGLE_PLAY_GAMES
     memset(rendering_options_, 0, sizeof(rendering_options_));
   }
 
@@ -128,13 +170,60 @@ struct World {
                   fplbase::Renderer* renderer, scene_lab::SceneLab* scene_lab,
                   UnlockableManager* unlockable_mgr, XpSystem* xp_system,
                   InvitesListener* invites_lstr, MessageListener* message_lstr,
-                  AdMobHelper* admob_hlpr);
+                  AdMobHelper* admob_hlpr, JobSystem* jobsystem,
+                  AudioThread* audio_thread);
 
   // Entity manager
   corgi::EntityManager entity_manager;
 
   // Entity factory, for creating entities from data.
   std::unique_ptr<corgi::component_library::EntityFactory> entity_factory;
+  // Prototypes flattened for entities created while playing.
+  PrototypeCache prototype_cache;
+
+  // An entity file of the loaded world or level. Entities may refer to its
+  // data, so it's kept, in place, until they're unloaded.
+  struct EntityFile {
+    EntityFile() : read(false), valid(false) {}
+    std::string filename;
+    MappedFile file;
+    // Whether the file's been read yet, and whether it was read and verified.
+    bool read;
+    bool valid;
+  };
+  // The world def's files, followed by the level's.
+  std::deque<EntityFile> entity_files;
+  size_t num_world_entity_files;
+  // The world def whose entities are loaded, if any.
+  const WorldDef* loaded_world_def;
+  // Files being read by PrefetchWorldDef(), while the loaded ones are still
+  // in use, and which world def and level they're for.
+  std::deque<EntityFile> prefetched_files;
+  const WorldDef* prefetched_world_def;
+  size_t prefetched_level_index;
+  JobCounter prefetch_reads;
+
+  // A sector of the loaded level, and how much of it is loaded.
+  struct LevelSector {
+    LevelSector() : def(nullptr), reading(false), loaded(false) {}
+    const LevelSectorDef* def;
+    std::deque<EntityFile> files;
+    JobCounter reads;
+    // The entities created from `files`, while it's loaded.
+    std::vector<corgi::EntityRef> entities;
+    // Whether `files` are being, or have been, read but have no entities
+    // yet, and whether they have.
+    bool reading;
+    bool loaded;
+  };
+  // The sectors of the loaded level, if it has any, and that level. Only
+  // those near the raft are loaded.
+  std::deque<LevelSector> level_sectors;
+  const LevelDef* sectored_level;
+
+  // What can be seen from where the raft is on the loaded level's rail, if
+  // the level has it baked.
+  RailVisibility rail_visibility;
 
   // Rail Manager - manages loading and storing of rail definitions
   RailManager rail_manager;
@@ -145,6 +234,7 @@ struct World {
   RailDenizenComponent rail_denizen_component;
   PlayerComponent player_component;
   PlayerProjectileComponent player_projectile_component;
+  EntityPoolComponent entity_pool_component;
   corgi::component_library::RenderMeshComponent render_mesh_component;
   corgi::component_library::PhysicsComponent physics_component;
   PatronComponent patron_component;
@@ -164,7 +254,20 @@ struct World {
   SimpleMovementComponent simple_movement_component;
   LapDependentComponent lap_dependent_component;
   corgi::component_library::GraphComponent graph_component;
+  // Events for graph_component, broadcast after the components update.
+  GraphEventQueue graph_events;
   Render3dTextComponent render_3d_text_component;
+  RemoteEntityComponent remote_entity_component;
+  ParticleEmitterComponent particle_emitter_component;
+
+  // Worker threads for splitting up component updates.
+  JobSystem* job_system;
+
+  // Runs the updates of components that can share the job system.
+  ComponentScheduler component_scheduler;
+
+  // Blends entity transforms between simulation steps while rendering.
+  TransformInterpolator transform_interpolator;
 
   // Each player has direct control over one entity.
   corgi::EntityRef active_player_entity;
@@ -172,6 +275,21 @@ struct World {
   const Config* config;
 
   fplbase::AssetManager* asset_manager;
+  // Splits the time UpdateComponents() is given into simulation steps. May
+  // be null, in which case each call is one step.
+  FixedTimestep* fixed_timestep;
+  // Streams in asset groups after startup. May be null.
+  AssetLoader* asset_loader;
+  // Counts frequent analytics events. May be null.
+  AnalyticsBuffer* analytics;
+  // The player's settings and progress.
+  SaveStore* save_store;
+  // The game saved when the app was last backgrounded. May be null.
+  ResumeSnapshot* resume_snapshot;
+  // Copies of generated meshes, for a lost GL context. May be null.
+  ResidencyCache* residency_cache;
+  // Makes generated meshes' GL buffers off the render thread. May be null.
+  GlUploader* gl_uploader;
   WorldRenderer* world_renderer;
 
   UnlockableManager* unlockables;
@@ -209,10 +327,35 @@ struct World {
 
   fplbase::Material* cardboard_settings_gear;
 
+  // Screen-space quads queued by the states over a frame, drawn at its end.
+  SpriteBatch sprite_batch;
+
+  // Advance the simulation by `delta_time`, in as many fixed steps as
+  // `fixed_timestep` says, so the states that call it only run once a
+  // rendered frame and see each input edge once. Use instead of
+  // EntityManager::UpdateComponents().
+  void UpdateComponents(corgi::WorldTime delta_time);
+
+  // Update every component once, in the order they were registered, timing
+  // each with the profiler.
+  void StepComponents(corgi::WorldTime delta_time);
+
+  // Count the components' data towards the MemoryTracker. Called by
+  // UpdateComponents() every so often.
+  void MeasureComponentMemory();
+
+  // Count the live motivators each component drives, by motive processor,
+  // as profiler counters. The engine's time is the AnimationDef region,
+  // since AnimationComponent advances it. Called by UpdateComponents() while
+  // the profiler is enabled.
+  void CountMotivators();
+
   void AddController(BasePlayerController* controller);
   void SetActiveController(ControllerType controller_type);
   // Reset all controllers back to the default facing values.
   void ResetControllerFacing();
+  // Ignore taps made before now, so they don't throw sushi.
+  void DiscardControllerTaps();
 
   RenderingMode rendering_mode() const { return rendering_mode_; }
   void SetRenderingMode(RenderingMode rendering_mode);
@@ -221,6 +364,9 @@ struct World {
   bool RenderingOptionEnabled(ShaderDefines s) const;
   bool RenderingOptionEnabled(RenderingMode rendering_mode,
                               ShaderDefines s) const;
+  // Turn options off in the current rendering mode whatever they're set to,
+  // as a mask of 1 << ShaderDefines, without changing the settings.
+  void SetSuppressedRenderingOptions(uint32_t options);
   bool RenderingOptionsDirty() const { return rendering_dirty_; }
   void ResetRenderingDirty() { rendering_dirty_ = false; }
 
@@ -278,7 +424,44 @@ struct World {
   // The index of the level layout to use.
   size_t level_index;
 
+  // rand() is seeded with this before a level is loaded, so a recording can
+  // load it the same way. Unless `keep_level_seed` is set, each load draws a
+  // new seed from rand() first.
+  uint32_t level_seed;
+  bool keep_level_seed;
+
  private:
+  struct RegisteredComponent {
+    corgi::ComponentInterface* component;
+    // The name of the component's def, for the profiler.
+    const char* name;
+    // The bytes of data the component holds for its entities.
+    size_t (*data_bytes)(corgi::ComponentInterface* component);
+  };
+
+  template <typename T>
+  static size_t ComponentDataBytes(corgi::ComponentInterface* component) {
+    T* typed = static_cast<T*>(component);
+    size_t count = 0;
+    for (auto it = typed->begin(); it != typed->end(); ++it) ++count;
+    return count * sizeof(*typed->begin());
+  }
+
+  // Register `component` with the entity manager and the entity factory.
+  template <typename T>
+  void RegisterComponent(T* component, unsigned int data_type,
+                         const char* def_name) {
+    const corgi::ComponentId id = entity_manager.RegisterComponent(component);
+    entity_factory->SetComponentType(id, data_type, def_name);
+    prototype_cache.SetComponentType(id, data_type);
+    RegisteredComponent registered = {component, def_name,
+                                      ComponentDataBytes<T>};
+    registered_components_.push_back(registered);
+  }
+
+  // Components in the order they were registered.
+  std::vector<RegisteredComponent> registered_components_;
+
   // Determines if the game is in Cardboard mode (for special rendering).
   RenderingMode rendering_mode_;
 
@@ -288,6 +471,12 @@ struct World {
 
   // Whether any rendering option has been modified since last draw call.
   bool rendering_dirty_;
+
+  // Options RenderingOptionEnabled() reports as off in the current mode.
+  uint32_t suppressed_rendering_options_;
+
+  // UpdateComponents() calls until MeasureComponentMemory() is next called.
+  int frames_until_memory_sample_;
 };
 
 // Removes all entities from the world, then repopulates it based on the entity
@@ -295,6 +484,28 @@ struct World {
 // up the player's controller to the player entity.
 void LoadWorldDef(World* world, const WorldDef* world_def);
 
+// Start reading the entity files LoadWorldDef() would for `world_def` and
+// `world->level_index` on the job system, so it doesn't have to wait on them.
+// Nothing loaded is changed. Does nothing without worker threads.
+void PrefetchWorldDef(World* world, const WorldDef* world_def);
+
+// Start reading the loaded level's sectors that the raft is approaching,
+// create the entities of those that have been read, and delete those of the
+// sectors it's left behind. With `wait`, reads are waited on and every sector
+// in range is created, rather than some each frame. Call every frame while the
+// raft moves. Does nothing for levels without sectors.
+void StreamLevelSectors(World* world, bool wait);
+
+// Pick the loaded level's set of visible entities for where the raft is. Call
+// every frame while the raft moves, after StreamLevelSectors().
+void UpdateRailVisibility(World* world);
+
+// Replaces the loaded level's entities with those of `world->level_index`,
+// keeping the entities from the WorldDef's own files, such as the ground and
+// skybox. Anything spawned while playing is removed. If `world_def` isn't
+// loaded, loads it with LoadWorldDef().
+void LoadLevelDef(World* world, const WorldDef* world_def);
+
 }  // zooshi
 }  // fpl
 
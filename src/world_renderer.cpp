@@ -14,12 +14,20 @@
 
 #include "world_renderer.h"
 
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
 #include "components/light.h"
 #include "components/services.h"
+#include "btBulletDynamicsCommon.h"
 #include "corgi_component_library/transform.h"
 #include "fplbase/debug_markers.h"
 #include "fplbase/flatbuffer_utils.h"
+#include "fplbase/utilities.h"
+#include "mapped_file.h"
 #include "motive/math/angle.h"
+#include "profiler.h"
 
 using mathfu::vec2i;
 using mathfu::vec2;
@@ -40,12 +48,20 @@ using corgi::EntityRef;
 // The texture ID that maps the one the shader is expecting. Any change to
 // this constant must be mirrored in shadow_map.glslf_h texture_unit_<id>.
 static const int kShadowMapTextureID = 7;
+static const int kDynamicShadowMapTextureID = 6;
 
 // RGB values should be near-max (1.0) to represent max depth, but the
 // DecodeFloatFromRGBA function in shadow_map.glslf_h requires that the values
 // are not at the max value.
 static const vec4 kShadowMapClearColor = vec4(0.99f, 0.99f, 0.99f, 1.0f);
 
+// Shadow maps are never scaled down below this many texels across.
+static const int kMinShadowMapResolution = 128;
+
+// A light's view fitted to the camera's is widened in steps of this many
+// radians (half a degree), so its texels only change size now and then.
+static const float kShadowFitAngleStep = 0.00872665f;
+
 static const char *kDefinesText[] = {"PHONG_SHADING", "SPECULAR_EFFECT",
                                      "SHADOW_EFFECT", "NORMALS"};
 static_assert(FPL_ARRAYSIZE(kDefinesText) == kNumShaderDefines,
@@ -53,27 +69,123 @@ static_assert(FPL_ARRAYSIZE(kDefinesText) == kNumShaderDefines,
 
 const char *kEmptyString = "";
 
-void WorldRenderer::Initialize(World *world) {
-  int shadow_map_resolution =
-      world->config->rendering_config()->shadow_map_resolution();
-  shadow_map_.Initialize(
-      mathfu::vec2i(shadow_map_resolution, shadow_map_resolution));
+// Lists the rendering options that may be enabled together, one set per
+// line, named by their kDefinesText. Written by build_assets.py.
+static const char kShaderVariantsFile[] = "shader_variants.txt";
+
+// The name each render pass is timed under on the GPU.
+static const char *GpuPassName(int pass) {
+  switch (pass) {
+    case corgi::RenderPass_Opaque:
+      return "Opaque";
+    case corgi::RenderPass_Alpha:
+      return "Alpha";
+    default:
+      return "RenderPass";
+  }
+}
+
+// Whether the second shadow map holds a near cascade, rather than the moving
+// casters or nothing.
+static bool ShadowCascades(const RenderConfig *config) {
+  return config->fit_shadows_to_view() && !config->cache_static_shadows() &&
+         config->shadow_cascade_split() > 0.0f;
+}
+
+// The shadow maps' configured resolution, scaled by `scale`.
+static int ScaledShadowMapResolution(int resolution, float scale) {
+  return std::max(static_cast<int>(static_cast<float>(resolution) * scale),
+                  kMinShadowMapResolution);
+}
+
+void WorldRenderer::Initialize(World *world, fplbase::Renderer &renderer) {
+  const RenderConfig *config = world->config->rendering_config();
+  shadow_map_scale_ = 0.0f;
+  shadow_map_resolution_ = 0;
+  SetShadowMapScale(world, 1.0f);
+
+  RegisterUniforms();
+  render_queue_.Initialize(config, &world->entity_manager);
+  shader_cache_.Initialize(renderer);
+  shader_variants_.clear();
+  shader_variants_loaded_ = false;
+  next_shader_variant_ = 0;
+  RefreshGlobalShaderDefines(world, renderer);
+  gpu_timer_.Initialize();
+  culler_.Initialize(config, world->asset_manager, &world->entity_manager);
+  instancer_.Initialize(config, world->asset_manager, renderer,
+                        &world->entity_manager);
+  impostors_.Initialize(config, world->asset_manager, &world->entity_manager);
+  debug_draw_.Initialize(world->asset_manager);
+  view_culled_ = false;
+
+  cache_static_shadows_ = config->cache_static_shadows();
+  static_shadows_valid_ = false;
+  dynamic_shadow_map_cleared_ = false;
+  static_caster_hash_ = 0;
+  light_focus_ = mathfu::kZeros3f;
+  static_light_focus_ = mathfu::kZeros3f;
+  shadow_plan_ = kShadowPlanAll;
+
+  dynamic_resolution_.Initialize(world->config->dynamic_resolution());
+  gpu_timer_.set_required(dynamic_resolution_.enabled());
+  scene_target_size_ = mathfu::kZeros2i;
+  scene_size_ = mathfu::kZeros2i;
+}
 
-  RefreshGlobalShaderDefines(world);
+void WorldRenderer::SetShadowMapScale(World *world, float scale) {
+  if (scale == shadow_map_scale_) return;
+  shadow_map_scale_ = scale;
+  const RenderConfig *config = world->config->rendering_config();
+  const int resolution =
+      ScaledShadowMapResolution(config->shadow_map_resolution(), scale);
+  if (resolution == shadow_map_resolution_) return;
+  shadow_map_resolution_ = resolution;
+
+  // A near cascade needs as much detail as the map it's cut from.
+  const int dynamic_resolution =
+      config->dynamic_shadow_map_resolution() > 0 && !ShadowCascades(config)
+          ? ScaledShadowMapResolution(config->dynamic_shadow_map_resolution(),
+                                      scale)
+          : resolution;
+  shadow_map_.Delete();
+  shadow_map_.Initialize(mathfu::vec2i(resolution, resolution));
+  dynamic_shadow_map_resolution_ = dynamic_resolution;
+  dynamic_shadow_map_.Delete();
+  dynamic_shadow_map_.Initialize(
+      mathfu::vec2i(dynamic_resolution, dynamic_resolution));
+  static_shadows_valid_ = false;
+  dynamic_shadow_map_cleared_ = false;
 }
 
-void WorldRenderer::RefreshGlobalShaderDefines(World *world) {
+void WorldRenderer::RefreshGlobalShaderDefines(World *world,
+                                               fplbase::Renderer &renderer) {
+  uint32_t enabled = 0;
+  for (int s = 0; s < kNumShaderDefines; ++s) {
+    if (world->RenderingOptionEnabled(static_cast<ShaderDefines>(s))) {
+      enabled |= 1u << s;
+    }
+  }
+  ApplyShaderDefines(world, renderer, enabled);
+  world->ResetRenderingDirty();
+}
+
+void WorldRenderer::ApplyShaderDefines(World *world,
+                                       fplbase::Renderer &renderer,
+                                       uint32_t enabled) {
   std::vector<std::string> defines_to_add;
   std::vector<std::string> defines_to_omit;
+  std::string defines_key;
   for (int s = 0; s < kNumShaderDefines; ++s) {
-    ShaderDefines shader_define = static_cast<ShaderDefines>(s);
-    if (!world->RenderingOptionEnabled(shader_define)) {
-      defines_to_omit.push_back(kDefinesText[shader_define]);
+    if ((enabled & (1u << s)) == 0) {
+      defines_to_omit.push_back(kDefinesText[s]);
+      defines_key += std::string("-") + kDefinesText[s];
     }
   }
 
   world->asset_manager->ResetGlobalShaderDefines(defines_to_add,
                                                  defines_to_omit);
+  shader_cache_.set_defines(defines_key);
 
   PushDebugMarker("ShaderCompile");
 
@@ -82,22 +194,217 @@ void WorldRenderer::RefreshGlobalShaderDefines(World *world) {
       world->asset_manager->FindShader("shaders/render_depth_skinned");
   textured_shader_ = world->asset_manager->FindShader("shaders/textured");
 
-  depth_shader_->ReloadIfDirty();
-  depth_skinned_shader_->ReloadIfDirty();
-  textured_shader_->ReloadIfDirty();
+  shader_cache_.Reload(depth_shader_, renderer);
+  shader_cache_.Reload(depth_skinned_shader_, renderer);
+  shader_cache_.Reload(textured_shader_, renderer);
+
+  uniforms_.Refresh(world->asset_manager, &shader_cache_, renderer);
+  instancer_.ResetShaders();
+  render_queue_.ResetShaders(world->asset_manager);
 
   PopDebugMarker();  // ShaderCompile
+}
 
-  world->ResetRenderingDirty();
+void WorldRenderer::LoadShaderVariants() {
+  shader_variants_loaded_ = true;
+  MappedFile manifest;
+  if (!manifest.Open(kShaderVariantsFile)) {
+    fplbase::LogInfo("No %s; shader variants will be compiled when used",
+                     kShaderVariantsFile);
+    return;
+  }
+  const char *line = manifest.data();
+  const char *end = manifest.data() + manifest.size();
+  while (line < end) {
+    const char *line_end = static_cast<const char *>(
+        memchr(line, '\n', static_cast<size_t>(end - line)));
+    if (line_end == nullptr) line_end = end;
+    uint32_t enabled = 0;
+    const char *name = line;
+    while (name < line_end) {
+      const char *name_end = name;
+      while (name_end < line_end && *name_end != ' ' && *name_end != '\r') {
+        name_end++;
+      }
+      const size_t length = static_cast<size_t>(name_end - name);
+      for (int s = 0; s < kNumShaderDefines && length > 0; ++s) {
+        if (strlen(kDefinesText[s]) == length &&
+            strncmp(kDefinesText[s], name, length) == 0) {
+          enabled |= 1u << s;
+        }
+      }
+      name = name_end + 1;
+    }
+    shader_variants_.push_back(enabled);
+    line = line_end + 1;
+  }
 }
 
-void WorldRenderer::CreateShadowMap(const corgi::CameraInterface &camera,
-                                    fplbase::Renderer &renderer, World *world) {
-  PushDebugMarker("CreateShadowMap");
+bool WorldRenderer::PrecompileShaderVariants(World *world,
+                                             fplbase::Renderer &renderer) {
+  if (!shader_variants_loaded_) {
+    LoadShaderVariants();
+    // Without program binaries, the shader cache can't keep what's built.
+    if (!shader_cache_.supported()) shader_variants_.clear();
+  }
+  if (next_shader_variant_ >= shader_variants_.size()) return true;
 
-  PushDebugMarker("Setup");
-  float shadow_map_resolution = static_cast<float>(
-      world->config->rendering_config()->shadow_map_resolution());
+  // One variant per frame, so the loading screen keeps drawing.
+  ApplyShaderDefines(world, renderer, shader_variants_[next_shader_variant_]);
+  next_shader_variant_++;
+  if (next_shader_variant_ < shader_variants_.size()) return false;
+
+  RefreshGlobalShaderDefines(world, renderer);
+  return true;
+}
+
+void WorldRenderer::RegisterUniforms() {
+  const char *shadow = kDefinesText[kShadowEffect];
+  const char *phong = kDefinesText[kPhongShading];
+  uniform_ids_.view_projection =
+      uniforms_.Register(shadow, "view_projection", 16);
+  uniform_ids_.light_view_projection =
+      uniforms_.Register(shadow, "light_view_projection", 16);
+  uniform_ids_.dynamic_light_view_projection =
+      uniforms_.Register(shadow, "dynamic_light_view_projection", 16);
+  uniform_ids_.shadow_cascades =
+      uniforms_.Register(shadow, "shadow_cascades", 1);
+  uniform_ids_.river_offset = uniforms_.Register("WATER", "river_offset", 1);
+  uniform_ids_.texture_repeats =
+      uniforms_.Register("WATER", "texture_repeats", 1);
+  uniform_ids_.shadow_intensity =
+      uniforms_.Register(phong, "shadow_intensity", 1);
+  uniform_ids_.ambient_material =
+      uniforms_.Register(phong, "ambient_material", 4);
+  uniform_ids_.diffuse_material =
+      uniforms_.Register(phong, "diffuse_material", 4);
+  uniform_ids_.specular_material =
+      uniforms_.Register(phong, "specular_material", 4);
+  uniform_ids_.shininess = uniforms_.Register(phong, "shininess", 1);
+  uniform_ids_.fog_roll_in_dist =
+      uniforms_.Register("FOG_EFFECT", "fog_roll_in_dist", 1);
+  uniform_ids_.fog_max_dist =
+      uniforms_.Register("FOG_EFFECT", "fog_max_dist", 1);
+  uniform_ids_.fog_color = uniforms_.Register("FOG_EFFECT", "fog_color", 4);
+  uniform_ids_.fog_max_saturation =
+      uniforms_.Register("FOG_EFFECT", "fog_max_saturation", 1);
+}
+
+// The ends of the edges of `camera`'s view, between `near_depth` and
+// `far_depth` in front of it, or where they meet the ground if that's nearer.
+// Fills `corners` with 8 points.
+static void ViewCorners(const corgi::CameraInterface &camera, float near_depth,
+                        float far_depth, vec3 *corners) {
+  const vec3 position = camera.position();
+  const vec3 facing = camera.facing().Normalized();
+  const vec3 right = vec3::CrossProduct(facing, camera.up()).Normalized();
+  const vec3 up = vec3::CrossProduct(right, facing);
+  const float tan_y = std::tan(camera.viewport_angle() * 0.5f);
+  const vec2 resolution = camera.viewport_resolution();
+  const float tan_x =
+      resolution.y > 0.0f ? tan_y * resolution.x / resolution.y : tan_y;
+
+  for (int i = 0; i < 4; ++i) {
+    // Each edge moves this far for every unit of depth.
+    const vec3 edge = facing + right * (i & 1 ? tan_x : -tan_x) +
+                      up * (i & 2 ? tan_y : -tan_y);
+    float ground_depth = far_depth;
+    if (edge.z < 0.0f && position.z > 0.0f) {
+      ground_depth = std::min(far_depth, -position.z / edge.z);
+    }
+    corners[i] = position + edge * std::min(near_depth, ground_depth);
+    corners[i + 4] = position + edge * ground_depth;
+  }
+}
+
+// Aim `light` at `points`, with a square view just wide enough to see them
+// all, drawn into a map `resolution` texels across. The point it's aimed at
+// on the ground is kept to a grid of about a texel's size, so the map's
+// texels don't crawl across the world as the view moves. Returns that
+// point.
+static vec3 FitLightCamera(const vec3 *points, int count, float resolution,
+                           Camera *light) {
+  const vec3 light_position = light->position();
+  vec3 center = mathfu::kZeros3f;
+  for (int i = 0; i < count; ++i) center += points[i];
+  center /= static_cast<float>(count);
+  vec3 facing = (center - light_position).Normalized();
+
+  float min_cos = 1.0f;
+  for (int i = 0; i < count; ++i) {
+    const vec3 to_point = points[i] - light_position;
+    const float length = to_point.Length();
+    if (length > 0.0f) {
+      min_cos = std::min(min_cos, vec3::DotProduct(to_point, facing) / length);
+    }
+  }
+  // Snapping the focus turns the view by less than one step, so one more
+  // than the points need keeps them in it.
+  const float angle =
+      (std::ceil(2.0f * std::acos(mathfu::Clamp(min_cos, -1.0f, 1.0f)) /
+                 kShadowFitAngleStep) +
+       1.0f) *
+      kShadowFitAngleStep;
+
+  vec3 focus = center;
+  if (facing.z < 0.0f && light_position.z > 0.0f) {
+    focus = light_position + facing * (-light_position.z / facing.z);
+  }
+  const float texel = 2.0f * (focus - light_position).Length() *
+                      std::tan(angle * 0.5f) / resolution;
+  if (texel > 0.0f) {
+    focus.x = std::floor(focus.x / texel + 0.5f) * texel;
+    focus.y = std::floor(focus.y / texel + 0.5f) * texel;
+  }
+  facing = focus - light_position;
+  if (facing.LengthSquared() > 0.0f) light->set_facing(facing.Normalized());
+  light->set_viewport_angle(angle);
+  light->set_viewport_resolution(vec2(resolution, resolution));
+  return focus;
+}
+
+void WorldRenderer::FitLightCameras(const corgi::CameraInterface &camera,
+                                    World *world) {
+  const RenderConfig *config = world->config->rendering_config();
+  const float near_depth = camera.viewport_near_plane();
+  float far_depth = camera.viewport_far_plane();
+  const float fog_depth =
+      RenderCuller::FogHiddenDepth(config, near_depth, far_depth);
+  if (fog_depth > 0.0f) far_depth = std::min(far_depth, fog_depth);
+  if (config->cull_distance() > 0.0f) {
+    far_depth = std::min(far_depth, config->cull_distance());
+  }
+  if (config->shadow_distance() > 0.0f) {
+    far_depth = std::min(far_depth, config->shadow_distance());
+  }
+  far_depth = std::max(far_depth, near_depth);
+
+  const float resolution = static_cast<float>(shadow_map_resolution_);
+  vec3 corners[8];
+  ViewCorners(camera, near_depth, far_depth, corners);
+  if (!ShadowCascades(config)) {
+    light_focus_ = FitLightCamera(corners, 8, resolution, &light_camera_);
+    return;
+  }
+
+  // The far cascade covers the whole view, for wherever the near one doesn't
+  // reach, and the near one just its nearest part.
+  static_light_camera_.set_position(light_camera_.position());
+  static_light_camera_.set_up(light_camera_.up());
+  light_focus_ =
+      FitLightCamera(corners, 8, resolution, &static_light_camera_);
+  const float split_depth =
+      near_depth + (far_depth - near_depth) *
+                       std::min(config->shadow_cascade_split(), 1.0f);
+  ViewCorners(camera, near_depth, split_depth, corners);
+  FitLightCamera(corners, 8,
+                 static_cast<float>(dynamic_shadow_map_resolution_),
+                 &light_camera_);
+}
+
+void WorldRenderer::UpdateLightCamera(const corgi::CameraInterface &camera,
+                                      World *world) {
+  float shadow_map_resolution = static_cast<float>(shadow_map_resolution_);
   float shadow_map_zoom = world->config->rendering_config()->shadow_map_zoom();
   float shadow_map_offset =
       world->config->rendering_config()->shadow_map_offset();
@@ -109,6 +416,10 @@ void WorldRenderer::CreateShadowMap(const corgi::CameraInterface &camera,
       world->entity_manager.GetComponentData<TransformData>(main_light_entity);
   vec3 light_position = light_transform->position;
   SetLightPosition(light_position);
+  if (world->config->rendering_config()->fit_shadows_to_view()) {
+    FitLightCameras(camera, world);
+    return;
+  }
 
   float viewport_angle =
       world->config->rendering_config()->shadow_map_viewport_angle() *
@@ -119,12 +430,125 @@ void WorldRenderer::CreateShadowMap(const corgi::CameraInterface &camera,
   vec3 light_camera_focus =
       camera.position() + camera.facing() * shadow_map_offset;
   light_camera_focus.z = 0;
+  light_focus_ = light_camera_focus;
   vec3 light_facing = light_camera_focus - light_camera_.position();
   light_camera_.set_facing(light_facing.Normalized());
+}
+
+// Copy `camera` into `widened`, with a view `margin` radians wider on every
+// side.
+static void WidenView(const corgi::CameraInterface &camera, float margin,
+                      Camera *widened) {
+  widened->set_position(camera.position());
+  widened->set_facing(camera.facing());
+  widened->set_up(camera.up());
+  widened->set_viewport_angle(camera.viewport_angle() + 2.0f * margin);
+  widened->set_viewport_resolution(camera.viewport_resolution());
+  widened->set_viewport_near_plane(camera.viewport_near_plane());
+  widened->set_viewport_far_plane(camera.viewport_far_plane());
+}
+
+// In Cardboard, the camera may still be turned to the head's latest pose
+// after culling, so cull for a view wide enough to cover the turn. Returns
+// `camera`, or `widened` if it's used.
+static const corgi::CameraInterface &ViewToCull(
+    const corgi::CameraInterface &camera, World *world, Camera *widened) {
+  const float margin =
+      world->rendering_mode() == kRenderingStereoscopic
+          ? world->config->rendering_config()->cardboard_late_latch_margin()
+          : 0.0f;
+  if (margin <= 0.0f) return camera;
+  WidenView(camera, margin, widened);
+  return *widened;
+}
+
+void WorldRenderer::CullForView(const corgi::CameraInterface &camera,
+                                World *world) {
+  Camera widened;
+  const corgi::CameraInterface &view = ViewToCull(camera, world, &widened);
+
+  // Impostors, instanced props and the sorted queue are collected first, and
+  // hidden from the render lists, which draw whatever is left.
+  RenderMeshComponent *render_mesh_component = &world->render_mesh_component;
+  culler_.FitToFog(view);
+  culler_.HideUnseen(render_mesh_component, world->rail_visibility);
+  // Distant props are taken first, so they're not instanced as well.
+  impostors_.Collect(render_mesh_component, view, culler_);
+  // The instanced shaders don't support normal maps.
+  if (world->RenderingOptionEnabled(kNormalMaps)) {
+    instancer_.Clear();
+  } else {
+    instancer_.Collect(render_mesh_component, view, culler_);
+  }
+  render_queue_.Collect(render_mesh_component, view, culler_);
+  culler_.CullForView(render_mesh_component, view);
+  culler_.ShowUnseen(render_mesh_component);
+  render_queue_.ShowCollected(render_mesh_component);
+  instancer_.ShowCollected(render_mesh_component);
+  impostors_.ShowCollected(render_mesh_component);
+}
+
+void WorldRenderer::ClearCollected() {
+  impostors_.Clear();
+  instancer_.Clear();
+  render_queue_.Clear();
+}
+
+void WorldRenderer::ContextLost() { impostors_.ContextLost(); }
+
+void WorldRenderer::PrepareShadows(const corgi::CameraInterface &camera,
+                                   World *world) {
+  UpdateLightCamera(camera, world);
+  RenderMeshComponent *render_mesh_component = &world->render_mesh_component;
+  if (ShadowCascades(world->config->rendering_config())) {
+    culler_.CullForShadows(render_mesh_component, static_light_camera_,
+                           RenderCuller::kAllShadowCasters);
+    shadow_plan_ = kShadowPlanCascades;
+    return;
+  }
+  if (!cache_static_shadows_) {
+    culler_.CullForShadows(render_mesh_component, light_camera_,
+                           RenderCuller::kAllShadowCasters);
+    shadow_plan_ = kShadowPlanAll;
+    return;
+  }
+
+  // The cached map covers less of the view the farther the light's focus
+  // drifts from where it was drawn. It's also stale once a static caster
+  // appears or goes away.
+  const float rebuild_distance =
+      world->config->rendering_config()->static_shadow_rebuild_distance();
+  bool rebuild =
+      !static_shadows_valid_ ||
+      (light_focus_ - static_light_focus_).LengthSquared() >
+          rebuild_distance * rebuild_distance;
+  if (!rebuild) {
+    culler_.CullForShadows(render_mesh_component, light_camera_,
+                           RenderCuller::kDynamicShadowCasters);
+    rebuild = culler_.static_caster_hash() != static_caster_hash_;
+  }
+
+  if (rebuild) {
+    static_light_camera_ = light_camera_;
+    static_light_focus_ = light_focus_;
+    culler_.CullForShadows(render_mesh_component, static_light_camera_,
+                           RenderCuller::kStaticShadowCasters);
+    static_caster_hash_ = culler_.static_caster_hash();
+    static_shadows_valid_ = true;
+    shadow_plan_ = kShadowPlanRebuild;
+  } else {
+    shadow_plan_ = kShadowPlanDynamic;
+  }
+}
 
+void WorldRenderer::RenderShadowCasters(fplbase::RenderTarget &target,
+                                        const corgi::CameraInterface &camera,
+                                        fplbase::Renderer &renderer,
+                                        World *world) {
+  PushDebugMarker("Setup");
   // Shadow map needs to be cleared to near-white, since that's
   // the maximum (furthest) depth.
-  shadow_map_.SetAsRenderTarget();
+  target.SetAsRenderTarget();
   renderer.ClearFrameBuffer(kShadowMapClearColor);
   renderer.SetCulling(fplbase::kCullingModeBack);
 
@@ -136,10 +560,55 @@ void WorldRenderer::CreateShadowMap(const corgi::CameraInterface &camera,
 
   for (int pass = 0; pass < corgi::RenderPass_Count; pass++) {
     PushDebugMarker("RenderPass");
-    world->render_mesh_component.RenderPass(pass, light_camera_, renderer,
+    Profiler::Get().Begin("RenderPass");
+    world->render_mesh_component.RenderPass(pass, camera, renderer,
                                             ShaderIndex_Depth);
+    Profiler::Get().End();
     PopDebugMarker();
   }
+}
+
+void WorldRenderer::CreateShadowMap(fplbase::Renderer &renderer,
+                                    World *world) {
+  PushDebugMarker("CreateShadowMap");
+  ProfileScope scope("CreateShadowMap");
+  GpuTimerScope gpu_scope(&gpu_timer_, "Shadow");
+
+  switch (shadow_plan_) {
+    case kShadowPlanAll:
+      static_light_camera_ = light_camera_;
+      RenderShadowCasters(shadow_map_, light_camera_, renderer, world);
+      // Nothing is drawn into the dynamic map, but the shaders still read it.
+      if (!dynamic_shadow_map_cleared_) {
+        dynamic_shadow_map_.SetAsRenderTarget();
+        renderer.ClearFrameBuffer(kShadowMapClearColor);
+        dynamic_shadow_map_cleared_ = true;
+      }
+      break;
+    case kShadowPlanCascades:
+      PushDebugMarker("Far");
+      RenderShadowCasters(shadow_map_, static_light_camera_, renderer, world);
+      PopDebugMarker();
+      culler_.CullForShadows(&world->render_mesh_component, light_camera_,
+                             RenderCuller::kAllShadowCasters);
+      PushDebugMarker("Near");
+      RenderShadowCasters(dynamic_shadow_map_, light_camera_, renderer, world);
+      PopDebugMarker();
+      dynamic_shadow_map_cleared_ = false;
+      break;
+    case kShadowPlanRebuild:
+      PushDebugMarker("Static");
+      RenderShadowCasters(shadow_map_, static_light_camera_, renderer, world);
+      PopDebugMarker();
+      culler_.CullForShadows(&world->render_mesh_component, light_camera_,
+                             RenderCuller::kDynamicShadowCasters);
+    // Fall through to draw the moving casters.
+    case kShadowPlanDynamic:
+      PushDebugMarker("Dynamic");
+      RenderShadowCasters(dynamic_shadow_map_, light_camera_, renderer, world);
+      PopDebugMarker();
+      break;
+  }
 
   fplbase::RenderTarget::ScreenRenderTarget(renderer).SetAsRenderTarget();
   PopDebugMarker(); // CreateShadowMap
@@ -147,48 +616,106 @@ void WorldRenderer::CreateShadowMap(const corgi::CameraInterface &camera,
 
 void WorldRenderer::RenderPrep(const corgi::CameraInterface &camera,
                                World *world) {
-  world->render_mesh_component.RenderPrep(camera);
+  // The render lists can only hold one camera's view at a time. Build the
+  // shadow map's now, and the main view's after the shadow map is drawn.
+  if (world->RenderingOptionEnabled(kShadowEffect)) {
+    PrepareShadows(camera, world);
+    view_culled_ = false;
+  } else {
+    // The queue records transforms, so record those the frame is drawn with.
+    world->transform_interpolator.Apply(&world->transform_component);
+    CullForView(camera, world);
+    world->transform_interpolator.Restore(&world->transform_component);
+    view_culled_ = true;
+    // The cached shadows may be out of date by the time they're turned on.
+    static_shadows_valid_ = false;
+  }
 }
 
 // Draw the shadow map in the world, so we can see it.
-void WorldRenderer::DebugShowShadowMap(const corgi::CameraInterface &camera,
-                                       fplbase::Renderer &renderer) {
-  fplbase::RenderTarget::ScreenRenderTarget(renderer).SetAsRenderTarget();
+void WorldRenderer::DebugShowShadowMap(SpriteBatch *batch) {
+  // A square a third of the screen's height, in its bottom left corner.
+  const vec2 window_size(batch->window_size());
+  const vec2 size(window_size.y / 3.0f);
+  batch->Add(&shadow_map_, vec2(0.0f, window_size.y - size.y), size,
+             mathfu::kOnes4f);
+}
 
-  static const mat4 kDebugTextureWorldTransform =
-      mat4::FromScaleVector(mathfu::vec3(10.0f, 10.0f, 10.0f));
+bool WorldRenderer::BeginScene(fplbase::Renderer &renderer) {
+  // At full scale the copy would cost a full screen pass for nothing, so draw
+  // straight to the screen.
+  if (!dynamic_resolution_.enabled() || dynamic_resolution_.scale() >= 1.0f) {
+    return false;
+  }
 
-  const mat4 mvp = camera.GetTransformMatrix() * kDebugTextureWorldTransform;
-  const mat4 world_matrix_inverse = kDebugTextureWorldTransform.Inverse();
+  const vec2i window_size = renderer.window_size();
+  if (window_size.x != scene_target_size_.x ||
+      window_size.y != scene_target_size_.y) {
+    if (scene_target_.initialized()) scene_target_.Delete();
+    scene_target_.Initialize(window_size);
+    scene_target_size_ = window_size;
+  }
+  scene_size_ = dynamic_resolution_.ScaledSize(window_size);
+  scene_target_.SetAsRenderTarget();
+  renderer.SetViewport(mathfu::vec4i(0, 0, scene_size_.x, scene_size_.y));
+  return true;
+}
 
-  renderer.set_camera_pos(world_matrix_inverse * camera.position());
-  renderer.set_light_pos(world_matrix_inverse * light_camera_.position());
-  renderer.set_model_view_projection(mvp);
-  renderer.set_color(vec4(1.0f, 1.0f, 1.0f, 1.0f));
+void WorldRenderer::EndScene(fplbase::Renderer &renderer) {
+  fplbase::RenderTarget::ScreenRenderTarget(renderer).SetAsRenderTarget();
+  // Clearing lets tiled GPUs skip loading the old frame.
+  renderer.ClearFrameBuffer(mathfu::kZeros4f);
 
-  shadow_map_.BindAsTexture(0);
+  const vec2 screen_size = vec2(scene_target_size_);
+  renderer.set_model_view_projection(
+      mat4::Ortho(0.0f, screen_size.x, 0.0f, screen_size.y, -1.0f, 1.0f));
+  renderer.set_color(mathfu::kOnes4f);
+  renderer.SetBlendMode(fplbase::kBlendModeOff);
+  renderer.SetDepthFunction(fplbase::kDepthFunctionDisabled);
+  renderer.SetCulling(fplbase::kCullingModeNone);
 
+  scene_target_.BindAsTexture(0);
   textured_shader_->Set(renderer);
 
-  // Render a large quad in the world, with the shadowmap texture on it:
+  // Stretch the scaled part of the target over the whole screen.
+  const vec2 scaled_uv = vec2(scene_size_) / screen_size;
   fplbase::Mesh::RenderAAQuadAlongX(vec3(0.0f, 0.0f, 0.0f),
-                                    vec3(10.0f, 0.0f, 10.0f), vec2(1.0f, 0.0f),
-                                    vec2(0.0f, 1.0f));
+                                    vec3(screen_size.x, screen_size.y, 0.0f),
+                                    vec2(0.0f, 0.0f), scaled_uv);
+
+  renderer.SetDepthFunction(fplbase::kDepthFunctionLess);
+  renderer.SetCulling(fplbase::kCullingModeBack);
+}
+
+void WorldRenderer::FitCameraToFog(World *world, Camera *camera) const {
+  const float near_plane = camera->viewport_near_plane();
+  const float far_plane = camera->viewport_far_plane();
+  const float depth = RenderCuller::FogHiddenDepth(
+      world->config->rendering_config(), near_plane, far_plane);
+  // Pulling the far plane in brings the fog's depth in a little too, so over
+  // a few frames this settles where the two meet.
+  if (depth > near_plane && depth < far_plane) {
+    camera->set_viewport_far_plane(depth);
+  }
+}
+
+vec4 WorldRenderer::ClearColor(World *world) const {
+  const RenderConfig *config = world->config->rendering_config();
+  return config->fog_max_saturation() >= 1.0f
+             ? LoadColorRGBA(config->fog_color())
+             : mathfu::kZeros4f;
 }
 
-void WorldRenderer::SetFogUniforms(fplbase::Shader *shader, World *world) {
-  shader->SetUniform("fog_roll_in_dist",
-                     world->config->rendering_config()->fog_roll_in_dist());
-  shader->SetUniform("fog_max_dist",
-                     world->config->rendering_config()->fog_max_dist());
-  shader->SetUniform(
-      "fog_color",
-      LoadColorRGBA(world->config->rendering_config()->fog_color()));
-  shader->SetUniform("fog_max_saturation",
-                     world->config->rendering_config()->fog_max_saturation());
+void WorldRenderer::SetFogUniforms(World *world) {
+  const RenderConfig *config = world->config->rendering_config();
+  uniforms_.Set(uniform_ids_.fog_roll_in_dist, config->fog_roll_in_dist());
+  uniforms_.Set(uniform_ids_.fog_max_dist, config->fog_max_dist());
+  uniforms_.Set(uniform_ids_.fog_color, LoadColorRGBA(config->fog_color()));
+  uniforms_.Set(uniform_ids_.fog_max_saturation,
+                config->fog_max_saturation());
 }
 
-void WorldRenderer::SetLightingUniforms(fplbase::Shader *shader, World *world) {
+void WorldRenderer::SetLightingUniforms(World *world) {
   LightComponent *light_component =
       world->entity_manager.GetComponent<LightComponent>();
   const EntityRef &main_light_entity = light_component->begin()->entity;
@@ -196,32 +723,39 @@ void WorldRenderer::SetLightingUniforms(fplbase::Shader *shader, World *world) {
       world->entity_manager.GetComponentData<LightData>(main_light_entity);
 
   if (world->RenderingOptionEnabled(kShadowEffect)) {
-    shader->SetUniform("shadow_intensity", light_data->shadow_intensity);
-  }
-  shader->SetUniform("ambient_material",
-                     light_data->ambient_color * light_data->ambient_intensity);
-  shader->SetUniform("diffuse_material",
-                     light_data->diffuse_color * light_data->diffuse_intensity);
-  shader->SetUniform("specular_material", light_data->specular_color *
-                                              light_data->specular_intensity);
-  shader->SetUniform("shininess", light_data->specular_exponent);
+    uniforms_.Set(uniform_ids_.shadow_intensity, light_data->shadow_intensity);
+  }
+  uniforms_.Set(uniform_ids_.ambient_material,
+                light_data->ambient_color * light_data->ambient_intensity);
+  uniforms_.Set(uniform_ids_.diffuse_material,
+                light_data->diffuse_color * light_data->diffuse_intensity);
+  uniforms_.Set(uniform_ids_.specular_material,
+                light_data->specular_color * light_data->specular_intensity);
+  uniforms_.Set(uniform_ids_.shininess, light_data->specular_exponent);
 }
 
 void WorldRenderer::RenderShadowMap(const corgi::CameraInterface &camera,
                                     fplbase::Renderer &renderer, World *world) {
   PushDebugMarker("Render ShadowMap");
+  ProfileScope scope("Render ShadowMap");
 
   PushDebugMarker("Scene Setup");
   if (world->RenderingOptionsDirty()) {
-    RefreshGlobalShaderDefines(world);
+    RefreshGlobalShaderDefines(world, renderer);
   }
 
   float shadow_map_bias = world->config->rendering_config()->shadow_map_bias();
   depth_shader_->SetUniform("bias", shadow_map_bias);
   depth_skinned_shader_->SetUniform("bias", shadow_map_bias);
+
+  // Shadows were turned on after RenderPrep() culled for the main view.
+  if (view_culled_) {
+    PrepareShadows(camera, world);
+    view_culled_ = false;
+  }
   PopDebugMarker(); // Scene Setup
 
-  CreateShadowMap(camera, renderer, world);
+  CreateShadowMap(renderer, world);
 
   PopDebugMarker(); // Render ShadowMap
 }
@@ -229,10 +763,11 @@ void WorldRenderer::RenderShadowMap(const corgi::CameraInterface &camera,
 void WorldRenderer::RenderWorld(const corgi::CameraInterface &camera,
                                 fplbase::Renderer &renderer, World *world) {
   PushDebugMarker("Render World");
+  ProfileScope scope("Render World");
 
   PushDebugMarker("Scene Setup");
   if (world->RenderingOptionsDirty()) {
-    RefreshGlobalShaderDefines(world);
+    RefreshGlobalShaderDefines(world, renderer);
   }
 
   mat4 camera_transform = camera.GetTransformMatrix();
@@ -245,47 +780,89 @@ void WorldRenderer::RenderWorld(const corgi::CameraInterface &camera,
   float river_offset = world->river_component.river_offset();
 
   if (world->RenderingOptionEnabled(kShadowEffect)) {
-    world->asset_manager->ForEachShaderWithDefine(
-        kDefinesText[kShadowEffect], [&](fplbase::Shader *shader) {
-          shader->SetUniform("view_projection", camera_transform);
-          shader->SetUniform("light_view_projection",
-                             light_camera_.GetTransformMatrix());
-        });
+    uniforms_.Set(uniform_ids_.view_projection, camera_transform);
+    uniforms_.Set(uniform_ids_.light_view_projection,
+                  static_light_camera_.GetTransformMatrix());
+    uniforms_.Set(uniform_ids_.dynamic_light_view_projection,
+                  light_camera_.GetTransformMatrix());
+    uniforms_.Set(uniform_ids_.shadow_cascades,
+                  shadow_plan_ == kShadowPlanCascades ? 1.0f : 0.0f);
   }
-
-  world->asset_manager->ForEachShaderWithDefine(
-      "WATER", [&](fplbase::Shader *shader) {
-        shader->SetUniform("river_offset", river_offset);
-        shader->SetUniform("texture_repeats", texture_repeats);
-      });
-
-  world->asset_manager->ForEachShaderWithDefine(
-      kDefinesText[kPhongShading],
-      [&](fplbase::Shader *shader) { SetLightingUniforms(shader, world); });
-
-  world->asset_manager->ForEachShaderWithDefine(
-      "FOG_EFFECT",
-      [&](fplbase::Shader *shader) { SetFogUniforms(shader, world); });
+  uniforms_.Set(uniform_ids_.river_offset, river_offset);
+  uniforms_.Set(uniform_ids_.texture_repeats, texture_repeats);
+  SetLightingUniforms(world);
+  SetFogUniforms(world);
+  // Only the values that changed since the last frame are sent.
+  uniforms_.Apply();
 
   shadow_map_.BindAsTexture(kShadowMapTextureID);
+  dynamic_shadow_map_.BindAsTexture(kDynamicShadowMapTextureID);
   PopDebugMarker(); // Scene Setup
 
+  if (!view_culled_) {
+    CullForView(camera, world);
+    view_culled_ = true;
+  }
+
+  if (!world->skip_rendermesh_rendering && render_queue_.HasDepthPrepass()) {
+    PushDebugMarker("DepthPrepass");
+    Profiler::Get().Begin("DepthPrepass");
+    gpu_timer_.Begin("DepthPrepass");
+    GL_CALL(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+    render_queue_.RenderDepth(camera, renderer);
+    GL_CALL(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+    gpu_timer_.End();
+    Profiler::Get().End();
+    PopDebugMarker();
+  }
+
   if (!world->skip_rendermesh_rendering) {
     for (int pass = 0; pass < corgi::RenderPass_Count; pass++) {
       PushDebugMarker("RenderPass");
+      Profiler::Get().Begin("RenderPass");
+      gpu_timer_.Begin(GpuPassName(pass));
+      // The sorted meshes go first, as they hold most of the occluders.
+      render_queue_.Render(pass, camera, renderer, kMeshLightPosition);
+      if (pass == corgi::RenderPass_Opaque) {
+        instancer_.Render(camera, renderer, kMeshLightPosition);
+        impostors_.Render(camera, renderer);
+      }
       world->render_mesh_component.RenderPass(pass, camera, renderer);
+      gpu_timer_.End();
+      Profiler::Get().End();
       PopDebugMarker();
     }
   }
 
+  PushDebugMarker("Particles");
+  Profiler::Get().Begin("Particles");
+  gpu_timer_.Begin("Particles");
+  world->particle_emitter_component.Render(camera, renderer);
+  gpu_timer_.End();
+  Profiler::Get().End();
+  PopDebugMarker();
+
   if (world->draw_debug_physics) {
     PushDebugMarker("Debug Draw World");
-    world->physics_component.DebugDrawWorld(&renderer, camera_transform);
+    // Bullet hands over one line at a time, so they're batched, and only
+    // what the view can show is kept.
+    btDiscreteDynamicsWorld *bullet_world =
+        world->physics_component.bullet_world();
+    btIDebugDraw *debug_drawer = bullet_world->getDebugDrawer();
+    debug_draw_.Begin(camera, culler_.view_cull_distance());
+    bullet_world->setDebugDrawer(&debug_draw_);
+    bullet_world->debugDrawWorld();
+    bullet_world->setDebugDrawer(debug_drawer);
+    debug_draw_.Render(camera, renderer);
     PopDebugMarker();
   }
 
   PushDebugMarker("Text");
+  Profiler::Get().Begin("Text");
+  gpu_timer_.Begin("Text");
   world->render_3d_text_component.RenderAllEntities(camera);
+  gpu_timer_.End();
+  Profiler::Get().End();
   PopDebugMarker();
 
   PopDebugMarker(); // Render World
@@ -15,6 +15,16 @@
 #ifndef ZOOSHI_WORLD_RENDERER_H_
 #define ZOOSHI_WORLD_RENDERER_H_
 
+#include "debug_draw_batch.h"
+#include "dynamic_resolution.h"
+#include "gpu_timer.h"
+#include "impostor_renderer.h"
+#include "prop_instancer.h"
+#include "render_culler.h"
+#include "render_queue.h"
+#include "shader_cache.h"
+#include "shader_uniforms.h"
+#include "sprite_batch.h"
 #include "world.h"
 
 namespace fpl {
@@ -26,28 +36,63 @@ struct World;
 class WorldRenderer {
  public:
   // Initialize the world renderer.  Must be called before any other functions.
-  void Initialize(World* world);
+  void Initialize(World* world, fplbase::Renderer& renderer);
 
   // Refresh global shader defines with current rendering options.
-  void RefreshGlobalShaderDefines(World* world);
+  void RefreshGlobalShaderDefines(World* world, fplbase::Renderer& renderer);
+
+  // Build the shaders with the next set of defines in the variant manifest
+  // written by build_assets.py, so the shader cache holds their programs and
+  // changing rendering options later restores them rather than compiling.
+  // Call once per frame while loading, after the shaders have loaded. Returns
+  // true once every variant has been built and the world's defines restored.
+  bool PrecompileShaderVariants(World* world, fplbase::Renderer& renderer);
 
   // Call this before you call RenderWorld - it takes care of clearing
-  // the frame, setting up the shadowmap, etc.
+  // the frame, setting up the shadowmap, etc. Culls for the shadow map if
+  // shadows are on, and otherwise for `camera`. The main view is then culled
+  // once the shadow map has been drawn. Makes no GL calls, so it runs on the
+  // update thread.
   void RenderPrep(const corgi::CameraInterface& camera,
                   World* world);
 
+  // Forget what was collected for the main view, so the sorted, instanced
+  // and impostor meshes aren't drawn this frame. Call if their meshes may
+  // have been deleted.
+  void ClearCollected();
+
+  // Forget the GL objects made in a context that was lost, without deleting
+  // them. Call on the render thread before anything else is drawn.
+  void ContextLost();
+
+  // Drop anything kept for `mesh`, which is about to be deleted. Call on the
+  // render thread.
+  void ReleaseMesh(const fplbase::Mesh* mesh) { impostors_.ReleaseMesh(mesh); }
+
   // Render the shadowmap from the current camera.
   void RenderShadowMap(const corgi::CameraInterface& camera,
                        fplbase::Renderer& renderer, World* world);
 
+  // Pull `camera`'s far plane in to where fully saturated fog hides
+  // everything, so nothing past it is drawn. Call before culling for it.
+  void FitCameraToFog(World* world, Camera* camera) const;
+
+  // What the scene is cleared to. The fog color when it saturates, so what
+  // the far plane clips still looks fogged.
+  mathfu::vec4 ClearColor(World* world) const;
+
   // Render the world, viewed from the current camera.
   void RenderWorld(const corgi::CameraInterface& camera,
                    fplbase::Renderer& renderer,
                    World* world);
 
-  // Render the shadowmap into the world as a billboard, for debugging.
-  void DebugShowShadowMap(const corgi::CameraInterface& camera,
-                          fplbase::Renderer& renderer);
+  // Queue the shadowmap in the corner of the screen, for debugging.
+  void DebugShowShadowMap(SpriteBatch* batch);
+
+  // Draw the shadow maps at `scale` times the configured resolutions. The
+  // maps are reallocated, and cached static shadows redrawn, when the
+  // resolution changes.
+  void SetShadowMapScale(World* world, float scale);
 
   // Sets the position of the light source in the world.  (Where the light is
   // located when generating shdaow maps, etc.)
@@ -55,21 +100,143 @@ class WorldRenderer {
     light_camera_.set_position(light_pos);
   }
 
+  // Times the shadow map, each render pass and the 3D text on the GPU.
+  GpuTimer& gpu_timer() { return gpu_timer_; }
+
+  // Picks the resolution RenderWorld() draws at, between BeginScene() and
+  // EndScene().
+  DynamicResolution& dynamic_resolution() { return dynamic_resolution_; }
+
+  // If dynamic resolution has scaled the world down, direct rendering into an
+  // offscreen target at the current scale, and return true. EndScene() must
+  // then be called to draw the target over the screen. At full scale, return
+  // false and leave rendering on the screen. Call after RenderShadowMap().
+  bool BeginScene(fplbase::Renderer& renderer);
+  void EndScene(fplbase::Renderer& renderer);
+
  private:
+  // What CreateShadowMap() draws this frame.
+  enum ShadowPlan {
+    // Every caster into shadow_map_. Used when static shadows aren't cached.
+    kShadowPlanAll,
+    // Static casters into shadow_map_, then moving ones into
+    // dynamic_shadow_map_.
+    kShadowPlanRebuild,
+    // Only moving casters into dynamic_shadow_map_, reusing shadow_map_.
+    kShadowPlanDynamic,
+    // Every caster into shadow_map_ for the whole view, from
+    // static_light_camera_, then again into dynamic_shadow_map_ for its
+    // nearest part, from light_camera_.
+    kShadowPlanCascades
+  };
+
+  // The uniforms RenderWorld() sets on every shader that uses them.
+  struct UniformIds {
+    ShaderUniforms::UniformId view_projection;
+    ShaderUniforms::UniformId light_view_projection;
+    ShaderUniforms::UniformId dynamic_light_view_projection;
+    ShaderUniforms::UniformId shadow_cascades;
+    ShaderUniforms::UniformId river_offset;
+    ShaderUniforms::UniformId texture_repeats;
+    ShaderUniforms::UniformId shadow_intensity;
+    ShaderUniforms::UniformId ambient_material;
+    ShaderUniforms::UniformId diffuse_material;
+    ShaderUniforms::UniformId specular_material;
+    ShaderUniforms::UniformId shininess;
+    ShaderUniforms::UniformId fog_roll_in_dist;
+    ShaderUniforms::UniformId fog_max_dist;
+    ShaderUniforms::UniformId fog_color;
+    ShaderUniforms::UniformId fog_max_saturation;
+  };
+
   fplbase::Shader* depth_shader_;
   fplbase::Shader* depth_skinned_shader_;
   fplbase::Shader* textured_shader_;
   Camera light_camera_;
   fplbase::RenderTarget shadow_map_;
+  // The width and height of shadow_map_, in texels.
+  int shadow_map_resolution_;
+  float shadow_map_scale_;
+  GpuTimer gpu_timer_;
+  RenderCuller culler_;
+  // True once the render lists hold the main view.
+  bool view_culled_;
+
+  // With cached static shadows, shadow_map_ holds the static casters as seen
+  // by static_light_camera_ when it was last drawn, and dynamic_shadow_map_
+  // the moving ones from light_camera_. Without, dynamic_shadow_map_ is left
+  // empty, unless it holds the near cascade.
+  fplbase::RenderTarget dynamic_shadow_map_;
+  int dynamic_shadow_map_resolution_;
+  Camera static_light_camera_;
+  bool cache_static_shadows_;
+  bool static_shadows_valid_;
+  bool dynamic_shadow_map_cleared_;
+  uint64_t static_caster_hash_;
+  mathfu::vec3 light_focus_;
+  mathfu::vec3 static_light_focus_;
+  ShadowPlan shadow_plan_;
+  ShaderUniforms uniforms_;
+  ShaderCache shader_cache_;
+  UniformIds uniform_ids_;
+  PropInstancer instancer_;
+  ImpostorRenderer impostors_;
+  DebugDrawBatch debug_draw_;
+  RenderQueue render_queue_;
+
+  // The sets of defines, as ApplyShaderDefines() takes them, that
+  // PrecompileShaderVariants() builds, and the next one it will.
+  std::vector<uint32_t> shader_variants_;
+  size_t next_shader_variant_;
+  bool shader_variants_loaded_;
+
+  // The world is drawn into the bottom left `scene_size_` of `scene_target_`
+  // while scaled. The target is as big as the screen, so changing the scale
+  // never reallocates it.
+  DynamicResolution dynamic_resolution_;
+  fplbase::RenderTarget scene_target_;
+  mathfu::vec2i scene_target_size_;
+  mathfu::vec2i scene_size_;
+
+  // Point the light's camera at the part of the world `camera` sees.
+  void UpdateLightCamera(const corgi::CameraInterface& camera, World* world);
+
+  // Fit the light's cameras to what `camera` sees of the world, out to the
+  // shadow distance. Sets light_focus_ to where they're aimed.
+  void FitLightCameras(const corgi::CameraInterface& camera, World* world);
+
+  // Build the render lists for drawing the world from `camera`, with distant
+  // props drawn as impostors, repeated props grouped for instancing, and
+  // other opaque meshes recorded into `render_queue_`, sorted.
+  void CullForView(const corgi::CameraInterface& camera, World* world);
+
+  // Decide what the shadow maps need this frame, and cull for the first one
+  // to be drawn.
+  void PrepareShadows(const corgi::CameraInterface& camera, World* world);
+
+  // Draw whatever is in the render lists into `target`, as seen by `camera`.
+  void RenderShadowCasters(fplbase::RenderTarget& target,
+                           const corgi::CameraInterface& camera,
+                           fplbase::Renderer& renderer, World* world);
 
   // Create the shadowmap for the current worldstate.  Needs to be called
   // before RenderWorld.
-  void CreateShadowMap(const corgi::CameraInterface& camera,
-                       fplbase::Renderer& renderer, World* world);
+  void CreateShadowMap(fplbase::Renderer& renderer, World* world);
+
+  // Add the uniforms in UniformIds to `uniforms_`.
+  void RegisterUniforms();
+
+  // Reload the shaders with the defines whose bit is set in `enabled`
+  // (1 << ShaderDefines), and every other define omitted.
+  void ApplyShaderDefines(World* world, fplbase::Renderer& renderer,
+                          uint32_t enabled);
+
+  // Read the variant manifest into `shader_variants_`.
+  void LoadShaderVariants();
 
-  void SetFogUniforms(fplbase::Shader* shader, World* world);
+  void SetFogUniforms(World* world);
 
-  void SetLightingUniforms(fplbase::Shader* shader, World* world);
+  void SetLightingUniforms(World* world);
 };
 
 }  // zooshi
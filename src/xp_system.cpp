@@ -14,39 +14,41 @@
 
 #include "xp_system.h"
 
-#include <fplbase/utilities.h>
+#include "fplbase/utilities.h"
 
 namespace fpl {
 namespace zooshi {
 
 const char* kCurrentXPKey = "zooshi.current_xp";
 
-void XpSystem::Initialize(const Config* config) {
+void XpSystem::Initialize(const Config* config, SaveStore* save_store) {
   config_ = config;
+  save_store_ = save_store;
   xp_for_reward_ = config->xp_for_reward();
-  current_xp_ = fplbase::LoadPreference(kCurrentXPKey, 0);
+  current_xp_ = save_store_->GetValue(kCurrentXPKey, 0);
 }
 
 int XpSystem::ApplyBonuses(int base_xp, bool consume_bonuses) {
   // Apply the bonuses in the order of the enum.
   for (int i = BonusApplyType_Multiply; i < BonusApplyType_Size; ++i) {
-    for (auto it = bonuses[i].begin(); it != bonuses[i].end();) {
+    for (int j = 0; j < num_bonuses_[i];) {
+      BonusData& bonus = bonuses_[i][j];
       switch (i) {
         case BonusApplyType_Multiply:
-          base_xp = static_cast<int>(static_cast<float>(base_xp) * it->value);
+          base_xp = static_cast<int>(static_cast<float>(base_xp) * bonus.value);
           break;
         case BonusApplyType_Addition:
-          base_xp += static_cast<int>(it->value);
+          base_xp += static_cast<int>(bonus.value);
           break;
         default:
           break;
       }
       // If after consuming the bonus the apply count is finished, remove the
       // bonus from the list.
-      if (consume_bonuses && --(it->apply_count) == 0) {
-        it = bonuses[i].erase(it);
+      if (consume_bonuses && --bonus.apply_count == 0) {
+        RemoveBonus(i, j);
       } else {
-        ++it;
+        ++j;
       }
     }
   }
@@ -61,7 +63,7 @@ bool XpSystem::GrantXP(int xp) {
     current_xp_ %= xp_for_reward_;
     earned_reward = true;
   }
-  fplbase::SavePreference(kCurrentXPKey, current_xp_);
+  save_store_->SetValue(kCurrentXPKey, current_xp_);
   return earned_reward;
 }
 
@@ -71,11 +73,26 @@ void XpSystem::AddBonus(BonusApplyType type, float value, int apply_count,
   if (unique_key != XpSystem::kNonUniqueKey) {
     // If a unique key is provided, remove any similar typed bonus with the same
     // key first.
-    bonuses[type].remove_if([unique_key](const BonusData& data) {
-      return data.unique_key == unique_key;
-    });
+    for (int i = num_bonuses_[type] - 1; i >= 0; --i) {
+      if (bonuses_[type][i].unique_key == unique_key) RemoveBonus(type, i);
+    }
+  }
+  if (num_bonuses_[type] == kMaxBonuses) {
+    fplbase::LogInfo("Too many xp bonuses, dropping the oldest.");
+    RemoveBonus(type, 0);
+  }
+  BonusData& bonus = bonuses_[type][num_bonuses_[type]++];
+  bonus.value = value;
+  bonus.apply_count = apply_count;
+  bonus.unique_key = unique_key;
+}
+
+void XpSystem::RemoveBonus(int type, int index) {
+  BonusData* bonuses = bonuses_[type];
+  for (int i = index + 1; i < num_bonuses_[type]; ++i) {
+    bonuses[i - 1] = bonuses[i];
   }
-  bonuses[type].push_back(BonusData(value, apply_count, unique_key));
+  num_bonuses_[type]--;
 }
 
 }  // zooshi
@@ -16,8 +16,7 @@
 #define ZOOSHI_XP_SYSTEM_H_
 
 #include "config_generated.h"
-
-#include <list>
+#include "save_store.h"
 
 namespace fpl {
 namespace zooshi {
@@ -30,7 +29,12 @@ enum BonusApplyType {
 
 class XpSystem {
  public:
-  void Initialize(const Config* config);
+  XpSystem() : config_(nullptr), save_store_(nullptr) {
+    for (int i = 0; i < BonusApplyType_Size; ++i) num_bonuses_[i] = 0;
+  }
+
+  // The player's xp is kept in `save_store`.
+  void Initialize(const Config* config, SaveStore* save_store);
 
   // Applies the tracked bonuses to the given xp value. If consume_bonuses is
   // true, this will consume one application of the bonuses.
@@ -43,7 +47,8 @@ class XpSystem {
   // is not tracked.
   bool GrantXP(int xp);
 
-  // Adds a bonus to be applied when calculating earned xp.
+  // Adds a bonus to be applied when calculating earned xp. There's room for
+  // kMaxBonuses of each type; past that, the oldest is dropped.
   // @param type How the bonus modifies the xp.
   // @param value The value to modify with.
   // @param apply_count The number of times to apply the bonus.
@@ -61,20 +66,27 @@ class XpSystem {
 
   static const int kNonUniqueKey = UniqueBonusId_NonUnique;
 
+  // Bonuses come from messages and rewarded videos, so only a few are ever
+  // pending at once.
+  static const int kMaxBonuses = 8;
+
  private:
   struct BonusData {
-    BonusData(float value_, int apply_count_, int unique_key_)
-        : value(value_), apply_count(apply_count_), unique_key(unique_key_) {}
-
     float value;
     int apply_count;
     int unique_key;
   };
 
+  // Remove the bonus at `index` of `type`, keeping the rest in order.
+  void RemoveBonus(int type, int index);
+
   const Config* config_;
+  SaveStore* save_store_;
   int xp_for_reward_;
   int current_xp_;
-  std::list<BonusData> bonuses[BonusApplyType_Size];
+  // Each type's bonuses, in the order they're applied.
+  BonusData bonuses_[BonusApplyType_Size][kMaxBonuses];
+  int num_bonuses_[BonusApplyType_Size];
 };
 
 }  // zooshi